@@ -8,7 +8,7 @@ namespace NEO {
 	DWORD* g_pMvaArena = NULL;		//initialized by sphArenaInit()
 
 								   // global mega-arena
-	static CSphArena g_tMvaArena;
+	CSphArena g_tMvaArena;
 
 	const char* sphArenaInit(int iMaxBytes)
 	{
@@ -533,6 +533,153 @@ namespace NEO {
 		}
 	}
 
+	void CSphArena::UnlinkPage(int iPage)
+	{
+		PageDesc_t* pPage = m_pPages + iPage;
+		int iSizeSlot = pPage->m_iSizeBits ? pPage->m_iSizeBits - MIN_BITS + 1 : 0;
+
+		if (pPage->m_iPrev >= 0)
+		{
+			assert(m_pPages[pPage->m_iPrev].m_iNext == iPage);
+			m_pPages[pPage->m_iPrev].m_iNext = pPage->m_iNext;
+		}
+		else
+		{
+			assert(m_pFreelistHeads[iSizeSlot] == iPage);
+			m_pFreelistHeads[iSizeSlot] = pPage->m_iNext;
+		}
+
+		if (pPage->m_iNext >= 0)
+		{
+			assert(m_pPages[pPage->m_iNext].m_iPrev == iPage);
+			m_pPages[pPage->m_iNext].m_iPrev = pPage->m_iPrev;
+		}
+
+		pPage->m_iPrev = -1;
+		pPage->m_iNext = -1;
+	}
+
+
+	bool CSphArena::DrainPage(int iPage, int iTag, tRelocator* pRelocator)
+	{
+		PageDesc_t* pPage = m_pPages + iPage;
+		int iSizeBits = pPage->m_iSizeBits;
+		int iSlots = PAGE_SIZE >> iSizeBits;
+		int iFirst = 2 + iPage * PAGE_SIZE / sizeof(DWORD);
+		int iStride = (1 << iSizeBits) / sizeof(DWORD);
+
+		// only drain pages that are fully ours; tag logs and foreign allocs stay put
+		for (int i = 0; i < iSlots; i++)
+			if ((pPage->m_uBitmap[i >> 5] & (1UL << (i & 31))) && m_pBasePtr[iFirst + i * iStride - 1] != DWORD(iTag))
+				return false;
+
+		// keep RawAlloc() off the page we are draining
+		UnlinkPage(iPage);
+
+		int iPayload = (1 << iSizeBits) - 2 * sizeof(int); // NOLINT
+		for (int i = 0; i < iSlots; i++)
+		{
+			if (!(pPage->m_uBitmap[i >> 5] & (1UL << (i & 31))))
+				continue;
+
+			int iOld = iFirst + i * iStride;
+			int iNew = RawAlloc(iPayload);
+			assert(iNew >= 0 && "internal error, no room to drain a page");
+			assert(m_pPages[(iNew - 2) * sizeof(DWORD) / PAGE_SIZE].m_iSizeBits == iSizeBits);
+
+			memcpy(m_pBasePtr + iNew, m_pBasePtr + iOld, iPayload);
+
+			// tag it and repoint its log entry
+			int iLogEntry = m_pBasePtr[iOld - 2];
+			m_pBasePtr[iNew - 1] = iTag;
+			m_pBasePtr[iNew - 2] = iLogEntry;
+			AllocsLogEntry_t* pLog = (AllocsLogEntry_t*)(m_pBasePtr + iLogEntry);
+			for (int j = 0; j < pLog->m_iUsed; j++)
+				if (pLog->m_dEntries[j] == iOld)
+				{
+					pLog->m_dEntries[j] = iNew;
+					break;
+				}
+
+			m_pBasePtr[iOld - 1] = DWORD(-1);
+			m_pBasePtr[iOld - 2] = DWORD(-1);
+			pRelocator->Relocate(iOld, iNew);
+
+#if ARENADEBUG
+			(*m_pTotalAllocs)--;
+			(*m_pTotalBytes) -= (1 << iSizeBits);
+#endif
+		}
+
+		// page is empty now, hand it back
+		pPage->m_iUsed = 0;
+		pPage->m_iSizeBits = 0;
+		pPage->m_iNext = m_pFreelistHeads[0];
+		if (pPage->m_iNext >= 0)
+			m_pPages[pPage->m_iNext].m_iPrev = iPage;
+		m_pFreelistHeads[0] = iPage;
+
+		CheckFreelists();
+		return true;
+	}
+
+
+	int CSphArena::TaggedCompact(int iTag, tRelocator* pRelocator)
+	{
+		if (!m_iPages || !pRelocator)
+			return 0;
+
+		assert(iTag >= 0);
+		CSphScopedLock<CSphMutex> tThdLock(m_tThdMutex);
+
+		TagDesc_t* pTag = sphBinarySearch(m_pTags, m_pTags + (*m_pTagCount) - 1, bind(&TagDesc_t::m_iTag), iTag);
+		if (!pTag)
+			return 0;
+
+		int iReleased = 0;
+		CSphVector<int64_t> dPages;
+		for (int iSizeSlot = 1; iSizeSlot < NUM_SIZES; iSizeSlot++)
+		{
+			int iSlots = PAGE_ALLOCS >> (iSizeSlot - 1);
+			if (iSlots < 4)
+				continue; // a couple of big allocs per page, nothing to win
+
+			// sparse semi-free pages of this size (keyed by usage, so that the sparsest go first), and total free slots
+			dPages.Resize(0);
+			int iFree = 0;
+			for (int iPage = m_pFreelistHeads[iSizeSlot]; iPage >= 0; iPage = m_pPages[iPage].m_iNext)
+			{
+				iFree += iSlots - m_pPages[iPage].m_iUsed;
+				if (m_pPages[iPage].m_iUsed <= iSlots / 4)
+					dPages.Add((int64_t(m_pPages[iPage].m_iUsed) << 32) | iPage);
+			}
+			dPages.Sort();
+
+			ARRAY_FOREACH(i, dPages)
+			{
+				int iPage = int(dPages[i] & 0xffffffff);
+				const PageDesc_t& tPage = m_pPages[iPage];
+
+				// we might have filled it up while draining the others
+				if (tPage.m_iSizeBits != iSizeSlot + MIN_BITS - 1 || tPage.m_iUsed > iSlots / 4)
+					continue;
+
+				// its allocs must fit into the free slots of the other semi-free pages
+				if (iFree < iSlots)
+					break;
+
+				if (!DrainPage(iPage, iTag, pRelocator))
+					continue;
+
+				iFree -= iSlots;
+				iReleased++;
+			}
+		}
+
+		return iReleased;
+	}
+
+
 	void CSphArena::RemoveTag(TagDesc_t* pTag)
 	{
 		assert(pTag);
@@ -21,6 +21,15 @@ namespace NEO {
 	};
 
 
+	/// notified when an allocation is moved by the arena compaction
+	class tRelocator : public ISphNoncopyable
+	{
+	public:
+		virtual void Relocate(int iOldIndex, int iNewIndex) = 0;
+		virtual ~tRelocator() {}
+	};
+
+
 	/// shared-memory arena allocator
 	/// manages small tagged dword strings, upto 4096 bytes in size
 	class CSphArena
@@ -38,6 +47,10 @@ namespace NEO {
 
 		void					ExamineTag(tTester* pTest, int iTag);
 
+		/// move allocs of a given tag off sparse pages, returns the number of pages released
+		/// only pages that hold nothing but that tag are drained; the relocator must patch all references
+		int						TaggedCompact(int iTag, tRelocator* pRelocator);
+
 	protected:
 		static const int		MIN_BITS = 4;
 		static const int		MAX_BITS = 12;
@@ -82,6 +95,8 @@ namespace NEO {
 		int						RawAlloc(int iBytes);
 		void					RawFree(int iIndex);
 		void					RemoveTag(TagDesc_t* pTag);
+		void					UnlinkPage(int iPage);
+		bool					DrainPage(int iPage, int iTag, tRelocator* pRelocator);
 
 	protected:
 		CSphMutex				m_tThdMutex;
@@ -16,6 +16,7 @@ namespace NEO {
 			, m_uKillListSize(0)
 			, m_iMinMaxIndex(0)
 			, m_iTotalDups(0)
+			, m_uStringDictEnd(0)
 		{
 			m_iTotalDocuments = tStat.m_iTotalDocuments;
 			m_iTotalBytes = tStat.m_iTotalBytes;
@@ -28,6 +29,7 @@ namespace NEO {
 		DWORD				m_uKillListSize;
 		int64_t				m_iMinMaxIndex;
 		int					m_iTotalDups;
+		DWORD				m_uStringDictEnd;	///< string attribute dictionary end offset (0 if none)
 	};
 
 }
\ No newline at end of file
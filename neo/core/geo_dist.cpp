@@ -49,6 +49,78 @@ namespace NEO {
 	}
 
 
+	/// sphere radius that underestimates every distance model we have (haversine at 6371 or 6384 km, flat ellipsoid)
+	static const double GEO_BOUND_RADIUS = 6356000.0;
+
+	/// extra slack for approximate (adaptive) distances
+	static const double GEO_BOUND_SLACK_EXACT = 0.999;
+	static const double GEO_BOUND_SLACK_APPROX = 0.9;
+
+	static const double GEO_PI = 3.14159265358979323846;
+
+
+	static inline double GeoLonDiff(double fA, double fB)
+	{
+		double fDiff = fmod(fabs(fA - fB), 2 * GEO_PI);
+		return fDiff > GEO_PI ? 2 * GEO_PI - fDiff : fDiff;
+	}
+
+
+	float sphGeodistLowerBound(const GeodistInfo_t& tGeo, float fLatMin, float fLatMax, float fLonMin, float fLonMax)
+	{
+		const double fScale = tGeo.m_bDeg ? GEO_PI / 180.0 : 1.0;
+		double fLat = tGeo.m_fAnchorLat * fScale;
+		double fLon = tGeo.m_fAnchorLon * fScale;
+		double fLat1 = fLatMin * fScale;
+		double fLat2 = fLatMax * fScale;
+		double fLon1 = fLonMin * fScale;
+		double fLon2 = fLonMax * fScale;
+
+		// closest latitude and longitude deltas are independent lower bounds of their haversine terms
+		double fDLat = Max(0.0, Max(fLat1 - fLat, fLat - fLat2));
+		double fDLon = 0.0;
+		if (fLon < fLon1 || fLon > fLon2)
+			fDLon = Min(GeoLonDiff(fLon, fLon1), GeoLonDiff(fLon, fLon2));
+
+		double fCos = Max(0.0, cos(fLat)) * Max(0.0, Min(cos(fLat1), cos(fLat2)));
+		double fHav = sphSqr(sin(fDLat / 2)) + fCos * sphSqr(sin(fDLon / 2));
+		double fDist = 2 * GEO_BOUND_RADIUS * asin(Min(1.0, sqrt(fHav)));
+
+		fDist *= tGeo.m_bExact ? GEO_BOUND_SLACK_EXACT : GEO_BOUND_SLACK_APPROX;
+		return (float)(fDist * tGeo.m_fOut);
+	}
+
+
+	bool sphGeodistBoundingBox(const GeodistInfo_t& tGeo, float fDist, float& fLatMin, float& fLatMax, float& fLonMin, float& fLonMax)
+	{
+		const double fScale = tGeo.m_bDeg ? GEO_PI / 180.0 : 1.0;
+		double fLat = tGeo.m_fAnchorLat * fScale;
+		double fLon = tGeo.m_fAnchorLon * fScale;
+
+		double fMeters = Max(0.0, double(fDist) / tGeo.m_fOut);
+		fMeters /= tGeo.m_bExact ? GEO_BOUND_SLACK_EXACT : GEO_BOUND_SLACK_APPROX;
+		double fAngle = fMeters / GEO_BOUND_RADIUS;
+
+		fLatMin = (float)(Max(fLat - fAngle, -GEO_PI / 2) / fScale);
+		fLatMax = (float)(Min(fLat + fAngle, GEO_PI / 2) / fScale);
+		fLonMin = (float)(-GEO_PI / fScale);
+		fLonMax = (float)(GEO_PI / fScale);
+
+		// circle covers a pole, any longitude goes
+		if (fAngle >= GEO_PI / 2 || fLat + fAngle >= GEO_PI / 2 || fLat - fAngle <= -GEO_PI / 2)
+			return false;
+
+		double fSin = sin(fAngle) / cos(fLat);
+		if (fSin >= 1.0)
+			return false;
+
+		double fDLon = asin(fSin);
+		fLonMin = (float)((fLon - fDLon) / fScale);
+		fLonMax = (float)((fLon + fDLon) / fScale);
+		return true;
+	}
+
+
 	float ExprGeodist_t::Eval(const CSphMatch& tMatch) const
 	{
 		const double R = 6384000;
@@ -68,6 +140,23 @@ namespace NEO {
 			static_cast <CSphVector<int>*>(pArg)->Add(m_iLat);
 			static_cast <CSphVector<int>*>(pArg)->Add(m_iLon);
 		}
+
+		if (eCmd == SPH_EXPR_GET_GEODIST)
+		{
+			// same math as Eval(), radians
+			GeodistInfo_t& tGeo = *static_cast<GeodistInfo_t*>(pArg);
+			tGeo.m_pExpr = this;
+			tGeo.m_pFunc = GeodistSphereRad;
+			tGeo.m_fOut = 1.0f;
+			tGeo.m_bDeg = false;
+			tGeo.m_bExact = true;
+			tGeo.m_tLat = m_tGeoLatLoc;
+			tGeo.m_tLon = m_tGeoLongLoc;
+			tGeo.m_iLat = m_iLat;
+			tGeo.m_iLon = m_iLon;
+			tGeo.m_fAnchorLat = m_fGeoAnchorLat;
+			tGeo.m_fAnchorLon = m_fGeoAnchorLong;
+		}
 	}
 
 	uint64_t ExprGeodist_t::GetHash(const ISphSchema& tSorterSchema, uint64_t uPrevHash, bool& bDisable)
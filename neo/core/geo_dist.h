@@ -12,6 +12,50 @@ namespace NEO {
 	class ISphSchema;
 	class CSphMatch;
 
+	typedef float (*GeodistFn_fn)(float, float, float, float);
+
+	/// geodist() between a (lat,lon) attribute pair and a constant anchor
+	/// filled by SPH_EXPR_GET_GEODIST; commands propagate down the tree, so m_pExpr tells which node answered
+	struct GeodistInfo_t
+	{
+		const ISphExpr*		m_pExpr;		///< expression that filled the info
+		GeodistFn_fn		m_pFunc;		///< distance function (in meters)
+		float				m_fOut;			///< meters to output units scale
+		bool				m_bDeg;			///< whether coordinates are in degrees
+		bool				m_bExact;		///< whether m_pFunc is a true sphere distance (or an approximation)
+		CSphAttrLocator		m_tLat;
+		CSphAttrLocator		m_tLon;
+		int					m_iLat;
+		int					m_iLon;
+		float				m_fAnchorLat;
+		float				m_fAnchorLon;
+
+		GeodistInfo_t()
+			: m_pExpr(NULL)
+			, m_pFunc(NULL)
+			, m_fOut(1.0f)
+			, m_bDeg(false)
+			, m_bExact(true)
+			, m_iLat(-1)
+			, m_iLon(-1)
+			, m_fAnchorLat(0.0f)
+			, m_fAnchorLon(0.0f)
+		{}
+
+		/// distance in output units
+		float Dist(float fLat, float fLon) const
+		{
+			return m_fOut * m_pFunc(fLat, fLon, m_fAnchorLat, m_fAnchorLon);
+		}
+	};
+
+	/// lower bound of the distance (in output units) from the anchor to any point in a lat/lon box
+	float	sphGeodistLowerBound(const GeodistInfo_t& tGeo, float fLatMin, float fLatMax, float fLonMin, float fLonMax);
+
+	/// lat/lon box (in anchor units) that contains every point within a given distance (in output units) of the anchor
+	/// returns false when the longitude is not bounded (poles, or the distance is too big)
+	bool	sphGeodistBoundingBox(const GeodistInfo_t& tGeo, float fDist, float& fLatMin, float& fLatMax, float& fLonMin, float& fLonMax);
+
 	struct ExprGeodist_t : public ISphExpr
 	{
 	public:
@@ -0,0 +1,344 @@
+#include "neo/core/geo_index.h"
+#include "neo/tools/convert.h"
+
+#include <cmath>
+#include <climits>
+
+namespace NEO {
+
+	/// grid is sized for about that many rows per cell, up to that many cells per side
+	static const int GEO_GRID_ROWS_PER_CELL = 16;
+	static const int GEO_GRID_MAX = 1024;
+
+	/// radius growth limit for nearest-N lookups, meters (that is well over a half of the equator)
+	static const double GEO_MAX_METERS = 2.5e7;
+
+
+	CSphGeoIndex::CSphGeoIndex()
+	{
+		Reset();
+	}
+
+
+	void CSphGeoIndex::Reset()
+	{
+		m_tLat = CSphAttrLocator();
+		m_tLon = CSphAttrLocator();
+		m_iGrid = 0;
+		m_fLatOrg = m_fLonOrg = 0.0f;
+		m_fLatMin = m_fLatMax = 0.0f;
+		m_fLonMin = m_fLonMax = 0.0f;
+		m_fLatScale = m_fLonScale = 0.0f;
+		m_dCells.Reset();
+		m_dRows.Reset();
+		m_dLat.Reset();
+		m_dLon.Reset();
+	}
+
+
+	int64_t CSphGeoIndex::GetUsedBytes() const
+	{
+		return int64_t(m_dCells.GetLength()) * sizeof(DWORD) + int64_t(m_dRows.GetLength()) * (sizeof(DWORD) + 2 * sizeof(float));
+	}
+
+
+	bool CSphGeoIndex::Covers(const GeodistInfo_t& tGeo) const
+	{
+		return !IsEmpty() && !tGeo.m_tLat.m_bDynamic && !tGeo.m_tLon.m_bDynamic && tGeo.m_tLat == m_tLat && tGeo.m_tLon == m_tLon;
+	}
+
+
+	int CSphGeoIndex::LatCell(float fLat) const
+	{
+		int iCell = int((fLat - m_fLatOrg) * m_fLatScale);
+		return Max(0, Min(iCell, m_iGrid - 1));
+	}
+
+
+	int CSphGeoIndex::LonCell(float fLon) const
+	{
+		int iCell = int((fLon - m_fLonOrg) * m_fLonScale);
+		return Max(0, Min(iCell, m_iGrid - 1));
+	}
+
+
+	void CSphGeoIndex::Build(const DWORD* pDocinfo, int64_t iDocinfo, int iStride, const CSphAttrLocator& tLat, const CSphAttrLocator& tLon)
+	{
+		Reset();
+		if (!pDocinfo || iDocinfo <= 0 || iDocinfo > INT_MAX)
+			return;
+
+		// data extent; rows without valid coordinates are not indexed
+		int iRows = (int)iDocinfo;
+		int iValid = 0;
+		for (int i = 0; i < iRows; i++)
+		{
+			const DWORD* pAttrs = pDocinfo + int64_t(i) * iStride + DOCINFO_IDSIZE;
+			float fLat = sphDW2F((DWORD)sphGetRowAttr(pAttrs, tLat));
+			float fLon = sphDW2F((DWORD)sphGetRowAttr(pAttrs, tLon));
+			if (fLat != fLat || fLon != fLon)
+				continue;
+
+			if (!iValid)
+			{
+				m_fLatMin = m_fLatMax = fLat;
+				m_fLonMin = m_fLonMax = fLon;
+			}
+			else
+			{
+				m_fLatMin = Min(m_fLatMin, fLat);
+				m_fLatMax = Max(m_fLatMax, fLat);
+				m_fLonMin = Min(m_fLonMin, fLon);
+				m_fLonMax = Max(m_fLonMax, fLon);
+			}
+			iValid++;
+		}
+
+		if (!iValid)
+			return;
+
+		m_tLat = tLat;
+		m_tLon = tLon;
+		m_fLatOrg = m_fLatMin;
+		m_fLonOrg = m_fLonMin;
+		m_iGrid = Max(1, Min(GEO_GRID_MAX, int(sqrt(double(iValid) / GEO_GRID_ROWS_PER_CELL))));
+		m_fLatScale = m_fLatMax > m_fLatMin ? m_iGrid / (m_fLatMax - m_fLatMin) : 0.0f;
+		m_fLonScale = m_fLonMax > m_fLonMin ? m_iGrid / (m_fLonMax - m_fLonMin) : 0.0f;
+
+		// counting sort by cell
+		m_dCells.Resize(m_iGrid * m_iGrid + 1);
+		m_dCells.Fill(0);
+		for (int i = 0; i < iRows; i++)
+		{
+			const DWORD* pAttrs = pDocinfo + int64_t(i) * iStride + DOCINFO_IDSIZE;
+			float fLat = sphDW2F((DWORD)sphGetRowAttr(pAttrs, tLat));
+			float fLon = sphDW2F((DWORD)sphGetRowAttr(pAttrs, tLon));
+			if (fLat == fLat && fLon == fLon)
+				m_dCells[LatCell(fLat) * m_iGrid + LonCell(fLon) + 1]++;
+		}
+
+		for (int i = 1; i < m_dCells.GetLength(); i++)
+			m_dCells[i] += m_dCells[i - 1];
+
+		CSphVector<DWORD> dCursor;
+		dCursor = m_dCells;
+
+		m_dRows.Resize(iValid);
+		m_dLat.Resize(iValid);
+		m_dLon.Resize(iValid);
+		for (int i = 0; i < iRows; i++)
+		{
+			const DWORD* pAttrs = pDocinfo + int64_t(i) * iStride + DOCINFO_IDSIZE;
+			float fLat = sphDW2F((DWORD)sphGetRowAttr(pAttrs, tLat));
+			float fLon = sphDW2F((DWORD)sphGetRowAttr(pAttrs, tLon));
+			if (fLat != fLat || fLon != fLon)
+				continue;
+
+			DWORD uPos = dCursor[LatCell(fLat) * m_iGrid + LonCell(fLon)]++;
+			m_dRows[uPos] = (DWORD)i;
+			m_dLat[uPos] = fLat;
+			m_dLon[uPos] = fLon;
+		}
+	}
+
+
+	int CSphGeoIndex::MoveSlot(int iPos, int iFrom, int iTo)
+	{
+		// every cell in between hands its edge slot over to the neighbour, so the hole travels a slot per cell
+		// cell past the last one (iGrid*iGrid) stands for the slots beyond the end, where added rows come from and removed rows go
+		int iHole = iPos;
+		if (iFrom < iTo)
+		{
+			for (int iCell = iFrom; iCell < iTo; iCell++)
+			{
+				int iLast = m_dCells[iCell + 1] - 1;
+				m_dRows[iHole] = m_dRows[iLast];
+				m_dLat[iHole] = m_dLat[iLast];
+				m_dLon[iHole] = m_dLon[iLast];
+				m_dCells[iCell + 1]--;
+				iHole = iLast;
+			}
+		}
+		else
+		{
+			for (int iCell = iFrom; iCell > iTo; iCell--)
+			{
+				int iFirst = m_dCells[iCell];
+				m_dRows[iHole] = m_dRows[iFirst];
+				m_dLat[iHole] = m_dLat[iFirst];
+				m_dLon[iHole] = m_dLon[iFirst];
+				m_dCells[iCell]++;
+				iHole = iFirst;
+			}
+		}
+		return iHole;
+	}
+
+
+	void CSphGeoIndex::Update(DWORD uRow, const CSphRowitem* pOld, const CSphRowitem* pNew)
+	{
+		if (IsEmpty())
+			return;
+
+		float fOldLat = sphDW2F((DWORD)sphGetRowAttr(pOld, m_tLat));
+		float fOldLon = sphDW2F((DWORD)sphGetRowAttr(pOld, m_tLon));
+		float fLat = sphDW2F((DWORD)sphGetRowAttr(pNew, m_tLat));
+		float fLon = sphDW2F((DWORD)sphGetRowAttr(pNew, m_tLon));
+		bool bOld = (fOldLat == fOldLat && fOldLon == fOldLon);
+		bool bNew = (fLat == fLat && fLon == fLon);
+
+		// find the row in the cell of its old coordinates; rows without valid coordinates are not indexed
+		const int iEnd = m_iGrid * m_iGrid;
+		int iFrom = iEnd;
+		int iPos = -1;
+		if (bOld)
+		{
+			iFrom = LatCell(fOldLat) * m_iGrid + LonCell(fOldLon);
+			for (DWORD i = m_dCells[iFrom]; i < m_dCells[iFrom + 1] && iPos < 0; i++)
+				if (m_dRows[i] == uRow)
+					iPos = (int)i;
+		}
+
+		if (iPos < 0)
+		{
+			if (!bNew)
+				return;
+
+			iFrom = iEnd;
+			iPos = m_dRows.GetLength();
+			m_dRows.Add(uRow);
+			m_dLat.Add(fLat);
+			m_dLon.Add(fLon);
+		}
+
+		int iTo = iEnd;
+		if (bNew)
+		{
+			iTo = LatCell(fLat) * m_iGrid + LonCell(fLon);
+			m_fLatMin = Min(m_fLatMin, fLat);
+			m_fLatMax = Max(m_fLatMax, fLat);
+			m_fLonMin = Min(m_fLonMin, fLon);
+			m_fLonMax = Max(m_fLonMax, fLon);
+		}
+
+		iPos = MoveSlot(iPos, iFrom, iTo);
+		if (iTo == iEnd)
+		{
+			m_dRows.Pop();
+			m_dLat.Pop();
+			m_dLon.Pop();
+			return;
+		}
+
+		m_dRows[iPos] = uRow;
+		m_dLat[iPos] = fLat;
+		m_dLon[iPos] = fLon;
+	}
+
+
+	void CSphGeoIndex::CollectWithin(const GeodistInfo_t& tGeo, float fDist, CSphVector<DWORD>& dRows) const
+	{
+		dRows.Resize(0);
+		if (IsEmpty() || !(fDist >= 0.0f))
+			return;
+
+		float fLat1, fLat2, fLon1, fLon2;
+		bool bBounded = sphGeodistBoundingBox(tGeo, fDist, fLat1, fLat2, fLon1, fLon2);
+		if (fLat2 < m_fLatMin || fLat1 > m_fLatMax)
+			return;
+
+		// longitude intervals; the box might wrap around, and the data might use either -180..180 or 0..360
+		const float fPeriod = tGeo.m_bDeg ? 360.0f : float(2 * M_PI);
+		float dLons[3][2];
+		int iLons = 0;
+		if (!bBounded || fLon2 - fLon1 >= fPeriod)
+		{
+			dLons[0][0] = m_fLonMin;
+			dLons[0][1] = m_fLonMax;
+			iLons = 1;
+		}
+		else
+		{
+			for (int k = -1; k <= 1; k++)
+			{
+				float fMin = Max(fLon1 + k * fPeriod, m_fLonMin);
+				float fMax = Min(fLon2 + k * fPeriod, m_fLonMax);
+				if (fMin <= fMax)
+				{
+					dLons[iLons][0] = fMin;
+					dLons[iLons][1] = fMax;
+					iLons++;
+				}
+			}
+		}
+
+		const float fLatStep = m_fLatScale > 0.0f ? 1.0f / m_fLatScale : 0.0f;
+		const float fLonStep = m_fLonScale > 0.0f ? 1.0f / m_fLonScale : 0.0f;
+
+		for (int iLat = LatCell(fLat1); iLat <= LatCell(fLat2); iLat++)
+		{
+			float fCellLat1 = iLat ? m_fLatOrg + iLat * fLatStep : m_fLatMin;
+			float fCellLat2 = fLatStep > 0.0f && iLat < m_iGrid - 1 ? m_fLatOrg + (iLat + 1) * fLatStep : m_fLatMax;
+
+			for (int j = 0; j < iLons; j++)
+				for (int iLon = LonCell(dLons[j][0]); iLon <= LonCell(dLons[j][1]); iLon++)
+				{
+					int iCell = iLat * m_iGrid + iLon;
+					DWORD uStart = m_dCells[iCell];
+					DWORD uEnd = m_dCells[iCell + 1];
+					if (uStart == uEnd)
+						continue;
+
+					float fCellLon1 = iLon ? m_fLonOrg + iLon * fLonStep : m_fLonMin;
+					float fCellLon2 = fLonStep > 0.0f && iLon < m_iGrid - 1 ? m_fLonOrg + (iLon + 1) * fLonStep : m_fLonMax;
+					if (sphGeodistLowerBound(tGeo, fCellLat1, fCellLat2, fCellLon1, fCellLon2) > fDist)
+						continue;
+
+					for (DWORD i = uStart; i < uEnd; i++)
+						if (tGeo.Dist(m_dLat[i], m_dLon[i]) <= fDist)
+							dRows.Add(m_dRows[i]);
+				}
+		}
+
+		dRows.Sort();
+	}
+
+
+	void CSphGeoIndex::CollectNearest(const GeodistInfo_t& tGeo, int iCount, CSphVector<DWORD>& dRows) const
+	{
+		dRows.Resize(0);
+		if (IsEmpty() || iCount <= 0)
+			return;
+
+		const float fMaxDist = float(GEO_MAX_METERS * tGeo.m_fOut);
+		if (iCount >= m_dRows.GetLength() || m_fLatScale <= 0.0f)
+		{
+			CollectWithin(tGeo, fMaxDist, dRows);
+			return;
+		}
+
+		// start with a radius that covers about iCount rows at the average density
+		double fCells = sqrt(double(iCount) * m_iGrid * m_iGrid / m_dRows.GetLength()) + 1.0;
+		double fAngle = fCells / m_fLatScale;
+		if (tGeo.m_bDeg)
+			fAngle *= M_PI / 180.0;
+		float fDist = float(fAngle * 6371000.0 * tGeo.m_fOut);
+
+		// any row within the radius beats any row outside it, so once there are enough of them, we are done
+		for (;;)
+		{
+			if (fDist >= fMaxDist)
+			{
+				CollectWithin(tGeo, fMaxDist, dRows);
+				return;
+			}
+
+			CollectWithin(tGeo, fDist, dRows);
+			if (dRows.GetLength() >= iCount)
+				return;
+
+			fDist *= dRows.GetLength() ? Min(4.0f, Max(1.5f, sqrtf(float(iCount) / dRows.GetLength()) * 1.2f)) : 4.0f;
+		}
+	}
+
+}
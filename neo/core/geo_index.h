@@ -0,0 +1,64 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/source/attrib_locator.h"
+#include "neo/core/geo_dist.h"
+
+namespace NEO {
+
+	/// in-memory spatial index over a (lat,lon) float attribute pair
+	/// rows are bucketed into a uniform grid over the data extent (in the attribute units, degrees or radians);
+	/// buckets are stored back to back, so that a run of cells within a grid row is a single slice
+	class CSphGeoIndex : public ISphNoncopyable
+	{
+	public:
+		CSphGeoIndex();
+
+		/// build over docinfo rows (docid and attributes); lat/lon must be static float attributes
+		void			Build(const DWORD* pDocinfo, int64_t iDocinfo, int iStride, const CSphAttrLocator& tLat, const CSphAttrLocator& tLon);
+		void			Reset();
+
+		bool			IsEmpty() const { return m_dRows.GetLength() == 0; }
+		int64_t			GetUsedBytes() const;
+
+		/// check whether this index is over the same attributes as a given geodist()
+		bool			Covers(const GeodistInfo_t& tGeo) const;
+
+		/// check whether the index depends on a given attribute
+		bool			Uses(const CSphAttrLocator& tLocator) const { return !IsEmpty() && (tLocator == m_tLat || tLocator == m_tLon); }
+
+		/// move a row to the cell of its new coordinates, given its attributes (no docid) before and after an update
+		/// rows only travel through the cells in between, so that is what an update costs, rather than a rebuild
+		void			Update(DWORD uRow, const CSphRowitem* pOld, const CSphRowitem* pNew);
+
+		/// collect rows within a given distance (in geodist() output units) of the anchor, sorted by row
+		void			CollectWithin(const GeodistInfo_t& tGeo, float fDist, CSphVector<DWORD>& dRows) const;
+
+		/// collect rows that are guaranteed to contain the iCount nearest ones, sorted by row
+		/// rows are taken within a radius that grows until there are enough of them
+		void			CollectNearest(const GeodistInfo_t& tGeo, int iCount, CSphVector<DWORD>& dRows) const;
+
+	protected:
+		CSphAttrLocator		m_tLat;
+		CSphAttrLocator		m_tLon;
+
+		int					m_iGrid;		///< cells per side
+		float				m_fLatOrg;		///< grid origin, the data extent minimum as of the build
+		float				m_fLonOrg;
+		float				m_fLatMin;		///< data extent; updates might grow it past the grid, edge cells then take the outliers
+		float				m_fLatMax;
+		float				m_fLonMin;
+		float				m_fLonMax;
+		float				m_fLatScale;	///< cells per attribute unit
+		float				m_fLonScale;
+
+		CSphVector<DWORD>	m_dCells;		///< bucket start per cell, iGrid*iGrid+1 entries
+		CSphVector<DWORD>	m_dRows;		///< docinfo row numbers, bucketed by cell
+		CSphVector<float>	m_dLat;			///< point coordinates, in the m_dRows order
+		CSphVector<float>	m_dLon;
+
+		int				LatCell(float fLat) const;
+		int				LonCell(float fLon) const;
+		int				MoveSlot(int iPos, int iFrom, int iTo);
+	};
+
+}
@@ -17,7 +17,7 @@ namespace NEO {
 	//////////////////////////////////////////////////////////////////////////
 
 	const DWORD		INDEX_MAGIC_HEADER = 0x58485053;		///< my magic 'SPHX' header
-	const DWORD		INDEX_FORMAT_VERSION = 42;				///< my format version
+	const DWORD		INDEX_FORMAT_VERSION = 46;				///< my format version
 
 	const char		MAGIC_SYNONYM_WHITESPACE = 1;				// used internally in tokenizer only
 	//const char		MAGIC_CODE_SENTENCE = 2;				// emitted from tokenizer on sentence boundary
@@ -40,6 +40,7 @@ namespace NEO {
 
 	CSphString			g_sLemmatizerBase = SHAREDIR;
 	bool				g_bProgressiveMerge = false;
+	int					g_iMergeThreads = 1;
 
 	// quick hack for indexer crash reporting
 	// one day, these might turn into a callback or something
@@ -87,6 +88,10 @@ namespace NEO {
 	int g_iPredictorCostSkip = 2048;
 	int g_iPredictorCostMatch = 64;
 
+	/// exact group-by spills to disk past that much memory per query
+	int64_t g_iGroupbyMemory = 64*1024*1024;
+	CSphString g_sGroupbyTmpDir;
+
 
 	///////////////////////
 
@@ -40,6 +40,7 @@ namespace NEO {
 
 	extern CSphString			g_sLemmatizerBase;
 	extern bool				g_bProgressiveMerge;
+	extern int				g_iMergeThreads;		///< 2 moves attributes of an index merge or RT disk chunk save onto a thread of their own, 1 keeps them serial
 
 	
 	extern int64_t		g_iIndexerCurrentDocID;
@@ -84,6 +85,9 @@ namespace NEO {
 	extern int g_iPredictorCostHit;
 	extern int g_iPredictorCostMatch;
 
+	extern int64_t		g_iGroupbyMemory;	///< default per-query memory budget for exact group-by, in bytes
+	extern CSphString	g_sGroupbyTmpDir;	///< where exact group-by spills its partitions (empty means system temp dir)
+
 	extern bool g_bJsonStrict;
 	extern bool g_bJsonAutoconvNumbers;
 	extern bool g_bJsonKeynamesToLowercase;
@@ -0,0 +1,80 @@
+#include "neo/core/match_arena.h"
+
+namespace NEO {
+
+	CSphMatchArena::CSphMatchArena()
+		: m_iDynamic(0)
+		, m_iStride(0)
+		, m_pFree(NULL)
+		, m_iRows(0)
+		, m_iBytes(0)
+	{}
+
+
+	CSphMatchArena::~CSphMatchArena()
+	{
+		ARRAY_FOREACH(i, m_dSlabs)
+			SafeDeleteArray(m_dSlabs[i].m_pBegin);
+	}
+
+
+	CSphRowitem* CSphMatchArena::Alloc(int iDynamic)
+	{
+		assert(iDynamic > 0);
+		assert(!m_iDynamic || m_iDynamic == iDynamic);
+
+		if (!m_iDynamic)
+		{
+			m_iDynamic = iDynamic;
+#ifndef NDEBUG
+			m_iStride = iDynamic + 1;
+#else
+			m_iStride = iDynamic;
+#endif
+		}
+
+		if (!m_dSlabs.GetLength() || m_pFree == m_dSlabs.Last().m_pEnd)
+		{
+			// grow geometrically, so that small sorters stay small, and big ones do not end up with too many slabs
+			int iRows = (int)Min(Max(m_iRows, (int64_t)MIN_SLAB_ROWS), (int64_t)MAX_SLAB_ROWS);
+			Slab_t& tSlab = m_dSlabs.Add();
+			tSlab.m_pBegin = new CSphRowitem[iRows * m_iStride];
+			tSlab.m_pEnd = tSlab.m_pBegin + iRows * m_iStride;
+
+			// dynamic stuff might contain pointers (STRINGPTR type), so start clean
+			memset(tSlab.m_pBegin, 0, iRows * m_iStride * sizeof(CSphRowitem));
+			m_pFree = tSlab.m_pBegin;
+			m_iRows += iRows;
+			m_iBytes += iRows * m_iStride * sizeof(CSphRowitem);
+		}
+
+		CSphRowitem* pRow = m_pFree;
+		m_pFree += m_iStride;
+#ifndef NDEBUG
+		*pRow++ = m_iDynamic;
+#endif
+		return pRow;
+	}
+
+
+	bool CSphMatchArena::Owns(const CSphRowitem* pRow) const
+	{
+		// recent slabs are the biggest ones
+		for (int i = m_dSlabs.GetLength() - 1; i >= 0; i--)
+			if (pRow >= m_dSlabs[i].m_pBegin && pRow < m_dSlabs[i].m_pEnd)
+				return true;
+		return false;
+	}
+
+
+	void CSphMatchArena::Detach(CSphMatch* pMatches, int iCount) const
+	{
+		if (!m_dSlabs.GetLength())
+			return;
+
+		for (int i = 0; i < iCount; i++)
+			if (pMatches[i].m_pDynamic && Owns(pMatches[i].m_pDynamic))
+				pMatches[i].m_pDynamic = NULL;
+	}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/core/match.h"
+
+namespace NEO {
+
+	/// slab allocator for the dynamic rows of the matches a sorter keeps
+	/// rows are laid out just like CSphMatch::Reset() makes them, and are never freed one by one;
+	/// they stay with the sorter matches (heap operations only swap them around), and all go away with the arena
+	/// so a match that leaves the sorter must take a copy of its row, and matches must be detached before their dtors run
+	class CSphMatchArena : public ISphNoncopyable
+	{
+	public:
+							CSphMatchArena();
+							~CSphMatchArena();
+
+		/// get a zeroed row; all rows of an arena must be of the same size
+		CSphRowitem*		Alloc(int iDynamic);
+
+		/// check whether a row came from this arena
+		bool				Owns(const CSphRowitem* pRow) const;
+
+		/// forget arena rows of the given matches, so that match dtors do not free them
+		void				Detach(CSphMatch* pMatches, int iCount) const;
+
+		/// memory taken by the slabs
+		int64_t				GetBytes() const { return m_iBytes; }
+
+	protected:
+		struct Slab_t
+		{
+			CSphRowitem*	m_pBegin;
+			CSphRowitem*	m_pEnd;
+		};
+
+		static const int	MIN_SLAB_ROWS = 64;
+		static const int	MAX_SLAB_ROWS = 65536;
+
+		CSphVector<Slab_t>	m_dSlabs;
+		int					m_iDynamic;
+		int					m_iStride;		///< row size, plus the size prefix in debug builds
+		CSphRowitem*		m_pFree;		///< next unused row in the last slab
+		int64_t				m_iRows;
+		int64_t				m_iBytes;
+	};
+
+}
@@ -0,0 +1,234 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/core/attrib_index_builder.h"
+
+#include <climits>
+
+#ifndef USE_SSE2
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP>=2 )
+#define USE_SSE2 1
+#else
+#define USE_SSE2 0
+#endif
+#endif
+
+#if USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace NEO {
+
+	/// sorted MVA list vs sorted value set intersection kernels
+	/// used by MVA ANY()/ALL() filters and IN() over MVA expressions
+
+	/// size ratio at which we switch from a linear merge to galloping over the longer list
+	const int MVA_GALLOP_RATIO = 8;
+
+	/// longest MVA list (and value set) to scan with SIMD compares instead of searching, for both ANY and ALL
+	/// longer 32-bit lists and all 64-bit ones go through the merge and gallop paths
+	const int MVA_SIMD_MAX_LIST = 64;
+	const int MVA_SIMD_MAX_VALUES = 4;
+
+
+	/// MVA value accessors; 64-bit values are only dword aligned in the pool
+	inline SphAttr_t MvaValue(const DWORD* pMva) { return *pMva; }
+	inline SphAttr_t MvaValue(const int64_t* pMva) { return MVA_UPSIZE((const DWORD*)pMva); }
+
+
+	/// first element in [pBegin,pEnd) that is not less than tRef, exponential probe then bisect
+	template < typename T >
+	inline const T* MvaGallop(const T* pBegin, const T* pEnd, SphAttr_t tRef)
+	{
+		int iLen = int(pEnd - pBegin);
+		int iStep = 1;
+		int iLo = 0;
+		while (iStep < iLen && MvaValue(pBegin + iStep) < tRef)
+		{
+			iLo = iStep;
+			iStep <<= 1;
+		}
+
+		int iHi = iStep < iLen ? iStep + 1 : iLen;
+		while (iLo < iHi)
+		{
+			int iMid = iLo + (iHi - iLo) / 2;
+			if (MvaValue(pBegin + iMid) < tRef)
+				iLo = iMid + 1;
+			else
+				iHi = iMid;
+		}
+		return pBegin + iLo;
+	}
+
+
+#if USE_SSE2
+	/// brute force compare of a short dword list against a few values
+	inline bool MvaAnySSE2(const DWORD* pMva, int iMva, const SphAttr_t* pValues, int iValues)
+	{
+		for (int i = 0; i < iValues; i++)
+		{
+			// values outside of dword range can not match
+			if (pValues[i] < 0 || pValues[i] > (SphAttr_t)UINT_MAX)
+				continue;
+
+			__m128i tRef = _mm_set1_epi32((int)(DWORD)pValues[i]);
+			int j = 0;
+			for (; j + 4 <= iMva; j += 4)
+			{
+				__m128i tMva = _mm_loadu_si128((const __m128i*)(pMva + j));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(tMva, tRef)))
+					return true;
+			}
+			for (; j < iMva; j++)
+				if (pMva[j] == (DWORD)pValues[i])
+					return true;
+		}
+		return false;
+	}
+
+
+	/// brute force check that every value of a short dword list is one of a few values
+	inline bool MvaAllSSE2(const DWORD* pMva, int iMva, const SphAttr_t* pValues, int iValues)
+	{
+		// values outside of dword range can not match
+		__m128i dRefs[MVA_SIMD_MAX_VALUES];
+		int iRefs = 0;
+		for (int i = 0; i < iValues; i++)
+			if (pValues[i] >= 0 && pValues[i] <= (SphAttr_t)UINT_MAX)
+				dRefs[iRefs++] = _mm_set1_epi32((int)(DWORD)pValues[i]);
+
+		int j = 0;
+		for (; j + 4 <= iMva; j += 4)
+		{
+			__m128i tMva = _mm_loadu_si128((const __m128i*)(pMva + j));
+			__m128i tHits = _mm_setzero_si128();
+			for (int i = 0; i < iRefs; i++)
+				tHits = _mm_or_si128(tHits, _mm_cmpeq_epi32(tMva, dRefs[i]));
+			if (_mm_movemask_epi8(tHits) != 0xFFFF)
+				return false;
+		}
+		for (; j < iMva; j++)
+		{
+			bool bHit = false;
+			for (int i = 0; i < iValues && !bHit; i++)
+				bHit = (pValues[i] == (SphAttr_t)pMva[j]);
+			if (!bHit)
+				return false;
+		}
+		return true;
+	}
+#endif
+
+
+	/// check whether a sorted MVA list has at least one value from a sorted value set
+	template < typename T >
+	inline bool sphMvaAny(const T* pMva, int iMva, const SphAttr_t* pValues, int iValues)
+	{
+		if (!iMva || !iValues)
+			return false;
+
+		// disjoint ranges
+		if (MvaValue(pMva + iMva - 1) < pValues[0] || MvaValue(pMva) > pValues[iValues - 1])
+			return false;
+
+#if USE_SSE2
+		if (sizeof(T) == sizeof(DWORD) && iMva <= MVA_SIMD_MAX_LIST && iValues <= MVA_SIMD_MAX_VALUES)
+			return MvaAnySSE2((const DWORD*)pMva, iMva, pValues, iValues);
+#endif
+
+		const T* pM = pMva;
+		const T* pMEnd = pMva + iMva;
+		const SphAttr_t* pV = pValues;
+		const SphAttr_t* pVEnd = pValues + iValues;
+
+		if (iValues * MVA_GALLOP_RATIO < iMva)
+		{
+			// few values vs long list, gallop over the list
+			for (; pV < pVEnd; pV++)
+			{
+				pM = MvaGallop(pM, pMEnd, *pV);
+				if (pM == pMEnd)
+					return false;
+				if (MvaValue(pM) == *pV)
+					return true;
+			}
+			return false;
+		}
+
+		if (iMva * MVA_GALLOP_RATIO < iValues)
+		{
+			// short list vs many values, gallop over the values
+			for (; pM < pMEnd; pM++)
+			{
+				SphAttr_t tVal = MvaValue(pM);
+				pV = MvaGallop(pV, pVEnd, tVal);
+				if (pV == pVEnd)
+					return false;
+				if (*pV == tVal)
+					return true;
+			}
+			return false;
+		}
+
+		// comparable sizes, merge
+		while (pM < pMEnd && pV < pVEnd)
+		{
+			SphAttr_t tVal = MvaValue(pM);
+			if (tVal == *pV)
+				return true;
+			pM += (tVal < *pV);
+			pV += (*pV < tVal);
+		}
+		return false;
+	}
+
+
+	/// check whether all values of a sorted MVA list are in a sorted value set
+	template < typename T >
+	inline bool sphMvaAll(const T* pMva, int iMva, const SphAttr_t* pValues, int iValues)
+	{
+		if (!iMva)
+			return true;
+		if (!iValues)
+			return false;
+
+		// every list value must be within the set range
+		if (MvaValue(pMva) < pValues[0] || MvaValue(pMva + iMva - 1) > pValues[iValues - 1])
+			return false;
+
+#if USE_SSE2
+		if (sizeof(T) == sizeof(DWORD) && iMva <= MVA_SIMD_MAX_LIST && iValues <= MVA_SIMD_MAX_VALUES)
+			return MvaAllSSE2((const DWORD*)pMva, iMva, pValues, iValues);
+#endif
+
+		const T* pM = pMva;
+		const T* pMEnd = pMva + iMva;
+		const SphAttr_t* pV = pValues;
+		const SphAttr_t* pVEnd = pValues + iValues;
+
+		if (iMva * MVA_GALLOP_RATIO < iValues)
+		{
+			for (; pM < pMEnd; pM++)
+			{
+				SphAttr_t tVal = MvaValue(pM);
+				pV = MvaGallop(pV, pVEnd, tVal);
+				if (pV == pVEnd || *pV != tVal)
+					return false;
+			}
+			return true;
+		}
+
+		// list values might repeat, so only the set cursor advances on a match
+		while (pM < pMEnd)
+		{
+			SphAttr_t tVal = MvaValue(pM);
+			while (pV < pVEnd && *pV < tVal)
+				pV++;
+			if (pV == pVEnd || *pV != tVal)
+				return false;
+			pM++;
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,225 @@
+#include "neo/core/mva_pack.h"
+#include "neo/core/attrib_index_builder.h"
+#include "neo/core/generic.h"
+
+namespace NEO {
+
+	static inline void PutVarint(CSphVector<BYTE>& dOut, uint64_t uValue)
+	{
+		while (uValue >= 0x80)
+		{
+			dOut.Add(BYTE(uValue | 0x80));
+			uValue >>= 7;
+		}
+		dOut.Add(BYTE(uValue));
+	}
+
+
+	static inline uint64_t GetVarint(const BYTE*& pIn)
+	{
+		uint64_t uValue = 0;
+		int iShift = 0;
+		BYTE uByte;
+		do
+		{
+			uByte = *pIn++;
+			uValue |= uint64_t(uByte & 0x7f) << iShift;
+			iShift += 7;
+		} while ((uByte & 0x80) && iShift < 64);
+		return uValue;
+	}
+
+
+	/// LSB-first bit stream over a byte vector
+	struct MvaBitWriter_t
+	{
+		CSphVector<BYTE>&	m_dOut;
+		uint64_t			m_uAcc;
+		int					m_iBits;
+
+		explicit MvaBitWriter_t(CSphVector<BYTE>& dOut)
+			: m_dOut(dOut)
+			, m_uAcc(0)
+			, m_iBits(0)
+		{}
+
+		void Put(uint64_t uValue, int iWidth)
+		{
+			// at most 32 bits at a time, so that the accumulator never overflows
+			while (iWidth > 0)
+			{
+				int iChunk = Min(iWidth, 32);
+				m_uAcc |= (uValue & ((U64C(1) << iChunk) - 1)) << m_iBits;
+				m_iBits += iChunk;
+				uValue >>= iChunk;
+				iWidth -= iChunk;
+
+				for (; m_iBits >= 8; m_iBits -= 8)
+				{
+					m_dOut.Add(BYTE(m_uAcc));
+					m_uAcc >>= 8;
+				}
+			}
+		}
+
+		void Flush()
+		{
+			if (m_iBits)
+				m_dOut.Add(BYTE(m_uAcc));
+			m_uAcc = 0;
+			m_iBits = 0;
+		}
+	};
+
+
+	struct MvaBitReader_t
+	{
+		const BYTE*		m_pIn;
+		uint64_t		m_uAcc;
+		int				m_iBits;
+
+		explicit MvaBitReader_t(const BYTE* pIn)
+			: m_pIn(pIn)
+			, m_uAcc(0)
+			, m_iBits(0)
+		{}
+
+		uint64_t Get(int iWidth)
+		{
+			uint64_t uValue = 0;
+			int iShift = 0;
+			while (iWidth > 0)
+			{
+				int iChunk = Min(iWidth, 32);
+				while (m_iBits < iChunk)
+				{
+					m_uAcc |= uint64_t(*m_pIn++) << m_iBits;
+					m_iBits += 8;
+				}
+
+				uValue |= (m_uAcc & ((U64C(1) << iChunk) - 1)) << iShift;
+				m_uAcc >>= iChunk;
+				m_iBits -= iChunk;
+				iShift += iChunk;
+				iWidth -= iChunk;
+			}
+			return uValue;
+		}
+
+		void Flush()
+		{
+			m_uAcc = 0;
+			m_iBits = 0;
+		}
+	};
+
+
+	static inline uint64_t GetPoolValue(const DWORD* pValues, int i, bool bMva64)
+	{
+		return bMva64 ? uint64_t(MVA_UPSIZE(pValues + 2 * i)) : uint64_t(pValues[i]);
+	}
+
+
+	static inline void PutPoolValue(DWORD*& pDst, uint64_t uValue, bool bMva64)
+	{
+		*pDst++ = DWORD(uValue);
+		if (bMva64)
+			*pDst++ = DWORD(uValue >> 32);
+	}
+
+
+	void sphPackMva(const DWORD* pMva, bool bMva64, CSphVector<BYTE>& dOut)
+	{
+		DWORD uCount = *pMva++;
+		PutVarint(dOut, uCount);
+
+		int iValues = bMva64 ? int(uCount / 2) : int(uCount);
+		if (!iValues)
+			return;
+
+		// deltas wrap around on unsorted input, which only costs space
+		uint64_t uPrev = GetPoolValue(pMva, 0, bMva64);
+		PutVarint(dOut, uPrev);
+
+		if (iValues <= MVA_PACK_SHORT)
+		{
+			for (int i = 1; i < iValues; i++)
+			{
+				uint64_t uValue = GetPoolValue(pMva, i, bMva64);
+				PutVarint(dOut, uValue - uPrev);
+				uPrev = uValue;
+			}
+			return;
+		}
+
+		uint64_t dDeltas[MVA_PACK_BLOCK];
+		MvaBitWriter_t tBits(dOut);
+		for (int iStart = 1; iStart < iValues; iStart += MVA_PACK_BLOCK)
+		{
+			int iBlock = Min(MVA_PACK_BLOCK, iValues - iStart);
+			uint64_t uMax = 0;
+			for (int i = 0; i < iBlock; i++)
+			{
+				uint64_t uValue = GetPoolValue(pMva, iStart + i, bMva64);
+				dDeltas[i] = uValue - uPrev;
+				uMax |= dDeltas[i];
+				uPrev = uValue;
+			}
+
+			int iWidth = 0;
+			while (iWidth < 64 && (uMax >> iWidth))
+				iWidth++;
+
+			dOut.Add(BYTE(iWidth));
+			for (int i = 0; i < iBlock; i++)
+				tBits.Put(dDeltas[i], iWidth);
+			tBits.Flush();
+		}
+	}
+
+
+	int sphPackedMvaLength(const BYTE* pPacked)
+	{
+		return 1 + int(GetVarint(pPacked));
+	}
+
+
+	const BYTE* sphUnpackMva(const BYTE* pPacked, bool bMva64, DWORD* pOut)
+	{
+		DWORD uCount = DWORD(GetVarint(pPacked));
+		*pOut++ = uCount;
+
+		int iValues = bMva64 ? int(uCount / 2) : int(uCount);
+		if (!iValues)
+			return pPacked;
+
+		uint64_t uValue = GetVarint(pPacked);
+		DWORD* pDst = pOut;
+		PutPoolValue(pDst, uValue, bMva64);
+
+		if (iValues <= MVA_PACK_SHORT)
+		{
+			for (int i = 1; i < iValues; i++)
+			{
+				uValue += GetVarint(pPacked);
+				PutPoolValue(pDst, uValue, bMva64);
+			}
+			return pPacked;
+		}
+
+		MvaBitReader_t tBits(pPacked);
+		for (int iStart = 1; iStart < iValues; iStart += MVA_PACK_BLOCK)
+		{
+			int iBlock = Min(MVA_PACK_BLOCK, iValues - iStart);
+			int iWidth = *tBits.m_pIn++;
+			for (int i = 0; i < iBlock; i++)
+			{
+				uValue += tBits.Get(iWidth);
+				PutPoolValue(pDst, uValue, bMva64);
+			}
+			tBits.Flush();
+		}
+		return tBits.m_pIn;
+	}
+
+}
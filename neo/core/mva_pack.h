@@ -0,0 +1,22 @@
+#pragma once
+#include "neo/int/types.h"
+
+namespace NEO {
+
+	/// packed MVA list format, used for the persisted MVA updates (.mvp) only
+	/// the in-memory .spm pool and the update arena stay raw, as filters, expressions, sorters and UDFs read values in place
+	/// count (in dwords, same as in the pool) and the first value are varints, the rest are deltas;
+	/// short lists keep deltas as varints, longer ones are split into blocks that share a bit width
+	const int MVA_PACK_SHORT = 8;
+	const int MVA_PACK_BLOCK = 128;
+
+	/// append a pool entry (count followed by values) in packed format
+	void			sphPackMva(const DWORD* pMva, bool bMva64, CSphVector<BYTE>& dOut);
+
+	/// pool entry length (count included, in dwords) of a packed list
+	int				sphPackedMvaLength(const BYTE* pPacked);
+
+	/// unpack a list into pool entry format, returns the pointer past its packed data
+	const BYTE*		sphUnpackMva(const BYTE* pPacked, bool bMva64, DWORD* pOut);
+
+}
@@ -0,0 +1,298 @@
+#include "neo/core/rollup.h"
+#include "neo/sphinx/xutility.h"
+#include "neo/tools/convert.h"
+#include "neo/tools/docinfo_transformer.h"
+#include "neo/io/fnv64.h"
+
+namespace NEO {
+
+	CSphRollup::CSphRollup()
+		: m_iDocinfoStride(DOCINFO_IDSIZE)
+		, m_iSlotShift(64 - MIN_SLOTS_SHIFT)
+	{}
+
+
+	static bool IsRollupDimension(ESphAttr eAttr)
+	{
+		return eAttr == ESphAttr::SPH_ATTR_INTEGER || eAttr == ESphAttr::SPH_ATTR_TIMESTAMP || eAttr == ESphAttr::SPH_ATTR_BOOL
+			|| eAttr == ESphAttr::SPH_ATTR_BIGINT || eAttr == ESphAttr::SPH_ATTR_TOKENCOUNT;
+	}
+
+
+	bool CSphRollup::Setup(const CSphString& sSpec, const ISphSchema& tSchema, CSphString& sError)
+	{
+		Reset();
+		m_sSpec = sSpec;
+		m_sSpec.Trim();
+		m_dDims.Reset();
+		m_dMeasures.Reset();
+
+		// dimensions, and then measures after a colon
+		CSphVector<CSphString> dParts;
+		sphSplit(dParts, m_sSpec.cstr(), ":");
+		if (dParts.GetLength() > 2)
+		{
+			sError.SetSprintf("rollup '%s': expected 'dimensions : measures'", m_sSpec.cstr());
+			return false;
+		}
+
+		CSphVector<CSphString> dDims;
+		sphSplit(dDims, dParts[0].cstr());
+		if (!dDims.GetLength() || dDims.GetLength() > MAX_DIMS)
+		{
+			sError.SetSprintf("rollup '%s': expected 1 to %d dimensions", m_sSpec.cstr(), MAX_DIMS);
+			return false;
+		}
+
+		ARRAY_FOREACH(i, dDims)
+		{
+			const CSphColumnInfo* pAttr = tSchema.GetAttr(dDims[i].cstr());
+			if (!pAttr || !IsRollupDimension(pAttr->m_eAttrType))
+			{
+				sError.SetSprintf("rollup '%s': dimension '%s' is not an integer attribute", m_sSpec.cstr(), dDims[i].cstr());
+				return false;
+			}
+
+			Column_t& tDim = m_dDims.Add();
+			tDim.m_sName = pAttr->m_sName;
+			tDim.m_tLocator = pAttr->m_tLocator;
+			tDim.m_bFloat = false;
+		}
+
+		CSphVector<CSphString> dMeasures;
+		if (dParts.GetLength() == 2)
+			sphSplit(dMeasures, dParts[1].cstr());
+
+		ARRAY_FOREACH(i, dMeasures)
+		{
+			const CSphColumnInfo* pAttr = tSchema.GetAttr(dMeasures[i].cstr());
+			if (!pAttr || (!IsRollupDimension(pAttr->m_eAttrType) && pAttr->m_eAttrType != ESphAttr::SPH_ATTR_FLOAT))
+			{
+				sError.SetSprintf("rollup '%s': measure '%s' is not a numeric attribute", m_sSpec.cstr(), dMeasures[i].cstr());
+				return false;
+			}
+
+			Column_t& tMeasure = m_dMeasures.Add();
+			tMeasure.m_sName = pAttr->m_sName;
+			tMeasure.m_tLocator = pAttr->m_tLocator;
+			tMeasure.m_bFloat = (pAttr->m_eAttrType == ESphAttr::SPH_ATTR_FLOAT);
+		}
+
+		m_iDocinfoStride = DOCINFO_IDSIZE + tSchema.GetRowSize();
+		return true;
+	}
+
+
+	void CSphRollup::Reset()
+	{
+		m_dKeys.Reset();
+		m_dDocinfo.Reset();
+		m_dTotals.Reset();
+		m_iSlotShift = 64 - MIN_SLOTS_SHIFT;
+		m_dSlots.Resize(1 << MIN_SLOTS_SHIFT);
+		m_dSlots.Fill(0);
+	}
+
+
+	int64_t CSphRollup::GetUsedBytes() const
+	{
+		return int64_t(m_dKeys.GetLength()) * sizeof(SphAttr_t) + int64_t(m_dDocinfo.GetLength()) * sizeof(CSphRowitem)
+			+ int64_t(m_dTotals.GetLength()) * sizeof(Total_t) + int64_t(m_dSlots.GetLength()) * sizeof(int);
+	}
+
+
+	void CSphRollup::Build(const DWORD* pDocinfo, int64_t iDocinfo, int iStride)
+	{
+		assert(m_dDims.GetLength());
+		assert(iStride == m_iDocinfoStride);
+		Reset();
+
+		const int iTotals = GetTotalsStride();
+		SphAttr_t dKey[MAX_DIMS];
+
+		for (int64_t i = 0; i < iDocinfo; i++)
+		{
+			const DWORD* pRow = pDocinfo + i * iStride;
+			const CSphRowitem* pAttrs = DOCINFO2ATTRS(pRow);
+			GetKey(pAttrs, dKey);
+
+			int iCell = FindCell(dKey);
+			if (iCell < 0)
+				iCell = AddCell(dKey, DOCINFO2ID(pRow));
+
+			AddTotals(pAttrs, m_dTotals.Begin() + iCell * iTotals, 1);
+		}
+	}
+
+
+	void CSphRollup::AddTotals(const CSphRowitem* pAttrs, Total_t* pTotals, int iSign) const
+	{
+		pTotals[0].m_iValue += iSign;
+		ARRAY_FOREACH(j, m_dMeasures)
+		{
+			const Column_t& tMeasure = m_dMeasures[j];
+			if (tMeasure.m_bFloat)
+				pTotals[j + 1].m_fValue += iSign * sphDW2F((DWORD)sphGetRowAttr(pAttrs, tMeasure.m_tLocator));
+			else
+				pTotals[j + 1].m_iValue += iSign * (int64_t)sphGetRowAttr(pAttrs, tMeasure.m_tLocator);
+		}
+	}
+
+
+	void CSphRollup::Update(const CSphRowitem* pOld, const CSphRowitem* pNew, SphDocID_t uDocid)
+	{
+		const int iTotals = GetTotalsStride();
+		SphAttr_t dKey[MAX_DIMS];
+
+		GetKey(pOld, dKey);
+		int iCell = FindCell(dKey);
+		if (iCell >= 0)
+			AddTotals(pOld, m_dTotals.Begin() + iCell * iTotals, -1);
+
+		// a cell that loses all its rows just stays empty, the way kill-list subtraction leaves them too
+		GetKey(pNew, dKey);
+		iCell = FindCell(dKey);
+		if (iCell < 0)
+			iCell = AddCell(dKey, uDocid);
+		AddTotals(pNew, m_dTotals.Begin() + iCell * iTotals, 1);
+	}
+
+
+	bool CSphRollup::Subtract(const CSphRowitem* pAttrs, CSphVector<Total_t>& dTotals) const
+	{
+		assert(dTotals.GetLength() == m_dTotals.GetLength());
+
+		SphAttr_t dKey[MAX_DIMS];
+		GetKey(pAttrs, dKey);
+		int iCell = FindCell(dKey);
+		if (iCell < 0)
+			return false;
+
+		AddTotals(pAttrs, dTotals.Begin() + iCell * GetTotalsStride(), -1);
+		return true;
+	}
+
+
+	int CSphRollup::GetDimension(const char* sName) const
+	{
+		ARRAY_FOREACH(i, m_dDims)
+			if (m_dDims[i].m_sName == sName)
+				return i;
+		return -1;
+	}
+
+
+	int CSphRollup::GetMeasure(const char* sName) const
+	{
+		ARRAY_FOREACH(i, m_dMeasures)
+			if (m_dMeasures[i].m_sName == sName)
+				return i;
+		return -1;
+	}
+
+
+	void CSphRollup::GetKey(const CSphRowitem* pAttrs, SphAttr_t* pKey) const
+	{
+		ARRAY_FOREACH(i, m_dDims)
+			pKey[i] = sphGetRowAttr(pAttrs, m_dDims[i].m_tLocator);
+	}
+
+
+	int CSphRollup::GetSlot(const SphAttr_t* pKey) const
+	{
+		uint64_t uHash = sphFNV64(pKey, m_dDims.GetLength() * sizeof(SphAttr_t));
+		return int((uHash * U64C(0x9E3779B97F4A7C15)) >> m_iSlotShift);
+	}
+
+
+	int CSphRollup::FindCell(const SphAttr_t* pKey) const
+	{
+		const int iDims = m_dDims.GetLength();
+		const int iMask = m_dSlots.GetLength() - 1;
+		for (int iSlot = GetSlot(pKey);; iSlot = (iSlot + 1) & iMask)
+		{
+			int iCell = m_dSlots[iSlot] - 1;
+			if (iCell < 0)
+				return -1;
+
+			if (!memcmp(m_dKeys.Begin() + iCell * iDims, pKey, iDims * sizeof(SphAttr_t)))
+				return iCell;
+		}
+	}
+
+
+	int CSphRollup::AddCell(const SphAttr_t* pKey, SphDocID_t uDocid)
+	{
+		const int iDims = m_dDims.GetLength();
+		int iCell = GetCells();
+
+		// keep the table at most half full
+		if (2 * (iCell + 1) > m_dSlots.GetLength())
+			Rehash();
+
+		memcpy(m_dKeys.AddN(iDims), pKey, iDims * sizeof(SphAttr_t));
+
+		CSphRowitem* pRow = m_dDocinfo.AddN(m_iDocinfoStride);
+		memset(pRow, 0, m_iDocinfoStride * sizeof(CSphRowitem));
+		DOCINFOSETID(pRow, uDocid);
+		CSphRowitem* pAttrs = DOCINFO2ATTRS(pRow);
+		ARRAY_FOREACH(i, m_dDims)
+			sphSetRowAttr(pAttrs, m_dDims[i].m_tLocator, pKey[i]);
+
+		Total_t* pTotals = m_dTotals.AddN(GetTotalsStride());
+		memset(pTotals, 0, GetTotalsStride() * sizeof(Total_t));
+
+		const int iMask = m_dSlots.GetLength() - 1;
+		int iSlot = GetSlot(pKey);
+		while (m_dSlots[iSlot])
+			iSlot = (iSlot + 1) & iMask;
+		m_dSlots[iSlot] = iCell + 1;
+
+		return iCell;
+	}
+
+
+	void CSphRollup::Rehash()
+	{
+		const int iDims = m_dDims.GetLength();
+		m_iSlotShift--;
+		m_dSlots.Resize(2 * m_dSlots.GetLength());
+		m_dSlots.Fill(0);
+
+		const int iMask = m_dSlots.GetLength() - 1;
+		for (int i = 0; i < GetCells(); i++)
+		{
+			int iSlot = GetSlot(m_dKeys.Begin() + i * iDims);
+			while (m_dSlots[iSlot])
+				iSlot = (iSlot + 1) & iMask;
+			m_dSlots[iSlot] = i + 1;
+		}
+	}
+
+
+	bool sphRollupsSetup(const CSphString& sRollups, const ISphSchema& tSchema, CSphVector<CSphRollup*>& dRollups, CSphString& sError)
+	{
+		// rollup = dim1, dim2 : measure1, measure2; dim3 : measure3
+		CSphVector<CSphString> dSpecs;
+		sphSplit(dSpecs, sRollups.cstr(), ";");
+
+		bool bOk = true;
+		ARRAY_FOREACH(i, dSpecs)
+		{
+			dSpecs[i].Trim();
+			if (dSpecs[i].IsEmpty())
+				continue;
+
+			CSphRollup* pRollup = new CSphRollup();
+			if (!pRollup->Setup(dSpecs[i], tSchema, sError))
+			{
+				SafeDelete(pRollup);
+				bOk = false;
+				continue;
+			}
+			dRollups.Add(pRollup);
+		}
+		return bOk;
+	}
+
+}
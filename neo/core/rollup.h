@@ -0,0 +1,97 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/source/attrib_locator.h"
+#include "neo/source/schema_int.h"
+
+namespace NEO {
+
+	/// pre-aggregated group-by table over a tuple of integer attributes (dimensions)
+	/// keeps a cell per distinct dimensions value, with the row count and the sums of a few numeric attributes (measures);
+	/// every cell also carries a docinfo row with just the dimensions set, so that it can go to the sorter as a regular match
+	class CSphRollup : public ISphNoncopyable
+	{
+	public:
+		/// cell totals, the count first, then a sum per measure
+		union Total_t
+		{
+			int64_t		m_iValue;	///< count, and integer measure sums
+			double		m_fValue;	///< float measure sums
+		};
+
+	public:
+		/// max dimensions per rollup
+		static const int	MAX_DIMS = 16;
+
+		/// cells only get patched while killed rows are under that fraction of the rows (each killed id is a lookup)
+		static const int	KILL_RATIO = 8;
+
+	public:
+		CSphRollup();
+
+		/// parse a "dim1, dim2 : measure1, measure2" tuple against a schema
+		/// dimensions must be integer attributes, measures integer or float ones; measures are optional
+		bool			Setup(const CSphString& sSpec, const ISphSchema& tSchema, CSphString& sError);
+
+		/// count all cells over docinfo rows (docid and attributes)
+		void			Build(const DWORD* pDocinfo, int64_t iDocinfo, int iStride);
+		void			Reset();
+
+		const CSphString&	GetSpec() const { return m_sSpec; }
+		int				GetCells() const { return m_dDocinfo.GetLength() / m_iDocinfoStride; }
+		int64_t			GetUsedBytes() const;
+
+		/// cell docinfo row; docid of the first counted document, then the attributes, all zero but the dimensions
+		const CSphRowitem*	GetDocinfo(int iCell) const { return m_dDocinfo.Begin() + iCell * m_iDocinfoStride; }
+
+		/// totals of all cells, GetTotalsStride() entries per cell
+		const CSphVector<Total_t>&	GetTotals() const { return m_dTotals; }
+		int				GetTotalsStride() const { return 1 + m_dMeasures.GetLength(); }
+
+		/// take a row (attributes, no docid) out of the given totals, eg. for a killed document; false if there is no such cell
+		bool			Subtract(const CSphRowitem* pAttrs, CSphVector<Total_t>& dTotals) const;
+
+		/// move an updated row (attributes, no docid) from the cell of its old values to the one of the new values, adjusting both totals
+		void			Update(const CSphRowitem* pOld, const CSphRowitem* pNew, SphDocID_t uDocid);
+
+		/// column lookups by attribute name, -1 if not found
+		int				GetDimension(const char* sName) const;
+		int				GetMeasure(const char* sName) const;
+		bool			IsFloatMeasure(int iMeasure) const { return m_dMeasures[iMeasure].m_bFloat; }
+
+		/// check whether the cells depend on a given attribute
+		bool			Uses(const char* sAttr) const { return GetDimension(sAttr) >= 0 || GetMeasure(sAttr) >= 0; }
+
+	protected:
+		struct Column_t
+		{
+			CSphString		m_sName;
+			CSphAttrLocator	m_tLocator;
+			bool			m_bFloat;
+		};
+
+		static const int		MIN_SLOTS_SHIFT = 6;
+
+		CSphString				m_sSpec;
+		CSphVector<Column_t>	m_dDims;
+		CSphVector<Column_t>	m_dMeasures;
+		int						m_iDocinfoStride;	///< docid plus attribute row size
+
+		CSphVector<SphAttr_t>	m_dKeys;		///< dimension values, m_dDims entries per cell
+		CSphVector<CSphRowitem>	m_dDocinfo;		///< cell docinfo rows
+		CSphVector<Total_t>		m_dTotals;		///< cell totals
+		CSphVector<int>			m_dSlots;		///< open-addressing table, cell index plus 1, or 0 for empty slots
+		int						m_iSlotShift;
+
+		void			GetKey(const CSphRowitem* pAttrs, SphAttr_t* pKey) const;
+		void			AddTotals(const CSphRowitem* pAttrs, Total_t* pTotals, int iSign) const;
+		int				FindCell(const SphAttr_t* pKey) const;
+		int				AddCell(const SphAttr_t* pKey, SphDocID_t uDocid);
+		int				GetSlot(const SphAttr_t* pKey) const;
+		void			Rehash();
+	};
+
+	/// parse semicolon separated rollup tuples (as per rollup directive) against a schema
+	/// good tuples are added to dRollups (unbuilt) even if some others fail; returns false and the last problem if any did
+	bool sphRollupsSetup(const CSphString& sRollups, const ISphSchema& tSchema, CSphVector<CSphRollup*>& dRollups, CSphString& sError);
+
+}
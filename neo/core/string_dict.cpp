@@ -0,0 +1,222 @@
+#include "neo/core/string_dict.h"
+#include "neo/io/fnv64.h"
+#include "neo/tools/utf8_tools.h"
+
+#include <cstring>
+
+namespace NEO {
+
+	static inline int64_t StringDictKey(const BYTE* pStr, int iLen)
+	{
+		// keep clear of CSphHash reserved keys
+		return int64_t(sphFNV64(pStr, iLen) >> 2);
+	}
+
+
+	/// bytewise order of packed pool values
+	struct StringDictCmp_fn
+	{
+		const BYTE* m_pPool;
+		const CSphVector<DWORD>& m_dOffsets;
+
+		StringDictCmp_fn(const BYTE* pPool, const CSphVector<DWORD>& dOffsets)
+			: m_pPool(pPool)
+			, m_dOffsets(dOffsets)
+		{}
+
+		inline bool IsLess(int a, int b) const
+		{
+			return sphCollateBinary(m_pPool + m_dOffsets[a], m_pPool + m_dOffsets[b], true) < 0;
+		}
+	};
+
+
+	CSphStringDictBuilder::CSphStringDictBuilder()
+		: m_hValues(1024)
+	{}
+
+
+	void CSphStringDictBuilder::Reset()
+	{
+		m_dPool.Reset();
+		m_dOffsets.Reset();
+		m_dNext.Reset();
+		m_hValues.Reset(1024);
+	}
+
+
+	DWORD CSphStringDictBuilder::Add(const BYTE* pStr, int iLen)
+	{
+		if (!iLen)
+			return 0;
+
+		int64_t iKey = StringDictKey(pStr, iLen);
+		int* pHead = m_hValues.Find(iKey);
+
+		// walk the chain, hash collisions are rare but possible
+		for (int iId = pHead ? *pHead : 0; iId; iId = m_dNext[iId - 1])
+		{
+			const BYTE* pVal = NULL;
+			int iValLen = sphUnpackStr(m_dPool.Begin() + m_dOffsets[iId - 1], &pVal);
+			if (iValLen == iLen && memcmp(pVal, pStr, iLen) == 0)
+				return iId;
+		}
+
+		// new value
+		m_dOffsets.Add(m_dPool.GetLength());
+		m_dNext.Add(pHead ? *pHead : 0);
+
+		BYTE dPackedLen[4];
+		int iLenLen = sphPackStrlen(dPackedLen, iLen);
+		BYTE* pDst = m_dPool.AddN(iLenLen + iLen);
+		memcpy(pDst, dPackedLen, iLenLen);
+		memcpy(pDst + iLenLen, pStr, iLen);
+
+		int iId = m_dOffsets.GetLength();
+		if (pHead)
+			*pHead = iId;
+		else
+			m_hValues.Add(iKey, iId);
+		return iId;
+	}
+
+
+	bool CSphStringDictBuilder::Save(CSphWriter& tWriter, CSphVector<DWORD>& dRemap, DWORD& uEnd, CSphString& sError) const
+	{
+		CSphVector<int> dOrder(m_dOffsets.GetLength());
+		ARRAY_FOREACH(i, dOrder)
+			dOrder[i] = i;
+		dOrder.Sort(StringDictCmp_fn(m_dPool.Begin(), m_dOffsets));
+
+		// slot 0 is reserved for empty values
+		dRemap.Resize(m_dOffsets.GetLength() + 1);
+		dRemap[0] = 0;
+
+		ARRAY_FOREACH(i, dOrder)
+		{
+			SphOffset_t uOff = tWriter.GetPos();
+			if (uint64_t(uOff) >> 32)
+			{
+				sError.SetSprintf("too many string attributes (current index format allows up to 4 GB)");
+				return false;
+			}
+
+			int iId = dOrder[i];
+			const BYTE* pVal = m_dPool.Begin() + m_dOffsets[iId];
+			const BYTE* pStr = NULL;
+			int iLen = sphUnpackStr(pVal, &pStr);
+			tWriter.PutBytes(pVal, int(pStr - pVal) + iLen);
+			dRemap[iId + 1] = DWORD(uOff);
+		}
+
+		SphOffset_t uOff = tWriter.GetPos();
+		if (uint64_t(uOff) >> 32)
+		{
+			sError.SetSprintf("too many string attributes (current index format allows up to 4 GB)");
+			return false;
+		}
+		uEnd = DWORD(uOff);
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	CSphStringDict::CSphStringDict()
+		: m_pPool(NULL)
+		, m_uEnd(0)
+	{}
+
+
+	void CSphStringDict::Reset()
+	{
+		m_pPool = NULL;
+		m_uEnd = 0;
+		m_dEntries.Reset();
+	}
+
+
+	bool CSphStringDict::Setup(const BYTE* pPool, DWORD uEnd, CSphString& sError)
+	{
+		Reset();
+		if (uEnd <= 1)
+			return true;
+
+		if (!pPool)
+		{
+			sError.SetSprintf("string dictionary is not empty (end=%u) but strings are not loaded", uEnd);
+			return false;
+		}
+
+		DWORD uOff = 1;
+		while (uOff < uEnd)
+		{
+			const BYTE* pStr = NULL;
+			int iLen = sphUnpackStr(pPool + uOff, &pStr);
+			if (!iLen)
+			{
+				sError.SetSprintf("broken string dictionary (empty entry at offset %u)", uOff);
+				m_dEntries.Reset();
+				return false;
+			}
+			m_dEntries.Add(uOff);
+			uOff = DWORD(pStr - pPool) + iLen;
+		}
+
+		if (uOff != uEnd)
+		{
+			sError.SetSprintf("broken string dictionary (last entry ends at %u, expected %u)", uOff, uEnd);
+			m_dEntries.Reset();
+			return false;
+		}
+
+		m_pPool = pPool;
+		m_uEnd = uEnd;
+		return true;
+	}
+
+
+	int CSphStringDict::FindEntry(SphAttr_t uOffset) const
+	{
+		if (!Contains(uOffset))
+			return -1;
+		const DWORD* pEntry = m_dEntries.BinarySearch(DWORD(uOffset));
+		return pEntry ? int(pEntry - m_dEntries.Begin()) : -1;
+	}
+
+
+	void CSphStringDict::FindMatching(const BYTE* pStr, int iLen, SphStringCmp_fn fnCmp, CSphVector<SphAttr_t>& dOffsets) const
+	{
+		dOffsets.Resize(0);
+		if (IsEmpty())
+			return;
+
+		// collation functions compare either both packed or both asciiz values
+		CSphVector<BYTE> dRef(iLen + 4);
+		int iLenLen = sphPackStrlen(dRef.Begin(), iLen);
+		memcpy(dRef.Begin() + iLenLen, pStr, iLen);
+		const BYTE* pRef = dRef.Begin();
+
+		// entries are in bytewise order, so binary collation can bisect
+		if (fnCmp == sphCollateBinary)
+		{
+			int iL = 0, iR = m_dEntries.GetLength();
+			while (iL < iR)
+			{
+				int iM = iL + (iR - iL) / 2;
+				if (sphCollateBinary(m_pPool + m_dEntries[iM], pRef, true) < 0)
+					iL = iM + 1;
+				else
+					iR = iM;
+			}
+			if (iL < m_dEntries.GetLength() && sphCollateBinary(m_pPool + m_dEntries[iL], pRef, true) == 0)
+				dOffsets.Add(m_dEntries[iL]);
+			return;
+		}
+
+		// other collations might fold several distinct entries into one value
+		ARRAY_FOREACH(i, m_dEntries)
+			if (fnCmp(m_pPool + m_dEntries[i], pRef, true) == 0)
+				dOffsets.Add(m_dEntries[i]);
+	}
+
+}
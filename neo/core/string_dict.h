@@ -0,0 +1,74 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/utility/hash.h"
+#include "neo/io/writer.h"
+
+namespace NEO {
+
+	/// string collation function (see tools/utf8_tools.h)
+	typedef int(*SphStringCmp_fn)(const BYTE* pStr1, const BYTE* pStr2, bool bPacked);
+
+
+	/// per-index string attribute dictionary builder
+	/// collects distinct values of dictionary-encoded string attributes at indexing time
+	class CSphStringDictBuilder : public ISphNoncopyable
+	{
+	public:
+		CSphStringDictBuilder();
+
+		/// add a value, returns 1-based provisional id (the same for the same bytes), or 0 for empty values
+		DWORD			Add(const BYTE* pStr, int iLen);
+
+		/// sort and save the distinct values, fill provisional id to final offset remap
+		/// dictionary entries are written in packed string format, right at the current writer position
+		bool			Save(CSphWriter& tWriter, CSphVector<DWORD>& dRemap, DWORD& uEnd, CSphString& sError) const;
+
+		int				GetLength() const { return m_dOffsets.GetLength(); }
+		void			Reset();
+
+	protected:
+		CSphVector<BYTE>		m_dPool;		///< packed distinct values
+		CSphVector<DWORD>		m_dOffsets;		///< value offsets in pool, by provisional id-1
+		CSphVector<int>			m_dNext;		///< next value with the same hash key, by provisional id-1
+		CSphHash<int>			m_hValues;		///< value hash key to provisional id of the chain head
+	};
+
+
+	/// per-index string attribute dictionary reader
+	/// the dictionary occupies [1,end) offsets of the string pool, and holds distinct values in bytewise order;
+	/// string attributes keep regular offsets, so any offset within the dictionary region is also an order-preserving value code
+	class CSphStringDict
+	{
+	public:
+		CSphStringDict();
+
+		bool			Setup(const BYTE* pPool, DWORD uEnd, CSphString& sError);
+		void			Reset();
+
+		bool			IsEmpty() const { return m_dEntries.GetLength() == 0; }
+		int				GetLength() const { return m_dEntries.GetLength(); }
+		DWORD			GetEnd() const { return m_uEnd; }
+		const BYTE*		GetPool() const { return m_pPool; }
+
+		/// check whether a string attribute value (ie. offset) is a dictionary code
+		inline bool		Contains(SphAttr_t uOffset) const { return uOffset > 0 && uOffset < m_uEnd; }
+
+		/// check whether a string pointer points into the dictionary region
+		inline bool		ContainsPtr(const BYTE* pStr) const { return m_pPool && pStr > m_pPool && pStr < m_pPool + m_uEnd; }
+
+		/// dictionary entry offset by its index
+		inline DWORD	GetEntry(int iEntry) const { return m_dEntries[iEntry]; }
+
+		/// entry index by offset, -1 if the offset is not an entry start
+		int				FindEntry(SphAttr_t uOffset) const;
+
+		/// collect offsets of all entries equal to a given (unpacked) string under a given collation
+		void			FindMatching(const BYTE* pStr, int iLen, SphStringCmp_fn fnCmp, CSphVector<SphAttr_t>& dOffsets) const;
+
+	protected:
+		const BYTE*				m_pPool;
+		DWORD					m_uEnd;
+		CSphVector<DWORD>		m_dEntries;		///< entry offsets, ascending (and therefore sorted by value)
+	};
+
+}
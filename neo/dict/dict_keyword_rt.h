@@ -71,7 +71,7 @@ namespace NEO {
 			m_hKeywords.Reset();
 		}
 
-		SphWordID_t AddKeyword(const BYTE* pWord)
+		virtual SphWordID_t AddKeyword(const BYTE* pWord)
 		{
 			int iLen = strlen((const char*)pWord);
 			// stemmer might squeeze out the word
@@ -44,7 +44,8 @@ namespace NEO {
 		SPH_EXPR_SET_STRING_POOL,
 		SPH_EXPR_SET_EXTRA_DATA,
 		SPH_EXPR_GET_DEPENDENT_COLS, ///< used to determine proper evaluating stage
-		SPH_EXPR_GET_UDF
+		SPH_EXPR_GET_UDF,
+		SPH_EXPR_GET_GEODIST		///< geodist() over attributes vs a constant anchor fills GeodistInfo_t, for spatial pruning
 	};
 
 	enum ESphFactor
@@ -29,6 +29,9 @@ namespace NEO {
 		, m_bLocalDF(false)
 		, m_pLocalDocs(NULL)
 		, m_iTotalDocs(0)
+		, m_pDeadRows(NULL)
+		, m_pSorterFactory(NULL)
+		, m_iThreads(1)
 	{
 		assert(iIndexWeight > 0);
 	}
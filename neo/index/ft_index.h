@@ -51,6 +51,10 @@ namespace NEO {
 		int64_t			m_iRamChunkSize; // not used for plain
 		int				m_iNumChunks; // not used for plain
 		int64_t			m_iMemLimit; // not used for plain
+		int				m_iRamSegments; // not used for plain
+		int				m_iMergeBacklog; // not used for plain
+		int64_t			m_iFlushedBytes; // not used for plain; disk chunk bytes saved from RAM
+		int64_t			m_iCompactedBytes; // not used for plain; disk chunk bytes rewritten by merges
 
 		CSphIndexStatus()
 			: m_iRamUse(0)
@@ -58,10 +62,24 @@ namespace NEO {
 			, m_iRamChunkSize(0)
 			, m_iNumChunks(0)
 			, m_iMemLimit(0)
+			, m_iRamSegments(0)
+			, m_iMergeBacklog(0)
+			, m_iFlushedBytes(0)
+			, m_iCompactedBytes(0)
 		{}
 	};
 
 
+	/// makes more sorters for a query, just like the one it was given, eg. for an index to search its parts on several threads
+	struct ISphSorterFactory
+	{
+		virtual ~ISphSorterFactory() {}
+
+		/// NULL if the query sorter can not be recreated (the caller then has to make do with the one it has)
+		virtual ISphMatchSorter* CreateSorter(const CSphQuery& tQuery) const = 0;
+	};
+
+
 	struct CSphMultiQueryArgs : public ISphNoncopyable
 	{
 		const KillListVector& m_dKillList;
@@ -71,6 +89,9 @@ namespace NEO {
 		bool									m_bLocalDF;
 		const SmallStringHash_T<int64_t>* m_pLocalDocs;
 		int64_t									m_iTotalDocs;
+		const CSphBitvec* m_pDeadRows;		///< docinfo rows to skip on top of the kill-list, by row number (NULL if none)
+		const ISphSorterFactory* m_pSorterFactory;	///< NULL if the index must stick to the given sorters
+		int										m_iThreads;			///< how many threads the index may search on
 
 		CSphMultiQueryArgs(const KillListVector& dKillList, int iIndexWeight);
 	};
@@ -117,6 +138,9 @@ namespace NEO {
 		virtual SphDocID_t* GetKillList() const = 0;
 		virtual int					GetKillListSize() const = 0;
 		virtual bool				HasDocid(SphDocID_t uDocid) const = 0;
+
+		/// mark the docinfo rows of the given (sorted) documents, and tell how many got marked; -1 if the index has no such rows
+		virtual int64_t				MarkDocinfoRows(const SphDocID_t*, int, CSphBitvec&) const { return -1; }
 		virtual bool				IsRT() const { return false; }
 		void						SetBinlog(bool bBinlog) { m_bBinlog = bBinlog; }
 		virtual int64_t* GetFieldLens() const { return NULL; }
@@ -261,6 +285,9 @@ namespace NEO {
 
 	public:
 		void						SetGlobalIDFPath(const CSphString& sPath) { m_sGlobalIDFPath = sPath; }
+		void						SetGeoIndex(const CSphString& sSpec) { m_tSettings.m_sGeoIndex = sSpec; }	///< for headers that do not store it; must be called before Preread()
+		void						SetRollups(const CSphString& sSpec) { m_tSettings.m_sRollups = sSpec; }	///< same as SetGeoIndex()
+		void						SetJsonAttrs(const CSphString& sSpec) { m_tSettings.m_sJsonAttrs = sSpec; }	///< same as SetGeoIndex()
 		float						GetGlobalIDF(const CSphString& sWord, int64_t iDocsLocal, bool bPlainIDF) const;
 
 	protected:
@@ -284,9 +311,16 @@ namespace NEO {
 
 
 
-	/// convert queue to sorted array, and add its entries to result's matches array
+	/// convert queue to sorted array, and add its entries to result's matches array, and its arena size to result's meta
 	int					sphFlattenQueue(ISphMatchSorter* pQueue, CSphQueryResult* pResult, int iTag);
 
+	/// merge the result sets of several sources into a sorter, dropping the duplicate docids (or grouping the groups again)
+	/// dMatchCounts are the source set sizes, in source order; given partition sorters, the matches get split over them
+	/// by docid (or group key), and merged on a thread per partition; those sorters get freed
+	/// returns the number of dupes
+	int					sphMergeDupes(ISphMatchSorter* pSorter, CSphVector<ISphMatchSorter*>& dParts, CSphSwapVector<CSphMatch>& dMatches,
+		const CSphVector<int>& dMatchCounts, const ISphSchema& tSchema, int64_t& iArenaBytes);
+
 	/// setup per-keyword read buffer sizes
 	void				sphSetReadBuffers(int iReadBuffer, int iReadUnhinted);
 
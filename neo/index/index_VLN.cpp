@@ -11,6 +11,8 @@
 #include "neo/core/version.h"
 #include "neo/core/build_header.h"
 #include "neo/core/arena.h"
+#include "neo/core/mva_pack.h"
+#include "neo/source/json_attrs.h"
 #include "neo/core/hit_builder.h"
 #include "neo/core/ranker.h"
 #include "neo/core/build_header.h"
@@ -41,12 +43,20 @@
 #include "neo/sphinx/xquery.h"
 #include "neo/sphinx/xfilter.h"
 #include "neo/sphinx/xsearch.h"
+#include "neo/sphinx/xutility.h"
 
 
 namespace NEO {
 
 volatile int CSphIndex_VLN::m_iIndexTagSeq = 0;
 
+/// updated MVA frees between arena compaction passes
+static const int MVA_COMPACT_THRESH = 1024;
+
+/// packed persistent MVA file marker; legacy files start right with the affected docs count
+static const DWORD MVP_PACKED_MAGIC = 0xffffffffUL;
+static const DWORD MVP_PACKED_VERSION = 1;
+
 CSphString CSphIndex_VLN::GetIndexFileName ( const char * sExt ) const
 {
 	CSphString sRes;
@@ -110,6 +120,19 @@ bool CSphIndex_VLN::WriteHeader ( const BuildHeader_t & tBuildHeader, CSphWriter
 		ARRAY_FOREACH ( i, m_tSchema.m_dFields )
 			fdInfo.PutOffset ( m_dFieldLens[i] );
 
+	// string attribute dictionary
+	fdInfo.PutString ( m_tSettings.m_sStringDictAttrs );
+	fdInfo.PutDword ( tBuildHeader.m_uStringDictEnd );
+
+	// generated attributes
+	fdInfo.PutString ( m_tSettings.m_sJsonAttrs );
+
+	// spatial indexes
+	fdInfo.PutString ( m_tSettings.m_sGeoIndex );
+
+	// rollups
+	fdInfo.PutString ( m_tSettings.m_sRollups );
+
 	return true;
 }
 
@@ -158,10 +181,14 @@ CSphIndex_VLN::CSphIndex_VLN ( const char* sIndexName, const char * sFilename )
 
 	m_iMinMaxIndex = 0;
 	m_iIndexTag = -1;
+	m_iMvaFreed = 0;
 	m_uMinDocid = 0;
+	m_uStringDictEnd = 0;
 
 	ARRAY_FOREACH ( i, m_dFieldLens )
 		m_dFieldLens[i] = 0;
+
+	Verify ( m_tCellsLock.Init() );
 }
 
 
@@ -170,11 +197,42 @@ CSphIndex_VLN::~CSphIndex_VLN ()
 	if ( m_iIndexTag>=0 && g_pMvaArena )
 		g_tMvaArena.TaggedFreeTag ( m_iIndexTag );
 
+	ResetGeoIndexes();
+	ResetRollups();
 	Unlock();
+	Verify ( m_tCellsLock.Done() );
 }
 
 
 
+/// widen the docinfo block and index ranges of an attribute to cover an updated value
+static void UpdateDocinfoRanges ( DWORD * pBlockRanges, DWORD * pIndexRanges, int iRowStride, const CSphAttrLocator & tLoc, SphAttr_t uValue, bool bFloat )
+{
+	for ( int i=0; i<2; i++ )
+	{
+		DWORD * pBlock = i ? pBlockRanges : pIndexRanges;
+		SphAttr_t uMin = sphGetRowAttr ( DOCINFO2ATTRS ( pBlock ), tLoc );
+		SphAttr_t uMax = sphGetRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ) , tLoc );
+		if ( bFloat ) // update float's indexes assumes float comparision
+		{
+			float fValue = sphDW2F ( (DWORD) uValue );
+			float fMin = sphDW2F ( (DWORD) uMin );
+			float fMax = sphDW2F ( (DWORD) uMax );
+			if ( fValue<fMin )
+				sphSetRowAttr ( DOCINFO2ATTRS ( pBlock ), tLoc, sphF2DW ( fValue ) );
+			if ( fValue>fMax )
+				sphSetRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ), tLoc, sphF2DW ( fValue ) );
+		} else // update usual integers
+		{
+			if ( uValue<uMin )
+				sphSetRowAttr ( DOCINFO2ATTRS ( pBlock ), tLoc, uValue );
+			if ( uValue>uMax )
+				sphSetRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ), tLoc, uValue );
+		}
+	}
+}
+
+
 int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphString & sError, CSphString & sWarning )
 {
 	// check if we can
@@ -204,6 +262,14 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 	CSphVector < CSphRefcountedPtr<ISphExpr> > dExpr ( iUpdLen );
 	memset ( dLocators.Begin(), 0, dLocators.GetSizeBytes() );
 
+	// JSON paths that got generated attributes would parse into those, but updates need the blob values
+	CSphSchema tJsonSchema;
+	if ( m_dJsonAttrs.GetLength() )
+	{
+		tJsonSchema = m_tSchema;
+		sphJsonAttrsUntag ( tJsonSchema );
+	}
+
 	uint64_t uDst64 = 0;
 	ARRAY_FOREACH ( i, tUpd.m_dAttrs )
 	{
@@ -216,14 +282,21 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 			{
 				iIdx = m_tSchema.GetAttrIndex ( sJsonCol.cstr() );
 				if ( iIdx>=0 )
-					dExpr[i] = sphExprParse ( tUpd.m_dAttrs[i], m_tSchema, NULL, NULL, sError, NULL );
+					dExpr[i] = sphExprParse ( tUpd.m_dAttrs[i], m_dJsonAttrs.GetLength() ? tJsonSchema : m_tSchema, NULL, NULL, sError, NULL );
 			}
 		}
 
 		if ( iIdx>=0 )
 		{
-			// forbid updates on non-int columns
+			// generated attributes follow their JSON values, and only those
 			const CSphColumnInfo & tCol = m_tSchema.GetAttr(iIdx);
+			if ( !tCol.m_sJsonPath.IsEmpty() )
+			{
+				sError.SetSprintf ( "attribute '%s' is generated from JSON path '%s' and can not be updated directly", tUpd.m_dAttrs[i], tCol.m_sJsonPath.cstr() );
+				return -1;
+			}
+
+			// forbid updates on non-int columns
 			if ( !( tCol.m_eAttrType==ESphAttr::SPH_ATTR_BOOL || tCol.m_eAttrType==ESphAttr::SPH_ATTR_INTEGER || tCol.m_eAttrType==ESphAttr::SPH_ATTR_TIMESTAMP
 				|| tCol.m_eAttrType==ESphAttr::SPH_ATTR_UINT32SET || tCol.m_eAttrType==ESphAttr::SPH_ATTR_INT64SET
 				|| tCol.m_eAttrType==ESphAttr::SPH_ATTR_BIGINT || tCol.m_eAttrType==ESphAttr::SPH_ATTR_FLOAT || tCol.m_eAttrType==ESphAttr::SPH_ATTR_JSON ))
@@ -439,9 +512,43 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 	DWORD uUpdateMask = 0;
 	int iJsonWarnings = 0;
 
+	// spatial indexes keep their own copy of coordinates, so moved rows have to be moved there, too
+	// that needs their old attributes, so those are saved as we go
+	// generated attributes of the updated JSON values might change, too
+	bool bJsonAttrs = ( m_dJsonAttrs.GetLength() && dJsonFields.BitCount() );
+	CSphVector<CSphGeoIndex*> dGeoUpdates;
+	ARRAY_FOREACH ( i, m_dGeoIndexes )
+	{
+		bool bUses = ARRAY_ANY ( bUses, tUpd.m_dAttrs, dFloats.BitGet ( _any ) && m_dGeoIndexes[i]->Uses ( dLocators[_any] ) );
+		if ( !bUses && bJsonAttrs )
+		{
+			bUses = ARRAY_ANY ( bUses, m_dJsonAttrs, m_dGeoIndexes[i]->Uses ( m_dJsonAttrs[_any].m_tLocator ) );
+		}
+		if ( bUses )
+			dGeoUpdates.Add ( m_dGeoIndexes[i] );
+	}
+
+	// rollups count attribute values, so the rows move between their cells, too
+	CSphVector<CSphRollup*> dRollupUpdates;
+	ARRAY_FOREACH ( i, m_dRollups )
+	{
+		bool bUses = ARRAY_ANY ( bUses, tUpd.m_dAttrs, m_dRollups[i]->Uses ( tUpd.m_dAttrs[_any] ) );
+		if ( !bUses && bJsonAttrs )
+		{
+			bUses = ARRAY_ANY ( bUses, m_dJsonAttrs, m_dRollups[i]->Uses ( m_dJsonAttrs[_any].m_sName.cstr() ) );
+		}
+		if ( bUses )
+			dRollupUpdates.Add ( m_dRollups[i] );
+	}
+
+	CSphVector<DWORD> dCellRows;
+	CSphVector<CSphRowitem> dCellOldAttrs;
+	bool bCellUpdates = ( dGeoUpdates.GetLength()>0 || dRollupUpdates.GetLength()>0 );
+
 	for ( int iUpd=iFirst; iUpd<iLast; iUpd++ )
 	{
 		bool bUpdated = false;
+		bool bJsonUpdated = false;
 
 		DWORD * pEntry = dRowPtrs[iUpd];
 		if ( !pEntry )
@@ -452,6 +559,12 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 		DWORD * pIndexRanges = m_pDocinfoIndex + ( m_iDocinfoIndex * iRowStride * 2 );
 		assert ( iBlock>=0 && iBlock<m_iDocinfoIndex );
 
+		if ( bCellUpdates )
+		{
+			dCellRows.Add ( DWORD ( ( pEntry-m_tAttr.GetWritePtr() ) / iRowStride ) );
+			memcpy ( dCellOldAttrs.AddN ( m_tSchema.GetRowSize() ), DOCINFO2ATTRS ( pEntry ), sizeof(CSphRowitem)*m_tSchema.GetRowSize() );
+		}
+
 		pEntry = DOCINFO2ATTRS(pEntry);
 
 		int iPos = tUpd.m_dRowOffset[iUpd];
@@ -474,28 +587,7 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 				sphSetRowAttr ( pEntry, dLocators[iCol], uValue );
 
 				// update block and index ranges
-				for ( int i=0; i<2; i++ )
-				{
-					DWORD * pBlock = i ? pBlockRanges : pIndexRanges;
-					SphAttr_t uMin = sphGetRowAttr ( DOCINFO2ATTRS ( pBlock ), dLocators[iCol] );
-					SphAttr_t uMax = sphGetRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ) , dLocators[iCol] );
-					if ( dFloats.BitGet ( iCol ) ) // update float's indexes assumes float comparision
-					{
-						float fValue = sphDW2F ( (DWORD) uValue );
-						float fMin = sphDW2F ( (DWORD) uMin );
-						float fMax = sphDW2F ( (DWORD) uMax );
-						if ( fValue<fMin )
-							sphSetRowAttr ( DOCINFO2ATTRS ( pBlock ), dLocators[iCol], sphF2DW ( fValue ) );
-						if ( fValue>fMax )
-							sphSetRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ), dLocators[iCol], sphF2DW ( fValue ) );
-					} else // update usual integers
-					{
-						if ( uValue<uMin )
-							sphSetRowAttr ( DOCINFO2ATTRS ( pBlock ), dLocators[iCol], uValue );
-						if ( uValue>uMax )
-							sphSetRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ), dLocators[iCol], uValue );
-					}
-				}
+				UpdateDocinfoRanges ( pBlockRanges, pIndexRanges, iRowStride, dLocators[iCol], uValue, dFloats.BitGet ( iCol ) );
 
 				bUpdated = true;
 				uUpdateMask |= ATTRS_UPDATED;
@@ -518,6 +610,7 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 				if ( sphJsonInplaceUpdate ( eType, uValue, dExpr[iCol].Ptr(), m_tString.GetWritePtr(), pEntry, true ) )
 				{
 					bUpdated = true;
+					bJsonUpdated = true;
 					uUpdateMask |= ATTRS_STRINGS_UPDATED;
 
 				} else
@@ -601,16 +694,45 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 			{
 				uOldIndex = ((DWORD*)((SphDocID_t*)(g_pMvaArena + (uOldIndex & MVA_OFFSET_MASK))-1))-g_pMvaArena;
 				g_tMvaArena.TaggedFreeIndex ( m_iIndexTag, uOldIndex );
+				m_iMvaFreed++;
 			}
 
 			bUpdated = true;
 			uUpdateMask |= ATTRS_MVA_UPDATED;
 		}
 
+		// generated attributes follow their JSON values
+		if ( bJsonUpdated && m_dJsonAttrs.GetLength() )
+		{
+			sphJsonAttrsRefresh ( pEntry, m_dJsonAttrs, m_tSchema, m_tString.GetWritePtr() );
+			ARRAY_FOREACH ( i, m_dJsonAttrs )
+			{
+				const CSphJsonAttr & tAttr = m_dJsonAttrs[i];
+				UpdateDocinfoRanges ( pBlockRanges, pIndexRanges, iRowStride, tAttr.m_tLocator, sphGetRowAttr ( pEntry, tAttr.m_tLocator ),
+					tAttr.m_eType==ESphAttr::SPH_ATTR_FLOAT );
+			}
+			uUpdateMask |= ATTRS_UPDATED;
+		}
+
 		if ( bUpdated )
 			iUpdated++;
 	}
 
+	// patch the cells of the updated rows; searchers might be reading them meanwhile, hence the lock
+	if ( dCellRows.GetLength() )
+	{
+		CSphScopedWLock tCellsLock ( m_tCellsLock );
+		ARRAY_FOREACH ( i, dCellRows )
+		{
+			const CSphRowitem * pOld = dCellOldAttrs.Begin() + i*m_tSchema.GetRowSize();
+			const CSphRowitem * pNew = DOCINFO2ATTRS ( m_tAttr.GetWritePtr() + int64_t ( dCellRows[i] )*iRowStride );
+			ARRAY_FOREACH ( j, dGeoUpdates )
+				dGeoUpdates[j]->Update ( dCellRows[i], pOld, pNew );
+			ARRAY_FOREACH ( j, dRollupUpdates )
+				dRollupUpdates[j]->Update ( pOld, pNew, DOCINFO2ID ( pNew-DOCINFO_IDSIZE ) );
+		}
+	}
+
 	if ( iJsonWarnings>0 )
 	{
 		sWarning.SetSprintf ( "%d attribute(s) can not be updated (not found or incompatible types)", iJsonWarnings );
@@ -626,9 +748,67 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 
 	m_uAttrsStatus |= uUpdateMask; // FIXME! add lock/atomic?
 
+	// repeated updates leave the arena sparse, repack once enough was freed
+	if ( m_iMvaFreed>=MVA_COMPACT_THRESH )
+		CompactUpdatedMVA();
+
 	return iUpdated;
 }
 
+
+/// repoints docinfo rows to MVA values moved by the arena compaction
+class MvaRelocator_c : public tRelocator
+{
+public:
+	MvaRelocator_c ( const CSphIndex_VLN * pIndex, const CSphVector<CSphAttrLocator> & dLocators )
+		: m_pIndex ( pIndex )
+		, m_dLocators ( dLocators )
+	{}
+
+	virtual void Relocate ( int iOldIndex, int iNewIndex )
+	{
+		// arena allocs are [docid][count][values], and rows point right past the docid
+		SphDocID_t uDocid = *(const SphDocID_t *)( g_pMvaArena + iNewIndex );
+		DWORD * pRow = const_cast<DWORD *> ( m_pIndex->FindDocinfo ( uDocid ) );
+		if ( !pRow )
+			return;
+
+		DWORD * pAttrs = DOCINFO2ATTRS ( pRow );
+		DWORD uOld = DWORD ( iOldIndex + DOCINFO_IDSIZE ) | MVA_ARENA_FLAG;
+		DWORD uNew = DWORD ( iNewIndex + DOCINFO_IDSIZE ) | MVA_ARENA_FLAG;
+		ARRAY_FOREACH ( i, m_dLocators )
+			if ( MVA_DOWNSIZE ( sphGetRowAttr ( pAttrs, m_dLocators[i] ) )==uOld )
+				sphSetRowAttr ( pAttrs, m_dLocators[i], uNew );
+	}
+
+protected:
+	const CSphIndex_VLN *				m_pIndex;
+	const CSphVector<CSphAttrLocator> &	m_dLocators;
+};
+
+
+void CSphIndex_VLN::CompactUpdatedMVA ()
+{
+	m_iMvaFreed = 0;
+	if ( m_iIndexTag<0 || !g_pMvaArena )
+		return;
+
+	CSphVector<CSphAttrLocator> dMvaLocators;
+	for ( int i=0; i<m_tSchema.GetAttrsCount(); i++ )
+	{
+		const CSphColumnInfo & tCol = m_tSchema.GetAttr(i);
+		if ( tCol.m_eAttrType==ESphAttr::SPH_ATTR_UINT32SET || tCol.m_eAttrType==ESphAttr::SPH_ATTR_INT64SET )
+			dMvaLocators.Add ( tCol.m_tLocator );
+	}
+
+	if ( !dMvaLocators.GetLength() )
+		return;
+
+	MvaRelocator_c tRelocator ( this, dMvaLocators );
+	g_tMvaArena.TaggedCompact ( m_iIndexTag, &tRelocator );
+}
+
+
 bool CSphIndex_VLN::LoadPersistentMVA ( CSphString & sError )
 {
 	// prepare the file to load
@@ -653,6 +833,17 @@ bool CSphIndex_VLN::LoadPersistentMVA ( CSphString & sError )
 	}
 
 	DWORD uDocs = fdReader.GetDword();
+	bool bPacked = ( uDocs==MVP_PACKED_MAGIC );
+	if ( bPacked )
+	{
+		DWORD uVersion = fdReader.GetDword();
+		if ( uVersion>MVP_PACKED_VERSION )
+		{
+			sError.SetSprintf ( "%s is v.%d, binary is v.%d", GetIndexFileName("mvp").cstr(), uVersion, MVP_PACKED_VERSION );
+			return false;
+		}
+		uDocs = fdReader.GetDword();
+	}
 
 	// if we have docs to update
 	if ( !uDocs )
@@ -669,9 +860,7 @@ bool CSphIndex_VLN::LoadPersistentMVA ( CSphString & sError )
 		if ( tAttr.m_eAttrType==ESphAttr::SPH_ATTR_UINT32SET )
 			dMvaLocators.Add ( tAttr.m_tLocator );
 	}
-#ifndef NDEBUG
 	int iMva64 = dMvaLocators.GetLength();
-#endif
 	for ( int i=0; i<m_tSchema.GetAttrsCount(); i++ )
 	{
 		const CSphColumnInfo & tAttr = m_tSchema.GetAttr(i);
@@ -703,6 +892,7 @@ bool CSphIndex_VLN::LoadPersistentMVA ( CSphString & sError )
 	CSphVector<DWORD*> dRowPtrs ( uDocs );
 	CSphVector<int> dAllocs;
 	dAllocs.Reserve ( uDocs );
+	CSphVector<BYTE> dPacked;
 
 	// prealloc values (and also preload)
 	bool bFailed = false;
@@ -716,7 +906,15 @@ bool CSphIndex_VLN::LoadPersistentMVA ( CSphString & sError )
 			// if this MVA was updated
 			if ( MVA_DOWNSIZE ( sphGetRowAttr ( pDocinfo, dMvaLocators[j] ) ) & MVA_ARENA_FLAG )
 			{
-				DWORD uCount = fdReader.GetDword();
+				DWORD uCount;
+				if ( bPacked )
+				{
+					dPacked.Resize ( fdReader.UnzipInt() );
+					fdReader.GetBytes ( dPacked.Begin(), dPacked.GetLength() );
+					uCount = dPacked.GetLength() ? sphPackedMvaLength ( dPacked.Begin() )-1 : 0;
+				} else
+					uCount = fdReader.GetDword();
+
 				if ( uCount )
 				{
 					assert ( j<iMva64 || ( uCount%2 )==0 );
@@ -728,8 +926,13 @@ bool CSphIndex_VLN::LoadPersistentMVA ( CSphString & sError )
 						SphDocID_t *pDocid = (SphDocID_t*)(g_pMvaArena + iAlloc);
 						*pDocid++ = dAffected[i];
 						DWORD * pData = (DWORD*)pDocid;
-						*pData++ = uCount;
-						fdReader.GetBytes ( pData, uCount*sizeof(DWORD) );
+						if ( bPacked )
+							sphUnpackMva ( dPacked.Begin(), j>=iMva64, pData );
+						else
+						{
+							*pData++ = uCount;
+							fdReader.GetBytes ( pData, uCount*sizeof(DWORD) );
+						}
 						dAllocs.Add ( iAlloc );
 					}
 				}
@@ -865,9 +1068,7 @@ bool CSphIndex_VLN::SaveAttributes ( CSphString & sError ) const
 			if ( tAttr.m_eAttrType==ESphAttr::SPH_ATTR_UINT32SET )
 				dMvaLocators.Add ( tAttr.m_tLocator );
 		}
-#ifndef NDEBUG
 		int iMva64 = dMvaLocators.GetLength();
-#endif
 		for ( int i=0; i<m_tSchema.GetAttrsCount(); i++ )
 		{
 			const CSphColumnInfo & tAttr = m_tSchema.GetAttr(i);
@@ -894,10 +1095,13 @@ bool CSphIndex_VLN::SaveAttributes ( CSphString & sError ) const
 
 		// save the vector of affected docids
 		DWORD uPos = dAffected.GetLength();
+		fdFlushMVA.PutDword ( MVP_PACKED_MAGIC );
+		fdFlushMVA.PutDword ( MVP_PACKED_VERSION );
 		fdFlushMVA.PutDword ( uPos );
 		fdFlushMVA.PutBytes ( &dAffected[0], uPos*sizeof(SphDocID_t) );
 
-		// save the updated MVA vectors
+		// save the updated MVA vectors, delta and bit packed
+		CSphVector<BYTE> dPacked;
 		ARRAY_FOREACH ( i, dAffected )
 		{
 			DWORD* pDocinfo = const_cast<DWORD*> ( FindDocinfo ( dAffected[i] ) );
@@ -910,11 +1114,12 @@ bool CSphIndex_VLN::SaveAttributes ( CSphString & sError ) const
 				// if this MVA was updated
 				if ( uOldIndex & MVA_ARENA_FLAG )
 				{
-					DWORD * pMva = g_pMvaArena + ( uOldIndex & MVA_OFFSET_MASK );
-					DWORD uCount = *pMva;
-					assert ( j<iMva64 || ( uCount%2 )==0 );
-					fdFlushMVA.PutDword ( uCount );
-					fdFlushMVA.PutBytes ( pMva+1, uCount*sizeof(DWORD) );
+					const DWORD * pMva = g_pMvaArena + ( uOldIndex & MVA_OFFSET_MASK );
+					assert ( j<iMva64 || ( (*pMva)%2 )==0 );
+					dPacked.Resize ( 0 );
+					sphPackMva ( pMva, j>=iMva64, dPacked );
+					fdFlushMVA.ZipInt ( dPacked.GetLength() );
+					fdFlushMVA.PutBytes ( dPacked.Begin(), dPacked.GetLength() );
 				}
 			}
 		}
@@ -1066,6 +1271,7 @@ bool CSphIndex_VLN::AddRemoveAttribute ( bool bAddAttr, const CSphString & sAttr
 	tBuildHeader.m_uMinDocid = m_uMinDocid;
 	tBuildHeader.m_uKillListSize = (int)m_tKillList.GetNumEntries();
 	tBuildHeader.m_iMinMaxIndex = iNewMinMaxIndex;
+	tBuildHeader.m_uStringDictEnd = m_uStringDictEnd;
 
 	*(DictHeader_t*)&tBuildHeader = *(DictHeader_t*)&m_tWordlist;
 
@@ -1144,6 +1350,12 @@ bool CSphIndex_VLN::AddRemoveAttribute ( bool bAddAttr, const CSphString & sAttr
 	m_iDocinfoIndex = ( ( m_tAttr.GetNumEntries() - m_iMinMaxIndex ) / iNewStride / 2 ) - 1;
 
 	PrereadMapping ( m_sIndexName.cstr(), "attributes", m_bMlock, m_bOndiskAllAttr, m_tAttr );
+
+	// locators might have moved
+	SetupJsonAttrs();
+	if ( m_dRollups.GetLength() )
+		SetupRollups();
+
 	return true;
 }
 
@@ -1863,6 +2075,32 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 		return 0;
 	}
 
+	// dictionary-encoded string attributes
+	CSphBitvec dStringDictAttrs ( m_tSchema.GetAttrsCount() );
+	CSphStringDictBuilder tStringDict;
+	bool bHaveStringDict = false;
+	if ( !m_tSettings.m_sStringDictAttrs.IsEmpty() )
+	{
+		CSphVector<CSphString> dDictAttrs;
+		sphSplit ( dDictAttrs, m_tSettings.m_sStringDictAttrs.cstr() );
+		ARRAY_FOREACH ( i, dDictAttrs )
+		{
+			int iAttr = m_tSchema.GetAttrIndex ( dDictAttrs[i].cstr() );
+			if ( iAttr<0 || m_tSchema.GetAttr ( iAttr ).m_eAttrType!=ESphAttr::SPH_ATTR_STRING )
+			{
+				m_sLastError.SetSprintf ( "string_attr_dict: '%s' is not a string attribute", dDictAttrs[i].cstr() );
+				return 0;
+			}
+			dStringDictAttrs.BitSet ( iAttr );
+			bHaveStringDict = true;
+		}
+	}
+
+	// generated attributes, computed from their JSON paths right after the JSON blobs are parsed
+	CSphVector<CSphJsonAttr> dJsonAttrs;
+	if ( !m_tSettings.m_sJsonAttrs.IsEmpty() && !sphJsonAttrsSetup ( m_tSchema, m_tSettings.m_sJsonAttrs, dJsonAttrs, m_sLastError ) )
+		return 0;
+
 	if ( !m_pTokenizer->SetFilterSchema ( m_tSchema, m_sLastError ) )
 		return 0;
 
@@ -2277,10 +2515,21 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 							iLen = sphUnpackStr ( pBase+uPrevOff, (const BYTE **)&sData );
 					}
 
+					bool bJsonAttrs = ( dJsonAttrs.GetLength() && tCol.m_eAttrType==ESphAttr::SPH_ATTR_JSON && !bKeepPrevAttr );
+
 					// no data
 					if ( !iLen )
 					{
 						pSource->m_tDocInfo.SetAttr ( tCol.m_tLocator, 0 );
+						if ( bJsonAttrs )
+							sphJsonAttrsEval ( pSource->m_tDocInfo, dJsonAttrs, iStrAttr, NULL, 0 );
+						continue;
+					}
+
+					// dictionary-encoded values only store a provisional id for now, remapped to an offset once the dictionary is saved
+					if ( dStringDictAttrs.BitGet ( iStrAttr ) )
+					{
+						pSource->m_tDocInfo.SetAttr ( tCol.m_tLocator, tStringDict.Add ( (const BYTE*)sData, iLen ) );
 						continue;
 					}
 
@@ -2309,8 +2558,14 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 							sphWarning ( "%s", m_sLastError.cstr() );
 							m_sLastError = "";
 							pSource->m_tDocInfo.SetAttr ( tCol.m_tLocator, 0 );
+							if ( bJsonAttrs )
+								sphJsonAttrsEval ( pSource->m_tDocInfo, dJsonAttrs, iStrAttr, NULL, 0 );
 							continue;
 						}
+
+						if ( bJsonAttrs )
+							sphJsonAttrsEval ( pSource->m_tDocInfo, dJsonAttrs, iStrAttr, dBson.Begin(), dBson.GetLength() );
+
 						if ( !dBson.GetLength() )
 						{
 							// empty SphinxBSON, need not save any data
@@ -2950,9 +3205,15 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 	int iStringStride = dStringAttrs.GetLength();
 	SphOffset_t iNumDocs = iDocinfoWritePos/sizeof(DWORD)/iDocinfoStride;
 	CSphTightVector<DWORD> dStrOffsets;
+	DWORD uStringDictEnd = 0;
 
 	if ( iStringStride )
 	{
+		// dictionary goes first, right after the magic zero offset
+		CSphVector<DWORD> dStringDictRemap;
+		if ( bHaveStringDict && !tStringDict.Save ( tStrFinalWriter, dStringDictRemap, uStringDictEnd, m_sLastError ) )
+			return 0;
+
 		// read only non-zero string locators
 		{
 			CSphReader tAttrReader;
@@ -2965,6 +3226,8 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 				CSphRowitem * pAttrs = DOCINFO2ATTRS ( pDocinfo );
 				ARRAY_FOREACH ( j, dStringAttrs )
 				{
+					if ( dStringDictAttrs.BitGet ( dStringAttrs[j] ) )
+						continue;
 					const CSphAttrLocator & tLoc = m_tSchema.GetAttr ( dStringAttrs[j] ).m_tLocator;
 					DWORD uData = (DWORD)sphGetRowAttr ( pAttrs, tLoc );
 					if ( uData )
@@ -3078,7 +3341,12 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 					ARRAY_FOREACH ( j, dStringAttrs )
 					{
 						const CSphAttrLocator& tLocator = m_tSchema.GetAttr ( dStringAttrs[j] ).m_tLocator;
-						if ( sphGetRowAttr ( pAttrs, tLocator ) )
+						SphAttr_t uData = sphGetRowAttr ( pAttrs, tLocator );
+						if ( !uData )
+							continue;
+						if ( dStringDictAttrs.BitGet ( dStringAttrs[j] ) )
+							sphSetRowAttr ( pAttrs, tLocator, dStringDictRemap[(int)uData] );
+						else
 							sphSetRowAttr ( pAttrs, tLocator, dStrOffsets[iStr++] );
 					}
 				}
@@ -3312,6 +3580,7 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 	tBuildHeader.m_uKillListSize = uKillistSize;
 	tBuildHeader.m_iMinMaxIndex = m_iMinMaxIndex;
 	tBuildHeader.m_iTotalDups = iDupes;
+	tBuildHeader.m_uStringDictEnd = uStringDictEnd;
 
 	// we're done
 	if ( !BuildDone ( tBuildHeader, m_sLastError ) )
@@ -3682,6 +3951,263 @@ bool CSphIndex_VLN::Merge ( CSphIndex * pSource, const CSphVector<CSphFilterSett
 									dKillList, m_sLastError, m_tProgress,&g_tThrottle, &bGlobalStop, &bLocalStop );
 }
 
+/// docinfo merge pass of DoMerge
+/// a dry pass only walks the docids, to collect what the words merge needs; that allows to write docinfo on another thread
+struct MergeDocinfo_t
+{
+	const CSphIndex_VLN *				m_pDst;
+	const CSphIndex_VLN *				m_pSrc;
+	ISphFilter *						m_pFilter;
+	const CSphVector<SphDocID_t> *		m_pKillList;
+	const CSphVector<CSphAttrLocator> *	m_pMvaLocators;
+	const CSphVector<CSphAttrLocator> *	m_pStringLocators;
+	CSphWriter *						m_pSPMWriter;	///< NULL for a dry pass
+	CSphWriter *						m_pSPSWriter;
+	ThrottleState_t *					m_pThrottle;
+	volatile bool *						m_pGlobalStop;
+	volatile bool *						m_pLocalStop;
+
+	CSphVector<SphDocID_t>				m_dPhantomKiller;
+	SphDocID_t							m_uMergeInfinum;
+	int64_t								m_iTotalDocuments;
+	int64_t								m_iMinMaxIndex;
+	CSphString							m_sError;
+	bool								m_bOk;
+
+	MergeDocinfo_t ( const CSphIndex_VLN * pDst, const CSphIndex_VLN * pSrc, ISphFilter * pFilter, const CSphVector<SphDocID_t> & dKillList,
+		const CSphVector<CSphAttrLocator> & dMvaLocators, const CSphVector<CSphAttrLocator> & dStringLocators, ThrottleState_t * pThrottle,
+		volatile bool * pGlobalStop, volatile bool * pLocalStop )
+		: m_pDst ( pDst )
+		, m_pSrc ( pSrc )
+		, m_pFilter ( pFilter )
+		, m_pKillList ( &dKillList )
+		, m_pMvaLocators ( &dMvaLocators )
+		, m_pStringLocators ( &dStringLocators )
+		, m_pSPMWriter ( NULL )
+		, m_pSPSWriter ( NULL )
+		, m_pThrottle ( pThrottle )
+		, m_pGlobalStop ( pGlobalStop )
+		, m_pLocalStop ( pLocalStop )
+		, m_uMergeInfinum ( 0 )
+		, m_iTotalDocuments ( 0 )
+		, m_iMinMaxIndex ( 0 )
+		, m_bOk ( true )
+	{}
+};
+
+
+/// joins the docinfo writer thread of a merge, on any way out
+struct MergeDocinfoThread_t
+{
+	SphThread_t		m_tThread;
+	bool			m_bStarted;
+
+	MergeDocinfoThread_t ()
+		: m_bStarted ( false )
+	{}
+
+	~MergeDocinfoThread_t ()
+	{
+		Join();
+	}
+
+	void Join ()
+	{
+		if ( m_bStarted )
+			sphThreadJoin ( &m_tThread );
+		m_bStarted = false;
+	}
+};
+
+
+bool CSphIndex_VLN::MergeDocinfo ( MergeDocinfo_t & tCtx )
+{
+	const CSphIndex_VLN * pDstIndex = tCtx.m_pDst;
+	const CSphIndex_VLN * pSrcIndex = tCtx.m_pSrc;
+	const CSphVector<SphDocID_t> & dKillList = *tCtx.m_pKillList;
+	const CSphVector<CSphAttrLocator> & dMvaLocators = *tCtx.m_pMvaLocators;
+	const CSphVector<CSphAttrLocator> & dStringLocators = *tCtx.m_pStringLocators;
+	const bool bWrite = ( tCtx.m_pSPMWriter!=NULL );
+	CSphString & sError = tCtx.m_sError;
+
+	tCtx.m_dPhantomKiller.Resize ( 0 );
+	tCtx.m_uMergeInfinum = 0;
+	tCtx.m_iTotalDocuments = 0;
+	tCtx.m_iMinMaxIndex = 0;
+	bool bNeedInfinum = true;
+
+	int iStride = DOCINFO_IDSIZE + pDstIndex->m_tSchema.GetRowSize();
+	CSphFixedVector<CSphRowitem> dRow ( iStride );
+
+	CSphWriter wrRows;
+	wrRows.SetThrottle ( tCtx.m_pThrottle );
+	if ( bWrite && !wrRows.OpenFile ( pDstIndex->GetIndexFileName("tmp.spa"), sError ) )
+		return false;
+
+	int64_t iExpectedDocs = pDstIndex->m_tStats.m_iTotalDocuments + pSrcIndex->GetStats().m_iTotalDocuments;
+	AttrIndexBuilder_c tMinMax ( pDstIndex->m_tSchema );
+	int64_t iMinMaxSize = tMinMax.GetExpectedSize ( iExpectedDocs );
+	if ( iMinMaxSize>INT_MAX || iExpectedDocs>INT_MAX )
+	{
+		if ( iMinMaxSize>INT_MAX )
+			sError.SetSprintf ( "attribute files over 128 GB are not supported (projected_minmax_size=" INT64_FMT ")", iMinMaxSize );
+		else if ( iExpectedDocs>INT_MAX )
+			sError.SetSprintf ( "indexes over 2B docs are not supported (projected_docs=" INT64_FMT ")", iExpectedDocs );
+		return false;
+	}
+	CSphFixedVector<DWORD> dMinMaxBuffer ( bWrite ? (int)iMinMaxSize : 0 );
+	if ( bWrite )
+		tMinMax.Prepare ( dMinMaxBuffer.Begin(), dMinMaxBuffer.Begin() + dMinMaxBuffer.GetLength() ); // FIXME!!! for over INT_MAX blocks
+
+	const DWORD * pSrcRow = pSrcIndex->m_tAttr.GetWritePtr(); // they *can* be null if the respective index is empty
+	const DWORD * pDstRow = pDstIndex->m_tAttr.GetWritePtr();
+
+	int64_t iSrcCount = 0;
+	int64_t iDstCount = 0;
+
+	int iKillListIdx = 0;
+
+	CSphMatch tMatch;
+	while ( iSrcCount < pSrcIndex->m_iDocinfo || iDstCount < pDstIndex->m_iDocinfo )
+	{
+		if ( *tCtx.m_pGlobalStop || *tCtx.m_pLocalStop )
+			return false;
+
+		SphDocID_t iDstDocID, iSrcDocID;
+
+		if ( iDstCount < pDstIndex->m_iDocinfo )
+		{
+			iDstDocID = DOCINFO2ID ( pDstRow );
+
+			// kill list filter goes first
+			while ( dKillList [ iKillListIdx ]<iDstDocID )
+				iKillListIdx++;
+			if ( dKillList [ iKillListIdx ]==iDstDocID )
+			{
+				pDstRow += iStride;
+				iDstCount++;
+				continue;
+			}
+
+			if ( tCtx.m_pFilter )
+			{
+				tMatch.m_uDocID = iDstDocID;
+				tMatch.m_pStatic = DOCINFO2ATTRS ( pDstRow );
+				tMatch.m_pDynamic = NULL;
+				if ( !tCtx.m_pFilter->Eval ( tMatch ) )
+				{
+					pDstRow += iStride;
+					iDstCount++;
+					continue;
+				}
+			}
+		} else
+			iDstDocID = 0;
+
+		if ( iSrcCount < pSrcIndex->m_iDocinfo )
+			iSrcDocID = DOCINFO2ID ( pSrcRow );
+		else
+			iSrcDocID = 0;
+
+		if ( ( iDstDocID && iDstDocID < iSrcDocID ) || ( iDstDocID && !iSrcDocID ) )
+		{
+			if ( bWrite )
+			{
+				Verify ( tMinMax.Collect ( pDstRow, pDstIndex->m_tMva.GetWritePtr(), pDstIndex->m_tMva.GetNumEntries(), sError, true ) );
+
+				if ( dMvaLocators.GetLength() || dStringLocators.GetLength() )
+				{
+					memcpy ( dRow.Begin(), pDstRow, iStride * sizeof ( CSphRowitem ) );
+					CopyRowMVA ( pDstIndex->m_tMva.GetWritePtr(), dMvaLocators, iDstDocID, dRow.Begin(), *tCtx.m_pSPMWriter );
+					CopyRowString ( pDstIndex->m_tString.GetWritePtr(), dStringLocators, dRow.Begin(), *tCtx.m_pSPSWriter );
+					wrRows.PutBytes ( dRow.Begin(), sizeof(DWORD)*iStride );
+				} else
+				{
+					wrRows.PutBytes ( pDstRow, sizeof(DWORD)*iStride );
+				}
+			}
+
+			tCtx.m_iMinMaxIndex += iStride;
+			pDstRow += iStride;
+			iDstCount++;
+			tCtx.m_iTotalDocuments++;
+			if ( bNeedInfinum )
+			{
+				bNeedInfinum = false;
+				tCtx.m_uMergeInfinum = iDstDocID - 1;
+			}
+
+		} else if ( iSrcDocID )
+		{
+			if ( bWrite )
+			{
+				Verify ( tMinMax.Collect ( pSrcRow, pSrcIndex->m_tMva.GetWritePtr(), pSrcIndex->m_tMva.GetNumEntries(), sError, true ) );
+
+				if ( dMvaLocators.GetLength() || dStringLocators.GetLength() )
+				{
+					memcpy ( dRow.Begin(), pSrcRow, iStride * sizeof ( CSphRowitem ) );
+					CopyRowMVA ( pSrcIndex->m_tMva.GetWritePtr(), dMvaLocators, iSrcDocID, dRow.Begin(), *tCtx.m_pSPMWriter );
+					CopyRowString ( pSrcIndex->m_tString.GetWritePtr(), dStringLocators, dRow.Begin(), *tCtx.m_pSPSWriter );
+					wrRows.PutBytes ( dRow.Begin(), sizeof(DWORD)*iStride );
+				} else
+				{
+					wrRows.PutBytes ( pSrcRow, sizeof(DWORD)*iStride );
+				}
+			}
+
+			tCtx.m_iMinMaxIndex += iStride;
+			pSrcRow += iStride;
+			iSrcCount++;
+			tCtx.m_iTotalDocuments++;
+			if ( bNeedInfinum )
+			{
+				bNeedInfinum = false;
+				tCtx.m_uMergeInfinum = iSrcDocID - 1;
+			}
+
+			if ( iDstDocID==iSrcDocID )
+			{
+				tCtx.m_dPhantomKiller.Add ( iSrcDocID );
+				pDstRow += iStride;
+				iDstCount++;
+			}
+		}
+	}
+
+	if ( !bWrite )
+		return true;
+
+	if ( tCtx.m_iTotalDocuments )
+	{
+		tMinMax.FinishCollect();
+		iMinMaxSize = tMinMax.GetActualSize() * sizeof(DWORD);
+		wrRows.PutBytes ( dMinMaxBuffer.Begin(), iMinMaxSize );
+	}
+	wrRows.CloseFile();
+	return !wrRows.IsError();
+}
+
+
+/// split the IO budget of a throttled merge between the words, merged on this thread, and docinfo, merged on its own
+static void SplitMergeThrottle ( const ThrottleState_t & tThrottle, ThrottleState_t & tWords, ThrottleState_t & tDocinfo )
+{
+	tWords = tThrottle;
+	tDocinfo = tThrottle;
+	if ( tThrottle.m_iMaxIOps>0 )
+	{
+		tWords.m_iMaxIOps = Max ( tThrottle.m_iMaxIOps/2, 1 );
+		tDocinfo.m_iMaxIOps = Max ( tThrottle.m_iMaxIOps-tWords.m_iMaxIOps, 1 );
+	}
+}
+
+
+static void MergeDocinfoThreadFunc ( void * pArg )
+{
+	MergeDocinfo_t * pCtx = (MergeDocinfo_t *)pArg;
+	pCtx->m_bOk = CSphIndex_VLN::MergeDocinfo ( *pCtx );
+}
+
+
 bool CSphIndex_VLN::DoMerge ( const CSphIndex_VLN * pDstIndex, const CSphIndex_VLN * pSrcIndex,
 							bool bMergeKillLists, ISphFilter * pFilter, const CSphVector<SphDocID_t> & dKillList
 							, CSphString & sError, CSphIndexProgress & tProgress, ThrottleState_t * pThrottle,
@@ -3718,13 +4244,26 @@ bool CSphIndex_VLN::DoMerge ( const CSphIndex_VLN * pDstIndex, const CSphIndex_V
 
 	BuildHeader_t tBuildHeader ( pDstIndex->m_tStats );
 
+	// docinfo might get written on a thread of its own while the words merge here, given a dry pass for the docids first
+	// filters are not thread safe, so those merges stay serial; throttled ones split the IO budget between the threads
+	bool bDocinfo = ( pDstIndex->m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN && pSrcIndex->m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN );
+	bool bDocinfoThread = ( bDocinfo && g_iMergeThreads>1 && !pFilter );
+	ThrottleState_t tWordsThrottle, tDocinfoThrottle;
+	ThrottleState_t * pDocinfoThrottle = pThrottle;
+	if ( bDocinfoThread && pThrottle )
+	{
+		SplitMergeThrottle ( *pThrottle, tWordsThrottle, tDocinfoThrottle );
+		pThrottle = &tWordsThrottle;
+		pDocinfoThrottle = &tDocinfoThrottle;
+	}
+
 	/////////////////////////////////////////
 	// merging attributes (.spa, .spm, .sps)
 	/////////////////////////////////////////
 
 	CSphWriter tSPMWriter, tSPSWriter;
-	tSPMWriter.SetThrottle ( pThrottle );
-	tSPSWriter.SetThrottle ( pThrottle );
+	tSPMWriter.SetThrottle ( pDocinfoThrottle );
+	tSPSWriter.SetThrottle ( pDocinfoThrottle );
 	if ( !tSPMWriter.OpenFile ( pDstIndex->GetIndexFileName("tmp.spm"), sError )
 		|| !tSPSWriter.OpenFile ( pDstIndex->GetIndexFileName("tmp.sps"), sError ) )
 	{
@@ -3750,186 +4289,59 @@ bool CSphIndex_VLN::DoMerge ( const CSphIndex_VLN * pDstIndex, const CSphIndex_V
 			dMvaLocators.Add ( tInfo.m_tLocator );
 	}
 
-	CSphVector<SphDocID_t> dPhantomKiller;
-
-	int64_t iTotalDocuments = 0;
-	bool bNeedInfinum = true;
-	// minimal docid-1 for merging
-	SphDocID_t uMergeInfinum = 0;
+	MergeDocinfo_t tDocinfo ( pDstIndex, pSrcIndex, pFilter, dKillList, dMvaLocators, dStringLocators, pThrottle, pGlobalStop, pLocalStop );
+	MergeDocinfo_t tDocinfoWriter ( pDstIndex, pSrcIndex, pFilter, dKillList, dMvaLocators, dStringLocators, pDocinfoThrottle, pGlobalStop, pLocalStop );
+	tDocinfoWriter.m_pSPMWriter = &tSPMWriter;
+	tDocinfoWriter.m_pSPSWriter = &tSPSWriter;
+	MergeDocinfoThread_t tDocinfoThread;
 
-	if ( pDstIndex->m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN && pSrcIndex->m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN )
+	if ( bDocinfoThread )
 	{
-		int iStride = DOCINFO_IDSIZE + pDstIndex->m_tSchema.GetRowSize();
-		CSphFixedVector<CSphRowitem> dRow ( iStride );
-
-		CSphWriter wrRows;
-		wrRows.SetThrottle ( pThrottle );
-		if ( !wrRows.OpenFile ( pDstIndex->GetIndexFileName("tmp.spa"), sError ) )
+		if ( !MergeDocinfo ( tDocinfo ) )
+		{
+			sError = tDocinfo.m_sError;
 			return false;
+		}
+		tDocinfoThread.m_bStarted = sphThreadCreate ( &tDocinfoThread.m_tThread, MergeDocinfoThreadFunc, &tDocinfoWriter );
+	}
 
-		int64_t iExpectedDocs = pDstIndex->m_tStats.m_iTotalDocuments + pSrcIndex->GetStats().m_iTotalDocuments;
-		AttrIndexBuilder_c tMinMax ( pDstIndex->m_tSchema );
-		int64_t iMinMaxSize = tMinMax.GetExpectedSize ( iExpectedDocs );
-		if ( iMinMaxSize>INT_MAX || iExpectedDocs>INT_MAX )
+	if ( bDocinfo && !tDocinfoThread.m_bStarted )
+	{
+		if ( !MergeDocinfo ( tDocinfoWriter ) )
 		{
-			if ( iMinMaxSize>INT_MAX )
-				sError.SetSprintf ( "attribute files over 128 GB are not supported (projected_minmax_size=" INT64_FMT ")", iMinMaxSize );
-			else if ( iExpectedDocs>INT_MAX )
-				sError.SetSprintf ( "indexes over 2B docs are not supported (projected_docs=" INT64_FMT ")", iExpectedDocs );
+			sError = tDocinfoWriter.m_sError;
 			return false;
 		}
-		CSphFixedVector<DWORD> dMinMaxBuffer ( (int)iMinMaxSize );
-		tMinMax.Prepare ( dMinMaxBuffer.Begin(), dMinMaxBuffer.Begin() + dMinMaxBuffer.GetLength() ); // FIXME!!! for over INT_MAX blocks
+		tDocinfo.m_dPhantomKiller.SwapData ( tDocinfoWriter.m_dPhantomKiller );
+		tDocinfo.m_uMergeInfinum = tDocinfoWriter.m_uMergeInfinum;
+		tDocinfo.m_iTotalDocuments = tDocinfoWriter.m_iTotalDocuments;
+		tDocinfo.m_iMinMaxIndex = tDocinfoWriter.m_iMinMaxIndex;
 
-		const DWORD * pSrcRow = pSrcIndex->m_tAttr.GetWritePtr(); // they *can* be null if the respective index is empty
-		const DWORD * pDstRow = pDstIndex->m_tAttr.GetWritePtr();
+	} else if ( bDocinfo )
+	{
+		// docinfo is being written on the thread
+	} else if ( pDstIndex->m_bIsEmpty || pSrcIndex->m_bIsEmpty )
+	{
+		// one of the indexes has no documents; copy the .spa file from the other one
+		CSphString sSrc = !pDstIndex->m_bIsEmpty ? pDstIndex->GetIndexFileName("spa") : pSrcIndex->GetIndexFileName("spa");
+		CSphString sDst = pDstIndex->GetIndexFileName("tmp.spa");
 
-		int64_t iSrcCount = 0;
-		int64_t iDstCount = 0;
+		if ( !CopyFile ( sSrc.cstr(), sDst.cstr(), sError, pThrottle, pGlobalStop, pLocalStop ) )
+			return false;
 
-		int iKillListIdx = 0;
+	} else
+	{
+		// storage is not extern; create dummy .spa file
+		CSphAutofile fdSpa ( pDstIndex->GetIndexFileName("tmp.spa"), SPH_O_NEW, sError );
+		fdSpa.Close();
+	}
 
-		CSphMatch tMatch;
-		while ( iSrcCount < pSrcIndex->m_iDocinfo || iDstCount < pDstIndex->m_iDocinfo )
-		{
-			if ( *pGlobalStop || *pLocalStop )
-				return false;
-
-			SphDocID_t iDstDocID, iSrcDocID;
-
-			if ( iDstCount < pDstIndex->m_iDocinfo )
-			{
-				iDstDocID = DOCINFO2ID ( pDstRow );
-
-				// kill list filter goes first
-				while ( dKillList [ iKillListIdx ]<iDstDocID )
-					iKillListIdx++;
-				if ( dKillList [ iKillListIdx ]==iDstDocID )
-				{
-					pDstRow += iStride;
-					iDstCount++;
-					continue;
-				}
-
-				if ( pFilter )
-				{
-					tMatch.m_uDocID = iDstDocID;
-					tMatch.m_pStatic = DOCINFO2ATTRS ( pDstRow );
-					tMatch.m_pDynamic = NULL;
-					if ( !pFilter->Eval ( tMatch ) )
-					{
-						pDstRow += iStride;
-						iDstCount++;
-						continue;
-					}
-				}
-			} else
-				iDstDocID = 0;
-
-			if ( iSrcCount < pSrcIndex->m_iDocinfo )
-				iSrcDocID = DOCINFO2ID ( pSrcRow );
-			else
-				iSrcDocID = 0;
-
-			if ( ( iDstDocID && iDstDocID < iSrcDocID ) || ( iDstDocID && !iSrcDocID ) )
-			{
-				Verify ( tMinMax.Collect ( pDstRow, pDstIndex->m_tMva.GetWritePtr(), pDstIndex->m_tMva.GetNumEntries(), sError, true ) );
-
-				if ( dMvaLocators.GetLength() || dStringLocators.GetLength() )
-				{
-					memcpy ( dRow.Begin(), pDstRow, iStride * sizeof ( CSphRowitem ) );
-					CopyRowMVA ( pDstIndex->m_tMva.GetWritePtr(), dMvaLocators, iDstDocID, dRow.Begin(), tSPMWriter );
-					CopyRowString ( pDstIndex->m_tString.GetWritePtr(), dStringLocators, dRow.Begin(), tSPSWriter );
-					wrRows.PutBytes ( dRow.Begin(), sizeof(DWORD)*iStride );
-				} else
-				{
-					wrRows.PutBytes ( pDstRow, sizeof(DWORD)*iStride );
-				}
-
-				tBuildHeader.m_iMinMaxIndex += iStride;
-				pDstRow += iStride;
-				iDstCount++;
-				iTotalDocuments++;
-				if ( bNeedInfinum )
-				{
-					bNeedInfinum = false;
-					uMergeInfinum = iDstDocID - 1;
-				}
-
-			} else if ( iSrcDocID )
-			{
-				Verify ( tMinMax.Collect ( pSrcRow, pSrcIndex->m_tMva.GetWritePtr(), pSrcIndex->m_tMva.GetNumEntries(), sError, true ) );
-
-				if ( dMvaLocators.GetLength() || dStringLocators.GetLength() )
-				{
-					memcpy ( dRow.Begin(), pSrcRow, iStride * sizeof ( CSphRowitem ) );
-					CopyRowMVA ( pSrcIndex->m_tMva.GetWritePtr(), dMvaLocators, iSrcDocID, dRow.Begin(), tSPMWriter );
-					CopyRowString ( pSrcIndex->m_tString.GetWritePtr(), dStringLocators, dRow.Begin(), tSPSWriter );
-					wrRows.PutBytes ( dRow.Begin(), sizeof(DWORD)*iStride );
-				} else
-				{
-					wrRows.PutBytes ( pSrcRow, sizeof(DWORD)*iStride );
-				}
-
-				tBuildHeader.m_iMinMaxIndex += iStride;
-				pSrcRow += iStride;
-				iSrcCount++;
-				iTotalDocuments++;
-				if ( bNeedInfinum )
-				{
-					bNeedInfinum = false;
-					uMergeInfinum = iSrcDocID - 1;
-				}
-
-				if ( iDstDocID==iSrcDocID )
-				{
-					dPhantomKiller.Add ( iSrcDocID );
-					pDstRow += iStride;
-					iDstCount++;
-				}
-			}
-		}
-
-		if ( iTotalDocuments )
-		{
-			tMinMax.FinishCollect();
-			iMinMaxSize = tMinMax.GetActualSize() * sizeof(DWORD);
-			wrRows.PutBytes ( dMinMaxBuffer.Begin(), iMinMaxSize );
-		}
-		wrRows.CloseFile();
-		if ( wrRows.IsError() )
-			return false;
-
-	} else if ( pDstIndex->m_bIsEmpty || pSrcIndex->m_bIsEmpty )
-	{
-		// one of the indexes has no documents; copy the .spa file from the other one
-		CSphString sSrc = !pDstIndex->m_bIsEmpty ? pDstIndex->GetIndexFileName("spa") : pSrcIndex->GetIndexFileName("spa");
-		CSphString sDst = pDstIndex->GetIndexFileName("tmp.spa");
-
-		if ( !CopyFile ( sSrc.cstr(), sDst.cstr(), sError, pThrottle, pGlobalStop, pLocalStop ) )
-			return false;
-
-	} else
-	{
-		// storage is not extern; create dummy .spa file
-		CSphAutofile fdSpa ( pDstIndex->GetIndexFileName("tmp.spa"), SPH_O_NEW, sError );
-		fdSpa.Close();
-	}
-
-	if ( !CheckDocsCount ( iTotalDocuments, sError ) )
-		return false;
-
-	if ( tSPSWriter.GetPos()>SphOffset_t( U64C(1)<<32 ) )
-	{
-		sError.SetSprintf ( "resulting .sps file is over 4 GB" );
+	if ( !CheckDocsCount ( tDocinfo.m_iTotalDocuments, sError ) )
 		return false;
-	}
 
-	if ( tSPMWriter.GetPos()>SphOffset_t( U64C(4)<<32 ) )
-	{
-		sError.SetSprintf ( "resulting .spm file is over 16 GB" );
-		return false;
-	}
+	tBuildHeader.m_iMinMaxIndex += tDocinfo.m_iMinMaxIndex;
+	const SphDocID_t uMergeInfinum = tDocinfo.m_uMergeInfinum;
+	CSphVector<SphDocID_t> & dPhantomKiller = tDocinfo.m_dPhantomKiller;
 
 	int iOldLen = dPhantomKiller.GetLength();
 	int iKillLen = dKillList.GetLength();
@@ -3983,8 +4395,27 @@ bool CSphIndex_VLN::DoMerge ( const CSphIndex_VLN * pDstIndex, const CSphIndex_V
 		} ) );
 	}
 
-	if ( iTotalDocuments )
-		tBuildHeader.m_iTotalDocuments = iTotalDocuments;
+	tDocinfoThread.Join();
+	if ( !tDocinfoWriter.m_bOk )
+	{
+		sError = tDocinfoWriter.m_sError;
+		return false;
+	}
+
+	if ( tSPSWriter.GetPos()>SphOffset_t( U64C(1)<<32 ) )
+	{
+		sError.SetSprintf ( "resulting .sps file is over 4 GB" );
+		return false;
+	}
+
+	if ( tSPMWriter.GetPos()>SphOffset_t( U64C(4)<<32 ) )
+	{
+		sError.SetSprintf ( "resulting .spm file is over 16 GB" );
+		return false;
+	}
+
+	if ( tDocinfo.m_iTotalDocuments )
+		tBuildHeader.m_iTotalDocuments = tDocinfo.m_iTotalDocuments;
 
 	// merge kill-lists
 	CSphAutofile tKillList ( pDstIndex->GetIndexFileName("tmp.spk"), SPH_O_NEW, sError );
@@ -4155,6 +4586,7 @@ bool CSphIndex_VLN::ReplaceKillList ( const SphDocID_t * pKillist, int iCount )
 	tBuildHeader.m_uMinDocid = m_uMinDocid;
 	tBuildHeader.m_uKillListSize = iCount;
 	tBuildHeader.m_iMinMaxIndex = m_iMinMaxIndex;
+	tBuildHeader.m_uStringDictEnd = m_uStringDictEnd;
 
 	if ( !BuildDone ( tBuildHeader, m_sLastError ) )
 		return false;
@@ -4177,6 +4609,35 @@ bool CSphIndex_VLN::HasDocid ( SphDocID_t uDocid ) const
 }
 
 
+int64_t CSphIndex_VLN::MarkDocinfoRows ( const SphDocID_t * pDocs, int iDocs, CSphBitvec & tRows ) const
+{
+	if ( m_tSettings.m_eDocinfo!=SPH_DOCINFO_EXTERN || m_iDocinfo<=0 || m_tAttr.IsEmpty() )
+		return -1;
+
+	// rows either come empty, or marked over this very docinfo before
+	if ( !tRows.GetBits() )
+		tRows.Init ( (size_t)m_iDocinfo );
+	assert ( tRows.GetBits()==(size_t)m_iDocinfo );
+
+	int iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+	int64_t iMarked = 0;
+	for ( int i=0; i<iDocs; i++ )
+	{
+		const DWORD * pRow = FindDocinfo ( pDocs[i] );
+		if ( !pRow )
+			continue;
+
+		int64_t iRow = ( pRow - m_tAttr.GetWritePtr() ) / iStride;
+		if ( !tRows.BitGet ( (size_t)iRow ) )
+		{
+			tRows.BitSet ( (size_t)iRow );
+			iMarked++;
+		}
+	}
+	return iMarked;
+}
+
+
 const DWORD * CSphIndex_VLN::FindDocinfo ( SphDocID_t uDocID ) const
 {
 	if ( m_iDocinfo<=0 )
@@ -4343,6 +4804,113 @@ void CSphIndex_VLN::MatchExtended ( CSphQueryContext * pCtx, const CSphQuery * p
 }
 
 
+/// fetch full-scan candidate rows from a spatial index, if the query allows for that
+/// either a geodist() upper bound filter, or a plain nearest-N query (ORDER BY geodist ASC, and nothing else to reject rows)
+bool CSphIndex_VLN::GetGeoCandidates ( const CSphQuery * pQuery, const ISphSchema & tSchema, const CSphQueryContext & tCtx, int iSorters, CSphVector<DWORD> & dRows ) const
+{
+	if ( !m_dGeoIndexes.GetLength() )
+		return false;
+
+	// cells move around on coordinate updates
+	CSphScopedRLock tCellsLock ( m_tCellsLock );
+
+	GeodistInfo_t tGeo;
+	float fMaxDist;
+	ARRAY_FOREACH ( i, pQuery->m_dFilters )
+		if ( sphGetGeodistFilter ( pQuery->m_dFilters[i], tSchema, tGeo, fMaxDist ) )
+			ARRAY_FOREACH ( j, m_dGeoIndexes )
+				if ( m_dGeoIndexes[j]->Covers ( tGeo ) )
+				{
+					m_dGeoIndexes[j]->CollectWithin ( tGeo, fMaxDist, dRows );
+					return true;
+				}
+
+	// nearest-N needs every row it returns to reach the sorter, and the sorter to keep the N closest ones
+	if ( tCtx.m_pFilter || iSorters!=1 || pQuery->m_eSort!=SPH_SORT_EXTENDED || !pQuery->m_sGroupBy.IsEmpty() || pQuery->m_iCutoff>0 )
+		return false;
+
+	CSphVector<CSphString> dSort;
+	sphSplit ( dSort, pQuery->m_sSortBy.cstr() );
+	if ( dSort.GetLength()!=2 || strcasecmp ( dSort[1].cstr(), "asc" )!=0 )
+		return false;
+
+	if ( !sphGetGeodistAttr ( tSchema, dSort[0].cstr(), tGeo ) )
+		return false;
+
+	ARRAY_FOREACH ( j, m_dGeoIndexes )
+		if ( m_dGeoIndexes[j]->Covers ( tGeo ) )
+		{
+			m_dGeoIndexes[j]->CollectNearest ( tGeo, pQuery->m_iOffset + pQuery->m_iLimit, dRows );
+			return true;
+		}
+
+	return false;
+}
+
+
+/// pick a rollup to answer a full-scan group-by with, if the query allows for that
+/// kill-listed documents are taken out of a copy of the cell totals, so there must be few enough of them
+int CSphIndex_VLN::GetRollup ( const CSphQuery * pQuery, int iSorters, ISphMatchSorter ** ppSorters, const CSphMultiQueryArgs & tArgs,
+	CSphRollupQuery & tRollup ) const
+{
+	if ( !m_dRollups.GetLength() || iSorters!=1 )
+		return -1;
+
+	int iRollup = tRollup.Setup ( m_dRollups, *pQuery, ppSorters[0] );
+	if ( iRollup<0 )
+		return -1;
+
+	int64_t iKilled = tArgs.m_pDeadRows ? (int64_t)tArgs.m_pDeadRows->BitCount() : 0;
+	ARRAY_FOREACH ( i, tArgs.m_dKillList )
+		iKilled += tArgs.m_dKillList[i].m_iLen;
+
+	if ( iKilled*CSphRollup::KILL_RATIO > m_iDocinfo )
+		return -1;
+
+	return iRollup;
+}
+
+
+/// copy the cell totals of a rollup without the kill-listed documents; leaves them empty if nothing is killed
+/// expects the cells lock held, as updates patch the totals in place
+void CSphIndex_VLN::GetRollupTotals ( int iRollup, const CSphMultiQueryArgs & tArgs, CSphVector<CSphRollup::Total_t> & dTotals ) const
+{
+	const CSphBitvec * pDeadRows = tArgs.m_pDeadRows;
+	int64_t iDeadRows = pDeadRows ? (int64_t)pDeadRows->BitCount() : 0;
+	if ( !tArgs.m_dKillList.GetLength() && !iDeadRows )
+		return;
+
+	// kill-lists of several indexes might overlap
+	CSphVector<SphDocID_t> dKilled;
+	ARRAY_FOREACH ( i, tArgs.m_dKillList )
+		memcpy ( dKilled.AddN ( tArgs.m_dKillList[i].m_iLen ), tArgs.m_dKillList[i].m_pBegin, sizeof(SphDocID_t)*tArgs.m_dKillList[i].m_iLen );
+	dKilled.Uniq();
+
+	const CSphRollup & tCells = *m_dRollups[iRollup];
+	const int iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+	dTotals = tCells.GetTotals();
+	ARRAY_FOREACH ( i, dKilled )
+	{
+		const DWORD * pRow = FindDocinfo ( dKilled[i] );
+		if ( !pRow )
+			continue;
+
+		// dead rows are taken out below, and must not go twice
+		size_t iRow = size_t ( ( pRow - m_tAttr.GetWritePtr() ) / iStride );
+		if ( !iDeadRows || !pDeadRows->BitGet ( iRow ) )
+			tCells.Subtract ( DOCINFO2ATTRS ( pRow ), dTotals );
+	}
+
+	for ( size_t iWord=0; iDeadRows && iWord<pDeadRows->GetSize(); iWord++ )
+	{
+		DWORD uBits = pDeadRows->Begin()[iWord];
+		for ( int iBit=0; uBits; iBit++, uBits >>= 1 )
+			if ( uBits & 1 )
+				tCells.Subtract ( DOCINFO2ATTRS ( m_tAttr.GetWritePtr() + ( iWord*32+iBit )*iStride ), dTotals );
+	}
+}
+
+
 bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pResult,
 	int iSorters, ISphMatchSorter ** ppSorters, const CSphMultiQueryArgs & tArgs ) const
 {
@@ -4397,12 +4965,23 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 
 	// set string pool for string on_sort expression fix up
 	tCtx.SetStringPool ( m_tString.GetWritePtr() );
+	tCtx.m_pStringDict = &m_tStringDict;
+
+	// group-by over rollup dimensions might be answered from pre-aggregated cells
+	// kill-list then goes into the cell totals, so that filters only see the dimensions
+	CSphRollupQuery tRollup;
+	int iRollup = GetRollup ( pQuery, iSorters, ppSorters, tArgs, tRollup );
 
 	// setup filters
 	if ( !tCtx.CreateFilters ( true, &pQuery->m_dFilters, ppSorters[iMaxSchemaIndex]->GetSchema(),
-		m_tMva.GetWritePtr(), m_tString.GetWritePtr(), pResult->m_sError, pResult->m_sWarning, pQuery->m_eCollation, m_bArenaProhibit, tArgs.m_dKillList ) )
+		m_tMva.GetWritePtr(), m_tString.GetWritePtr(), pResult->m_sError, pResult->m_sWarning, pQuery->m_eCollation, m_bArenaProhibit,
+		iRollup>=0 ? KillListVector() : tArgs.m_dKillList ) )
 			return false;
 
+	// dead rows go by row number, which rollup cells do not have (their totals lost those rows already)
+	if ( iRollup<0 && tArgs.m_pDeadRows )
+		tCtx.m_pFilter = sphJoinFilters ( tCtx.m_pFilter, sphCreateFilter ( *tArgs.m_pDeadRows, m_tAttr.GetWritePtr(), DOCINFO_IDSIZE + m_tSchema.GetRowSize() ) );
+
 	// check if we can early reject the whole index
 	if ( tCtx.m_pFilter && m_iDocinfoIndex )
 	{
@@ -4426,6 +5005,7 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 	{
 		(ppSorters[i])->SetMVAPool ( m_tMva.GetWritePtr(), m_bArenaProhibit );
 		(ppSorters[i])->SetStringPool ( m_tString.GetWritePtr() );
+		(ppSorters[i])->SetStringDict ( &m_tStringDict );
 	}
 
 	// setup overrides
@@ -4443,13 +5023,20 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 	if ( pResult->m_pProfile )
 		pResult->m_pProfile->Switch ( SPH_QSTATE_FULLSCAN );
 
+	// spatial index might narrow the scan down to a few candidate rows
+	CSphVector<DWORD> dGeoRows;
+	bool bGeoRows = GetGeoCandidates ( pQuery, ppSorters[iMaxSchemaIndex]->GetSchema(), tCtx, iSorters, dGeoRows );
+
 	// optimize direct lookups by id
+	// push rollup cells, if any
+	// scan spatial index candidates with row filtering, if any
 	// run full scan with block and row filtering for everything else
 	if ( pQuery->m_dFilters.GetLength()==1
 		&& pQuery->m_dFilters[0].m_eType==SPH_FILTER_VALUES
 		&& pQuery->m_dFilters[0].m_bExclude==false
 		&& pQuery->m_dFilters[0].m_sAttrName=="@id"
-		&& tArgs.m_dKillList.GetLength()==0 )
+		&& tArgs.m_dKillList.GetLength()==0
+		&& !tArgs.m_pDeadRows )
 	{
 		// run id lookups
 		for ( int i=0; i<pQuery->m_dFilters[0].GetNumValues(); i++ )
@@ -4477,6 +5064,55 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 			// stringptr expressions should be duplicated (or taken over) at this point
 			tCtx.FreeStrSort ( tMatch );
 		}
+	} else if ( iRollup>=0 )
+	{
+		// aggregates come from the cells, so there is nothing to calculate
+		// updates patch the cells in place, so they are only read under the lock
+		CSphScopedRLock tCellsLock ( m_tCellsLock );
+		CSphVector<CSphRollup::Total_t> dRollupTotals;
+		GetRollupTotals ( iRollup, tArgs, dRollupTotals );
+		pResult->m_tStats.m_iFetchedDocs += tRollup.Push ( *m_dRollups[iRollup], dRollupTotals.GetLength() ? &dRollupTotals : NULL,
+			tCtx.m_pFilter, ppSorters[0], tMatch );
+	} else if ( bGeoRows )
+	{
+		int iCutoff = ( pQuery->m_iCutoff<=0 ) ? -1 : pQuery->m_iCutoff;
+		DWORD uStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+		int iRows = dGeoRows.GetLength();
+
+		for ( int i=0; i<iRows; i++ )
+		{
+			int iRow = pQuery->m_bReverseScan ? iRows-1-i : i;
+			const DWORD * pDocinfo = m_tAttr.GetWritePtr() + int64_t ( dGeoRows[iRow] )*uStride;
+
+			pResult->m_tStats.m_iFetchedDocs++;
+			tMatch.m_uDocID = DOCINFO2ID ( pDocinfo );
+			CopyDocinfo ( &tCtx, tMatch, pDocinfo );
+
+			tCtx.CalcFilter ( tMatch );
+			if ( tCtx.m_pFilter && !tCtx.m_pFilter->Eval ( tMatch ) )
+			{
+				tCtx.FreeStrFilter ( tMatch );
+				continue;
+			}
+
+			if ( bRandomize )
+				tMatch.m_iWeight = ( sphRand() & 0xffff ) * tArgs.m_iIndexWeight;
+
+			// submit match to sorters
+			tCtx.CalcSort ( tMatch );
+
+			bool bNewMatch = false;
+			for ( int iSorter=0; iSorter<iSorters; iSorter++ )
+				bNewMatch |= ppSorters[iSorter]->Push ( tMatch );
+
+			// stringptr expressions should be duplicated (or taken over) at this point
+			tCtx.FreeStrFilter ( tMatch );
+			tCtx.FreeStrSort ( tMatch );
+
+			// handle cutoff
+			if ( bNewMatch && --iCutoff==0 )
+				break;
+		}
 	} else
 	{
 		bool bReverse = pQuery->m_bReverseScan; // shortcut
@@ -4646,6 +5282,9 @@ void CSphIndex_VLN::Dealloc ()
 	m_tAttr.Reset ();
 	m_tMva.Reset ();
 	m_tString.Reset ();
+	m_tStringDict.Reset ();
+	ResetGeoIndexes();
+	ResetRollups();
 	m_tKillList.Reset ();
 	m_tSkiplists.Reset ();
 	m_tWordlist.Reset ();
@@ -4843,6 +5482,26 @@ bool CSphIndex_VLN::LoadHeader ( const char * sHeaderName, bool bStripPath, CSph
 		ARRAY_FOREACH ( i, m_tSchema.m_dFields )
 			m_dFieldLens[i] = rdInfo.GetOffset(); // FIXME? ideally 64bit even when off is 32bit..
 
+	m_uStringDictEnd = 0;
+	if ( m_uVersion>=43 )
+	{
+		m_tSettings.m_sStringDictAttrs = rdInfo.GetString();
+		m_uStringDictEnd = rdInfo.GetDword();
+	}
+
+	if ( m_uVersion>=44 )
+	{
+		// generated attributes are regular ones; the setup only tags them with their paths, so that queries can use them
+		m_tSettings.m_sJsonAttrs = rdInfo.GetString();
+		SetupJsonAttrs();
+	}
+
+	if ( m_uVersion>=45 )
+		m_tSettings.m_sGeoIndex = rdInfo.GetString();
+
+	if ( m_uVersion>=46 )
+		m_tSettings.m_sRollups = rdInfo.GetString();
+
 	// post-load stuff.. for now, bigrams
 	CSphIndexSettings & s = m_tSettings;
 	if ( s.m_eBigramIndex!=SPH_BIGRAM_NONE && s.m_eBigramIndex!=SPH_BIGRAM_ALL )
@@ -4948,6 +5607,14 @@ void CSphIndex_VLN::DebugDumpHeader ( FILE * fp, const char * sHeaderName, bool
 			fprintf ( fp, "\trlp_context = %s\n", m_tSettings.m_sRLPContext.cstr() );
 		if ( !m_tSettings.m_sIndexTokenFilter.IsEmpty() )
 			fprintf ( fp, "\tindex_token_filter = %s\n", m_tSettings.m_sIndexTokenFilter.cstr() );
+		if ( !m_tSettings.m_sStringDictAttrs.IsEmpty() )
+			fprintf ( fp, "\tstring_attr_dict = %s\n", m_tSettings.m_sStringDictAttrs.cstr() );
+		if ( !m_tSettings.m_sJsonAttrs.IsEmpty() )
+			fprintf ( fp, "\tjson_attrs = %s\n", m_tSettings.m_sJsonAttrs.cstr() );
+		if ( !m_tSettings.m_sGeoIndex.IsEmpty() )
+			fprintf ( fp, "\tgeo_index = %s\n", m_tSettings.m_sGeoIndex.cstr() );
+		if ( !m_tSettings.m_sRollups.IsEmpty() )
+			fprintf ( fp, "\trollup = %s\n", m_tSettings.m_sRollups.cstr() );
 
 
 		CSphFieldFilterSettings tFieldFilter;
@@ -5057,6 +5724,10 @@ void CSphIndex_VLN::DebugDumpHeader ( FILE * fp, const char * sHeaderName, bool
 	fprintf ( fp, "bigram-freq-words: %s\n", m_tSettings.m_sBigramWords.cstr() );
 	fprintf ( fp, "rlp-context: %s\n", m_tSettings.m_sRLPContext.cstr() );
 	fprintf ( fp, "index-token-filter: %s\n", m_tSettings.m_sIndexTokenFilter.cstr() );
+	fprintf ( fp, "string-attr-dict: %s (end=%u, entries=%d)\n", m_tSettings.m_sStringDictAttrs.cstr(), m_uStringDictEnd, m_tStringDict.GetLength() );
+	fprintf ( fp, "json-attrs: %s\n", m_tSettings.m_sJsonAttrs.cstr() );
+	fprintf ( fp, "geo-index: %s\n", m_tSettings.m_sGeoIndex.cstr() );
+	fprintf ( fp, "rollup: %s\n", m_tSettings.m_sRollups.cstr() );
 	CSphFieldFilterSettings tFieldFilter;
 	GetFieldFilterSettings ( tFieldFilter );
 	ARRAY_FOREACH ( i, tFieldFilter.m_dRegexps )
@@ -5393,6 +6064,19 @@ bool CSphIndex_VLN::Prealloc ( bool bStripPath )
 
 		if ( m_uVersion>=17 && !m_tString.Setup ( GetIndexFileName("sps").cstr(), m_sLastError, true ) )
 				return false;
+
+		// string attribute dictionary lives at the head of string data
+		if ( m_uStringDictEnd )
+		{
+			if ( m_uStringDictEnd>m_tString.GetLengthBytes() )
+			{
+				m_sLastError.SetSprintf ( "string dictionary end %u is out of strings file bounds (size=" INT64_FMT ")",
+					m_uStringDictEnd, (int64_t)m_tString.GetLengthBytes() );
+				return false;
+			}
+			if ( !m_tStringDict.Setup ( m_tString.GetWritePtr(), m_uStringDictEnd, m_sLastError ) )
+				return false;
+		}
 	}
 
 
@@ -5433,6 +6117,87 @@ bool CSphIndex_VLN::Prealloc ( bool bStripPath )
 }
 
 
+void CSphIndex_VLN::SetupJsonAttrs ()
+{
+	m_dJsonAttrs.Reset();
+	if ( m_tSettings.m_sJsonAttrs.IsEmpty() )
+		return;
+
+	CSphString sError;
+	if ( !sphJsonAttrsSetup ( m_tSchema, m_tSettings.m_sJsonAttrs, m_dJsonAttrs, sError ) )
+	{
+		sphWarning ( "index '%s': %s (generated attributes will not replace JSON paths)", m_sIndexName.cstr(), sError.cstr() );
+		m_dJsonAttrs.Reset();
+	}
+}
+
+
+void CSphIndex_VLN::ResetGeoIndexes ()
+{
+	ARRAY_FOREACH ( i, m_dGeoIndexes )
+		SafeDelete ( m_dGeoIndexes[i] );
+	m_dGeoIndexes.Reset();
+}
+
+
+void CSphIndex_VLN::SetupGeoIndexes ()
+{
+	ResetGeoIndexes();
+
+	// geo_index = lat1:lon1, lat2:lon2, ...
+	CSphVector<CSphString> dAttrs;
+	sphSplit ( dAttrs, m_tSettings.m_sGeoIndex.cstr() );
+	if ( dAttrs.GetLength()%2 )
+	{
+		sphWarning ( "index '%s': geo_index: expected lat:lon attribute pairs, got '%s' (spatial index disabled)", m_sIndexName.cstr(), m_tSettings.m_sGeoIndex.cstr() );
+		return;
+	}
+
+	int iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+	for ( int i=0; i<dAttrs.GetLength(); i+=2 )
+	{
+		const CSphColumnInfo * pLat = m_tSchema.GetAttr ( dAttrs[i].cstr() );
+		const CSphColumnInfo * pLon = m_tSchema.GetAttr ( dAttrs[i+1].cstr() );
+		if ( !pLat || !pLon || pLat->m_eAttrType!=ESphAttr::SPH_ATTR_FLOAT || pLon->m_eAttrType!=ESphAttr::SPH_ATTR_FLOAT )
+		{
+			sphWarning ( "index '%s': geo_index: '%s:%s' is not a pair of float attributes (skipped)", m_sIndexName.cstr(), dAttrs[i].cstr(), dAttrs[i+1].cstr() );
+			continue;
+		}
+
+		CSphGeoIndex * pGeo = new CSphGeoIndex();
+		pGeo->Build ( m_tAttr.GetWritePtr(), m_iDocinfo, iStride, pLat->m_tLocator, pLon->m_tLocator );
+		sphLogDebug ( "index '%s': spatial index on %s:%s, " INT64_FMT " bytes", m_sIndexName.cstr(), dAttrs[i].cstr(), dAttrs[i+1].cstr(), pGeo->GetUsedBytes() );
+		m_dGeoIndexes.Add ( pGeo );
+	}
+}
+
+
+void CSphIndex_VLN::ResetRollups ()
+{
+	ARRAY_FOREACH ( i, m_dRollups )
+		SafeDelete ( m_dRollups[i] );
+	m_dRollups.Reset();
+}
+
+
+void CSphIndex_VLN::SetupRollups ()
+{
+	ResetRollups();
+
+	CSphString sError;
+	if ( !sphRollupsSetup ( m_tSettings.m_sRollups, m_tSchema, m_dRollups, sError ) )
+		sphWarning ( "index '%s': %s (skipped)", m_sIndexName.cstr(), sError.cstr() );
+
+	int iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+	ARRAY_FOREACH ( i, m_dRollups )
+	{
+		m_dRollups[i]->Build ( m_tAttr.GetWritePtr(), m_iDocinfo, iStride );
+		sphLogDebug ( "index '%s': rollup '%s', %d cells, " INT64_FMT " bytes", m_sIndexName.cstr(), m_dRollups[i]->GetSpec().cstr(),
+			m_dRollups[i]->GetCells(), m_dRollups[i]->GetUsedBytes() );
+	}
+}
+
+
 void CSphIndex_VLN::Preread ()
 {
 	MEMORY ( MEM_INDEX_DISK );
@@ -5496,6 +6261,18 @@ void CSphIndex_VLN::Preread ()
 		pHash [ ++uLastHash ] = (DWORD)m_iDocinfo;
 	}
 
+	// generated attributes, unless the header had them already
+	if ( !m_tSettings.m_sJsonAttrs.IsEmpty() && !m_dJsonAttrs.GetLength() )
+		SetupJsonAttrs();
+
+	// build spatial indexes
+	if ( !m_tSettings.m_sGeoIndex.IsEmpty() && m_tAttr.GetLengthBytes() && !m_bDebugCheck )
+		SetupGeoIndexes();
+
+	// count rollups
+	if ( !m_tSettings.m_sRollups.IsEmpty() && m_tAttr.GetLengthBytes() && !m_bDebugCheck )
+		SetupRollups();
+
 	m_bPassedRead = true;
 	sphLogDebug ( "Preread successfully finished, hash=%u", (DWORD)uRead );
 	return;
@@ -6074,6 +6851,66 @@ bool CSphIndex_VLN::MultiQueryEx ( int iQueries, const CSphQuery * pQueries,
 	return bResult | bResultScan;
 }
 
+/// queue the columns an expression reads, skipping the ones already queued
+static void QueueDependentCols ( ISphExpr * pExpr, CSphVector<int> & dCols, CSphBitvec & dQueued )
+{
+	CSphVector<int> dDeps;
+	pExpr->Command ( SPH_EXPR_GET_DEPENDENT_COLS, &dDeps );
+	ARRAY_FOREACH ( i, dDeps )
+		if ( !dQueued.BitGet ( dDeps[i] ) )
+		{
+			dQueued.BitSet ( dDeps[i] );
+			dCols.Add ( dDeps[i] );
+		}
+}
+
+
+/// check whether computed items read row attributes, either directly or through the computed columns they depend on
+/// every column gets checked (and expanded) once, however many items share it
+static bool CalcUsesRow ( const CSphVector<CSphQueryContext::CalcItem_t> & dCalc, const ISphSchema & tSchema )
+{
+	CSphVector<int> dCols;
+	CSphBitvec dQueued ( tSchema.GetAttrsCount() );
+	ARRAY_FOREACH ( i, dCalc )
+		QueueDependentCols ( dCalc[i].m_pExpr, dCols, dQueued );
+
+	for ( int i=0; i<dCols.GetLength(); i++ )
+	{
+		const CSphColumnInfo & tCol = tSchema.GetAttr ( dCols[i] );
+		if ( !tCol.m_tLocator.m_bDynamic )
+			return true;
+		if ( tCol.m_pExpr.Ptr() )
+			QueueDependentCols ( tCol.m_pExpr.Ptr(), dCols, dQueued );
+	}
+	return false;
+}
+
+
+/// check whether a sorter reads row attributes when it compares matches
+/// keys over computed columns do not count, those get computed (or looked up) along with the sort stage items
+static bool SorterUsesRow ( ISphMatchSorter * pSorter )
+{
+	if ( !pSorter->UsesAttrs() )
+		return false;
+
+	if ( pSorter->IsGroupby() )
+		return true;
+
+	const CSphMatchComparatorState & tState = pSorter->GetState();
+	const ISphSchema & tSchema = pSorter->GetSchema();
+	for ( int i=0; i<CSphMatchComparatorState::MAX_ATTRS; i++ )
+	{
+		ESphSortKeyPart ePart = tState.m_eKeypart[i];
+		if ( ePart==SPH_KEYPART_ID || ePart==SPH_KEYPART_WEIGHT )
+			continue;
+
+		if ( tState.m_dAttrs[i]<0 || !tSchema.GetAttr ( tState.m_dAttrs[i] ).m_tLocator.m_bDynamic )
+			return true;
+	}
+	return false;
+}
+
+
 bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult,
 	int iSorters, ISphMatchSorter ** ppSorters, const XQQuery_t & tXQ, CSphDict * pDict,
 	const CSphMultiQueryArgs & tArgs, CSphQueryNodeCache * pNodeCache, const SphWordStatChecker_t & tStatDiff ) const
@@ -6124,6 +6961,7 @@ bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult
 
 	// set string pool for string on_sort expression fix up
 	tCtx.SetStringPool ( m_tString.GetWritePtr() );
+	tCtx.m_pStringDict = &m_tStringDict;
 
 	tCtx.m_uPackedFactorFlags = tArgs.m_uPackedFactorFlags;
 
@@ -6221,6 +7059,11 @@ bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult
 		m_tMva.GetWritePtr(), m_tString.GetWritePtr(), pResult->m_sError, pResult->m_sWarning, pQuery->m_eCollation, m_bArenaProhibit, tArgs.m_dKillList ) )
 			return false;
 
+	// dead rows need the row looked up before the filters
+	bool bDeadRows = ( tArgs.m_pDeadRows && m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN );
+	if ( bDeadRows )
+		tCtx.m_pFilter = sphJoinFilters ( tCtx.m_pFilter, sphCreateFilter ( *tArgs.m_pDeadRows, m_tAttr.GetWritePtr(), DOCINFO_IDSIZE + m_tSchema.GetRowSize() ) );
+
 	// check if we can early reject the whole index
 	if ( tCtx.m_pFilter && m_iDocinfoIndex )
 	{
@@ -6233,23 +7076,31 @@ bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult
 	}
 
 	// setup lookup
-	tCtx.m_bLookupFilter = ( m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN ) && pQuery->m_dFilters.GetLength();
+	tCtx.m_bLookupFilter = ( ( m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN ) && pQuery->m_dFilters.GetLength() ) || bDeadRows;
 	if ( tCtx.m_dCalcFilter.GetLength() || pQuery->m_eRanker==SPH_RANK_EXPR || pQuery->m_eRanker==SPH_RANK_EXPORT )
 		tCtx.m_bLookupFilter = true; // suboptimal in case of attr-independent expressions, but we don't care
 
+	// rows that neither filters nor sorting need only get looked up for the final top-k (see SphFinalMatchCalc_t)
+	// overrides are applied on lookup, so anything they touch might need it early
 	tCtx.m_bLookupSort = false;
 	if ( m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN && !tCtx.m_bLookupFilter )
+	{
+		const ISphSchema & tSorterSchema = ppSorters[iMaxSchemaIndex]->GetSchema();
+		bool bOverrides = pQuery->m_dOverrides.GetLength()>0;
 		for ( int iSorter=0; iSorter<iSorters && !tCtx.m_bLookupSort; iSorter++ )
-			if ( ppSorters[iSorter]->UsesAttrs() )
+			if ( bOverrides ? ppSorters[iSorter]->UsesAttrs() : SorterUsesRow ( ppSorters[iSorter] ) )
 				tCtx.m_bLookupSort = true;
-	if ( tCtx.m_dCalcSort.GetLength() )
-		tCtx.m_bLookupSort = true; // suboptimal in case of attr-independent expressions, but we don't care
+		if ( tCtx.m_dCalcSort.GetLength() && ( bOverrides || CalcUsesRow ( tCtx.m_dCalcSort, tSorterSchema ) ) )
+			tCtx.m_bLookupSort = true;
+	} else if ( tCtx.m_dCalcSort.GetLength() && !tCtx.m_bLookupFilter )
+		tCtx.m_bLookupSort = true;
 
 	// setup sorters vs. MVA
 	for ( int i=0; i<iSorters; i++ )
 	{
 		(ppSorters[i])->SetMVAPool ( m_tMva.GetWritePtr(), m_bArenaProhibit );
 		(ppSorters[i])->SetStringPool ( m_tString.GetWritePtr() );
+		(ppSorters[i])->SetStringDict ( &m_tStringDict );
 	}
 
 	// setup overrides
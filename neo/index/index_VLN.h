@@ -24,6 +24,11 @@
 #include "neo/core/match.h"
 #include "neo/core/build_header.h"
 #include "neo/core/word_list.h"
+#include "neo/core/string_dict.h"
+#include "neo/core/geo_index.h"
+#include "neo/source/json_attrs.h"
+#include "neo/platform/mutex.h"
+#include "neo/query/rollup_query.h"
 #include "neo/query/get_keyword_settings.h"
 
 
@@ -38,6 +43,7 @@ namespace NEO {
 	class CSphQueryNodeCache;
 	struct SphWordStatChecker_t;
 	class CSphScopedPayload;
+	struct MergeDocinfo_t;
 
 
 	/// this is my actual VLN-compressed phrase index implementation
@@ -47,6 +53,7 @@ namespace NEO {
 		friend class CSphMerger;
 		friend class AttrIndexBuilder_t<SphDocID_t>;
 		friend struct SphFinalMatchCalc_t;
+		friend class MvaRelocator_c;
 
 	public:
 		explicit					CSphIndex_VLN(const char* sIndexName, const char* sFilename);
@@ -89,6 +96,7 @@ namespace NEO {
 
 		template <class QWORDDST, class QWORDSRC>
 		static bool					MergeWords(const CSphIndex_VLN* pDstIndex, const CSphIndex_VLN* pSrcIndex, const ISphFilter* pFilter, const CSphVector<SphDocID_t>& dKillList, SphDocID_t uMinID, CSphHitBuilder* pHitBuilder, CSphString& sError, CSphSourceStats& tStat, CSphIndexProgress& tProgress, ThrottleState_t* pThrottle, volatile bool* pGlobalStop, volatile bool* pLocalStop);
+		static bool					MergeDocinfo(MergeDocinfo_t& tCtx);
 		static bool					DoMerge(const CSphIndex_VLN* pDstIndex, const CSphIndex_VLN* pSrcIndex, bool bMergeKillLists, ISphFilter* pFilter, const CSphVector<SphDocID_t>& dKillList, CSphString& sError, CSphIndexProgress& tProgress, ThrottleState_t* pThrottle, volatile bool* pGlobalStop, volatile bool* pLocalStop);
 
 		virtual int					UpdateAttributes(const CSphAttrUpdate& tUpd, int iIndex, CSphString& sError, CSphString& sWarning);
@@ -104,6 +112,7 @@ namespace NEO {
 		virtual SphDocID_t* GetKillList() const;
 		virtual int					GetKillListSize() const;
 		virtual bool				HasDocid(SphDocID_t uDocid) const;
+		virtual int64_t				MarkDocinfoRows(const SphDocID_t* pDocs, int iDocs, CSphBitvec& tRows) const;
 
 		virtual const CSphSourceStats& GetStats() const { return m_tStats; }
 		virtual int64_t* GetFieldLens() const { return m_tSettings.m_bIndexFieldLens ? m_dFieldLens.Begin() : NULL; }
@@ -146,6 +155,12 @@ namespace NEO {
 		CSphMappedBuffer<DWORD>			m_tAttr;
 		CSphMappedBuffer<DWORD>			m_tMva;
 		CSphMappedBuffer<BYTE>			m_tString;
+		DWORD							m_uStringDictEnd;	//string attribute dictionary end offset within m_tString
+		CSphStringDict					m_tStringDict;		//string attribute dictionary over m_tString
+		CSphVector<CSphGeoIndex*>		m_dGeoIndexes;		//in-memory spatial indexes over lat/lon attribute pairs (as per geo_index)
+		CSphVector<CSphRollup*>			m_dRollups;			//pre-aggregated group-by tables (as per rollup)
+		CSphVector<CSphJsonAttr>		m_dJsonAttrs;		//generated attributes (as per json_attrs), re-evaluated on JSON updates
+		mutable CSphRwlock				m_tCellsLock;		//guards spatial index and rollup cells, which attribute updates patch in place
 		CSphMappedBuffer<SphDocID_t>	m_tKillList;		//killlist
 		CSphMappedBuffer<BYTE>			m_tSkiplists;		//(compressed) skiplists data
 		CWordlist										m_tWordlist;		//my wordlist
@@ -168,6 +183,7 @@ namespace NEO {
 		DWORD						m_uAttrsStatus;
 		int							m_iIndexTag;			//my ids for MVA updates pool
 		static volatile int			m_iIndexTagSeq;			//static ids sequence
+		int							m_iMvaFreed;			//updated MVA frees since the last arena compaction
 
 		CSphAutofile				m_tDoclistFile;			//doclist file
 		CSphAutofile				m_tHitlistFile;			//hitlist file
@@ -191,8 +207,19 @@ namespace NEO {
 		bool						RelocateBlock(int iFile, BYTE* pBuffer, int iRelocationSize, SphOffset_t* pFileSize, CSphBin* pMinBin, SphOffset_t* pSharedOffset);
 		bool						PrecomputeMinMax();
 
+		void						SetupJsonAttrs();
+		void						SetupGeoIndexes();
+		void						ResetGeoIndexes();
+		bool						GetGeoCandidates(const CSphQuery* pQuery, const ISphSchema& tSchema, const CSphQueryContext& tCtx, int iSorters, CSphVector<DWORD>& dRows) const;
+		void						SetupRollups();
+		void						ResetRollups();
+		int							GetRollup(const CSphQuery* pQuery, int iSorters, ISphMatchSorter** ppSorters, const CSphMultiQueryArgs& tArgs,
+										CSphRollupQuery& tRollup) const;
+		void						GetRollupTotals(int iRollup, const CSphMultiQueryArgs& tArgs, CSphVector<CSphRollup::Total_t>& dTotals) const;
+
 	private:
 		bool						LoadPersistentMVA(CSphString& sError);
+		void						CompactUpdatedMVA();
 
 		bool						JuggleFile(const char* szExt, CSphString& sError, bool bNeedOrigin = true) const;
 		XQNode_t* ExpandPrefix(XQNode_t* pNode, CSphQueryResultMeta* pResult, CSphScopedPayload* pPayloads, DWORD uQueryDebugFlags) const;
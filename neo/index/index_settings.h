@@ -30,6 +30,9 @@ namespace NEO {
 		CSphString		m_sRLPContext;			///< path to RLP context file
 
 		CSphString		m_sIndexTokenFilter;	///< indexing time token filter spec string (pretty useless for disk, vital for RT)
+		CSphString		m_sStringDictAttrs;		///< string attributes to store via per-index value dictionary (comma separated)
+		CSphString		m_sGeoIndex;			///< lat:lon float attribute pairs to keep an in-memory spatial index for (comma separated)
+		CSphString		m_sRollups;				///< dimensions:measures tuples to keep pre-aggregated group-by tables for (semicolon separated)
 
 		CSphIndexSettings()
 			: m_eDocinfo(SPH_DOCINFO_NONE)
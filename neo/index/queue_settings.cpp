@@ -3,18 +3,23 @@
 #include "neo/query/query.h"
 #include "neo/query/match_sorter.h"
 #include "neo/query/match_queue.h"
+#include "neo/query/key_match_queue.h"
+#include "neo/query/stream_match_queue.h"
 #include "neo/query/query_result.h"
 #include "neo/source/schema.h"
+#include "neo/source/json_attrs.h"
 #include "neo/io/fnv64.h"
 #include "neo/core/geo_dist.h"
 #include "neo/query/group_sorter_settings.h"
 #include "neo/query/group_sorter.h"
+#include "neo/query/exact_group_sorter.h"
 #include "neo/query/grouper.h"
 #include "neo/query/attr_update.h"
 #include "neo/query/imatch_comparator.h"
 #include "neo/tools/utf8_tools.h"
 #include "neo/platform/random.h"
 #include "neo/tools/docinfo_transformer.h"
+#include "neo/platform/thread.h"
 
 #include "neo/sphinx/xjson.h"
 #include "neo/sphinx/xfilter.h"
@@ -586,6 +591,15 @@ static ISphMatchSorter* sphCreateSorter3rd(const ISphMatchComparator* pComp, con
 		+ (tSettings.m_bImplicit ? 8 : 0)
 		+ ((pQuery->m_iGroupbyLimit > 1) ? 16 : 0)
 		+ (tSettings.m_bJson ? 32 : 0);
+
+	// exact group-by covers plain groupers; MVA, JSON, N-best and packed factors stay on k-buffers
+	if (pQuery->m_bGroupbyExact && (uSelector == 0 || uSelector == 2))
+	{
+		if (tSettings.m_bDistinct)
+			return new CSphExactGroupSorter < COMPGROUP, true >(pComp, pQuery, tSettings);
+		return new CSphExactGroupSorter < COMPGROUP, false >(pComp, pQuery, tSettings);
+	}
+
 	switch (uSelector)
 	{
 	case 0:
@@ -777,7 +791,12 @@ static ISphMatchSorter* CreatePlainSorter(bool bKbuffer, int iMaxMatches, bool b
 
 int sphFlattenQueue(ISphMatchSorter* pQueue, CSphQueryResult* pResult, int iTag)
 {
-	if (!pQueue || !pQueue->GetLength())
+	if (!pQueue)
+		return 0;
+
+	// the arena is kept for the next round of a reused sorter, so it gets reported even when there are no matches left
+	pResult->m_iArenaBytes += pQueue->GetArenaBytes();
+	if (!pQueue->GetLength())
 		return 0;
 
 	int iOffset = pResult->m_dMatches.GetLength();
@@ -788,6 +807,227 @@ int sphFlattenQueue(ISphMatchSorter* pQueue, CSphQueryResult* pResult, int iTag)
 }
 
 
+/// sorts by docid, then by tag, to pick the match of the most recent source among the dupes
+struct TaggedMatchSorter_fn : public SphAccessor_T<CSphMatch>
+{
+	void CopyKey(CSphMatch* pMed, CSphMatch* pVal) const
+	{
+		pMed->m_uDocID = pVal->m_uDocID;
+		pMed->m_iTag = pVal->m_iTag;
+	}
+
+	bool IsLess(const CSphMatch& a, const CSphMatch& b) const
+	{
+		bool bDistA = ((a.m_iTag & 0x80000000) == 0x80000000);
+		bool bDistB = ((b.m_iTag & 0x80000000) == 0x80000000);
+		// sort by doc_id, dist_tag, tag
+		return (a.m_uDocID < b.m_uDocID) ||
+			(a.m_uDocID == b.m_uDocID && ((!bDistA && bDistB) || ((a.m_iTag & 0x7FFFFFFF) > (b.m_iTag & 0x7FFFFFFF))));
+	}
+
+	// inherited swap does not work on gcc
+	void Swap(CSphMatch* a, CSphMatch* b) const
+	{
+		NEO::Swap(*a, *b);
+	}
+};
+
+
+static int MergeMatches(ISphMatchSorter* pSorter, CSphMatch* pMatches, int iMatches, const bool* pNewSet)
+{
+	int iDupes = 0;
+	if (pSorter->IsGroupby())
+	{
+		// groupby sorter does that automagically
+		for (int i = 0; i < iMatches; i++)
+			if (!pSorter->PushGrouped(pMatches[i], pNewSet[i]))
+				iDupes++;
+	}
+	else
+	{
+		// normal sorter needs massasging
+		// sort by docid and then by tag to guarantee the replacement order
+		TaggedMatchSorter_fn fnSort;
+		sphSort(pMatches, iMatches, fnSort, fnSort);
+
+		// by default, simply remove dupes (select first by tag)
+		for (int i = 0; i < iMatches; i++)
+		{
+			if (i == 0 || pMatches[i].m_uDocID != pMatches[i - 1].m_uDocID)
+				pSorter->Push(pMatches[i]);
+			else
+				iDupes++;
+		}
+	}
+	return iDupes;
+}
+
+
+/// merge stage partition
+/// gets the matches whose group key (or docid) hashes to it, and merges them with a sorter of its own, on its own thread
+struct MergePartition_t
+{
+	SphThread_t				m_tThd;
+	bool					m_bThread;
+	ISphMatchSorter*		m_pSorter;
+	CSphMatch*				m_pMatches;
+	const bool*				m_pNewSet;		///< whether a match begins the bunch of matches got from one source
+	int						m_iMatches;
+	int						m_iDupes;
+	CSphQueryResult			m_tResult;		///< flattened partition sorter
+
+	MergePartition_t()
+		: m_bThread(false)
+		, m_pSorter(NULL)
+		, m_pMatches(NULL)
+		, m_pNewSet(NULL)
+		, m_iMatches(0)
+		, m_iDupes(0)
+	{}
+};
+
+
+static void MergePartitionThreadFunc(void* pArg)
+{
+	MergePartition_t* pPart = (MergePartition_t*)pArg;
+	pPart->m_iDupes = MergeMatches(pPart->m_pSorter, pPart->m_pMatches, pPart->m_iMatches, pPart->m_pNewSet);
+	sphFlattenQueue(pPart->m_pSorter, &pPart->m_tResult, -1);
+}
+
+
+/// merge matches in partitions of disjoint docids (or group keys), each on its own thread
+/// partition sorters flatten to whatever passes their own limit, which is all the final sorter could take from them anyway
+static int MergeDupesMT(ISphMatchSorter* pSorter, CSphVector<ISphMatchSorter*>& dParts, CSphSwapVector<CSphMatch>& dMatches,
+	const CSphVector<int>& dMatchCounts, const ISphSchema& tSchema, int64_t& iArenaBytes)
+{
+	const int iParts = dParts.GetLength();
+	const bool bGroupby = pSorter->IsGroupby();
+	CSphAttrLocator tLocGroupby;
+	if (bGroupby)
+		tLocGroupby = pSorter->GetSchema().GetAttr("@groupby")->m_tLocator;
+
+	// assign matches to partitions, keeping the result set order within each one
+	CSphVector<int> dPartOf(dMatches.GetLength());
+	CSphVector<bool> dNewSet(dMatches.GetLength());
+	CSphVector<int> dLastSet(iParts);
+	CSphVector<int> dCounts(iParts + 1);
+	dLastSet.Fill(-1);
+	dCounts.Fill(0);
+
+	int iMC = 0;
+	int iBound = 0;
+	ARRAY_FOREACH(i, dMatches)
+	{
+		if (i == iBound)
+			iBound += dMatchCounts[iMC++];
+
+		const CSphMatch& tMatch = dMatches[i];
+		uint64_t uKey = bGroupby ? (uint64_t)tMatch.GetAttr(tLocGroupby) : (uint64_t)tMatch.m_uDocID;
+		int iPart = (int)(((uKey * U64C(0x9E3779B97F4A7C15)) >> 32) % (uint64_t)iParts);
+
+		dPartOf[i] = iPart;
+		dNewSet[i] = (dLastSet[iPart] != iMC);
+		dLastSet[iPart] = iMC;
+		dCounts[iPart + 1]++;
+	}
+
+	for (int i = 1; i <= iParts; i++)
+		dCounts[i] += dCounts[i - 1];
+
+	// move matches (and their source flags) to contiguous partition ranges
+	CSphSwapVector<CSphMatch> dSorted;
+	dSorted.Resize(dMatches.GetLength());
+	CSphVector<bool> dNewSetSorted(dMatches.GetLength());
+	CSphVector<int> dCursor(iParts);
+	memcpy(dCursor.Begin(), dCounts.Begin(), iParts * sizeof(int));
+	ARRAY_FOREACH(i, dMatches)
+	{
+		int iDst = dCursor[dPartOf[i]]++;
+		Swap(dSorted[iDst], dMatches[i]);
+		dNewSetSorted[iDst] = dNewSet[i];
+	}
+	dMatches.SwapData(dSorted);
+
+	// partitions that get no thread are merged right here
+	CSphVector<MergePartition_t> dThreads(iParts);
+	ARRAY_FOREACH(i, dThreads)
+	{
+		MergePartition_t& t = dThreads[i];
+		t.m_pSorter = dParts[i];
+		t.m_pMatches = dMatches.Begin() + dCounts[i];
+		t.m_pNewSet = dNewSetSorted.Begin() + dCounts[i];
+		t.m_iMatches = dCounts[i + 1] - dCounts[i];
+		t.m_bThread = sphThreadCreate(&t.m_tThd, MergePartitionThreadFunc, (void*)&t);
+		if (!t.m_bThread)
+			MergePartitionThreadFunc(&t);
+	}
+
+	ARRAY_FOREACH(i, dThreads)
+		if (dThreads[i].m_bThread)
+			sphThreadJoin(&dThreads[i].m_tThd);
+
+	// partitions share no docids (or groups), so the final sorter only orders and limits them
+	int iDupes = 0;
+	ARRAY_FOREACH(i, dThreads)
+	{
+		MergePartition_t& t = dThreads[i];
+		iDupes += t.m_iDupes;
+
+		CSphSwapVector<CSphMatch>& dPartMatches = t.m_tResult.m_dMatches;
+		ARRAY_FOREACH(j, dPartMatches)
+		{
+			if (bGroupby)
+				pSorter->PushGrouped(dPartMatches[j], j == 0);
+			else
+				pSorter->Push(dPartMatches[j]);
+			tSchema.FreeStringPtrs(&dPartMatches[j]);
+		}
+
+		iArenaBytes += dParts[i]->GetArenaBytes();
+		SafeDelete(dParts[i]);
+	}
+	dParts.Reset();
+
+	return iDupes;
+}
+
+
+int sphMergeDupes(ISphMatchSorter* pSorter, CSphVector<ISphMatchSorter*>& dParts, CSphSwapVector<CSphMatch>& dMatches,
+	const CSphVector<int>& dMatchCounts, const ISphSchema& tSchema, int64_t& iArenaBytes)
+{
+	assert(pSorter);
+
+	if (pSorter->IsGroupby())
+	{
+		pSorter->SetMVAPool(NULL, false); // because we must be able to group on @groupby anyway
+		pSorter->SetStringPool(NULL);
+		ARRAY_FOREACH(i, dParts)
+		{
+			dParts[i]->SetMVAPool(NULL, false);
+			dParts[i]->SetStringPool(NULL);
+		}
+	}
+
+	if (dParts.GetLength())
+		return MergeDupesMT(pSorter, dParts, dMatches, dMatchCounts, tSchema, iArenaBytes);
+
+	if (!pSorter->IsGroupby())
+		return MergeMatches(pSorter, dMatches.Begin(), dMatches.GetLength(), NULL);
+
+	// source boundaries go along with the matches
+	CSphVector<bool> dNewSet(dMatches.GetLength());
+	int iMC = 0;
+	int iBound = 0;
+	ARRAY_FOREACH(i, dMatches)
+	{
+		dNewSet[i] = (i == iBound);
+		if (i == iBound)
+			iBound += dMatchCounts[iMC++];
+	}
+	return MergeMatches(pSorter, dMatches.Begin(), dMatches.GetLength(), dNewSet.Begin());
+}
+
+
 bool sphHasExpressions(const CSphQuery& tQuery, const CSphSchema& tSchema)
 {
 	ARRAY_FOREACH(i, tQuery.m_dItems)
@@ -808,8 +1048,17 @@ bool sphHasExpressions(const CSphQuery& tQuery, const CSphSchema& tSchema)
 }
 
 
-static ISphMatchSorter* CreatePlainSorter(ESphSortFunc eMatchFunc, bool bKbuffer, int iMaxMatches, bool bUsesAttrs, bool bFactors)
+static ISphMatchSorter* CreatePlainSorter(ESphSortFunc eMatchFunc, const CSphMatchComparatorState& tState, bool bKbuffer, int iMaxMatches, bool bUsesAttrs, bool bFactors)
 {
+	// numeric keys can be normalized once per match, and compared as plain words in the heap
+	if (!bKbuffer && CSphKeyMatchQueue<false>::IsSupported(eMatchFunc, tState))
+	{
+		if (bFactors)
+			return new CSphKeyMatchQueue<true>(eMatchFunc, iMaxMatches, bUsesAttrs);
+		else
+			return new CSphKeyMatchQueue<false>(eMatchFunc, iMaxMatches, bUsesAttrs);
+	}
+
 	switch (eMatchFunc)
 	{
 	case FUNC_REL_DESC:		return CreatePlainSorter<MatchRelevanceLt_fn>(bKbuffer, iMaxMatches, bUsesAttrs, bFactors); break;
@@ -846,6 +1095,10 @@ static bool SetupGroupbySettings(const CSphQuery* pQuery, const ISphSchema& tSch
 
 	CSphString sJsonColumn;
 	CSphString sJsonKey;
+
+	// json path materialized into a generated attribute groups as a plain attribute
+	int iGenerated = sphJsonAttrFind(tSchema, pQuery->m_sGroupBy.cstr());
+
 	if (pQuery->m_eGroupFunc == SPH_GROUPBY_MULTIPLE)
 	{
 		CSphVector<CSphAttrLocator> dLocators;
@@ -907,7 +1160,7 @@ static bool SetupGroupbySettings(const CSphQuery* pQuery, const ISphSchema& tSch
 		tSettings.m_pGrouper = sphCreateGrouperMulti(dLocators, dAttrTypes, dJsonKeys, pQuery->m_eCollation);
 
 	}
-	else if (sphJsonNameSplit(pQuery->m_sGroupBy.cstr(), &sJsonColumn, &sJsonKey))
+	else if (iGenerated < 0 && sphJsonNameSplit(pQuery->m_sGroupBy.cstr(), &sJsonColumn, &sJsonKey))
 	{
 		const int iAttr = tSchema.GetAttrIndex(sJsonColumn.cstr());
 		if (iAttr < 0)
@@ -944,6 +1197,8 @@ static bool SetupGroupbySettings(const CSphQuery* pQuery, const ISphSchema& tSch
 	{
 		// setup groupby attr
 		int iGroupBy = tSchema.GetAttrIndex(pQuery->m_sGroupBy.cstr());
+		if (iGroupBy < 0)
+			iGroupBy = iGenerated;
 
 		if (iGroupBy < 0)
 		{
@@ -1199,17 +1454,34 @@ static CSphGrouper* sphCreateGrouperString(const CSphAttrLocator& tLoc, ESphColl
 		return new CSphGrouperString<BinaryHash_fn>(tLoc);
 }
 
+template <class PRED>
+static CSphGrouper* CreateGrouperMulti(const CSphVector<CSphAttrLocator>& dLocators, const CSphVector<ESphAttr>& dAttrTypes,
+	const CSphVector<ISphExpr*>& dJsonKeys)
+{
+	// common composites get their own kernels; those take no JSON keys
+	if (CSphGrouperIntString<PRED>::CanGroup(dAttrTypes))
+		return new CSphGrouperIntString<PRED>(dLocators, dAttrTypes);
+
+	return new CSphGrouperMulti<PRED>(dLocators, dAttrTypes, dJsonKeys);
+}
+
 static CSphGrouper* sphCreateGrouperMulti(const CSphVector<CSphAttrLocator>& dLocators, const CSphVector<ESphAttr>& dAttrTypes,
 	const CSphVector<ISphExpr*>& dJsonKeys, ESphCollation eCollation)
 {
+	// integers that fit into a single key do not need hashing (nor a collation)
+	if (CSphGrouperMultiPacked<2>::CanPack(dLocators, dAttrTypes))
+		return new CSphGrouperMultiPacked<2>(dLocators);
+	if (CSphGrouperMultiPacked<3>::CanPack(dLocators, dAttrTypes))
+		return new CSphGrouperMultiPacked<3>(dLocators);
+
 	if (eCollation == SPH_COLLATION_UTF8_GENERAL_CI)
-		return new CSphGrouperMulti<Utf8CIHash_fn>(dLocators, dAttrTypes, dJsonKeys);
+		return CreateGrouperMulti<Utf8CIHash_fn>(dLocators, dAttrTypes, dJsonKeys);
 	else if (eCollation == SPH_COLLATION_LIBC_CI)
-		return new CSphGrouperMulti<LibcCIHash_fn>(dLocators, dAttrTypes, dJsonKeys);
+		return CreateGrouperMulti<LibcCIHash_fn>(dLocators, dAttrTypes, dJsonKeys);
 	else if (eCollation == SPH_COLLATION_LIBC_CS)
-		return new CSphGrouperMulti<LibcCSHash_fn>(dLocators, dAttrTypes, dJsonKeys);
+		return CreateGrouperMulti<LibcCSHash_fn>(dLocators, dAttrTypes, dJsonKeys);
 	else
-		return new CSphGrouperMulti<BinaryHash_fn>(dLocators, dAttrTypes, dJsonKeys);
+		return CreateGrouperMulti<BinaryHash_fn>(dLocators, dAttrTypes, dJsonKeys);
 }
 
 
@@ -1476,6 +1748,16 @@ public:
 };
 
 
+/// check whether the matches can be sent right off the push; postponed expressions need the final result set
+static bool CanStream(const ISphSchema& tSchema)
+{
+	for (int i = 0; i < tSchema.GetAttrsCount(); i++)
+		if (tSchema.GetAttr(i).m_eStage == SPH_EVAL_POSTLIMIT)
+			return false;
+	return true;
+}
+
+
 ISphMatchSorter* sphCreateQueue(SphQueueSettings_t& tQueue)
 {
 	// prepare for descent
@@ -1794,6 +2076,9 @@ ISphMatchSorter* sphCreateQueue(SphQueueSettings_t& tQueue)
 	const bool bGotGroupby = !pQuery->m_sGroupBy.IsEmpty() || tSettings.m_bImplicit; // or else, check in SetupGroupbySettings() would already fail
 	const bool bGotDistinct = (tSettings.m_tDistinctLoc.m_iBitOffset >= 0);
 
+	// approximate count(distinct) keeps a mergeable sketch per group; N-best group-by has no use for it
+	const bool bDistinctSketch = bGotDistinct && pQuery->m_iDistinctApprox > 0 && pQuery->m_iGroupbyLimit <= 1;
+
 	if (bHasGroupByExpr && !bGotGroupby)
 	{
 		sError = "GROUPBY() is allowed only in GROUP BY queries";
@@ -1861,6 +2146,16 @@ ISphMatchSorter* sphCreateQueue(SphQueueSettings_t& tQueue)
 				pExtra->AddAttr(tDistinct, true);
 		}
 
+		// sketches travel along with the groups (to the master too), so that partial groups merge exactly like counts do
+		if (bDistinctSketch)
+		{
+			CSphColumnInfo tSketch("@distinct_hll", ESphAttr::SPH_ATTR_FACTORS);
+			tSketch.m_eStage = SPH_EVAL_SORTER;
+			tSorterSchema.AddDynamicAttr(tSketch);
+			if (pExtra)
+				pExtra->AddAttr(tSketch, true);
+		}
+
 		// add @groupbystr last in case we need to skip it on sending (like @int_str2ptr_*)
 		if (tSettings.m_bJson)
 		{
@@ -1897,6 +2192,15 @@ ISphMatchSorter* sphCreateQueue(SphQueueSettings_t& tQueue)
 			LOC_CHECK(iDistinct <= 0, "unexpected @distinct");
 		}
 
+		// sketch might also come from agents or other indexes, and then it's already in the schema
+		int iSketch = tSorterSchema.GetAttrIndex("@distinct_hll");
+		if (bDistinctSketch && iSketch >= 0)
+		{
+			tSettings.m_tLocDistinctHll = tSorterSchema.GetAttr(iSketch).m_tLocator;
+			tSettings.m_iDistinctHll = pQuery->m_iDistinctApprox;
+			LOC_CHECK(tSettings.m_tLocDistinctHll.m_bDynamic, "@distinct_hll must be dynamic");
+		}
+
 		int iGroupbyStr = tSorterSchema.GetAttrIndex("@groupbystr");
 		if (iGroupbyStr >= 0)
 			tSettings.m_tLocGroupbyStr = tSorterSchema.GetAttr(iGroupbyStr).m_tLocator;
@@ -2070,8 +2374,21 @@ ISphMatchSorter* sphCreateQueue(SphQueueSettings_t& tQueue)
 			pTop = new CSphUpdateQueue(pQuery->m_iMaxMatches, tQueue.m_pUpdate, pQuery->m_bIgnoreNonexistent, pQuery->m_bStrict);
 		else if (tQueue.m_pDeletes)
 			pTop = new CSphDeleteQueue(pQuery->m_iMaxMatches, tQueue.m_pDeletes);
+		else if (tQueue.m_pStream && !bRandomize && CanStream(tSorterSchema) && tQueue.m_pStream->SetSchema(tSorterSchema))
+		{
+			// nothing gets to the final stage, so compute everything before the push
+			for (int i = 0; i < tSorterSchema.GetAttrsCount(); i++)
+			{
+				CSphColumnInfo& tCol = const_cast <CSphColumnInfo&> (tSorterSchema.GetAttr(i));
+				if (tCol.m_eStage == SPH_EVAL_FINAL)
+					tCol.m_eStage = SPH_EVAL_PRESORT;
+			}
+
+			pTop = new CSphStreamQueue(tQueue.m_pStream, pQuery->m_iOffset, pQuery->m_iLimit);
+			tQueue.m_bStreaming = true;
+		}
 		else
-			pTop = CreatePlainSorter(eMatchFunc, pQuery->m_bSortKbuffer, pQuery->m_iMaxMatches, bUsesAttrs, uPackedFactorFlags & SPH_FACTOR_ENABLE);
+			pTop = CreatePlainSorter(eMatchFunc, tStateMatch, pQuery->m_bSortKbuffer, pQuery->m_iMaxMatches, bUsesAttrs, uPackedFactorFlags & SPH_FACTOR_ENABLE);
 	}
 	else
 	{
@@ -14,6 +14,20 @@ namespace NEO {
 	class CSphAttrUpdateEx;
 	class CSphAttrUpdateEx;
 	class ISphMatchSorter;
+	class CSphMatch;
+
+	/// receiver of the matches of a streamed query (see CSphQuery::m_bStream)
+	/// the stream queue hands matches over as the index yields them, so the receiver must be done with a match when PushMatch() returns
+	struct ISphMatchStream
+	{
+		virtual			~ISphMatchStream() {}
+
+		/// bind to the sorter schema; false if the matches can not be sent as they are, so that the query gets a regular sorter
+		virtual bool	SetSchema(const ISphSchema& tSchema) = 0;
+
+		/// send a match, with the pools of the index it came from; false when the receiver can take no more
+		virtual bool	PushMatch(const CSphMatch& tMatch, const PoolPtrs_t& tPools) = 0;
+	};
 
 	struct SphQueueSettings_t : public ISphNoncopyable
 	{
@@ -29,7 +43,8 @@ namespace NEO {
 		DWORD						m_uPackedFactorFlags;
 		ISphExprHook* m_pHook;
 		const CSphFilterSettings* m_pAggrFilter;
-
+		ISphMatchStream* m_pStream;			///< send the matches there (unsorted, with offset and limit applied) if the query allows
+		bool						m_bStreaming;		///< out: the queue does stream the matches
 		SphQueueSettings_t(const CSphQuery& tQuery, const ISphSchema& tSchema, CSphString& sError, CSphQueryProfile* pProfiler)
 			: m_tQuery(tQuery)
 			, m_tSchema(tSchema)
@@ -43,6 +58,8 @@ namespace NEO {
 			, m_uPackedFactorFlags(SPH_FACTOR_DISABLE)
 			, m_pHook(NULL)
 			, m_pAggrFilter(NULL)
+			, m_pStream(NULL)
+			, m_bStreaming(false)
 		{ }
 	};
 
@@ -0,0 +1,572 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/core/globals.h"
+#include "neo/query/match_queue.h"
+#include "neo/query/group_sorter.h"
+#include "neo/query/group_spill.h"
+#include "neo/utility/log.h"
+
+namespace NEO {
+
+/// match sorter with exact (unbounded) group-by
+/// every group is aggregated in a growable open-addressing hash; once the groups take more than the memory budget,
+/// they get partitioned by key into temp files, and each partition is then merged on its own (grace hash style)
+/// top-K of the exact groups is only picked in the end, so counts, aggregates, distincts, and total_found are exact
+/// AVG values are kept as sums until the end, so that partial groups can be merged
+template < typename COMPGROUP, bool DISTINCT >
+class CSphExactGroupSorter : public CSphMatchQueueTraits, protected CSphGroupSorterSettings
+{
+protected:
+	CSphGrouper*				m_pGrouper;
+	int							m_iLimit;		///< max matches to be retrieved
+	int64_t						m_iMemLimit;	///< groups memory budget, bytes
+
+	CSphVector<CSphMatch*>		m_dPages;		///< group storage; pages never move, so the matches don't either
+	CSphVector<SphGroupKey_t>	m_dKeys;		///< group keys, in group order
+	CSphVector<int>				m_dSlots;		///< open-addressing table, group index plus 1, or 0 for empty slots
+	int							m_iSlotShift;
+
+	CSphUniqounter				m_tUniq;
+	bool						m_bDistinctSketch;	///< approximate count(distinct) via per-group sketches instead of m_tUniq
+	int64_t						m_iSketchBytes;		///< in-memory sketches size
+	CSphGroupSpill				m_tSpill;
+	CSphMatch					m_tSpilled;		///< spilled group being read back
+	bool						m_bSpillFailed;
+	bool						m_bResolved;	///< whether m_pData holds the final top-K
+
+	GroupSorter_fn<COMPGROUP>	m_tGroupSorter;
+	const ISphMatchComparator*	m_pComp;
+
+	CSphVector<IAggrFunc*>		m_dAggregates;
+	CSphVector<IAggrFunc*>		m_dAvgs;
+	const ISphFilter*			m_pAggrFilter;	///< aggregate filter for groups on resolve
+	MatchCloner_t				m_tPregroup;
+	const BYTE*					m_pStringBase;
+
+	static const int			GROUP_PAGE = 1024;
+	static const int			EXACT_FACTOR = 2;	///< top-K buffer is that many times bigger than the limit
+	static const int			MIN_SLOTS_SHIFT = 10;
+
+public:
+	/// ctor
+	CSphExactGroupSorter(const ISphMatchComparator* pComp, const CSphQuery* pQuery, const CSphGroupSorterSettings& tSettings)
+		: CSphMatchQueueTraits(pQuery->m_iMaxMatches* EXACT_FACTOR, true)
+		, CSphGroupSorterSettings(tSettings)
+		, m_pGrouper(tSettings.m_pGrouper)
+		, m_iLimit(pQuery->m_iMaxMatches)
+		, m_iMemLimit(pQuery->m_iGroupbyMemory > 0 ? pQuery->m_iGroupbyMemory : g_iGroupbyMemory)
+		, m_iSlotShift(64 - MIN_SLOTS_SHIFT)
+		, m_bDistinctSketch(DISTINCT && tSettings.m_iDistinctHll > 0 && tSettings.m_tLocDistinctHll.m_iBitOffset >= 0)
+		, m_iSketchBytes(0)
+		, m_bSpillFailed(false)
+		, m_bResolved(false)
+		, m_pComp(pComp)
+		, m_pAggrFilter(tSettings.m_pAggrFilterTrait)
+		, m_pStringBase(NULL)
+	{
+		assert(DISTINCT == false || tSettings.m_tDistinctLoc.m_iBitOffset >= 0);
+		m_dSlots.Resize(1 << MIN_SLOTS_SHIFT);
+		m_dSlots.Fill(0);
+	}
+
+	/// schema setup
+	virtual void SetSchema(CSphRsetSchema& tSchema)
+	{
+		m_tSchema = tSchema;
+		m_tPregroup.SetSchema(&m_tSchema, &m_tArena);
+		m_tPregroup.m_dAttrsRaw.Add(m_tLocGroupby);
+		m_tPregroup.m_dAttrsRaw.Add(m_tLocCount);
+		if_const(DISTINCT)
+		{
+			m_tPregroup.m_dAttrsRaw.Add(m_tLocDistinct);
+			if (m_bDistinctSketch)
+				m_tPregroup.m_dAttrsBlob.Add(m_tLocDistinctHll);
+		}
+		ExtractAggregates(m_tSchema, m_tLocCount, m_tGroupSorter.m_eKeypart, m_tGroupSorter.m_tLocator, m_dAggregates, m_dAvgs, m_tPregroup);
+		m_tSpill.Setup(m_tSchema);
+	}
+
+	/// dtor
+	~CSphExactGroupSorter()
+	{
+		ResetGroups();
+
+		// rows move between pages, the top-K buffer, and the read back match, so arena ones might be anywhere
+		m_tArena.Detach(&m_tSpilled, 1);
+		ARRAY_FOREACH(i, m_dPages)
+		{
+			m_tArena.Detach(m_dPages[i], GROUP_PAGE);
+			SafeDeleteArray(m_dPages[i]);
+		}
+
+		SafeDelete(m_pComp);
+		SafeDelete(m_pGrouper);
+		SafeDelete(m_pAggrFilter);
+		ARRAY_FOREACH(i, m_dAggregates)
+			SafeDelete(m_dAggregates[i]);
+	}
+
+	/// check if this sorter does groupby
+	virtual bool IsGroupby() const
+	{
+		return true;
+	}
+
+	virtual bool CanMulti() const
+	{
+		if (m_pGrouper && !m_pGrouper->CanMulti())
+			return false;
+
+		if (HasString(&m_tState))
+			return false;
+
+		if (HasString(&m_tGroupSorter))
+			return false;
+
+		return true;
+	}
+
+	/// set string pool pointer (for string+groupby sorters)
+	void SetStringPool(const BYTE* pStrings)
+	{
+		m_pStringBase = pStrings;
+		m_pGrouper->SetStringPool(pStrings);
+	}
+
+	/// set string attribute dictionary (for dictionary-encoded string groupby)
+	virtual void SetStringDict(const CSphStringDict* pDict)
+	{
+		CSphMatchQueueTraits::SetStringDict(pDict);
+		m_pGrouper->SetStringDict(pDict);
+	}
+
+	/// distinct values do not come with pre-grouped matches
+	virtual const CSphGrouper* GetGrouper() const
+	{
+		return DISTINCT ? NULL : m_pGrouper;
+	}
+
+	/// set group comparator state
+	void SetGroupState(const CSphMatchComparatorState& tState)
+	{
+		m_tGroupSorter.m_fnStrCmp = tState.m_fnStrCmp;
+
+		for (int i = 0; i < CSphMatchComparatorState::MAX_ATTRS; i++)
+		{
+			m_tGroupSorter.m_eKeypart[i] = tState.m_eKeypart[i];
+			m_tGroupSorter.m_tLocator[i] = tState.m_tLocator[i];
+		}
+		m_tGroupSorter.m_uAttrDesc = tState.m_uAttrDesc;
+		m_tGroupSorter.m_iNow = tState.m_iNow;
+	}
+
+	/// add entry to the queue
+	virtual bool Push(const CSphMatch& tEntry)
+	{
+		return PushEx(tEntry, m_pGrouper->KeyFromMatch(tEntry), false);
+	}
+
+	/// add grouped entry to the queue
+	virtual bool PushGrouped(const CSphMatch& tEntry, bool)
+	{
+		return PushEx(tEntry, tEntry.GetAttr(m_tLocGroupby), true);
+	}
+
+	bool PushEx(const CSphMatch& tEntry, const SphGroupKey_t uGroupKey, bool bGrouped)
+	{
+		assert(!m_bResolved);
+
+		CSphMatch* pMatch = FindGroup(uGroupKey);
+		if (pMatch)
+		{
+			if (bGrouped)
+				pMatch->SetAttr(m_tLocCount, pMatch->GetAttr(m_tLocCount) + tEntry.GetAttr(m_tLocCount));
+			else
+				pMatch->SetAttr(m_tLocCount, 1 + pMatch->GetAttr(m_tLocCount));
+
+			ARRAY_FOREACH(i, m_dAggregates)
+				m_dAggregates[i]->Update(pMatch, &tEntry, bGrouped);
+
+			if (DISTINCT && m_bDistinctSketch)
+				UpdateSketch(pMatch, tEntry, bGrouped);
+
+			// if new entry is more relevant, update from it
+			if (m_pComp->VirtualIsLess(*pMatch, tEntry, m_tState))
+				m_tPregroup.Clone(pMatch, &tEntry);
+		}
+
+		if (DISTINCT && !m_bDistinctSketch)
+		{
+			int iCount = 1;
+			if (bGrouped)
+				iCount = (int)tEntry.GetAttr(m_tLocDistinct);
+
+			SphAttr_t tAttr = GetDistinctKey(tEntry, m_tDistinctLoc, m_eDistinctAttr, m_pStringBase);
+			m_tUniq.Add(SphGroupedValue_t(uGroupKey, tAttr, iCount));
+		}
+
+		bool bNew = (pMatch == NULL);
+		if (bNew)
+		{
+			CSphMatch* pNew = AddGroup(uGroupKey);
+			CloneToSlot(pNew, tEntry);
+
+			if (!bGrouped)
+			{
+				pNew->SetAttr(m_tLocGroupby, uGroupKey);
+				pNew->SetAttr(m_tLocCount, 1);
+				if_const(DISTINCT)
+					pNew->SetAttr(m_tLocDistinct, 0);
+
+				if (DISTINCT && m_bDistinctSketch)
+					UpdateSketch(pNew, tEntry, false);
+			}
+			else
+			{
+				ARRAY_FOREACH(i, m_dAggregates)
+					m_dAggregates[i]->Ungroup(pNew);
+
+				if (DISTINCT && m_bDistinctSketch)
+					m_iSketchBytes += GetSketchBytes(pNew);
+			}
+			m_iTotal++;
+		}
+
+		if (!m_bSpillFailed && GetUsedBytes() > m_iMemLimit)
+			Spill();
+
+		return bNew;
+	}
+
+	/// get entries count
+	int GetLength() const
+	{
+		const_cast<CSphExactGroupSorter*>(this)->Resolve();
+		return m_iUsed;
+	}
+
+	/// groups are only known exactly once resolved
+	virtual int64_t GetTotalCount() const
+	{
+		const_cast<CSphExactGroupSorter*>(this)->Resolve();
+		return m_iTotal;
+	}
+
+	/// store all entries into specified location in sorted order, and remove them from queue
+	int Flatten(CSphMatch* pTo, int iTag)
+	{
+		Resolve();
+
+		for (int i = 0; i < m_iUsed; i++)
+		{
+			m_tSchema.CloneMatch(pTo + i, m_pData[i]);
+			if (iTag >= 0)
+				pTo[i].m_iTag = iTag;
+		}
+
+		int iFlattened = m_iUsed;
+		m_iUsed = 0;
+		m_iTotal = 0;
+		m_bResolved = false;
+		return iFlattened;
+	}
+
+	virtual void Finalize(ISphMatchProcessor& tProcessor, bool)
+	{
+		if (m_bResolved)
+		{
+			for (int i = 0; i < m_iUsed; i++)
+				tProcessor.Process(m_pData + i);
+			return;
+		}
+
+		// mid-query (eg. an RT disk chunk is done); process every group, spilled ones included
+		ARRAY_FOREACH(i, m_dKeys)
+			tProcessor.Process(GetGroup(i));
+
+		SphGroupedValue_t tValue;
+		for (int iPart = 0; iPart < m_tSpill.GetParts(); iPart++)
+		{
+			if (m_tSpill.IsEmpty(iPart))
+				continue;
+
+			bool bOk = m_tSpill.StartRead(iPart, true);
+			for (int iType = bOk ? m_tSpill.ReadRecord(m_tSpilled, tValue) : CSphGroupSpill::RECORD_NONE; iType != CSphGroupSpill::RECORD_NONE && bOk;
+				iType = m_tSpill.ReadRecord(m_tSpilled, tValue))
+			{
+				if (iType == CSphGroupSpill::RECORD_DISTINCT)
+				{
+					bOk = m_tSpill.WriteDistinct(tValue);
+					continue;
+				}
+
+				tProcessor.Process(&m_tSpilled);
+				bOk = m_tSpill.WriteGroup(m_tSpilled, m_tSpilled.GetAttr(m_tLocGroupby));
+				m_tSchema.FreeStringPtrs(&m_tSpilled); // the file keeps its own copies
+			}
+			m_tSpill.EndRead();
+
+			if (!bOk || !m_tSpill.GetError().IsEmpty())
+				SpillFailed();
+		}
+	}
+
+protected:
+	inline CSphMatch* GetGroup(int iGroup) const
+	{
+		return m_dPages[iGroup / GROUP_PAGE] + (iGroup % GROUP_PAGE);
+	}
+
+	inline int GetSlot(SphGroupKey_t uKey) const
+	{
+		return int((uint64_t(uKey) * U64C(0x9E3779B97F4A7C15)) >> m_iSlotShift);
+	}
+
+	CSphMatch* FindGroup(SphGroupKey_t uKey) const
+	{
+		const int iMask = m_dSlots.GetLength() - 1;
+		for (int iSlot = GetSlot(uKey);; iSlot = (iSlot + 1) & iMask)
+		{
+			int iGroup = m_dSlots[iSlot] - 1;
+			if (iGroup < 0)
+				return NULL;
+			if (m_dKeys[iGroup] == uKey)
+				return GetGroup(iGroup);
+		}
+	}
+
+	CSphMatch* AddGroup(SphGroupKey_t uKey)
+	{
+		// keep the table at most half full
+		if (2 * (m_dKeys.GetLength() + 1) > m_dSlots.GetLength())
+		{
+			m_iSlotShift--;
+			m_dSlots.Resize(2 * m_dSlots.GetLength());
+			m_dSlots.Fill(0);
+			ARRAY_FOREACH(i, m_dKeys)
+				InsertSlot(m_dKeys[i], i);
+		}
+
+		int iGroup = m_dKeys.GetLength();
+		if (iGroup == m_dPages.GetLength() * GROUP_PAGE)
+			m_dPages.Add(new CSphMatch[GROUP_PAGE]);
+
+		m_dKeys.Add(uKey);
+		InsertSlot(uKey, iGroup);
+		return GetGroup(iGroup);
+	}
+
+	void InsertSlot(SphGroupKey_t uKey, int iGroup)
+	{
+		const int iMask = m_dSlots.GetLength() - 1;
+		int iSlot = GetSlot(uKey);
+		while (m_dSlots[iSlot])
+			iSlot = (iSlot + 1) & iMask;
+		m_dSlots[iSlot] = iGroup + 1;
+	}
+
+	/// live groups memory estimate; pages are reused after spills, so they are not counted on their own
+	int64_t GetUsedBytes() const
+	{
+		int64_t iGroup = sizeof(CSphMatch) + sizeof(CSphRowitem) * m_tSchema.GetDynamicSize() + sizeof(SphGroupKey_t);
+		return iGroup * m_dKeys.GetLength() + sizeof(int) * m_dSlots.GetLength() + sizeof(SphGroupedValue_t) * m_tUniq.GetLength() + m_iSketchBytes;
+	}
+
+	inline int64_t GetSketchBytes(const CSphMatch* pMatch) const
+	{
+		const BYTE* pSketch = (const BYTE*)pMatch->GetAttr(m_tLocDistinctHll);
+		return pSketch ? *(const DWORD*)pSketch : 0;
+	}
+
+	/// add a value to (or merge a grouped entry into) the group sketch, keeping track of the sketches memory
+	void UpdateSketch(CSphMatch* pMatch, const CSphMatch& tEntry, bool bGrouped)
+	{
+		m_iSketchBytes -= GetSketchBytes(pMatch);
+		if (bGrouped)
+			DistinctSketchMerge(pMatch, *this, tEntry);
+		else
+			DistinctSketchAdd(pMatch, *this, GetDistinctKey(tEntry, m_tDistinctLoc, m_eDistinctAttr, m_pStringBase));
+		m_iSketchBytes += GetSketchBytes(pMatch);
+	}
+
+	/// move match contents without copying strings
+	static void MoveMatch(CSphMatch* pDst, CSphMatch* pSrc)
+	{
+		pDst->m_uDocID = pSrc->m_uDocID;
+		pDst->m_pStatic = pSrc->m_pStatic;
+		pDst->m_iWeight = pSrc->m_iWeight;
+		pDst->m_iTag = pSrc->m_iTag;
+		Swap(pDst->m_pDynamic, pSrc->m_pDynamic);
+	}
+
+	/// forget in-memory groups, freeing whatever they point to
+	void ResetGroups()
+	{
+		ARRAY_FOREACH(i, m_dKeys)
+			m_tSchema.FreeStringPtrs(GetGroup(i));
+		m_dKeys.Resize(0);
+		m_dSlots.Fill(0);
+		m_tUniq.Resize(0);
+		m_iSketchBytes = 0;
+	}
+
+	void SpillFailed()
+	{
+		if (!m_bSpillFailed)
+			sphWarning("exact group-by spill failed (%s), groups are kept in memory and might be inexact", m_tSpill.GetError().cstr());
+		m_bSpillFailed = true;
+	}
+
+	/// move all in-memory groups and distinct values to the spill partitions
+	void Spill()
+	{
+		if (!m_tSpill.Open())
+		{
+			SpillFailed();
+			return;
+		}
+
+		// write errors are sticky, so check once in the end
+		bool bOk = true;
+		ARRAY_FOREACH(i, m_dKeys)
+			bOk &= m_tSpill.WriteGroup(*GetGroup(i), m_dKeys[i]);
+
+		if_const(DISTINCT)
+		{
+			m_tUniq.Sort();
+			ARRAY_FOREACH(i, m_tUniq)
+				if (!i || !(m_tUniq[i] == m_tUniq[i - 1]))
+					bOk &= m_tSpill.WriteDistinct(m_tUniq[i]);
+		}
+
+		if (!bOk)
+			SpillFailed();
+
+		// the spilled records carry copies of the strings and factors, so the in-memory ones go away
+		ResetGroups();
+	}
+
+	/// merge a spilled partition into (empty) in-memory groups
+	void LoadPartition(int iPart)
+	{
+		SphGroupedValue_t tValue;
+		if (!m_tSpill.StartRead(iPart, false))
+		{
+			SpillFailed();
+			return;
+		}
+
+		for (int iType = m_tSpill.ReadRecord(m_tSpilled, tValue); iType != CSphGroupSpill::RECORD_NONE; iType = m_tSpill.ReadRecord(m_tSpilled, tValue))
+		{
+			if (iType == CSphGroupSpill::RECORD_DISTINCT)
+			{
+				m_tUniq.Add(tValue);
+				continue;
+			}
+
+			SphGroupKey_t uKey = m_tSpilled.GetAttr(m_tLocGroupby);
+			CSphMatch* pMatch = FindGroup(uKey);
+			if (!pMatch)
+			{
+				pMatch = AddGroup(uKey);
+				MoveMatch(pMatch, &m_tSpilled);
+				if (DISTINCT && m_bDistinctSketch)
+					m_iSketchBytes += GetSketchBytes(pMatch);
+				continue;
+			}
+
+			// partial group; sums (and AVG sums) add up, MIN/MAX combine, sketches merge
+			pMatch->SetAttr(m_tLocCount, pMatch->GetAttr(m_tLocCount) + m_tSpilled.GetAttr(m_tLocCount));
+			ARRAY_FOREACH(i, m_dAggregates)
+				m_dAggregates[i]->Update(pMatch, &m_tSpilled, false);
+
+			if (DISTINCT && m_bDistinctSketch)
+				UpdateSketch(pMatch, m_tSpilled, true);
+
+			if (m_pComp->VirtualIsLess(*pMatch, m_tSpilled, m_tState))
+				m_tPregroup.Clone(pMatch, &m_tSpilled);
+
+			m_tSchema.FreeStringPtrs(&m_tSpilled);
+		}
+
+		if (!m_tSpill.GetError().IsEmpty())
+			SpillFailed();
+		m_tSpill.EndRead();
+	}
+
+	/// finalize in-memory groups and push them into the top-K buffer
+	void CollectGroups()
+	{
+		if (DISTINCT && !m_bDistinctSketch)
+		{
+			m_tUniq.Sort();
+			SphGroupKey_t uGroup;
+			for (int iCount = m_tUniq.CountStart(&uGroup); iCount; iCount = m_tUniq.CountNext(&uGroup))
+			{
+				CSphMatch* pMatch = FindGroup(uGroup);
+				if (pMatch)
+					pMatch->SetAttr(m_tLocDistinct, iCount);
+			}
+		}
+
+		ARRAY_FOREACH(i, m_dKeys)
+		{
+			CSphMatch* pMatch = GetGroup(i);
+			if (DISTINCT && m_bDistinctSketch)
+				DistinctSketchCount(pMatch, *this);
+
+			ARRAY_FOREACH(j, m_dAggregates)
+				m_dAggregates[j]->Finalize(pMatch);
+			m_iTotal++;
+
+			// HAVING filtering
+			if (m_pAggrFilter && !m_pAggrFilter->Eval(*pMatch))
+				continue;
+
+			if (m_iUsed == m_iSize)
+				CutWorst();
+
+			// that swaps the cut off row into the group, so ResetGroups() frees it
+			MoveMatch(m_pData + m_iUsed++, pMatch);
+		}
+
+		ResetGroups();
+	}
+
+	void CutWorst()
+	{
+		sphSort(m_pData, m_iUsed, m_tGroupSorter, m_tGroupSorter);
+		m_iUsed = Min(m_iUsed, m_iLimit);
+	}
+
+	/// compute exact groups and pick the top-K
+	void Resolve()
+	{
+		if (m_bResolved)
+			return;
+
+		m_bResolved = true;
+		m_iUsed = 0;
+		m_iTotal = 0;
+
+		if (m_tSpill.IsUsed() && !m_bSpillFailed)
+			Spill();
+
+		// if spilling failed at some point, whatever stayed in memory goes separately
+		if (m_dKeys.GetLength())
+			CollectGroups();
+
+		for (int iPart = 0; iPart < m_tSpill.GetParts(); iPart++)
+		{
+			if (m_tSpill.IsEmpty(iPart))
+				continue;
+
+			LoadPartition(iPart);
+			CollectGroups();
+		}
+
+		CutWorst();
+	}
+};
+
+}
@@ -0,0 +1,249 @@
+#include "neo/query/facet_sorter.h"
+#include "neo/query/query.h"
+#include "neo/query/match_processor.h"
+
+namespace NEO {
+
+	CSphFacetSorter::CSphFacetSorter()
+		: m_iSchema(0)
+		, m_pMva(NULL)
+		, m_bArenaProhibit(false)
+		, m_pStrings(NULL)
+		, m_pDict(NULL)
+	{}
+
+
+	CSphFacetSorter::~CSphFacetSorter()
+	{
+		ARRAY_FOREACH(i, m_dFacets)
+		{
+			Facet_t* pFacet = m_dFacets[i];
+			ResetFacet(*pFacet);
+			ARRAY_FOREACH(j, pFacet->m_dPages)
+				SafeDeleteArray(pFacet->m_dPages[j]);
+			SafeDelete(pFacet);
+		}
+	}
+
+
+	bool CSphFacetSorter::AddFacet(ISphMatchSorter* pSorter, const CSphQuery& tQuery)
+	{
+		assert(pSorter);
+		const CSphGrouper* pGrouper = pSorter->GetFacetGrouper();
+		if (!pGrouper)
+			return false;
+
+		// groups only carry their first match, so every selected column must be the same within a group
+		ARRAY_FOREACH(i, tQuery.m_dItems)
+		{
+			const CSphString& sExpr = tQuery.m_dItems[i].m_sExpr;
+			if (!IsGroupbyMagic(sExpr) && sExpr != tQuery.m_sGroupBy)
+				return false;
+		}
+
+		const CSphRsetSchema& tSchema = pSorter->GetSchema();
+		int iGroupby = tSchema.GetAttrIndex("@groupby");
+		int iCount = tSchema.GetAttrIndex("@count");
+		if (iGroupby < 0 || iCount < 0)
+			return false;
+
+		// facets share the match, so they must agree on its layout (multi-queue checks that for the whole batch)
+		if (m_dFacets.GetLength() && tSchema.GetDynamicSize() != GetSchema().GetDynamicSize())
+			return false;
+
+		Facet_t* pFacet = new Facet_t;
+		pFacet->m_pSorter = pSorter;
+		pFacet->m_pGrouper = pGrouper;
+		pFacet->m_bPlainKey = (tQuery.m_eGroupFunc == SPH_GROUPBY_ATTR);
+		pGrouper->GetLocator(pFacet->m_tLocKey);
+		pFacet->m_tLocGroupby = tSchema.GetAttr(iGroupby).m_tLocator;
+		pFacet->m_tLocCount = tSchema.GetAttr(iCount).m_tLocator;
+		pFacet->m_iSlotShift = 64 - MIN_SLOTS_SHIFT;
+		pFacet->m_dSlots.Resize(1 << MIN_SLOTS_SHIFT);
+		pFacet->m_dSlots.Fill(0);
+
+		if (m_dFacets.GetLength() && tSchema.GetAttrsCount() > GetSchema().GetAttrsCount())
+			m_iSchema = m_dFacets.GetLength();
+		m_dFacets.Add(pFacet);
+		return true;
+	}
+
+
+	const CSphRsetSchema& CSphFacetSorter::GetSchema() const
+	{
+		if (!m_dFacets.GetLength())
+			return m_tSchema;
+		return m_dFacets[m_iSchema]->m_pSorter->GetSchema();
+	}
+
+
+	bool CSphFacetSorter::UsesAttrs() const
+	{
+		ARRAY_FOREACH(i, m_dFacets)
+			if (m_dFacets[i]->m_pSorter->UsesAttrs())
+				return true;
+		return false;
+	}
+
+
+	void CSphFacetSorter::SetMVAPool(const DWORD* pMva, bool bArenaProhibit)
+	{
+		// counted groups refer to the current pools, so they must reach the sorters first
+		if (pMva != m_pMva)
+			Flush();
+
+		m_pMva = pMva;
+		m_bArenaProhibit = bArenaProhibit;
+		ARRAY_FOREACH(i, m_dFacets)
+			m_dFacets[i]->m_pSorter->SetMVAPool(pMva, bArenaProhibit);
+	}
+
+
+	void CSphFacetSorter::SetStringPool(const BYTE* pStrings)
+	{
+		if (pStrings != m_pStrings)
+			Flush();
+
+		m_pStrings = pStrings;
+		ARRAY_FOREACH(i, m_dFacets)
+			m_dFacets[i]->m_pSorter->SetStringPool(pStrings);
+	}
+
+
+	void CSphFacetSorter::SetStringDict(const CSphStringDict* pDict)
+	{
+		if (pDict != m_pDict)
+			Flush();
+
+		m_pDict = pDict;
+		ARRAY_FOREACH(i, m_dFacets)
+			m_dFacets[i]->m_pSorter->SetStringDict(pDict);
+	}
+
+
+	bool CSphFacetSorter::Push(const CSphMatch& tEntry)
+	{
+		bool bNew = false;
+		ARRAY_FOREACH(i, m_dFacets)
+		{
+			Facet_t& tFacet = *m_dFacets[i];
+			SphGroupKey_t uKey = tFacet.m_bPlainKey
+				? (SphGroupKey_t)tEntry.GetAttr(tFacet.m_tLocKey)
+				: tFacet.m_pGrouper->KeyFromMatch(tEntry);
+
+			const int iMask = tFacet.m_dSlots.GetLength() - 1;
+			int iSlot = int((uint64_t(uKey) * U64C(0x9E3779B97F4A7C15)) >> tFacet.m_iSlotShift);
+			for (;; iSlot = (iSlot + 1) & iMask)
+			{
+				int iGroup = tFacet.m_dSlots[iSlot] - 1;
+				if (iGroup < 0)
+				{
+					iGroup = AddGroup(tFacet, uKey);
+					CSphMatch* pGroup = tFacet.m_dPages[iGroup / GROUP_PAGE] + (iGroup % GROUP_PAGE);
+					tFacet.m_pSorter->GetSchema().CloneMatch(pGroup, tEntry);
+					bNew = true;
+					break;
+				}
+
+				if (tFacet.m_dKeys[iGroup] == uKey)
+				{
+					tFacet.m_dCounts[iGroup]++;
+					break;
+				}
+			}
+		}
+
+		m_iTotal++;
+		return bNew;
+	}
+
+
+	int CSphFacetSorter::AddGroup(Facet_t& tFacet, SphGroupKey_t uKey)
+	{
+		// too many groups for this facet; hand them over, and start counting anew
+		if (tFacet.m_dKeys.GetLength() == MAX_GROUPS)
+			FlushFacet(tFacet);
+
+		// keep the table at most half full
+		if (2 * (tFacet.m_dKeys.GetLength() + 1) > tFacet.m_dSlots.GetLength())
+		{
+			tFacet.m_iSlotShift--;
+			tFacet.m_dSlots.Resize(2 * tFacet.m_dSlots.GetLength());
+			tFacet.m_dSlots.Fill(0);
+			ARRAY_FOREACH(i, tFacet.m_dKeys)
+			{
+				const int iMask = tFacet.m_dSlots.GetLength() - 1;
+				int iSlot = int((uint64_t(tFacet.m_dKeys[i]) * U64C(0x9E3779B97F4A7C15)) >> tFacet.m_iSlotShift);
+				while (tFacet.m_dSlots[iSlot])
+					iSlot = (iSlot + 1) & iMask;
+				tFacet.m_dSlots[iSlot] = i + 1;
+			}
+		}
+
+		int iGroup = tFacet.m_dKeys.GetLength();
+		if (iGroup == tFacet.m_dPages.GetLength() * GROUP_PAGE)
+			tFacet.m_dPages.Add(new CSphMatch[GROUP_PAGE]);
+
+		tFacet.m_dKeys.Add(uKey);
+		tFacet.m_dCounts.Add(1);
+
+		const int iMask = tFacet.m_dSlots.GetLength() - 1;
+		int iSlot = int((uint64_t(uKey) * U64C(0x9E3779B97F4A7C15)) >> tFacet.m_iSlotShift);
+		while (tFacet.m_dSlots[iSlot])
+			iSlot = (iSlot + 1) & iMask;
+		tFacet.m_dSlots[iSlot] = iGroup + 1;
+
+		return iGroup;
+	}
+
+
+	void CSphFacetSorter::FlushFacet(Facet_t& tFacet)
+	{
+		ARRAY_FOREACH(i, tFacet.m_dKeys)
+		{
+			CSphMatch* pGroup = tFacet.m_dPages[i / GROUP_PAGE] + (i % GROUP_PAGE);
+			pGroup->SetAttr(tFacet.m_tLocGroupby, tFacet.m_dKeys[i]);
+			pGroup->SetAttr(tFacet.m_tLocCount, tFacet.m_dCounts[i]);
+			tFacet.m_pSorter->PushGrouped(*pGroup, i == 0);
+		}
+		ResetFacet(tFacet);
+	}
+
+
+	void CSphFacetSorter::ResetFacet(Facet_t& tFacet)
+	{
+		// sorters made their own copies of whatever the matches point to
+		const CSphRsetSchema& tSchema = tFacet.m_pSorter->GetSchema();
+		ARRAY_FOREACH(i, tFacet.m_dKeys)
+			tSchema.FreeStringPtrs(tFacet.m_dPages[i / GROUP_PAGE] + (i % GROUP_PAGE));
+
+		tFacet.m_dKeys.Resize(0);
+		tFacet.m_dCounts.Resize(0);
+		tFacet.m_dSlots.Fill(0);
+	}
+
+
+	void CSphFacetSorter::Flush()
+	{
+		ARRAY_FOREACH(i, m_dFacets)
+			FlushFacet(*m_dFacets[i]);
+	}
+
+
+	int CSphFacetSorter::GetLength() const
+	{
+		int iLength = 0;
+		ARRAY_FOREACH(i, m_dFacets)
+			iLength += m_dFacets[i]->m_pSorter->GetLength() + m_dFacets[i]->m_dKeys.GetLength();
+		return iLength;
+	}
+
+
+	void CSphFacetSorter::Finalize(ISphMatchProcessor& tProcessor, bool bCallProcessInResultSetOrder)
+	{
+		Flush();
+		ARRAY_FOREACH(i, m_dFacets)
+			m_dFacets[i]->m_pSorter->Finalize(tProcessor, bCallProcessInResultSetOrder);
+	}
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/query/match_sorter.h"
+#include "neo/query/grouper.h"
+
+namespace NEO {
+
+	class CSphQuery;
+
+	/// shared-scan aggregator for a FACET batch
+	/// takes the matches of the main query once, and counts every attached facet in a compact per-facet hash (key, count, first match),
+	/// instead of running each match through every facet k-buffer; the counted groups are then pushed into the facet sorters pre-grouped,
+	/// so ordering, limits, and HAVING stay with those sorters
+	/// only COUNT(*) facets whose select lists are constant within a group can be attached, see AddFacet()
+	class CSphFacetSorter : public ISphMatchSorter, ISphNoncopyable
+	{
+	public:
+		/// groups per facet to collect before handing them over to the facet sorter
+		static const int	MAX_GROUPS = 65536;
+
+	public:
+							CSphFacetSorter();
+		virtual				~CSphFacetSorter();
+
+		/// attach a facet sorter (not owned); returns false if that sorter has to get raw matches
+		bool				AddFacet(ISphMatchSorter* pSorter, const CSphQuery& tQuery);
+
+		/// number of attached facets
+		int					GetFacets() const { return m_dFacets.GetLength(); }
+
+		/// push all the counted groups into the facet sorters
+		void				Flush();
+
+		virtual bool		UsesAttrs() const;
+		virtual bool		CanMulti() const { return true; }
+		virtual bool		IsGroupby() const { return true; }
+
+		virtual void		SetMVAPool(const DWORD* pMva, bool bArenaProhibit);
+		virtual void		SetStringPool(const BYTE* pStrings);
+		virtual void		SetStringDict(const CSphStringDict* pDict);
+
+		/// the widest facet schema, so that the shared match carries every column any facet needs
+		virtual const CSphRsetSchema& GetSchema() const;
+
+		virtual bool		Push(const CSphMatch& tEntry);
+		virtual bool		PushGrouped(const CSphMatch&, bool) { assert(0 && "facet aggregator only takes raw matches"); return false; }
+
+		/// upper bound of the matches the facet sorters will have after the flush
+		virtual int			GetLength() const;
+		virtual int			GetDataLength() const { return GetLength(); }
+
+		virtual void		Finalize(ISphMatchProcessor& tProcessor, bool bCallProcessInResultSetOrder);
+		virtual int			Flatten(CSphMatch*, int) { assert(0 && "facet results are taken from the facet sorters"); return 0; }
+
+	protected:
+		struct Facet_t
+		{
+			ISphMatchSorter*			m_pSorter;
+			const CSphGrouper*			m_pGrouper;
+			bool						m_bPlainKey;	///< key is the attribute value itself, no need to call the grouper
+			CSphAttrLocator				m_tLocKey;
+			CSphAttrLocator				m_tLocGroupby;
+			CSphAttrLocator				m_tLocCount;
+
+			CSphVector<SphGroupKey_t>	m_dKeys;		///< group keys, in group order
+			CSphVector<int>				m_dCounts;		///< group counts, in group order
+			CSphVector<int>				m_dSlots;		///< open-addressing table, group index plus 1, or 0 for empty slots
+			int							m_iSlotShift;
+			CSphVector<CSphMatch*>		m_dPages;		///< first match of every group
+		};
+
+		CSphVector<Facet_t*>	m_dFacets;
+		int						m_iSchema;		///< facet with the widest schema
+		const DWORD*			m_pMva;
+		bool					m_bArenaProhibit;
+		const BYTE*				m_pStrings;
+		const CSphStringDict*	m_pDict;
+
+		static const int		GROUP_PAGE = 1024;
+		static const int		MIN_SLOTS_SHIFT = 8;
+
+		int						AddGroup(Facet_t& tFacet, SphGroupKey_t uKey);
+		void					FlushFacet(Facet_t& tFacet);
+		void					ResetFacet(Facet_t& tFacet);
+	};
+
+}
@@ -8,7 +8,9 @@
 #include "neo/core/attrib_index_builder.h"
 #include "neo/core/match_engine.h"
 #include "neo/core/match.h"
+#include "neo/core/match_arena.h"
 #include "neo/query/uniqounter.h"
+#include "neo/query/hll.h"
 #include "neo/tools/utf8_tools.h"
 #include "neo/utility/fixed_hash.h"
 #include "neo/utility/hash.h"
@@ -199,16 +201,20 @@ struct MatchCloner_t
 	CSphFixedVector<CSphRowitem>	m_dRowBuf;
 	CSphVector<CSphAttrLocator>		m_dAttrsRaw;
 	CSphVector<CSphAttrLocator>		m_dAttrsPtr;
+	CSphVector<CSphAttrLocator>		m_dAttrsBlob;	///< blobs owned by the group (eg. distinct sketches) that stay with it on clone
 	const CSphRsetSchema* m_pSchema;
+	CSphMatchArena* m_pArena;		///< where fresh destination matches get their rows from, if any
 
 	MatchCloner_t()
 		: m_dRowBuf(0)
 		, m_pSchema(NULL)
+		, m_pArena(NULL)
 	{ }
 
-	void SetSchema(const CSphRsetSchema* pSchema)
+	void SetSchema(const CSphRsetSchema* pSchema, CSphMatchArena* pArena = NULL)
 	{
 		m_pSchema = pSchema;
+		m_pArena = pArena;
 		m_dRowBuf.Reset(m_pSchema->GetDynamicSize());
 	}
 
@@ -240,6 +246,8 @@ struct MatchCloner_t
 		assert(m_pSchema && pOld && pNew);
 		if (pOld->m_pDynamic == NULL) // no old match has no data to copy, just a fresh but old match
 		{
+			if (m_pArena && m_dRowBuf.GetLength())
+				pOld->m_pDynamic = m_pArena->Alloc(m_dRowBuf.GetLength());
 			m_pSchema->CloneMatch(pOld, *pNew);
 			return;
 		}
@@ -250,6 +258,8 @@ struct MatchCloner_t
 		// as it will be copied back
 		ARRAY_FOREACH(i, m_dAttrsPtr)
 			pOld->SetAttr(m_dAttrsPtr[i], 0);
+		ARRAY_FOREACH(i, m_dAttrsBlob)
+			pOld->SetAttr(m_dAttrsBlob[i], 0);
 
 		m_pSchema->CloneMatch(pOld, *pNew);
 
@@ -257,6 +267,14 @@ struct MatchCloner_t
 			pOld->SetAttr(m_dAttrsRaw[i], sphGetRowAttr(m_dRowBuf.Begin(), m_dAttrsRaw[i]));
 		ARRAY_FOREACH(i, m_dAttrsPtr)
 			pOld->SetAttr(m_dAttrsPtr[i], sphGetRowAttr(m_dRowBuf.Begin(), m_dAttrsPtr[i]));
+
+		// drop the copy that came along with the new match, if any
+		ARRAY_FOREACH(i, m_dAttrsBlob)
+		{
+			BYTE* pCopy = (BYTE*)pOld->GetAttr(m_dAttrsBlob[i]);
+			SafeDeleteArray(pCopy);
+			pOld->SetAttr(m_dAttrsBlob[i], sphGetRowAttr(m_dRowBuf.Begin(), m_dAttrsBlob[i]));
+		}
 	}
 };
 
@@ -358,6 +376,43 @@ static SphAttr_t GetDistinctKey(const CSphMatch& tEntry, const CSphAttrLocator&
 }
 
 
+/// add a distinct value to the group sketch, creating the sketch on the first value
+static inline void DistinctSketchAdd(CSphMatch* pGroup, const CSphGroupSorterSettings& tSettings, SphAttr_t uValue)
+{
+	BYTE* pSketch = (BYTE*)pGroup->GetAttr(tSettings.m_tLocDistinctHll);
+	if (!pSketch)
+		pSketch = sphHllCreate(tSettings.m_iDistinctHll);
+
+	sphHllAdd(pSketch, sphHllHash(uValue));
+	pGroup->SetAttr(tSettings.m_tLocDistinctHll, (SphAttr_t)pSketch);
+}
+
+
+/// merge the sketch of an already grouped match (from another index, chunk, or agent) into the group sketch
+static inline void DistinctSketchMerge(CSphMatch* pGroup, const CSphGroupSorterSettings& tSettings, const CSphMatch& tEntry)
+{
+	const BYTE* pOther = (const BYTE*)tEntry.GetAttr(tSettings.m_tLocDistinctHll);
+	if (!sphHllCheck(pOther))
+		return;
+
+	BYTE* pSketch = (BYTE*)pGroup->GetAttr(tSettings.m_tLocDistinctHll);
+	if (!pSketch)
+		pSketch = sphHllCreate(tSettings.m_iDistinctHll);
+
+	sphHllMerge(pSketch, pOther);
+	pGroup->SetAttr(tSettings.m_tLocDistinctHll, (SphAttr_t)pSketch);
+}
+
+
+/// set @distinct from the group sketch
+static inline void DistinctSketchCount(CSphMatch* pGroup, const CSphGroupSorterSettings& tSettings)
+{
+	const BYTE* pSketch = (const BYTE*)pGroup->GetAttr(tSettings.m_tLocDistinctHll);
+	if (pSketch)
+		pGroup->SetAttr(tSettings.m_tLocDistinct, (SphAttr_t)Min(sphHllEstimate(pSketch), (int64_t)UINT_MAX));
+}
+
+
 /// match sorter with k-buffering and group-by
 template < typename COMPGROUP, bool DISTINCT, bool NOTIFICATIONS >
 class CSphKBufferGroupSorter : public CSphMatchQueueTraits, protected CSphGroupSorterSettings
@@ -373,6 +428,7 @@ protected:
 
 	CSphUniqounter	m_tUniq;
 	bool			m_bSortByDistinct;
+	bool			m_bDistinctSketch;	///< approximate count(distinct) via per-group sketches instead of m_tUniq
 
 	GroupSorter_fn<COMPGROUP>	m_tGroupSorter;
 	const ISphMatchComparator* m_pComp;
@@ -395,6 +451,7 @@ public:
 		, m_hGroup2Match(pQuery->m_iMaxMatches* GROUPBY_FACTOR)
 		, m_iLimit(pQuery->m_iMaxMatches)
 		, m_bSortByDistinct(false)
+		, m_bDistinctSketch(DISTINCT && tSettings.m_iDistinctHll > 0 && tSettings.m_tLocDistinctHll.m_iBitOffset >= 0)
 		, m_pComp(pComp)
 		, m_pAggrFilter(tSettings.m_pAggrFilterTrait)
 		, m_pStringBase(NULL)
@@ -410,12 +467,14 @@ public:
 	virtual void SetSchema(CSphRsetSchema& tSchema)
 	{
 		m_tSchema = tSchema;
-		m_tPregroup.SetSchema(&m_tSchema);
+		m_tPregroup.SetSchema(&m_tSchema, &m_tArena);
 		m_tPregroup.m_dAttrsRaw.Add(m_tLocGroupby);
 		m_tPregroup.m_dAttrsRaw.Add(m_tLocCount);
 		if_const(DISTINCT)
 		{
 			m_tPregroup.m_dAttrsRaw.Add(m_tLocDistinct);
+			if (m_bDistinctSketch)
+				m_tPregroup.m_dAttrsBlob.Add(m_tLocDistinctHll);
 		}
 		ExtractAggregates(m_tSchema, m_tLocCount, m_tGroupSorter.m_eKeypart, m_tGroupSorter.m_tLocator, m_dAggregates, m_dAvgs, m_tPregroup);
 	}
@@ -457,6 +516,29 @@ public:
 		m_pGrouper->SetStringPool(pStrings);
 	}
 
+	/// set string attribute dictionary (for dictionary-encoded string groupby)
+	virtual void SetStringDict(const CSphStringDict* pDict)
+	{
+		CSphMatchQueueTraits::SetStringDict(pDict);
+		m_pGrouper->SetStringDict(pDict);
+	}
+
+	/// plain COUNT(*) grouping can be pre-aggregated elsewhere; distinct values, aggregates, MVA and JSON keys can not
+	virtual const CSphGrouper* GetFacetGrouper() const
+	{
+		if (DISTINCT || NOTIFICATIONS || m_bMVA || m_bJson || m_dAggregates.GetLength())
+			return NULL;
+		return m_pGrouper;
+	}
+
+	/// aggregates take pre-grouped values, but distinct values do not come with them, and MVA and JSON keys are per value
+	virtual const CSphGrouper* GetGrouper() const
+	{
+		if (DISTINCT || m_bMVA || m_bJson)
+			return NULL;
+		return m_pGrouper;
+	}
+
 	/// add entry to the queue
 	virtual bool Push(const CSphMatch& tEntry)
 	{
@@ -505,6 +587,14 @@ public:
 			ARRAY_FOREACH(i, m_dAggregates)
 				m_dAggregates[i]->Update(pMatch, &tEntry, bGrouped);
 
+			if (DISTINCT && m_bDistinctSketch)
+			{
+				if (bGrouped)
+					DistinctSketchMerge(pMatch, *this, tEntry);
+				else
+					DistinctSketchAdd(pMatch, *this, GetDistinctKey(tEntry, m_tDistinctLoc, m_eDistinctAttr, m_pStringBase));
+			}
+
 			// if new entry is more relevant, update from it
 			if (m_pComp->VirtualIsLess(*pMatch, tEntry, m_tState))
 			{
@@ -524,7 +614,7 @@ public:
 		}
 
 		// submit actual distinct value in all cases
-		if_const(DISTINCT)
+		if (DISTINCT && !m_bDistinctSketch)
 		{
 			int iCount = 1;
 			if (bGrouped)
@@ -545,7 +635,7 @@ public:
 		// do add
 		assert(m_iUsed < m_iSize);
 		CSphMatch& tNew = m_pData[m_iUsed++];
-		m_tSchema.CloneMatch(&tNew, tEntry);
+		CloneToSlot(&tNew, tEntry);
 
 		if_const(NOTIFICATIONS)
 			m_iJustPushed = tNew.m_uDocID;
@@ -560,6 +650,9 @@ public:
 			// set @groupbystr value if available
 			if (pAttr && m_tLocGroupbyStr.m_bDynamic)
 				tNew.SetAttr(m_tLocGroupbyStr, *pAttr);
+
+			if (DISTINCT && m_bDistinctSketch)
+				DistinctSketchAdd(&tNew, *this, GetDistinctKey(tEntry, m_tDistinctLoc, m_eDistinctAttr, m_pStringBase));
 		}
 		else
 		{
@@ -672,6 +765,13 @@ protected:
 	/// count distinct values if necessary
 	void CountDistinct()
 	{
+		if (DISTINCT && m_bDistinctSketch)
+		{
+			for (int i = 0; i < m_iUsed; i++)
+				DistinctSketchCount(m_pData + i, *this);
+			return;
+		}
+
 		if_const(DISTINCT)
 		{
 			m_tUniq.Sort();
@@ -702,8 +802,8 @@ protected:
 				m_dJustPopped.Add(m_pData[i].m_uDocID);
 		}
 
-		// cleanup unused distinct stuff
-		if_const(DISTINCT)
+		// cleanup unused distinct stuff; sketches just go away along with their groups
+		if (DISTINCT && !m_bDistinctSketch)
 		{
 			// build kill-list
 			CSphVector<SphGroupKey_t> dRemove;
@@ -870,7 +970,7 @@ public:
 	{
 		m_tSchema = tSchema;
 
-		m_tPregroup.SetSchema(&m_tSchema);
+		m_tPregroup.SetSchema(&m_tSchema, &m_tArena);
 		m_tPregroup.m_dAttrsRaw.Add(m_tLocGroupby);
 		m_tPregroup.m_dAttrsRaw.Add(m_tLocCount);
 		if_const(DISTINCT)
@@ -917,6 +1017,13 @@ public:
 		m_pGrouper->SetStringPool(pStrings);
 	}
 
+	/// set string attribute dictionary (for dictionary-encoded string groupby)
+	virtual void SetStringDict(const CSphStringDict* pDict)
+	{
+		CSphMatchQueueTraits::SetStringDict(pDict);
+		m_pGrouper->SetStringDict(pDict);
+	}
+
 	/// add entry to the queue
 	virtual bool Push(const CSphMatch& tEntry)
 	{
@@ -1163,7 +1270,7 @@ public:
 		assert(iNew >= 0 && iNew < m_iSize);
 
 		CSphMatch& tNew = m_pData[iNew];
-		m_tSchema.CloneMatch(&tNew, tEntry);
+		CloneToSlot(&tNew, tEntry);
 
 		m_dGroupByList[iNew] = -1;
 		m_dGroupsLen[iNew] = 1;
@@ -1736,6 +1843,7 @@ protected:
 	bool			m_bDataInitialized;
 
 	CSphVector<SphUngroupedValue_t>	m_dUniq;
+	bool			m_bDistinctSketch;	///< approximate count(distinct) via a sketch instead of m_dUniq
 
 	CSphVector<IAggrFunc*>		m_dAggregates;
 	const ISphFilter* m_pAggrFilter;				///< aggregate filter for matches on flatten
@@ -1747,6 +1855,7 @@ public:
 	CSphImplicitGroupSorter(const ISphMatchComparator* DEBUGARG(pComp), const CSphQuery*, const CSphGroupSorterSettings& tSettings)
 		: CSphGroupSorterSettings(tSettings)
 		, m_bDataInitialized(false)
+		, m_bDistinctSketch(DISTINCT && tSettings.m_iDistinctHll > 0 && tSettings.m_tLocDistinctHll.m_iBitOffset >= 0)
 		, m_pAggrFilter(tSettings.m_pAggrFilterTrait)
 		, m_pStringBase(NULL)
 	{
@@ -1756,7 +1865,8 @@ public:
 		if_const(NOTIFICATIONS)
 			m_dJustPopped.Reserve(1);
 
-		m_dUniq.Reserve(16384);
+		if (!m_bDistinctSketch)
+			m_dUniq.Reserve(16384);
 		m_iMatchCapacity = 1;
 	}
 
@@ -1778,6 +1888,8 @@ public:
 		if_const(DISTINCT)
 		{
 			m_tPregroup.m_dAttrsRaw.Add(m_tLocDistinct);
+			if (m_bDistinctSketch)
+				m_tPregroup.m_dAttrsBlob.Add(m_tLocDistinctHll);
 		}
 
 		CSphVector<IAggrFunc*> dTmp;
@@ -1901,6 +2013,14 @@ protected:
 			ARRAY_FOREACH(i, m_dAggregates)
 				m_dAggregates[i]->Update(&m_tData, &tEntry, bGrouped);
 
+			if (DISTINCT && m_bDistinctSketch)
+			{
+				if (bGrouped)
+					DistinctSketchMerge(&m_tData, *this, tEntry);
+				else
+					DistinctSketchAdd(&m_tData, *this, GetDistinctKey(tEntry, m_tDistinctLoc, m_eDistinctAttr, m_pStringBase));
+			}
+
 			// if new entry is more relevant, update from it
 			if (tEntry.m_uDocID < m_tData.m_uDocID)
 			{
@@ -1915,7 +2035,7 @@ protected:
 		}
 
 		// submit actual distinct value in all cases
-		if_const(DISTINCT)
+		if (DISTINCT && !m_bDistinctSketch)
 		{
 			int iCount = 1;
 			if (bGrouped)
@@ -1941,6 +2061,9 @@ protected:
 			m_tData.SetAttr(m_tLocCount, 1);
 			if_const(DISTINCT)
 				m_tData.SetAttr(m_tLocDistinct, 0);
+
+			if (DISTINCT && m_bDistinctSketch)
+				DistinctSketchAdd(&m_tData, *this, GetDistinctKey(tEntry, m_tDistinctLoc, m_eDistinctAttr, m_pStringBase));
 		}
 		else
 		{
@@ -1956,6 +2079,12 @@ protected:
 	/// count distinct values if necessary
 	void CountDistinct()
 	{
+		if (DISTINCT && m_bDistinctSketch)
+		{
+			DistinctSketchCount(&m_tData, *this);
+			return;
+		}
+
 		if_const(DISTINCT)
 		{
 			assert(m_bDataInitialized);
@@ -26,6 +26,8 @@ namespace NEO {
 		const ISphFilter* m_pAggrFilterTrait; ///< aggregate filter that got owned by grouper
 		bool				m_bJson;			///< whether we're grouping by Json attribute
 		CSphAttrLocator		m_tLocGroupbyStr;	///< locator for @groupbystr
+		CSphAttrLocator		m_tLocDistinctHll;	///< locator for @distinct_hll, the per-group sketch for approximate count(distinct)
+		int					m_iDistinctHll;		///< sketch precision; 0 means exact count(distinct)
 
 		CSphGroupSorterSettings()
 			: m_eDistinctAttr(ESphAttr::SPH_ATTR_NONE)
@@ -36,6 +38,7 @@ namespace NEO {
 			, m_bImplicit(false)
 			, m_pAggrFilterTrait(NULL)
 			, m_bJson(false)
+			, m_iDistinctHll(0)
 		{}
 	};
 
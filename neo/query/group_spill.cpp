@@ -0,0 +1,318 @@
+#include "neo/query/group_spill.h"
+#include "neo/core/globals.h"
+#include "neo/io/autofile.h"
+#include "neo/io/writer.h"
+#include "neo/io/reader.h"
+#include "neo/source/schema_int.h"
+#include "neo/platform/atomic.h"
+
+#if !USE_WINDOWS
+#include <unistd.h>
+#else
+#define getpid() GetCurrentProcessId()
+#endif
+
+namespace NEO {
+
+	static const int GROUP_SPILL_BUFFER = 65536;
+
+	/// spill files sequence, to keep names unique across concurrent queries
+	static CSphAtomic g_iGroupSpillSeq;
+
+
+	CSphGroupSpill::CSphGroupSpill(int iParts)
+		: m_iDynamic(0)
+		, m_bUsed(false)
+		, m_iSpilled(0)
+		, m_pReadFile(NULL)
+		, m_pReader(NULL)
+		, m_iReadSize(0)
+	{
+		assert(iParts > 0 && !(iParts & (iParts - 1)));
+		m_dParts.Resize(iParts);
+		ARRAY_FOREACH(i, m_dParts)
+		{
+			m_dParts[i].m_pFile = NULL;
+			m_dParts[i].m_pWriter = NULL;
+		}
+	}
+
+
+	CSphGroupSpill::~CSphGroupSpill()
+	{
+		EndRead();
+		ARRAY_FOREACH(i, m_dParts)
+			ClosePart(m_dParts[i]);
+	}
+
+
+	void CSphGroupSpill::Setup(int iDynamic)
+	{
+		m_iDynamic = iDynamic;
+		m_dStrings.Resize(0);
+		m_dBlobs.Resize(0);
+	}
+
+
+	void CSphGroupSpill::Setup(const ISphSchema& tSchema)
+	{
+		Setup(tSchema.GetDynamicSize());
+		for (int i = 0; i < tSchema.GetAttrsCount(); i++)
+		{
+			const CSphColumnInfo& tCol = tSchema.GetAttr(i);
+			if (!tCol.m_tLocator.m_bDynamic)
+				continue;
+
+			int iItem = tCol.m_tLocator.m_iBitOffset / ROWITEM_BITS;
+			if (tCol.m_eAttrType == ESphAttr::SPH_ATTR_STRINGPTR)
+				m_dStrings.Add(iItem);
+			else if (tCol.m_eAttrType == ESphAttr::SPH_ATTR_FACTORS || tCol.m_eAttrType == ESphAttr::SPH_ATTR_FACTORS_JSON)
+				m_dBlobs.Add(iItem);
+		}
+	}
+
+
+	int CSphGroupSpill::PartOf(SphGroupKey_t uKey) const
+	{
+		// top bits of a multiplicative hash; the in-memory table uses another multiplier, so partitions don't skew it
+		uint64_t uHash = uint64_t(uKey) * U64C(0xC2B2AE3D27D4EB4F);
+		return int((uHash >> 40) & (m_dParts.GetLength() - 1));
+	}
+
+
+	bool CSphGroupSpill::IsEmpty(int iPart) const
+	{
+		return !m_dParts[iPart].m_pWriter || !m_dParts[iPart].m_pWriter->GetPos();
+	}
+
+
+	bool CSphGroupSpill::Open()
+	{
+		ARRAY_FOREACH(i, m_dParts)
+			if (!GetWriter(i))
+				return false;
+		return true;
+	}
+
+
+	void CSphGroupSpill::ClosePart(SpillPart_t& tPart)
+	{
+		SafeDelete(tPart.m_pWriter);
+		SafeDelete(tPart.m_pFile); // temporary, so that unlinks it
+	}
+
+
+	CSphWriter* CSphGroupSpill::GetWriter(int iPart)
+	{
+		SpillPart_t& tPart = m_dParts[iPart];
+		if (tPart.m_pWriter)
+			return tPart.m_pWriter;
+
+		const char* sDir = g_sGroupbyTmpDir.cstr();
+		if (!sDir || !*sDir)
+			sDir = getenv("TMPDIR");
+		if (!sDir || !*sDir)
+			sDir = "/tmp";
+
+		CSphString sName;
+		sName.SetSprintf("%s/groupby.%d.%d.%d.tmp", sDir, (int)getpid(), (int)g_iGroupSpillSeq.Inc(), iPart);
+
+		tPart.m_pFile = new CSphAutofile(sName, SPH_O_NEW, m_sError, true);
+		if (tPart.m_pFile->GetFD() < 0)
+		{
+			SafeDelete(tPart.m_pFile);
+			return NULL;
+		}
+
+		tPart.m_pWriter = new CSphWriter();
+		tPart.m_pWriter->SetBufferSize(GROUP_SPILL_BUFFER);
+		tPart.m_pWriter->SetFile(*tPart.m_pFile, NULL, m_sError);
+		m_bUsed = true;
+		return tPart.m_pWriter;
+	}
+
+
+	bool CSphGroupSpill::WriteGroup(const CSphMatch& tMatch, SphGroupKey_t uKey)
+	{
+		CSphWriter* pWriter = GetWriter(PartOf(uKey));
+		if (!pWriter)
+			return false;
+
+		SphOffset_t iStart = pWriter->GetPos();
+		pWriter->PutByte(RECORD_GROUP);
+		pWriter->PutOffset((SphOffset_t)tMatch.m_uDocID);
+		pWriter->PutDword((DWORD)tMatch.m_iWeight);
+		pWriter->PutDword((DWORD)tMatch.m_iTag);
+		pWriter->PutOffset((SphOffset_t)(size_t)tMatch.m_pStatic); // static rows outlive the query, and spills never outlive the query
+		pWriter->PutBytes(tMatch.m_pDynamic, sizeof(CSphRowitem) * m_iDynamic);
+
+		// payloads go by value, length plus 1, so that NULL and empty strings differ
+		ARRAY_FOREACH(i, m_dStrings)
+		{
+			const char* sStr = *(const char**)(tMatch.m_pDynamic + m_dStrings[i]);
+			int iLen = sStr ? (int)strlen(sStr) : 0;
+			pWriter->PutDword(sStr ? iLen + 1 : 0);
+			if (iLen)
+				pWriter->PutBytes(sStr, iLen);
+		}
+
+		// factor blobs start with their own size
+		ARRAY_FOREACH(i, m_dBlobs)
+		{
+			const BYTE* pData = *(const BYTE**)(tMatch.m_pDynamic + m_dBlobs[i]);
+			DWORD uSize = pData ? *(const DWORD*)pData : 0;
+			pWriter->PutDword(uSize);
+			if (uSize)
+				pWriter->PutBytes(pData, uSize);
+		}
+
+		m_iSpilled += pWriter->GetPos() - iStart;
+		return !pWriter->IsError();
+	}
+
+
+	bool CSphGroupSpill::WriteDistinct(const SphGroupedValue_t& tValue)
+	{
+		CSphWriter* pWriter = GetWriter(PartOf(tValue.m_uGroup));
+		if (!pWriter)
+			return false;
+
+		SphOffset_t iStart = pWriter->GetPos();
+		pWriter->PutByte(RECORD_DISTINCT);
+		pWriter->PutOffset((SphOffset_t)tValue.m_uGroup);
+		pWriter->PutOffset((SphOffset_t)tValue.m_uValue);
+		pWriter->PutDword((DWORD)tValue.m_iCount);
+		m_iSpilled += pWriter->GetPos() - iStart;
+		return !pWriter->IsError();
+	}
+
+
+	bool CSphGroupSpill::StartRead(int iPart, bool bRewrite)
+	{
+		EndRead();
+
+		SpillPart_t& tPart = m_dParts[iPart];
+		if (!tPart.m_pWriter)
+			return false;
+
+		// flush whatever is buffered; reader works with explicit offsets, so the shared fd is fine
+		m_iReadSize = tPart.m_pWriter->GetPos();
+		tPart.m_pWriter->CloseFile();
+		bool bError = tPart.m_pWriter->IsError();
+		SafeDelete(tPart.m_pWriter);
+
+		m_pReadFile = tPart.m_pFile;
+		tPart.m_pFile = NULL;
+		if (bError)
+			return false;
+
+		m_pReader = new CSphReader();
+		m_pReader->SetFile(*m_pReadFile);
+		m_pReader->SeekTo(0, GROUP_SPILL_BUFFER);
+
+		if (bRewrite && !GetWriter(iPart))
+			return false;
+
+		return true;
+	}
+
+
+	int CSphGroupSpill::ReadRecord(CSphMatch& tMatch, SphGroupedValue_t& tValue)
+	{
+		if (!m_pReader || m_pReader->GetPos() >= m_iReadSize || m_pReader->GetErrorFlag())
+			return RECORD_NONE;
+
+		int iType = m_pReader->GetByte();
+		switch (iType)
+		{
+		case RECORD_GROUP:
+			tMatch.Reset(m_iDynamic);
+			tMatch.m_uDocID = (SphDocID_t)m_pReader->GetOffset();
+			tMatch.m_iWeight = (int)m_pReader->GetDword();
+			tMatch.m_iTag = (int)m_pReader->GetDword();
+			tMatch.m_pStatic = (const CSphRowitem*)(size_t)m_pReader->GetOffset();
+			m_pReader->GetBytes(tMatch.m_pDynamic, sizeof(CSphRowitem) * m_iDynamic);
+
+			// the raw pointers are stale; replace them with the payload copies
+			ARRAY_FOREACH(i, m_dStrings)
+				*(char**)(tMatch.m_pDynamic + m_dStrings[i]) = NULL;
+			ARRAY_FOREACH(i, m_dBlobs)
+				*(BYTE**)(tMatch.m_pDynamic + m_dBlobs[i]) = NULL;
+
+			for (int i = 0; i < m_dStrings.GetLength() && !m_pReader->GetErrorFlag(); i++)
+			{
+				DWORD uLen = m_pReader->GetDword();
+				if (!uLen)
+					continue;
+
+				char* sStr = new char[uLen];
+				m_pReader->GetBytes(sStr, uLen - 1);
+				sStr[uLen - 1] = '\0';
+				*(char**)(tMatch.m_pDynamic + m_dStrings[i]) = sStr;
+			}
+
+			for (int i = 0; i < m_dBlobs.GetLength() && !m_pReader->GetErrorFlag(); i++)
+			{
+				DWORD uSize = m_pReader->GetDword();
+				if (!uSize)
+					continue;
+
+				if (uSize < sizeof(DWORD))
+				{
+					m_sError.SetSprintf("corrupted group-by spill file %s", m_pReader->GetFilename().cstr());
+					FreePtrs(tMatch);
+					return RECORD_NONE;
+				}
+
+				BYTE* pData = new BYTE[uSize];
+				m_pReader->GetBytes(pData, uSize);
+				*(BYTE**)(tMatch.m_pDynamic + m_dBlobs[i]) = pData;
+			}
+			break;
+
+		case RECORD_DISTINCT:
+			tValue.m_uGroup = (SphGroupKey_t)m_pReader->GetOffset();
+			tValue.m_uValue = (SphAttr_t)m_pReader->GetOffset();
+			tValue.m_iCount = (int)m_pReader->GetDword();
+			break;
+
+		default:
+			m_sError.SetSprintf("corrupted group-by spill file %s", m_pReader->GetFilename().cstr());
+			return RECORD_NONE;
+		}
+
+		if (m_pReader->GetErrorFlag())
+		{
+			m_sError = m_pReader->GetErrorMessage();
+			if (iType == RECORD_GROUP)
+				FreePtrs(tMatch);
+			return RECORD_NONE;
+		}
+		return iType;
+	}
+
+
+	void CSphGroupSpill::FreePtrs(CSphMatch& tMatch) const
+	{
+		ARRAY_FOREACH(i, m_dStrings)
+		{
+			char*& sStr = *(char**)(tMatch.m_pDynamic + m_dStrings[i]);
+			SafeDeleteArray(sStr);
+		}
+
+		ARRAY_FOREACH(i, m_dBlobs)
+		{
+			BYTE*& pData = *(BYTE**)(tMatch.m_pDynamic + m_dBlobs[i]);
+			SafeDeleteArray(pData);
+		}
+	}
+
+
+	void CSphGroupSpill::EndRead()
+	{
+		SafeDelete(m_pReader);
+		SafeDelete(m_pReadFile);
+		m_iReadSize = 0;
+	}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/core/match.h"
+#include "neo/query/uniqounter.h"
+
+namespace NEO {
+
+	class CSphAutofile;
+	class CSphWriter;
+	class CSphReader;
+	class ISphSchema;
+
+	/// on-disk partitions for exact group-by (grace hash style)
+	/// groups and their distinct values are routed into a fixed set of temp files by group key,
+	/// so that every partition can later be merged in memory on its own
+	/// records keep raw dynamic rows followed by the string and factor payloads, so the spilled groups own no memory
+	class CSphGroupSpill : public ISphNoncopyable
+	{
+	public:
+		enum
+		{
+			RECORD_NONE = 0,
+			RECORD_GROUP = 1,
+			RECORD_DISTINCT = 2
+		};
+
+		static const int	DEFAULT_PARTS = 32;
+
+	public:
+		explicit			CSphGroupSpill(int iParts = DEFAULT_PARTS);
+							~CSphGroupSpill();
+
+		void				Setup(int iDynamic);
+
+		/// same, but also pick the string and factor pointers from the schema, so that their payloads get spilled too
+		void				Setup(const ISphSchema& tSchema);
+
+		/// create all the partition files upfront, so that a bad temp dir fails before anything is written
+		bool				Open();
+
+		int					GetParts() const { return m_dParts.GetLength(); }
+		int					PartOf(SphGroupKey_t uKey) const;
+		bool				IsEmpty(int iPart) const;
+		bool				IsUsed() const { return m_bUsed; }
+		int64_t				GetSpilledBytes() const { return m_iSpilled; }
+		const CSphString&	GetError() const { return m_sError; }
+
+		bool				WriteGroup(const CSphMatch& tMatch, SphGroupKey_t uKey);
+		bool				WriteDistinct(const SphGroupedValue_t& tValue);
+
+		/// start reading a partition back; with bRewrite, subsequent writes go to a fresh file for the same partition
+		bool				StartRead(int iPart, bool bRewrite);
+
+		/// read next record; group records overwrite the match dynamic part (its pointers must be freed by then) with fresh string and factor copies; returns record type, or RECORD_NONE at the end
+		int					ReadRecord(CSphMatch& tMatch, SphGroupedValue_t& tValue);
+
+		/// done reading; drops the file that was read
+		void				EndRead();
+
+	protected:
+		struct SpillPart_t
+		{
+			CSphAutofile*	m_pFile;
+			CSphWriter*		m_pWriter;
+		};
+
+		CSphVector<SpillPart_t>	m_dParts;
+		int						m_iDynamic;
+		CSphVector<int>			m_dStrings;		///< rowitems of string pointers
+		CSphVector<int>			m_dBlobs;		///< rowitems of factor pointers (size-prefixed blobs)
+		bool					m_bUsed;
+		int64_t					m_iSpilled;
+		CSphString				m_sError;
+
+		CSphAutofile*			m_pReadFile;
+		CSphReader*				m_pReader;
+		SphOffset_t				m_iReadSize;
+
+		CSphWriter*				GetWriter(int iPart);
+		void					ClosePart(SpillPart_t& tPart);
+		void					FreePtrs(CSphMatch& tMatch) const;
+	};
+
+}
@@ -5,6 +5,7 @@
 #include "neo/source/attrib_locator.h"
 #include "neo/core/match.h"
 #include "neo/utility/inline_misc.h"
+#include "neo/core/string_dict.h"
 
 #include "neo/sphinxexpr.h"
 
@@ -44,6 +45,7 @@ namespace NEO {
 		virtual void			GetLocator(CSphAttrLocator& tOut) const = 0;
 		virtual ESphAttr		GetResultType() const = 0;
 		virtual void			SetStringPool(const BYTE*) {}
+		virtual void			SetStringDict(const CSphStringDict*) {}
 		virtual bool			CanMulti() const { return true; }
 	};
 
@@ -116,12 +118,18 @@ namespace NEO {
 	{
 	protected:
 		const BYTE* m_pStringBase;
+		const CSphStringDict* m_pDict;				///< string attribute dictionary (if any)
+		bool m_bDictActive;							///< whether dictionary matches current string pool
+		mutable CSphHash<SphGroupKey_t> m_hDictKeys;	///< dictionary code to group key cache, so that every distinct value gets hashed once
 
 	public:
 
 		explicit CSphGrouperString(const CSphAttrLocator& tLoc)
 			: CSphGrouperAttr(tLoc)
 			, m_pStringBase(NULL)
+			, m_pDict(NULL)
+			, m_bDictActive(false)
+			, m_hDictKeys(0)
 		{
 		}
 
@@ -135,18 +143,46 @@ namespace NEO {
 			if (!m_pStringBase || !uValue)
 				return 0;
 
+			// dictionary-encoded value; keys are the same as for raw strings, just computed once per code
+			SphGroupKey_t* pKey = NULL;
+			if (m_bDictActive && m_pDict->Contains(uValue))
+			{
+				pKey = m_hDictKeys.Find(uValue);
+				if (pKey)
+					return *pKey;
+			}
+
 			const BYTE* pStr = NULL;
 			int iLen = sphUnpackStr(m_pStringBase + uValue, &pStr);
 
 			if (!pStr || !iLen)
 				return 0;
 
-			return PRED::Hash(pStr, iLen);
+			SphGroupKey_t uKey = PRED::Hash(pStr, iLen);
+			if (m_bDictActive && m_pDict->Contains(uValue))
+				m_hDictKeys.Add(uValue, uKey);
+			return uKey;
 		}
 
 		virtual void SetStringPool(const BYTE* pStrings)
 		{
 			m_pStringBase = pStrings;
+			UpdateDict();
+		}
+
+		virtual void SetStringDict(const CSphStringDict* pDict)
+		{
+			if (pDict != m_pDict)
+				m_hDictKeys.Reset(0);
+			m_pDict = (pDict && !pDict->IsEmpty()) ? pDict : NULL;
+			UpdateDict();
+		}
+
+		void UpdateDict()
+		{
+			m_bDictActive = m_pDict && m_pDict->GetPool() == m_pStringBase;
+			if (m_bDictActive && !m_hDictKeys.GetLength())
+				m_hDictKeys.Reset(Min(m_pDict->GetLength(), 65536));
 		}
 
 		virtual bool CanMulti() const { return false; }
@@ -238,6 +274,124 @@ namespace NEO {
 	};
 
 
+	/// multi-attribute grouper over a few integer attributes whose widths add up to 64 bits at most
+	/// the key is the values packed side by side, so it is exact and needs no hashing; see CanPack()
+	/// the layout follows the locator widths, so indexes grouped together must declare the attributes alike
+	template < int ATTRS >
+	class CSphGrouperMultiPacked : public CSphGrouper
+	{
+	public:
+		/// check whether the values of given attributes fit into a single key
+		static bool CanPack(const CSphVector<CSphAttrLocator>& dLocators, const CSphVector<ESphAttr>& dAttrTypes)
+		{
+			if (dLocators.GetLength() != ATTRS)
+				return false;
+
+			int iBits = 0;
+			ARRAY_FOREACH(i, dLocators)
+			{
+				if (!IsPackable(dAttrTypes[i]) || dLocators[i].m_iBitCount <= 0)
+					return false;
+				iBits += dLocators[i].m_iBitCount;
+			}
+			return iBits <= 64;
+		}
+
+		explicit CSphGrouperMultiPacked(const CSphVector<CSphAttrLocator>& dLocators)
+		{
+			assert(dLocators.GetLength() == ATTRS);
+
+			int iShift = 0;
+			for (int i = 0; i < ATTRS; i++)
+			{
+				m_tLocators[i] = dLocators[i];
+				m_iShifts[i] = iShift;
+				m_uMasks[i] = (U64C(1) << dLocators[i].m_iBitCount) - 1;
+				iShift += dLocators[i].m_iBitCount;
+			}
+			assert(iShift <= 64);
+		}
+
+		virtual SphGroupKey_t KeyFromMatch(const CSphMatch& tMatch) const
+		{
+			uint64_t uKey = 0;
+			for (int i = 0; i < ATTRS; i++)
+				uKey |= ((uint64_t)tMatch.GetAttr(m_tLocators[i]) & m_uMasks[i]) << m_iShifts[i];
+			return (SphGroupKey_t)uKey;
+		}
+
+		virtual SphGroupKey_t KeyFromValue(SphAttr_t) const { assert(0); return SphGroupKey_t(); }
+		virtual void GetLocator(CSphAttrLocator&) const { assert(0); }
+		virtual ESphAttr GetResultType() const { return ESphAttr::SPH_ATTR_BIGINT; }
+
+	protected:
+		CSphAttrLocator		m_tLocators[ATTRS];
+		int					m_iShifts[ATTRS];
+		uint64_t			m_uMasks[ATTRS];
+
+		static bool IsPackable(ESphAttr eAttr)
+		{
+			return eAttr == ESphAttr::SPH_ATTR_INTEGER || eAttr == ESphAttr::SPH_ATTR_TIMESTAMP || eAttr == ESphAttr::SPH_ATTR_BOOL
+				|| eAttr == ESphAttr::SPH_ATTR_TOKENCOUNT || eAttr == ESphAttr::SPH_ATTR_FLOAT || eAttr == ESphAttr::SPH_ATTR_BIGINT;
+		}
+	};
+
+
+	/// multi-attribute grouper over an integer and a string attribute (in any order)
+	/// the string goes through the string grouper, so every distinct dictionary value gets hashed once, and the integer is mixed in
+	template <class PRED>
+	class CSphGrouperIntString : public CSphGrouper
+	{
+	public:
+		/// check for exactly one plain string attribute and one integer one
+		static bool CanGroup(const CSphVector<ESphAttr>& dAttrTypes)
+		{
+			if (dAttrTypes.GetLength() != 2)
+				return false;
+
+			int iString = GetString(dAttrTypes);
+			if (iString < 0)
+				return false;
+
+			ESphAttr eInt = dAttrTypes[1 - iString];
+			return eInt == ESphAttr::SPH_ATTR_INTEGER || eInt == ESphAttr::SPH_ATTR_TIMESTAMP || eInt == ESphAttr::SPH_ATTR_BOOL
+				|| eInt == ESphAttr::SPH_ATTR_TOKENCOUNT || eInt == ESphAttr::SPH_ATTR_BIGINT;
+		}
+
+		CSphGrouperIntString(const CSphVector<CSphAttrLocator>& dLocators, const CSphVector<ESphAttr>& dAttrTypes)
+			: m_tString(dLocators[GetString(dAttrTypes)])
+			, m_tInt(dLocators[1 - GetString(dAttrTypes)])
+		{
+			assert(CanGroup(dAttrTypes));
+		}
+
+		virtual SphGroupKey_t KeyFromMatch(const CSphMatch& tMatch) const
+		{
+			SphAttr_t tInt = tMatch.GetAttr(m_tInt);
+			return (SphGroupKey_t)sphFNV64(&tInt, sizeof(tInt), (uint64_t)m_tString.KeyFromMatch(tMatch));
+		}
+
+		virtual void SetStringPool(const BYTE* pStrings) { m_tString.SetStringPool(pStrings); }
+		virtual void SetStringDict(const CSphStringDict* pDict) { m_tString.SetStringDict(pDict); }
+
+		virtual SphGroupKey_t KeyFromValue(SphAttr_t) const { assert(0); return SphGroupKey_t(); }
+		virtual void GetLocator(CSphAttrLocator&) const { assert(0); }
+		virtual ESphAttr GetResultType() const { return ESphAttr::SPH_ATTR_BIGINT; }
+		virtual bool CanMulti() const { return false; }
+
+	protected:
+		CSphGrouperString<PRED>		m_tString;
+		CSphAttrLocator				m_tInt;
+
+		static int GetString(const CSphVector<ESphAttr>& dAttrTypes)
+		{
+			if (dAttrTypes[0] == ESphAttr::SPH_ATTR_STRING)
+				return dAttrTypes[1] == ESphAttr::SPH_ATTR_STRING ? -1 : 0;
+			return dAttrTypes[1] == ESphAttr::SPH_ATTR_STRING ? 1 : -1;
+		}
+	};
+
+
 	template <class PRED>
 	class CSphGrouperMulti : public CSphGrouper, public PRED
 	{
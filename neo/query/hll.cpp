@@ -0,0 +1,397 @@
+#include "neo/query/hll.h"
+#include "neo/utility/string_tools.h"
+
+#include <cmath>
+#include <cassert>
+
+namespace NEO {
+
+	/// sparse entries are (index<<6)|rank at that precision; anything below it converts to dense exactly
+	static const int HLL_SPARSE_PRECISION = 25;
+	static const int HLL_SPARSE_RESERVE = 8;
+
+	struct HllHeader_t
+	{
+		DWORD	m_uSize;		///< whole blob size, in bytes
+		BYTE	m_uPrecision;
+		BYTE	m_uDense;
+		WORD	m_uReserved;
+		DWORD	m_uSparse;		///< sparse entries used (sparse form only)
+	};
+
+
+	static inline HllHeader_t* HllHeader(BYTE* pSketch)
+	{
+		return (HllHeader_t*)pSketch;
+	}
+
+
+	static inline const HllHeader_t* HllHeader(const BYTE* pSketch)
+	{
+		return (const HllHeader_t*)pSketch;
+	}
+
+
+	static inline DWORD* HllSparse(BYTE* pSketch)
+	{
+		return (DWORD*)(pSketch + sizeof(HllHeader_t));
+	}
+
+
+	static inline const DWORD* HllSparse(const BYTE* pSketch)
+	{
+		return (const DWORD*)(pSketch + sizeof(HllHeader_t));
+	}
+
+
+	static inline BYTE* HllRegisters(BYTE* pSketch)
+	{
+		return pSketch + sizeof(HllHeader_t);
+	}
+
+
+	static inline const BYTE* HllRegisters(const BYTE* pSketch)
+	{
+		return pSketch + sizeof(HllHeader_t);
+	}
+
+
+	static inline int HllSparseCapacity(const BYTE* pSketch)
+	{
+		return int((HllHeader(pSketch)->m_uSize - sizeof(HllHeader_t)) / sizeof(DWORD));
+	}
+
+
+	/// sparse list is converted once it takes more than half of the dense registers memory
+	static inline int HllSparseLimit(int iPrecision)
+	{
+		return Max((1 << iPrecision) / 8, HLL_SPARSE_RESERVE);
+	}
+
+
+	static inline DWORD HllSparseEntry(uint64_t uHash)
+	{
+		DWORD uIndex = DWORD(uHash >> (64 - HLL_SPARSE_PRECISION));
+		uint64_t uRest = uHash << HLL_SPARSE_PRECISION;
+		DWORD uRank = uRest ? DWORD(65 - sphLog2(uRest)) : DWORD(65 - HLL_SPARSE_PRECISION);
+		return (uIndex << 6) | uRank;
+	}
+
+
+	static inline void HllSetRegister(BYTE* pRegisters, DWORD uIndex, int iRank)
+	{
+		if (pRegisters[uIndex] < iRank)
+			pRegisters[uIndex] = (BYTE)iRank;
+	}
+
+
+	/// fold a sparse entry into dense registers; bits between the two precisions are the leading part of the dense rank
+	static inline void HllSetFromSparse(BYTE* pRegisters, int iPrecision, DWORD uEntry)
+	{
+		const int iShift = HLL_SPARSE_PRECISION - iPrecision;
+		DWORD uIndex = uEntry >> 6;
+		DWORD uMiddle = uIndex & ((1UL << iShift) - 1);
+		int iRank = uMiddle ? iShift - sphLog2(uMiddle) + 1 : iShift + int(uEntry & 63);
+		HllSetRegister(pRegisters, uIndex >> iShift, iRank);
+	}
+
+
+	static void HllToDense(BYTE*& pSketch)
+	{
+		const HllHeader_t* pOld = HllHeader(pSketch);
+		assert(!pOld->m_uDense);
+
+		int iRegisters = 1 << pOld->m_uPrecision;
+		DWORD uSize = sizeof(HllHeader_t) + iRegisters;
+		BYTE* pDense = new BYTE[uSize];
+
+		HllHeader_t* pNew = HllHeader(pDense);
+		pNew->m_uSize = uSize;
+		pNew->m_uPrecision = pOld->m_uPrecision;
+		pNew->m_uDense = 1;
+		pNew->m_uReserved = 0;
+		pNew->m_uSparse = 0;
+
+		BYTE* pRegisters = HllRegisters(pDense);
+		memset(pRegisters, 0, iRegisters);
+
+		const DWORD* pEntries = HllSparse((const BYTE*)pSketch);
+		for (DWORD i = 0; i < pOld->m_uSparse; i++)
+			HllSetFromSparse(pRegisters, pOld->m_uPrecision, pEntries[i]);
+
+		delete[] pSketch;
+		pSketch = pDense;
+	}
+
+
+	static void HllSparseInsert(BYTE*& pSketch, DWORD uEntry)
+	{
+		HllHeader_t* pHeader = HllHeader(pSketch);
+		DWORD* pEntries = HllSparse(pSketch);
+		DWORD uIndex = uEntry >> 6;
+
+		// lower bound by index
+		int iLo = 0;
+		int iHi = (int)pHeader->m_uSparse;
+		while (iLo < iHi)
+		{
+			int iMid = (iLo + iHi) / 2;
+			if ((pEntries[iMid] >> 6) < uIndex)
+				iLo = iMid + 1;
+			else
+				iHi = iMid;
+		}
+
+		if (iLo < (int)pHeader->m_uSparse && (pEntries[iLo] >> 6) == uIndex)
+		{
+			if ((pEntries[iLo] & 63) < (uEntry & 63))
+				pEntries[iLo] = uEntry;
+			return;
+		}
+
+		int iLimit = HllSparseLimit(pHeader->m_uPrecision);
+		if ((int)pHeader->m_uSparse >= iLimit)
+		{
+			HllToDense(pSketch);
+			HllSetFromSparse(HllRegisters(pSketch), HllHeader(pSketch)->m_uPrecision, uEntry);
+			return;
+		}
+
+		if ((int)pHeader->m_uSparse == HllSparseCapacity(pSketch))
+		{
+			int iCapacity = Min(2 * HllSparseCapacity(pSketch), iLimit);
+			DWORD uSize = DWORD(sizeof(HllHeader_t) + iCapacity * sizeof(DWORD));
+			BYTE* pGrown = new BYTE[uSize];
+			memcpy(pGrown, pSketch, sizeof(HllHeader_t) + pHeader->m_uSparse * sizeof(DWORD));
+			delete[] pSketch;
+
+			pSketch = pGrown;
+			pHeader = HllHeader(pSketch);
+			pHeader->m_uSize = uSize;
+			pEntries = HllSparse(pSketch);
+		}
+
+		memmove(pEntries + iLo + 1, pEntries + iLo, (pHeader->m_uSparse - iLo) * sizeof(DWORD));
+		pEntries[iLo] = uEntry;
+		pHeader->m_uSparse++;
+	}
+
+
+	static double HllSigma(double fX)
+	{
+		if (fX >= 1.0)
+			return HUGE_VAL;
+
+		double fY = 1.0;
+		double fZ = fX;
+		double fPrev;
+		do
+		{
+			fX *= fX;
+			fPrev = fZ;
+			fZ += fX * fY;
+			fY += fY;
+		} while (fZ != fPrev);
+		return fZ;
+	}
+
+
+	static double HllTau(double fX)
+	{
+		if (fX <= 0.0 || fX >= 1.0)
+			return 0.0;
+
+		double fY = 1.0;
+		double fZ = 1.0 - fX;
+		double fPrev;
+		do
+		{
+			fX = sqrt(fX);
+			fPrev = fZ;
+			fY *= 0.5;
+			fZ -= (1.0 - fX) * (1.0 - fX) * fY;
+		} while (fZ != fPrev);
+		return fZ / 3.0;
+	}
+
+
+	uint64_t sphHllHash(SphAttr_t uValue)
+	{
+		// murmur3 finalizer; a bijection, so distinct keys never collide here
+		uint64_t uHash = (uint64_t)uValue;
+		uHash ^= uHash >> 33;
+		uHash *= U64C(0xff51afd7ed558ccd);
+		uHash ^= uHash >> 33;
+		uHash *= U64C(0xc4ceb9fe1a85ec53);
+		uHash ^= uHash >> 33;
+		return uHash;
+	}
+
+
+	BYTE* sphHllCreate(int iPrecision)
+	{
+		iPrecision = Max(HLL_MIN_PRECISION, Min(iPrecision, HLL_MAX_PRECISION));
+
+		DWORD uSize = DWORD(sizeof(HllHeader_t) + HLL_SPARSE_RESERVE * sizeof(DWORD));
+		BYTE* pSketch = new BYTE[uSize];
+		HllHeader_t* pHeader = HllHeader(pSketch);
+		pHeader->m_uSize = uSize;
+		pHeader->m_uPrecision = (BYTE)iPrecision;
+		pHeader->m_uDense = 0;
+		pHeader->m_uReserved = 0;
+		pHeader->m_uSparse = 0;
+		return pSketch;
+	}
+
+
+	bool sphHllCheck(const BYTE* pSketch)
+	{
+		if (!pSketch)
+			return false;
+
+		const HllHeader_t* pHeader = HllHeader(pSketch);
+		if (pHeader->m_uSize < sizeof(HllHeader_t) || pHeader->m_uPrecision < HLL_MIN_PRECISION || pHeader->m_uPrecision > HLL_MAX_PRECISION)
+			return false;
+
+		if (pHeader->m_uDense)
+			return pHeader->m_uSize == sizeof(HllHeader_t) + (1UL << pHeader->m_uPrecision);
+
+		if ((int)pHeader->m_uSparse > HllSparseCapacity(pSketch))
+			return false;
+
+		// binary search relies on that
+		const DWORD* pEntries = HllSparse(pSketch);
+		for (DWORD i = 1; i < pHeader->m_uSparse; i++)
+			if ((pEntries[i - 1] >> 6) >= (pEntries[i] >> 6))
+				return false;
+
+		return true;
+	}
+
+
+	void sphHllAdd(BYTE*& pSketch, uint64_t uHash)
+	{
+		assert(pSketch);
+		const HllHeader_t* pHeader = HllHeader(pSketch);
+		if (!pHeader->m_uDense)
+		{
+			HllSparseInsert(pSketch, HllSparseEntry(uHash));
+			return;
+		}
+
+		int iPrecision = pHeader->m_uPrecision;
+		uint64_t uRest = uHash << iPrecision;
+		int iRank = uRest ? 65 - sphLog2(uRest) : 65 - iPrecision;
+		HllSetRegister(HllRegisters(pSketch), DWORD(uHash >> (64 - iPrecision)), iRank);
+	}
+
+
+	bool sphHllMerge(BYTE*& pSketch, const BYTE* pOther)
+	{
+		assert(pSketch);
+		if (!pOther)
+			return true;
+
+		const HllHeader_t* pSrc = HllHeader(pOther);
+		if (pSrc->m_uPrecision != HllHeader(pSketch)->m_uPrecision)
+			return false;
+
+		int iPrecision = pSrc->m_uPrecision;
+		if (pSrc->m_uDense)
+		{
+			if (!HllHeader(pSketch)->m_uDense)
+				HllToDense(pSketch);
+
+			BYTE* pDst = HllRegisters(pSketch);
+			const BYTE* pRegisters = HllRegisters(pOther);
+			for (int i = 0; i < (1 << iPrecision); i++)
+				if (pDst[i] < pRegisters[i])
+					pDst[i] = pRegisters[i];
+			return true;
+		}
+
+		const DWORD* pEntries = HllSparse(pOther);
+		if (HllHeader(pSketch)->m_uDense)
+		{
+			BYTE* pDst = HllRegisters(pSketch);
+			for (DWORD i = 0; i < pSrc->m_uSparse; i++)
+				HllSetFromSparse(pDst, iPrecision, pEntries[i]);
+			return true;
+		}
+
+		// both sparse; merge the sorted lists, then convert if that grew too much
+		const HllHeader_t* pHeader = HllHeader(pSketch);
+		const DWORD* pMine = HllSparse((const BYTE*)pSketch);
+		int iMine = (int)pHeader->m_uSparse;
+		int iTheirs = (int)pSrc->m_uSparse;
+
+		DWORD uSize = DWORD(sizeof(HllHeader_t) + Max(iMine + iTheirs, HLL_SPARSE_RESERVE) * sizeof(DWORD));
+		BYTE* pMerged = new BYTE[uSize];
+		memcpy(pMerged, pSketch, sizeof(HllHeader_t));
+		DWORD* pOut = HllSparse(pMerged);
+
+		int iOut = 0, i = 0, j = 0;
+		while (i < iMine || j < iTheirs)
+		{
+			if (j >= iTheirs || (i < iMine && (pMine[i] >> 6) < (pEntries[j] >> 6)))
+				pOut[iOut++] = pMine[i++];
+			else if (i >= iMine || (pEntries[j] >> 6) < (pMine[i] >> 6))
+				pOut[iOut++] = pEntries[j++];
+			else
+			{
+				pOut[iOut++] = Max(pMine[i], pEntries[j]); // same index, so that picks the higher rank
+				i++;
+				j++;
+			}
+		}
+
+		HllHeader_t* pNew = HllHeader(pMerged);
+		pNew->m_uSize = uSize;
+		pNew->m_uSparse = iOut;
+
+		delete[] pSketch;
+		pSketch = pMerged;
+
+		if (iOut > HllSparseLimit(iPrecision))
+			HllToDense(pSketch);
+		return true;
+	}
+
+
+	int64_t sphHllEstimate(const BYTE* pSketch)
+	{
+		if (!pSketch)
+			return 0;
+
+		const HllHeader_t* pHeader = HllHeader(pSketch);
+		if (!pHeader->m_uDense)
+		{
+			// linear counting over the 25-bit sparse registers; practically exact at sparse sizes
+			double fM = double(1 << HLL_SPARSE_PRECISION);
+			double fZeros = fM - pHeader->m_uSparse;
+			return (int64_t)floor(fM * log(fM / fZeros) + 0.5);
+		}
+
+		// register histogram; ranks go up to 65-precision
+		int iPrecision = pHeader->m_uPrecision;
+		int iRegisters = 1 << iPrecision;
+		const int iTop = 65 - iPrecision;
+		int dHist[66] = { 0 };
+
+		const BYTE* pRegisters = HllRegisters(pSketch);
+		for (int i = 0; i < iRegisters; i++)
+			dHist[Min((int)pRegisters[i], iTop)]++;
+
+		// improved raw estimator (Ertl, 2017); unlike the classic one, it is unbiased over the whole range
+		// so neither the empirical bias tables nor a linear counting switch are needed
+		double fM = double(iRegisters);
+		double fZ = fM * HllTau(1.0 - dHist[iTop] / fM);
+		for (int k = iTop - 1; k >= 1; k--)
+			fZ = 0.5 * (fZ + dHist[k]);
+		fZ += fM * HllSigma(dHist[0] / fM);
+
+		const double fAlpha = 0.5 / log(2.0);
+		return (int64_t)floor(fAlpha * fM * fM / fZ + 0.5);
+	}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "neo/int/types.h"
+
+namespace NEO {
+
+	/// HyperLogLog++ sketch for approximate COUNT(DISTINCT)
+	/// kept as a self-contained blob whose first DWORD is the blob size (just like packed factors),
+	/// so that it lives in a FACTORS-typed match attribute, gets copied and freed along with the match,
+	/// and travels from agents to master as is
+	///
+	/// small sketches keep a sorted list of (index,rank) pairs at 25-bit precision (the sparse form),
+	/// and switch to plain byte-per-register form once that list outgrows a fraction of the registers
+	/// sketches of the same precision merge losslessly, so partial per-index results can be combined anywhere
+	static const int	HLL_MIN_PRECISION = 4;
+	static const int	HLL_MAX_PRECISION = 18;
+	static const int	HLL_DEFAULT_PRECISION = 14;	///< 16K registers, about 0.8% standard error
+
+	/// hash a distinct value key; keys are expected to be distinct already (attribute values or string hashes), so a mixer is enough
+	uint64_t	sphHllHash(SphAttr_t uValue);
+
+	/// create an empty sketch; blob is allocated with new[], and freed with delete[]
+	BYTE*		sphHllCreate(int iPrecision);
+
+	/// check whether a blob (eg. one received from the network) looks like a valid sketch
+	bool		sphHllCheck(const BYTE* pSketch);
+
+	/// add a hashed value; the blob may get reallocated
+	void		sphHllAdd(BYTE*& pSketch, uint64_t uHash);
+
+	/// merge another sketch in; the blob may get reallocated; sketches of different precision are not merged
+	bool		sphHllMerge(BYTE*& pSketch, const BYTE* pOther);
+
+	/// estimate the number of distinct values added
+	int64_t		sphHllEstimate(const BYTE* pSketch);
+
+}
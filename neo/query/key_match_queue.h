@@ -0,0 +1,377 @@
+#pragma once
+#include "neo/query/match_queue.h"
+#include "neo/query/enums.h"
+#include "neo/tools/convert.h"
+
+namespace NEO {
+
+	/// heap sorter over normalized sort keys
+	/// every match gets its sort key extracted once, into a tuple of unsigned words where the bigger tuple is the better match;
+	/// the heap then moves slot indexes around and compares plain words, instead of swapping whole matches and going through
+	/// the attribute locators at every step, and a match that is worse than the current worst is rejected before it gets copied
+	/// only numeric keys (id, weight, integer and float attributes) can be normalized, see IsSupported()
+	template < bool NOTIFICATIONS >
+	class CSphKeyMatchQueue : public CSphMatchQueueTraits
+	{
+	public:
+		/// max key words, ie. sort-by attributes plus the implicit tie-breakers
+		static const int	MAX_KEYS = CSphMatchComparatorState::MAX_ATTRS + 2;
+
+		/// check whether the matches sorted by a given function and state can be keyed
+		static bool IsSupported(ESphSortFunc eFunc, const CSphMatchComparatorState& tState)
+		{
+			switch (eFunc)
+			{
+			case FUNC_REL_DESC:
+			case FUNC_EXPR:
+				return true;
+
+			case FUNC_ATTR_DESC:
+			case FUNC_ATTR_ASC:
+				return tState.m_eKeypart[0] != SPH_KEYPART_STRING && tState.m_eKeypart[0] != SPH_KEYPART_STRINGPTR;
+
+			case FUNC_GENERIC2:
+			case FUNC_GENERIC3:
+			case FUNC_GENERIC4:
+			case FUNC_GENERIC5:
+				for (int i = 0; i < GenericAttrs(eFunc); i++)
+					if (tState.m_eKeypart[i] == SPH_KEYPART_STRING || tState.m_eKeypart[i] == SPH_KEYPART_STRINGPTR)
+						return false;
+				return true;
+
+			default:
+				return false;
+			}
+		}
+
+	public:
+		/// ctor
+		CSphKeyMatchQueue(ESphSortFunc eFunc, int iSize, bool bUsesAttrs)
+			: CSphMatchQueueTraits(iSize, bUsesAttrs)
+			, m_eFunc(eFunc)
+			, m_iKeys(0)
+			, m_dHeap(iSize)
+			, m_dKeys(0)
+		{
+			if_const(NOTIFICATIONS)
+				m_dJustPopped.Reserve(1);
+
+			SetupKeys();
+			m_dKeys.Reset(iSize * m_iKeys);
+		}
+
+		/// check if this sorter does groupby
+		virtual bool IsGroupby() const
+		{
+			return false;
+		}
+
+		/// key parts come from the comparator state, so they have to follow it
+		virtual void SetState(const CSphMatchComparatorState& tState)
+		{
+			CSphMatchQueueTraits::SetState(tState);
+			SetupKeys();
+		}
+
+		virtual const CSphMatch* GetWorst() const
+		{
+			return m_iUsed ? m_pData + m_dHeap[0] : m_pData;
+		}
+
+		/// add entry to the queue
+		virtual bool Push(const CSphMatch& tEntry)
+		{
+			m_iTotal++;
+
+			if_const(NOTIFICATIONS)
+			{
+				m_iJustPushed = 0;
+				m_dJustPopped.Resize(0);
+			}
+
+			uint64_t dKey[MAX_KEYS];
+			ExtractKey(tEntry, dKey);
+
+			int iSlot;
+			if (m_iUsed == m_iSize)
+			{
+				// if it's not better than current worst, reject it before copying anything
+				iSlot = m_dHeap[0];
+				if (!KeyLess(GetKey(iSlot), dKey))
+					return true;
+
+				// replace the worst entry in place
+				if_const(NOTIFICATIONS)
+				{
+					if (m_dJustPopped.GetLength())
+						m_dJustPopped[0] = m_pData[iSlot].m_uDocID;
+					else
+						m_dJustPopped.Add(m_pData[iSlot].m_uDocID);
+				}
+
+				m_tSchema.FreeStringPtrs(m_pData + iSlot);
+				CloneToSlot(m_pData + iSlot, tEntry);
+				memcpy(GetKey(iSlot), dKey, m_iKeys * sizeof(uint64_t));
+				SiftDown(0);
+			}
+			else
+			{
+				// do add, and sift up if needed, so that worst (lesser) ones float to the top
+				iSlot = m_iUsed;
+				CloneToSlot(m_pData + iSlot, tEntry);
+				memcpy(GetKey(iSlot), dKey, m_iKeys * sizeof(uint64_t));
+
+				int iEntry = m_iUsed++;
+				while (iEntry)
+				{
+					int iParent = (iEntry - 1) >> 1;
+					if (!KeyLess(GetKey(iSlot), GetKey(m_dHeap[iParent])))
+						break;
+
+					m_dHeap[iEntry] = m_dHeap[iParent];
+					iEntry = iParent;
+				}
+				m_dHeap[iEntry] = iSlot;
+			}
+
+			if_const(NOTIFICATIONS)
+				m_iJustPushed = tEntry.m_uDocID;
+
+			return true;
+		}
+
+		/// add grouped entry (must not happen)
+		virtual bool PushGrouped(const CSphMatch&, bool)
+		{
+			assert(0);
+			return false;
+		}
+
+		/// store all entries into specified location in sorted order, and remove them from queue
+		int Flatten(CSphMatch* pTo, int iTag)
+		{
+			assert(m_iUsed >= 0);
+			pTo += m_iUsed;
+			int iCopied = m_iUsed;
+			while (m_iUsed > 0)
+			{
+				--pTo;
+				m_tSchema.FreeStringPtrs(pTo);
+				MoveOut(pTo, m_pData + m_dHeap[0]);
+				if (iTag >= 0)
+					pTo->m_iTag = iTag;
+
+				// slots are not reused until the queue is empty, so the freed one can just be dropped
+				if (--m_iUsed)
+				{
+					m_dHeap[0] = m_dHeap[m_iUsed];
+					SiftDown(0);
+				}
+			}
+			m_iTotal = 0;
+			return iCopied;
+		}
+
+		void Finalize(ISphMatchProcessor& tProcessor, bool bCallProcessInResultSetOrder)
+		{
+			if (!GetLength())
+				return;
+
+			if (!bCallProcessInResultSetOrder)
+			{
+				// just evaluate in slot order
+				for (int i = 0; i < m_iUsed; i++)
+					tProcessor.Process(m_pData + i);
+			}
+			else
+			{
+				// means final-stage calls will be evaluated
+				// a) over the final, pre-limit result set
+				// b) in the final result set order
+				CSphFixedVector<int> dIndexes(GetLength());
+				ARRAY_FOREACH(i, dIndexes)
+					dIndexes[i] = i;
+				sphSort(dIndexes.Begin(), dIndexes.GetLength(), CompareKey_fn(this));
+
+				ARRAY_FOREACH(i, dIndexes)
+				{
+					tProcessor.Process(m_pData + dIndexes[i]);
+				}
+			}
+		}
+
+	protected:
+		/// key word kinds
+		enum KeyKind_e
+		{
+			KEY_ID,
+			KEY_WEIGHT,
+			KEY_INT,
+			KEY_FLOAT
+		};
+
+		struct KeyPart_t
+		{
+			KeyKind_e		m_eKind;
+			CSphAttrLocator	m_tLocator;
+			bool			m_bDesc;	///< bigger values are better
+		};
+
+		const ESphSortFunc			m_eFunc;
+		KeyPart_t					m_dParts[MAX_KEYS];
+		int							m_iKeys;
+		CSphFixedVector<int>		m_dHeap;	///< binary heap of slots, worst on top
+		CSphFixedVector<uint64_t>	m_dKeys;	///< m_iKeys words per slot
+
+		/// sorts best first, as the comparator-based queue does
+		struct CompareKey_fn
+		{
+			const CSphKeyMatchQueue* m_pQueue;
+
+			explicit CompareKey_fn(const CSphKeyMatchQueue* pQueue)
+				: m_pQueue(pQueue)
+			{}
+
+			bool IsLess(int a, int b) const
+			{
+				return m_pQueue->KeyLess(m_pQueue->GetKey(b), m_pQueue->GetKey(a));
+			}
+		};
+
+		static int GenericAttrs(ESphSortFunc eFunc)
+		{
+			return 2 + (eFunc - FUNC_GENERIC2);
+		}
+
+		inline uint64_t* GetKey(int iSlot)
+		{
+			return m_dKeys.Begin() + iSlot * m_iKeys;
+		}
+
+		inline const uint64_t* GetKey(int iSlot) const
+		{
+			return m_dKeys.Begin() + iSlot * m_iKeys;
+		}
+
+		/// lexicographic tuple comparison; the leading word decides almost always
+		inline bool KeyLess(const uint64_t* a, const uint64_t* b) const
+		{
+			if (a[0] != b[0])
+				return a[0] < b[0];
+			for (int i = 1; i < m_iKeys; i++)
+				if (a[i] != b[i])
+					return a[i] < b[i];
+			return false;
+		}
+
+		void AddPart(KeyKind_e eKind, int iAttr, bool bDesc)
+		{
+			assert(m_iKeys < MAX_KEYS);
+			KeyPart_t& tPart = m_dParts[m_iKeys++];
+			tPart.m_eKind = eKind;
+			if (iAttr >= 0)
+				tPart.m_tLocator = m_tState.m_tLocator[iAttr];
+			tPart.m_bDesc = bDesc;
+		}
+
+		/// mirror the comparator of a given sort function, part by part, see MatchAttrLt_fn and friends
+		void SetupKeys()
+		{
+			m_iKeys = 0;
+			switch (m_eFunc)
+			{
+			case FUNC_REL_DESC:
+				AddPart(KEY_WEIGHT, -1, true);
+				break;
+
+			case FUNC_ATTR_DESC:
+			case FUNC_ATTR_ASC:
+				// these compare raw attribute values, even for floats
+				AddPart(KEY_INT, 0, m_eFunc == FUNC_ATTR_DESC);
+				AddPart(KEY_WEIGHT, -1, true);
+				break;
+
+			case FUNC_EXPR:
+				AddPart(KEY_FLOAT, 0, true);
+				break;
+
+			default:
+				for (int i = 0; i < GenericAttrs(m_eFunc); i++)
+				{
+					bool bDesc = ((m_tState.m_uAttrDesc >> i) & 1) != 0;
+					switch (m_tState.m_eKeypart[i])
+					{
+					case SPH_KEYPART_ID:		AddPart(KEY_ID, -1, bDesc); break;
+					case SPH_KEYPART_WEIGHT:	AddPart(KEY_WEIGHT, -1, bDesc); break;
+					case SPH_KEYPART_FLOAT:		AddPart(KEY_FLOAT, i, bDesc); break;
+					default:					AddPart(KEY_INT, i, bDesc); break;
+					}
+				}
+				break;
+			}
+
+			// lesser id wins the ties
+			AddPart(KEY_ID, -1, false);
+		}
+
+		/// map every key part to an unsigned word that orders the same way, and flip the ascending ones
+		inline void ExtractKey(const CSphMatch& tMatch, uint64_t* pKey) const
+		{
+			for (int i = 0; i < m_iKeys; i++)
+			{
+				const KeyPart_t& tPart = m_dParts[i];
+				uint64_t uKey;
+				switch (tPart.m_eKind)
+				{
+				case KEY_ID:
+					uKey = (uint64_t)tMatch.m_uDocID;
+					break;
+
+				case KEY_WEIGHT:
+					uKey = (uint64_t)(int64_t)tMatch.m_iWeight ^ U64C(0x8000000000000000);
+					break;
+
+				case KEY_INT:
+					uKey = (uint64_t)tMatch.GetAttr(tPart.m_tLocator) ^ U64C(0x8000000000000000);
+					break;
+
+				default:
+				{
+					float fValue = tMatch.GetAttrFloat(tPart.m_tLocator);
+					if (fValue == 0.0f)
+						fValue = 0.0f; // -0 and +0 compare equal
+					DWORD uValue = sphF2DW(fValue);
+					uKey = (uValue & 0x80000000UL) ? (~uValue & 0xffffffffUL) : (uValue | 0x80000000UL);
+					break;
+				}
+				}
+
+				pKey[i] = tPart.m_bDesc ? uKey : ~uKey;
+			}
+		}
+
+		void SiftDown(int iEntry)
+		{
+			int iSlot = m_dHeap[iEntry];
+			for (;; )
+			{
+				// select smallest child
+				int iChild = (iEntry << 1) + 1;
+				if (iChild >= m_iUsed)
+					break;
+
+				if (iChild + 1 < m_iUsed && KeyLess(GetKey(m_dHeap[iChild + 1]), GetKey(m_dHeap[iChild])))
+					iChild++;
+
+				// if smallest child is less than entry, do float it to the top
+				if (!KeyLess(GetKey(m_dHeap[iChild]), GetKey(iSlot)))
+					break;
+
+				m_dHeap[iEntry] = m_dHeap[iChild];
+				iEntry = iChild;
+			}
+			m_dHeap[iEntry] = iSlot;
+		}
+	};
+
+}
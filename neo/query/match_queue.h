@@ -1,6 +1,7 @@
 #pragma once
 #include "neo/query/match_sorter.h"
 #include "neo/core/match_engine.h"
+#include "neo/core/match_arena.h"
 
 namespace NEO {
 
@@ -31,6 +32,7 @@ namespace NEO {
 		int							m_iUsed;
 		int							m_iSize;
 		const bool					m_bUsesAttrs;
+		CSphMatchArena				m_tArena;		///< dynamic rows of my matches
 
 	private:
 		const int					m_iDataLength;
@@ -56,6 +58,7 @@ namespace NEO {
 		{
 			for (int i = 0; i < m_iDataLength; ++i)
 				m_tSchema.FreeStringPtrs(m_pData + i);
+			m_tArena.Detach(m_pData, m_iDataLength);
 			SafeDeleteArray(m_pData);
 		}
 
@@ -63,11 +66,42 @@ namespace NEO {
 		bool				UsesAttrs() const { return m_bUsesAttrs; }
 		virtual int			GetLength() const { return m_iUsed; }
 		virtual int			GetDataLength() const { return m_iDataLength; }
+		virtual int64_t		GetArenaBytes() const { return m_tArena.GetBytes(); }
 
 		virtual bool CanMulti() const
 		{
 			return !HasString(&m_tState);
 		}
+
+	protected:
+		/// clone into a match of my own, taking its dynamic row from the arena if it has none yet
+		inline void CloneToSlot(CSphMatch* pSlot, const CSphMatch& tEntry)
+		{
+			if (!pSlot->m_pDynamic && m_tSchema.GetDynamicSize())
+				pSlot->m_pDynamic = m_tArena.Alloc(m_tSchema.GetDynamicSize());
+			m_tSchema.CloneMatch(pSlot, tEntry);
+		}
+
+		/// hand a match of mine over (pTo strings must be freed already)
+		/// arena rows have to stay with the sorter, so those get copied out, along with the strings they own
+		void MoveOut(CSphMatch* pTo, CSphMatch* pFrom)
+		{
+			if (!pFrom->m_pDynamic || !m_tArena.Owns(pFrom->m_pDynamic))
+			{
+				Swap(*pTo, *pFrom);
+				return;
+			}
+
+			int iDynamic = m_tSchema.GetDynamicSize();
+			pTo->Reset(iDynamic);
+			memcpy(pTo->m_pDynamic, pFrom->m_pDynamic, iDynamic * sizeof(CSphRowitem));
+			memset(pFrom->m_pDynamic, 0, iDynamic * sizeof(CSphRowitem));
+
+			pTo->m_uDocID = pFrom->m_uDocID;
+			pTo->m_pStatic = pFrom->m_pStatic;
+			pTo->m_iWeight = pFrom->m_iWeight;
+			pTo->m_iTag = pFrom->m_iTag;
+		}
 	};
 
 	//////////////////////////////////////////////////////////////////////////
@@ -137,7 +171,7 @@ namespace NEO {
 			}
 
 			// do add
-			m_tSchema.CloneMatch(m_pData + m_iUsed, tEntry);
+			CloneToSlot(m_pData + m_iUsed, tEntry);
 
 			if_const(NOTIFICATIONS)
 				m_iJustPushed = tEntry.m_uDocID;
@@ -221,7 +255,7 @@ namespace NEO {
 			{
 				--pTo;
 				m_tSchema.FreeStringPtrs(pTo);
-				Swap(*pTo, *m_pData);
+				MoveOut(pTo, m_pData);
 				if (iTag >= 0)
 					pTo->m_iTag = iTag;
 				Pop();
@@ -332,7 +366,7 @@ namespace NEO {
 			// fill the data, back to front
 			m_bFinalized = false;
 			m_iUsed++;
-			m_tSchema.CloneMatch(m_pEnd - m_iUsed, tEntry);
+			CloneToSlot(m_pEnd - m_iUsed, tEntry);
 
 			if_const(NOTIFICATIONS)
 				m_iJustPushed = tEntry.m_uDocID;
@@ -419,7 +453,7 @@ namespace NEO {
 			for (int i = 1; i <= Min(m_iUsed, m_iSize); i++)
 			{
 				m_tSchema.FreeStringPtrs(pTo);
-				Swap(*pTo, m_pEnd[-i]);
+				MoveOut(pTo, m_pEnd - i);
 				if (iTag >= 0)
 					pTo->m_iTag = iTag;
 				pTo++;
@@ -1,4 +1,5 @@
 #include "neo/query/match_sorter.h"
+#include "neo/tools/utf8_tools.h"
 
 namespace NEO {
 
@@ -8,4 +9,19 @@ namespace NEO {
 		m_tState.m_iNow = (DWORD)time(NULL);
 	}
 
+
+	void ISphMatchSorter::SetStringDict(const CSphStringDict* pDict)
+	{
+		// pointer order only matches value order under binary collation
+		if (pDict && !pDict->IsEmpty() && m_tState.m_fnStrCmp == sphCollateBinary)
+		{
+			m_tState.m_pStrDictBegin = pDict->GetPool() + 1;
+			m_tState.m_pStrDictEnd = pDict->GetPool() + pDict->GetEnd();
+		}
+		else
+		{
+			m_tState.m_pStrDictBegin = m_tState.m_pStrDictEnd = NULL;
+		}
+	}
+
 }
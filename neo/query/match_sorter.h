@@ -2,6 +2,7 @@
 #include "neo/query/enums.h"
 #include "neo/core/match.h"
 #include "neo/source/schema.h"
+#include "neo/core/string_dict.h"
 
 namespace NEO {
 
@@ -10,6 +11,7 @@ namespace NEO {
 	struct ISphExpr;
 	struct ISphMatchProcessor;
 	struct CSphMatchComparatorState;
+	class CSphGrouper;
 
 	/// JSON key lookup stuff
 	struct JsonKey_t
@@ -22,8 +24,6 @@ namespace NEO {
 		explicit JsonKey_t(const char* sKey, int iLen);
 	};
 
-	typedef int (*SphStringCmp_fn)(const BYTE* pStr1, const BYTE* pStr2, bool bPacked);
-
 
 	/// match comparator state
 	struct CSphMatchComparatorState
@@ -40,6 +40,8 @@ namespace NEO {
 		DWORD				m_uAttrDesc;				///< sort order mask (if i-th bit is set, i-th attr order is DESC)
 		DWORD				m_iNow;						///< timestamp (for timesegments sorting mode)
 		SphStringCmp_fn		m_fnStrCmp;					///< string comparator
+		const BYTE*			m_pStrDictBegin;			///< string dictionary region, where pointer order is value order (binary collation only)
+		const BYTE*			m_pStrDictEnd;
 
 
 		/// create default empty state
@@ -47,6 +49,8 @@ namespace NEO {
 			: m_uAttrDesc(0)
 			, m_iNow(0)
 			, m_fnStrCmp(NULL)
+			, m_pStrDictBegin(NULL)
+			, m_pStrDictEnd(NULL)
 		{
 			for (int i = 0; i < MAX_ATTRS; i++)
 			{
@@ -80,6 +84,12 @@ namespace NEO {
 					return -1;
 				return 1;
 			}
+
+			// both values are dictionary entries, compare codes
+			if (aa >= m_pStrDictBegin && aa < m_pStrDictEnd && bb >= m_pStrDictBegin && bb < m_pStrDictEnd
+				&& m_eKeypart[iAttr] == SPH_KEYPART_STRING)
+				return (aa < bb) ? -1 : (aa > bb ? 1 : 0);
+
 			return m_fnStrCmp(aa, bb, (m_eKeypart[iAttr] == SPH_KEYPART_STRING));
 		}
 	};
@@ -132,6 +142,9 @@ namespace NEO {
 		/// set string pool pointer (for string+groupby sorters)
 		virtual void		SetStringPool(const BYTE*) {}
 
+		/// set string attribute dictionary of the current string pool
+		virtual void		SetStringDict(const CSphStringDict* pDict);
+
 		/// set sorter schema by swapping in and (optionally) adjusting the argument
 		virtual void		SetSchema(CSphRsetSchema& tSchema) { m_tSchema = tSchema; }
 
@@ -166,6 +179,15 @@ namespace NEO {
 
 		/// get a pointer to the worst element, NULL if there is no fixed location
 		virtual const CSphMatch* GetWorst() const { return NULL; }
+
+		/// get the group key calculator, if the sorter can take pre-grouped matches that only carry @groupby and @count (see CSphFacetSorter)
+		virtual const CSphGrouper* GetFacetGrouper() const { return NULL; }
+
+		/// get the group key calculator, if the sorter can take pre-grouped matches with their aggregates (see CSphRollupQuery)
+		virtual const CSphGrouper* GetGrouper() const { return NULL; }
+
+		/// get memory taken by the dynamic rows of the matches this sorter keeps
+		virtual int64_t		GetArenaBytes() const { return 0; }
 	};
 
 }
\ No newline at end of file
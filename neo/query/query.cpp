@@ -52,6 +52,10 @@ namespace NEO {
 		, m_iSQLSelectStart(-1)
 		, m_iSQLSelectEnd(-1)
 		, m_iGroupbyLimit(1)
+		, m_bGroupbyExact(false)
+		, m_iGroupbyMemory(0)
+		, m_iDistinctApprox(0)
+		, m_bStream(false)
 
 		, m_eCollation(SPH_COLLATION_DEFAULT)
 		, m_bAgent(false)
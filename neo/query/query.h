@@ -133,6 +133,10 @@ namespace NEO {
 		int				m_iSQLSelectEnd;	///< SQL parser helper
 
 		int				m_iGroupbyLimit;	///< number of elems within group
+		bool			m_bGroupbyExact;	///< aggregate every group (spilling to disk if needed), not just the k-buffer
+		int64_t			m_iGroupbyMemory;	///< memory budget for exact group-by, in bytes (0 means searchd default)
+		int				m_iDistinctApprox;	///< HyperLogLog precision for approximate count(distinct) (0 means exact)
+		bool			m_bStream;			///< send matches to the client as the index yields them, instead of sorting and buffering
 
 	public:
 		CSphVector<CSphQueryItem>	m_dItems;		///< parsed select-list
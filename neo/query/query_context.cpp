@@ -236,6 +236,7 @@ namespace NEO {
 		m_pLocalDocs = NULL;
 		m_iTotalDocs = 0;
 		m_iBadRows = 0;
+		m_pStringDict = NULL;
 	}
 
 	CSphQueryContext::~CSphQueryContext()
@@ -459,7 +460,7 @@ namespace NEO {
 					pFilterSettings = &tUservar;
 				}
 
-				ISphFilter* pFilter = sphCreateFilter(*pFilterSettings, tSchema, pMvaPool, pStrings, sError, sWarning, eCollation, bArenaProhibit);
+				ISphFilter* pFilter = sphCreateFilter(*pFilterSettings, tSchema, pMvaPool, pStrings, sError, sWarning, eCollation, bArenaProhibit, m_pStringDict, &m_tJsonPaths);
 				if (!pFilter)
 					return false;
 
@@ -8,6 +8,7 @@
 #include "neo/query/match_sorter.h"
 #include "neo/core/kill_list_trait.h"
 #include "neo/core/ranker.h"
+#include "neo/sphinx/xfilter.h"
 
 namespace NEO {
 
@@ -59,6 +60,8 @@ namespace NEO {
 		const SmallStringHash_T<int64_t>* m_pLocalDocs;
 		int64_t									m_iTotalDocs;
 		int64_t									m_iBadRows;
+		const CSphStringDict* m_pStringDict;		///< string attribute dictionary for filters (disk index only)
+		CSphJsonPathCache						m_tJsonPaths;			///< JSON path expressions shared between filters
 
 	public:
 		explicit CSphQueryContext(const CSphQuery& q);
@@ -54,6 +54,7 @@ namespace NEO {
 		, m_iAgentFetchedSkips(0)
 		, m_bHasPrediction(false)
 		, m_iBadRows(0)
+		, m_iArenaBytes(0)
 	{
 	}
 
@@ -48,6 +48,7 @@ namespace NEO {
 		CSphString				m_sError;			///< error message
 		CSphString				m_sWarning;			///< warning message
 		int64_t					m_iBadRows;
+		int64_t					m_iArenaBytes;		///< dynamic row arenas of the sorters
 
 		CSphQueryResultMeta();													///< ctor
 		virtual					~CSphQueryResultMeta() {}						///< dtor
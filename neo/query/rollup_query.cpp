@@ -0,0 +1,180 @@
+#include "neo/query/rollup_query.h"
+#include "neo/query/query.h"
+#include "neo/sphinx/xfilter.h"
+#include "neo/sphinx/xutility.h"
+#include "neo/tools/docinfo_transformer.h"
+
+namespace NEO {
+
+	CSphRollupQuery::CSphRollupQuery()
+		: m_pGrouper(NULL)
+	{}
+
+
+	int CSphRollupQuery::Setup(const CSphVector<CSphRollup*>& dRollups, const CSphQuery& tQuery, const ISphMatchSorter* pSorter)
+	{
+		if (!dRollups.GetLength() || !pSorter || pSorter->m_bRandomize)
+			return -1;
+
+		// plain group-by over attributes, with nothing that needs the actual rows
+		if (tQuery.m_sGroupBy.IsEmpty() || (tQuery.m_eGroupFunc != SPH_GROUPBY_ATTR && tQuery.m_eGroupFunc != SPH_GROUPBY_MULTIPLE))
+			return -1;
+
+		if (!tQuery.m_sGroupDistinct.IsEmpty() || tQuery.m_iCutoff > 0 || tQuery.m_dOverrides.GetLength() || tQuery.m_eSort == SPH_SORT_EXPR)
+			return -1;
+
+		m_pGrouper = pSorter->GetGrouper();
+		if (!m_pGrouper)
+			return -1;
+
+		const ISphSchema& tSchema = pSorter->GetSchema();
+		int iGroupby = tSchema.GetAttrIndex("@groupby");
+		int iCount = tSchema.GetAttrIndex("@count");
+		if (iGroupby < 0 || iCount < 0)
+			return -1;
+
+		m_tLocGroupby = tSchema.GetAttr(iGroupby).m_tLocator;
+		m_tLocCount = tSchema.GetAttr(iCount).m_tLocator;
+
+		ARRAY_FOREACH(i, dRollups)
+			if (Bind(*dRollups[i], tQuery, tSchema))
+				return i;
+
+		return -1;
+	}
+
+
+	bool CSphRollupQuery::Bind(const CSphRollup& tRollup, const CSphQuery& tQuery, const ISphSchema& tSchema)
+	{
+		m_dOutputs.Resize(0);
+
+		CSphVector<CSphString> dGroupBy;
+		sphSplit(dGroupBy, tQuery.m_sGroupBy.cstr(), ",");
+		ARRAY_FOREACH(i, dGroupBy)
+		{
+			dGroupBy[i].Trim();
+			if (tRollup.GetDimension(dGroupBy[i].cstr()) < 0)
+				return false;
+		}
+
+		// filters can only reject whole cells
+		ARRAY_FOREACH(i, tQuery.m_dFilters)
+		{
+			const CSphFilterSettings& tFilter = tQuery.m_dFilters[i];
+			if ((tFilter.m_eType != SPH_FILTER_VALUES && tFilter.m_eType != SPH_FILTER_RANGE) || tRollup.GetDimension(tFilter.m_sAttrName.cstr()) < 0)
+				return false;
+		}
+
+		// cells only know their dimensions and totals
+		ARRAY_FOREACH(i, tQuery.m_dItems)
+		{
+			const CSphQueryItem& tItem = tQuery.m_dItems[i];
+			const CSphString& sExpr = tItem.m_sExpr;
+
+			if (tItem.m_eAggrFunc == SPH_AGGR_NONE)
+			{
+				if (IsCount(sExpr) || (IsGroupby(sExpr) && sExpr != "@distinct"))
+					continue;
+
+				if (tRollup.GetDimension(sExpr.cstr()) >= 0 && (tItem.m_sAlias.IsEmpty() || tItem.m_sAlias == sExpr))
+					continue;
+
+				return false;
+			}
+
+			int iMeasure = tRollup.GetMeasure(sExpr.cstr());
+			if (iMeasure < 0 || (tItem.m_eAggrFunc != SPH_AGGR_SUM && tItem.m_eAggrFunc != SPH_AGGR_AVG))
+				return false;
+
+			const CSphColumnInfo* pCol = tSchema.GetAttr(tItem.m_sAlias.cstr());
+			if (!pCol || !pCol->m_tLocator.m_bDynamic)
+				return false;
+
+			Output_t& tOut = m_dOutputs.Add();
+			tOut.m_sAlias = tItem.m_sAlias;
+			tOut.m_tLocator = pCol->m_tLocator;
+			tOut.m_bFloat = (pCol->m_eAttrType == ESphAttr::SPH_ATTR_FLOAT);
+			tOut.m_bAvg = (tItem.m_eAggrFunc == SPH_AGGR_AVG);
+			tOut.m_iMeasure = iMeasure;
+		}
+
+		// the group sort and the in-group sort pick rows and order groups by whatever they name
+		if (tQuery.m_eSort != SPH_SORT_RELEVANCE && !CheckSortClause(tRollup, tQuery.m_sSortBy))
+			return false;
+
+		return CheckSortClause(tRollup, tQuery.m_sGroupSortBy);
+	}
+
+
+	bool CSphRollupQuery::CheckSortClause(const CSphRollup& tRollup, const CSphString& sClause) const
+	{
+		CSphVector<CSphString> dTokens;
+		sphSplit(dTokens, sClause.cstr(), ", \t");
+		ARRAY_FOREACH(i, dTokens)
+		{
+			const CSphString& sToken = dTokens[i];
+			if (sToken.IsEmpty() || !strcasecmp(sToken.cstr(), "asc") || !strcasecmp(sToken.cstr(), "desc"))
+				continue;
+
+			if (IsCount(sToken) || (IsGroupby(sToken) && sToken != "@distinct") || tRollup.GetDimension(sToken.cstr()) >= 0)
+				continue;
+
+			if (sToken == "@weight" || sToken == "weight()" || sToken == "@relevance" || sToken == "@rank" || sToken == "@id" || sToken == "id")
+				continue;
+
+			bool bOutput = false;
+			ARRAY_FOREACH(j, m_dOutputs)
+				bOutput |= (m_dOutputs[j].m_sAlias == sToken);
+			if (!bOutput)
+				return false;
+		}
+		return true;
+	}
+
+
+	int CSphRollupQuery::Push(const CSphRollup& tRollup, const CSphVector<CSphRollup::Total_t>* pTotals, const ISphFilter* pFilter,
+		ISphMatchSorter* pSorter, CSphMatch& tMatch) const
+	{
+		assert(m_pGrouper);
+		const CSphVector<CSphRollup::Total_t>& dTotals = pTotals ? *pTotals : tRollup.GetTotals();
+		const int iStride = tRollup.GetTotalsStride();
+
+		int iPushed = 0;
+		for (int iCell = 0; iCell < tRollup.GetCells(); iCell++)
+		{
+			const CSphRollup::Total_t* pCell = dTotals.Begin() + iCell * iStride;
+			int64_t iCount = pCell[0].m_iValue;
+			if (iCount <= 0)
+				continue;
+
+			const CSphRowitem* pDocinfo = tRollup.GetDocinfo(iCell);
+			tMatch.m_uDocID = DOCINFO2ID(pDocinfo);
+			tMatch.m_pStatic = DOCINFO2ATTRS(pDocinfo);
+			if (pFilter && !pFilter->Eval(tMatch))
+				continue;
+
+			tMatch.SetAttr(m_tLocGroupby, m_pGrouper->KeyFromMatch(tMatch));
+			tMatch.SetAttr(m_tLocCount, iCount);
+
+			ARRAY_FOREACH(i, m_dOutputs)
+			{
+				const Output_t& tOut = m_dOutputs[i];
+				const CSphRollup::Total_t& tSum = pCell[tOut.m_iMeasure + 1];
+				bool bFloatSum = tRollup.IsFloatMeasure(tOut.m_iMeasure);
+
+				// grouped AVG() takes the average, and weighs it by @count
+				if (tOut.m_bAvg)
+					tMatch.SetAttrFloat(tOut.m_tLocator, float((bFloatSum ? tSum.m_fValue : double(tSum.m_iValue)) / double(iCount)));
+				else if (tOut.m_bFloat)
+					tMatch.SetAttrFloat(tOut.m_tLocator, float(bFloatSum ? tSum.m_fValue : double(tSum.m_iValue)));
+				else
+					tMatch.SetAttr(tOut.m_tLocator, bFloatSum ? SphAttr_t(tSum.m_fValue) : tSum.m_iValue);
+			}
+
+			pSorter->PushGrouped(tMatch, iPushed == 0);
+			iPushed++;
+		}
+		return iPushed;
+	}
+
+}
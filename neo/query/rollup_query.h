@@ -0,0 +1,49 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/core/rollup.h"
+#include "neo/query/match_sorter.h"
+#include "neo/query/grouper.h"
+
+namespace NEO {
+
+	class CSphQuery;
+	struct ISphFilter;
+
+	/// answers a full-scan group-by from rollup cells
+	/// a query binds to a rollup when everything it groups, filters, selects, and sorts on is either a rollup dimension,
+	/// COUNT(*), or SUM() and AVG() over a rollup measure; cells that pass the filters then go to the sorter pre-grouped,
+	/// so ordering, limits, and HAVING stay with the sorter
+	class CSphRollupQuery
+	{
+	public:
+		CSphRollupQuery();
+
+		/// pick a rollup that can answer a query; returns its index among the given ones, or -1
+		int			Setup(const CSphVector<CSphRollup*>& dRollups, const CSphQuery& tQuery, const ISphMatchSorter* pSorter);
+
+		/// push the cells that pass the filter (if any) into the sorter; returns the number of cells pushed
+		/// totals default to the rollup own ones; cells with no rows left (eg. after kill-list subtraction) are skipped
+		int			Push(const CSphRollup& tRollup, const CSphVector<CSphRollup::Total_t>* pTotals, const ISphFilter* pFilter,
+						ISphMatchSorter* pSorter, CSphMatch& tMatch) const;
+
+	protected:
+		/// SUM() or AVG() column
+		struct Output_t
+		{
+			CSphString			m_sAlias;
+			CSphAttrLocator		m_tLocator;
+			bool				m_bFloat;		///< column is a float (otherwise, an integer)
+			bool				m_bAvg;
+			int					m_iMeasure;
+		};
+
+		const CSphGrouper*		m_pGrouper;
+		CSphAttrLocator			m_tLocGroupby;
+		CSphAttrLocator			m_tLocCount;
+		CSphVector<Output_t>	m_dOutputs;
+
+		bool		Bind(const CSphRollup& tRollup, const CSphQuery& tQuery, const ISphSchema& tSchema);
+		bool		CheckSortClause(const CSphRollup& tRollup, const CSphString& sClause) const;
+	};
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "neo/query/match_queue.h"
+#include "neo/index/queue_settings.h"
+
+namespace NEO {
+
+	/// pass-through queue for streamed queries
+	/// keeps no matches; every one that makes it past the offset goes right to the stream, in whatever order the index yields them,
+	/// until the limit is reached; the caller is expected to stop the search there (eg. with a cutoff)
+	class CSphStreamQueue : public CSphMatchQueueTraits
+	{
+	public:
+		/// ctor
+		CSphStreamQueue(ISphMatchStream* pStream, int iOffset, int iLimit)
+			: CSphMatchQueueTraits(1, true)
+			, m_pStream(pStream)
+			, m_iOffset(iOffset)
+			, m_iLimit(iLimit)
+			, m_iSent(0)
+			, m_bStopped(false)
+		{
+			assert(m_pStream);
+		}
+
+		/// check if this sorter does groupby
+		virtual bool IsGroupby() const
+		{
+			return false;
+		}
+
+		/// streamed matches need the pools of the index they come from
+		virtual void SetMVAPool(const DWORD* pMva, bool bArenaProhibit)
+		{
+			m_tPools.m_pMva = pMva;
+			m_tPools.m_bArenaProhibit = bArenaProhibit;
+		}
+
+		virtual void SetStringPool(const BYTE* pStrings)
+		{
+			m_tPools.m_pStrings = pStrings;
+		}
+
+		/// add entry to the queue
+		virtual bool Push(const CSphMatch& tEntry)
+		{
+			if (m_iTotal++ < m_iOffset || m_bStopped || m_iSent >= m_iLimit)
+				return true;
+
+			m_iSent++;
+			m_bStopped = !m_pStream->PushMatch(tEntry, m_tPools);
+			return true;
+		}
+
+		/// add grouped entry (must not happen)
+		virtual bool PushGrouped(const CSphMatch&, bool)
+		{
+			assert(0);
+			return false;
+		}
+
+		/// nothing is kept, so nothing is left to flatten
+		int Flatten(CSphMatch*, int)
+		{
+			m_iTotal = 0;
+			return 0;
+		}
+
+		virtual void Finalize(ISphMatchProcessor&, bool)
+		{}
+
+		/// matches sent so far
+		int GetSent() const
+		{
+			return m_iSent;
+		}
+
+	protected:
+		ISphMatchStream*	m_pStream;
+		const int			m_iOffset;
+		const int			m_iLimit;
+		int					m_iSent;
+		bool				m_bStopped;		///< the stream could take no more
+		PoolPtrs_t			m_tPools;
+	};
+
+}
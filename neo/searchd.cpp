@@ -23,6 +23,8 @@
 #include "sphinxplugin.h"
 #include "sphinxqcache.h"
 #include "sphinxrlp.h"
+#include "neo/query/hll.h"
+#include "neo/query/facet_sorter.h"
 
 extern "C"
 {
@@ -349,6 +351,7 @@ static SphThread_t							g_tOptimizeThread;
 static CSphMutex							g_tOptimizeQueueMutex;
 static CSphVector<CSphString>				g_dOptimizeQueue;
 static ThrottleState_t						g_tRtThrottle;
+static int									g_iRtCompactInterval = 60;	// in seconds; 0 means "do not compact automatically"
 
 static CSphMutex							g_tDistLock;
 static CSphMutex							g_tPersLock;
@@ -358,7 +361,7 @@ static CSphAtomic							g_iPersistentInUse;
 /// master-agent API protocol extensions version
 enum
 {
-	VER_MASTER = 14
+	VER_MASTER = 15
 };
 
 
@@ -3075,6 +3078,7 @@ int SearchRequestBuilder_t::CalcQueryLen ( const char * sIndexes, const CSphQuer
 		iReqSize += 4; // outer limit
 	if ( q.m_iMaxPredictedMsec>0 )
 		iReqSize += 4;
+	iReqSize += 4; // int distinct-approx
 	return iReqSize;
 }
 
@@ -3264,6 +3268,7 @@ void SearchRequestBuilder_t::SendQuery ( const char * sIndexes, NetOutputBuffer_
 	tOut.SendString ( q.m_sQueryTokenFilterLib.cstr() );
 	tOut.SendString ( q.m_sQueryTokenFilterName.cstr() );
 	tOut.SendString ( q.m_sQueryTokenFilterOpts.cstr() );
+	tOut.SendInt ( q.m_iDistinctApprox ); // v.15
 }
 
 
@@ -3414,10 +3419,17 @@ bool SearchReplyParser_t::ParseReply ( MemInputBuffer_c & tReq, AgentConn_t & tA
 					} else if ( tAttr.m_eAttrType==ESphAttr::SPH_ATTR_FACTORS || tAttr.m_eAttrType==ESphAttr::SPH_ATTR_FACTORS_JSON )
 					{
 						DWORD uLength = tReq.GetDword();
-						BYTE * pData = new BYTE[uLength];
-						*(DWORD *)pData = uLength;
-						tReq.GetBytes ( pData+sizeof(DWORD), uLength-sizeof(DWORD) );
-						tMatch.SetAttr ( tAttr.m_tLocator, (SphAttr_t) pData );
+						if ( uLength<sizeof(DWORD) )
+						{
+							// agents send zero length for NULL blobs (eg. groups without a distinct sketch)
+							tMatch.SetAttr ( tAttr.m_tLocator, 0 );
+						} else
+						{
+							BYTE * pData = new BYTE[uLength];
+							*(DWORD *)pData = uLength;
+							tReq.GetBytes ( pData+sizeof(DWORD), uLength-sizeof(DWORD) );
+							tMatch.SetAttr ( tAttr.m_tLocator, (SphAttr_t) pData );
+						}
 
 					} else if ( tAttr.m_eAttrType==ESphAttr::SPH_ATTR_JSON_FIELD )
 					{
@@ -4141,6 +4153,12 @@ bool ParseSearchQuery ( InputBuffer_c & tReq, ISphOutputBuffer & tOut, CSphQuery
 		tQuery.m_sQueryTokenFilterOpts = tReq.GetString();
 	}
 
+	if ( iMasterVer>=15 )
+	{
+		int iPrecision = tReq.GetInt();
+		tQuery.m_iDistinctApprox = ( iPrecision>=HLL_MIN_PRECISION && iPrecision<=HLL_MAX_PRECISION ) ? iPrecision : 0;
+	}
+
 	/////////////////////
 	// additional checks
 	/////////////////////
@@ -4542,6 +4560,30 @@ static void FormatOption ( const CSphQuery & tQuery, CSphStringBuilder & tBuf )
 		tBuf.Appendf ( "max_predicted_time=%d", tQuery.m_iMaxPredictedMsec );
 	}
 
+	if ( tQuery.m_bGroupbyExact )
+	{
+		tBuf.Appendf ( iOpts++ ? ", " : " OPTION " );
+		tBuf.Appendf ( "groupby_exact=1" );
+	}
+
+	if ( tQuery.m_iGroupbyMemory )
+	{
+		tBuf.Appendf ( iOpts++ ? ", " : " OPTION " );
+		tBuf.Appendf ( "groupby_memory=" INT64_FMT, tQuery.m_iGroupbyMemory );
+	}
+
+	if ( tQuery.m_iDistinctApprox )
+	{
+		tBuf.Appendf ( iOpts++ ? ", " : " OPTION " );
+		tBuf.Appendf ( "distinct_approx=%d", tQuery.m_iDistinctApprox );
+	}
+
+	if ( tQuery.m_bStream )
+	{
+		tBuf.Appendf ( iOpts++ ? ", " : " OPTION " );
+		tBuf.Appendf ( "stream=1" );
+	}
+
 	if ( tQuery.m_iRetryCount!=g_iAgentRetryCount )
 	{
 		tBuf.Appendf ( iOpts++ ? ", " : " OPTION " );
@@ -5488,31 +5530,6 @@ void AggrResult_t::ClampMatches ( int iLimit, bool bCommonSchema )
 }
 
 
-struct TaggedMatchSorter_fn : public SphAccessor_T<CSphMatch>
-{
-	void CopyKey ( CSphMatch * pMed, CSphMatch * pVal ) const
-	{
-		pMed->m_uDocID = pVal->m_uDocID;
-		pMed->m_iTag = pVal->m_iTag;
-	}
-
-	bool IsLess ( const CSphMatch & a, const CSphMatch & b ) const
-	{
-		bool bDistA = ( ( a.m_iTag & 0x80000000 )==0x80000000 );
-		bool bDistB = ( ( b.m_iTag & 0x80000000 )==0x80000000 );
-		// sort by doc_id, dist_tag, tag
-		return ( a.m_uDocID < b.m_uDocID ) ||
-			( a.m_uDocID==b.m_uDocID && ( ( !bDistA && bDistB ) || ( ( a.m_iTag & 0x7FFFFFFF )>( b.m_iTag & 0x7FFFFFFF ) ) ) );
-	}
-
-	// inherited swap does not work on gcc
-	void Swap ( CSphMatch * a, CSphMatch * b ) const
-	{
-		::Swap ( *a, *b );
-	}
-};
-
-
 void RemapResult ( const ISphSchema * pTarget, AggrResult_t * pRes )
 {
 	int iCur = 0;
@@ -5529,6 +5546,7 @@ void RemapResult ( const ISphSchema * pTarget, AggrResult_t * pRes )
 				|| pTarget->GetAttr(i).m_tLocator.IsID()
 				|| sphIsSortStringInternal ( pTarget->GetAttr(i).m_sName.cstr() )
 				|| pTarget->GetAttr(i).m_sName=="@groupbystr"
+				|| pTarget->GetAttr(i).m_sName=="@distinct_hll"
 				);
 		}
 		int iLimit = Min ( iCur + pRes->m_dMatchCounts[iSchema], pRes->m_dMatches.GetLength() );
@@ -5650,44 +5668,32 @@ static void RemapStrings ( ISphMatchSorter * pSorter, AggrResult_t & tRes )
 }
 
 
-static int KillAllDupes ( ISphMatchSorter * pSorter, AggrResult_t & tRes )
+/// min matches to merge that are worth a partition thread
+static const int MERGE_PARTITION_MIN_MATCHES = 16384;
+
+
+/// how many partitions to merge a result in, or 0 to merge it serially
+static int GetMergePartitions ( const CSphQuery & tQuery, const ISphMatchSorter * pSorter, int iMatches )
 {
-	assert ( pSorter );
-	int iDupes = 0;
+	if ( g_iDistThreads<=1 || iMatches<2*MERGE_PARTITION_MIN_MATCHES || pSorter->m_bRandomize )
+		return 0;
 
-	if ( pSorter->IsGroupby () )
-	{
-		// groupby sorter does that automagically
-		pSorter->SetMVAPool ( NULL, false ); // because we must be able to group on @groupby anyway
-		pSorter->SetStringPool ( NULL );
-		int iMC = 0;
-		int iBound = 0;
+	// outer order only patches the query while the final sorter gets created
+	if ( tQuery.m_bHasOuter )
+		return 0;
 
-		ARRAY_FOREACH ( i, tRes.m_dMatches )
-		{
-			CSphMatch & tMatch = tRes.m_dMatches[i];
-			if ( !pSorter->PushGrouped ( tMatch, i==iBound ) )
-				iDupes++;
+	// distinct counts and n-best groups do not survive a second merge, and exact groups spill on their own
+	if ( pSorter->IsGroupby() && ( !tQuery.m_sGroupDistinct.IsEmpty() || tQuery.m_iGroupbyLimit>1 || tQuery.m_bGroupbyExact ) )
+		return 0;
 
-			if ( i==iBound )
-				iBound += tRes.m_dMatchCounts[iMC++];
-		}
-	} else
-	{
-		// normal sorter needs massasging
-		// sort by docid and then by tag to guarantee the replacement order
-		TaggedMatchSorter_fn fnSort;
-		sphSort ( tRes.m_dMatches.Begin(), tRes.m_dMatches.GetLength(), fnSort, fnSort );
+	return Min ( g_iDistThreads, iMatches/MERGE_PARTITION_MIN_MATCHES );
+}
 
-		// by default, simply remove dupes (select first by tag)
-		ARRAY_FOREACH ( i, tRes.m_dMatches )
-		{
-			if ( i==0 || tRes.m_dMatches[i].m_uDocID!=tRes.m_dMatches[i-1].m_uDocID )
-				pSorter->Push ( tRes.m_dMatches[i] );
-			else
-				iDupes++;
-		}
-	}
+
+static int KillAllDupes ( ISphMatchSorter * pSorter, CSphVector<ISphMatchSorter*> & dParts, AggrResult_t & tRes )
+{
+	assert ( pSorter );
+	int iDupes = sphMergeDupes ( pSorter, dParts, tRes.m_dMatches, tRes.m_dMatchCounts, tRes.m_tSchema, tRes.m_iArenaBytes );
 
 	ARRAY_FOREACH ( i, tRes.m_dMatches )
 		tRes.m_tSchema.FreeStringPtrs ( &(tRes.m_dMatches[i]) );
@@ -5787,7 +5793,7 @@ struct AggregateColumnSort_fn
 {
 	bool IsAggr ( const CSphColumnInfo & c ) const
 	{
-		return c.m_eAggrFunc!=SPH_AGGR_NONE || c.m_sName=="@groupby" || c.m_sName=="@count" || c.m_sName=="@distinct" || c.m_sName=="@groupbystr";
+		return c.m_eAggrFunc!=SPH_AGGR_NONE || c.m_sName=="@groupby" || c.m_sName=="@count" || c.m_sName=="@distinct" || c.m_sName=="@groupbystr" || c.m_sName=="@distinct_hll";
 	}
 
 	bool IsLess ( const CSphColumnInfo & a, const CSphColumnInfo & b ) const
@@ -5978,6 +5984,10 @@ bool MinimizeAggrResult ( AggrResult_t & tRes, CSphQuery & tQuery, int iLocals,
 		assert ( !tCol.m_sName.IsEmpty() );
 		bool bMagic = ( *tCol.m_sName.cstr()=='@' );
 
+		// count(distinct) sketches only travel from agents to master; clients get the estimate in @distinct
+		if ( !bAgent && tCol.m_sName=="@distinct_hll" )
+			continue;
+
 		if ( !bMagic && tCol.m_pExpr.Ptr() )
 		{
 			ARRAY_FOREACH ( j, dUnmappedItems )
@@ -6166,6 +6176,23 @@ bool MinimizeAggrResult ( AggrResult_t & tRes, CSphQuery & tQuery, int iLocals,
 		if ( !pSorter )
 			return false;
 
+		// big enough merges go to partition sorters first, made the same way
+		CSphVector<ISphMatchSorter*> dParts;
+		int iParts = GetMergePartitions ( tQuery, pSorter, tRes.m_dMatches.GetLength() );
+		for ( int i=0; i<iParts; i++ )
+		{
+			ISphMatchSorter * pPart = sphCreateQueue ( tQueueSettings );
+			if ( !pPart )
+				break;
+			dParts.Add ( pPart );
+		}
+		if ( dParts.GetLength()<iParts )
+		{
+			ARRAY_FOREACH ( i, dParts )
+				SafeDelete ( dParts[i] );
+			dParts.Reset();
+		}
+
 		// reset bAllEqual flag if sorter makes new attributes
 		if ( bAllEqual )
 		{
@@ -6197,7 +6224,7 @@ bool MinimizeAggrResult ( AggrResult_t & tRes, CSphQuery & tQuery, int iLocals,
 		RemapStrings ( pSorter, tRes );
 
 		// do the sort work!
-		tRes.m_iTotalMatches -= KillAllDupes ( pSorter, tRes );
+		tRes.m_iTotalMatches -= KillAllDupes ( pSorter, dParts, tRes );
 	}
 
 	// apply outer order clause to single result set
@@ -6734,6 +6761,7 @@ public:
 	CSphVector<SearchFailuresLog_c>	m_dFailuresSet;					///< failure logs for each query
 	CSphVector < CSphVector<int64_t> >	m_dAgentTimes;				///< per-agent time stats
 	CSphQueryProfile *				m_pProfile;
+	ISphMatchStream *				m_pStream;						///< where to stream the matches of a single query, if it allows (see CanStream())
 	CSphVector<DWORD *>				m_dMva2Free;
 	CSphVector<BYTE *>				m_dString2Free;
 	int								m_iCid;
@@ -6744,12 +6772,14 @@ protected:
 	void							RunLocalSearchesMT ();
 	bool							RunLocalSearch ( int iLocal, ISphMatchSorter ** ppSorters, CSphQueryResult ** pResults, bool * pMulti ) const;
 	bool							AllowsMulti ( int iStart, int iEnd ) const;
+	bool							CanStream ( const CSphQuery & tQuery ) const;
 	void							SetupLocalDF ( int iStart, int iEnd );
 
 	int								m_iStart;		///< subset start
 	int								m_iEnd;			///< subset end
 	bool							m_bMultiQueue;	///< whether current subset is subject to multi-queue optimization
 	bool							m_bFacetQueue;	///< whether current subset is subject to facet-queue optimization
+	bool							m_bStreamQueue;	///< whether current subset matches go right to m_pStream
 	CSphVector<LocalIndex_t>		m_dLocal;		///< local indexes for the current subset
 	mutable CSphVector<CSphSchemaMT>		m_dExtraSchemas; ///< the extra fields for agents
 	bool							m_bSphinxql;	///< if the query get from sphinxql - to avoid applying sphinxql magick for others
@@ -6785,6 +6815,7 @@ SearchHandler_c::SearchHandler_c ( int iQueries, bool bSphinxql, bool bMaster, i
 	m_iEnd = 0;
 	m_bMultiQueue = false;
 	m_bFacetQueue = false;
+	m_bStreamQueue = false;
 
 	m_dQueries.Resize ( iQueries );
 	m_dResults.Resize ( iQueries );
@@ -6796,6 +6827,7 @@ SearchHandler_c::SearchHandler_c ( int iQueries, bool bSphinxql, bool bMaster, i
 	m_pDelete = NULL;
 
 	m_pProfile = NULL;
+	m_pStream = NULL;
 	m_tHook.m_pProfiler = NULL;
 	m_iTotalDocs = 0;
 	m_bGotLocalDF = false;
@@ -7139,10 +7171,62 @@ static int64_t CalcPredictedTimeMsec ( const CSphQueryResult & tRes )
 }
 
 
+/// multi-query one index; with a facet batch, the facets that only count groups share a single aggregating pass
+static bool MultiQueryIndex ( const CSphIndex * pIndex, const CSphQuery * pQueries, CSphQueryResult * pResult, int iSorters,
+	ISphMatchSorter ** ppSorters, const CSphMultiQueryArgs & tArgs, bool bFacets )
+{
+	// the main query sorter goes first and stays as is; packed factors need per-sorter ranker notifications
+	if ( !bFacets || iSorters<2 || !ppSorters[0] || ( tArgs.m_uPackedFactorFlags & SPH_FACTOR_ENABLE ) )
+		return pIndex->MultiQuery ( pQueries, pResult, iSorters, ppSorters, tArgs );
+
+	CSphFacetSorter tFacets;
+	CSphVector<ISphMatchSorter*> dSorters;
+	dSorters.Add ( ppSorters[0] );
+	for ( int i=1; i<iSorters; i++ )
+		if ( ppSorters[i] && !tFacets.AddFacet ( ppSorters[i], pQueries[i] ) )
+			dSorters.Add ( ppSorters[i] );
+
+	if ( !tFacets.GetFacets() )
+		return pIndex->MultiQuery ( pQueries, pResult, iSorters, ppSorters, tArgs );
+
+	dSorters.Add ( &tFacets );
+	bool bResult = pIndex->MultiQuery ( pQueries, pResult, dSorters.GetLength(), dSorters.Begin(), tArgs );
+	tFacets.Flush();
+	return bResult;
+}
+
+
+/// recreates local query sorters, so that an index can search its parts on several threads (eg. RT disk chunks)
+/// sorters that agents extend with their own schema are left alone
+class LocalSorterFactory_c : public ISphSorterFactory
+{
+public:
+	LocalSorterFactory_c ( const CSphSchema & tSchema, ISphExprHook * pHook )
+		: m_tSchema ( tSchema )
+		, m_pHook ( pHook )
+	{}
+
+	virtual ISphMatchSorter * CreateSorter ( const CSphQuery & tQuery ) const
+	{
+		if ( tQuery.m_bAgent )
+			return NULL;
+
+		CSphString sError;
+		SphQueueSettings_t tQueueSettings ( tQuery, m_tSchema, sError, NULL );
+		tQueueSettings.m_bComputeItems = true;
+		tQueueSettings.m_pHook = m_pHook;
+		return sphCreateQueue ( tQueueSettings );
+	}
+
+private:
+	const CSphSchema &	m_tSchema;
+	ISphExprHook *		m_pHook;
+};
+
+
 static void FlattenToRes ( ISphMatchSorter * pSorter, AggrResult_t & tRes, int iTag )
 {
 	assert ( pSorter );
-
 	if ( pSorter->GetLength() )
 	{
 		tRes.m_dSchemas.Add ( pSorter->GetSchema() );
@@ -7460,7 +7544,7 @@ bool SearchHandler_c::RunLocalSearch ( int iLocal, ISphMatchSorter ** ppSorters,
 	ppResults[0]->m_tIOStats.Start();
 	if ( *pMulti )
 	{
-		bResult = pServed->m_pIndex->MultiQuery ( &m_dQueries[m_iStart], ppResults[0], iQueries, ppSorters, tMultiArgs );
+		bResult = MultiQueryIndex ( pServed->m_pIndex, &m_dQueries[m_iStart], ppResults[0], iQueries, ppSorters, tMultiArgs, m_bFacetQueue );
 	} else
 	{
 		bResult = pServed->m_pIndex->MultiQueryEx ( iQueries, &m_dQueries[m_iStart], ppResults, ppSorters, tMultiArgs );
@@ -7537,11 +7621,20 @@ void SearchHandler_c::RunLocalSearches ( ISphMatchSorter * pLocalSorter, DWORD u
 				tQueueSettings.m_pUpdate = m_pUpdates;
 				tQueueSettings.m_pDeletes = m_pDelete;
 				tQueueSettings.m_pHook = &m_tHook;
+				tQueueSettings.m_pStream = m_bStreamQueue ? m_pStream : NULL;
 
 				pSorter = sphCreateQueue ( tQueueSettings );
 
 				uTotalFactorFlags |= tQueueSettings.m_uPackedFactorFlags;
 				tQuery.m_bZSlist = tQueueSettings.m_bZonespanlist;
+
+				// streamed matches are not kept, so there is no need to look past the limit
+				if ( tQueueSettings.m_bStreaming )
+				{
+					int iWanted = tQuery.m_iOffset + tQuery.m_iLimit;
+					if ( tQuery.m_iCutoff<=0 || tQuery.m_iCutoff>iWanted )
+						tQuery.m_iCutoff = iWanted;
+				}
 				if ( !pSorter )
 				{
 					m_dFailuresSet[iQuery].Submit ( sLocal, sParentIndex, sError.cstr() );
@@ -7637,11 +7730,20 @@ void SearchHandler_c::RunLocalSearches ( ISphMatchSorter * pLocalSorter, DWORD u
 			tMultiArgs.m_iTotalDocs = m_iTotalDocs;
 		}
 
+		// a single local index may use the idle distributed threads on its own parts
+		// but not with sorters that keep their matches out of the result (updates, deletes, streams), or that came from outside
+		LocalSorterFactory_c tSorterFactory ( pServed->m_pIndex->GetMatchSchema(), &m_tHook );
+		if ( !pLocalSorter && !m_pUpdates && !m_pDelete && !m_bStreamQueue )
+		{
+			tMultiArgs.m_pSorterFactory = &tSorterFactory;
+			tMultiArgs.m_iThreads = g_iDistThreads;
+		}
+
 		bool bResult = false;
 		if ( m_bMultiQueue )
 		{
 			tStats.m_tIOStats.Start();
-			bResult = pServed->m_pIndex->MultiQuery ( &m_dQueries[m_iStart], &tStats, dSorters.GetLength(), dSorters.Begin(), tMultiArgs );
+			bResult = MultiQueryIndex ( pServed->m_pIndex, &m_dQueries[m_iStart], &tStats, dSorters.GetLength(), dSorters.Begin(), tMultiArgs, m_bFacetQueue );
 			tStats.m_tIOStats.Stop();
 		} else
 		{
@@ -7738,6 +7840,34 @@ void SearchHandler_c::RunLocalSearches ( ISphMatchSorter * pLocalSorter, DWORD u
 }
 
 
+// check whether the index order is good enough for a query to stream its matches
+bool SearchHandler_c::CanStream ( const CSphQuery & tQuery ) const
+{
+	if ( !tQuery.m_bStream || tQuery.m_bFacet || tQuery.m_bHasOuter || !tQuery.m_sGroupBy.IsEmpty() || tQuery.m_iLimit<=0 )
+		return false;
+
+	// weights only order the matches of ranked full-text queries, and equal weights are ordered by docid
+	bool bDefaultOrder = ( tQuery.m_eSort==SPH_SORT_RELEVANCE
+		|| ( tQuery.m_eSort==SPH_SORT_EXTENDED && tQuery.m_sSortBy=="@weight desc" ) );
+	if ( bDefaultOrder && !tQuery.m_sQuery.IsEmpty() && tQuery.m_eRanker!=SPH_RANK_NONE )
+		return false;
+
+	// plain indexes yield matches in docid order, RT ones go segment by segment
+	bool bById = ( tQuery.m_eSort==SPH_SORT_EXTENDED
+		&& ( !strcasecmp ( tQuery.m_sSortBy.cstr(), "id asc" ) || !strcasecmp ( tQuery.m_sSortBy.cstr(), "@id asc" ) ) );
+	if ( !bDefaultOrder && ( !bById || tQuery.m_bReverseScan ) )
+		return false;
+
+	const ServedIndex_c * pServed = UseIndex ( 0 );
+	if ( !pServed )
+		return false;
+
+	bool bRT = pServed->m_bRT;
+	ReleaseIndex ( 0 );
+	return !bRT;
+}
+
+
 // check expressions into a query to make sure that it's ready for multi query optimization
 bool SearchHandler_c::AllowsMulti ( int iStart, int iEnd ) const
 {
@@ -8265,6 +8395,10 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 		break;
 	}
 
+	// a lone query against a lone local index might stream its matches instead
+	m_bStreamQueue = m_pStream && iStart==iEnd && !pLocalSorter && !dAgents.GetLength() && m_dLocal.GetLength()==1
+		&& CanStream ( tFirst );
+
 	// select lists must have no expressions
 	if ( m_bMultiQueue )
 		m_bMultiQueue = AllowsMulti ( iStart, iEnd );
@@ -9479,6 +9613,29 @@ bool SqlParser_c::AddOption ( const SqlNode_t & tIdent, const SqlNode_t & tValue
 	{
 		m_pQuery->m_iMaxPredictedMsec = int ( tValue.m_iValue > INT_MAX ? INT_MAX : tValue.m_iValue );
 
+	} else if ( sOpt=="groupby_exact" )
+	{
+		m_pQuery->m_bGroupbyExact = ( tValue.m_iValue!=0 );
+
+	} else if ( sOpt=="groupby_memory" )
+	{
+		m_pQuery->m_iGroupbyMemory = Max ( tValue.m_iValue, (int64_t)0 );
+
+	} else if ( sOpt=="distinct_approx" )
+	{
+		// 1 means default precision, bigger values are the precision itself
+		int64_t iPrecision = tValue.m_iValue==1 ? HLL_DEFAULT_PRECISION : tValue.m_iValue;
+		if ( iPrecision!=0 && ( iPrecision<HLL_MIN_PRECISION || iPrecision>HLL_MAX_PRECISION ) )
+		{
+			m_pParseError->SetSprintf ( "distinct_approx must be 0, 1, or a precision from %d to %d", HLL_MIN_PRECISION, HLL_MAX_PRECISION );
+			return false;
+		}
+		m_pQuery->m_iDistinctApprox = (int)iPrecision;
+
+	} else if ( sOpt=="stream" )
+	{
+		m_pQuery->m_bStream = ( tValue.m_iValue!=0 );
+
 	} else if ( sOpt=="boolean_simplify" )
 	{
 		m_pQuery->m_bSimplify = true;
@@ -11511,6 +11668,27 @@ void BuildStatus ( VectorLike & dStatus )
 			dStatus.Add() = OFF;
 	}
 
+	BinlogStatus_t tBinlog;
+	sphGetBinlogStatus ( tBinlog );
+	if ( tBinlog.m_bGroupCommit )
+	{
+		const int64_t iSyncsDiv = Max ( tBinlog.m_iSyncs, 1 );
+		if ( dStatus.MatchAdd ( "binlog_commits" ) )
+			dStatus.Add().SetSprintf ( FMT64, tBinlog.m_iCommits );
+		if ( dStatus.MatchAdd ( "binlog_fsyncs" ) )
+			dStatus.Add().SetSprintf ( FMT64, tBinlog.m_iSyncs );
+		if ( dStatus.MatchAdd ( "binlog_avg_fsync_batch" ) )
+			dStatus.Add().SetSprintf ( "%.1f", (float)( tBinlog.m_iSyncedTxns*10/iSyncsDiv )/10.0f );
+		if ( dStatus.MatchAdd ( "binlog_max_fsync_batch" ) )
+			dStatus.Add().SetSprintf ( FMT64, tBinlog.m_iMaxBatch );
+		if ( dStatus.MatchAdd ( "binlog_avg_fsync_time" ) )
+			FormatMsec ( dStatus.Add(), tBinlog.m_tmSyncTotal / iSyncsDiv );
+		if ( dStatus.MatchAdd ( "binlog_avg_commit_wait" ) )
+			FormatMsec ( dStatus.Add(), tBinlog.m_tmWaitTotal / Max ( tBinlog.m_iCommits, 1 ) );
+		if ( dStatus.MatchAdd ( "binlog_max_commit_wait" ) )
+			FormatMsec ( dStatus.Add(), tBinlog.m_tmWaitMax );
+	}
+
 	const QcacheStatus_t & s = QcacheGetStatus();
 	if ( dStatus.MatchAdd ( "qcache_max_bytes" ) )
 		dStatus.Add().SetSprintf ( INT64_FMT, s.m_iMaxBytes );
@@ -11722,6 +11900,9 @@ void BuildMeta ( VectorLike & dStatus, const CSphQueryResultMeta & tMeta )
 	if ( dStatus.MatchAdd ( "time" ) )
 		dStatus.Add().SetSprintf ( "%d.%03d", tMeta.m_iQueryTime/1000, tMeta.m_iQueryTime%1000 );
 
+	if ( tMeta.m_iArenaBytes && dStatus.MatchAdd ( "arena_bytes" ) )
+		dStatus.Add().SetSprintf ( INT64_FMT, tMeta.m_iArenaBytes );
+
 	if ( g_bCpuStats )
 	{
 		if ( dStatus.MatchAdd ( "cpu_time" ) )
@@ -12397,6 +12578,12 @@ public:
 	}
 
 	// wrappers for popular packets
+	/// push the committed packets to the client right away (streamed result sets)
+	inline void Flush ()
+	{
+		m_tOut.Flush();
+	}
+
 	inline void Eof ( bool bMoreResults=false, int iWarns=0 )
 	{
 		SendMysqlEofPacket ( m_tOut, m_uPacketID++, iWarns, bMoreResults );
@@ -12568,7 +12755,7 @@ private:
 
 
 void HandleMysqlInsert ( SqlRowBuffer_c & tOut, const SqlStmt_t & tStmt,
-	bool bReplace, bool bCommit, CSphString & sWarning, CSphSessionAccum & tAcc )
+	bool bReplace, bool bCommit, bool bBulk, CSphString & sWarning, CSphSessionAccum & tAcc )
 {
 	MEMORY ( MEM_SQL_INSERT );
 
@@ -12721,19 +12908,23 @@ void HandleMysqlInsert ( SqlRowBuffer_c & tOut, const SqlStmt_t & tStmt,
 		}
 	}
 
-	CSphVector<const char *> dStrings;
-	CSphVector<DWORD> dMvas;
+	// all the rows get converted first, so that the index could tokenize them in parallel
+	CSphFixedVector<CSphMatchVariant> dDocs ( tStmt.m_iRowsAffected );
+	CSphFixedVector< CSphVector<const char *> > dRowFields ( tStmt.m_iRowsAffected );
+	CSphFixedVector< CSphVector<const char *> > dRowStrings ( tStmt.m_iRowsAffected );
+	CSphFixedVector< CSphVector<DWORD> > dRowMvas ( tStmt.m_iRowsAffected );
+	CSphVector<RtInsertDoc_t> dInsert;
 
 	// convert attrs
 	for ( int c=0; c<tStmt.m_iRowsAffected; c++ )
 	{
 		assert ( sError.IsEmpty() );
 
-		CSphMatchVariant tDoc;
+		CSphMatchVariant & tDoc = dDocs[c];
 		tDoc.Reset ( tSchema.GetRowSize() );
 		tDoc.m_uDocID = CSphMatchVariant::ToDocid ( tStmt.m_dInsertValues[iIdIndex + c * iExp] );
-		dStrings.Resize ( 0 );
-		dMvas.Resize ( 0 );
+		CSphVector<const char *> & dStrings = dRowStrings[c];
+		CSphVector<DWORD> & dMvas = dRowMvas[c];
 
 		int iSchemaAttrCount = tSchema.GetAttrsCount();
 		if ( pIndex->GetSettings().m_bIndexFieldLens )
@@ -12822,7 +13013,7 @@ void HandleMysqlInsert ( SqlRowBuffer_c & tOut, const SqlStmt_t & tStmt,
 			break;
 
 		// convert fields
-		CSphVector<const char*> dFields;
+		CSphVector<const char*> & dFields = dRowFields[c];
 		ARRAY_FOREACH ( i, tSchema.m_dFields )
 		{
 			int iQuerySchemaIdx = dFieldSchema[i];
@@ -12841,15 +13032,18 @@ void HandleMysqlInsert ( SqlRowBuffer_c & tOut, const SqlStmt_t & tStmt,
 		if ( !sError.IsEmpty() )
 			break;
 
-		// do add
-		pIndex->AddDocument ( pIndex->CloneIndexingTokenizer(), dFields.GetLength(), dFields.Begin(), tDoc,
-			bReplace, tStmt.m_sStringParam,
-			dStrings.Begin(), dMvas, sError, sWarning, pAccum );
-
-		if ( !sError.IsEmpty() )
-			break;
+		RtInsertDoc_t & tInsert = dInsert.Add();
+		tInsert.m_pDoc = &tDoc;
+		tInsert.m_ppFields = dFields.Begin();
+		tInsert.m_ppStr = dStrings.Begin();
+		tInsert.m_pMvas = &dMvas;
 	}
 
+	// do add
+	if ( sError.IsEmpty() )
+		pIndex->AddDocuments ( tSchema.m_dFields.GetLength(), dInsert, bReplace, tStmt.m_sStringParam,
+			sError, sWarning, pAccum );
+
 	// fire exit
 	if ( !sError.IsEmpty() )
 	{
@@ -12860,7 +13054,13 @@ void HandleMysqlInsert ( SqlRowBuffer_c & tOut, const SqlStmt_t & tStmt,
 	}
 
 	// no errors so far
-	if ( bCommit )
+	if ( bCommit && bBulk && !pIndex->BulkCommit ( NULL, pAccum ) )
+	{
+		sError = pIndex->GetLastError();
+		pServed->Unlock();
+		tOut.Error ( tStmt.m_sStmt, sError.cstr() );
+		return;
+	} else if ( bCommit && !bBulk )
 		pIndex->Commit ( NULL, pAccum );
 
 	pServed->Unlock();
@@ -14343,6 +14543,232 @@ static void ReturnZeroCount ( const CSphRsetSchema & tSchema, int iAttrsCount, c
 }
 
 
+static MysqlColumnType_e MysqlColumnType ( ESphAttr eAttr )
+{
+	if ( eAttr==ESphAttr::SPH_ATTR_INTEGER || eAttr==ESphAttr::SPH_ATTR_TIMESTAMP || eAttr==ESphAttr::SPH_ATTR_BOOL )
+		return MYSQL_COL_LONG;
+	if ( eAttr==ESphAttr::SPH_ATTR_FLOAT )
+		return MYSQL_COL_FLOAT;
+	if ( eAttr==ESphAttr::SPH_ATTR_BIGINT )
+		return MYSQL_COL_LONGLONG;
+	return MYSQL_COL_STRING;
+}
+
+
+/// send a single column value of a match, as a part of a result set row
+static void SendMysqlAttr ( SqlRowBuffer_c & dRows, const CSphMatch & tMatch, const CSphColumnInfo & tCol, const PoolPtrs_t & tPools, CSphVector<BYTE> & dTmp )
+{
+	const CSphAttrLocator & tLoc = tCol.m_tLocator;
+	ESphAttr eAttrType = tCol.m_eAttrType;
+
+	switch ( eAttrType )
+	{
+	case ESphAttr::SPH_ATTR_INTEGER:
+	case ESphAttr::SPH_ATTR_TIMESTAMP:
+	case ESphAttr::SPH_ATTR_BOOL:
+	case ESphAttr::SPH_ATTR_TOKENCOUNT:
+		dRows.PutNumeric<DWORD> ( "%u", (DWORD)tMatch.GetAttr(tLoc) );
+		break;
+
+	case ESphAttr::SPH_ATTR_BIGINT:
+	{
+		const char * sName = tCol.m_sName.cstr();
+		// how to get rid of this if?
+		if ( sName[0]=='i' && sName[1]=='d' && sName[2]=='\0' )
+			dRows.PutNumeric<SphDocID_t> ( DOCID_FMT, tMatch.m_uDocID );
+		else
+			dRows.PutNumeric<SphAttr_t> ( INT64_FMT, tMatch.GetAttr(tLoc) );
+		break;
+		}
+
+	case ESphAttr::SPH_ATTR_FLOAT:
+		dRows.PutNumeric ( "%f", tMatch.GetAttrFloat(tLoc) );
+		break;
+
+	case ESphAttr::SPH_ATTR_INT64SET:
+	case ESphAttr::SPH_ATTR_UINT32SET:
+		{
+			int iLenOff = dRows.Length();
+			dRows.Reserve ( 4 );
+			dRows.IncPtr ( 4 );
+
+			assert ( tMatch.GetAttr ( tLoc )==0 || tPools.m_pMva || ( MVA_DOWNSIZE ( tMatch.GetAttr ( tLoc ) ) & MVA_ARENA_FLAG ) );
+			const DWORD * pValues = tMatch.GetAttrMVA ( tLoc, tPools.m_pMva, tPools.m_bArenaProhibit );
+			if ( pValues )
+			{
+				DWORD nValues = *pValues++;
+				assert ( eAttrType==ESphAttr::SPH_ATTR_UINT32SET || ( nValues%2 )==0 );
+				if ( eAttrType==ESphAttr::SPH_ATTR_UINT32SET )
+				{
+					while ( nValues-- )
+					{
+						dRows.Reserve ( SPH_MAX_NUMERIC_STR );
+						int iLen = snprintf ( dRows.Get(), SPH_MAX_NUMERIC_STR, nValues>0 ? "%u," : "%u", *pValues++ );
+						dRows.IncPtr ( iLen );
+					}
+				} else
+				{
+					for ( ; nValues; nValues-=2, pValues+=2 )
+					{
+						int64_t iVal = MVA_UPSIZE ( pValues );
+						dRows.Reserve ( SPH_MAX_NUMERIC_STR );
+						int iLen = snprintf ( dRows.Get(), SPH_MAX_NUMERIC_STR, nValues>2 ? INT64_FMT"," : INT64_FMT, iVal );
+						dRows.IncPtr ( iLen );
+					}
+				}
+			}
+
+			// manually pack length, forcibly into exactly 3 bytes
+			int iLen = dRows.Length()-iLenOff-4;
+			char * pLen = dRows.Off ( iLenOff );
+			pLen[0] = (BYTE)0xfd;
+			pLen[1] = (BYTE)( iLen & 0xff );
+			pLen[2] = (BYTE)( ( iLen>>8 ) & 0xff );
+			pLen[3] = (BYTE)( ( iLen>>16 ) & 0xff );
+			break;
+		}
+
+	case ESphAttr::SPH_ATTR_STRING:
+	case ESphAttr::SPH_ATTR_JSON:
+		{
+			const BYTE * pStrings = tPools.m_pStrings;
+
+			// get that string
+			const BYTE * pStr = NULL;
+			int iLen = 0;
+
+			DWORD uOffset = (DWORD) tMatch.GetAttr ( tLoc );
+			if ( uOffset )
+			{
+				assert ( pStrings );
+				iLen = sphUnpackStr ( pStrings+uOffset, &pStr );
+			}
+
+			if ( eAttrType==ESphAttr::SPH_ATTR_JSON )
+			{
+				// no object at all? return NULL
+				if ( !pStr )
+				{
+					dRows.PutNULL();
+					break;
+				}
+				dTmp.Resize ( 0 );
+				sphJsonFormat ( dTmp, pStr );
+				pStr = dTmp.Begin();
+				iLen = dTmp.GetLength();
+				if ( iLen==0 )
+				{
+					// empty string (no objects) - return NULL
+					// (canonical "{}" and "[]" are handled by sphJsonFormat)
+					dRows.PutNULL();
+					break;
+				}
+			}
+
+			// send length
+			dRows.Reserve ( iLen+4 );
+			char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
+
+			// send string data
+			if ( iLen )
+				memcpy ( pOutStr, pStr, iLen );
+
+			dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
+			break;
+		}
+
+	case ESphAttr::SPH_ATTR_STRINGPTR:
+		{
+			int iLen = 0;
+			const char* pString = (const char*) tMatch.GetAttr ( tLoc );
+			if ( pString )
+				iLen = strlen ( pString );
+			else
+			{
+				// stringptr is NULL - send NULL value
+				dRows.PutNULL();
+				break;
+			}
+
+			// send length
+			dRows.Reserve ( iLen+4 );
+			char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
+
+			// send string data
+			if ( iLen )
+				memcpy ( pOutStr, pString, iLen );
+
+			dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
+			break;
+		}
+
+	case ESphAttr::SPH_ATTR_FACTORS:
+	case ESphAttr::SPH_ATTR_FACTORS_JSON:
+		{
+			int iLen = 0;
+			const BYTE * pStr = NULL;
+			const unsigned int * pFactors = (unsigned int*) tMatch.GetAttr ( tLoc );
+			if ( pFactors )
+			{
+				dTmp.Resize ( 0 );
+				sphFormatFactors ( dTmp, pFactors, eAttrType==ESphAttr::SPH_ATTR_FACTORS_JSON );
+				iLen = dTmp.GetLength();
+				pStr = dTmp.Begin();
+			}
+
+			// send length
+			dRows.Reserve ( iLen+4 );
+			char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
+
+			// send string data
+			if ( iLen )
+				memcpy ( pOutStr, pStr, iLen );
+
+			dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
+			break;
+		}
+
+	case ESphAttr::SPH_ATTR_JSON_FIELD:
+		{
+			uint64_t uTypeOffset = tMatch.GetAttr ( tLoc );
+			ESphJsonType eJson = ESphJsonType ( uTypeOffset>>32 );
+			DWORD uOff = (DWORD)uTypeOffset;
+			if ( !uOff || eJson==JSON_NULL )
+			{
+				// no key found - NULL value
+				dRows.PutNULL();
+
+			} else
+			{
+				// send string to client
+				dTmp.Resize ( 0 );
+				const BYTE * pStrings = tPools.m_pStrings;
+				sphJsonFieldFormat ( dTmp, pStrings+uOff, eJson, false );
+
+				// send length
+				int iLen = dTmp.GetLength();
+				dRows.Reserve ( iLen+4 );
+				char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
+
+				// send string data
+				if ( iLen )
+					memcpy ( pOutStr, dTmp.Begin(), iLen );
+
+				dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
+			}
+			break;
+		}
+
+	default:
+		char * pDef = dRows.Reserve ( 2 );
+		pDef[0] = 1;
+		pDef[1] = '-';
+		dRows.IncPtr ( 2 );
+		break;
+	}
+}
+
+
 void SendMysqlSelectResult ( SqlRowBuffer_c & dRows, const AggrResult_t & tRes, bool bMoreResultsFollow )
 {
 	if ( !tRes.m_iSuccesses )
@@ -14376,16 +14802,7 @@ void SendMysqlSelectResult ( SqlRowBuffer_c & dRows, const AggrResult_t & tRes,
 		for ( int i=0; i<iSchemaAttrsCount; i++ )
 		{
 			const CSphColumnInfo & tCol = tRes.m_tSchema.GetAttr(i);
-			MysqlColumnType_e eType = MYSQL_COL_STRING;
-			if ( tCol.m_eAttrType==ESphAttr::SPH_ATTR_INTEGER || tCol.m_eAttrType==ESphAttr::SPH_ATTR_TIMESTAMP || tCol.m_eAttrType==ESphAttr::SPH_ATTR_BOOL )
-				eType = MYSQL_COL_LONG;
-			if ( tCol.m_eAttrType==ESphAttr::SPH_ATTR_FLOAT )
-				eType = MYSQL_COL_FLOAT;
-			if ( tCol.m_eAttrType==ESphAttr::SPH_ATTR_BIGINT )
-				eType = MYSQL_COL_LONGLONG;
-			if ( tCol.m_eAttrType==ESphAttr::SPH_ATTR_STRING || tCol.m_eAttrType==ESphAttr::SPH_ATTR_STRINGPTR || tCol.m_eAttrType==ESphAttr::SPH_ATTR_FACTORS || tCol.m_eAttrType==ESphAttr::SPH_ATTR_FACTORS_JSON )
-				eType = MYSQL_COL_STRING;
-			dRows.HeadColumn ( tCol.m_sName.cstr(), eType, tCol.m_sName=="id" ? MYSQL_COL_UNSIGNED_FLAG : 0 );
+			dRows.HeadColumn ( tCol.m_sName.cstr(), MysqlColumnType ( tCol.m_eAttrType ), tCol.m_sName=="id" ? MYSQL_COL_UNSIGNED_FLAG : 0 );
 		}
 	}
 
@@ -14403,226 +14820,102 @@ void SendMysqlSelectResult ( SqlRowBuffer_c & dRows, const AggrResult_t & tRes,
 
 		const CSphRsetSchema & tSchema = tRes.m_tSchema;
 		for ( int i=0; i<iSchemaAttrsCount; i++ )
-		{
-			CSphAttrLocator tLoc = tSchema.GetAttr(i).m_tLocator;
-			ESphAttr eAttrType = tSchema.GetAttr(i).m_eAttrType;
-
-			switch ( eAttrType )
-			{
-			case ESphAttr::SPH_ATTR_INTEGER:
-			case ESphAttr::SPH_ATTR_TIMESTAMP:
-			case ESphAttr::SPH_ATTR_BOOL:
-			case ESphAttr::SPH_ATTR_TOKENCOUNT:
-				dRows.PutNumeric<DWORD> ( "%u", (DWORD)tMatch.GetAttr(tLoc) );
-				break;
-
-			case ESphAttr::SPH_ATTR_BIGINT:
-			{
-				const char * sName = tSchema.GetAttr(i).m_sName.cstr();
-				// how to get rid of this if?
-				if ( sName[0]=='i' && sName[1]=='d' && sName[2]=='\0' )
-					dRows.PutNumeric<SphDocID_t> ( DOCID_FMT, tMatch.m_uDocID );
-				else
-					dRows.PutNumeric<SphAttr_t> ( INT64_FMT, tMatch.GetAttr(tLoc) );
-				break;
-				}
-
-			case ESphAttr::SPH_ATTR_FLOAT:
-				dRows.PutNumeric ( "%f", tMatch.GetAttrFloat(tLoc) );
-				break;
-
-			case ESphAttr::SPH_ATTR_INT64SET:
-			case ESphAttr::SPH_ATTR_UINT32SET:
-				{
-					int iLenOff = dRows.Length();
-					dRows.Reserve ( 4 );
-					dRows.IncPtr ( 4 );
-
-					assert ( tMatch.GetAttr ( tLoc )==0 || tRes.m_dTag2Pools [ tMatch.m_iTag ].m_pMva || ( MVA_DOWNSIZE ( tMatch.GetAttr ( tLoc ) ) & MVA_ARENA_FLAG ) );
-					const PoolPtrs_t & tPools = tRes.m_dTag2Pools [ tMatch.m_iTag ];
-					const DWORD * pValues = tMatch.GetAttrMVA ( tLoc, tPools.m_pMva, tPools.m_bArenaProhibit );
-					if ( pValues )
-					{
-						DWORD nValues = *pValues++;
-						assert ( eAttrType==ESphAttr::SPH_ATTR_UINT32SET || ( nValues%2 )==0 );
-						if ( eAttrType==ESphAttr::SPH_ATTR_UINT32SET )
-						{
-							while ( nValues-- )
-							{
-								dRows.Reserve ( SPH_MAX_NUMERIC_STR );
-								int iLen = snprintf ( dRows.Get(), SPH_MAX_NUMERIC_STR, nValues>0 ? "%u," : "%u", *pValues++ );
-								dRows.IncPtr ( iLen );
-							}
-						} else
-						{
-							for ( ; nValues; nValues-=2, pValues+=2 )
-							{
-								int64_t iVal = MVA_UPSIZE ( pValues );
-								dRows.Reserve ( SPH_MAX_NUMERIC_STR );
-								int iLen = snprintf ( dRows.Get(), SPH_MAX_NUMERIC_STR, nValues>2 ? INT64_FMT"," : INT64_FMT, iVal );
-								dRows.IncPtr ( iLen );
-							}
-						}
-					}
-
-					// manually pack length, forcibly into exactly 3 bytes
-					int iLen = dRows.Length()-iLenOff-4;
-					char * pLen = dRows.Off ( iLenOff );
-					pLen[0] = (BYTE)0xfd;
-					pLen[1] = (BYTE)( iLen & 0xff );
-					pLen[2] = (BYTE)( ( iLen>>8 ) & 0xff );
-					pLen[3] = (BYTE)( ( iLen>>16 ) & 0xff );
-					break;
-				}
-
-			case ESphAttr::SPH_ATTR_STRING:
-			case ESphAttr::SPH_ATTR_JSON:
-				{
-					const BYTE * pStrings = tRes.m_dTag2Pools [ tMatch.m_iTag ].m_pStrings;
-
-					// get that string
-					const BYTE * pStr = NULL;
-					int iLen = 0;
-
-					DWORD uOffset = (DWORD) tMatch.GetAttr ( tLoc );
-					if ( uOffset )
-					{
-						assert ( pStrings );
-						iLen = sphUnpackStr ( pStrings+uOffset, &pStr );
-					}
-
-					if ( eAttrType==ESphAttr::SPH_ATTR_JSON )
-					{
-						// no object at all? return NULL
-						if ( !pStr )
-						{
-							dRows.PutNULL();
-							break;
-						}
-						dTmp.Resize ( 0 );
-						sphJsonFormat ( dTmp, pStr );
-						pStr = dTmp.Begin();
-						iLen = dTmp.GetLength();
-						if ( iLen==0 )
-						{
-							// empty string (no objects) - return NULL
-							// (canonical "{}" and "[]" are handled by sphJsonFormat)
-							dRows.PutNULL();
-							break;
-						}
-					}
-
-					// send length
-					dRows.Reserve ( iLen+4 );
-					char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
-
-					// send string data
-					if ( iLen )
-						memcpy ( pOutStr, pStr, iLen );
-
-					dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
-					break;
-				}
-
-			case ESphAttr::SPH_ATTR_STRINGPTR:
-				{
-					int iLen = 0;
-					const char* pString = (const char*) tMatch.GetAttr ( tLoc );
-					if ( pString )
-						iLen = strlen ( pString );
-					else
-					{
-						// stringptr is NULL - send NULL value
-						dRows.PutNULL();
-						break;
-					}
+			SendMysqlAttr ( dRows, tMatch, tSchema.GetAttr(i), tRes.m_dTag2Pools [ tMatch.m_iTag ], dTmp );
+		dRows.Commit();
+	}
 
-					// send length
-					dRows.Reserve ( iLen+4 );
-					char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
+	if ( bReturnZeroCount )
+		ReturnZeroCount ( tRes.m_tSchema, iSchemaAttrsCount, tRes.m_dZeroCount, dRows );
 
-					// send string data
-					if ( iLen )
-						memcpy ( pOutStr, pString, iLen );
+	// eof packet
+	dRows.Eof ( bMoreResultsFollow, iWarns );
+}
 
-					dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
-					break;
-				}
 
-			case ESphAttr::SPH_ATTR_FACTORS:
-			case ESphAttr::SPH_ATTR_FACTORS_JSON:
-				{
-					int iLen = 0;
-					const BYTE * pStr = NULL;
-					const unsigned int * pFactors = (unsigned int*) tMatch.GetAttr ( tLoc );
-					if ( pFactors )
-					{
-						dTmp.Resize ( 0 );
-						sphFormatFactors ( dTmp, pFactors, eAttrType==ESphAttr::SPH_ATTR_FACTORS_JSON );
-						iLen = dTmp.GetLength();
-						pStr = dTmp.Begin();
-					}
+/// sends SphinxQL result set rows as the index yields the matches (see OPTION stream)
+/// the header goes out with the first match; when there are none, the regular (empty) result set is sent instead
+class SqlMatchStream_c : public ISphMatchStream
+{
+public:
+	SqlMatchStream_c ( SqlRowBuffer_c & dRows, const CSphQuery & tQuery )
+		: m_dRows ( dRows )
+		, m_tQuery ( tQuery )
+		, m_iRows ( 0 )
+	{}
 
-					// send length
-					dRows.Reserve ( iLen+4 );
-					char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
+	virtual bool SetSchema ( const ISphSchema & tSchema )
+	{
+		CSphVector<CSphQueryItem> dExpanded;
+		const CSphVector<CSphQueryItem> * pItems = ExpandAsterisk ( tSchema, m_tQuery.m_dItems, &dExpanded, false );
 
-					// send string data
-					if ( iLen )
-						memcpy ( pOutStr, pStr, iLen );
+		m_dColumns.Reset();
+		ARRAY_FOREACH ( i, (*pItems) )
+		{
+			const CSphQueryItem & tItem = (*pItems)[i];
+			const CSphString & sName = tItem.m_sAlias.IsEmpty() ? tItem.m_sExpr : tItem.m_sAlias;
+			if ( sName=="id" )
+			{
+				m_dColumns.Add ( CSphColumnInfo ( "id", ESphAttr::SPH_ATTR_BIGINT ) );
+				continue;
+			}
 
-					dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
-					break;
-				}
+			// anything the sorter does not compute (say, the internal columns) needs the regular result set
+			int iAttr = tSchema.GetAttrIndex ( sName.cstr() );
+			if ( iAttr<0 )
+				return false;
 
-			case ESphAttr::SPH_ATTR_JSON_FIELD:
-				{
-					uint64_t uTypeOffset = tMatch.GetAttr ( tLoc );
-					ESphJsonType eJson = ESphJsonType ( uTypeOffset>>32 );
-					DWORD uOff = (DWORD)uTypeOffset;
-					if ( !uOff || eJson==JSON_NULL )
-					{
-						// no key found - NULL value
-						dRows.PutNULL();
+			const CSphColumnInfo & tAttr = tSchema.GetAttr ( iAttr );
+			CSphColumnInfo & tCol = m_dColumns.Add();
+			tCol.m_sName = sName;
+			tCol.m_eAttrType = tAttr.m_eAttrType;
+			tCol.m_tLocator = tAttr.m_tLocator;
+		}
+		return true;
+	}
 
-					} else
-					{
-						// send string to client
-						dTmp.Resize ( 0 );
-						const BYTE * pStrings = tRes.m_dTag2Pools [ tMatch.m_iTag ].m_pStrings;
-						sphJsonFieldFormat ( dTmp, pStrings+uOff, eJson, false );
+	virtual bool PushMatch ( const CSphMatch & tMatch, const PoolPtrs_t & tPools )
+	{
+		if ( !m_iRows )
+		{
+			m_dRows.HeadBegin ( m_dColumns.GetLength() );
+			ARRAY_FOREACH ( i, m_dColumns )
+				m_dRows.HeadColumn ( m_dColumns[i].m_sName.cstr(), MysqlColumnType ( m_dColumns[i].m_eAttrType ),
+					m_dColumns[i].m_sName=="id" ? MYSQL_COL_UNSIGNED_FLAG : 0 );
+			m_dRows.HeadEnd();
+		}
 
-						// send length
-						int iLen = dTmp.GetLength();
-						dRows.Reserve ( iLen+4 );
-						char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
+		ARRAY_FOREACH ( i, m_dColumns )
+			SendMysqlAttr ( m_dRows, tMatch, m_dColumns[i], tPools, m_dTmp );
+		m_dRows.Commit();
 
-						// send string data
-						if ( iLen )
-							memcpy ( pOutStr, dTmp.Begin(), iLen );
+		// the first row goes out at once, the rest in batches
+		if ( !m_iRows++ || !( m_iRows % FLUSH_ROWS ) )
+			m_dRows.Flush();
+		return true;
+	}
 
-						dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
-					}
-					break;
-				}
+	/// end the streamed result set; false if nothing was streamed
+	bool Finish ( const AggrResult_t & tRes )
+	{
+		if ( !m_iRows )
+			return false;
 
-			default:
-				char * pDef = dRows.Reserve ( 2 );
-				pDef[0] = 1;
-				pDef[1] = '-';
-				dRows.IncPtr ( 2 );
-				break;
-			}
-		}
-		dRows.Commit();
+		if ( !tRes.m_iSuccesses )
+			m_dRows.Error ( NULL, tRes.m_sError.cstr() );
+		else
+			m_dRows.Eof ( false, tRes.m_sWarning.IsEmpty() ? 0 : 1 );
+		return true;
 	}
 
-	if ( bReturnZeroCount )
-		ReturnZeroCount ( tRes.m_tSchema, iSchemaAttrsCount, tRes.m_dZeroCount, dRows );
+protected:
+	static const int				FLUSH_ROWS = 1024;
 
-	// eof packet
-	dRows.Eof ( bMoreResultsFollow, iWarns );
-}
+	SqlRowBuffer_c &				m_dRows;
+	const CSphQuery &				m_tQuery;
+	CSphVector<CSphColumnInfo>		m_dColumns;
+	CSphVector<BYTE>				m_dTmp;
+	int64_t							m_iRows;
+};
 
 
 void HandleMysqlWarning ( const CSphQueryResultMeta & tLastMeta, SqlRowBuffer_c & dRows, bool bMoreResultsFollow )
@@ -14878,12 +15171,14 @@ struct SessionVars_t
 	bool			m_bInTransaction;
 	ESphCollation	m_eCollation;
 	bool			m_bProfile;
+	bool			m_bBulkLoad;	///< commit rt txns straight into disk chunks
 
 	SessionVars_t ()
 		: m_bAutoCommit ( true )
 		, m_bInTransaction ( false )
 		, m_eCollation ( g_eCollation )
 		, m_bProfile ( false )
+		, m_bBulkLoad ( false )
 	{}
 };
 
@@ -14944,6 +15239,7 @@ void HandleMysqlMultiStmt ( const CSphVector<SqlStmt_t> & dStmt, CSphQueryResult
 				tLastMeta.m_iQueryTime += tHandler.m_dResults[i].m_iQueryTime;
 				tLastMeta.m_iCpuTime += tHandler.m_dResults[i].m_iCpuTime;
 				tLastMeta.m_iAgentCpuTime += tHandler.m_dResults[i].m_iAgentCpuTime;
+				tLastMeta.m_iArenaBytes += tHandler.m_dResults[i].m_iArenaBytes;
 			}
 	}
 
@@ -15066,6 +15362,13 @@ void HandleMysqlSet ( SqlRowBuffer_c & tOut, SqlStmt_t & tStmt, SessionVars_t &
 					{
 						tOut.Error ( tStmt.m_sStmt, sError.cstr() );
 						return;
+					} else if ( tVars.m_bBulkLoad )
+					{
+						if ( !pIndex->BulkCommit ( NULL, pAccum ) )
+						{
+							tOut.Error ( tStmt.m_sStmt, pIndex->GetLastError().cstr() );
+							return;
+						}
 					} else
 					{
 						pIndex->Commit ( NULL, pAccum );
@@ -15096,6 +15399,11 @@ void HandleMysqlSet ( SqlRowBuffer_c & tOut, SqlStmt_t & tStmt, SessionVars_t &
 			// per-session PROFILING
 			tVars.m_bProfile = ( tStmt.m_iSetValue!=0 );
 
+		} else if ( tStmt.m_sSetName=="bulk_load" )
+		{
+			// per-session BULK_LOAD
+			tVars.m_bBulkLoad = ( tStmt.m_iSetValue!=0 );
+
 		} else
 		{
 			// unknown variable, return error
@@ -15527,6 +15835,9 @@ void HandleMysqlShowVariables ( SqlRowBuffer_c & dRows, const SqlStmt_t & tStmt,
 	if ( dStatus.MatchAdd ( "autocommit" ) )
 		dStatus.Add ( tVars.m_bAutoCommit ? "1" : "0" );
 
+	if ( dStatus.MatchAdd ( "bulk_load" ) )
+		dStatus.Add ( tVars.m_bBulkLoad ? "1" : "0" );
+
 	if ( dStatus.MatchAdd ( "collation_connection" ) )
 		dStatus.Add ( sphCollationToName ( tVars.m_eCollation ) );
 
@@ -15679,6 +15990,16 @@ static void AddPlainIndexStatus ( SqlRowBuffer_c & tOut, const ServedIndex_c * p
 		tOut.DataTuplet ( "ram_chunk", tStatus.m_iRamChunkSize );
 		tOut.DataTuplet ( "disk_chunks", tStatus.m_iNumChunks );
 		tOut.DataTuplet ( "mem_limit", tStatus.m_iMemLimit );
+		tOut.DataTuplet ( "ram_segments", tStatus.m_iRamSegments );
+		tOut.DataTuplet ( "merge_backlog", tStatus.m_iMergeBacklog );
+		tOut.DataTuplet ( "flushed_bytes", tStatus.m_iFlushedBytes );
+		tOut.DataTuplet ( "compacted_bytes", tStatus.m_iCompactedBytes );
+		if ( tStatus.m_iFlushedBytes )
+		{
+			CSphString sAmplification;
+			sAmplification.SetSprintf ( "%.2f", double ( tStatus.m_iFlushedBytes+tStatus.m_iCompactedBytes ) / tStatus.m_iFlushedBytes );
+			tOut.DataTuplet ( "write_amplification", sAmplification.cstr() );
+		}
 	}
 
 	AddIndexQueryStats ( tOut, pServed );
@@ -15762,6 +16083,10 @@ void DumpIndexSettings ( CSphStringBuilder & tBuf, CSphIndex * pIndex )
 	DumpKey ( tBuf, "bigram_freq_words",	tSettings.m_sBigramWords.cstr(),		!tSettings.m_sBigramWords.IsEmpty() );
 	DumpKey ( tBuf, "rlp_context",			tSettings.m_sRLPContext.cstr(),			!tSettings.m_sRLPContext.IsEmpty() );
 	DumpKey ( tBuf, "index_token_filter",	tSettings.m_sIndexTokenFilter.cstr(),	!tSettings.m_sIndexTokenFilter.IsEmpty() );
+	DumpKey ( tBuf, "string_attr_dict",		tSettings.m_sStringDictAttrs.cstr(),	!tSettings.m_sStringDictAttrs.IsEmpty() );
+	DumpKey ( tBuf, "json_attrs",			tSettings.m_sJsonAttrs.cstr(),			!tSettings.m_sJsonAttrs.IsEmpty() );
+	DumpKey ( tBuf, "geo_index",			tSettings.m_sGeoIndex.cstr(),			!tSettings.m_sGeoIndex.IsEmpty() );
+	DumpKey ( tBuf, "rollup",				tSettings.m_sRollups.cstr(),			!tSettings.m_sRollups.IsEmpty() );
 	CSphFieldFilterSettings tFieldFilter;
 	pIndex->GetFieldFilterSettings ( tFieldFilter );
 	ARRAY_FOREACH ( i, tFieldFilter.m_dRegexps )
@@ -16286,12 +16611,17 @@ public:
 				if ( m_tVars.m_bProfile )
 					tHandler.m_pProfile = &m_tProfile;
 
+				SqlMatchStream_c tStream ( tOut, tHandler.m_dQueries[0] );
+				if ( tHandler.m_dQueries[0].m_bStream )
+					tHandler.m_pStream = &tStream;
+
 				if ( HandleMysqlSelect ( tOut, tHandler ) )
 				{
 					// query just completed ok; reset out error message
 					m_sError = "";
 					AggrResult_t & tLast = tHandler.m_dResults.Last();
-					SendMysqlSelectResult ( tOut, tLast, false );
+					if ( !tStream.Finish ( tLast ) )
+						SendMysqlSelectResult ( tOut, tLast, false );
 				}
 
 				// save meta for SHOW META (profile is saved elsewhere)
@@ -16318,7 +16648,7 @@ public:
 			m_tLastMeta.m_sError = m_sError;
 			m_tLastMeta.m_sWarning = "";
 			HandleMysqlInsert ( tOut, *pStmt, eStmt==STMT_REPLACE,
-				m_tVars.m_bAutoCommit && !m_tVars.m_bInTransaction, m_tLastMeta.m_sWarning, m_tAcc );
+				m_tVars.m_bAutoCommit && !m_tVars.m_bInTransaction, m_tVars.m_bBulkLoad, m_tLastMeta.m_sWarning, m_tAcc );
 			return true;
 
 		case STMT_DELETE:
@@ -16347,7 +16677,12 @@ public:
 						tOut.Error ( sQuery.cstr(), m_sError.cstr() );
 						return true;
 					}
-					pIndex->Commit ( NULL, pAccum );
+					if ( m_tVars.m_bBulkLoad && !pIndex->BulkCommit ( NULL, pAccum ) )
+					{
+						tOut.Error ( sQuery.cstr(), pIndex->GetLastError().cstr() );
+						return true;
+					} else if ( !m_tVars.m_bBulkLoad )
+						pIndex->Commit ( NULL, pAccum );
 				}
 				tOut.Ok();
 				return true;
@@ -16367,7 +16702,14 @@ public:
 						tOut.Error ( sQuery.cstr(), m_sError.cstr() );
 						return true;
 					}
-					if ( eStmt==STMT_COMMIT )
+					if ( eStmt==STMT_COMMIT && m_tVars.m_bBulkLoad )
+					{
+						if ( !pIndex->BulkCommit ( NULL, pAccum ) )
+						{
+							tOut.Error ( sQuery.cstr(), pIndex->GetLastError().cstr() );
+							return true;
+						}
+					} else if ( eStmt==STMT_COMMIT )
 						pIndex->Commit ( NULL, pAccum );
 					else
 						pIndex->RollBack ( pAccum );
@@ -17729,13 +18071,56 @@ static void SphinxqlStateRead ( const CSphString & sName )
 
 //////////////////////////////////////////////////////////////////////////
 
+/// daemon is idle enough for background compaction when fewer queries than cores are running
+static bool IsDaemonIdle ()
+{
+	int iQueries = 0;
+	g_tThdMutex.Lock();
+	for ( const ListNode_t * pIt = g_dThd.Begin(); pIt!=g_dThd.End(); pIt = pIt->m_pNext )
+		iQueries += ( ( (const ThdDesc_t *)pIt )->m_eThdState==THD_QUERY );
+	g_tThdMutex.Unlock();
+
+	return iQueries<sphCpuThreadsCount();
+}
+
+
+/// merge the disk chunks of rt indexes their compaction policy picks
+static void CompactRtIndexes ()
+{
+	CSphVector<CSphString> dRtIndexes;
+	for ( IndexHashIterator_c it ( g_pLocalIndexes ); it.Next(); )
+		if ( it.Get().m_bRT )
+			dRtIndexes.Add ( it.GetKey() );
+
+	ARRAY_FOREACH_COND ( i, dRtIndexes, !g_bShutdown && !g_dOptimizeQueue.GetLength() )
+	{
+		const ServedIndex_c * pServed = g_pLocalIndexes->GetRlockedEntry ( dRtIndexes[i] );
+		if ( !pServed )
+			continue;
+
+		if ( pServed->m_pIndex && pServed->m_bEnabled )
+			static_cast<ISphRtIndex *>( pServed->m_pIndex )->Compact ( &g_bShutdown, &g_tRtThrottle );
+
+		pServed->Unlock();
+	}
+}
+
+
 void OptimizeThreadFunc ( void * )
 {
+	int64_t tmNextCompact = sphMicroTimer() + int64_t(g_iRtCompactInterval)*I64C(1000000);
 	while ( !g_bShutdown )
 	{
-		// stand still till optimize time
+		// stand still till optimize time, compacting rt indexes every now and then while idle
 		if ( !g_dOptimizeQueue.GetLength() )
 		{
+			if ( g_iRtCompactInterval && tmNextCompact<=sphMicroTimer() )
+			{
+				if ( IsDaemonIdle() )
+					CompactRtIndexes();
+				tmNextCompact = sphMicroTimer() + int64_t(g_iRtCompactInterval)*I64C(1000000);
+			}
+
 			sphSleepMsec ( 50 );
 			continue;
 		}
@@ -21821,6 +22206,10 @@ void ConfigureSearchd ( const CSphConfig & hConf, bool bOptPIDFile )
 	if ( hSearchd("subtree_hits_cache") )
 		g_iMaxCachedHits = hSearchd.GetSize ( "subtree_hits_cache", g_iMaxCachedHits );
 
+	g_iGroupbyMemory = hSearchd.GetSize64 ( "groupby_memory", g_iGroupbyMemory );
+	if ( hSearchd("groupby_tmpdir") )
+		g_sGroupbyTmpDir = hSearchd["groupby_tmpdir"].strval();
+
 	if ( hSearchd("seamless_rotate") )
 		g_bSeamlessRotate = ( hSearchd["seamless_rotate"].intval()!=0 );
 
@@ -21835,6 +22224,7 @@ void ConfigureSearchd ( const CSphConfig & hConf, bool bOptPIDFile )
 	g_iDistThreads = hSearchd.GetInt ( "dist_threads", g_iDistThreads );
 	g_tRtThrottle.m_iMaxIOps = hSearchd.GetInt ( "rt_merge_iops", 0 );
 	g_tRtThrottle.m_iMaxIOSize = hSearchd.GetSize ( "rt_merge_maxiosize", 0 );
+	g_iRtCompactInterval = Max ( hSearchd.GetInt ( "rt_compact_interval", g_iRtCompactInterval ), 0 );
 	g_iPingInterval = hSearchd.GetInt ( "ha_ping_interval", 1000 );
 	g_uHAPeriodKarma = hSearchd.GetInt ( "ha_period_karma", 60 );
 	g_iQueryLogMinMsec = hSearchd.GetInt ( "query_log_min_msec", g_iQueryLogMinMsec );
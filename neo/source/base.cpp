@@ -337,6 +337,7 @@ namespace NEO {
 		m_dPrefixFields = tSettings.m_dPrefixFields;
 		m_dInfixFields = tSettings.m_dInfixFields;
 		m_bIndexFieldLens = tSettings.m_bIndexFieldLens;
+		m_sJsonAttrs = tSettings.m_sJsonAttrs;
 	}
 
 
@@ -28,6 +28,7 @@ namespace NEO {
 
 		CSphVector<CSphString>	m_dPrefixFields;	///< list of prefix fields
 		CSphVector<CSphString>	m_dInfixFields;		///< list of infix fields
+		CSphString				m_sJsonAttrs;		///< generated attributes spec, name:type:path (comma separated)
 
 		explicit				CSphSourceSettings();
 		ESphWordpart			GetWordpart(const char* sField, bool bWordDict);
@@ -31,6 +31,7 @@ namespace NEO {
 		bool							m_bPayload;
 		bool							m_bFilename;	///< column is a file name
 		bool							m_bWeight;		///< is a weight column
+		CSphString						m_sJsonPath;	///< canonical JSON path this attribute is generated from (see json_attrs)
 
 		WORD							m_uNext;		///< next in linked list for hash in CSphSchema
 
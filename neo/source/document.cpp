@@ -3,6 +3,7 @@
 #include "neo/utility/log.h"
 #include "neo/tools/convert.h"
 #include "neo/source/hitman.h"
+#include "neo/source/json_attrs.h"
 #include "neo/dict/dict.h"
 #include "neo/tokenizer/tokenizer.h"
 #include "neo/utility/inline_misc.h"
@@ -275,8 +276,12 @@ namespace NEO {
 	bool CSphSource_Document::AddAutoAttrs(CSphString& sError)
 	{
 		// auto-computed length attributes
-		if (m_bIndexFieldLens)
-			return AddFieldLens(m_tSchema, true, sError);
+		if (m_bIndexFieldLens && !AddFieldLens(m_tSchema, true, sError))
+			return false;
+
+		// generated attributes, computed from JSON paths by the indexer
+		if (!m_sJsonAttrs.IsEmpty())
+			return sphJsonAttrsAddToSchema(m_tSchema, m_sJsonAttrs, true, sError);
 		return true;
 	}
 
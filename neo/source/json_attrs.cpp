@@ -0,0 +1,417 @@
+#include "neo/source/json_attrs.h"
+#include "neo/sphinx/xjson.h"
+#include "neo/sphinx/xutility.h"
+#include "neo/tools/convert.h"
+#include "neo/tools/utf8_tools.h"
+#include "neo/utility/inline_misc.h"
+
+namespace NEO {
+
+	CSphJsonAttr::CSphJsonAttr()
+		: m_eType(ESphAttr::SPH_ATTR_NONE)
+		, m_iJsonAttr(-1)
+	{}
+
+
+	static ESphAttr JsonAttrType(const CSphString& sType)
+	{
+		if (sType == "uint")		return ESphAttr::SPH_ATTR_INTEGER;
+		if (sType == "bigint")		return ESphAttr::SPH_ATTR_BIGINT;
+		if (sType == "float")		return ESphAttr::SPH_ATTR_FLOAT;
+		if (sType == "bool")		return ESphAttr::SPH_ATTR_BOOL;
+		if (sType == "timestamp")	return ESphAttr::SPH_ATTR_TIMESTAMP;
+		return ESphAttr::SPH_ATTR_NONE;
+	}
+
+
+	bool sphJsonAttrParsePath(const char* sPath, CSphJsonAttr& tAttr, CSphString& sError)
+	{
+		const char* p = sPath;
+		while (isspace(*p))
+			p++;
+
+		const char* sColumn = p;
+		while (sphIsAttr(*p))
+			p++;
+
+		if (p == sColumn)
+		{
+			sError.SetSprintf("invalid JSON path '%s' (column name expected)", sPath);
+			return false;
+		}
+
+		tAttr.m_sColumn.SetBinary(sColumn, int(p - sColumn));
+		tAttr.m_sColumn.ToLower();
+		tAttr.m_sPath = tAttr.m_sColumn;
+		tAttr.m_dSteps.Reset();
+
+		CSphString sStep;
+		while (*p)
+		{
+			while (isspace(*p))
+				p++;
+			if (!*p)
+				break;
+
+			JsonAttrStep_t tStep;
+			tStep.m_iIndex = -1;
+			tStep.m_uMask = 0;
+
+			if (*p == '.')
+			{
+				// .key
+				p++;
+				while (isspace(*p))
+					p++;
+				const char* sKey = p;
+				while (sphIsAttr(*p))
+					p++;
+				if (p == sKey)
+				{
+					sError.SetSprintf("invalid JSON path '%s' (key name expected)", sPath);
+					return false;
+				}
+				tStep.m_sKey.SetBinary(sKey, int(p - sKey));
+
+			}
+			else if (*p == '[')
+			{
+				// [index] or ['key']
+				p++;
+				while (isspace(*p))
+					p++;
+				if (*p == '\'' || *p == '"')
+				{
+					const char cQuote = *p++;
+					const char* sKey = p;
+					while (*p && *p != cQuote)
+						p++;
+					if (!*p)
+					{
+						sError.SetSprintf("invalid JSON path '%s' (unterminated key name)", sPath);
+						return false;
+					}
+					tStep.m_sKey.SetBinary(sKey, int(p - sKey));
+					p++;
+
+				}
+				else if (isdigit(*p))
+				{
+					char* sEnd = NULL;
+					tStep.m_iIndex = (int)strtol(p, &sEnd, 10);
+					p = sEnd;
+
+				}
+				else
+				{
+					sError.SetSprintf("invalid JSON path '%s' (only constant keys and indexes are supported)", sPath);
+					return false;
+				}
+
+				while (isspace(*p))
+					p++;
+				if (*p != ']')
+				{
+					sError.SetSprintf("invalid JSON path '%s' (']' expected)", sPath);
+					return false;
+				}
+				p++;
+
+			}
+			else
+			{
+				sError.SetSprintf("invalid JSON path '%s' (unexpected '%c')", sPath, *p);
+				return false;
+			}
+
+			if (tStep.m_iIndex < 0)
+			{
+				tStep.m_uMask = sphJsonKeyMask(tStep.m_sKey.cstr(), tStep.m_sKey.Length());
+				sStep.SetSprintf("%s.%s", tAttr.m_sPath.cstr(), tStep.m_sKey.cstr());
+			}
+			else
+				sStep.SetSprintf("%s[%d]", tAttr.m_sPath.cstr(), tStep.m_iIndex);
+
+			tAttr.m_sPath.SwapWith(sStep);
+			tAttr.m_dSteps.Add(tStep);
+		}
+
+		// root is always an object
+		if (!tAttr.m_dSteps.GetLength() || tAttr.m_dSteps[0].m_iIndex >= 0)
+		{
+			sError.SetSprintf("invalid JSON path '%s' (must start with a key)", sPath);
+			return false;
+		}
+		return true;
+	}
+
+
+	/// split the spec on commas, but those within quoted keys
+	static void SplitJsonAttrsSpec(const char* sSpec, CSphVector<CSphString>& dItems)
+	{
+		const char* sItem = sSpec;
+		char cQuote = 0;
+		for (const char* p = sSpec; p && *p; p++)
+		{
+			if (cQuote)
+			{
+				if (*p == cQuote)
+					cQuote = 0;
+			}
+			else if (*p == '\'' || *p == '"')
+				cQuote = *p;
+			else if (*p == ',')
+			{
+				dItems.Add().SetBinary(sItem, int(p - sItem));
+				sItem = p + 1;
+			}
+		}
+
+		if (sItem && *sItem)
+			dItems.Add() = sItem;
+	}
+
+
+	bool sphJsonAttrsParse(const CSphString& sSpec, CSphVector<CSphJsonAttr>& dAttrs, CSphString& sError)
+	{
+		dAttrs.Reset();
+
+		CSphVector<CSphString> dItems;
+		SplitJsonAttrsSpec(sSpec.cstr(), dItems);
+		ARRAY_FOREACH(i, dItems)
+		{
+			dItems[i].Trim();
+			if (dItems[i].IsEmpty())
+				continue;
+
+			// name:type:path, the path itself might have colons in quoted keys
+			const char* sItem = dItems[i].cstr();
+			const char* pType = strchr(sItem, ':');
+			const char* pPath = pType ? strchr(pType + 1, ':') : NULL;
+			if (!pPath)
+			{
+				sError.SetSprintf("json_attrs: '%s' must be in name:type:path form", sItem);
+				return false;
+			}
+
+			CSphString dParts[3];
+			dParts[0].SetBinary(sItem, int(pType - sItem));
+			dParts[1].SetBinary(pType + 1, int(pPath - pType - 1));
+			dParts[2] = pPath + 1;
+			for (int j = 0; j < 3; j++)
+				dParts[j].Trim();
+
+			CSphJsonAttr& tAttr = dAttrs.Add();
+			tAttr.m_sName = dParts[0];
+			tAttr.m_sName.ToLower();
+			tAttr.m_eType = JsonAttrType(dParts[1].ToLower());
+
+			if (tAttr.m_sName.IsEmpty())
+			{
+				sError.SetSprintf("json_attrs: '%s' has no attribute name", dItems[i].cstr());
+				return false;
+			}
+
+			if (tAttr.m_eType == ESphAttr::SPH_ATTR_NONE)
+			{
+				sError.SetSprintf("json_attrs: attribute '%s' has unsupported type '%s' (must be uint, bigint, float, bool, or timestamp)",
+					tAttr.m_sName.cstr(), dParts[1].cstr());
+				return false;
+			}
+
+			CSphString sPathError;
+			if (!sphJsonAttrParsePath(dParts[2].cstr(), tAttr, sPathError))
+			{
+				sError.SetSprintf("json_attrs: attribute '%s': %s", tAttr.m_sName.cstr(), sPathError.cstr());
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+
+	static bool CheckJsonColumn(const CSphSchema& tSchema, const CSphJsonAttr& tAttr, CSphString& sError)
+	{
+		int iJson = tSchema.GetAttrIndex(tAttr.m_sColumn.cstr());
+		if (iJson < 0 || tSchema.GetAttr(iJson).m_eAttrType != ESphAttr::SPH_ATTR_JSON)
+		{
+			sError.SetSprintf("json_attrs: attribute '%s': '%s' is not a JSON attribute", tAttr.m_sName.cstr(), tAttr.m_sColumn.cstr());
+			return false;
+		}
+		return true;
+	}
+
+
+	bool sphJsonAttrsAddToSchema(CSphSchema& tSchema, const CSphString& sSpec, bool bDynamic, CSphString& sError)
+	{
+		CSphVector<CSphJsonAttr> dAttrs;
+		if (!sphJsonAttrsParse(sSpec, dAttrs, sError))
+			return false;
+
+		ARRAY_FOREACH(i, dAttrs)
+		{
+			const CSphJsonAttr& tAttr = dAttrs[i];
+			if (!CheckJsonColumn(tSchema, tAttr, sError))
+				return false;
+
+			int iGot = tSchema.GetAttrIndex(tAttr.m_sName.cstr());
+			if (iGot >= 0)
+			{
+				// sources might add auto attributes more than once
+				if (tSchema.GetAttr(iGot).m_sJsonPath == tAttr.m_sPath && tSchema.GetAttr(iGot).m_eAttrType == tAttr.m_eType)
+					continue;
+
+				sError.SetSprintf("json_attrs: attribute '%s' conflicts with an existing attribute", tAttr.m_sName.cstr());
+				return false;
+			}
+
+			CSphColumnInfo tCol(tAttr.m_sName.cstr(), tAttr.m_eType);
+			tCol.m_sJsonPath = tAttr.m_sPath;
+			tSchema.AddAttr(tCol, bDynamic);
+		}
+		return true;
+	}
+
+
+	bool sphJsonAttrsSetup(CSphSchema& tSchema, const CSphString& sSpec, CSphVector<CSphJsonAttr>& dAttrs, CSphString& sError)
+	{
+		if (!sphJsonAttrsParse(sSpec, dAttrs, sError))
+			return false;
+
+		ARRAY_FOREACH(i, dAttrs)
+		{
+			CSphJsonAttr& tAttr = dAttrs[i];
+			if (!CheckJsonColumn(tSchema, tAttr, sError))
+				return false;
+
+			int iAttr = tSchema.GetAttrIndex(tAttr.m_sName.cstr());
+			if (iAttr < 0 || tSchema.GetAttr(iAttr).m_eAttrType != tAttr.m_eType)
+			{
+				sError.SetSprintf("json_attrs: attribute '%s' is missing or has a different type in the index schema", tAttr.m_sName.cstr());
+				return false;
+			}
+
+			tAttr.m_iJsonAttr = tSchema.GetAttrIndex(tAttr.m_sColumn.cstr());
+			tAttr.m_tLocator = tSchema.GetAttr(iAttr).m_tLocator;
+			tSchema.m_dAttrs[iAttr].m_sJsonPath = tAttr.m_sPath;
+		}
+		return true;
+	}
+
+
+	void sphJsonAttrsEval(CSphMatch& tDoc, const CSphVector<CSphJsonAttr>& dAttrs, int iJsonAttr, const BYTE* pBlob, int iBlobLen)
+	{
+		sphJsonAttrsEval(tDoc.m_pDynamic, dAttrs, iJsonAttr, pBlob, iBlobLen);
+	}
+
+
+	void sphJsonAttrsEval(CSphRowitem* pRow, const CSphVector<CSphJsonAttr>& dAttrs, int iJsonAttr, const BYTE* pBlob, int iBlobLen)
+	{
+		ARRAY_FOREACH(i, dAttrs)
+		{
+			const CSphJsonAttr& tAttr = dAttrs[i];
+			if (tAttr.m_iJsonAttr != iJsonAttr)
+				continue;
+
+			// missing values (and values that are not numbers) become zeroes
+			int64_t iValue = 0;
+			double fValue = 0.0;
+
+			if (pBlob && iBlobLen)
+			{
+				const BYTE* p = pBlob;
+				ESphJsonType eType = JSON_ROOT;
+				ARRAY_FOREACH_COND(j, tAttr.m_dSteps, eType != JSON_EOF)
+				{
+					const JsonAttrStep_t& tStep = tAttr.m_dSteps[j];
+					if (tStep.m_iIndex >= 0)
+						eType = sphJsonFindByIndex(eType, &p, tStep.m_iIndex);
+					else
+						eType = sphJsonFindByKey(eType, &p, tStep.m_sKey.cstr(), tStep.m_sKey.Length(), tStep.m_uMask, j ? NULL : pBlob + iBlobLen);
+				}
+
+				switch (eType)
+				{
+				case JSON_INT32:	iValue = sphJsonLoadInt(&p); fValue = (double)iValue; break;
+				case JSON_INT64:	iValue = sphJsonLoadBigint(&p); fValue = (double)iValue; break;
+				case JSON_DOUBLE:	fValue = sphQW2D(sphJsonLoadBigint(&p)); iValue = (int64_t)fValue; break;
+				case JSON_TRUE:		iValue = 1; fValue = 1.0; break;
+				case JSON_STRING:
+					{
+						int iLen = sphJsonUnpackInt(&p);
+						ESphJsonType eNum;
+						if (sphJsonStringToNumber((const char*)p, iLen, eNum, iValue, fValue))
+						{
+							if (eNum == JSON_DOUBLE)
+								iValue = (int64_t)fValue;
+							else
+								fValue = (double)iValue;
+						}
+						else
+						{
+							iValue = 0;
+							fValue = 0.0;
+						}
+						break;
+					}
+				default:
+					break;
+				}
+			}
+
+			if (tAttr.m_eType == ESphAttr::SPH_ATTR_FLOAT)
+				sphSetRowAttr(pRow, tAttr.m_tLocator, sphF2DW((float)fValue));
+			else if (tAttr.m_eType == ESphAttr::SPH_ATTR_BOOL)
+				sphSetRowAttr(pRow, tAttr.m_tLocator, iValue != 0);
+			else
+				sphSetRowAttr(pRow, tAttr.m_tLocator, iValue);
+		}
+	}
+
+
+	void sphJsonAttrsRefresh(CSphRowitem* pRow, const CSphVector<CSphJsonAttr>& dAttrs, const ISphSchema& tSchema, const BYTE* pStrings)
+	{
+		ARRAY_FOREACH(i, dAttrs)
+		{
+			// one pass per source column
+			int iJsonAttr = dAttrs[i].m_iJsonAttr;
+			bool bSeen = ARRAY_ANY(bSeen, dAttrs, _any < i && dAttrs[_any].m_iJsonAttr == iJsonAttr);
+			if (bSeen || iJsonAttr < 0)
+				continue;
+
+			const BYTE* pBlob = NULL;
+			int iBlobLen = 0;
+			SphAttr_t uOff = sphGetRowAttr(pRow, tSchema.GetAttr(iJsonAttr).m_tLocator);
+			if (uOff && pStrings)
+				iBlobLen = sphUnpackStr(pStrings + uOff, &pBlob);
+
+			sphJsonAttrsEval(pRow, dAttrs, iJsonAttr, pBlob, iBlobLen);
+		}
+	}
+
+
+	void sphJsonAttrsUntag(CSphSchema& tSchema)
+	{
+		ARRAY_FOREACH(i, tSchema.m_dAttrs)
+			tSchema.m_dAttrs[i].m_sJsonPath = "";
+	}
+
+
+	int sphJsonAttrFind(const ISphSchema& tSchema, const char* sPath)
+	{
+		if (!sPath || !strpbrk(sPath, ".["))
+			return -1;
+
+		CSphJsonAttr tAttr;
+		CSphString sError;
+		if (!sphJsonAttrParsePath(sPath, tAttr, sError))
+			return -1;
+
+		for (int i = 0; i < tSchema.GetAttrsCount(); i++)
+			if (tSchema.GetAttr(i).m_sJsonPath == tAttr.m_sPath)
+				return i;
+		return -1;
+	}
+
+}
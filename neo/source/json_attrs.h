@@ -0,0 +1,63 @@
+#pragma once
+#include "neo/int/types.h"
+#include "neo/source/schema.h"
+#include "neo/core/match.h"
+
+namespace NEO {
+
+	/// generated (JSON path) attributes
+	/// json_attrs = name:type:path [, ...], e.g. json_attrs = brand_id:uint:attrs.brand, price:float:attrs.price
+	/// the path value is extracted once at indexing time and stored as a regular typed attribute;
+	/// queries that reference the same constant path are then served from that attribute
+
+	/// one path step, either a key or an array index
+	struct JsonAttrStep_t
+	{
+		CSphString		m_sKey;			///< key name (for object steps)
+		DWORD			m_uMask;		///< key bloom mask (for object steps)
+		int				m_iIndex;		///< array index, or -1 for object steps
+	};
+
+
+	/// generated attribute
+	struct CSphJsonAttr
+	{
+		CSphString					m_sName;		///< attribute name
+		ESphAttr					m_eType;		///< attribute type (integer, bigint, bool, timestamp, or float)
+		CSphString					m_sColumn;		///< source JSON attribute name
+		CSphString					m_sPath;		///< canonical path (as in jsoncol.key1[2].key3)
+		CSphVector<JsonAttrStep_t>	m_dSteps;		///< path steps after the column
+		int							m_iJsonAttr;	///< source JSON attribute index in the schema
+		CSphAttrLocator				m_tLocator;		///< generated attribute locator
+
+		CSphJsonAttr();
+	};
+
+
+	/// parse a path into the column name, steps, and canonical form
+	bool	sphJsonAttrParsePath(const char* sPath, CSphJsonAttr& tAttr, CSphString& sError);
+
+	/// parse json_attrs spec
+	bool	sphJsonAttrsParse(const CSphString& sSpec, CSphVector<CSphJsonAttr>& dAttrs, CSphString& sError);
+
+	/// add generated attributes to the (indexing time) schema; the source JSON attributes must already be there
+	bool	sphJsonAttrsAddToSchema(CSphSchema& tSchema, const CSphString& sSpec, bool bDynamic, CSphString& sError);
+
+	/// bind generated attributes to an existing schema, and tag their columns with canonical paths
+	bool	sphJsonAttrsSetup(CSphSchema& tSchema, const CSphString& sSpec, CSphVector<CSphJsonAttr>& dAttrs, CSphString& sError);
+
+	/// compute generated attributes that originate from a given JSON attribute; NULL blob zeroes them out
+	void	sphJsonAttrsEval(CSphMatch& tDoc, const CSphVector<CSphJsonAttr>& dAttrs, int iJsonAttr, const BYTE* pBlob, int iBlobLen);
+	void	sphJsonAttrsEval(CSphRowitem* pRow, const CSphVector<CSphJsonAttr>& dAttrs, int iJsonAttr, const BYTE* pBlob, int iBlobLen);
+
+	/// recompute all generated attributes of a stored row (attributes, no docid) from the JSON blobs it points to, eg. after an in-place JSON update
+	void	sphJsonAttrsRefresh(CSphRowitem* pRow, const CSphVector<CSphJsonAttr>& dAttrs, const ISphSchema& tSchema, const BYTE* pStrings);
+
+	/// drop the path tags off generated attributes, so that expressions parsed against the schema keep walking the JSON blobs
+	/// (in-place JSON updates need the blob values, not the generated copies)
+	void	sphJsonAttrsUntag(CSphSchema& tSchema);
+
+	/// find a generated attribute by (any spelling of) its path, returns attribute index or -1
+	int		sphJsonAttrFind(const ISphSchema& tSchema, const char* sPath);
+
+}
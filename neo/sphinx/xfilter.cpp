@@ -20,6 +20,9 @@
 #include "neo/tools/docinfo_transformer.h"
 #include "neo/core/kill_list_trait.h"
 #include "neo/core/match.h"
+#include "neo/core/mva_intersect.h"
+#include "neo/source/json_attrs.h"
+#include "neo/core/geo_dist.h"
 
 #include "neo/sphinx/xfilter.h"
 #include "neo/sphinxint.h"
@@ -421,28 +424,9 @@ struct Filter_MVAValues_Any : public IFilter_MVA, IFilter_Values
 
 	bool MvaEval ( const DWORD * pMva, const DWORD * pMvaMax ) const
 	{
-		const SphAttr_t * pFilter = m_pValues;
-		const SphAttr_t * pFilterMax = pFilter + m_iValueCount;
-
 		const T * L = (const T *)pMva;
 		const T * R = (const T *)pMvaMax;
-		R--;
-		for ( ; pFilter < pFilterMax; pFilter++ )
-		{
-			while ( L<=R )
-			{
-				const T * pVal = L + (R - L) / 2;
-				if ( *pFilter > *pVal )
-					L = pVal + 1;
-				else if ( *pFilter < *pVal )
-					R = pVal - 1;
-				else
-					return true;
-			}
-			R = (const T *)pMvaMax;
-			R--;
-		}
-		return false;
+		return sphMvaAny ( L, int ( R-L ), m_pValues, m_iValueCount );
 	}
 };
 
@@ -463,14 +447,7 @@ struct Filter_MVAValues_All : public IFilter_MVA, IFilter_Values
 	{
 		const T * L = (const T *)pMva;
 		const T * R = (const T *)pMvaMax;
-
-		for ( const T * pVal=L; pVal<R; pVal++ )
-		{
-			const SphAttr_t iCheck = *pVal;
-			if ( !sphBinarySearch ( m_pValues, m_pValues + m_iValueCount - 1, iCheck ) )
-				return false;
-		}
-		return true;
+		return sphMvaAll ( L, int ( R-L ), m_pValues, m_iValueCount );
 	}
 };
 
@@ -576,6 +553,10 @@ protected:
 	const BYTE *			m_pStringBase;
 	bool					m_bPacked;
 
+	const CSphStringDict *	m_pDict;		///< string attribute dictionary over m_pStringBase (if any)
+	CSphVector<SphAttr_t>	m_dDictHits;	///< dictionary codes (offsets) that match the reference value(s), sorted
+	bool					m_bDictActive;	///< whether dictionary codes are valid against current string storage
+
 public:
 	FilterString_c ( ESphCollation eCollation, ESphAttr eType, bool bEq )
 		: m_dVal ( 0 )
@@ -583,8 +564,41 @@ public:
 		, m_fnStrCmp ( CmpFn ( eCollation ) )
 		, m_pStringBase ( NULL )
 		, m_bPacked ( eType==ESphAttr::SPH_ATTR_STRING )
+		, m_pDict ( NULL )
+		, m_bDictActive ( false )
 	{}
 
+	virtual void SetStringDict ( const CSphStringDict * pDict )
+	{
+		m_pDict = ( m_bPacked && pDict && !pDict->IsEmpty() ) ? pDict : NULL;
+		m_dDictHits.Resize ( 0 );
+		if ( m_pDict )
+			CollectDictHits();
+		m_bDictActive = m_pDict && m_pDict->GetPool()==m_pStringBase;
+	}
+
+protected:
+	/// resolve reference value(s) into matching dictionary codes, once per query
+	virtual void CollectDictHits ()
+	{
+		const BYTE * pRef = NULL;
+		int iLen = sphUnpackStr ( m_dVal.Begin(), &pRef );
+		m_pDict->FindMatching ( pRef, iLen, m_fnStrCmp, m_dDictHits );
+	}
+
+	/// check a value against dictionary codes; only valid for values within the dictionary region
+	inline bool IsDictHit ( SphAttr_t uVal ) const
+	{
+		switch ( m_dDictHits.GetLength() )
+		{
+			case 0:		return false;
+			case 1:		return m_dDictHits[0]==uVal;
+			default:	return m_dDictHits.BinarySearch ( uVal )!=NULL;
+		}
+	}
+
+public:
+
 	virtual void SetRefString ( const CSphString * pRef, int iCount )
 	{
 		assert ( iCount<2 );
@@ -606,6 +620,7 @@ public:
 	virtual void SetStringStorage ( const BYTE * pStrings )
 	{
 		m_pStringBase = pStrings;
+		m_bDictActive = m_pDict && m_pDict->GetPool()==m_pStringBase;
 	}
 
 	virtual bool Eval ( const CSphMatch & tMatch ) const
@@ -615,6 +630,10 @@ public:
 
 		SphAttr_t uVal = tMatch.GetAttr ( m_tLocator );
 
+		// dictionary-encoded value, compare codes rather than strings
+		if ( m_bDictActive && m_pDict->Contains ( uVal ) )
+			return ( m_bEq==IsDictHit ( uVal ) );
+
 		const BYTE * pStr;
 		if ( !uVal )
 			pStr = (const BYTE*)"\0"; // 2 bytes, for packed strings
@@ -666,10 +685,28 @@ struct Filter_StringValues_c: FilterString_c
 		}
 	}
 
+	virtual void CollectDictHits ()
+	{
+		CSphVector<SphAttr_t> dHits;
+		ARRAY_FOREACH ( i, m_dOfs )
+		{
+			const BYTE * pRef = NULL;
+			int iLen = sphUnpackStr ( m_dVal.Begin() + m_dOfs[i], &pRef );
+			m_pDict->FindMatching ( pRef, iLen, m_fnStrCmp, dHits );
+			ARRAY_FOREACH ( j, dHits )
+				m_dDictHits.Add ( dHits[j] );
+		}
+		m_dDictHits.Uniq();
+	}
+
 	virtual bool Eval ( const CSphMatch & tMatch ) const
 	{
 		SphAttr_t uVal = tMatch.GetAttr ( m_tLocator );
 
+		// dictionary-encoded value, compare codes rather than strings
+		if ( m_bDictActive && m_pDict->Contains ( uVal ) )
+			return IsDictHit ( uVal );
+
 		const BYTE * pStr;
 		if ( !uVal )
 			pStr = (const BYTE*)"\0";
@@ -733,6 +770,12 @@ struct Filter_And2 : public ISphFilter
 		m_pArg1->SetStringStorage ( pStrings );
 		m_pArg2->SetStringStorage ( pStrings );
 	}
+
+	virtual void SetStringDict ( const CSphStringDict * pDict )
+	{
+		m_pArg1->SetStringDict ( pDict );
+		m_pArg2->SetStringDict ( pDict );
+	}
 };
 
 
@@ -787,6 +830,13 @@ struct Filter_And3 : public ISphFilter
 		m_pArg2->SetStringStorage ( pStrings );
 		m_pArg3->SetStringStorage ( pStrings );
 	}
+
+	virtual void SetStringDict ( const CSphStringDict * pDict )
+	{
+		m_pArg1->SetStringDict ( pDict );
+		m_pArg2->SetStringDict ( pDict );
+		m_pArg3->SetStringDict ( pDict );
+	}
 };
 
 
@@ -846,6 +896,12 @@ struct Filter_And: public ISphFilter
 			m_dFilters[i]->SetStringStorage ( pStrings );
 	}
 
+	virtual void SetStringDict ( const CSphStringDict * pDict )
+	{
+		ARRAY_FOREACH ( i, m_dFilters )
+			m_dFilters[i]->SetStringDict ( pDict );
+	}
+
 	virtual ISphFilter * Optimize()
 	{
 		if ( m_dFilters.GetLength()==2 )
@@ -905,8 +961,80 @@ struct Filter_Not: public ISphFilter
 	{
 		m_pFilter->SetStringStorage ( pStrings );
 	}
+
+	virtual void SetStringDict ( const CSphStringDict * pDict )
+	{
+		m_pFilter->SetStringDict ( pDict );
+	}
 };
 
+// geodist
+
+/// geodist() upper bound filter that also rejects blocks whose lat/lon box is too far from the anchor
+struct Filter_GeodistBlock: public ISphFilter
+{
+	ISphFilter *	m_pFilter;
+	GeodistInfo_t	m_tGeo;
+	float			m_fMaxDist;
+
+	Filter_GeodistBlock ( ISphFilter * pFilter, const GeodistInfo_t & tGeo, float fMaxDist )
+		: m_pFilter ( pFilter )
+		, m_tGeo ( tGeo )
+		, m_fMaxDist ( fMaxDist )
+	{
+		assert ( pFilter );
+		m_bUsesAttrs = pFilter->UsesAttrs();
+	}
+
+	~Filter_GeodistBlock ()
+	{
+		SafeDelete ( m_pFilter );
+	}
+
+	virtual bool Eval ( const CSphMatch & tMatch ) const
+	{
+		return m_pFilter->Eval ( tMatch );
+	}
+
+	virtual bool EvalBlock ( const DWORD * pMinDocinfo, const DWORD * pMaxDocinfo ) const
+	{
+		float fLatMin = sphDW2F ( (DWORD)sphGetRowAttr ( DOCINFO2ATTRS ( pMinDocinfo ), m_tGeo.m_tLat ) );
+		float fLatMax = sphDW2F ( (DWORD)sphGetRowAttr ( DOCINFO2ATTRS ( pMaxDocinfo ), m_tGeo.m_tLat ) );
+		float fLonMin = sphDW2F ( (DWORD)sphGetRowAttr ( DOCINFO2ATTRS ( pMinDocinfo ), m_tGeo.m_tLon ) );
+		float fLonMax = sphDW2F ( (DWORD)sphGetRowAttr ( DOCINFO2ATTRS ( pMaxDocinfo ), m_tGeo.m_tLon ) );
+
+		// not-reject
+		return sphGeodistLowerBound ( m_tGeo, fLatMin, fLatMax, fLonMin, fLonMax )<=m_fMaxDist;
+	}
+};
+
+
+bool sphGetGeodistAttr ( const ISphSchema & tSchema, const char * sAttr, GeodistInfo_t & tGeo )
+{
+	int iAttr = tSchema.GetAttrIndex ( sAttr );
+	if ( iAttr<0 || !tSchema.GetAttr(iAttr).m_pExpr.Ptr() )
+		return false;
+
+	// commands propagate to subexpressions, so check that it is geodist() itself that answered
+	ISphExpr * pExpr = tSchema.GetAttr(iAttr).m_pExpr.Ptr();
+	tGeo = GeodistInfo_t();
+	pExpr->Command ( SPH_EXPR_GET_GEODIST, &tGeo );
+	return tGeo.m_pExpr==pExpr && !tGeo.m_tLat.m_bDynamic && !tGeo.m_tLon.m_bDynamic;
+}
+
+
+bool sphGetGeodistFilter ( const CSphFilterSettings & tSettings, const ISphSchema & tSchema, GeodistInfo_t & tGeo, float & fMaxDist )
+{
+	if ( tSettings.m_bExclude || ( tSettings.m_eType!=SPH_FILTER_FLOATRANGE && tSettings.m_eType!=SPH_FILTER_RANGE ) )
+		return false;
+
+	if ( !sphGetGeodistAttr ( tSchema, tSettings.m_sAttrName.cstr(), tGeo ) )
+		return false;
+
+	fMaxDist = ( tSettings.m_eType==SPH_FILTER_FLOATRANGE ) ? tSettings.m_fMaxValue : (float)tSettings.m_iMaxValue;
+	return true;
+}
+
 /// impl
 
 ISphFilter * ISphFilter::Join ( ISphFilter * pFilter )
@@ -1324,12 +1452,64 @@ struct Filter_KillList : public ISphFilter
 };
 
 
+/// rejects docinfo rows by number, so the match must point right into the docinfo it was made for
+struct Filter_DeadRows : public ISphFilter
+{
+	const CSphBitvec &	m_tDeadRows;
+	const DWORD *		m_pFirstRow;
+	int					m_iStride;
+
+	Filter_DeadRows ( const CSphBitvec & tDeadRows, const DWORD * pDocinfo, int iStride )
+		: m_tDeadRows ( tDeadRows )
+		, m_pFirstRow ( DOCINFO2ATTRS ( pDocinfo ) )
+		, m_iStride ( iStride )
+	{}
+
+	virtual bool Eval ( const CSphMatch & tMatch ) const
+	{
+		assert ( tMatch.m_pStatic );
+		size_t iRow = size_t ( tMatch.m_pStatic - m_pFirstRow ) / m_iStride;
+		return iRow>=m_tDeadRows.GetBits() || !m_tDeadRows.BitGet ( iRow );
+	}
+};
+
+
 //////////////////////////////////////////////////////////////////////////
 // PUBLIC FACING INTERFACE
 //////////////////////////////////////////////////////////////////////////
 
+CSphJsonPathCache::~CSphJsonPathCache ()
+{
+	ARRAY_FOREACH ( i, m_dPaths )
+		SafeRelease ( m_dPaths[i].m_pExpr );
+}
+
+
+ISphExpr * CSphJsonPathCache::Get ( const CSphString & sPath, ESphAttr & eAttrType ) const
+{
+	ARRAY_FOREACH ( i, m_dPaths )
+		if ( m_dPaths[i].m_sPath==sPath )
+		{
+			eAttrType = m_dPaths[i].m_eAttrType;
+			m_dPaths[i].m_pExpr->AddRef();
+			return m_dPaths[i].m_pExpr;
+		}
+	return NULL;
+}
+
+
+void CSphJsonPathCache::Add ( const CSphString & sPath, ISphExpr * pExpr, ESphAttr eAttrType )
+{
+	Path_t & tPath = m_dPaths.Add();
+	tPath.m_sPath = sPath;
+	tPath.m_pExpr = pExpr;
+	tPath.m_eAttrType = eAttrType;
+	pExpr->AddRef();
+}
+
+
 static ISphFilter * CreateFilter ( const CSphFilterSettings & tSettings, const CSphString & sAttrName, const ISphSchema & tSchema, const DWORD * pMvaPool, const BYTE * pStrings,
-	CSphString & sError, CSphString & sWarning, bool bHaving, ESphCollation eCollation, bool bArenaProhibit )
+	CSphString & sError, CSphString & sWarning, bool bHaving, ESphCollation eCollation, bool bArenaProhibit, const CSphStringDict * pStringDict, CSphJsonPathCache * pJsonPaths )
 {
 	ISphFilter * pFilter = NULL;
 	const CSphColumnInfo * pAttr = NULL;
@@ -1355,12 +1535,26 @@ static ISphFilter * CreateFilter ( const CSphFilterSettings & tSettings, const C
 
 	if ( !pFilter )
 	{
-		const int iAttr = tSchema.GetAttrIndex ( sAttrName.cstr() );
+		int iAttr = tSchema.GetAttrIndex ( sAttrName.cstr() );
+
+		// json path materialized into a generated attribute? filter on it directly
+		// (null checks and string compares still need the json value itself)
+		if ( iAttr<0 && ( eType==SPH_FILTER_VALUES || eType==SPH_FILTER_RANGE || eType==SPH_FILTER_FLOATRANGE ) )
+			iAttr = sphJsonAttrFind ( tSchema, sAttrName.cstr() );
+
 		if ( iAttr<0 )
 		{
 			// try expression
+			// same JSON path in several filters? evaluate it with one expression, and let its memo work
 			ESphAttr eAttrType;
-			ISphExpr * pExpr = sphExprParse ( sAttrName.cstr(), tSchema, &eAttrType, NULL, sError, NULL, eCollation );
+			ISphExpr * pExpr = pJsonPaths ? pJsonPaths->Get ( sAttrName, eAttrType ) : NULL;
+			if ( !pExpr )
+			{
+				pExpr = sphExprParse ( sAttrName.cstr(), tSchema, &eAttrType, NULL, sError, NULL, eCollation );
+				if ( pExpr && pJsonPaths && eAttrType==ESphAttr::SPH_ATTR_JSON_FIELD )
+					pJsonPaths->Add ( sAttrName, pExpr, eAttrType );
+			}
+
 			if ( pExpr )
 			{
 				pFilter = CreateFilterExpr ( pExpr, tSettings.m_eType, tSettings.m_bHasEqual, sError, eCollation, eAttrType );
@@ -1417,6 +1611,8 @@ static ISphFilter * CreateFilter ( const CSphFilterSettings & tSettings, const C
 			pFilter->SetRangeFloat ( (float)tSettings.m_iMinValue, (float)tSettings.m_iMaxValue );
 
 		pFilter->SetRefString ( tSettings.m_dStrings.Begin(), tSettings.m_dStrings.GetLength() );
+		if ( pStringDict && pAttr && pAttr->m_eAttrType==ESphAttr::SPH_ATTR_STRING )
+			pFilter->SetStringDict ( pStringDict );
 		if ( tSettings.GetNumValues() > 0 )
 		{
 			pFilter->SetValues ( tSettings.GetValueArray(), tSettings.GetNumValues() );
@@ -1429,6 +1625,12 @@ static ISphFilter * CreateFilter ( const CSphFilterSettings & tSettings, const C
 #endif
 		}
 
+		// distance upper bounds can reject whole blocks by their lat/lon boxes
+		GeodistInfo_t tGeo;
+		float fMaxDist;
+		if ( !bHaving && sphGetGeodistFilter ( tSettings, tSchema, tGeo, fMaxDist ) )
+			pFilter = new Filter_GeodistBlock ( pFilter, tGeo, fMaxDist );
+
 		if ( tSettings.m_bExclude )
 			pFilter = new Filter_Not ( pFilter );
 	}
@@ -1437,9 +1639,9 @@ static ISphFilter * CreateFilter ( const CSphFilterSettings & tSettings, const C
 }
 
 
-ISphFilter * sphCreateFilter ( const CSphFilterSettings & tSettings, const ISphSchema & tSchema, const DWORD * pMvaPool, const BYTE * pStrings, CSphString & sError, CSphString & sWarning, ESphCollation eCollation, bool bArenaProhibit )
+ISphFilter * sphCreateFilter ( const CSphFilterSettings & tSettings, const ISphSchema & tSchema, const DWORD * pMvaPool, const BYTE * pStrings, CSphString & sError, CSphString & sWarning, ESphCollation eCollation, bool bArenaProhibit, const CSphStringDict * pStringDict, CSphJsonPathCache * pJsonPaths )
 {
-	return CreateFilter ( tSettings, tSettings.m_sAttrName, tSchema, pMvaPool, pStrings, sError, sWarning, false, eCollation, bArenaProhibit );
+	return CreateFilter ( tSettings, tSettings.m_sAttrName, tSchema, pMvaPool, pStrings, sError, sWarning, false, eCollation, bArenaProhibit, pStringDict, pJsonPaths );
 }
 
 
@@ -1447,7 +1649,7 @@ ISphFilter * sphCreateAggrFilter ( const CSphFilterSettings * pSettings, const C
 {
 	assert ( pSettings );
 	CSphString sWarning;
-	ISphFilter * pRes = CreateFilter ( *pSettings, sAttrName, tSchema, NULL, NULL, sError, sWarning, true, SPH_COLLATION_DEFAULT, false );
+	ISphFilter * pRes = CreateFilter ( *pSettings, sAttrName, tSchema, NULL, NULL, sError, sWarning, true, SPH_COLLATION_DEFAULT, false, NULL, NULL );
 	assert ( sWarning.IsEmpty() );
 	return pRes;
 }
@@ -1457,6 +1659,11 @@ ISphFilter * sphCreateFilter ( const KillListVector & dKillList )
 	return new Filter_KillList ( dKillList );
 }
 
+ISphFilter * sphCreateFilter ( const CSphBitvec & tDeadRows, const DWORD * pDocinfo, int iStride )
+{
+	return new Filter_DeadRows ( tDeadRows, pDocinfo, iStride );
+}
+
 ISphFilter * sphJoinFilters ( ISphFilter * pA, ISphFilter * pB )
 {
 	if ( pA )
@@ -16,6 +16,7 @@
 #include "neo/core/kill_list_trait.h"
 #include "neo/source/schema_int.h"
 #include "neo/source/attrib_locator.h"
+#include "neo/core/string_dict.h"
 
 namespace NEO {
 
@@ -28,6 +29,7 @@ namespace NEO {
 		virtual void SetMVAStorage(const DWORD*, bool) {}
 		virtual void SetStringStorage(const BYTE*) {}
 		virtual void SetRefString(const CSphString*, int) {}
+		virtual void SetStringDict(const CSphStringDict*) {}
 
 		virtual ~ISphFilter() {}
 
@@ -56,10 +58,41 @@ namespace NEO {
 		bool m_bUsesAttrs;
 	};
 
-	ISphFilter* sphCreateFilter(const CSphFilterSettings& tSettings, const ISphSchema& tSchema, const DWORD* pMvaPool, const BYTE* pStrings, CSphString& sError, CSphString& sWarning, ESphCollation eCollation, bool bArenaProhibit);
+	struct ISphExpr;
+	struct GeodistInfo_t;
+
+	/// per-query JSON path expressions, so that filters over the same path share one evaluator
+	class CSphJsonPathCache : public ISphNoncopyable
+	{
+	public:
+		~CSphJsonPathCache();
+
+		/// returns an addref'ed expression, or NULL if the path was not seen yet
+		ISphExpr*		Get(const CSphString& sPath, ESphAttr& eAttrType) const;
+		void			Add(const CSphString& sPath, ISphExpr* pExpr, ESphAttr eAttrType);
+
+	private:
+		struct Path_t
+		{
+			CSphString	m_sPath;
+			ISphExpr*	m_pExpr;
+			ESphAttr	m_eAttrType;
+		};
+		CSphVector<Path_t>	m_dPaths;
+	};
+
+	ISphFilter* sphCreateFilter(const CSphFilterSettings& tSettings, const ISphSchema& tSchema, const DWORD* pMvaPool, const BYTE* pStrings, CSphString& sError, CSphString& sWarning, ESphCollation eCollation, bool bArenaProhibit, const CSphStringDict* pStringDict = NULL, CSphJsonPathCache* pJsonPaths = NULL);
 	ISphFilter* sphCreateAggrFilter(const CSphFilterSettings* pSettings, const CSphString& sAttrName, const ISphSchema& tSchema, CSphString& sError);
 	ISphFilter* sphCreateFilter(const KillListVector& dKillList);
+	/// rejects the marked rows of the given docinfo (row numbers are taken from match static pointers)
+	ISphFilter* sphCreateFilter(const CSphBitvec& tDeadRows, const DWORD* pDocinfo, int iStride);
 	ISphFilter* sphJoinFilters(ISphFilter*, ISphFilter*);
 
+	/// check whether an attribute is a geodist() over static lat/lon attributes vs a constant anchor, and fetch the details
+	bool		sphGetGeodistAttr(const ISphSchema& tSchema, const char* sAttr, GeodistInfo_t& tGeo);
+
+	/// check whether a filter is a geodist() upper bound over static lat/lon attributes, and fetch the details
+	bool		sphGetGeodistFilter(const CSphFilterSettings& tSettings, const ISphSchema& tSchema, GeodistInfo_t& tGeo, float& fMaxDist);
+
 }
 
@@ -30,6 +30,25 @@ struct JsonNode_t
 // must be included after YYSTYPE declaration
 class JsonParser_c;
 
+/// object key, as seen by the key table builder
+struct JsonTableKey_t
+{
+	const char *	m_sKey;
+	int				m_iLen;
+	int				m_iOffset;	///< entry offset from the object bloom mask
+
+	/// key table order; ties go by offset, so that duplicate keys resolve the same way as with a scan
+	inline bool operator < ( const JsonTableKey_t & rhs ) const
+	{
+		if ( m_iLen!=rhs.m_iLen )
+			return m_iLen<rhs.m_iLen;
+		int iCmp = memcmp ( m_sKey, rhs.m_sKey, m_iLen );
+		if ( iCmp )
+			return iCmp<0;
+		return m_iOffset<rhs.m_iOffset;
+	}
+};
+
 /// actually, JSON-to-SphinxBSON converter helper, but who cares
 class JsonParser_c : ISphNoncopyable
 {
@@ -43,6 +62,7 @@ public:
 	char *				m_pBuf;
 	CSphVector < CSphVector<JsonNode_t> >	m_dNodes;
 	CSphVector<JsonNode_t>					m_dEmpty;
+	CSphVector<BYTE>						m_dRootTable;	///< root key table, goes after the final JSON_EOF
 
 public:
 	JsonParser_c ( CSphVector<BYTE> & dBuffer, bool bAutoconv, bool bToLowercase, CSphString & sError )
@@ -228,10 +248,42 @@ protected:
 		m_dBuffer.Resize ( iOfs+iPackLen+iSize );
 	}
 
+	/// append a key table trailer: entry offsets in key order, their count, and the width marker
+	void StoreKeyTable ( CSphVector<JsonTableKey_t> & dKeys, CSphVector<BYTE> & dOut )
+	{
+		dKeys.Sort();
+
+		bool bWide = false;
+		ARRAY_FOREACH ( i, dKeys )
+			bWide |= ( dKeys[i].m_iOffset>=0x10000 );
+
+		ARRAY_FOREACH ( i, dKeys )
+		{
+			DWORD uOff = dKeys[i].m_iOffset;
+			dOut.Add ( BYTE ( uOff & 0xff ) );
+			dOut.Add ( BYTE ( ( uOff>>8 ) & 0xff ) );
+			if ( bWide )
+			{
+				dOut.Add ( BYTE ( ( uOff>>16 ) & 0xff ) );
+				dOut.Add ( BYTE ( uOff>>24 ) );
+			}
+		}
+
+		DWORD uCount = dKeys.GetLength();
+		for ( int i=0; i<4; i++ )
+			dOut.Add ( BYTE ( ( uCount>>( 8*i ) ) & 0xff ) );
+		dOut.Add ( bWide ? JSON_KEYTABLE_W32 : JSON_KEYTABLE_W16 );
+	}
+
 public:
 	void Finalize()
 	{
 		m_dBuffer.Add ( JSON_EOF );
+		if ( m_dRootTable.GetLength() )
+		{
+			BYTE * p = BufAlloc ( m_dRootTable.GetLength() );
+			memcpy ( p, m_dRootTable.Begin(), m_dRootTable.GetLength() );
+		}
 	}
 
 	void NumericFixup ( JsonNode_t & tNode )
@@ -322,15 +374,30 @@ public:
 					StoreInt ( uMask );
 				}
 
+				// bloom mask offset, entries are located relative to it
+				int iBase = ( eType==JSON_OBJECT ) ? iOfs+1 : 0;
+				bool bKeyTable = ( dNodes.GetLength()>=JSON_KEYTABLE_MIN );
+				CSphVector<JsonTableKey_t> dKeys;
+
 				ARRAY_FOREACH ( i, dNodes )
 				{
 					char * sObjKey = m_pBuf + dNodes[i].m_iKeyStart;
 					int iLen = KeyUnescape ( &sObjKey, dNodes[i].m_iKeyEnd-dNodes[i].m_iKeyStart );
+					if ( bKeyTable )
+					{
+						JsonTableKey_t & tKey = dKeys.Add();
+						tKey.m_sKey = sObjKey;
+						tKey.m_iLen = iLen;
+						tKey.m_iOffset = m_dBuffer.GetLength()-iBase;
+					}
 					WriteNode ( dNodes[i], sObjKey, iLen );
 					uMask |= sphJsonKeyMask ( sObjKey, iLen );
 				}
 				m_dBuffer.Add ( JSON_EOF );
 
+				if ( bKeyTable )
+					StoreKeyTable ( dKeys, eType==JSON_OBJECT ? m_dBuffer : m_dRootTable );
+
 				if ( eType==JSON_OBJECT )
 				{
 					StoreMask ( iOfs+1, uMask );
@@ -708,18 +775,86 @@ ESphJsonType sphJsonFindFirst ( const BYTE ** ppData )
 }
 
 
-ESphJsonType sphJsonFindByKey ( ESphJsonType eType, const BYTE ** ppValue, const void * pKey, int iLen, DWORD uMask )
+int sphJsonKeyTableSize ( const BYTE * pEnd )
+{
+	switch ( pEnd[-1] )
+	{
+	case JSON_KEYTABLE_W16:	return 5 + 2*sphGetDword ( pEnd-5 );
+	case JSON_KEYTABLE_W32:	return 5 + 4*sphGetDword ( pEnd-5 );
+	default:				return 0; // plain objects end with JSON_EOF
+	}
+}
+
+
+/// bisect the key table of an object, given its bloom mask and end pointers
+/// returns false when there is no table, and the caller has to scan
+static bool JsonFindInKeyTable ( const BYTE * pBase, const BYTE * pEnd, const void * pKey, int iLen, const BYTE ** ppValue, ESphJsonType & eType )
+{
+	int iWidth;
+	switch ( pEnd[-1] )
+	{
+	case JSON_KEYTABLE_W16:	iWidth = 2; break;
+	case JSON_KEYTABLE_W32:	iWidth = 4; break;
+	default:				return false;
+	}
+
+	int iCount = (int)sphGetDword ( pEnd-5 );
+	const BYTE * pTable = pEnd - 5 - iCount*iWidth;
+
+	const BYTE * pFound = NULL;
+	int iL = 0, iR = iCount;
+	while ( iL<iR )
+	{
+		int iM = iL + ( iR-iL )/2;
+		const BYTE * pEntry = pTable + iM*iWidth;
+		DWORD uOff = pEntry[0] | ( pEntry[1]<<8 );
+		if ( iWidth==4 )
+			uOff |= ( pEntry[2]<<16 ) | ( DWORD(pEntry[3])<<24 );
+
+		const BYTE * p = pBase + uOff + 1; // skip type
+		int iStrLen = sphJsonUnpackInt ( &p );
+		int iCmp = ( iStrLen!=iLen ) ? ( iStrLen<iLen ? -1 : 1 ) : memcmp ( p, pKey, iLen );
+		if ( iCmp<0 )
+			iL = iM+1;
+		else
+		{
+			if ( iCmp==0 )
+				pFound = pBase + uOff;
+			iR = iM;
+		}
+	}
+
+	eType = JSON_EOF;
+	if ( pFound )
+	{
+		eType = (ESphJsonType) *pFound++;
+		int iStrLen = sphJsonUnpackInt ( &pFound );
+		*ppValue = pFound + iStrLen;
+	}
+	return true;
+}
+
+
+ESphJsonType sphJsonFindByKey ( ESphJsonType eType, const BYTE ** ppValue, const void * pKey, int iLen, DWORD uMask, const BYTE * pRootEnd )
 {
 	if ( eType!=JSON_OBJECT && eType!=JSON_ROOT )
 		return JSON_EOF;
 
 	const BYTE * p = *ppValue;
+	const BYTE * pEnd = pRootEnd;
 	if ( eType==JSON_OBJECT )
-		sphJsonUnpackInt ( &p );
+	{
+		int iSize = sphJsonUnpackInt ( &p );
+		pEnd = p + iSize;
+	}
 
 	if ( ( sphGetDword(p) & uMask )!=uMask )
 		return JSON_EOF;
 
+	ESphJsonType eFound;
+	if ( pEnd && JsonFindInKeyTable ( p, pEnd, pKey, iLen, ppValue, eFound ) )
+		return eFound;
+
 	p += 4;
 	for ( ;; )
 	{
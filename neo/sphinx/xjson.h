@@ -113,8 +113,20 @@ namespace NEO {
 	/// find first value in SphinxBSON blob, return associated type
 	ESphJsonType sphJsonFindFirst(const BYTE** ppData);
 
+	/// objects with at least that many keys get a sorted key table
+	const int JSON_KEYTABLE_MIN = 8;
+
+	/// key table trailer markers (the last byte of an object or a root blob), by entry offset width
+	const BYTE JSON_KEYTABLE_W16 = 0xF2;
+	const BYTE JSON_KEYTABLE_W32 = 0xF4;
+
+	/// key table trailer size, in bytes, given the end of an object node or a root blob; 0 when there is no table
+	/// the table is stored past the closing JSON_EOF, so scanning readers never see it
+	int sphJsonKeyTableSize(const BYTE* pEnd);
+
 	/// find value by key in SphinxBSON blob, return associated type
-	ESphJsonType sphJsonFindByKey(ESphJsonType eType, const BYTE** ppValue, const void* pKey, int iLen, DWORD uMask);
+	/// objects use their key table (if any) automatically; root lookups also need the blob end to do that
+	ESphJsonType sphJsonFindByKey(ESphJsonType eType, const BYTE** ppValue, const void* pKey, int iLen, DWORD uMask, const BYTE* pRootEnd = NULL);
 
 	/// find value by index in SphinxBSON blob, return associated type
 	ESphJsonType sphJsonFindByIndex(ESphJsonType eType, const BYTE** ppValue, int iIndex);
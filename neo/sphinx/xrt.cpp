@@ -64,6 +64,8 @@
 #include "neo/source/base.h"
 #include "neo/source/schema.h"
 #include "neo/source/source_stringvector.h"
+#include "neo/source/json_attrs.h"
+#include "neo/query/rollup_query.h"
 
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -72,7 +74,9 @@
 //////////////////////////////////////////////////////////////////////////
 
 #define BINLOG_WRITE_BUFFER		256*1024
+#define BINLOG_READ_BUFFER		8*1024*1024
 #define BINLOG_AUTO_FLUSH		1000000
+#define BINLOG_REPLAY_REPORT	5000000
 
 #define RTDICT_CHECKPOINT_V3			1024
 #define RTDICT_CHECKPOINT_V5			48
@@ -258,6 +262,91 @@ struct KlistRefcounted_t
 };
 
 
+/// kill-lists that apply to each disk chunk, ie. those of all the newer chunks, merged
+/// built once per disk chunk set, so that queries do not have to merge them over and over
+/// chunk rows these kill are also marked by row number, so that scans can skip them without any docid lookups
+struct DiskKlists_t
+{
+	explicit DiskKlists_t ( int iChunks )
+		: m_dKlists ( iChunks )
+		, m_dDeadRows ( iChunks )
+		, m_tRefCount ( 1 )
+	{}
+	CSphFixedVector < CSphVector<SphDocID_t> >	m_dKlists;
+	CSphFixedVector<CSphBitvec>					m_dDeadRows;	///< empty when nothing is dead, or the chunk has no docinfo rows
+	CSphAtomic									m_tRefCount;
+};
+
+
+static void ReleaseDiskKlists ( const DiskKlists_t * pKlists )
+{
+	if ( !pKlists )
+		return;
+
+	DiskKlists_t * pOwned = const_cast<DiskKlists_t *> ( pKlists );
+	if ( pOwned->m_tRefCount.Dec()==1 ) // 1 means we only owner when decrement event occurred
+		SafeDelete ( pOwned );
+}
+
+
+/// merge two sorted kill-lists, dropping the duplicates
+static void MergeKillLists ( const CSphVector<SphDocID_t> & dKlist, const SphDocID_t * pKlist, int iKlist, CSphVector<SphDocID_t> & dMerged )
+{
+	const SphDocID_t * pSrc1 = dKlist.Begin();
+	const SphDocID_t * pSrc2 = pKlist;
+	const SphDocID_t * pEnd1 = pSrc1 + dKlist.GetLength();
+	const SphDocID_t * pEnd2 = pSrc2 + iKlist;
+	dMerged.Resize ( ( pEnd1-pSrc1 )+( pEnd2-pSrc2 ) );
+	SphDocID_t * pDst = dMerged.Begin();
+
+	while ( pSrc1!=pEnd1 && pSrc2!=pEnd2 )
+	{
+		if ( *pSrc1<*pSrc2 )
+			*pDst = *pSrc1++;
+		else if ( *pSrc2<*pSrc1 )
+			*pDst = *pSrc2++;
+		else
+		{
+			*pDst = *pSrc1++;
+			// handle duplicates
+			while ( pSrc1!=pEnd1 && *pDst==*pSrc1 ) pSrc1++;
+			while ( pSrc2!=pEnd2 && *pDst==*pSrc2 ) pSrc2++;
+		}
+		pDst++;
+	}
+	while ( pSrc1!=pEnd1 ) *pDst++ = *pSrc1++;
+	while ( pSrc2!=pEnd2 ) *pDst++ = *pSrc2++;
+
+	assert ( pDst<=( dMerged.Begin()+dMerged.GetLength() ) );
+	dMerged.Resize ( pDst-dMerged.Begin() );
+}
+
+
+/// the newest chunk gets an empty kill-list, every older one the merge of its newer neighbour own and cumulative ones
+static DiskKlists_t * BuildDiskKlists ( const CSphVector<CSphIndex*> & dDiskChunks )
+{
+	DiskKlists_t * pKlists = new DiskKlists_t ( dDiskChunks.GetLength() );
+	for ( int iChunk=dDiskChunks.GetLength()-2; iChunk>=0; iChunk-- )
+	{
+		const CSphIndex * pNewerChunk = dDiskChunks[iChunk+1];
+		MergeKillLists ( pKlists->m_dKlists[iChunk+1], pNewerChunk->GetKillList(), pNewerChunk->GetKillListSize(), pKlists->m_dKlists[iChunk] );
+
+		const CSphVector<SphDocID_t> & dKlist = pKlists->m_dKlists[iChunk];
+		if ( dKlist.GetLength() && dDiskChunks[iChunk]->MarkDocinfoRows ( dKlist.Begin(), dKlist.GetLength(), pKlists->m_dDeadRows[iChunk] )<=0 )
+			pKlists->m_dDeadRows[iChunk] = CSphBitvec();
+	}
+	return pKlists;
+}
+
+
+static int64_t GetChunkSize ( const CSphIndex * pChunk )
+{
+	CSphIndexStatus tDisk;
+	pChunk->GetStatus(&tDisk);
+	return tDisk.m_iDiskUse;
+}
+
+
 // this is what actually stores index data
 // RAM chunk consists of such segments
 struct RtSegment_t : ISphNoncopyable
@@ -284,6 +373,8 @@ public:
 	CSphTightVector<BYTE>		m_dStrings;		///< strings storage
 	CSphTightVector<DWORD>		m_dMvas;		///< MVAs storage
 	CSphVector<BYTE>			m_dKeywordCheckpoints;
+	CSphVector<CSphRollup*>		m_dRollups;		///< pre-aggregated group-by tables over alive and killed rows
+	bool						m_bRollupsStale;	///< rows got updated in place since the rollups were counted
 	mutable CSphAtomic			m_tRefCount;
 
 	RtSegment_t ()
@@ -294,6 +385,7 @@ public:
 		m_iRows = 0;
 		m_iAliveRows = 0;
 		m_bTlsKlist = false;
+		m_bRollupsStale = false;
 		m_dStrings.Add ( 0 ); // dummy zero offset
 		m_dMvas.Add ( 0 ); // dummy zero offset
 		m_pKlist = new KlistRefcounted_t();
@@ -302,13 +394,19 @@ public:
 	~RtSegment_t ()
 	{
 		SafeDelete ( m_pKlist );
+		ARRAY_FOREACH ( i, m_dRollups )
+			SafeDelete ( m_dRollups[i] );
 	}
 
 
 	int64_t GetUsedRam () const
 	{
+		int64_t iRollups = 0;
+		ARRAY_FOREACH ( i, m_dRollups )
+			iRollups += m_dRollups[i]->GetUsedBytes();
+
 		// FIXME! gonna break on vectors over 2GB
-		return
+		return iRollups +
 			( (int64_t)m_dWords.GetLimit() )*sizeof(m_dWords[0]) +
 			( (int64_t)m_dDocs.GetLimit() )*sizeof(m_dDocs[0]) +
 			( (int64_t)m_dHits.GetLimit() )*sizeof(m_dHits[0]) +
@@ -773,9 +871,14 @@ public:
 
 	void			AddDocument ( ISphHits * pHits, const CSphMatch & tDoc, bool bReplace, int iRowSize, const char ** ppStr, const CSphVector<DWORD> & dMvas, const CSphVector<JSONAttr_t> & dJson );
 	RtSegment_t *	CreateSegment ( int iRowSize, int iWordsCheckpoint );
+	RtSegment_t *	CreateRunSegment ( const CSphSchema & tSchema, int iWordsCheckpoint, SphDocID_t uMinID, SphDocID_t uMaxID );
 	void			CleanupDuplicates ( int iRowSize );
 	void			GrabLastWarning ( CSphString & sWarning );
+	SphWordID_t		AddKeyword ( const BYTE * pWord );
 	void			SetIndex ( ISphRtIndex * pIndex ) { m_pIndex = pIndex; }
+
+private:
+	void			ZipHits ( RtSegment_t * pSeg, int iWordsCheckpoint, SphDocID_t uMinID, SphDocID_t uMaxID );
 };
 
 /// TLS indexing accumulator (we disallow two uncommitted adds within one thread; and so need at most one)
@@ -828,6 +931,7 @@ enum Blop_e
 	BLOP_ADD_INDEX		= 3,
 	BLOP_ADD_CACHE		= 4,
 	BLOP_RECONFIGURE	= 5,
+	BLOP_ADD_CHUNK		= 6,
 
 	BLOP_TOTAL
 };
@@ -837,6 +941,57 @@ class BufferReader_t;
 class RtBinlog_c;
 
 
+/// a commit read from the binlog, on its way to the index
+struct RtReplayTxn_t
+{
+	RtSegment_t *			m_pSeg;
+	CSphVector<SphDocID_t>	m_dKlist;
+	int64_t					m_iTID;
+
+	RtReplayTxn_t () : m_pSeg ( NULL ), m_iTID ( 0 ) {}
+	~RtReplayTxn_t () { SafeDelete ( m_pSeg ); }
+};
+
+
+struct RtReplayJob_t;
+
+/// binlog replay workers, shared by all the RT indexes
+/// an index gets applied by one worker at a time, so that its commits keep their order
+struct RtReplayWorkers_t : public ISphNoncopyable
+{
+	CSphMutex					m_tLock;
+	CSphAutoEvent				m_tWork;		///< reader to workers, an index got runnable, or shutdown
+	CSphAutoEvent				m_tDone;		///< workers to reader, a batch is applied
+	CSphVector<RtReplayJob_t *>	m_dRunnable;	///< indexes with queued txns that no worker took yet; guarded by m_tLock
+	bool						m_bShutdown;	///< guarded by m_tLock
+	CSphVector<SphThread_t>		m_dThreads;		///< reader side only
+
+								RtReplayWorkers_t ();
+								~RtReplayWorkers_t ();
+
+	bool						AddWorker ();
+	static void					ThreadFunc ( void * pArg );
+};
+
+
+/// commits queued by the binlog reader for some RT index, applied by the replay workers
+struct RtReplayJob_t : public ISphNoncopyable
+{
+	RtIndex_t *					m_pRT;
+	int64_t						m_iTID;			///< last tid handed over; reader side only
+	RtReplayWorkers_t *			m_pWorkers;		///< NULL means commits get applied inline
+
+	CSphVector<RtReplayTxn_t *>	m_dQueue;		///< guarded by the workers lock
+	bool						m_bBusy;		///< runnable, or being applied; guarded by the workers lock
+
+								RtReplayJob_t ( RtIndex_t * pRT, RtReplayWorkers_t * pWorkers );
+								~RtReplayJob_t ();
+
+	void						Push ( RtReplayTxn_t * pTxn );
+	void						Wait ( int iQueued );
+};
+
+
 class BinlogWriter_c : public CSphWriter
 {
 public:
@@ -848,6 +1003,8 @@ public:
 	void			Fsync ();
 	bool			HasUnwrittenData () const { return m_iPoolUsed>0; }
 	bool			HasUnsyncedData () const { return m_iLastFsyncPos!=m_iLastWritePos; }
+	int				GetFD () const { return m_iFD; }
+	const CSphString &	GetFilename () const { return m_sName; }
 
 	void			ResetCrc ();	///< restart checksumming
 	void			WriteCrc ();	///< finalize and write current checksum to output stream
@@ -885,10 +1042,13 @@ public:
 	RtBinlog_c ();
 	~RtBinlog_c ();
 
-	void	BinlogCommit ( int64_t * pTID, const char * sIndexName, const RtSegment_t * pSeg, const CSphVector<SphDocID_t> & dKlist, bool bKeywordDict );
+	int64_t	BinlogCommit ( int64_t * pTID, const char * sIndexName, const RtSegment_t * pSeg, const CSphVector<SphDocID_t> & dKlist, bool bKeywordDict );
 	void	BinlogUpdateAttributes ( int64_t * pTID, const char * sIndexName, const CSphAttrUpdate & tUpd );
 	void	BinlogReconfigure ( int64_t * pTID, const char * sIndexName, const CSphReconfigureSetup & tSetup );
+	void	BinlogAddChunk ( int64_t * pTID, const char * sIndexName, int iChunk, int64_t iDocs );
 	void	NotifyIndexFlush ( const char * sIndexName, int64_t iTID, bool bShutdown );
+	void	WaitSynced ( int64_t iSeq );
+	void	GetStatus ( BinlogStatus_t & tStatus );
 
 	void	Configure ( const CSphConfigSection & hSearchd, bool bTestMode );
 	void	Replay ( const SmallStringHash_T<CSphIndex*> & hIndexes, DWORD uReplayFlags, ProgressCallbackSimple_t * pfnProgressCallback );
@@ -917,6 +1077,13 @@ private:
 
 	CSphMutex				m_tWriteLock; // lock on operation
 
+	// group commit (binlog_flush=1)
+	// committers append under m_tWriteLock, then queue on m_tSyncLock; the one that gets it fsyncs for everybody appended so far
+	CSphMutex				m_tSyncLock;
+	int64_t					m_iCommitSeq;	///< txns appended so far, guarded by m_tWriteLock
+	int64_t					m_iSyncedSeq;	///< txns known durable, guarded by m_tSyncLock
+	BinlogStatus_t			m_tStatus;		///< guarded by m_tSyncLock
+
 	int						m_iLockFD;
 	CSphString				m_sWriterError;
 	BinlogWriter_c			m_tWriter;
@@ -930,6 +1097,7 @@ private:
 	bool					m_bDisabled;
 
 	int						m_iRestartSize; // binlog size restart threshold
+	int						m_iReplayThreads; // binlog_replay_threads directive
 
 	// replay stats
 	mutable int				m_iReplayedRows;
@@ -951,20 +1119,50 @@ private:
 	bool					ReplayIndexAdd ( int iBinlog, const SmallStringHash_T<CSphIndex*> & hIndexes, BinlogReader_c & tReader ) const;
 	bool					ReplayCacheAdd ( int iBinlog, BinlogReader_c & tReader ) const;
 	bool					ReplayReconfigure ( int iBinlog, DWORD uReplayFlags, BinlogReader_c & tReader ) const;
+	bool					ReplayAddChunk ( int iBinlog, DWORD uReplayFlags, BinlogReader_c & tReader ) const;
+
+	RtReplayJob_t *			GetReplayJob ( RtIndex_t * pRT ) const;
+	void					DrainReplayJobs () const;
+	void					SyncReplayJobs () const;
+	void					StopReplayJobs ();
+
+	mutable CSphVector<RtReplayJob_t *>	m_dReplayJobs;	///< per-index commit queues, alive during replay
+	mutable RtReplayWorkers_t *			m_pReplayWorkers;	///< up to m_iReplayThreads, alive during replay
+};
+
+
+/// immutable set of chunks for readers to search
+/// writers publish a new one on every change to the chunks, and whoever unpins a retired one last frees it (see ReleaseSnapshot)
+/// pins everything it lists, so retired segments and kill-lists outlive it
+struct RtSnapshot_t : public ISphNoncopyable
+{
+	CSphFixedVector<const RtSegment_t *>		m_dRamChunks;
+	CSphFixedVector<const KlistRefcounted_t *>	m_dKill;
+	CSphFixedVector<const CSphIndex *>			m_dDiskChunks;
+	const DiskKlists_t *						m_pDiskKlists;
+	mutable CSphAtomic							m_tRefs;		///< one per reader, plus the writer's own until it lets go of a retired one
+
+	RtSnapshot_t ( const CSphVector<RtSegment_t*> & dRamChunks, const CSphVector<CSphIndex*> & dDiskChunks, DiskKlists_t * pDiskKlists );
+	~RtSnapshot_t ();
 };
 
 
-struct SCOPED_CAPABILITY SphChunkGuard_t
+struct RtIndex_t;
+struct SphChunkGuard_t
 {
 	CSphFixedVector<const RtSegment_t *>	m_dRamChunks;
 	CSphFixedVector<const CSphIndex *>		m_dDiskChunks;
 	CSphFixedVector<const KlistRefcounted_t *>		m_dKill;
-	CSphRwlock *							m_pReading;
+	const DiskKlists_t *					m_pDiskKlists;
+	const RtSnapshot_t *					m_pSnapshot;
+	const RtIndex_t *						m_pIndex;
 	SphChunkGuard_t ()
 		: m_dRamChunks ( 0 )
 		, m_dDiskChunks ( 0 )
 		, m_dKill ( 0 )
-		, m_pReading ( NULL )
+		, m_pDiskKlists ( NULL )
+		, m_pSnapshot ( NULL )
+		, m_pIndex ( NULL )
 	{
 	}
 	~SphChunkGuard_t();
@@ -997,11 +1195,31 @@ private:
 private:
 	int							m_iStride;
 	CSphVector<RtSegment_t*>	m_dRamChunks;
-	CSphVector<const RtSegment_t*>	m_dRetired;
+	mutable CSphVector<const RtSegment_t*>	m_dRetired;				///< guarded by m_tRetiredLock, as the readers reap them too
 
 	CSphMutex					m_tWriting;
 	mutable CSphRwlock			m_tChunkLock;
-	mutable CSphRwlock			m_tReading;
+
+	/// readers never lock; they pin the current snapshot, and the last one to unpin a retired snapshot frees it,
+	/// along with the retired segments nothing else pins
+	RtSnapshot_t * volatile		m_pSnapshot;						///< published under m_tChunkLock
+	mutable CSphVector<RtSnapshot_t*>	m_dPinnedSnapshots;			///< retired ones the publisher still pins (guarded by m_tRetiredLock)
+	mutable CSphVector<RtSnapshot_t*>	m_dRetiredSnapshots;		///< all the retired ones still alive (guarded by m_tRetiredLock)
+	mutable CSphAtomic			m_tAcquiring;						///< readers between loading m_pSnapshot and pinning it
+	mutable CSphAtomic			m_tReleaseDeferred;					///< those readers kept the publisher from letting go of its pins
+	mutable CSphMutex			m_tRetiredLock;
+	mutable CSphAutoEvent		m_tSnapshotFreed;					///< set under m_tRetiredLock whenever a retired snapshot is freed
+
+	/// background merges copy segment rows, so they go exclusive against in-place changes to those rows
+	/// (attribute updates take it shared, ALTER and TRUNCATE exclusive)
+	CSphRwlock					m_tMergeLock;						///< updates read, background merge writes when it picks and installs segments
+	const RtSegment_t *			m_pMergeA;							///< segments being merged in the background (guarded by m_tMergeLock)
+	const RtSegment_t *			m_pMergeB;
+	CSphMutex					m_tMergeReading;					///< held by the merger while it reads the segments
+	CSphMutex					m_tMergeUpdatedLock;
+	CSphVector<SphDocID_t>		m_dMergeUpdated;					///< their rows updated meanwhile (guarded by m_tMergeUpdatedLock)
+	bool						m_bMergeQueued;						///< waiting in the background merge queue (guarded by g_tRtMergeLock)
+	bool						m_bMergeDisabled;					///< going away, must not be queued again (guarded by g_tRtMergeLock)
 
 	/// double buffer stuff (allows to work with RAM chunk while future disk is being saved)
 	/// m_dSegments consists of two parts
@@ -1010,6 +1228,7 @@ private:
 	CSphMutex					m_tFlushLock;
 	CSphMutex					m_tOptimizingLock;
 	int							m_iDoubleBuffer;
+	CSphAutoEvent				m_tChunkSaved;						///< set under m_tWriting once the double buffer got saved
 	CSphVector<SphDocID_t>		m_dNewSegmentKlist;					///< raw docid container
 	CSphVector<SphDocID_t>		m_dDiskChunkKlist;					///< ordered SphDocID_t kill list
 
@@ -1018,6 +1237,7 @@ private:
 	CSphString					m_sPath;
 	bool						m_bPathStripped;
 	CSphVector<CSphIndex*>		m_dDiskChunks;
+	DiskKlists_t *				m_pDiskKlists;						///< per disk chunk kill-lists (guarded by m_tChunkLock)
 	int							m_iLockFD;
 	mutable CSphKilllist		m_tKlist;							///< kill list for disk chunks and saved chunks
 	int							m_iDiskBase;
@@ -1025,6 +1245,8 @@ private:
 	volatile bool				m_bOptimizeStop;
 
 	int64_t						m_iSavedTID;
+	int64_t						m_iFlushedBytes;					///< disk chunk bytes saved from RAM since start
+	int64_t						m_iCompactedBytes;					///< disk chunk bytes written by merges since start
 	int64_t						m_tmSaved;
 	mutable DWORD				m_uDiskAttrStatus;
 
@@ -1041,6 +1263,7 @@ private:
 	CSphFixedVector<int64_t>	m_dFieldLens;						///< total field lengths over entire index
 	CSphFixedVector<int64_t>	m_dFieldLensRam;					///< field lengths summed over current RAM chunk
 	CSphFixedVector<int64_t>	m_dFieldLensDisk;					///< field lengths summed over all disk chunks
+	CSphVector<CSphJsonAttr>	m_dJsonAttrs;						///< generated attributes, evaluated on AddDocument
 	CSphVector<int>				m_dDiskChunkList;					///< disk chunk numbers (since meta v.12)
 
 public:
@@ -1049,38 +1272,63 @@ public:
 
 	virtual bool				AddDocument ( ISphTokenizer * pTokenizer, int iFields, const char ** ppFields, const CSphMatch & tDoc, bool bReplace, const CSphString & sTokenFilterOptions, const char ** ppStr, const CSphVector<DWORD> & dMvas, CSphString & sError, CSphString & sWarning, ISphRtAccum * pAccExt );
 	virtual bool				AddDocument ( ISphHits * pHits, const CSphMatch & tDoc, bool bReplace, const char ** ppStr, const CSphVector<DWORD> & dMvas, CSphString & sError, CSphString & sWarning, ISphRtAccum * pAccExt );
+	virtual bool				AddDocuments ( int iFields, const CSphVector<RtInsertDoc_t> & dDocs, bool bReplace, const CSphString & sTokenFilterOptions, CSphString & sError, CSphString & sWarning, ISphRtAccum * pAccExt );
 	virtual bool				DeleteDocument ( const SphDocID_t * pDocs, int iDocs, CSphString & sError, ISphRtAccum * pAccExt );
 	virtual void				Commit ( int * pDeleted, ISphRtAccum * pAccExt );
+	virtual bool				BulkCommit ( int * pDeleted, ISphRtAccum * pAccExt );
 	virtual void				RollBack ( ISphRtAccum * pAccExt );
 	void						CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t> & dAccKlist, int * pTotalKilled ); // FIXME? protect?
+	void						ReplayCommits ( const CSphVector<RtReplayTxn_t *> & dTxns );
+	bool						ReplayBulkChunk ( int iChunk, int64_t iDocs, int64_t iTID, CSphString & sError );
+	static void					MergeThreadFunc ( void * );
 	virtual void				CheckRamFlush ();
 	virtual void				ForceRamFlush ( bool bPeriodic=false );
 	virtual void				ForceDiskChunk ();
 	virtual bool				AttachDiskIndex ( CSphIndex * pIndex, CSphString & sError );
 	virtual bool				Truncate ( CSphString & sError );
 	virtual void				Optimize ( volatile bool * pForceTerminate, ThrottleState_t * pThrottle );
-	virtual void				ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleState_t * pThrottle );
+	virtual bool				Compact ( volatile bool * pForceTerminate, ThrottleState_t * pThrottle );
+	int							ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleState_t * pThrottle, bool bCompact=false );
+	bool						PickCompaction ( int & iDst, int & iSrc ) const;
 	CSphIndex *					GetDiskChunk ( int iChunk ) { return m_dDiskChunks.GetLength()>iChunk ? m_dDiskChunks[iChunk] : NULL; }
 	virtual ISphTokenizer *		CloneIndexingTokenizer() const { return m_pTokenizerIndexing->Clone ( SPH_CLONE_INDEX ); }
+	virtual ISphRtReader *		CreateReader () const;
 
 private:
 	/// acquire thread-local indexing accumulator
 	/// returns NULL if another index already uses it in an open txn
 	RtAccum_t *					AcquireAccum ( CSphString * sError, ISphRtAccum * pAccExt, bool bSetTLS );
 	virtual ISphRtAccum *		CreateAccum ( CSphString & sError );
-
-	RtSegment_t *				MergeSegments ( const RtSegment_t * pSeg1, const RtSegment_t * pSeg2, const CSphVector<SphDocID_t> * pAccKlist, bool bHasMorphology );
-	const RtWord_t *			CopyWord ( RtSegment_t * pDst, RtWordWriter_t & tOutWord, const RtSegment_t * pSrc, const RtWord_t * pWord, RtWordReader_t & tInWord, const CSphVector<SphDocID_t> * pAccKlist );
-	void						MergeWord ( RtSegment_t * pDst, const RtSegment_t * pSrc1, const RtWord_t * pWord1, const RtSegment_t * pSrc2, const RtWord_t * pWord2, RtWordWriter_t & tOut, const CSphVector<SphDocID_t> * pAccKlist );
+	RtSegment_t *				CreateAccumSegment ( RtAccum_t * pAcc ) const;
+	bool						IsDuplicate ( SphDocID_t uDocid, CSphString & sError ) const;
+	bool						TokenizeDocument ( CSphSource_StringVector & tSrc, CSphScopedPtr<ISphTokenizer> & tTokenizer, CSphDict * pDict, const CSphMatch & tDoc, const CSphString & sTokenFilterOptions, ISphHits * & pHits, CSphString & sError ) const;
+	static void					TokenizeThreadFunc ( void * pArg );
+	friend struct				RtTokenizePoolJob_t;
+	void						AddBulkChunk ( CSphIndex * pChunk, int64_t iDocs, int64_t iTID );
+
+	RtSegment_t *				MergeSegments ( const RtSegment_t * pSeg1, const RtSegment_t * pSeg2, const CSphFixedVector<SphDocID_t> & tKill1, const CSphFixedVector<SphDocID_t> & tKill2, const CSphVector<SphDocID_t> * pAccKlist, bool bHasMorphology );
+	const RtWord_t *			CopyWord ( RtSegment_t * pDst, RtWordWriter_t & tOutWord, const RtSegment_t * pSrc, const CSphFixedVector<SphDocID_t> & tKill, const RtWord_t * pWord, RtWordReader_t & tInWord, const CSphVector<SphDocID_t> * pAccKlist );
+	void						MergeWord ( RtSegment_t * pDst, const RtSegment_t * pSrc1, const CSphFixedVector<SphDocID_t> & tKill1, const RtWord_t * pWord1, const RtSegment_t * pSrc2, const CSphFixedVector<SphDocID_t> & tKill2, const RtWord_t * pWord2, RtWordWriter_t & tOut, const CSphVector<SphDocID_t> * pAccKlist );
 	void						CopyDoc ( RtSegment_t * pSeg, RtDocWriter_t & tOutDoc, RtWord_t * pWord, const RtSegment_t * pSrc, const RtDoc_t * pDoc );
 
 	void						SaveMeta ( int iDiskChunks, int64_t iTID );
 	void						SaveDiskHeader ( const char * sFilename, SphDocID_t iMinDocID, int iCheckpoints, SphOffset_t iCheckpointsPosition, DWORD iInfixBlocksOffset, int iInfixCheckpointWordsSize, DWORD uKillListSize, uint64_t uMinMaxSize, const ChunkStats_t & tStats ) const;
-	void						SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t & tGuard, const ChunkStats_t & tStats ) const;
+	void						SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t & tGuard, const ChunkStats_t & tStats, const CSphVector<SphDocID_t> & dKlist ) const;
+	SphOffset_t					SaveDiskAttrs ( const char * sFilename, const SphChunkGuard_t & tGuard ) const;
+	static void					SaveDiskAttrsThreadFunc ( void * pArg );
 	void						SaveDiskChunk ( int64_t iTID, const SphChunkGuard_t & tGuard, const ChunkStats_t & tStats );
 	CSphIndex *					LoadDiskChunk ( const char * sChunk, CSphString & sError ) const;
 	bool						LoadRamChunk ( DWORD uVersion, bool bRebuildInfixes );
 	bool						SaveRamChunk ();
+	void						SetupJsonAttrs ();
+	void						CheckRollups () const;
+	void						SetupSegmentRollups ( RtSegment_t * pSeg ) const;
+
+	void						ScheduleMerge ();
+	bool						BackgroundMerge ();
+	void						WaitForMerger () const;
+	int							GetRamSegments () const;
+	bool						IsMergePending () const;
 
 	virtual void				GetPrefixedWords ( const char * sSubstring, int iSubLen, const char * sWildcard, Args_t & tArgs ) const;
 	virtual void				GetInfixedWords ( const char * sSubstring, int iSubLen, const char * sWildcard, Args_t & tArgs ) const;
@@ -1170,23 +1418,57 @@ protected:
 
 private:
 
+	friend struct SphChunkGuard_t;
+
 	void						GetReaderChunks ( SphChunkGuard_t & tGuard ) const;
+	void						ReleaseSnapshot ( const RtSnapshot_t * pSnapshot ) const;
+	void						FreeSnapshot ( const RtSnapshot_t * pSnapshot ) const;
+	void						ReleasePinnedSnapshots () const;
+	void						PublishSnapshot ();
+	void						RetireSegment ( const RtSegment_t * pSeg );
+	int64_t						GetRetiredRam () const;
 	void						FreeRetired();
+	void						FreeRetiredSegments () const;
+	void						FreeSnapshots ();
+	void						WaitChunkReaders ( const CSphIndex * pChunk ) const;
+	void						UpdateDiskKlists ();
 };
 
 
+/// background RAM segments merger
+/// commits only append their segments, and queue the index up once it has enough of them to merge;
+/// a single thread then merges the queued indexes down, one segment pair at a time
+static CSphMutex				g_tRtMergeLock;
+static CSphVector<RtIndex_t*>	g_dRtMergeQueue;					///< indexes due for a merge (guarded by g_tRtMergeLock)
+static RtIndex_t *				g_pRtMerging = NULL;				///< index being merged right now (guarded by g_tRtMergeLock)
+static CSphAutoEvent			g_tRtMergeWork;						///< queue got an index, or shutdown
+static CSphAutoEvent			g_tRtMergeDone;						///< merger is done with g_pRtMerging
+static SphThread_t				g_tRtMergeThread;
+static bool						g_bRtMergeBackground = true;		///< rt_merge_background directive
+static volatile bool			g_bRtMergeActive = false;			///< merger is up, so commits do not merge
+static volatile bool			g_bRtMergeShutdown = false;
+
+
 RtIndex_t::RtIndex_t ( const CSphSchema & tSchema, const char * sIndexName, int64_t iRamSize, const char * sPath, bool bKeywordDict )
 
 	: ISphRtIndex ( sIndexName, sPath )
+	, m_pMergeA ( NULL )
+	, m_pMergeB ( NULL )
+	, m_bMergeQueued ( false )
+	, m_bMergeDisabled ( false )
+	, m_pSnapshot ( NULL )
 	, m_dDiskChunkKlist ( 0 )
 	, m_iSoftRamLimit ( iRamSize )
 	, m_sPath ( sPath )
 	, m_bPathStripped ( false )
+	, m_pDiskKlists ( NULL )
 	, m_iLockFD ( -1 )
 	, m_iDiskBase ( 0 )
 	, m_bOptimizing ( false )
 	, m_bOptimizeStop ( false )
 	, m_iSavedTID ( m_iTID )
+	, m_iFlushedBytes ( 0 )
+	, m_iCompactedBytes ( 0 )
 	, m_tmSaved ( sphMicroTimer() )
 	, m_uDiskAttrStatus ( 0 )
 	, m_bKeywordDict ( bKeywordDict )
@@ -1215,7 +1497,9 @@ RtIndex_t::RtIndex_t ( const CSphSchema & tSchema, const char * sIndexName, int6
 #endif
 
 	Verify ( m_tChunkLock.Init() );
-	Verify ( m_tReading.Init() );
+	Verify ( m_tMergeLock.Init() );
+	Verify ( m_tChunkSaved.Init ( &m_tWriting ) );
+	Verify ( m_tSnapshotFreed.Init ( &m_tRetiredLock ) );
 
 	ARRAY_FOREACH ( i, m_dFieldLens )
 	{
@@ -1228,6 +1512,19 @@ RtIndex_t::RtIndex_t ( const CSphSchema & tSchema, const char * sIndexName, int6
 
 RtIndex_t::~RtIndex_t ()
 {
+	// leave the merge queue, and wait for the merger if it works us right now
+	Verify ( g_tRtMergeLock.Lock() );
+	m_bMergeDisabled = true;
+	if ( m_bMergeQueued )
+		g_dRtMergeQueue.RemoveValue ( this );
+	while ( g_pRtMerging==this )
+	{
+		Verify ( g_tRtMergeLock.Unlock() );
+		g_tRtMergeDone.WaitEvent();
+		Verify ( g_tRtMergeLock.Lock() );
+	}
+	Verify ( g_tRtMergeLock.Unlock() );
+
 	int64_t tmSave = sphMicroTimer();
 	bool bValid = m_pTokenizer && m_pDict && m_bLoadRamPassedOk;
 
@@ -1237,9 +1534,12 @@ RtIndex_t::~RtIndex_t ()
 		SaveMeta ( m_dDiskChunks.GetLength(), m_iTID );
 	}
 
-	Verify ( m_tReading.Done() );
 	Verify ( m_tChunkLock.Done() );
+	Verify ( m_tMergeLock.Done() );
+	Verify ( m_tChunkSaved.Done() );
 
+	FreeSnapshots();
+	Verify ( m_tSnapshotFreed.Done() );
 	ARRAY_FOREACH ( i, m_dRamChunks )
 		SafeDelete ( m_dRamChunks[i] );
 
@@ -1249,6 +1549,7 @@ RtIndex_t::~RtIndex_t ()
 
 	ARRAY_FOREACH ( i, m_dDiskChunks )
 		SafeDelete ( m_dDiskChunks[i] );
+	ReleaseDiskKlists ( m_pDiskKlists );
 
 	SafeDelete ( m_pTokenizerIndexing );
 
@@ -1348,23 +1649,45 @@ bool RtIndex_t::AddDocument ( ISphTokenizer * pTokenizer, int iFields, const cha
 
 	MEMORY ( MEM_INDEX_RT );
 
-	if ( !bReplace )
-	{
-		m_tChunkLock.ReadLock ();
-		bool bGotID = ARRAY_ANY ( bGotID, m_dRamChunks, ( m_dRamChunks[_any]->FindAliveRow ( tDoc.m_uDocID )!=NULL ) );
-		m_tChunkLock.Unlock ();
-
-		if ( bGotID )
-		{
-			sError.SetSprintf ( "duplicate id '" UINT64_FMT "'", (uint64_t)tDoc.m_uDocID );
-			return false; // already exists and not deleted; INSERT fails
-		}
-	}
+	if ( !bReplace && IsDuplicate ( tDoc.m_uDocID, sError ) )
+		return false; // already exists and not deleted; INSERT fails
 
 	RtAccum_t * pAcc = AcquireAccum ( &sError, pAccExt, true );
 	if ( !pAcc )
 		return false;
 
+	CSphSource_StringVector tSrc ( iFields, ppFields, m_tSchema );
+	ISphHits * pHits = NULL;
+	if ( !TokenizeDocument ( tSrc, tTokenizer, pAcc->m_pDict, tDoc, sTokenFilterOptions, pHits, sError ) )
+		return false;
+	pAcc->GrabLastWarning ( sWarning );
+
+	if ( !AddDocument ( pHits, tDoc, bReplace, ppStr, dMvas, sError, sWarning, pAcc ) )
+		return false;
+
+	m_tStats.m_iTotalBytes += tSrc.GetStats().m_iTotalBytes;
+
+	return true;
+}
+
+
+bool RtIndex_t::IsDuplicate ( SphDocID_t uDocid, CSphString & sError ) const
+{
+	m_tChunkLock.ReadLock ();
+	bool bGotID = ARRAY_ANY ( bGotID, m_dRamChunks, ( m_dRamChunks[_any]->FindAliveRow ( uDocid )!=NULL ) );
+	m_tChunkLock.Unlock ();
+
+	if ( bGotID )
+		sError.SetSprintf ( "duplicate id '" UINT64_FMT "'", (uint64_t)uDocid );
+	return bGotID;
+}
+
+
+/// run a document through the token and field filters and the tokenizer; the hits stay owned by tSrc
+/// thread-safe, as long as the dictionary is not shared with another thread
+bool RtIndex_t::TokenizeDocument ( CSphSource_StringVector & tSrc, CSphScopedPtr<ISphTokenizer> & tTokenizer, CSphDict * pDict,
+	const CSphMatch & tDoc, const CSphString & sTokenFilterOptions, ISphHits * & pHits, CSphString & sError ) const
+{
 	// OPTIMIZE? do not create filter on each(!) INSERT
 	if ( !m_tSettings.m_sIndexTokenFilter.IsEmpty() )
 	{
@@ -1382,8 +1705,6 @@ bool RtIndex_t::AddDocument ( ISphTokenizer * pTokenizer, int iFields, const cha
 	if ( m_tSettings.m_uAotFilterMask )
 		tTokenizer.ReplacePtr ( sphAotCreateFilter ( tTokenizer.Ptr(), m_pDict, m_tSettings.m_bIndexExactWords, m_tSettings.m_uAotFilterMask ) );
 
-	CSphSource_StringVector tSrc ( iFields, ppFields, m_tSchema );
-
 	// SPZ setup
 	if ( m_tSettings.m_bIndexSP && !tTokenizer->EnableSentenceIndexing ( sError ) )
 		return false;
@@ -1402,9 +1723,9 @@ bool RtIndex_t::AddDocument ( ISphTokenizer * pTokenizer, int iFields, const cha
 
 	tSrc.Setup ( m_tSettings );
 	tSrc.SetTokenizer ( tTokenizer.Ptr() );
-	tSrc.SetDict ( pAcc->m_pDict );
+	tSrc.SetDict ( pDict );
 	tSrc.SetFieldFilter ( pFieldFilter.Ptr() );
-	if ( !tSrc.Connect ( m_sLastError ) )
+	if ( !tSrc.Connect ( sError ) )
 		return false;
 
 	m_tSchema.CloneWholeMatch ( &tSrc.m_tDocInfo, tDoc );
@@ -1412,15 +1733,273 @@ bool RtIndex_t::AddDocument ( ISphTokenizer * pTokenizer, int iFields, const cha
 	if ( !tSrc.IterateStart ( sError ) || !tSrc.IterateDocument ( sError ) )
 		return false;
 
-	ISphHits * pHits = tSrc.IterateHits ( sError );
-	pAcc->GrabLastWarning ( sWarning );
+	pHits = tSrc.IterateHits ( sError );
+	return true;
+}
 
-	if ( !AddDocument ( pHits, tDoc, bReplace, ppStr, dMvas, sError, sWarning, pAcc ) )
+
+/// multi-row inserts with less documents than that per thread get tokenized on the calling thread
+static const int RT_TOKENIZE_MIN_DOCS = 64;
+
+/// multi-row inserts tokenize on the calling thread, and on up to rt_insert_threads-1 workers of a pool shared by all the indexes
+static int						g_iRtInsertThreads = 1;				///< rt_insert_threads directive
+static ISphThdPool *			g_pRtInsertPool = NULL;
+
+
+/// a slice of a multi-row insert, tokenized on a thread of its own
+/// hits get collected with slice-local keyword ids (keywords dictionaries), and remapped to the accum ones on merge
+struct RtTokenizeJob_t
+{
+	const RtIndex_t *					m_pIndex;
+	const CSphVector<RtInsertDoc_t> *	m_pDocs;
+	int									m_iFields;
+	int									m_iStart;
+	int									m_iEnd;
+	const CSphString *					m_pFilterOptions;
+	CSphDict *							m_pDict;
+	CSphDict *							m_pDictCloned;
+	ISphRtDictWraper *					m_pDictRt;
+
+	CSphVector<CSphWordHit>				m_dHits;
+	CSphVector<int>						m_dDocHits;		///< hits per document of the slice
+	int64_t								m_iBytes;
+	CSphString							m_sError;
+	CSphString							m_sWarning;
+	CSphAtomic							m_tClaimed;		///< whoever claims the slice first tokenizes it, a pool worker or the inserting thread
+
+	RtTokenizeJob_t ()
+		: m_pIndex ( NULL )
+		, m_pDocs ( NULL )
+		, m_iFields ( 0 )
+		, m_iStart ( 0 )
+		, m_iEnd ( 0 )
+		, m_pFilterOptions ( NULL )
+		, m_pDict ( NULL )
+		, m_pDictCloned ( NULL )
+		, m_pDictRt ( NULL )
+		, m_iBytes ( 0 )
+	{}
+
+	~RtTokenizeJob_t ()
+	{
+		SafeDelete ( m_pDictRt );
+		SafeDelete ( m_pDictCloned );
+	}
+
+	void SetupDict ( CSphDict * pDict, bool bKeywordDict )
+	{
+		m_pDict = pDict;
+		if ( pDict->HasState() )
+			m_pDict = m_pDictCloned = pDict->Clone();
+		if ( bKeywordDict )
+			m_pDict = m_pDictRt = sphCreateRtKeywordsDictionaryWrapper ( m_pDict );
+	}
+
+	bool Claim ()
+	{
+		return m_tClaimed.Inc()==0;
+	}
+};
+
+
+/// slices of a multi-row insert handed to the pool, counted down as the workers get done with them
+struct RtTokenizeBatch_t
+{
+	CSphMutex		m_tLock;
+	CSphAutoEvent	m_tDone;
+	int				m_iPending;		///< guarded by m_tLock
+
+	explicit RtTokenizeBatch_t ( int iPending )
+		: m_iPending ( iPending )
+	{
+		m_tDone.Init ( &m_tLock );
+	}
+
+	~RtTokenizeBatch_t ()
+	{
+		m_tDone.Done();
+	}
+
+	void JobDone ()
+	{
+		Verify ( m_tLock.Lock() );
+		if ( !--m_iPending )
+			m_tDone.SetEvent();
+		Verify ( m_tLock.Unlock() );
+	}
+
+	void Wait ()
+	{
+		for ( ;; )
+		{
+			Verify ( m_tLock.Lock() );
+			bool bDone = ( m_iPending==0 );
+			Verify ( m_tLock.Unlock() );
+			if ( bDone )
+				break;
+			m_tDone.WaitEvent();
+		}
+	}
+};
+
+
+/// tokenizes a slice on a pool worker, unless the inserting thread got to it first
+struct RtTokenizePoolJob_t : public ISphJob
+{
+	RtTokenizeJob_t *	m_pJob;
+	RtTokenizeBatch_t *	m_pBatch;
+
+	RtTokenizePoolJob_t ( RtTokenizeJob_t * pJob, RtTokenizeBatch_t * pBatch )
+		: m_pJob ( pJob )
+		, m_pBatch ( pBatch )
+	{}
+
+	virtual void Call ()
+	{
+		if ( m_pJob->Claim() )
+			RtIndex_t::TokenizeThreadFunc ( m_pJob );
+		m_pBatch->JobDone();
+	}
+};
+
+
+void RtIndex_t::TokenizeThreadFunc ( void * pArg )
+{
+	RtTokenizeJob_t * pJob = (RtTokenizeJob_t *) pArg;
+	const CSphVector<RtInsertDoc_t> & dDocs = *pJob->m_pDocs;
+
+	for ( int i=pJob->m_iStart; i<pJob->m_iEnd && pJob->m_sError.IsEmpty(); i++ )
+	{
+		const RtInsertDoc_t & tDoc = dDocs[i];
+		int iHits = pJob->m_dHits.GetLength();
+
+		if ( tDoc.m_pDoc->m_uDocID )
+		{
+			CSphScopedPtr<ISphTokenizer> tTokenizer ( pJob->m_pIndex->CloneIndexingTokenizer() );
+			CSphSource_StringVector tSrc ( pJob->m_iFields, tDoc.m_ppFields, pJob->m_pIndex->m_tSchema );
+			ISphHits * pHits = NULL;
+			if ( !pJob->m_pIndex->TokenizeDocument ( tSrc, tTokenizer, pJob->m_pDict, *tDoc.m_pDoc, *pJob->m_pFilterOptions, pHits, pJob->m_sError ) )
+				break;
+
+			if ( pHits && pHits->Length() )
+			{
+				pJob->m_dHits.Resize ( iHits + pHits->Length() );
+				memcpy ( pJob->m_dHits.Begin() + iHits, pHits->First(), sizeof(CSphWordHit)*pHits->Length() );
+			}
+			pJob->m_iBytes += tSrc.GetStats().m_iTotalBytes;
+		}
+
+		pJob->m_dDocHits.Add ( pJob->m_dHits.GetLength() - iHits );
+	}
+
+	if ( pJob->m_pDictRt && pJob->m_pDictRt->GetLastWarning() )
+		pJob->m_sWarning = pJob->m_pDictRt->GetLastWarning();
+}
+
+
+bool RtIndex_t::AddDocuments ( int iFields, const CSphVector<RtInsertDoc_t> & dDocs, bool bReplace,
+	const CSphString & sTokenFilterOptions, CSphString & sError, CSphString & sWarning, ISphRtAccum * pAccExt )
+{
+	assert ( g_bRTChangesAllowed );
+
+	// not worth the threads
+	int iJobs = g_pRtInsertPool ? Min ( g_iRtInsertThreads, dDocs.GetLength()/RT_TOKENIZE_MIN_DOCS ) : 1;
+	if ( iJobs<=1 )
+	{
+		ARRAY_FOREACH_COND ( i, dDocs, sError.IsEmpty() )
+			AddDocument ( CloneIndexingTokenizer(), iFields, dDocs[i].m_ppFields, *dDocs[i].m_pDoc, bReplace, sTokenFilterOptions,
+				dDocs[i].m_ppStr, *dDocs[i].m_pMvas, sError, sWarning, pAccExt );
+		return sError.IsEmpty();
+	}
+
+	MEMORY ( MEM_INDEX_RT );
+
+	RtAccum_t * pAcc = AcquireAccum ( &sError, pAccExt, true );
+	if ( !pAcc )
 		return false;
 
-	m_tStats.m_iTotalBytes += tSrc.GetStats().m_iTotalBytes;
+	// contiguous slices, so that merging them one after another keeps the insert order
+	CSphFixedVector<RtTokenizeJob_t> dJobs ( iJobs );
+	ARRAY_FOREACH ( i, dJobs )
+	{
+		RtTokenizeJob_t & tJob = dJobs[i];
+		tJob.m_pIndex = this;
+		tJob.m_pDocs = &dDocs;
+		tJob.m_iFields = iFields;
+		tJob.m_iStart = (int)( (int64_t)dDocs.GetLength()*i/iJobs );
+		tJob.m_iEnd = (int)( (int64_t)dDocs.GetLength()*(i+1)/iJobs );
+		tJob.m_pFilterOptions = &sTokenFilterOptions;
+		tJob.SetupDict ( m_pDict, m_bKeywordDict );
+	}
 
-	return true;
+	// the pool gets all the slices but the first one; this thread then takes whatever the busy workers did not get to yet
+	RtTokenizeBatch_t tBatch ( iJobs-1 );
+	for ( int i=1; i<iJobs; i++ )
+		g_pRtInsertPool->AddJob ( new RtTokenizePoolJob_t ( &dJobs[i], &tBatch ) );
+
+	ARRAY_FOREACH ( i, dJobs )
+		if ( dJobs[i].Claim() )
+			TokenizeThreadFunc ( &dJobs[i] );
+
+	tBatch.Wait();
+
+	// merge into the accum in insert order
+	BYTE sKeyword [ SPH_MAX_WORD_LEN*3+4 ];
+	ISphHits tHits;
+	ARRAY_FOREACH_COND ( iJob, dJobs, sError.IsEmpty() )
+	{
+		RtTokenizeJob_t & tJob = dJobs[iJob];
+		if ( !tJob.m_sWarning.IsEmpty() )
+			sWarning = tJob.m_sWarning;
+
+		// slice keyword offsets to the accum ones
+		CSphFixedVector<SphWordID_t> dKeywords ( tJob.m_pDictRt ? tJob.m_pDictRt->GetPackedLen() : 0 );
+		ARRAY_FOREACH ( i, dKeywords )
+			dKeywords[i] = 0;
+
+		const CSphWordHit * pHit = tJob.m_dHits.Begin();
+		ARRAY_FOREACH_COND ( i, tJob.m_dDocHits, sError.IsEmpty() )
+		{
+			const RtInsertDoc_t & tDoc = dDocs [ tJob.m_iStart+i ];
+			int iHits = tJob.m_dDocHits[i];
+			tHits.m_dData.Resize ( iHits );
+			memcpy ( tHits.m_dData.Begin(), pHit, sizeof(CSphWordHit)*iHits );
+			pHit += iHits;
+
+			if ( !tDoc.m_pDoc->m_uDocID )
+				continue;
+
+			if ( !bReplace && IsDuplicate ( tDoc.m_pDoc->m_uDocID, sError ) )
+				break;
+
+			if ( tJob.m_pDictRt )
+				ARRAY_FOREACH ( j, tHits.m_dData )
+				{
+					SphWordID_t & uWordID = tHits.m_dData[j].m_uWordID;
+					if ( !uWordID )
+						continue;
+					SphWordID_t & uMapped = dKeywords [ (int)uWordID ];
+					if ( !uMapped )
+					{
+						const BYTE * pPacked = tJob.m_pDictRt->GetPackedKeywords() + uWordID;
+						memcpy ( sKeyword, pPacked+1, pPacked[0] );
+						sKeyword [ pPacked[0] ] = '\0';
+						uMapped = pAcc->AddKeyword ( sKeyword );
+					}
+					uWordID = uMapped;
+				}
+
+			if ( !AddDocument ( &tHits, *tDoc.m_pDoc, bReplace, tDoc.m_ppStr, *tDoc.m_pMvas, sError, sWarning, pAcc ) )
+				break;
+		}
+
+		if ( sError.IsEmpty() && !tJob.m_sError.IsEmpty() )
+			sError = tJob.m_sError;
+
+		m_tStats.m_iTotalBytes += tJob.m_iBytes;
+	}
+
+	return sError.IsEmpty();
 }
 
 
@@ -1485,6 +2064,15 @@ bool RtIndex_t::AddDocument ( ISphHits * pHits, const CSphMatch & tDoc, bool bRe
 		const CSphSchema & tSchema = GetInternalSchema();
 		int iAttr = 0;
 
+		// generated attributes override whatever the caller supplied, so work on a copy of the row
+		CSphMatch tGenerated;
+		if ( m_dJsonAttrs.GetLength() )
+		{
+			tGenerated.Reset ( m_tSchema.GetRowSize() );
+			tGenerated.m_uDocID = tDoc.m_uDocID;
+			memcpy ( tGenerated.m_pDynamic, tDoc.m_pDynamic, m_tSchema.GetRowSize()*sizeof(CSphRowitem) );
+		}
+
 		for ( int i=0; i<tSchema.GetAttrsCount(); i++ )
 		{
 			const CSphColumnInfo & tColumn = tSchema.GetAttr(i);
@@ -1493,6 +2081,9 @@ bool RtIndex_t::AddDocument ( ISphHits * pHits, const CSphMatch & tDoc, bool bRe
 				const char * pStr = ppStr ? ppStr[iAttr] : NULL;
 				int iLen = pStr ? strlen ( pStr ) : 0;
 
+				if ( m_dJsonAttrs.GetLength() )
+					sphJsonAttrsEval ( tGenerated, m_dJsonAttrs, i, NULL, 0 );
+
 				if ( pStr && iLen )
 				{
 					// pStr originates as CSphString, so we DO have space for an extra '\0'
@@ -1520,6 +2111,9 @@ bool RtIndex_t::AddDocument ( ISphHits * pHits, const CSphMatch & tDoc, bool bRe
 						sError = "";
 					}
 
+					if ( m_dJsonAttrs.GetLength() )
+						sphJsonAttrsEval ( tGenerated, m_dJsonAttrs, i, dBuf.Begin(), dBuf.GetLength() );
+
 					JSONAttr_t & tAttr = dJsonData.Add();
 					tAttr.m_iLen = dBuf.GetLength();
 					tAttr.m_pData = dBuf.LeakData();
@@ -1529,7 +2123,7 @@ bool RtIndex_t::AddDocument ( ISphHits * pHits, const CSphMatch & tDoc, bool bRe
 			iAttr += ( tColumn.m_eAttrType==ESphAttr::SPH_ATTR_STRING || tColumn.m_eAttrType==ESphAttr::SPH_ATTR_JSON ) ? 1 : 0;
 		}
 
-		pAcc->AddDocument ( pHits, tDoc, bReplace, m_tSchema.GetRowSize(), ppStr, dMvas, dJsonData );
+		pAcc->AddDocument ( pHits, m_dJsonAttrs.GetLength() ? tGenerated : tDoc, bReplace, m_tSchema.GetRowSize(), ppStr, dMvas, dJsonData );
 	}
 
 	return ( pAcc!=NULL );
@@ -1760,6 +2354,28 @@ RtSegment_t * RtAccum_t::CreateSegment ( int iRowSize, int iWordsCheckpoint )
 	MEMORY ( MEM_RT_ACCUM );
 
 	RtSegment_t * pSeg = new RtSegment_t ();
+	ZipHits ( pSeg, iWordsCheckpoint, 0, DOCID_MAX );
+
+	pSeg->m_iRows = m_iAccumDocs;
+	pSeg->m_iAliveRows = m_iAccumDocs;
+
+	// copy and sort attributes
+	int iStride = DOCINFO_IDSIZE + iRowSize;
+	pSeg->m_dRows.SwapData ( m_dAccumRows );
+	pSeg->m_dStrings.SwapData ( m_dStrings );
+	pSeg->m_dMvas.SwapData ( m_dMvas );
+	sphSortDocinfos ( pSeg->m_dRows.Begin(), pSeg->m_dRows.GetLength()/iStride, iStride );
+
+	// done
+	return pSeg;
+}
+
+
+/// encode the sorted accumulated hits of the documents with ids in [uMinID, uMaxID] into segment words, docs and hits
+/// leaves the hits intact, so that the other id ranges can be encoded later
+void RtAccum_t::ZipHits ( RtSegment_t * pSeg, int iWordsCheckpoint, SphDocID_t uMinID, SphDocID_t uMaxID )
+{
+	int iHits = m_dAccum.GetLength();
 
 	CSphWordHit tClosingHit;
 	tClosingHit.m_uWordID = WORDID_MAX;
@@ -1793,6 +2409,10 @@ RtSegment_t * RtAccum_t::CreateSegment ( int iRowSize, int iWordsCheckpoint )
 	{
 		const CSphWordHit & tHit = m_dAccum[i];
 
+		// out of the range; the closing hit never is
+		if ( i<iHits && ( tHit.m_uDocID<uMinID || tHit.m_uDocID>uMaxID ) )
+			continue;
+
 		// new keyword or doc; flush current doc
 		if ( tHit.m_uWordID!=tWord.m_uWordID || tHit.m_uDocID!=tDoc.m_uDocID )
 		{
@@ -1867,21 +2487,10 @@ RtSegment_t * RtAccum_t::CreateSegment ( int iRowSize, int iWordsCheckpoint )
 		tDoc.m_uHits++;
 	}
 
+	m_dAccum.Resize ( iHits );
+
 	if ( m_bKeywordDict )
 		FixupSegmentCheckpoints ( pSeg );
-
-	pSeg->m_iRows = m_iAccumDocs;
-	pSeg->m_iAliveRows = m_iAccumDocs;
-
-	// copy and sort attributes
-	int iStride = DOCINFO_IDSIZE + iRowSize;
-	pSeg->m_dRows.SwapData ( m_dAccumRows );
-	pSeg->m_dStrings.SwapData ( m_dStrings );
-	pSeg->m_dMvas.SwapData ( m_dMvas );
-	sphSortDocinfos ( pSeg->m_dRows.Begin(), pSeg->m_dRows.GetLength()/iStride, iStride );
-
-	// done
-	return pSeg;
 }
 
 
@@ -1995,9 +2604,15 @@ void RtAccum_t::GrabLastWarning ( CSphString & sWarning )
 	}
 }
 
+SphWordID_t RtAccum_t::AddKeyword ( const BYTE * pWord )
+{
+	assert ( m_pDictRt );
+	return m_pDictRt->AddKeyword ( pWord );
+}
+
 
 const RtWord_t * RtIndex_t::CopyWord ( RtSegment_t * pDst, RtWordWriter_t & tOutWord,
-	const RtSegment_t * pSrc, const RtWord_t * pWord, RtWordReader_t & tInWord,
+	const RtSegment_t * pSrc, const CSphFixedVector<SphDocID_t> & tKill, const RtWord_t * pWord, RtWordReader_t & tInWord,
 	const CSphVector<SphDocID_t> * pAccKlist )
 {
 	RtDocReader_t tInDoc ( pSrc, *pWord );
@@ -2006,9 +2621,9 @@ const RtWord_t * RtIndex_t::CopyWord ( RtSegment_t * pDst, RtWordWriter_t & tOut
 	RtWord_t tNewWord = *pWord;
 	tNewWord.m_uDoc = tOutDoc.ZipDocPtr();
 
-	// if flag is there, acc must be there
-	// however, NOT vice versa (newly created segments are unaffected by TLS klist)
-	assert (!( pSrc->m_bTlsKlist && !pAccKlist ));
+	// acc is only there for the merges done by the committer, which is the only one to look at the flag
+	// (newly created segments are unaffected by TLS klist; background merges do not see any)
+	bool bTlsKlist = ( pAccKlist && pSrc->m_bTlsKlist );
 #if 0
 	// index *must* be holding acc during merge
 	assert ( !pAcc || pAcc->m_pIndex==this );
@@ -2022,8 +2637,8 @@ const RtWord_t * RtIndex_t::CopyWord ( RtSegment_t * pDst, RtWordWriter_t & tOut
 			break;
 
 		// apply klist
-		bool bKill = ( pSrc->GetKlist().BinarySearch ( pDoc->m_uDocID )!=NULL );
-		if ( !bKill && pSrc->m_bTlsKlist )
+		bool bKill = ( tKill.BinarySearch ( pDoc->m_uDocID )!=NULL );
+		if ( !bKill && bTlsKlist )
 			bKill = ( pAccKlist->BinarySearch ( pDoc->m_uDocID )!=NULL );
 
 		if ( bKill )
@@ -2088,8 +2703,8 @@ void RtIndex_t::CopyDoc ( RtSegment_t * pSeg, RtDocWriter_t & tOutDoc, RtWord_t
 }
 
 
-void RtIndex_t::MergeWord ( RtSegment_t * pSeg, const RtSegment_t * pSrc1, const RtWord_t * pWord1,
-	const RtSegment_t * pSrc2, const RtWord_t * pWord2, RtWordWriter_t & tOut,
+void RtIndex_t::MergeWord ( RtSegment_t * pSeg, const RtSegment_t * pSrc1, const CSphFixedVector<SphDocID_t> & tKill1, const RtWord_t * pWord1,
+	const RtSegment_t * pSrc2, const CSphFixedVector<SphDocID_t> & tKill2, const RtWord_t * pWord2, RtWordWriter_t & tOut,
 	const CSphVector<SphDocID_t> * pAccKlist )
 {
 	assert ( ( !m_bKeywordDict && pWord1->m_uWordID==pWord2->m_uWordID )
@@ -2110,6 +2725,8 @@ void RtIndex_t::MergeWord ( RtSegment_t * pSeg, const RtSegment_t * pSrc1, const
 	RtDocReader_t tIn2 ( pSrc2, *pWord2 );
 	const RtDoc_t * pDoc1 = tIn1.UnzipDoc();
 	const RtDoc_t * pDoc2 = tIn2.UnzipDoc();
+	const bool bTlsKlist1 = ( pAccKlist && pSrc1->m_bTlsKlist );
+	const bool bTlsKlist2 = ( pAccKlist && pSrc2->m_bTlsKlist );
 
 	while ( pDoc1 || pDoc2 )
 	{
@@ -2120,8 +2737,8 @@ void RtIndex_t::MergeWord ( RtSegment_t * pSeg, const RtSegment_t * pSrc1, const
 			assert ( pSrc1->m_dKlist.BinarySearch ( pDoc1->m_uDocID )
 				|| ( pSrc1->m_bTlsKlist && pAcc && pAcc->m_dAccumKlist.BinarySearch ( pDoc1->m_uDocID ) ) );
 #endif
-			if ( !pSrc2->GetKlist().BinarySearch ( pDoc2->m_uDocID )
-				&& ( !pSrc1->m_bTlsKlist || !pSrc2->m_bTlsKlist || !pAccKlist->BinarySearch ( pDoc2->m_uDocID ) ) )
+			if ( !tKill2.BinarySearch ( pDoc2->m_uDocID )
+				&& ( !bTlsKlist1 || !bTlsKlist2 || !pAccKlist->BinarySearch ( pDoc2->m_uDocID ) ) )
 				CopyDoc ( pSeg, tOutDoc, &tWord, pSrc2, pDoc2 );
 			pDoc1 = tIn1.UnzipDoc();
 			pDoc2 = tIn2.UnzipDoc();
@@ -2129,8 +2746,8 @@ void RtIndex_t::MergeWord ( RtSegment_t * pSeg, const RtSegment_t * pSrc1, const
 		} else if ( pDoc1 && ( !pDoc2 || pDoc1->m_uDocID < pDoc2->m_uDocID ) )
 		{
 			// winner from the first segment
-			if ( !pSrc1->GetKlist().BinarySearch ( pDoc1->m_uDocID )
-				&& ( !pSrc1->m_bTlsKlist || !pAccKlist->BinarySearch ( pDoc1->m_uDocID ) ) )
+			if ( !tKill1.BinarySearch ( pDoc1->m_uDocID )
+				&& ( !bTlsKlist1 || !pAccKlist->BinarySearch ( pDoc1->m_uDocID ) ) )
 				CopyDoc ( pSeg, tOutDoc, &tWord, pSrc1, pDoc1 );
 			pDoc1 = tIn1.UnzipDoc();
 
@@ -2138,8 +2755,8 @@ void RtIndex_t::MergeWord ( RtSegment_t * pSeg, const RtSegment_t * pSrc1, const
 		{
 			// winner from the second segment
 			assert ( pDoc2 && ( !pDoc1 || pDoc2->m_uDocID < pDoc1->m_uDocID ) );
-			if ( !pSrc2->GetKlist().BinarySearch ( pDoc2->m_uDocID )
-				&& ( !pSrc2->m_bTlsKlist || !pAccKlist->BinarySearch ( pDoc2->m_uDocID ) ) )
+			if ( !tKill2.BinarySearch ( pDoc2->m_uDocID )
+				&& ( !bTlsKlist2 || !pAccKlist->BinarySearch ( pDoc2->m_uDocID ) ) )
 				CopyDoc ( pSeg, tOutDoc, &tWord, pSrc2, pDoc2 );
 			pDoc2 = tIn2.UnzipDoc();
 		}
@@ -2533,10 +3150,18 @@ void RtIndex_t::BuildSegmentInfixes ( RtSegment_t * pSeg, bool bHasMorphology )
 }
 
 
-RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegment_t * pSeg2, const CSphVector<SphDocID_t> * pAccKlist, bool bHasMorphology )
+RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegment_t * pSeg2,
+	const CSphFixedVector<SphDocID_t> & tKill1, const CSphFixedVector<SphDocID_t> & tKill2,
+	const CSphVector<SphDocID_t> * pAccKlist, bool bHasMorphology )
 {
+	// kill-lists are passed along, as the segments might get new ones while a background merge runs
+	const CSphFixedVector<SphDocID_t> * pKill1 = &tKill1;
+	const CSphFixedVector<SphDocID_t> * pKill2 = &tKill2;
 	if ( pSeg1->m_iTag > pSeg2->m_iTag )
+	{
 		Swap ( pSeg1, pSeg2 );
+		Swap ( pKill1, pKill2 );
+	}
 
 	RtSegment_t * pSeg = new RtSegment_t ();
 
@@ -2567,8 +3192,8 @@ RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegm
 	StorageStringVector_t tStorageString ( m_tSchema, dStrings );
 	StorageMvaVector_t tStorageMva ( m_tSchema, dMvas );
 
-	RtRowIterator_t tIt1 ( pSeg1, m_iStride, true, pAccKlist, pSeg1->GetKlist() );
-	RtRowIterator_t tIt2 ( pSeg2, m_iStride, true, pAccKlist, pSeg2->GetKlist() );
+	RtRowIterator_t tIt1 ( pSeg1, m_iStride, true, pAccKlist, *pKill1 );
+	RtRowIterator_t tIt2 ( pSeg2, m_iStride, true, pAccKlist, *pKill2 );
 
 	const CSphRowitem * pRow1 = tIt1.GetNextAliveRow();
 	const CSphRowitem * pRow2 = tIt2.GetNextAliveRow();
@@ -2646,9 +3271,9 @@ RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegm
 				break;
 
 			if ( iCmp<0 )
-				pWords1 = CopyWord ( pSeg, tOut, pSeg1, pWords1, tIn1, pAccKlist );
+				pWords1 = CopyWord ( pSeg, tOut, pSeg1, *pKill1, pWords1, tIn1, pAccKlist );
 			else
-				pWords2 = CopyWord ( pSeg, tOut, pSeg2, pWords2, tIn2, pAccKlist );
+				pWords2 = CopyWord ( pSeg, tOut, pSeg2, *pKill2, pWords2, tIn2, pAccKlist );
 		}
 
 		if ( !pWords1 || !pWords2 )
@@ -2657,19 +3282,20 @@ RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegm
 		assert ( pWords1 && pWords2 &&
 			( ( !m_bKeywordDict && pWords1->m_uWordID==pWords2->m_uWordID )
 			|| ( m_bKeywordDict && sphDictCmpStrictly ( (const char *)pWords1->m_sWord+1, *pWords1->m_sWord, (const char *)pWords2->m_sWord+1, *pWords2->m_sWord )==0 ) ) );
-		MergeWord ( pSeg, pSeg1, pWords1, pSeg2, pWords2, tOut, pAccKlist );
+		MergeWord ( pSeg, pSeg1, *pKill1, pWords1, pSeg2, *pKill2, pWords2, tOut, pAccKlist );
 		pWords1 = tIn1.UnzipWord();
 		pWords2 = tIn2.UnzipWord();
 	}
 
 	// copy tails
-	while ( pWords1 ) pWords1 = CopyWord ( pSeg, tOut, pSeg1, pWords1, tIn1, pAccKlist );
-	while ( pWords2 ) pWords2 = CopyWord ( pSeg, tOut, pSeg2, pWords2, tIn2, pAccKlist );
+	while ( pWords1 ) pWords1 = CopyWord ( pSeg, tOut, pSeg1, *pKill1, pWords1, tIn1, pAccKlist );
+	while ( pWords2 ) pWords2 = CopyWord ( pSeg, tOut, pSeg2, *pKill2, pWords2, tIn2, pAccKlist );
 
 	if ( m_bKeywordDict )
 		FixupSegmentCheckpoints ( pSeg );
 
 	BuildSegmentInfixes ( pSeg, bHasMorphology );
+	SetupSegmentRollups ( pSeg );
 
 	assert ( pSeg->m_dRows.GetLength() );
 	assert ( pSeg->m_iRows );
@@ -2687,7 +3313,64 @@ struct CmpSegments_fn
 };
 
 
-void RtIndex_t::Commit ( int * pDeleted, ISphRtAccum * pAccExt )
+/// RAM segments merge policy
+/// segments are kept in a progression, each one at least twice the size of the next one
+/// past RT_MERGE_SEGMENTS, the smallest two get merged when they break it; past RT_MAX_SEGMENTS, unconditionally
+static const int RT_MAX_SEGMENTS = 32;
+static const int RT_MAX_PROGRESSION_SEGMENT = 8;
+static const int RT_MERGE_SEGMENTS = RT_MAX_SEGMENTS - RT_MAX_PROGRESSION_SEGMENT;
+
+/// with the background merger, commits wait for it past RT_MAX_SEGMENTS (for RT_MERGE_WAIT_MSEC at most),
+/// and dump a disk chunk past RT_HARD_SEGMENTS
+static const int RT_HARD_SEGMENTS = 2*RT_MAX_SEGMENTS;
+static const int RT_MERGE_WAIT_MSEC = 1000;
+
+/// check whether the two smallest segments are due for a merge; expects segments sorted with CmpSegments_fn
+static bool RtNeedsMerge ( const CSphVector<RtSegment_t*> & dSegments )
+{
+	const int iLen = dSegments.GetLength();
+	if ( iLen < RT_MERGE_SEGMENTS )
+		return false;
+	assert ( iLen>=2 );
+
+	// not if progression is kept AND lesser RT_MAX_SEGMENTS limit
+	return !( dSegments[iLen-2]->GetMergeFactor() > dSegments[iLen-1]->GetMergeFactor()*2 && iLen < RT_MAX_SEGMENTS );
+}
+
+
+/// estimate RAM needed to merge two segments; also returns the longest merged vector
+static int64_t RtMergeRamEstimate ( const RtSegment_t * pA, const RtSegment_t * pB, int64_t & iMaxLen )
+{
+#define LOC_ESTIMATE1(_seg,_vec) \
+	(int)( ( (int64_t)_seg->_vec.GetLength() ) * _seg->m_iAliveRows / _seg->m_iRows )
+
+#define LOC_ESTIMATE(_vec) \
+	( LOC_ESTIMATE1 ( pA, _vec ) + LOC_ESTIMATE1 ( pB, _vec ) )
+
+	int64_t iWordsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dWords ) );
+	int64_t iDocsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dDocs ) );
+	int64_t iHitsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dHits ) );
+	int64_t iStringsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dStrings ) );
+	int64_t iMvasRelimit = CSphTightVectorPolicy<DWORD>::Relimit ( 0, LOC_ESTIMATE ( m_dMvas ) );
+	int64_t iKeywordsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dKeywordCheckpoints ) );
+	int64_t iRowsRelimit = CSphTightVectorPolicy<SphDocID_t>::Relimit ( 0, LOC_ESTIMATE ( m_dRows ) );
+
+#undef LOC_ESTIMATE
+#undef LOC_ESTIMATE1
+
+	// split this way to avoid superlong string after macro expansion that kills gcov
+	iMaxLen = Max (
+		Max ( iWordsRelimit, iDocsRelimit ),
+		Max ( iHitsRelimit, iStringsRelimit ) );
+	iMaxLen = Max (
+		Max ( iMvasRelimit, iKeywordsRelimit ),
+		Max ( iMaxLen, iRowsRelimit ) );
+
+	return iWordsRelimit + iDocsRelimit + iHitsRelimit + iStringsRelimit + iMvasRelimit + iKeywordsRelimit + iRowsRelimit;
+}
+
+
+void RtIndex_t::Commit ( int * pDeleted, ISphRtAccum * pAccExt )
 {
 	assert ( g_bRTChangesAllowed );
 	MEMORY ( MEM_INDEX_RT );
@@ -2709,6 +3392,30 @@ void RtIndex_t::Commit ( int * pDeleted, ISphRtAccum * pAccExt )
 	}
 
 	// phase 0, build a new segment
+	RtSegment_t * pNewSeg = CreateAccumSegment ( pAcc );
+	BuildSegmentInfixes ( pNewSeg, m_pDict->HasMorphology() );
+
+#if PARANOID
+	if ( pNewSeg )
+		CheckSegmentRows ( pNewSeg, m_iStride );
+#endif
+
+	// now on to the stuff that needs locking and recovery
+	CommitReplayable ( pNewSeg, pAcc->m_dAccumKlist, pDeleted );
+
+	// done; cleanup accum
+	pAcc->SetIndex ( NULL );
+	pAcc->m_iAccumDocs = 0;
+	pAcc->m_dAccumKlist.Reset();
+	// reset accumulated warnings
+	CSphString sWarning;
+	pAcc->GrabLastWarning ( sWarning );
+}
+
+/// build a new segment off the accumulated documents, and free the accumulator parts that are no longer needed
+/// (but its kill-list, which gets sorted)
+RtSegment_t * RtIndex_t::CreateAccumSegment ( RtAccum_t * pAcc ) const
+{
 	// accum and segment are thread local; so no locking needed yet
 	// segment might be NULL if we're only killing rows this txn
 	pAcc->CleanupDuplicates ( m_tSchema.GetRowSize() );
@@ -2719,13 +3426,6 @@ void RtIndex_t::Commit ( int * pDeleted, ISphRtAccum * pAccExt )
 	assert ( !pNewSeg || pNewSeg->m_iAliveRows>0 );
 	assert ( !pNewSeg || pNewSeg->m_bTlsKlist==false );
 
-	BuildSegmentInfixes ( pNewSeg, m_pDict->HasMorphology() );
-
-#if PARANOID
-	if ( pNewSeg )
-		CheckSegmentRows ( pNewSeg, m_iStride );
-#endif
-
 	// clean up parts we no longer need
 	pAcc->m_dAccum.Resize ( 0 );
 	pAcc->m_dAccumRows.Resize ( 0 );
@@ -2736,21 +3436,528 @@ void RtIndex_t::Commit ( int * pDeleted, ISphRtAccum * pAccExt )
 
 	// sort accum klist, too
 	pAcc->m_dAccumKlist.Uniq ();
+	return pNewSeg;
+}
 
-	// now on to the stuff that needs locking and recovery
-	CommitReplayable ( pNewSeg, pAcc->m_dAccumKlist, pDeleted );
+
+/// txns smaller than that are cheaper to bulk commit via RAM segments as usual
+/// (and bulk runs never get smaller than that, either)
+static const int RT_BULK_MIN_DOCS = 8192;
+
+
+#if USE_WINDOWS
+int fsync ( int iFD );
+#endif
+
+
+/// files of a disk chunk written off RAM segments
+static const char * g_dChunkExts[] = { ".sph", ".spa", ".sps", ".spm", ".spp", ".spd", ".spi", ".spe", ".spk" };
+
+
+/// fsync the directory of a file, so that new entries there (or renames) are durable, too
+static bool SyncDirectory ( const char * sFile, CSphString & sError )
+{
+#if !USE_WINDOWS
+	CSphString sDir ( sFile );
+	char * sSlash = (char *) strrchr ( sDir.cstr(), '/' );
+	if ( sSlash )
+		*sSlash = '\0';
+	else
+		sDir = ".";
+
+	int iFD = ::open ( sDir.cstr(), O_RDONLY );
+	if ( iFD<0 )
+	{
+		sError.SetSprintf ( "failed to open directory %s: %s", sDir.cstr(), strerror ( errno ) );
+		return false;
+	}
+	bool bOk = ( fsync ( iFD )==0 );
+	if ( !bOk )
+		sError.SetSprintf ( "failed to sync directory %s: %s", sDir.cstr(), strerror ( errno ) );
+	::close ( iFD );
+	return bOk;
+#else
+	return true;
+#endif
+}
+
+
+/// fsync all the files of a freshly written disk chunk, and the directory that got them
+/// binlog only references the chunk, so it must be durable before that reference is
+static bool SyncChunkFiles ( const char * sChunk, CSphString & sError )
+{
+	CSphString sName;
+	for ( int i=0; i<(int)( sizeof(g_dChunkExts)/sizeof(g_dChunkExts[0]) ); i++ )
+	{
+		sName.SetSprintf ( "%s%s", sChunk, g_dChunkExts[i] );
+		int iFD = sphOpenFile ( sName.cstr(), sError, true );
+		if ( iFD<0 )
+			return false;
+
+		bool bOk = ( fsync ( iFD )==0 );
+		if ( !bOk )
+			sError.SetSprintf ( "failed to sync %s: %s", sName.cstr(), strerror ( errno ) );
+		::close ( iFD );
+		if ( !bOk )
+			return false;
+	}
+
+	return SyncDirectory ( sChunk, sError );
+}
+
+
+/// remove whatever files of a disk chunk that did not make it online
+static void UnlinkChunkFiles ( const char * sChunk )
+{
+	CSphString sName;
+	for ( int i=0; i<(int)( sizeof(g_dChunkExts)/sizeof(g_dChunkExts[0]) ); i++ )
+	{
+		sName.SetSprintf ( "%s%s", sChunk, g_dChunkExts[i] );
+		if ( ::unlink ( sName.cstr() ) && errno!=ENOENT )
+			sphWarning ( "failed to unlink %s: %s", sName.cstr(), strerror ( errno ) );
+	}
+}
+
+
+/// build a segment off the accumulated documents with ids in [uMinID, uMaxID] only
+/// expects the accum sorted and free of duplicates; leaves it intact for the other runs
+RtSegment_t * RtAccum_t::CreateRunSegment ( const CSphSchema & tSchema, int iWordsCheckpoint, SphDocID_t uMinID, SphDocID_t uMaxID )
+{
+	MEMORY ( MEM_RT_ACCUM );
+
+	RtSegment_t * pSeg = new RtSegment_t ();
+	ZipHits ( pSeg, iWordsCheckpoint, uMinID, uMaxID );
+
+	// copy the rows of the run, along with their own strings and mvas
+	int iStride = DOCINFO_IDSIZE + tSchema.GetRowSize();
+	StorageStringVector_t tStorageString ( tSchema, pSeg->m_dStrings );
+	StorageMvaVector_t tStorageMva ( tSchema, pSeg->m_dMvas );
+
+	for ( int i=0; i<m_dAccumRows.GetLength(); i+=iStride )
+	{
+		SphDocID_t uDocid = DOCINFO2ID ( m_dAccumRows.Begin()+i );
+		if ( uDocid<uMinID || uDocid>uMaxID )
+			continue;
+
+		int iOff = pSeg->m_dRows.GetLength();
+		pSeg->m_dRows.Resize ( iOff+iStride );
+		memcpy ( pSeg->m_dRows.Begin()+iOff, m_dAccumRows.Begin()+i, iStride*sizeof(CSphRowitem) );
+		CopyFixupStorageAttrs ( m_dStrings, tStorageString, pSeg->m_dRows.Begin()+iOff );
+		CopyFixupStorageAttrs ( m_dMvas, tStorageMva, pSeg->m_dRows.Begin()+iOff );
+		pSeg->m_iRows++;
+	}
+
+	assert ( pSeg->m_iRows>0 );
+	pSeg->m_iAliveRows = pSeg->m_iRows;
+	sphSortDocinfos ( pSeg->m_dRows.Begin(), pSeg->m_iRows, iStride );
+	return pSeg;
+}
+
+
+/// bulk load commit
+/// writes the txn straight into disk chunks of its own, bypassing RAM segments and their merges,
+/// and binlogs references to those chunks rather than their data
+/// the chunks are built and synced without locking; the writing lock only covers bringing them online
+bool RtIndex_t::BulkCommit ( int * pDeleted, ISphRtAccum * pAccExt )
+{
+	assert ( g_bRTChangesAllowed );
+	MEMORY ( MEM_INDEX_RT );
+
+	RtAccum_t * pAcc = AcquireAccum ( NULL, pAccExt, true );
+	if ( !pAcc )
+		return true;
+
+	if ( pAcc->m_iAccumDocs<RT_BULK_MIN_DOCS )
+	{
+		Commit ( pDeleted, pAccExt );
+		return true;
+	}
+
+	pAcc->CleanupDuplicates ( m_tSchema.GetRowSize() );
+	pAcc->Sort();
+	pAcc->m_dAccumKlist.Uniq();
+
+	// save the RAM chunk first, so that the bulk loaded documents are newer than everything committed before
+	// whatever other writers commit meanwhile is just newer than them
+	ForceDiskChunk();
+
+	// cut the txn into runs by ids, each about a RAM chunk worth at most
+	// so that neither a segment built off a run nor a chunk saved off it outgrows what a regular flush makes
+	CSphVector<SphDocID_t> dIds ( pAcc->m_iAccumDocs );
+	for ( int i=0; i<pAcc->m_iAccumDocs; i++ )
+		dIds[i] = DOCINFO2ID ( pAcc->m_dAccumRows.Begin() + i*m_iStride );
+	dIds.Sort();
+
+	int64_t iAccumBytes = pAcc->m_dAccum.GetSizeBytes() + pAcc->m_dAccumRows.GetSizeBytes() + pAcc->m_dStrings.GetSizeBytes() + pAcc->m_dMvas.GetSizeBytes();
+	int iRunDocs = (int) Min ( m_iSoftRamLimit * pAcc->m_iAccumDocs / Max ( iAccumBytes, 1 ), (int64_t)pAcc->m_iAccumDocs );
+	iRunDocs = Max ( iRunDocs, RT_BULK_MIN_DOCS );
+
+	// build the runs, sorted by words and docids just as the chunks want them, under names of their own
+	// the whole txn kill-list goes to the first run chunk; later runs are newer, and only ids of their own are in there
+	CSphVector<CSphIndex *> dChunks;
+	CSphVector<int64_t> dRows;
+	CSphVector<SphDocID_t> dNoKlist;
+	bool bOk = true;
+	for ( int iRun=0; iRun<dIds.GetLength() && bOk; iRun+=iRunDocs )
+	{
+		SphDocID_t uMinID = dIds[iRun];
+		SphDocID_t uMaxID = dIds [ Min ( iRun+iRunDocs, dIds.GetLength() ) - 1 ];
+		RtSegment_t * pSeg = pAcc->CreateRunSegment ( m_tSchema, m_iWordsCheckpoint, uMinID, uMaxID );
+
+		CSphFixedVector<int64_t> dLens ( SPH_MAX_FIELDS );
+		ARRAY_FOREACH ( i, dLens )
+			dLens[i] = 0;
+		int iFirstFieldLenAttr = m_tSchema.GetAttrId_FirstFieldLen();
+		if ( iFirstFieldLenAttr>=0 )
+			for ( int i=0; i<pSeg->m_iRows; i++ )
+				ARRAY_FOREACH ( j, m_tSchema.m_dFields )
+					dLens[j] += sphGetRowAttr ( &pSeg->m_dRows [ i*m_iStride+DOCINFO_IDSIZE ], m_tSchema.GetAttr ( j+iFirstFieldLenAttr ).m_tLocator );
+
+		SphChunkGuard_t tGuard;
+		tGuard.m_dRamChunks.Reset ( 1 );
+		tGuard.m_dKill.Reset ( 1 );
+		tGuard.m_dRamChunks[0] = pSeg;
+		tGuard.m_dKill[0] = pSeg->m_pKlist;
+
+		CSphSourceStats tStats;
+		tStats.m_iTotalDocuments = pSeg->m_iRows;
+
+		// segment tags are unique, so concurrent bulk commits never clash
+		CSphString sChunk;
+		sChunk.SetSprintf ( "%s.bulk%d", m_sPath.cstr(), pSeg->m_iTag );
+		SaveDiskDataImpl ( sChunk.cstr(), tGuard, ChunkStats_t ( tStats, dLens ), dChunks.GetLength() ? dNoKlist : pAcc->m_dAccumKlist );
+		dRows.Add ( pSeg->m_iRows );
+		SafeDelete ( pSeg );
+
+		// the chunks are on disk, so the binlog only needs to know about them; but they must really be there first
+		CSphString sError;
+		CSphIndex * pChunk = LoadDiskChunk ( sChunk.cstr(), sError );
+		if ( pChunk )
+			dChunks.Add ( pChunk );
+		bOk = ( pChunk && SyncChunkFiles ( sChunk.cstr(), sError ) );
+		if ( !bOk )
+		{
+			m_sLastError.SetSprintf ( "bulk commit failed: %s", sError.cstr() );
+			if ( !pChunk )
+				UnlinkChunkFiles ( sChunk.cstr() );
+		}
+	}
+
+	// runs are on their own now
+	pAcc->m_dAccum.Reset();
+	pAcc->m_dAccumRows.Reset();
+	pAcc->m_dStrings.Resize ( 1 );
+	pAcc->m_dMvas.Resize ( 1 );
+	pAcc->m_dPerDocHitsCount.Reset();
+	pAcc->ResetDict();
+
+	// lock other writers out until the chunks are online; the one saving a RAM chunk needs the lock to finish it, though
+	// (that RAM chunk is older, so it must go online first)
+	int iFirstChunk = 0;
+	int iKilled = 0;
+	if ( bOk )
+	{
+		Verify ( m_tWriting.Lock() );
+		bool bWaited = false;
+		while ( m_iDoubleBuffer )
+		{
+			Verify ( m_tWriting.Unlock() );
+			m_tChunkSaved.WaitEvent();
+			Verify ( m_tWriting.Lock() );
+			bWaited = true;
+		}
+		if ( bWaited )
+			m_tChunkSaved.SetEvent(); // pass the wakeup on to other bulk commits, if any
+
+		// count the ids that the kill-list really kills, in older disk chunks,
+		// or in RAM segments committed since ForceDiskChunk() (AddBulkChunk() kills those)
+		const CSphVector<SphDocID_t> & dKlist = pAcc->m_dAccumKlist;
+		ARRAY_FOREACH ( i, dKlist )
+		{
+			SphDocID_t uDocid = dKlist[i];
+			bool bAlive = ARRAY_ANY ( bAlive, m_dRamChunks, ( m_dRamChunks[_any]->FindAliveRow ( uDocid )!=NULL ) );
+			for ( int j=m_dDiskChunks.GetLength()-1; j>=0 && !bAlive && !m_tKlist.Exists ( uDocid ); j-- )
+			{
+				const CSphIndex * pChunk = m_dDiskChunks[j];
+				bAlive = pChunk->HasDocid ( uDocid );
+				if ( bAlive || sphBinarySearch ( pChunk->GetKillList(), pChunk->GetKillList() + pChunk->GetKillListSize() - 1, uDocid ) )
+					break;
+			}
+
+			if ( bAlive )
+				iKilled++;
+		}
+
+		// rename the runs to the chunks they are going to be
+		iFirstChunk = m_dDiskChunks.GetLength()+m_iDiskBase;
+		ARRAY_FOREACH_COND ( i, dChunks, bOk )
+		{
+			CSphString sChunk;
+			sChunk.SetSprintf ( "%s.%d", m_sPath.cstr(), iFirstChunk+i );
+			bOk = dChunks[i]->Rename ( sChunk.cstr() );
+			if ( !bOk )
+				m_sLastError.SetSprintf ( "bulk commit failed: %s", dChunks[i]->GetLastError().cstr() );
+		}
+
+		CSphString sError;
+		if ( bOk && !SyncDirectory ( m_sPath.cstr(), sError ) )
+		{
+			m_sLastError.SetSprintf ( "bulk commit failed: %s", sError.cstr() );
+			bOk = false;
+		}
+
+		if ( !bOk )
+			Verify ( m_tWriting.Unlock() );
+	}
+
+	// drop the partial chunks, and fail the txn
+	if ( !bOk )
+	{
+		ARRAY_FOREACH ( i, dChunks )
+		{
+			CSphString sChunk ( dChunks[i]->GetFilename() );
+			SafeDelete ( dChunks[i] );
+			UnlinkChunkFiles ( sChunk.cstr() );
+		}
+
+		pAcc->SetIndex ( NULL );
+		pAcc->m_iAccumDocs = 0;
+		pAcc->m_dAccumKlist.Reset();
+		CSphString sWarning;
+		pAcc->GrabLastWarning ( sWarning );
+		return false;
+	}
+
+	// and bring them online, oldest first; killed ids go off the earliest runs
+	int64_t iKilledLeft = iKilled;
+	ARRAY_FOREACH ( i, dChunks )
+	{
+		int64_t iRunKilled = ( i==dChunks.GetLength()-1 ) ? iKilledLeft : Min ( iKilledLeft, dRows[i] );
+		iKilledLeft -= iRunKilled;
+		int64_t iDocs = dRows[i] - iRunKilled;
+
+		m_iFlushedBytes += GetChunkSize ( dChunks[i] );
+		g_pRtBinlog->BinlogAddChunk ( &m_iTID, m_sIndexName.cstr(), iFirstChunk+i, iDocs );
+		AddBulkChunk ( dChunks[i], iDocs, m_iTID );
+	}
+	if ( !m_dRamChunks.GetLength() )
+		g_pBinlog->NotifyIndexFlush ( m_sIndexName.cstr(), m_iTID, false );
+
+	Verify ( m_tWriting.Unlock() );
+
+	if ( pDeleted )
+		*pDeleted = iKilled;
 
 	// done; cleanup accum
 	pAcc->SetIndex ( NULL );
 	pAcc->m_iAccumDocs = 0;
 	pAcc->m_dAccumKlist.Reset();
-	// reset accumulated warnings
 	CSphString sWarning;
 	pAcc->GrabLastWarning ( sWarning );
+	return true;
+}
+
+
+/// bring a bulk loaded disk chunk online (expects writing lock held)
+/// RAM segments always shadow disk chunks, but the ones committed before the chunk got online are older than it,
+/// so their rows that the chunk replaces or kills have to be killed
+/// on replay, the chunk might be online already; then only those rows get killed
+void RtIndex_t::AddBulkChunk ( CSphIndex * pChunk, int64_t iDocs, int64_t iTID )
+{
+	SphDocID_t * pChunkKlist = pChunk->GetKillList();
+	int iChunkKlist = pChunk->GetKillListSize();
+
+	int iShadowed = 0;
+	CSphVector<SphDocID_t> dSegmentKlist;
+	CSphFixedVector<KlistRefcounted_t *> dNewKlists ( m_dRamChunks.GetLength() );
+	ARRAY_FOREACH ( iSeg, m_dRamChunks )
+	{
+		RtSegment_t * pSeg = m_dRamChunks[iSeg];
+		dNewKlists[iSeg] = NULL;
+		dSegmentKlist.Resize ( 0 );
+
+		RtRowIterator_T<SphDocID_t> tRows ( pSeg, m_iStride, false, NULL, pSeg->GetKlist() );
+		for ( const CSphRowitem * pRow = tRows.GetNextAliveRow(); pRow; pRow = tRows.GetNextAliveRow() )
+		{
+			SphDocID_t uDocid = DOCINFO2ID ( pRow );
+			bool bKilled = ( iChunkKlist && sphBinarySearch ( pChunkKlist, pChunkKlist + iChunkKlist - 1, uDocid ) );
+			if ( bKilled || pChunk->HasDocid ( uDocid ) )
+			{
+				dSegmentKlist.Add ( uDocid );
+				if ( !bKilled )
+					iShadowed++; // killed ids are already accounted for in iDocs
+			}
+		}
+
+		if ( !dSegmentKlist.GetLength() )
+			continue;
+
+		int iAdded = dSegmentKlist.GetLength();
+		dSegmentKlist.Resize ( pSeg->GetKlist().GetLength() + iAdded );
+		memcpy ( dSegmentKlist.Begin() + iAdded, pSeg->GetKlist().Begin(), sizeof(dSegmentKlist[0]) * pSeg->GetKlist().GetLength() );
+		dSegmentKlist.Uniq();
+
+		KlistRefcounted_t * pKlist = new KlistRefcounted_t();
+		pKlist->m_dKilled.Reset ( dSegmentKlist.GetLength() );
+		memcpy ( pKlist->m_dKilled.Begin(), dSegmentKlist.Begin(), sizeof(dSegmentKlist[0]) * dSegmentKlist.GetLength() );
+		dNewKlists[iSeg] = pKlist;
+	}
+
+	Verify ( m_tChunkLock.WriteLock() );
+	ARRAY_FOREACH ( iSeg, m_dRamChunks )
+	{
+		RtSegment_t * pSeg = m_dRamChunks[iSeg];
+		KlistRefcounted_t * pKlist = dNewKlists[iSeg];
+		if ( !pKlist )
+			continue;
+
+		uint64_t uRefs = pSeg->m_pKlist->m_tRefCount.Dec();
+		pSeg->m_iAliveRows -= pKlist->m_dKilled.GetLength() - pSeg->m_pKlist->m_dKilled.GetLength();
+		assert ( pSeg->m_iAliveRows>=0 );
+		Swap ( pSeg->m_pKlist, pKlist ); // hold swapped kill-list for postponed delete
+		dNewKlists[iSeg] = ( uRefs==1 ) ? pKlist : NULL;
+	}
+	bool bListed = m_dDiskChunks.Contains ( pChunk );
+	if ( !bListed )
+	{
+		m_dDiskChunks.Add ( pChunk );
+		UpdateDiskKlists();
+	}
+	PublishSnapshot();
+	Verify ( m_tChunkLock.Unlock() );
+
+	ARRAY_FOREACH ( i, dNewKlists )
+		SafeDelete ( dNewKlists[i] );
+
+	m_tStats.m_iTotalDocuments += iDocs - iShadowed;
+
+	const int64_t * pLens = pChunk->GetFieldLens();
+	if ( !bListed && pLens && m_tSchema.GetAttrId_FirstFieldLen()>=0 )
+		ARRAY_FOREACH ( i, m_tSchema.m_dFields )
+		{
+			m_dFieldLensDisk[i] += pLens[i];
+			m_dFieldLens[i] = m_dFieldLensRam[i] + m_dFieldLensDisk[i];
+		}
+
+	// RAM segments committed meanwhile are older than iTID, and not saved yet
+	if ( m_dRamChunks.GetLength() )
+	{
+		SaveMeta ( m_dDiskChunks.GetLength(), m_iSavedTID );
+	} else
+	{
+		SaveMeta ( m_dDiskChunks.GetLength(), iTID );
+		m_iSavedTID = iTID;
+	}
+}
+
+
+/// bring a bulk loaded disk chunk online on binlog replay, unless the meta already lists it
+bool RtIndex_t::ReplayBulkChunk ( int iChunk, int64_t iDocs, int64_t iTID, CSphString & sError )
+{
+	CSphString sChunk;
+	sChunk.SetSprintf ( "%s.%d", m_sPath.cstr(), iChunk );
+
+	// the meta might list the chunk already; but commits replayed before it are still older, and must not shadow it
+	ARRAY_FOREACH ( i, m_dDiskChunks )
+		if ( sChunk==m_dDiskChunks[i]->GetFilename() )
+		{
+			Verify ( m_tWriting.Lock() );
+			AddBulkChunk ( m_dDiskChunks[i], 0, iTID );
+			Verify ( m_tWriting.Unlock() );
+			return true;
+		}
+
+	CSphIndex * pChunk = LoadDiskChunk ( sChunk.cstr(), sError );
+	if ( !pChunk )
+		return false;
+
+	Verify ( m_tWriting.Lock() );
+	AddBulkChunk ( pChunk, iDocs, iTID );
+	Verify ( m_tWriting.Unlock() );
+	return true;
 }
 
+
+/// consecutive binlog commits get merged into one segment up to that many rows
+static const int RT_REPLAY_BATCH_ROWS = 65536;
+
+/// apply replayed commits in tid order, folding runs of them into a single commit
+void RtIndex_t::ReplayCommits ( const CSphVector<RtReplayTxn_t *> & dTxns )
+{
+	bool bHasMorphology = m_pDict->HasMorphology();
+
+	int iTxn = 0;
+	while ( iTxn<dTxns.GetLength() )
+	{
+		RtReplayTxn_t * pFirst = dTxns[iTxn++];
+		RtSegment_t * pSeg = pFirst->m_pSeg;
+		pFirst->m_pSeg = NULL;
+		CSphVector<SphDocID_t> & dKlist = pFirst->m_dKlist;
+		int64_t iTID = pFirst->m_iTID;
+		bool bMerged = false;
+		bool bFolded = false;
+
+		if ( pSeg && m_bKeywordDict )
+			FixupSegmentCheckpoints ( pSeg );
+
+		for ( ; iTxn<dTxns.GetLength(); iTxn++ )
+		{
+			RtReplayTxn_t * pNext = dTxns[iTxn];
+			RtSegment_t * pNextSeg = pNext->m_pSeg;
+
+			// a bare kill-list can not be applied to the batch segment, so it starts a new batch
+			if ( pSeg && ( !pNextSeg || pSeg->m_iRows + pNextSeg->m_iRows > RT_REPLAY_BATCH_ROWS ) )
+				break;
+
+			pNext->m_pSeg = NULL;
+			if ( pNextSeg && m_bKeywordDict )
+				FixupSegmentCheckpoints ( pNextSeg );
+
+			if ( pSeg )
+			{
+				// the newer txn kills the batch rows, just like it kills the older segments
+				CSphFixedVector<SphDocID_t> dKillOld ( pNext->m_dKlist.GetLength() );
+				ARRAY_FOREACH ( i, pNext->m_dKlist )
+					dKillOld[i] = pNext->m_dKlist[i];
+				CSphFixedVector<SphDocID_t> dKillNew ( 0 );
+
+				RtSegment_t * pMerged = MergeSegments ( pSeg, pNextSeg, dKillOld, dKillNew, NULL, bHasMorphology );
+				SafeDelete ( pSeg );
+				SafeDelete ( pNextSeg );
+				pSeg = pMerged;
+				bMerged = true;
+			} else
+			{
+				// so far the batch only had kill-lists, and those can not touch the rows of a newer txn
+				pSeg = pNextSeg;
+				bMerged = false;
+			}
+
+			ARRAY_FOREACH ( i, pNext->m_dKlist )
+				dKlist.Add ( pNext->m_dKlist[i] );
+			iTID = pNext->m_iTID;
+			bFolded = true;
+		}
+
+		// merging built those already
+		if ( pSeg && !bMerged && m_bKeywordDict )
+			BuildSegmentInfixes ( pSeg, bHasMorphology );
+
+		if ( bFolded )
+			dKlist.Uniq();
+		CommitReplayable ( pSeg, dKlist, NULL );
+
+		// update committed tid on replay in case of unexpected / mismatched tid
+		m_iTID = iTID;
+	}
+}
+
+
 void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t> & dAccKlist, int * pTotalKilled )
 {
+	// segment is still private, count its rollups before it gets published
+	SetupSegmentRollups ( pNewSeg );
+
 	// store statistics, because pNewSeg just might get merged
 	int iNewDocs = pNewSeg ? pNewSeg->m_iRows : 0;
 
@@ -2767,13 +3974,18 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 				dLens[j] += sphGetRowAttr ( &pNewSeg->m_dRows [ i*m_iStride+DOCINFO_IDSIZE ], m_tSchema.GetAttr ( j+iFirstFieldLenAttr ).m_tLocator );
 	}
 
+	// let background merger catch up before adding yet another segment
+	if ( pNewSeg )
+		WaitForMerger();
+
 	// phase 1, lock out other writers (but not readers yet)
 	// concurrent readers are ok during merges, as existing segments won't be modified yet
 	// however, concurrent writers are not
 	Verify ( m_tWriting.Lock() );
+	bool bBackgroundMerge = g_bRtMergeActive;
 
 	// first of all, binlog txn data for recovery
-	g_pRtBinlog->BinlogCommit ( &m_iTID, m_sIndexName.cstr(), pNewSeg, dAccKlist, m_bKeywordDict );
+	int64_t iSyncTicket = g_pRtBinlog->BinlogCommit ( &m_iTID, m_sIndexName.cstr(), pNewSeg, dAccKlist, m_bKeywordDict );
 	int64_t iTID = m_iTID;
 
 	// let merger know that existing segments are subject to additional, TLS K-list filter
@@ -2807,15 +4019,23 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 	int64_t iRamLeft = m_iDoubleBuffer ? m_iDoubleBufferLimit : m_iSoftRamLimit;
 	ARRAY_FOREACH ( i, dSegments )
 		iRamLeft = Max ( iRamLeft - dSegments[i]->GetUsedRam(), 0 );
-	ARRAY_FOREACH ( i, m_dRetired )
-		iRamLeft = Max ( iRamLeft - m_dRetired[i]->GetUsedRam(), 0 );
+	iRamLeft = Max ( iRamLeft - GetRetiredRam(), 0 );
 
 	// skip merging if no rows were added or no memory left
 	bool bDump = ( iRamLeft==0 );
-	const int MAX_SEGMENTS = 32;
-	const int MAX_PROGRESSION_SEGMENT = 8;
+
+	// background merger does the merging, unless it falls too far behind, or can not merge at all
+	if ( bBackgroundMerge && !bDump && dSegments.GetLength()>=RT_MAX_SEGMENTS )
+	{
+		dSegments.Sort ( CmpSegments_fn() );
+		const int iLen = dSegments.GetLength();
+		int64_t iMaxLen = 0;
+		int64_t iEstimate = RtMergeRamEstimate ( dSegments[iLen-1], dSegments[iLen-2], iMaxLen );
+		bDump = ( iLen>=RT_HARD_SEGMENTS || iEstimate>iRamLeft || iMaxLen>INT_MAX );
+	}
+
 	const int64_t MAX_SEGMENT_VECTOR_LEN = INT_MAX;
-	while ( pNewSeg && iRamLeft>0 )
+	while ( pNewSeg && iRamLeft>0 && !bBackgroundMerge )
 	{
 		// segments sort order: large first, smallest last
 		// merge last smallest segments
@@ -2824,49 +4044,21 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 		// unconditionally merge if there's too much segments now
 		// conditionally merge if smallest segment has grown too large
 		// otherwise, we're done
-		const int iLen = dSegments.GetLength();
-		if ( iLen < ( MAX_SEGMENTS - MAX_PROGRESSION_SEGMENT ) )
-			break;
-		assert ( iLen>=2 );
-		// exit if progression is kept AND lesser MAX_SEGMENTS limit
-		if ( dSegments[iLen-2]->GetMergeFactor() > dSegments[iLen-1]->GetMergeFactor()*2 && iLen < MAX_SEGMENTS )
+		if ( !RtNeedsMerge ( dSegments ) )
 			break;
 
 		// check whether we have enough RAM
-#define LOC_ESTIMATE1(_seg,_vec) \
-	(int)( ( (int64_t)_seg->_vec.GetLength() ) * _seg->m_iAliveRows / _seg->m_iRows )
-
-#define LOC_ESTIMATE(_vec) \
-	( LOC_ESTIMATE1 ( dSegments[iLen-1], _vec ) + LOC_ESTIMATE1 ( dSegments[iLen-2], _vec ) )
-
-		int64_t iWordsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dWords ) );
-		int64_t iDocsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dDocs ) );
-		int64_t iHitsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dHits ) );
-		int64_t iStringsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dStrings ) );
-		int64_t iMvasRelimit = CSphTightVectorPolicy<DWORD>::Relimit ( 0, LOC_ESTIMATE ( m_dMvas ) );
-		int64_t iKeywordsRelimit = CSphTightVectorPolicy<BYTE>::Relimit ( 0, LOC_ESTIMATE ( m_dKeywordCheckpoints ) );
-		int64_t iRowsRelimit = CSphTightVectorPolicy<SphDocID_t>::Relimit ( 0, LOC_ESTIMATE ( m_dRows ) );
-
-#undef LOC_ESTIMATE
-#undef LOC_ESTIMATE1
-
-		int64_t iEstimate = iWordsRelimit + iDocsRelimit + iHitsRelimit + iStringsRelimit + iMvasRelimit + iKeywordsRelimit + iRowsRelimit;
+		const int iLen = dSegments.GetLength();
+		int64_t iMaxLen = 0;
+		int64_t iEstimate = RtMergeRamEstimate ( dSegments[iLen-1], dSegments[iLen-2], iMaxLen );
 		if ( iEstimate>iRamLeft )
 		{
 			// dump case: can't merge any more AND segments count limit's reached
-			bDump = ( ( iRamLeft + iRamFreed )<=iEstimate ) && ( iLen>=MAX_SEGMENTS );
+			bDump = ( ( iRamLeft + iRamFreed )<=iEstimate ) && ( iLen>=RT_MAX_SEGMENTS );
 			break;
 		}
 
 		// we have to dump if we can't merge even smallest segments without breaking vector constrain ( len<INT_MAX )
-		// split this way to avoid superlong string after macro expansion that kills gcov
-		int64_t iMaxLen = Max (
-			Max ( iWordsRelimit, iDocsRelimit ),
-			Max ( iHitsRelimit, iStringsRelimit ) );
-		iMaxLen = Max (
-			Max ( iMvasRelimit, iKeywordsRelimit ),
-			Max ( iMaxLen, iRowsRelimit ) );
-
 		if ( MAX_SEGMENT_VECTOR_LEN<iMaxLen )
 		{
 			bDump = true;
@@ -2876,17 +4068,18 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 		// do it
 		RtSegment_t * pA = dSegments.Pop();
 		RtSegment_t * pB = dSegments.Pop();
-		RtSegment_t * pMerged = MergeSegments ( pA, pB, &dAccKlist, bHasMorphology );
+		RtSegment_t * pMerged = MergeSegments ( pA, pB, pA->GetKlist(), pB->GetKlist(), &dAccKlist, bHasMorphology );
 		if ( pMerged )
 		{
 			int64_t iMerged = pMerged->GetUsedRam();
 			iRamLeft -= Min ( iRamLeft, iMerged );
 			dSegments.Add ( pMerged );
 		}
-		m_dRetired.Add ( pA );
-		m_dRetired.Add ( pB );
 
+		// a segment is not ours anymore once retired, readers might free it
 		iRamFreed += pA->GetUsedRam() + pB->GetUsedRam();
+		RetireSegment ( pA );
+		RetireSegment ( pB );
 	}
 
 	// phase 2, obtain exclusive writer lock
@@ -3027,7 +4220,7 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 		RtSegment_t * pSeg = dSegments[i];
 		if ( pSeg->m_iAliveRows==0 )
 		{
-			m_dRetired.Add ( pSeg );
+			RetireSegment ( pSeg );
 			dSegments.RemoveFast ( i );
 			i--;
 		}
@@ -3040,6 +4233,7 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 	// got rid of 'old' double-buffer segments then add 'new' onces
 	m_dRamChunks.Resize ( m_iDoubleBuffer + dSegments.GetLength() );
 	memcpy ( m_dRamChunks.Begin() + m_iDoubleBuffer, dSegments.Begin(), sizeof(dSegments[0]) * dSegments.GetLength() );
+	PublishSnapshot();
 
 	// phase 3, enable readers again
 	// we might need to dump data to disk now
@@ -3067,13 +4261,19 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 	// we can kill retired segments now
 	FreeRetired();
 
+	if ( bBackgroundMerge && dSegments.GetLength()>=RT_MERGE_SEGMENTS )
+		ScheduleMerge();
+
 	// double buffer writer stands still till save done
 	// all writers waiting double buffer done
 	// no need to dump or waiting for some writer
 	if ( !bDump || bDoubleBufferActive )
 	{
 		// all done, enable other writers
+		// the next txns get binlogged while this one syncs, so that they share an fsync with it
+		// readers might see the txn a bit before it is durable, but the client only hears back after
 		Verify ( m_tWriting.Unlock() );
+		g_pRtBinlog->WaitSynced ( iSyncTicket );
 		return;
 	}
 
@@ -3090,6 +4290,7 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 		m_tKlist.Flush ( m_dDiskChunkKlist );
 
 		Verify ( m_tWriting.Unlock() );
+		g_pRtBinlog->WaitSynced ( iSyncTicket );
 
 		SaveDiskChunk ( iTID, tGuard, tStat2Dump );
 		g_pBinlog->NotifyIndexFlush ( m_sIndexName.cstr(), iTID, false );
@@ -3097,7 +4298,37 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 }
 
 
+/// hand a segment that is no longer listed in the RAM chunks over to the reaper; it goes once no snapshot (or merge) pins it
+void RtIndex_t::RetireSegment ( const RtSegment_t * pSeg )
+{
+	CSphScopedLock<CSphMutex> tLock ( m_tRetiredLock );
+	m_dRetired.Add ( pSeg );
+}
+
+
+/// RAM of the retired segments that are still pinned
+int64_t RtIndex_t::GetRetiredRam () const
+{
+	CSphScopedLock<CSphMutex> tLock ( m_tRetiredLock );
+	int64_t iRam = 0;
+	ARRAY_FOREACH ( i, m_dRetired )
+		iRam += m_dRetired[i]->GetUsedRam();
+	return iRam;
+}
+
+
+/// let go of the publisher's pins on the retired snapshots, and free whatever is not pinned anymore
+/// must be called under m_tWriting
 void RtIndex_t::FreeRetired()
+{
+	CSphScopedLock<CSphMutex> tLock ( m_tRetiredLock );
+	ReleasePinnedSnapshots();
+	FreeRetiredSegments();
+}
+
+
+/// free the retired segments that nothing pins; must be called under m_tRetiredLock
+void RtIndex_t::FreeRetiredSegments () const
 {
 	m_dRetired.Uniq();
 	ARRAY_FOREACH ( i, m_dRetired )
@@ -3112,6 +4343,235 @@ void RtIndex_t::FreeRetired()
 }
 
 
+int RtIndex_t::GetRamSegments () const
+{
+	Verify ( m_tChunkLock.ReadLock() );
+	int iSegments = m_dRamChunks.GetLength() - m_iDoubleBuffer;
+	Verify ( m_tChunkLock.Unlock() );
+	return iSegments;
+}
+
+
+bool RtIndex_t::IsMergePending () const
+{
+	CSphScopedLock<CSphMutex> tLock ( g_tRtMergeLock );
+	return m_bMergeQueued || g_pRtMerging==this;
+}
+
+
+void RtIndex_t::WaitForMerger () const
+{
+	// bounded; past RT_HARD_SEGMENTS the committer dumps a disk chunk anyway
+	for ( int i=0; i<RT_MERGE_WAIT_MSEC && g_bRtMergeActive && GetRamSegments()>=RT_MAX_SEGMENTS && IsMergePending(); i++ )
+		sphSleepMsec ( 1 );
+}
+
+
+void RtIndex_t::ScheduleMerge ()
+{
+	CSphScopedLock<CSphMutex> tLock ( g_tRtMergeLock );
+	if ( m_bMergeQueued || m_bMergeDisabled )
+		return;
+
+	g_dRtMergeQueue.Add ( this );
+	m_bMergeQueued = true;
+	g_tRtMergeWork.SetEvent();
+}
+
+
+bool RtIndex_t::BackgroundMerge ()
+{
+	// phase 1, pick the segments, the same way committer does
+	// updates in progress finish first, and the next ones record the rows they change in the picked segments
+	Verify ( m_tMergeLock.WriteLock() );
+	Verify ( m_tWriting.Lock() );
+
+	CSphVector<RtSegment_t*> dSegments;
+	for ( int i=m_iDoubleBuffer; i<m_dRamChunks.GetLength(); i++ )
+		dSegments.Add ( m_dRamChunks[i] );
+	dSegments.Sort ( CmpSegments_fn() );
+
+	RtSegment_t * pA = NULL;
+	RtSegment_t * pB = NULL;
+	if ( RtNeedsMerge ( dSegments ) )
+	{
+		int64_t iRamLeft = m_iDoubleBuffer ? m_iDoubleBufferLimit : m_iSoftRamLimit;
+		ARRAY_FOREACH ( i, dSegments )
+			iRamLeft = Max ( iRamLeft - dSegments[i]->GetUsedRam(), 0 );
+		iRamLeft = Max ( iRamLeft - GetRetiredRam(), 0 );
+
+		// not enough RAM, leave it to committer to dump a disk chunk
+		const int iLen = dSegments.GetLength();
+		int64_t iMaxLen = 0;
+		int64_t iEstimate = RtMergeRamEstimate ( dSegments[iLen-1], dSegments[iLen-2], iMaxLen );
+		if ( iEstimate<=iRamLeft && iMaxLen<=INT_MAX )
+		{
+			pA = dSegments[iLen-1];
+			pB = dSegments[iLen-2];
+		}
+	}
+
+	if ( !pA )
+	{
+		Verify ( m_tWriting.Unlock() );
+		Verify ( m_tMergeLock.Unlock() );
+		return false;
+	}
+
+	// pin the segments along with their current kill-lists, and let commits and updates go on
+	KlistRefcounted_t * pKillA = pA->m_pKlist;
+	KlistRefcounted_t * pKillB = pB->m_pKlist;
+	pKillA->m_tRefCount.Inc();
+	pKillB->m_tRefCount.Inc();
+	pA->m_tRefCount.Inc();
+	pB->m_tRefCount.Inc();
+	bool bHasMorphology = m_pDict->HasMorphology();
+
+	m_pMergeA = pA;
+	m_pMergeB = pB;
+	m_dMergeUpdated.Resize ( 0 );
+	Verify ( m_tMergeReading.Lock() );
+	Verify ( m_tWriting.Unlock() );
+	Verify ( m_tMergeLock.Unlock() );
+
+	// phase 2, merge
+	RtSegment_t * pMerged = MergeSegments ( pA, pB, pKillA->m_dKilled, pKillB->m_dKilled, NULL, bHasMorphology );
+	Verify ( m_tMergeReading.Unlock() );
+
+	// phase 3, go live unless the segments went to a disk chunk meanwhile
+	Verify ( m_tMergeLock.WriteLock() );
+	Verify ( m_tWriting.Lock() );
+	m_pMergeA = NULL;
+	m_pMergeB = NULL;
+
+	int iA = -1;
+	int iB = -1;
+	for ( int i=m_iDoubleBuffer; i<m_dRamChunks.GetLength(); i++ )
+	{
+		if ( m_dRamChunks[i]==pA )
+			iA = i;
+		else if ( m_dRamChunks[i]==pB )
+			iB = i;
+	}
+	bool bInstall = ( iA>=0 && iB>=0 );
+
+	// updates might have changed rows in the sources while we merged; copy them over once again
+	if ( bInstall && pMerged && m_dMergeUpdated.GetLength() )
+	{
+		m_dMergeUpdated.Uniq();
+		StorageStringVector_t tStorageString ( m_tSchema, pMerged->m_dStrings );
+		StorageMvaVector_t tStorageMva ( m_tSchema, pMerged->m_dMvas );
+		ARRAY_FOREACH ( i, m_dMergeUpdated )
+		{
+			const RtSegment_t * pSrcSeg = pA;
+			const CSphRowitem * pSrc = pA->FindAliveRow ( m_dMergeUpdated[i] );
+			if ( !pSrc )
+			{
+				pSrcSeg = pB;
+				pSrc = pB->FindAliveRow ( m_dMergeUpdated[i] );
+			}
+			CSphRowitem * pDst = const_cast<CSphRowitem *> ( pMerged->FindRow ( m_dMergeUpdated[i] ) );
+			if ( !pSrc || !pDst )
+				continue;
+
+			memcpy ( pDst, pSrc, m_iStride*sizeof(CSphRowitem) );
+			CopyFixupStorageAttrs ( pSrcSeg->m_dStrings, tStorageString, pDst );
+			CopyFixupStorageAttrs ( pSrcSeg->m_dMvas, tStorageMva, pDst );
+		}
+		if ( pMerged->m_dRollups.GetLength() )
+			pMerged->m_bRollupsStale = true;
+	}
+	m_dMergeUpdated.Reset();
+
+	// commits might have killed more rows in the sources while we merged
+	if ( bInstall && pMerged )
+	{
+		CSphVector<SphDocID_t> dKilled;
+		ARRAY_FOREACH ( i, pA->GetKlist() )
+			dKilled.Add ( pA->GetKlist()[i] );
+		ARRAY_FOREACH ( i, pB->GetKlist() )
+			dKilled.Add ( pB->GetKlist()[i] );
+
+		ARRAY_FOREACH ( i, dKilled )
+			if ( !pMerged->FindAliveRow ( dKilled[i] ) )
+				dKilled.RemoveFast ( i-- );
+
+		if ( dKilled.GetLength() )
+		{
+			dKilled.Uniq();
+			pMerged->m_pKlist->m_dKilled.Reset ( dKilled.GetLength() );
+			memcpy ( pMerged->m_pKlist->m_dKilled.Begin(), dKilled.Begin(), sizeof(dKilled[0]) * dKilled.GetLength() );
+			pMerged->m_iAliveRows -= dKilled.GetLength();
+			assert ( pMerged->m_iAliveRows>=0 );
+			if ( !pMerged->m_iAliveRows )
+				SafeDelete ( pMerged );
+		}
+	}
+
+	if ( bInstall )
+	{
+		Verify ( m_tChunkLock.WriteLock() );
+		m_dRamChunks.Remove ( Max ( iA, iB ) );
+		if ( pMerged )
+			m_dRamChunks[Min ( iA, iB )] = pMerged;
+		else
+			m_dRamChunks.Remove ( Min ( iA, iB ) );
+		PublishSnapshot();
+		Verify ( m_tChunkLock.Unlock() );
+
+		RetireSegment ( pA );
+		RetireSegment ( pB );
+	} else
+		SafeDelete ( pMerged );
+
+	// unpin, kill-lists first, as segments own their current ones
+	if ( pKillA->m_tRefCount.Dec()==1 )
+		SafeDelete ( pKillA );
+	if ( pKillB->m_tRefCount.Dec()==1 )
+		SafeDelete ( pKillB );
+	pA->m_tRefCount.Dec();
+	pB->m_tRefCount.Dec();
+
+	FreeRetired();
+	Verify ( m_tWriting.Unlock() );
+	Verify ( m_tMergeLock.Unlock() );
+	return true;
+}
+
+
+void RtIndex_t::MergeThreadFunc ( void * )
+{
+	while ( !g_bRtMergeShutdown )
+	{
+		RtIndex_t * pIndex = NULL;
+		Verify ( g_tRtMergeLock.Lock() );
+		if ( g_dRtMergeQueue.GetLength() )
+		{
+			pIndex = g_dRtMergeQueue[0];
+			g_dRtMergeQueue.Remove ( 0 );
+			pIndex->m_bMergeQueued = false;
+		}
+		g_pRtMerging = pIndex;
+		Verify ( g_tRtMergeLock.Unlock() );
+
+		if ( !pIndex )
+		{
+			g_tRtMergeWork.WaitEvent();
+			continue;
+		}
+
+		// merge down to the policy limits
+		while ( !g_bRtMergeShutdown && pIndex->BackgroundMerge() )
+			;
+
+		Verify ( g_tRtMergeLock.Lock() );
+		g_pRtMerging = NULL;
+		g_tRtMergeDone.SetEvent();
+		Verify ( g_tRtMergeLock.Unlock() );
+	}
+}
+
+
 void RtIndex_t::RollBack ( ISphRtAccum * pAccExt )
 {
 	assert ( g_bRTChangesAllowed );
@@ -3194,48 +4654,17 @@ struct SaveSegment_t
 };
 
 
-void RtIndex_t::SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t & tGuard, const ChunkStats_t & tStats ) const
+/// write the attributes of a disk chunk (.spa, .sps, .spm); returns the min-max index offset in .spa, in rowitems
+SphOffset_t RtIndex_t::SaveDiskAttrs ( const char * sFilename, const SphChunkGuard_t & tGuard ) const
 {
-	typedef RtDoc_T<SphDocID_t> RTDOC;
-	typedef RtWord_T<SphWordID_t> RTWORD;
-
 	CSphString sName, sError; // FIXME!!! report collected (sError) errors
 
-	CSphWriter wrHits, wrDocs, wrDict, wrRows, wrSkips;
-	sName.SetSprintf ( "%s.spp", sFilename ); wrHits.OpenFile ( sName.cstr(), sError );
-	sName.SetSprintf ( "%s.spd", sFilename ); wrDocs.OpenFile ( sName.cstr(), sError );
-	sName.SetSprintf ( "%s.spi", sFilename ); wrDict.OpenFile ( sName.cstr(), sError );
+	CSphWriter wrRows;
 	sName.SetSprintf ( "%s.spa", sFilename ); wrRows.OpenFile ( sName.cstr(), sError );
-	sName.SetSprintf ( "%s.spe", sFilename ); wrSkips.OpenFile ( sName.cstr(), sError );
-
-
-	wrDict.PutByte ( 1 );
-	wrDocs.PutByte ( 1 );
-	wrHits.PutByte ( 1 );
-	wrSkips.PutByte ( 1 );
-
-	// we don't have enough RAM to create new merged segments
-	// and have to do N-way merge kinda in-place
-	CSphVector<RtWordReader_T<SphWordID_t>*> pWordReaders;
-	CSphVector<RtDocReader_T<SphDocID_t>*> pDocReaders;
-	CSphVector<SaveSegment_t> pSegments;
-	CSphVector<const RTWORD*> pWords;
-	CSphVector<const RTDOC*> pDocs;
-
-	int iSegments = tGuard.m_dRamChunks.GetLength();
-
-	pWordReaders.Reserve ( iSegments );
-	pDocReaders.Reserve ( iSegments );
-	pSegments.Reserve ( iSegments );
-	pWords.Reserve ( iSegments );
-	pDocs.Reserve ( iSegments );
-
-	////////////////////
-	// write attributes
-	////////////////////
 
 	// the new, template-param aligned iStride instead of index-wide
 	int iStride = DWSIZEOF(SphDocID_t) + m_tSchema.GetRowSize();
+	int iSegments = tGuard.m_dRamChunks.GetLength();
 	CSphFixedVector<RtRowIterator_T<SphDocID_t>*> pRowIterators ( iSegments );
 	ARRAY_FOREACH ( i, tGuard.m_dRamChunks )
 		pRowIterators[i] = new RtRowIterator_T<SphDocID_t> ( tGuard.m_dRamChunks[i], iStride, false, NULL, tGuard.m_dKill[i]->m_dKilled );
@@ -3263,7 +4692,6 @@ void RtIndex_t::SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t
 	tMvaWriter.OpenFile ( sName.cstr(), sError );
 	tMvaWriter.PutDword ( 0 ); // dummy dword, to reserve magic zero offset
 
-	SphDocID_t iMinDocID = DOCID_MAX;
 	CSphRowitem * pFixedRow = new CSphRowitem[iStride];
 
 #ifndef NDEBUG
@@ -3307,9 +4735,6 @@ void RtIndex_t::SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t
 		// collect min-max data
 		Verify ( tMinMaxBuilder.Collect ( pRow, pSegment->m_dMvas.Begin(), pSegment->m_dMvas.GetLength(), sError, false ) );
 
-		if ( iMinDocID==DOCID_MAX )
-			iMinDocID = DOCINFO2ID ( pRows[iMinRow] );
-
 		if ( pSegment->m_dStrings.GetLength()>1 || pSegment->m_dMvas.GetLength()>1 ) // should be more then dummy zero elements
 		{
 			// copy row content as we'll fix up its attrs ( string offset for now )
@@ -3341,6 +4766,95 @@ void RtIndex_t::SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t
 
 	tMvaWriter.CloseFile();
 	tStrWriter.CloseFile ();
+	wrRows.CloseFile ();
+
+	ARRAY_FOREACH ( i, pRowIterators )
+		SafeDelete ( pRowIterators[i] );
+
+	return uMinMaxOff;
+}
+
+
+/// attributes saver of a disk chunk save, when it goes on a thread of its own
+struct RtSaveAttrs_t
+{
+	const RtIndex_t *			m_pIndex;
+	const char *				m_sFilename;
+	const SphChunkGuard_t *		m_pGuard;
+	SphOffset_t					m_uMinMaxOff;
+};
+
+
+void RtIndex_t::SaveDiskAttrsThreadFunc ( void * pArg )
+{
+	RtSaveAttrs_t * pSave = (RtSaveAttrs_t *)pArg;
+	pSave->m_uMinMaxOff = pSave->m_pIndex->SaveDiskAttrs ( pSave->m_sFilename, *pSave->m_pGuard );
+}
+
+
+
+void RtIndex_t::SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t & tGuard, const ChunkStats_t & tStats, const CSphVector<SphDocID_t> & dKlist ) const
+{
+	typedef RtDoc_T<SphDocID_t> RTDOC;
+	typedef RtWord_T<SphWordID_t> RTWORD;
+
+	CSphString sName, sError; // FIXME!!! report collected (sError) errors
+
+	CSphWriter wrHits, wrDocs, wrDict, wrSkips;
+	sName.SetSprintf ( "%s.spp", sFilename ); wrHits.OpenFile ( sName.cstr(), sError );
+	sName.SetSprintf ( "%s.spd", sFilename ); wrDocs.OpenFile ( sName.cstr(), sError );
+	sName.SetSprintf ( "%s.spi", sFilename ); wrDict.OpenFile ( sName.cstr(), sError );
+	sName.SetSprintf ( "%s.spe", sFilename ); wrSkips.OpenFile ( sName.cstr(), sError );
+
+
+	wrDict.PutByte ( 1 );
+	wrDocs.PutByte ( 1 );
+	wrHits.PutByte ( 1 );
+	wrSkips.PutByte ( 1 );
+
+	// we don't have enough RAM to create new merged segments
+	// and have to do N-way merge kinda in-place
+	CSphVector<RtWordReader_T<SphWordID_t>*> pWordReaders;
+	CSphVector<RtDocReader_T<SphDocID_t>*> pDocReaders;
+	CSphVector<SaveSegment_t> pSegments;
+	CSphVector<const RTWORD*> pWords;
+	CSphVector<const RTDOC*> pDocs;
+
+	int iSegments = tGuard.m_dRamChunks.GetLength();
+
+	pWordReaders.Reserve ( iSegments );
+	pDocReaders.Reserve ( iSegments );
+	pSegments.Reserve ( iSegments );
+	pWords.Reserve ( iSegments );
+	pDocs.Reserve ( iSegments );
+
+	// segment rows are sorted by docid, so the min one is among their first alive rows
+	// doclists are delta coded against it, and that is all they need from attributes
+	int iStride = DWSIZEOF(SphDocID_t) + m_tSchema.GetRowSize();
+	SphDocID_t iMinDocID = DOCID_MAX;
+	ARRAY_FOREACH ( i, tGuard.m_dRamChunks )
+	{
+		RtRowIterator_T<SphDocID_t> tRows ( tGuard.m_dRamChunks[i], iStride, false, NULL, tGuard.m_dKill[i]->m_dKilled );
+		const CSphRowitem * pRow = tRows.GetNextAliveRow();
+		if ( pRow )
+			iMinDocID = Min ( iMinDocID, DOCINFO2ID ( pRow ) );
+	}
+
+	////////////////////
+	// write attributes
+	////////////////////
+
+	// on a thread of their own if allowed, while this one writes the postings
+	RtSaveAttrs_t tSaveAttrs;
+	tSaveAttrs.m_pIndex = this;
+	tSaveAttrs.m_sFilename = sFilename;
+	tSaveAttrs.m_pGuard = &tGuard;
+	tSaveAttrs.m_uMinMaxOff = 0;
+
+	SphThread_t tAttrsThread;
+	bool bAttrsThread = g_iMergeThreads>1 && sphThreadCreate ( &tAttrsThread, SaveDiskAttrsThreadFunc, &tSaveAttrs );
+	if ( !bAttrsThread )
+		SaveDiskAttrsThreadFunc ( &tSaveAttrs );
 
 	////////////////////
 	// write docs & hits
@@ -3651,33 +5165,34 @@ void RtIndex_t::SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t
 	wrDict.ZipInt ( m_pTokenizer->GetMaxCodepointLength() );
 	wrDict.ZipInt ( (DWORD)iInfixBlockOffset );
 
+	if ( bAttrsThread )
+		sphThreadJoin ( &tAttrsThread );
+	SphOffset_t uMinMaxOff = tSaveAttrs.m_uMinMaxOff;
+
 	// write dummy kill-list files
 	CSphWriter wrDummy;
 	// dump killlist
 	sName.SetSprintf ( "%s.spk", sFilename );
 	wrDummy.OpenFile ( sName.cstr(), sError );
-	if ( m_dDiskChunkKlist.GetLength() )
-		wrDummy.PutBytes ( m_dDiskChunkKlist.Begin(), m_dDiskChunkKlist.GetLength()*sizeof ( SphDocID_t ) );
+	if ( dKlist.GetLength() )
+		wrDummy.PutBytes ( dKlist.Begin(), dKlist.GetLength()*sizeof ( SphDocID_t ) );
 	wrDummy.CloseFile ();
 
 	// header
 	SaveDiskHeader ( sFilename, iMinDocID, dCheckpoints.GetLength(), iCheckpointsPosition, (DWORD)iInfixBlockOffset, iInfixCheckpointWordsSize,
-		m_dDiskChunkKlist.GetLength(), uMinMaxOff, tStats );
+		dKlist.GetLength(), uMinMaxOff, tStats );
 
 	// cleanup
 	ARRAY_FOREACH ( i, pWordReaders )
 		SafeDelete ( pWordReaders[i] );
 	ARRAY_FOREACH ( i, pDocReaders )
 		SafeDelete ( pDocReaders[i] );
-	ARRAY_FOREACH ( i, pRowIterators )
-		SafeDelete ( pRowIterators[i] );
 
 	// done
 	wrSkips.CloseFile ();
 	wrHits.CloseFile ();
 	wrDocs.CloseFile ();
 	wrDict.CloseFile ();
-	wrRows.CloseFile ();
 }
 
 
@@ -3841,12 +5356,13 @@ void RtIndex_t::SaveDiskChunk ( int64_t iTID, const SphChunkGuard_t & tGuard, co
 	// dump it
 	CSphString sNewChunk;
 	sNewChunk.SetSprintf ( "%s.%d", m_sPath.cstr(), tGuard.m_dDiskChunks.GetLength()+m_iDiskBase );
-	SaveDiskDataImpl ( sNewChunk.cstr(), tGuard, tStats );
+	SaveDiskDataImpl ( sNewChunk.cstr(), tGuard, tStats, m_dDiskChunkKlist );
 
 	// bring new disk chunk online
 	CSphIndex * pDiskChunk = LoadDiskChunk ( sNewChunk.cstr(), m_sLastError );
 	if ( !pDiskChunk )
 		sphDie ( "%s", m_sLastError.cstr() );
+	m_iFlushedBytes += GetChunkSize ( pDiskChunk );
 
 	// FIXME! add binlog cleanup here once we have binlogs
 
@@ -3865,6 +5381,8 @@ void RtIndex_t::SaveDiskChunk ( int64_t iTID, const SphChunkGuard_t & tGuard, co
 	m_dRamChunks.Resize ( iNewSegmentsCount );
 
 	m_dDiskChunks.Add ( pDiskChunk );
+	UpdateDiskKlists();
+	PublishSnapshot();
 
 	// update field lengths
 	if ( m_tSchema.GetAttrId_FirstFieldLen()>=0 )
@@ -3883,7 +5401,7 @@ void RtIndex_t::SaveDiskChunk ( int64_t iTID, const SphChunkGuard_t & tGuard, co
 	Verify ( m_tChunkLock.Unlock() );
 
 	ARRAY_FOREACH ( i, tGuard.m_dRamChunks )
-		m_dRetired.Add ( tGuard.m_dRamChunks[i] );
+		RetireSegment ( tGuard.m_dRamChunks[i] );
 
 	// abandon .ram file
 	CSphString sChunk;
@@ -3896,8 +5414,57 @@ void RtIndex_t::SaveDiskChunk ( int64_t iTID, const SphChunkGuard_t & tGuard, co
 	m_iDoubleBuffer = 0;
 	m_iSavedTID = iTID;
 	m_tmSaved = sphMicroTimer();
+	m_tChunkSaved.SetEvent();
+
+	Verify ( m_tWriting.Unlock() );
+}
+
+
+void RtIndex_t::SetupJsonAttrs ()
+{
+	m_dJsonAttrs.Reset();
+	if ( m_tSettings.m_sJsonAttrs.IsEmpty() )
+		return;
+
+	CSphString sError;
+	if ( !sphJsonAttrsSetup ( m_tSchema, m_tSettings.m_sJsonAttrs, m_dJsonAttrs, sError ) )
+	{
+		sphWarning ( "index '%s': %s; generated attributes disabled", m_sIndexName.cstr(), sError.cstr() );
+		m_dJsonAttrs.Reset();
+	}
+}
+
+
+void RtIndex_t::CheckRollups () const
+{
+	if ( m_tSettings.m_sRollups.IsEmpty() )
+		return;
+
+	// segments just skip the bad tuples, so only complain once here
+	CSphVector<CSphRollup*> dRollups;
+	CSphString sError;
+	if ( !sphRollupsSetup ( m_tSettings.m_sRollups, m_tSchema, dRollups, sError ) )
+		sphWarning ( "index '%s': %s; rollup ignored", m_sIndexName.cstr(), sError.cstr() );
+
+	ARRAY_FOREACH ( i, dRollups )
+		SafeDelete ( dRollups[i] );
+}
+
+
+void RtIndex_t::SetupSegmentRollups ( RtSegment_t * pSeg ) const
+{
+	if ( !pSeg || ( m_tSettings.m_sRollups.IsEmpty() && !pSeg->m_dRollups.GetLength() ) )
+		return;
 
-	Verify ( m_tWriting.Unlock() );
+	ARRAY_FOREACH ( i, pSeg->m_dRollups )
+		SafeDelete ( pSeg->m_dRollups[i] );
+	pSeg->m_dRollups.Reset();
+	pSeg->m_bRollupsStale = false;
+
+	CSphString sError;
+	sphRollupsSetup ( m_tSettings.m_sRollups, m_tSchema, pSeg->m_dRollups, sError );
+	ARRAY_FOREACH ( i, pSeg->m_dRollups )
+		pSeg->m_dRollups[i]->Build ( pSeg->m_dRows.Begin(), pSeg->m_iRows, m_iStride );
 }
 
 
@@ -3924,6 +5491,11 @@ CSphIndex * RtIndex_t::LoadDiskChunk ( const char * sChunk, CSphString & sError
 		SafeDelete ( pDiskChunk );
 		return NULL;
 	}
+
+	// chunk headers do not store spatial index, rollup, and generated attribute settings, those come from the RT index
+	pDiskChunk->SetGeoIndex ( m_tSettings.m_sGeoIndex );
+	pDiskChunk->SetRollups ( m_tSettings.m_sRollups );
+	pDiskChunk->SetJsonAttrs ( m_tSettings.m_sJsonAttrs );
 	pDiskChunk->Preread();
 
 	return pDiskChunk;
@@ -3964,7 +5536,11 @@ bool RtIndex_t::Prealloc ( bool bStripPath )
 
 	// no readable meta? no disk part yet
 	if ( !sphIsReadable ( sMeta.cstr() ) )
+	{
+		SetupJsonAttrs();
+		CheckRollups();
 		return true;
+	}
 
 	// opened and locked, lets read
 	CSphAutoreader rdMeta;
@@ -4047,6 +5623,8 @@ bool RtIndex_t::Prealloc ( bool bStripPath )
 
 		// update schema
 		m_iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+		SetupJsonAttrs();
+		CheckRollups();
 	}
 
 	// meta v.5 checkpoint freq
@@ -4128,9 +5706,12 @@ bool RtIndex_t::Prealloc ( bool bStripPath )
 					m_dFieldLensDisk[i] += pLens[i];
 		}
 	}
+	UpdateDiskKlists();
 
 	// load ram chunk
 	bool bRamLoaded = LoadRamChunk ( uVersion, bRebuildInfixes );
+	if ( bRamLoaded )
+		PublishSnapshot();
 
 	// field lengths
 	ARRAY_FOREACH ( i, m_dFieldLens )
@@ -4436,6 +6017,8 @@ bool RtIndex_t::LoadRamChunk ( DWORD uVersion, bool bRebuildInfixes )
 			if ( bRebuildInfixes )
 				BuildSegmentInfixes ( pSeg, bHasMorphology );
 		}
+
+		SetupSegmentRollups ( pSeg );
 	}
 
 	// field lengths
@@ -5330,8 +6913,17 @@ int RtIndex_t::DebugCheck ( FILE * fp )
 
 				const BYTE * p = pData+4;
 				CSphVector<ESphJsonType> dStateStack;
+				CSphVector<const BYTE *> dObjectEnds; // NULL for the root, which is not size prefixed
 				if ( pData[0] | pData[1]<<8 | pData[2]<<16 | pData[3]<<24 )
+				{
 					dStateStack.Add ( JSON_OBJECT );
+					dObjectEnds.Add ( NULL );
+				}
+
+				// root key table (if any) trails the blob
+				const BYTE * pBlobEnd = pData + iBlobLen;
+				if ( iBlobLen>0 )
+					pBlobEnd -= sphJsonKeyTableSize ( pData+iBlobLen );
 
 				do
 				{
@@ -5351,7 +6943,18 @@ int RtIndex_t::DebugCheck ( FILE * fp )
 					case JSON_EOF:
 					{
 						if ( dStateStack.GetLength() && dStateStack.Last()==JSON_OBJECT )
+						{
 							dStateStack.Pop();
+
+							// skip the object key table
+							const BYTE * pObjEnd = dObjectEnds.Pop();
+							if ( pObjEnd && p!=pObjEnd )
+							{
+								if ( p+sphJsonKeyTableSize ( pObjEnd )!=pObjEnd )
+									LOC_FAIL(( fp, "JSON object length mismatch (trailing=%d, key table=%d)", int ( pObjEnd-p ), sphJsonKeyTableSize ( pObjEnd ) ));
+								p = pObjEnd;
+							}
+						}
 						break;
 					}
 
@@ -5372,7 +6975,8 @@ int RtIndex_t::DebugCheck ( FILE * fp )
 					case JSON_OBJECT:
 					{
 						dStateStack.Add ( JSON_OBJECT );
-						sphJsonUnpackInt ( &p );
+						int iObjLen = sphJsonUnpackInt ( &p );
+						dObjectEnds.Add ( p+iObjLen );
 						p += 4; // bloom mask
 						break;
 					}
@@ -5411,12 +7015,12 @@ int RtIndex_t::DebugCheck ( FILE * fp )
 						LOC_FAIL(( fp, "incorrect type in JSON blob (type=%d", eType ));
 						break;
 					}
-				} while ( p<( pData+iBlobLen ));
+				} while ( p<pBlobEnd );
 
 				if ( dStateStack.GetLength() )
 					LOC_FAIL(( fp, "JSON blob nested arrays/objects mismatch"));
 
-				if ( iBlobLen!=( p-pData ))
+				if ( pBlobEnd!=p )
 					LOC_FAIL(( fp, "JSON blob length mismatch (stored=%d, actual=%d)", iBlobLen, int( p-pData ) ));
 
 				uLastStrOffset = uOffset;
@@ -6716,44 +8320,182 @@ struct SphRtFinalMatchCalc_t : ISphMatchProcessor, ISphNoncopyable
 };
 
 
-void RtIndex_t::GetReaderChunks ( SphChunkGuard_t & tGuard ) const NO_THREAD_SAFETY_ANALYSIS
+void RtIndex_t::GetReaderChunks ( SphChunkGuard_t & tGuard ) const
 {
-	if ( !m_dRamChunks.GetLength() && !m_dDiskChunks.GetLength() )
+	// the publisher only lets go of retired snapshots while nobody is in between here
+	m_tAcquiring.Inc();
+	const RtSnapshot_t * pSnapshot = m_pSnapshot;
+	if ( pSnapshot )
+		pSnapshot->m_tRefs.Inc();
+	if ( m_tAcquiring.Dec()==1 && m_tReleaseDeferred.GetValue() )
+	{
+		// the publisher could not let go of its pins while we were in between, so the last one of us does
+		CSphScopedLock<CSphMutex> tLock ( m_tRetiredLock );
+		ReleasePinnedSnapshots();
+	}
+
+	if ( !pSnapshot )
 		return;
 
-	m_tReading.ReadLock();
-	tGuard.m_pReading = &m_tReading;
+	tGuard.m_pSnapshot = pSnapshot;
+	tGuard.m_pIndex = this;
+	tGuard.m_dRamChunks.Reset ( pSnapshot->m_dRamChunks.GetLength() );
+	tGuard.m_dKill.Reset ( pSnapshot->m_dKill.GetLength() );
+	tGuard.m_dDiskChunks.Reset ( pSnapshot->m_dDiskChunks.GetLength() );
+	tGuard.m_pDiskKlists = pSnapshot->m_pDiskKlists;
 
-	m_tChunkLock.ReadLock ();
+	memcpy ( tGuard.m_dRamChunks.Begin(), pSnapshot->m_dRamChunks.Begin(), sizeof(tGuard.m_dRamChunks[0]) * tGuard.m_dRamChunks.GetLength() );
+	memcpy ( tGuard.m_dKill.Begin(), pSnapshot->m_dKill.Begin(), sizeof(tGuard.m_dKill[0]) * tGuard.m_dKill.GetLength() );
+	memcpy ( tGuard.m_dDiskChunks.Begin(), pSnapshot->m_dDiskChunks.Begin(), sizeof(tGuard.m_dDiskChunks[0]) * tGuard.m_dDiskChunks.GetLength() );
+}
+
+
+/// make the current chunks visible to readers; must be called with the chunk lock held exclusively (or before there
+/// are any readers at all) whenever RAM segments, their kill-lists, or disk chunks change
+void RtIndex_t::PublishSnapshot ()
+{
+	RtSnapshot_t * pOld = m_pSnapshot;
+	if ( pOld )
+	{
+		CSphScopedLock<CSphMutex> tLock ( m_tRetiredLock );
+		m_dPinnedSnapshots.Add ( pOld );
+		m_dRetiredSnapshots.Add ( pOld );
+	}
+	m_pSnapshot = new RtSnapshot_t ( m_dRamChunks, m_dDiskChunks, m_pDiskKlists );
+}
 
-	tGuard.m_dRamChunks.Reset ( m_dRamChunks.GetLength() );
-	tGuard.m_dKill.Reset ( m_dRamChunks.GetLength() );
-	tGuard.m_dDiskChunks.Reset ( m_dDiskChunks.GetLength() );
 
-	memcpy ( tGuard.m_dRamChunks.Begin(), m_dRamChunks.Begin(), sizeof(m_dRamChunks[0]) * m_dRamChunks.GetLength() );
-	memcpy ( tGuard.m_dDiskChunks.Begin(), m_dDiskChunks.Begin(), sizeof(m_dDiskChunks[0]) * m_dDiskChunks.GetLength() );
+/// unpin a snapshot; the last one to let go of a retired snapshot frees it
+void RtIndex_t::ReleaseSnapshot ( const RtSnapshot_t * pSnapshot ) const
+{
+	if ( pSnapshot->m_tRefs.Dec()!=1 ) // 1 means we were the last owner when decrement event occurred
+		return;
 
-	ARRAY_FOREACH ( i, tGuard.m_dRamChunks )
+	CSphScopedLock<CSphMutex> tLock ( m_tRetiredLock );
+	FreeSnapshot ( pSnapshot );
+}
+
+
+/// free an unpinned retired snapshot, along with the segments only it pinned; must be called under m_tRetiredLock
+void RtIndex_t::FreeSnapshot ( const RtSnapshot_t * pSnapshot ) const
+{
+	ARRAY_FOREACH ( i, m_dRetiredSnapshots )
+		if ( m_dRetiredSnapshots[i]==pSnapshot )
+		{
+			m_dRetiredSnapshots.RemoveFast ( i );
+			break;
+		}
+
+	RtSnapshot_t * pOwned = const_cast<RtSnapshot_t *> ( pSnapshot );
+	SafeDelete ( pOwned );
+	FreeRetiredSegments();
+	m_tSnapshotFreed.SetEvent();
+}
+
+
+/// let go of the publisher's pins on the retired snapshots; must be called under m_tRetiredLock
+/// only when no reader is about to pin one though, it might be a retired one; the last such reader comes here again
+void RtIndex_t::ReleasePinnedSnapshots () const
+{
+	if ( !m_dPinnedSnapshots.GetLength() )
+		return;
+
+	// the flag goes up first, so that either we see the reader, or the reader sees the flag
+	m_tReleaseDeferred.SetValue ( 1 );
+	if ( m_tAcquiring.GetValue() )
+		return;
+	m_tReleaseDeferred.SetValue ( 0 );
+
+	ARRAY_FOREACH ( i, m_dPinnedSnapshots )
+		if ( m_dPinnedSnapshots[i]->m_tRefs.Dec()==1 )
+			FreeSnapshot ( m_dPinnedSnapshots[i] );
+	m_dPinnedSnapshots.Reset();
+}
+
+
+/// drop all the snapshots, the current one too; only when there are no readers
+void RtIndex_t::FreeSnapshots ()
+{
+	Verify ( m_tRetiredLock.Lock() );
+	ReleasePinnedSnapshots();
+	assert ( m_dPinnedSnapshots.GetLength()==0 );
+	assert ( m_dRetiredSnapshots.GetLength()==0 );
+	Verify ( m_tRetiredLock.Unlock() );
+
+	RtSnapshot_t * pSnapshot = m_pSnapshot;
+	m_pSnapshot = NULL;
+	if ( pSnapshot )
 	{
-		KlistRefcounted_t * pKlist = tGuard.m_dRamChunks[i]->m_pKlist;
-		pKlist->m_tRefCount.Inc();
-		tGuard.m_dKill[i] = pKlist;
+		assert ( pSnapshot->m_tRefs.GetValue()==1 );
+		pSnapshot->m_tRefs.Dec();
+		SafeDelete ( pSnapshot );
+	}
+}
+
 
-		assert ( tGuard.m_dRamChunks[i]->m_tRefCount.GetValue()>=0 );
-		tGuard.m_dRamChunks[i]->m_tRefCount.Inc();
+/// wait until no snapshot lists a disk chunk that is no longer current, so that it can be deleted
+/// the readers free the retired snapshots as they leave, and wake us up
+void RtIndex_t::WaitChunkReaders ( const CSphIndex * pChunk ) const
+{
+	for ( ;; )
+	{
+		Verify ( m_tRetiredLock.Lock() );
+		ReleasePinnedSnapshots();
+		bool bUsed = false;
+		ARRAY_FOREACH_COND ( i, m_dRetiredSnapshots, !bUsed )
+		{
+			const CSphFixedVector<const CSphIndex *> & dChunks = m_dRetiredSnapshots[i]->m_dDiskChunks;
+			bUsed = ARRAY_ANY ( bUsed, dChunks, dChunks[_any]==pChunk );
+		}
+		Verify ( m_tRetiredLock.Unlock() );
+
+		if ( !bUsed )
+			break;
+		m_tSnapshotFreed.WaitEvent();
 	}
+}
 
-	m_tChunkLock.Unlock ();
+
+/// rebuild disk chunk kill-lists; must be called whenever the disk chunk set changes, with the chunk lock held exclusively
+/// (or before there are any readers at all)
+void RtIndex_t::UpdateDiskKlists ()
+{
+	DiskKlists_t * pKlists = BuildDiskKlists ( m_dDiskChunks );
+	ReleaseDiskKlists ( m_pDiskKlists );
+	m_pDiskKlists = pKlists;
 }
 
 
-SphChunkGuard_t::~SphChunkGuard_t()
+RtSnapshot_t::RtSnapshot_t ( const CSphVector<RtSegment_t*> & dRamChunks, const CSphVector<CSphIndex*> & dDiskChunks, DiskKlists_t * pDiskKlists )
+	: m_dRamChunks ( dRamChunks.GetLength() )
+	, m_dKill ( dRamChunks.GetLength() )
+	, m_dDiskChunks ( dDiskChunks.GetLength() )
+	, m_pDiskKlists ( pDiskKlists )
+	, m_tRefs ( 1 )
 {
-	if ( m_pReading )
-		m_pReading->Unlock();
+	ARRAY_FOREACH ( i, dRamChunks )
+	{
+		KlistRefcounted_t * pKlist = dRamChunks[i]->m_pKlist;
+		pKlist->m_tRefCount.Inc();
+		m_dKill[i] = pKlist;
 
-	if ( !m_dRamChunks.GetLength() )
-		return;
+		assert ( dRamChunks[i]->m_tRefCount.GetValue()>=0 );
+		dRamChunks[i]->m_tRefCount.Inc();
+		m_dRamChunks[i] = dRamChunks[i];
+	}
+
+	ARRAY_FOREACH ( i, dDiskChunks )
+		m_dDiskChunks[i] = dDiskChunks[i];
+
+	if ( pDiskKlists )
+		pDiskKlists->m_tRefCount.Inc();
+}
+
+
+RtSnapshot_t::~RtSnapshot_t ()
+{
+	assert ( m_tRefs.GetValue()==0 );
+	ReleaseDiskKlists ( m_pDiskKlists );
 
 	ARRAY_FOREACH ( i, m_dRamChunks )
 	{
@@ -6769,6 +8511,174 @@ SphChunkGuard_t::~SphChunkGuard_t()
 }
 
 
+SphChunkGuard_t::~SphChunkGuard_t()
+{
+	if ( m_pSnapshot )
+		m_pIndex->ReleaseSnapshot ( m_pSnapshot );
+}
+
+
+/// pinned chunk set handed out to callers
+struct RtReader_t : public ISphRtReader
+{
+	SphChunkGuard_t		m_tGuard;
+
+	virtual int GetDiskChunks () const
+	{
+		return m_tGuard.m_dDiskChunks.GetLength();
+	}
+
+	virtual const CSphIndex * GetDiskChunk ( int iChunk ) const
+	{
+		return m_tGuard.m_dDiskChunks[iChunk];
+	}
+
+	virtual int GetRamSegments () const
+	{
+		return m_tGuard.m_dRamChunks.GetLength();
+	}
+
+	virtual int GetRamRows () const
+	{
+		int iRows = 0;
+		ARRAY_FOREACH ( i, m_tGuard.m_dRamChunks )
+			iRows += m_tGuard.m_dRamChunks[i]->m_iRows;
+		return iRows;
+	}
+};
+
+
+ISphRtReader * RtIndex_t::CreateReader () const
+{
+	RtReader_t * pReader = new RtReader_t();
+	GetReaderChunks ( pReader->m_tGuard );
+	return pReader;
+}
+
+
+/// one disk chunk search of a query
+struct RtChunkSearch_t
+{
+	const CSphIndex *		m_pChunk;
+	int						m_iTag;
+	KillListVector			m_dKillList;
+	const CSphBitvec *		m_pDeadRows;
+	CSphQueryResult			m_tResult;
+	bool					m_bSearched;
+	bool					m_bOk;
+
+	RtChunkSearch_t ()
+		: m_pChunk ( NULL )
+		, m_iTag ( 0 )
+		, m_pDeadRows ( NULL )
+		, m_bSearched ( false )
+		, m_bOk ( false )
+	{}
+};
+
+
+/// disk chunk searches of a query, newest chunk first; workers take them in turn, each into sorters of its own
+struct RtChunkSearchCtx_t
+{
+	const CSphQuery *					m_pQuery;
+	CSphFixedVector<RtChunkSearch_t>	m_dChunks;
+	CSphAtomic							m_iNext;
+	volatile bool						m_bFailed;
+	int64_t								m_tmMaxTimer;
+	CSphQueryProfile *					m_pProfile;
+
+	int									m_iIndexWeight;
+	DWORD								m_uPackedFactorFlags;
+	bool								m_bLocalDF;
+	const SmallStringHash_T<int64_t> *	m_pLocalDocs;
+	int64_t								m_iTotalDocs;
+
+	explicit RtChunkSearchCtx_t ( int iChunks )
+		: m_pQuery ( NULL )
+		, m_dChunks ( iChunks )
+		, m_bFailed ( false )
+		, m_tmMaxTimer ( 0 )
+		, m_pProfile ( NULL )
+		, m_iIndexWeight ( 1 )
+		, m_uPackedFactorFlags ( SPH_FACTOR_DISABLE )
+		, m_bLocalDF ( false )
+		, m_pLocalDocs ( NULL )
+		, m_iTotalDocs ( 0 )
+	{}
+};
+
+
+struct RtChunkWorker_t
+{
+	RtChunkSearchCtx_t *			m_pCtx;
+	CSphVector<ISphMatchSorter*>	m_dSorters;
+	SphThread_t						m_tThd;
+};
+
+
+/// search disk chunks until there are none left, or the query fails or runs out of time
+/// a chunk that was started is always finished, and the newest one is always searched, just as in the single thread case
+static void RtChunkSearchFunc ( void * pArg )
+{
+	RtChunkWorker_t * pWorker = (RtChunkWorker_t *) pArg;
+	RtChunkSearchCtx_t & tCtx = *pWorker->m_pCtx;
+
+	for ( ;; )
+	{
+		int iJob = (int) tCtx.m_iNext.Inc();
+		if ( iJob>=tCtx.m_dChunks.GetLength() || tCtx.m_bFailed )
+			break;
+
+		if ( iJob && tCtx.m_tmMaxTimer>0 && sphMicroTimer()>=tCtx.m_tmMaxTimer )
+			break;
+
+		// because disk chunk search will switch the profiler state
+		if ( tCtx.m_pProfile )
+			tCtx.m_pProfile->Switch ( SPH_QSTATE_INIT );
+
+		RtChunkSearch_t & tChunk = tCtx.m_dChunks[iJob];
+		tChunk.m_tResult.m_pProfile = tCtx.m_pProfile;
+
+		CSphMultiQueryArgs tMultiArgs ( tChunk.m_dKillList, tCtx.m_iIndexWeight );
+		tMultiArgs.m_iTag = tChunk.m_iTag;
+		tMultiArgs.m_pDeadRows = tChunk.m_pDeadRows;
+		tMultiArgs.m_uPackedFactorFlags = tCtx.m_uPackedFactorFlags;
+		tMultiArgs.m_bLocalDF = tCtx.m_bLocalDF;
+		tMultiArgs.m_pLocalDocs = tCtx.m_pLocalDocs;
+		tMultiArgs.m_iTotalDocs = tCtx.m_iTotalDocs;
+
+		tChunk.m_bOk = tChunk.m_pChunk->MultiQuery ( tCtx.m_pQuery, &tChunk.m_tResult, pWorker->m_dSorters.GetLength(), pWorker->m_dSorters.Begin(), tMultiArgs );
+		tChunk.m_bSearched = true;
+		if ( !tChunk.m_bOk )
+			tCtx.m_bFailed = true;
+	}
+}
+
+
+/// move the matches of a worker sorter to the query one
+/// the chunks did not share any docids (older copies are killed), so that only limits and orders them
+static void RtMergeChunkSorter ( ISphMatchSorter * pSorter, ISphMatchSorter * pChunkSorter )
+{
+	int64_t iTotal = pChunkSorter->GetTotalCount();
+	CSphQueryResult tFlat;
+	sphFlattenQueue ( pChunkSorter, &tFlat, -1 );
+
+	bool bGroupby = pSorter->IsGroupby();
+	ARRAY_FOREACH ( i, tFlat.m_dMatches )
+	{
+		if ( bGroupby )
+			pSorter->PushGrouped ( tFlat.m_dMatches[i], i==0 );
+		else
+			pSorter->Push ( tFlat.m_dMatches[i] );
+		pChunkSorter->GetSchema().FreeStringPtrs ( &tFlat.m_dMatches[i] );
+	}
+
+	// plain sorters count every match they saw, the ones the worker sorter did not keep too
+	if ( !bGroupby )
+		pSorter->m_iTotal += iTotal - tFlat.m_dMatches.GetLength();
+}
+
+
 // FIXME! missing MVA, index_exact_words support
 // FIXME? any chance to factor out common backend agnostic code?
 // FIXME? do we need to support pExtraFilters?
@@ -6876,80 +8786,124 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 	if ( pQuery->m_uMaxQueryMsec>0 )
 		tmMaxTimer = sphMicroTimer() + pQuery->m_uMaxQueryMsec*1000; // max_query_time
 
-	CSphVector<SphDocID_t> dCumulativeKList;
-	KillListVector dMergedKillist;
-	CSphVector<const BYTE *> dDiskStrings ( tGuard.m_dDiskChunks.GetLength() );
-	CSphVector<const DWORD *> dDiskMva ( tGuard.m_dDiskChunks.GetLength() );
-	CSphBitvec tMvaArenaFlag ( tGuard.m_dDiskChunks.GetLength() );
-	if ( tGuard.m_dDiskChunks.GetLength() )
+	int iDiskChunks = tGuard.m_dDiskChunks.GetLength();
+	CSphVector<SphDocID_t> dRamKList;
+	CSphVector<const BYTE *> dDiskStrings ( iDiskChunks );
+	CSphVector<const DWORD *> dDiskMva ( iDiskChunks );
+	CSphBitvec tMvaArenaFlag ( iDiskChunks );
+	if ( iDiskChunks )
 	{
-		m_tKlist.Flush ( dCumulativeKList );
+		m_tKlist.Flush ( dRamKList );
 	}
 
-	for ( int iChunk = tGuard.m_dDiskChunks.GetLength()-1; iChunk>=0; iChunk-- )
+	// newest chunk goes first; every chunk gets the RAM kill-list and its own cumulative one, from the newer chunks
+	RtChunkSearchCtx_t tChunkCtx ( iDiskChunks );
+	tChunkCtx.m_pQuery = pQuery;
+	tChunkCtx.m_tmMaxTimer = tmMaxTimer;
+	tChunkCtx.m_iIndexWeight = tArgs.m_iIndexWeight;
+	tChunkCtx.m_uPackedFactorFlags = tArgs.m_uPackedFactorFlags;
+	tChunkCtx.m_bLocalDF = bGotLocalDF;
+	tChunkCtx.m_pLocalDocs = pLocalDocs;
+	tChunkCtx.m_iTotalDocs = iTotalDocs;
+
+	// scans and filtered queries get to rows anyway, so they skip dead ones by row number rather than look up their docids
+	bool bRowKills = pQuery->m_sQuery.IsEmpty() || pQuery->m_dFilters.GetLength()>0;
+
+	assert ( !iDiskChunks || tGuard.m_pDiskKlists );
+	ARRAY_FOREACH ( iJob, tChunkCtx.m_dChunks )
 	{
-		// because disk chunk search within the loop will switch the profiler state
-		if ( pProfiler )
-			pProfiler->Switch ( SPH_QSTATE_INIT );
+		int iChunk = iDiskChunks-1-iJob;
+		RtChunkSearch_t & tChunk = tChunkCtx.m_dChunks[iJob];
+		tChunk.m_pChunk = tGuard.m_dDiskChunks[iChunk];
+		// storing index in matches tag for finding strings attrs offset later, biased against default zero and segments
+		tChunk.m_iTag = tGuard.m_dRamChunks.GetLength()+iChunk+1;
 
-		// collect & sort cumulative killlist for current chunk
-		if ( iChunk<tGuard.m_dDiskChunks.GetLength()-1 )
+		if ( dRamKList.GetLength() )
 		{
-			const CSphIndex * pNewerChunk = tGuard.m_dDiskChunks [ iChunk+1 ];
-			int iKlistEntries = pNewerChunk->GetKillListSize();
-			if ( iKlistEntries )
-			{
-				// merging two kill lists, assuming they have sorted data
-				const SphDocID_t * pSrc1 = dCumulativeKList.Begin();
-				const SphDocID_t * pSrc2 = pNewerChunk->GetKillList();
-				const SphDocID_t * pEnd1 = pSrc1 + dCumulativeKList.GetLength();
-				const SphDocID_t * pEnd2 = pSrc2 + iKlistEntries;
-				CSphVector<SphDocID_t> dNewCumulative ( ( pEnd1-pSrc1 )+( pEnd2-pSrc2 ) );
-				SphDocID_t * pDst = dNewCumulative.Begin();
-
-				while ( pSrc1!=pEnd1 && pSrc2!=pEnd2 )
-				{
-					if ( *pSrc1<*pSrc2 )
-						*pDst = *pSrc1++;
-					else if ( *pSrc2<*pSrc1 )
-						*pDst = *pSrc2++;
-					else
-					{
-						*pDst = *pSrc1++;
-						// handle duplicates
-						while ( *pDst==*pSrc1 ) pSrc1++;
-						while ( *pDst==*pSrc2 ) pSrc2++;
-					}
-					pDst++;
-				}
-				while ( pSrc1!=pEnd1 ) *pDst++ = *pSrc1++;
-				while ( pSrc2!=pEnd2 ) *pDst++ = *pSrc2++;
+			KillListTrait_t & tKlist = tChunk.m_dKillList.Add();
+			tKlist.m_pBegin = dRamKList.Begin();
+			tKlist.m_iLen = dRamKList.GetLength();
+		}
 
-				assert ( pDst<=( dNewCumulative.Begin()+dNewCumulative.GetLength() ) );
-				dNewCumulative.Resize ( pDst-dNewCumulative.Begin() );
-				dNewCumulative.SwapData ( dCumulativeKList );
-			}
+		const CSphBitvec & tDeadRows = tGuard.m_pDiskKlists->m_dDeadRows[iChunk];
+		const CSphVector<SphDocID_t> & dChunkKlist = tGuard.m_pDiskKlists->m_dKlists[iChunk];
+		if ( bRowKills && tDeadRows.GetBits() )
+		{
+			tChunk.m_pDeadRows = &tDeadRows;
+		} else if ( dChunkKlist.GetLength() )
+		{
+			KillListTrait_t & tKlist = tChunk.m_dKillList.Add();
+			tKlist.m_pBegin = dChunkKlist.Begin();
+			tKlist.m_iLen = dChunkKlist.GetLength();
+		}
+	}
+
+	// several chunks might go on several threads, each with sorters of its own, to be merged into the query ones after
+	// but only a single plain query can have its sorter recreated; and its matches must not depend on the chunk pools
+	// distinct counts, n-best groups and exact groups do not survive that second merge, as groups span chunks
+	bool bGroupsMerge = !dSorters.GetLength() || !dSorters[0]->IsGroupby()
+		|| ( pQuery->m_sGroupDistinct.IsEmpty() && pQuery->m_iGroupbyLimit<=1 && !pQuery->m_bGroupbyExact );
+
+	int iWorkers = 1;
+	if ( tArgs.m_pSorterFactory && tArgs.m_iThreads>1 && iDiskChunks>1 && dSorters.GetLength()==1
+		&& dSorters[0]->CanMulti() && bGroupsMerge && !( tArgs.m_uPackedFactorFlags & SPH_FACTOR_ENABLE ) )
+		iWorkers = Min ( tArgs.m_iThreads, iDiskChunks );
+
+	// the calling thread is the first worker, and it searches straight into the query sorters
+	CSphVector<RtChunkWorker_t> dWorkers ( iWorkers );
+	dWorkers[0].m_pCtx = &tChunkCtx;
+	dWorkers[0].m_dSorters = dSorters;
+	for ( int i=1; i<dWorkers.GetLength(); i++ )
+	{
+		ISphMatchSorter * pSorter = tArgs.m_pSorterFactory->CreateSorter ( *pQuery );
+		if ( !pSorter )
+		{
+			dWorkers.Resize ( i );
+			break;
 		}
+		dWorkers[i].m_pCtx = &tChunkCtx;
+		dWorkers[i].m_dSorters.Add ( pSorter );
+	}
+
+	// profiler is not thread safe
+	if ( dWorkers.GetLength()==1 )
+		tChunkCtx.m_pProfile = pProfiler;
 
-		dMergedKillist.Resize ( 0 );
-		if ( dCumulativeKList.GetLength() )
+	for ( int i=1; i<dWorkers.GetLength(); i++ )
+		if ( !sphThreadCreate ( &dWorkers[i].m_tThd, RtChunkSearchFunc, (void*)&dWorkers[i] ) )
 		{
-			dMergedKillist.Resize ( 1 );
-			dMergedKillist.Last().m_pBegin = dCumulativeKList.Begin();
-			dMergedKillist.Last().m_iLen = dCumulativeKList.GetLength();
+			sphWarning ( "rt: index %s: failed to create disk chunk search thread: %s", m_sIndexName.cstr(), strerror(errno) );
+			for ( int j=i; j<dWorkers.GetLength(); j++ )
+				SafeDelete ( dWorkers[j].m_dSorters[0] );
+			dWorkers.Resize ( i );
+			break;
 		}
 
-		CSphQueryResult tChunkResult;
-		tChunkResult.m_pProfile = pResult->m_pProfile;
-		CSphMultiQueryArgs tMultiArgs ( dMergedKillist, tArgs.m_iIndexWeight );
-		// storing index in matches tag for finding strings attrs offset later, biased against default zero and segments
-		tMultiArgs.m_iTag = tGuard.m_dRamChunks.GetLength()+iChunk+1;
-		tMultiArgs.m_uPackedFactorFlags = tArgs.m_uPackedFactorFlags;
-		tMultiArgs.m_bLocalDF = bGotLocalDF;
-		tMultiArgs.m_pLocalDocs = pLocalDocs;
-		tMultiArgs.m_iTotalDocs = iTotalDocs;
+	RtChunkSearchFunc ( (void*)&dWorkers[0] );
+
+	for ( int i=1; i<dWorkers.GetLength(); i++ )
+		sphThreadJoin ( &dWorkers[i].m_tThd );
+
+	for ( int i=1; i<dWorkers.GetLength(); i++ )
+	{
+		RtMergeChunkSorter ( dSorters[0], dWorkers[i].m_dSorters[0] );
+		SafeDelete ( dWorkers[i].m_dSorters[0] );
+	}
+
+	// collect chunk stats in the newest to oldest order, the same as for a single thread
+	ARRAY_FOREACH ( iJob, tChunkCtx.m_dChunks )
+	{
+		int iChunk = iDiskChunks-1-iJob;
+		const RtChunkSearch_t & tChunk = tChunkCtx.m_dChunks[iJob];
+		if ( !tChunk.m_bSearched )
+		{
+			if ( !tChunkCtx.m_bFailed )
+				pResult->m_sWarning = "query time exceeded max_query_time";
+			break;
+		}
 
-		if ( !tGuard.m_dDiskChunks[iChunk]->MultiQuery ( pQuery, &tChunkResult, iSorters, ppSorters, tMultiArgs ) )
+		const CSphQueryResult & tChunkResult = tChunk.m_tResult;
+		if ( !tChunk.m_bOk )
 		{
 			// FIXME? maybe handle this more gracefully (convert to a warning)?
 			pResult->m_sError = tChunkResult.m_sError;
@@ -6990,12 +8944,6 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 			pResult->m_tStats.m_iFetchedHits += tChunkResult.m_tStats.m_iFetchedHits;
 			pResult->m_tStats.m_iSkips += tChunkResult.m_tStats.m_iSkips;
 		}
-
-		if ( iChunk && tmMaxTimer>0 && sphMicroTimer()>=tmMaxTimer )
-		{
-			pResult->m_sWarning = "query time exceeded max_query_time";
-			break;
-		}
 	}
 
 	////////////////////
@@ -7198,6 +9146,15 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 			tMatch.Reset ( dSorters[iMaxSchemaIndex]->GetSchema().GetDynamicSize() );
 			tMatch.m_iWeight = tArgs.m_iIndexWeight;
 
+			// segments share the rollup tuples, so the first one with fresh cells tells which one the query can use
+			CSphRollupQuery tRollup;
+			CSphVector<CSphRollup::Total_t> dRollupTotals;
+			int iRollup = -1;
+			if ( dSorters.GetLength()==1 )
+				ARRAY_FOREACH_COND ( iSeg, tGuard.m_dRamChunks, iRollup<0 )
+					if ( !tGuard.m_dRamChunks[iSeg]->m_bRollupsStale && tGuard.m_dRamChunks[iSeg]->m_dRollups.GetLength() )
+						iRollup = tRollup.Setup ( tGuard.m_dRamChunks[iSeg]->m_dRollups, *pQuery, dSorters[0] );
+
 			ARRAY_FOREACH ( iSeg, tGuard.m_dRamChunks )
 			{
 				// set string pool for string on_sort expression fix up
@@ -7209,6 +9166,26 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 					dSorters[i]->SetMVAPool ( tGuard.m_dRamChunks[iSeg]->m_dMvas.Begin(), false );
 				}
 
+				// push pre-grouped cells, minus the killed rows, unless there are too many of these
+				const RtSegment_t * pSeg = tGuard.m_dRamChunks[iSeg];
+				const CSphFixedVector<SphDocID_t> & dSegKilled = tGuard.m_dKill[iSeg]->m_dKilled;
+				if ( iRollup>=0 && iRollup<pSeg->m_dRollups.GetLength() && !pSeg->m_bRollupsStale
+					&& dSegKilled.GetLength()*CSphRollup::KILL_RATIO<=pSeg->m_iRows )
+				{
+					const CSphRollup & tSegRollup = *pSeg->m_dRollups[iRollup];
+					dRollupTotals = tSegRollup.GetTotals();
+					ARRAY_FOREACH ( i, dSegKilled )
+					{
+						const CSphRowitem * pRow = pSeg->FindRow ( dSegKilled[i] );
+						if ( pRow )
+							tSegRollup.Subtract ( DOCINFO2ATTRS ( pRow ), dRollupTotals );
+					}
+
+					tMatch.m_iTag = iSeg+1;
+					tRollup.Push ( tSegRollup, &dRollupTotals, tCtx.m_pFilter, dSorters[0], tMatch );
+					continue;
+				}
+
 				RtRowIterator_t tIt ( tGuard.m_dRamChunks[iSeg], m_iStride, false, NULL, tGuard.m_dKill[iSeg]->m_dKilled );
 				for ( ;; )
 				{
@@ -7774,6 +9751,14 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 	CSphVector < CSphRefcountedPtr<ISphExpr> > dExpr ( iUpdLen );
 	memset ( dLocators.Begin(), 0, dLocators.GetSizeBytes() );
 
+	// JSON paths that got generated attributes would parse into those, but updates need the blob values
+	CSphSchema tJsonSchema;
+	if ( m_dJsonAttrs.GetLength() )
+	{
+		tJsonSchema = m_tSchema;
+		sphJsonAttrsUntag ( tJsonSchema );
+	}
+
 	uint64_t uDst64 = 0;
 	ARRAY_FOREACH ( i, tUpd.m_dAttrs )
 	{
@@ -7786,14 +9771,21 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 			{
 				iIdx = m_tSchema.GetAttrIndex ( sJsonCol.cstr() );
 				if ( iIdx>=0 )
-					dExpr[i] = sphExprParse ( tUpd.m_dAttrs[i], m_tSchema, NULL, NULL, sError, NULL );
+					dExpr[i] = sphExprParse ( tUpd.m_dAttrs[i], m_dJsonAttrs.GetLength() ? tJsonSchema : m_tSchema, NULL, NULL, sError, NULL );
 			}
 		}
 
 		if ( iIdx>=0 )
 		{
-			// forbid updates on non-int columns
+			// generated attributes follow their JSON values, and only those
 			const CSphColumnInfo & tCol = m_tSchema.GetAttr(iIdx);
+			if ( !tCol.m_sJsonPath.IsEmpty() )
+			{
+				sError.SetSprintf ( "attribute '%s' is generated from JSON path '%s' and can not be updated directly", tUpd.m_dAttrs[i], tCol.m_sJsonPath.cstr() );
+				return -1;
+			}
+
+			// forbid updates on non-int columns
 			if ( !( tCol.m_eAttrType==ESphAttr::SPH_ATTR_BOOL || tCol.m_eAttrType==ESphAttr::SPH_ATTR_INTEGER || tCol.m_eAttrType==ESphAttr::SPH_ATTR_TIMESTAMP
 				|| tCol.m_eAttrType==ESphAttr::SPH_ATTR_UINT32SET || tCol.m_eAttrType==ESphAttr::SPH_ATTR_INT64SET
 				|| tCol.m_eAttrType==ESphAttr::SPH_ATTR_BIGINT || tCol.m_eAttrType==ESphAttr::SPH_ATTR_FLOAT || tCol.m_eAttrType==ESphAttr::SPH_ATTR_JSON ))
@@ -7869,6 +9861,9 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 		return true;
 	}
 
+	// background merger picks and installs segments between updates; rows it is merging get recorded, and copied again
+	CSphScopedRLock tMergeLock ( m_tMergeLock );
+
 	// FIXME!!! grab Writer lock to prevent segments retirement during commit(merge)
 	SphChunkGuard_t tGuard;
 	GetReaderChunks ( tGuard );
@@ -7931,6 +9926,7 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 	{
 		// search segments first
 		bool bUpdated = false;
+		bool bJsonUpdated = false;
 		for ( ;; )
 		{
 			const CSphRowitem * pRow = tUpd.m_dRows[iUpd];
@@ -7942,6 +9938,12 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 
 			assert ( pSegment );
 			assert ( !uDocid || ( DOCINFO2ID(pRow)==uDocid ) );
+			bool bMergeSource = ( pSegment==m_pMergeA || pSegment==m_pMergeB );
+			if ( bMergeSource )
+			{
+				CSphScopedLock<CSphMutex> tLock ( m_tMergeUpdatedLock );
+				m_dMergeUpdated.Add ( DOCINFO2ID(pRow) );
+			}
 			pRow = DOCINFO2ATTRS(pRow);
 
 			int iPos = tUpd.m_dRowOffset[iUpd];
@@ -7960,6 +9962,7 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 					if ( sphJsonInplaceUpdate ( eType, uValue, dExpr[iCol].Ptr(), pSegment->m_dStrings.Begin(), pRow, true ) )
 					{
 						bUpdated = true;
+						bJsonUpdated = true;
 						uUpdateMask |= ATTRS_STRINGS_UPDATED;
 
 					} else
@@ -7983,6 +9986,11 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 
 					sphSetRowAttr ( const_cast<CSphRowitem *>( pRow ), dLocators[iCol], uValue );
 
+					// cells got counted over the old value; scan this segment from now on
+					ARRAY_FOREACH ( i, pSegment->m_dRollups )
+						if ( pSegment->m_dRollups[i]->Uses ( tUpd.m_dAttrs[iCol] ) )
+							pSegment->m_bRollupsStale = true;
+
 					iPos += dBigints.BitGet ( iCol ) ? 2 : 1;
 				} else
 				{
@@ -8010,10 +10018,15 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 					DWORD * pDst = dStorageMVA.Begin() + uMvaOff;
 					if ( uCount>(*pDst) )
 					{
+						// growing the pool moves it, so wait for the merger to stop reading it
+						if ( bMergeSource )
+							Verify ( m_tMergeReading.Lock() );
 						uMvaOff = dStorageMVA.GetLength();
 						dStorageMVA.Resize ( uMvaOff+uCount+1 );
 						pDst = dStorageMVA.Begin()+uMvaOff;
 						sphSetRowAttr ( const_cast<CSphRowitem *>( pRow ), dLocators[iCol], uMvaOff );
+						if ( bMergeSource )
+							Verify ( m_tMergeReading.Unlock() );
 					}
 
 					if ( bDst64 )
@@ -8033,6 +10046,18 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 				}
 			}
 
+			// generated attributes follow their JSON values
+			if ( bJsonUpdated && m_dJsonAttrs.GetLength() )
+			{
+				sphJsonAttrsRefresh ( const_cast<CSphRowitem *>( pRow ), m_dJsonAttrs, m_tSchema, pSegment->m_dStrings.Begin() );
+				uUpdateMask |= ATTRS_UPDATED;
+
+				ARRAY_FOREACH ( i, pSegment->m_dRollups )
+					ARRAY_FOREACH ( j, m_dJsonAttrs )
+						if ( pSegment->m_dRollups[i]->Uses ( m_dJsonAttrs[j].m_sName.cstr() ) )
+							pSegment->m_bRollupsStale = true;
+			}
+
 			if ( bUpdated )
 				iUpdated++;
 
@@ -8143,6 +10168,7 @@ bool RtIndex_t::AddRemoveAttribute ( bool bAdd, const CSphString & sAttrName, ES
 	}
 
 	SphOptimizeGuard_t tStopOptimize ( m_tOptimizingLock, m_bOptimizeStop ); // got write-locked at daemon
+	CSphScopedWLock tMergeLock ( m_tMergeLock );
 
 	int iOldStride = m_iStride;
 	const CSphColumnInfo * pNewAttr = NULL;
@@ -8223,6 +10249,10 @@ bool RtIndex_t::AddRemoveAttribute ( bool bAdd, const CSphString & sAttrName, ES
 		pSeg->m_dRows.SwapData ( dNewRows );
 	}
 
+	// locators might have moved
+	ARRAY_FOREACH ( iSeg, m_dRamChunks )
+		SetupSegmentRollups ( m_dRamChunks[iSeg] );
+
 	// fixme: we can't rollback at this point
 	Verify ( SaveRamChunk () );
 
@@ -8231,6 +10261,9 @@ bool RtIndex_t::AddRemoveAttribute ( bool bAdd, const CSphString & sAttrName, ES
 	// fixme: notify that it was ALTER that caused the flush
 	g_pBinlog->NotifyIndexFlush ( m_sIndexName.cstr(), m_iTID, false );
 
+	// locators might have moved
+	SetupJsonAttrs();
+
 	return true;
 }
 
@@ -8402,6 +10435,8 @@ bool RtIndex_t::AttachDiskIndex ( CSphIndex * pIndex, CSphString & sError )
 
 	// recreate disk chunk list, resave header file
 	m_dDiskChunks.Add ( pIndex );
+	UpdateDiskKlists();
+	PublishSnapshot();
 	SaveMeta ( m_dDiskChunks.GetLength(), m_iTID );
 
 	// FIXME? do something about binlog too?
@@ -8420,6 +10455,7 @@ bool RtIndex_t::Truncate ( CSphString & )
 {
 	// TRUNCATE needs an exclusive lock, should be write-locked at daemon, conflicts only with optimize
 	SphOptimizeGuard_t tStopOptimize ( m_tOptimizingLock, m_bOptimizeStop );
+	CSphScopedWLock tMergeLock ( m_tMergeLock );
 
 	// update and save meta
 	// indicate 0 disk chunks, we are about to kill them anyway
@@ -8450,13 +10486,18 @@ bool RtIndex_t::Truncate ( CSphString & )
 	}
 
 	// kill in-memory data, reset stats
+	// no readers here, so the snapshots can go right away; they have to go before the chunks they pin
+	FreeSnapshots();
+
 	ARRAY_FOREACH ( i, m_dDiskChunks )
 		SafeDelete ( m_dDiskChunks[i] );
 	m_dDiskChunks.Reset();
+	UpdateDiskKlists();
 
 	ARRAY_FOREACH ( i, m_dRamChunks )
 		SafeDelete ( m_dRamChunks[i] );
 	m_dRamChunks.Reset();
+	PublishSnapshot();
 
 	// we don't want kill list to work if we perform ATTACH right after this TRUNCATE
 	m_tKlist.Reset ( NULL, 0 );
@@ -8556,6 +10597,7 @@ void RtIndex_t::Optimize ( volatile bool * pForceTerminate, ThrottleState_t * pT
 				m_sIndexName.cstr(), sError.cstr() );
 			break;
 		}
+		m_iCompactedBytes += GetChunkSize ( pMerged.Ptr() );
 		// check forced exit after long operation
 		if ( *pForceTerminate || m_bOptimizeStop )
 			break;
@@ -8590,6 +10632,8 @@ void RtIndex_t::Optimize ( volatile bool * pForceTerminate, ThrottleState_t * pT
 
 		m_dDiskChunks[1] = pMerged.LeakPtr();
 		m_dDiskChunks.Remove ( 0 );
+		UpdateDiskKlists();
+		PublishSnapshot();
 		m_iDiskBase++;
 		int iDiskChunksCount = m_dDiskChunks.GetLength();
 
@@ -8604,16 +10648,13 @@ void RtIndex_t::Optimize ( volatile bool * pForceTerminate, ThrottleState_t * pT
 			break;
 		}
 
-		// exclusive reader (to make sure that disk chunks not used any more) and writer lock here
-		Verify ( m_tReading.WriteLock() );
-		Verify ( m_tWriting.Lock() );
+		// make sure that older snapshot readers are done with the old chunks
+		WaitChunkReaders ( pOlder );
+		WaitChunkReaders ( pOldest );
 
 		SafeDelete ( pOlder );
 		SafeDelete ( pOldest );
 
-		Verify ( m_tWriting.Unlock() );
-		Verify ( m_tReading.Unlock() );
-
 		// we might remove old index files
 		sphUnlinkIndex ( sRename.cstr(), true );
 		sphUnlinkIndex ( sOldest.cstr(), true );
@@ -8641,9 +10682,7 @@ void RtIndex_t::Optimize ( volatile bool * pForceTerminate, ThrottleState_t * pT
 
 int64_t GetChunkSize ( CSphVector<CSphIndex*> & dDiskChunks, int iIndex )
 {
-	CSphIndexStatus tDisk;
-	dDiskChunks[iIndex]->GetStatus(&tDisk);
-	return tDisk.m_iDiskUse;
+	return GetChunkSize ( dDiskChunks[iIndex] );
 }
 
 
@@ -8661,11 +10700,102 @@ int GetNextSmallestChunk ( CSphVector<CSphIndex*> & dDiskChunks, int iIndex=-1 )
 		}
 	}
 
-	return iRes;
+	return iRes;
+}
+
+
+/// disk chunks compaction policy
+/// chunks within 2x of each other's size form a tier, RT_COMPACT_TIER of them get merged pairwise, smallest first;
+/// a chunk with RT_COMPACT_KILL_PERCENT of its rows killed by newer chunks gets merged with its newer neighbour,
+/// which purges the rows killed by any of them (see ProgressiveMerge)
+static const int RT_COMPACT_TIER = 4;
+static const int RT_COMPACT_KILL_PERCENT = 30;
+
+
+struct ChunkSize_t
+{
+	int		m_iChunk;
+	int64_t	m_iSize;
+
+	bool operator < ( const ChunkSize_t & rhs ) const
+	{
+		return m_iSize<rhs.m_iSize;
+	}
+};
+
+
+bool sphRtPickCompaction ( const CSphVector<RtChunkStats_t> & dChunks, int & iDst, int & iSrc )
+{
+	int iChunks = dChunks.GetLength();
+	if ( iChunks<2 )
+		return false;
+
+	// mostly dead chunks go first, as they waste both disk and search time
+	// (the newest chunk has nothing newer to be killed by)
+	for ( int i=0; i<iChunks-1; i++ )
+	{
+		const RtChunkStats_t & tChunk = dChunks[i];
+		if ( !tChunk.m_iRows || tChunk.m_iDead*100<tChunk.m_iRows*RT_COMPACT_KILL_PERCENT )
+			continue;
+
+		iDst = i;
+		iSrc = i+1;
+		return true;
+	}
+
+	// otherwise, look for a big enough tier of similarly sized chunks
+	CSphVector<ChunkSize_t> dSizes ( iChunks );
+	ARRAY_FOREACH ( i, dSizes )
+	{
+		dSizes[i].m_iChunk = i;
+		dSizes[i].m_iSize = dChunks[i].m_iSize;
+	}
+	dSizes.Sort();
+	int iTierStart = 0;
+	for ( int i=1; i<=iChunks; i++ )
+	{
+		if ( i<iChunks && dSizes[i].m_iSize<=2*dSizes[iTierStart].m_iSize )
+			continue;
+
+		if ( i-iTierStart>=RT_COMPACT_TIER )
+		{
+			iDst = Min ( dSizes[iTierStart].m_iChunk, dSizes[iTierStart+1].m_iChunk );
+			iSrc = Max ( dSizes[iTierStart].m_iChunk, dSizes[iTierStart+1].m_iChunk );
+			return true;
+		}
+		iTierStart = i;
+	}
+
+	return false;
+}
+
+
+/// pick the pair of disk chunks due for compaction (expects chunk lock held); iDst is older than iSrc
+bool RtIndex_t::PickCompaction ( int & iDst, int & iSrc ) const
+{
+	CSphVector<RtChunkStats_t> dChunks ( m_dDiskChunks.GetLength() );
+	ARRAY_FOREACH ( i, dChunks )
+	{
+		RtChunkStats_t & tChunk = dChunks[i];
+		tChunk.m_iSize = GetChunkSize ( m_dDiskChunks[i] );
+
+		// one bit per docinfo row; chunk headers carry index-wide stats, so no help there
+		const CSphBitvec * pDead = m_pDiskKlists ? &m_pDiskKlists->m_dDeadRows[i] : NULL;
+		tChunk.m_iRows = pDead ? pDead->GetBits() : 0;
+		tChunk.m_iDead = tChunk.m_iRows ? pDead->BitCount() : 0;
+	}
+
+	return sphRtPickCompaction ( dChunks, iDst, iSrc );
+}
+
+
+bool RtIndex_t::Compact ( volatile bool * pForceTerminate, ThrottleState_t * pThrottle )
+{
+	return ProgressiveMerge ( pForceTerminate, pThrottle, true )>0;
 }
 
 
-void RtIndex_t::ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleState_t * pThrottle )
+int RtIndex_t::ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleState_t * pThrottle, bool bCompact )
 {
 	// How does this work:
 	// In order to minimize IO operations we merge chunks in order from the smallest to the largest to build a progression
@@ -8676,6 +10806,7 @@ void RtIndex_t::ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleStat
 	// 4) merge A and B chunk data to A, apply all kill lists collected on step 2
 	// the timeline is: [older chunks], ..., A (iDst), A+1, ..., B (iSrc), ..., [younger chunks]
 	// this also needs meta v.12 (chunk list with possible skips, instead of a base chunk + length as in meta v.11)
+	// with bCompact, A and B come from the compaction policy instead, and we stop once it has nothing to offer
 
 	assert ( pForceTerminate && pThrottle );
 	int64_t tmStart = sphMicroTimer();
@@ -8703,8 +10834,20 @@ void RtIndex_t::ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleStat
 		// however 'merged' got placed at 'src' position and 'merged' renamed to 'src' name
 
 		// TODO: presort a list of chunks by size before the main loop?
-		int iSrc = GetNextSmallestChunk ( m_dDiskChunks );
-		int iDst = GetNextSmallestChunk ( m_dDiskChunks, iSrc );
+		int iSrc = -1;
+		int iDst = -1;
+		if ( bCompact )
+		{
+			if ( !PickCompaction ( iDst, iSrc ) )
+			{
+				Verify ( m_tChunkLock.Unlock() );
+				break;
+			}
+		} else
+		{
+			iSrc = GetNextSmallestChunk ( m_dDiskChunks );
+			iDst = GetNextSmallestChunk ( m_dDiskChunks, iSrc );
+		}
 
 		// in order to merge kill-lists correctly we need to make sure that iDst is the oldest one
 		// indexes go from oldest to newest so iDst must go before iSrc (iDst is always older than iSrc)
@@ -8735,6 +10878,16 @@ void RtIndex_t::ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleStat
 			memcpy ( dKlist.Begin()+iOff, pIndex->GetKillList(), sizeof(SphDocID_t)*pIndex->GetKillListSize() );
 		}
 
+		// rows of A killed by chunks newer than B are just as dead; purge them as well,
+		// or a mostly dead chunk would survive the merge and get picked for compaction over and over
+		if ( m_pDiskKlists )
+		{
+			const CSphVector<SphDocID_t> & dNewer = m_pDiskKlists->m_dKlists[iDst];
+			int iOff = dKlist.GetLength();
+			dKlist.Resize ( iOff+dNewer.GetLength() );
+			memcpy ( dKlist.Begin()+iOff, dNewer.Begin(), sizeof(SphDocID_t)*dNewer.GetLength() );
+		}
+
 		// check if A+1 isn't B, merge A and A+1 kill-lists, write to A+1
 		if ( iDst+1!=iSrc )
 		{
@@ -8789,6 +10942,7 @@ void RtIndex_t::ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleStat
 				m_sIndexName.cstr(), sError.cstr() );
 			break;
 		}
+		m_iCompactedBytes += GetChunkSize ( pMerged.Ptr() );
 
 		// check forced exit after long operation
 		if ( *pForceTerminate || m_bOptimizeStop )
@@ -8830,6 +10984,8 @@ void RtIndex_t::ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleStat
 
 		m_dDiskChunks[iDst] = pMerged.LeakPtr();
 		m_dDiskChunks.Remove ( iSrc );
+		UpdateDiskKlists();
+		PublishSnapshot();
 		m_iDiskBase++;
 		int iDiskChunksCount = m_dDiskChunks.GetLength();
 
@@ -8844,16 +11000,13 @@ void RtIndex_t::ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleStat
 			break;
 		}
 
-		// exclusive reader (to make sure that disk chunks not used any more) and writer lock here
-		Verify ( m_tReading.WriteLock() );
-		Verify ( m_tWriting.Lock() );
+		// make sure that older snapshot readers are done with the old chunks
+		WaitChunkReaders ( pSrc );
+		WaitChunkReaders ( pDst );
 
 		SafeDelete ( pSrc );
 		SafeDelete ( pDst );
 
-		Verify ( m_tWriting.Unlock() );
-		Verify ( m_tReading.Unlock() );
-
 		// we might remove old index files
 		sphUnlinkIndex ( sRename.cstr(), true );
 		sphUnlinkIndex ( sDst.cstr(), true );
@@ -8862,16 +11015,19 @@ void RtIndex_t::ProgressiveMerge ( volatile bool * pForceTerminate, ThrottleStat
 
 	m_bOptimizing = false;
 	int64_t tmPass = sphMicroTimer() - tmStart;
+	int iMerged = iChunks-m_dDiskChunks.GetLength();
 
 	if ( *pForceTerminate )
 	{
 		sphWarning ( "rt: index %s: optimization terminated chunk(s) %d ( of %d ) in %d.%03d sec",
-			m_sIndexName.cstr(), iChunks-m_dDiskChunks.GetLength(), iChunks, (int)(tmPass/1000000), (int)((tmPass/1000)%1000) );
-	} else
+			m_sIndexName.cstr(), iMerged, iChunks, (int)(tmPass/1000000), (int)((tmPass/1000)%1000) );
+	} else if ( !bCompact || iMerged )
 	{
-		sphInfo ( "rt: index %s: optimized chunk(s) %d ( of %d ) in %d.%03d sec",
-			m_sIndexName.cstr(), iChunks-m_dDiskChunks.GetLength(), iChunks, (int)(tmPass/1000000), (int)((tmPass/1000)%1000) );
+		sphInfo ( "rt: index %s: %s chunk(s) %d ( of %d ) in %d.%03d sec",
+			m_sIndexName.cstr(), bCompact ? "compacted" : "optimized", iMerged, iChunks, (int)(tmPass/1000000), (int)((tmPass/1000)%1000) );
 	}
+
+	return iMerged;
 }
 
 
@@ -8899,6 +11055,8 @@ void RtIndex_t::GetStatus ( CSphIndexStatus * pRes ) const
 
 	pRes->m_iMemLimit = m_iSoftRamLimit;
 	pRes->m_iDiskUse = 0;
+	pRes->m_iFlushedBytes = m_iFlushedBytes;
+	pRes->m_iCompactedBytes = m_iCompactedBytes;
 
 	CSphString sError;
 	char sFile [ SPH_MAX_FILENAME_LEN ];
@@ -8921,6 +11079,10 @@ void RtIndex_t::GetStatus ( CSphIndexStatus * pRes ) const
 
 	pRes->m_iNumChunks = m_dDiskChunks.GetLength();
 
+	// upper bound on the merges the policy still has to do
+	pRes->m_iRamSegments = m_dRamChunks.GetLength() - m_iDoubleBuffer;
+	pRes->m_iMergeBacklog = Max ( pRes->m_iRamSegments - RT_MERGE_SEGMENTS + 1, 0 );
+
 	Verify ( m_tChunkLock.Unlock() );
 }
 
@@ -9279,14 +11441,19 @@ RtBinlog_c::RtBinlog_c ()
 	: m_iFlushTimeLeft ( 0 )
 	, m_iFlushPeriod ( BINLOG_AUTO_FLUSH )
 	, m_eOnCommit ( ACTION_NONE )
+	, m_iCommitSeq ( 0 )
+	, m_iSyncedSeq ( 0 )
 	, m_iLockFD ( -1 )
 	, m_bReplayMode ( false )
 	, m_bDisabled ( true )
 	, m_iRestartSize ( 0 )
+	, m_iReplayThreads ( 1 )
+	, m_pReplayWorkers ( NULL )
 {
 	MEMORY ( MEM_BINLOG );
 
 	m_tWriter.SetBufferSize ( BINLOG_WRITE_BUFFER );
+	memset ( &m_tStatus, 0, sizeof(m_tStatus) );
 }
 
 RtBinlog_c::~RtBinlog_c ()
@@ -9304,11 +11471,12 @@ RtBinlog_c::~RtBinlog_c ()
 }
 
 
-void RtBinlog_c::BinlogCommit ( int64_t * pTID, const char * sIndexName, const RtSegment_t * pSeg,
+/// returns the ticket to pass to WaitSynced() before reporting the txn as committed
+int64_t RtBinlog_c::BinlogCommit ( int64_t * pTID, const char * sIndexName, const RtSegment_t * pSeg,
 	const CSphVector<SphDocID_t> & dKlist, bool bKeywordDict )
 {
 	if ( m_bReplayMode || m_bDisabled )
-		return;
+		return 0;
 
 	MEMORY ( MEM_BINLOG );
 	Verify ( m_tWriteLock.Lock() );
@@ -9364,9 +11532,11 @@ void RtBinlog_c::BinlogCommit ( int64_t * pTID, const char * sIndexName, const R
 	m_tWriter.WriteCrc ();
 
 	// finalize
+	int64_t iSeq = ++m_iCommitSeq;
 	CheckDoFlush();
 	CheckDoRestart();
 	Verify ( m_tWriteLock.Unlock() );
+	return iSeq;
 }
 
 void RtBinlog_c::BinlogUpdateAttributes ( int64_t * pTID, const char * sIndexName, const CSphAttrUpdate & tUpd )
@@ -9419,9 +11589,11 @@ void RtBinlog_c::BinlogUpdateAttributes ( int64_t * pTID, const char * sIndexNam
 	m_tWriter.WriteCrc ();
 
 	// finalize
+	int64_t iSeq = ++m_iCommitSeq;
 	CheckDoFlush();
 	CheckDoRestart();
 	Verify ( m_tWriteLock.Unlock() );
+	WaitSynced ( iSeq );
 }
 
 void RtBinlog_c::BinlogReconfigure ( int64_t * pTID, const char * sIndexName, const CSphReconfigureSetup & tSetup )
@@ -9455,9 +11627,48 @@ void RtBinlog_c::BinlogReconfigure ( int64_t * pTID, const char * sIndexName, co
 	m_tWriter.WriteCrc ();
 
 	// finalize
+	int64_t iSeq = ++m_iCommitSeq;
+	CheckDoFlush();
+	CheckDoRestart();
+	Verify ( m_tWriteLock.Unlock() );
+	WaitSynced ( iSeq );
+}
+
+
+void RtBinlog_c::BinlogAddChunk ( int64_t * pTID, const char * sIndexName, int iChunk, int64_t iDocs )
+{
+	if ( m_bReplayMode || m_bDisabled )
+		return;
+
+	MEMORY ( MEM_BINLOG );
+	Verify ( m_tWriteLock.Lock() );
+
+	int64_t iTID = ++(*pTID);
+	const int64_t tmNow = sphMicroTimer();
+	const int uIndex = GetWriteIndexID ( sIndexName, iTID, tmNow );
+
+	// header
+	m_tWriter.PutDword ( BLOP_MAGIC );
+	m_tWriter.ResetCrc ();
+
+	m_tWriter.ZipOffset ( BLOP_ADD_CHUNK );
+	m_tWriter.ZipOffset ( uIndex );
+	m_tWriter.ZipOffset ( iTID );
+	m_tWriter.ZipOffset ( tmNow );
+
+	// chunk data
+	m_tWriter.ZipOffset ( iChunk );
+	m_tWriter.ZipOffset ( iDocs );
+
+	// checksum
+	m_tWriter.WriteCrc ();
+
+	// finalize
+	int64_t iSeq = ++m_iCommitSeq;
 	CheckDoFlush();
 	CheckDoRestart();
 	Verify ( m_tWriteLock.Unlock() );
+	WaitSynced ( iSeq );
 }
 
 
@@ -9538,6 +11749,64 @@ void RtBinlog_c::NotifyIndexFlush ( const char * sIndexName, int64_t iTID, bool
 	Verify ( m_tWriteLock.Unlock() );
 }
 
+/// with binlog_flush=1, block until the txn with the given ticket is fsync'ed
+/// whoever gets the sync lock first fsyncs all the txns appended so far; the ones queued behind it usually find theirs done by then
+void RtBinlog_c::WaitSynced ( int64_t iSeq )
+{
+	if ( m_eOnCommit!=ACTION_FSYNC || !iSeq )
+		return;
+
+	int64_t tmStart = sphMicroTimer();
+	Verify ( m_tSyncLock.Lock() );
+
+	if ( m_iSyncedSeq<iSeq )
+	{
+		// push the batch to the OS and grab the file; commits can go on appending while we fsync it
+		// dup() keeps the descriptor valid even if the log gets rotated meanwhile
+		Verify ( m_tWriteLock.Lock() );
+		m_tWriter.Write();
+		int64_t iBatchSeq = m_iCommitSeq;
+		int iFD = m_tWriter.GetFD()>=0 ? dup ( m_tWriter.GetFD() ) : -1;
+		CSphString sLog = m_tWriter.GetFilename();
+		Verify ( m_tWriteLock.Unlock() );
+
+		// a failed fsync might have dropped the dirty pages, so retrying proves nothing; and the waiters must not get acked
+		int64_t tmSync = sphMicroTimer();
+		if ( iFD>=0 )
+		{
+			if ( fsync ( iFD )!=0 )
+				sphDie ( "binlog: failed to sync %s: %s", sLog.cstr(), strerror(errno) );
+			::close ( iFD );
+		}
+		tmSync = sphMicroTimer() - tmSync;
+
+		int64_t iBatch = iBatchSeq - m_iSyncedSeq;
+		m_iSyncedSeq = iBatchSeq;
+
+		m_tStatus.m_iSyncs++;
+		m_tStatus.m_iSyncedTxns += iBatch;
+		m_tStatus.m_iMaxBatch = Max ( m_tStatus.m_iMaxBatch, iBatch );
+		m_tStatus.m_tmSyncTotal += tmSync;
+	}
+
+	int64_t tmWait = sphMicroTimer() - tmStart;
+	m_tStatus.m_iCommits++;
+	m_tStatus.m_tmWaitTotal += tmWait;
+	m_tStatus.m_tmWaitMax = Max ( m_tStatus.m_tmWaitMax, tmWait );
+
+	Verify ( m_tSyncLock.Unlock() );
+}
+
+
+void RtBinlog_c::GetStatus ( BinlogStatus_t & tStatus )
+{
+	Verify ( m_tSyncLock.Lock() );
+	tStatus = m_tStatus;
+	Verify ( m_tSyncLock.Unlock() );
+	tStatus.m_bGroupCommit = ( !m_bDisabled && m_eOnCommit==ACTION_FSYNC );
+}
+
+
 void RtBinlog_c::Configure ( const CSphConfigSection & hSearchd, bool bTestMode )
 {
 	MEMORY ( MEM_BINLOG );
@@ -9559,6 +11828,7 @@ void RtBinlog_c::Configure ( const CSphConfigSection & hSearchd, bool bTestMode
 	m_bDisabled = m_sLogPath.IsEmpty();
 
 	m_iRestartSize = hSearchd.GetSize ( "binlog_max_log_size", m_iRestartSize );
+	m_iReplayThreads = Max ( hSearchd.GetInt ( "binlog_replay_threads", sphCpuThreadsCount() ), 1 );
 
 	if ( !m_bDisabled )
 	{
@@ -9587,6 +11857,7 @@ void RtBinlog_c::Replay ( const SmallStringHash_T<CSphIndex*> & hIndexes, DWORD
 		if ( pfnProgressCallback ) // on each replayed binlog
 			pfnProgressCallback();
 	}
+	StopReplayJobs();
 
 	if ( m_dLogFiles.GetLength()>0 )
 	{
@@ -9863,6 +12134,11 @@ void RtBinlog_c::CheckDoRestart ()
 		assert ( m_dLogFiles.GetLength() );
 
 		DoCacheWrite();
+
+		// commits waiting for a group sync only get to fsync the new log
+		if ( m_eOnCommit==ACTION_FSYNC )
+			m_tWriter.Flush();
+
 		m_tWriter.CloseFile();
 		OpenNewLog();
 	}
@@ -9873,16 +12149,9 @@ void RtBinlog_c::CheckDoFlush ()
 	if ( m_eOnCommit==ACTION_NONE )
 		return;
 
+	// fsync is up to the committers, see WaitSynced()
 	if ( m_eOnCommit==ACTION_WRITE && m_tWriter.HasUnwrittenData() )
 		m_tWriter.Write();
-
-	if ( m_eOnCommit==ACTION_FSYNC && m_tWriter.HasUnsyncedData() )
-	{
-		if ( m_tWriter.HasUnwrittenData() )
-			m_tWriter.Write();
-
-		m_tWriter.Fsync();
-	}
 }
 
 int RtBinlog_c::ReplayBinlog ( const SmallStringHash_T<CSphIndex*> & hIndexes, DWORD uReplayFlags, int iBinlog )
@@ -9897,6 +12166,7 @@ int RtBinlog_c::ReplayBinlog ( const SmallStringHash_T<CSphIndex*> & hIndexes, D
 	sphInfo ( "binlog: replaying log %s", sLog.cstr() );
 
 	BinlogReader_c tReader;
+	tReader.SetBuffers ( BINLOG_READ_BUFFER, BINLOG_READ_BUFFER );
 	if ( !tReader.Open ( sLog, sError ) )
 	{
 		if ( ( uReplayFlags & SPH_REPLAY_IGNORE_OPEN_ERROR )!=0 )
@@ -9940,6 +12210,7 @@ int RtBinlog_c::ReplayBinlog ( const SmallStringHash_T<CSphIndex*> & hIndexes, D
 
 	m_iReplayedRows = 0;
 	int64_t tmReplay = sphMicroTimer();
+	int64_t tmReport = tmReplay + BINLOG_REPLAY_REPORT;
 
 	while ( iFileSize!=tReader.GetPos() && !tReader.GetErrorFlag() && bReplayOK )
 	{
@@ -9956,6 +12227,10 @@ int RtBinlog_c::ReplayBinlog ( const SmallStringHash_T<CSphIndex*> & hIndexes, D
 		if ( uOp<=0 || uOp>=BLOP_TOTAL )
 			sphDie ( "binlog: unexpected entry (blop=" UINT64_FMT ", pos=" INT64_FMT ")", uOp, iPos );
 
+		// commits get applied in the background; anything else must see them all applied
+		if ( uOp==BLOP_UPDATE_ATTRS || uOp==BLOP_RECONFIGURE || uOp==BLOP_ADD_CHUNK )
+			DrainReplayJobs();
+
 		// FIXME! blop might be OK but skipped (eg. index that is no longer)
 		switch ( uOp )
 		{
@@ -9982,14 +12257,30 @@ int RtBinlog_c::ReplayBinlog ( const SmallStringHash_T<CSphIndex*> & hIndexes, D
 				bReplayOK = ReplayReconfigure ( iBinlog, uReplayFlags, tReader );
 				break;
 
+			case BLOP_ADD_CHUNK:
+				bReplayOK = ReplayAddChunk ( iBinlog, uReplayFlags, tReader );
+				break;
+
 			default:
 				sphDie ( "binlog: internal error, unhandled entry (blop=%d)", (int)uOp );
 		}
 
+		// those might have bumped the index tids, too
+		if ( uOp==BLOP_UPDATE_ATTRS || uOp==BLOP_RECONFIGURE || uOp==BLOP_ADD_CHUNK )
+			SyncReplayJobs();
+
 		dTotal [ uOp ] += bReplayOK ? 1 : 0;
 		dTotal [ BLOP_TOTAL ]++;
+
+		if ( sphMicroTimer()>tmReport )
+		{
+			tmReport = sphMicroTimer() + BINLOG_REPLAY_REPORT;
+			sphInfo ( "binlog: replaying %s: %d%% done, %d rows in %d commits so far",
+				sLog.cstr(), (int)( tReader.GetPos()*100/iFileSize ), m_iReplayedRows, dTotal[BLOP_COMMIT] );
+		}
 	}
 
+	DrainReplayJobs();
 	tmReplay = sphMicroTimer() - tmReplay;
 
 	if ( tReader.GetErrorFlag() )
@@ -10019,8 +12310,8 @@ int RtBinlog_c::ReplayBinlog ( const SmallStringHash_T<CSphIndex*> & hIndexes, D
 		}
 	}
 
-	sphInfo ( "binlog: replay stats: %d rows in %d commits; %d updates, %d reconfigure; %d indexes",
-		m_iReplayedRows, dTotal[BLOP_COMMIT], dTotal[BLOP_UPDATE_ATTRS], dTotal[BLOP_RECONFIGURE], dTotal[BLOP_ADD_INDEX] );
+	sphInfo ( "binlog: replay stats: %d rows in %d commits; %d updates, %d reconfigure, %d bulk chunks; %d indexes",
+		m_iReplayedRows, dTotal[BLOP_COMMIT], dTotal[BLOP_UPDATE_ATTRS], dTotal[BLOP_RECONFIGURE], dTotal[BLOP_ADD_CHUNK], dTotal[BLOP_ADD_INDEX] );
 	sphInfo ( "binlog: finished replaying %s; %d.%d MB in %d.%03d sec",
 		sLog.cstr(),
 		(int)(iFileSize/1048576), (int)((iFileSize*10/1048576)%10),
@@ -10033,6 +12324,194 @@ int RtBinlog_c::ReplayBinlog ( const SmallStringHash_T<CSphIndex*> & hIndexes, D
 }
 
 
+/// max commits queued per index before the reader waits for the applier
+static const int RT_REPLAY_QUEUE = 64;
+
+RtReplayWorkers_t::RtReplayWorkers_t ()
+	: m_bShutdown ( false )
+{
+	m_tWork.Init ( &m_tLock );
+	m_tDone.Init ( &m_tLock );
+}
+
+
+RtReplayWorkers_t::~RtReplayWorkers_t ()
+{
+	// workers pass the shutdown on to each other, see ThreadFunc
+	Verify ( m_tLock.Lock() );
+	m_bShutdown = true;
+	m_tWork.SetEvent();
+	Verify ( m_tLock.Unlock() );
+
+	ARRAY_FOREACH ( i, m_dThreads )
+		sphThreadJoin ( &m_dThreads[i] );
+
+	assert ( !m_dRunnable.GetLength() );
+	m_tWork.Done();
+	m_tDone.Done();
+}
+
+
+bool RtReplayWorkers_t::AddWorker ()
+{
+	if ( sphThreadCreate ( &m_dThreads.Add(), ThreadFunc, this ) )
+		return true;
+
+	m_dThreads.Pop();
+	return false;
+}
+
+
+void RtReplayWorkers_t::ThreadFunc ( void * pArg )
+{
+	RtReplayWorkers_t * pWorkers = (RtReplayWorkers_t *) pArg;
+	CSphVector<RtReplayTxn_t *> dTxns;
+
+	for ( ;; )
+	{
+		Verify ( pWorkers->m_tLock.Lock() );
+		RtReplayJob_t * pJob = NULL;
+		if ( pWorkers->m_dRunnable.GetLength() )
+		{
+			pJob = pWorkers->m_dRunnable[0];
+			pWorkers->m_dRunnable.Remove ( 0 );
+			dTxns.SwapData ( pJob->m_dQueue );
+		}
+
+		// the event wakes a single worker, so pass it on while there is more to do, or to shut them all down
+		bool bShutdown = pWorkers->m_bShutdown;
+		if ( pWorkers->m_dRunnable.GetLength() || ( !pJob && bShutdown ) )
+			pWorkers->m_tWork.SetEvent();
+		Verify ( pWorkers->m_tLock.Unlock() );
+
+		if ( !pJob )
+		{
+			if ( bShutdown )
+				break;
+			pWorkers->m_tWork.WaitEvent();
+			continue;
+		}
+
+		// everything queued so far goes in one go, so that commits could be batched
+		pJob->m_pRT->ReplayCommits ( dTxns );
+		ARRAY_FOREACH ( i, dTxns )
+			SafeDelete ( dTxns[i] );
+		dTxns.Resize ( 0 );
+
+		// commits queued meanwhile go to the back of the line, so that one busy index does not hog a worker
+		Verify ( pWorkers->m_tLock.Lock() );
+		if ( pJob->m_dQueue.GetLength() )
+			pWorkers->m_dRunnable.Add ( pJob );
+		else
+			pJob->m_bBusy = false;
+		pWorkers->m_tDone.SetEvent();
+		Verify ( pWorkers->m_tLock.Unlock() );
+	}
+}
+
+
+RtReplayJob_t::RtReplayJob_t ( RtIndex_t * pRT, RtReplayWorkers_t * pWorkers )
+	: m_pRT ( pRT )
+	, m_iTID ( pRT->m_iTID )
+	, m_pWorkers ( pWorkers )
+	, m_bBusy ( false )
+{}
+
+
+RtReplayJob_t::~RtReplayJob_t ()
+{
+	assert ( !m_dQueue.GetLength() && !m_bBusy );
+}
+
+
+void RtReplayJob_t::Push ( RtReplayTxn_t * pTxn )
+{
+	if ( !m_pWorkers )
+	{
+		CSphVector<RtReplayTxn_t *> dTxns;
+		dTxns.Add ( pTxn );
+		m_pRT->ReplayCommits ( dTxns );
+		SafeDelete ( pTxn );
+		return;
+	}
+
+	// do not let the reader run too far ahead
+	Wait ( RT_REPLAY_QUEUE-1 );
+
+	Verify ( m_pWorkers->m_tLock.Lock() );
+	m_dQueue.Add ( pTxn );
+	if ( !m_bBusy )
+	{
+		m_bBusy = true;
+		m_pWorkers->m_dRunnable.Add ( this );
+		m_pWorkers->m_tWork.SetEvent();
+	}
+	Verify ( m_pWorkers->m_tLock.Unlock() );
+}
+
+
+/// wait until at most iQueued commits are pending; zero means until everything is applied
+void RtReplayJob_t::Wait ( int iQueued )
+{
+	if ( !m_pWorkers )
+		return;
+
+	for ( ;; )
+	{
+		Verify ( m_pWorkers->m_tLock.Lock() );
+		bool bReady = ( m_dQueue.GetLength()<=iQueued && ( iQueued>0 || !m_bBusy ) );
+		Verify ( m_pWorkers->m_tLock.Unlock() );
+		if ( bReady )
+			return;
+		m_pWorkers->m_tDone.WaitEvent();
+	}
+}
+
+
+RtReplayJob_t * RtBinlog_c::GetReplayJob ( RtIndex_t * pRT ) const
+{
+	ARRAY_FOREACH ( i, m_dReplayJobs )
+		if ( m_dReplayJobs[i]->m_pRT==pRT )
+			return m_dReplayJobs[i];
+
+	// a worker per replayed index, up to binlog_replay_threads of them; the rest of the indexes queue up
+	if ( !m_pReplayWorkers )
+		m_pReplayWorkers = new RtReplayWorkers_t();
+	if ( m_pReplayWorkers->m_dThreads.GetLength()<m_iReplayThreads && !m_pReplayWorkers->AddWorker()
+		&& !m_pReplayWorkers->m_dThreads.GetLength() )
+		sphWarning ( "binlog: failed to create replay thread, replaying index %s inline", pRT->GetName() );
+
+	m_dReplayJobs.Add ( new RtReplayJob_t ( pRT, m_pReplayWorkers->m_dThreads.GetLength() ? m_pReplayWorkers : NULL ) );
+	return m_dReplayJobs.Last();
+}
+
+
+/// wait for all the queued commits to get applied
+void RtBinlog_c::DrainReplayJobs () const
+{
+	ARRAY_FOREACH ( i, m_dReplayJobs )
+		m_dReplayJobs[i]->Wait ( 0 );
+}
+
+
+/// pick up the index tids that non-commit ops might have changed; expects drained jobs
+void RtBinlog_c::SyncReplayJobs () const
+{
+	ARRAY_FOREACH ( i, m_dReplayJobs )
+		m_dReplayJobs[i]->m_iTID = m_dReplayJobs[i]->m_pRT->m_iTID;
+}
+
+
+void RtBinlog_c::StopReplayJobs ()
+{
+	DrainReplayJobs();
+	ARRAY_FOREACH ( i, m_dReplayJobs )
+		SafeDelete ( m_dReplayJobs[i] );
+	m_dReplayJobs.Reset();
+	SafeDelete ( m_pReplayWorkers );
+}
+
+
 static BinlogIndexInfo_t & ReplayIndexID ( BinlogReader_c & tReader, BinlogFileDesc_t & tLog, const char * sPlace )
 {
 	const int64_t iTxnPos = tReader.GetPos();
@@ -10106,28 +12585,23 @@ bool RtBinlog_c::ReplayCommit ( int iBinlog, DWORD uReplayFlags, BinlogReader_c
 	}
 
 	// only replay transaction when index exists and does not have it yet (based on TID)
-	if ( tIndex.m_pRT && iTID > tIndex.m_pRT->m_iTID )
+	// the replay workers cook checkpoints and infixes for dict=keywords, and commit
+	RtReplayJob_t * pJob = tIndex.m_pRT ? GetReplayJob ( tIndex.m_pRT ) : NULL;
+	if ( pJob && iTID > pJob->m_iTID )
 	{
 		// we normally expect per-index TIDs to be sequential
 		// but let's be graceful about that
-		if ( iTID!=tIndex.m_pRT->m_iTID+1 )
+		if ( iTID!=pJob->m_iTID+1 )
 			sphWarning ( "binlog: commit: unexpected tid (index=%s, indextid=" INT64_FMT ", logtid=" INT64_FMT ", pos=" INT64_FMT ")",
-				tIndex.m_sName.cstr(), tIndex.m_pRT->m_iTID, iTID, iTxnPos );
-
-		// in case dict=keywords
-		// + cook checkpoint
-		// + build infixes
-		if ( tIndex.m_pRT->IsWordDict() && pSeg.Ptr() )
-		{
-			FixupSegmentCheckpoints ( pSeg.Ptr() );
-			tIndex.m_pRT->BuildSegmentInfixes ( pSeg.Ptr(), tIndex.m_pRT->GetDictionary()->HasMorphology() );
-		}
+				tIndex.m_sName.cstr(), pJob->m_iTID, iTID, iTxnPos );
 
-		// actually replay
-		tIndex.m_pRT->CommitReplayable ( pSeg.LeakPtr(), dKlist, NULL );
+		RtReplayTxn_t * pTxn = new RtReplayTxn_t();
+		pTxn->m_pSeg = pSeg.LeakPtr();
+		pTxn->m_dKlist.SwapData ( dKlist );
+		pTxn->m_iTID = iTID;
 
-		// update committed tid on replay in case of unexpected / mismatched tid
-		tIndex.m_pRT->m_iTID = iTID;
+		pJob->m_iTID = iTID;
+		pJob->Push ( pTxn );
 	}
 
 	// update info
@@ -10385,6 +12859,70 @@ bool RtBinlog_c::ReplayReconfigure ( int iBinlog, DWORD uReplayFlags, BinlogRead
 	return true;
 }
 
+bool RtBinlog_c::ReplayAddChunk ( int iBinlog, DWORD uReplayFlags, BinlogReader_c & tReader ) const
+{
+	// load and lookup index
+	const int64_t iTxnPos = tReader.GetPos();
+	BinlogFileDesc_t & tLog = m_dLogFiles[iBinlog];
+	BinlogIndexInfo_t & tIndex = ReplayIndexID ( tReader, tLog, "add chunk" );
+
+	// load transaction data
+	const int64_t iTID = (int64_t) tReader.UnzipOffset();
+	const int64_t tmStamp = (int64_t) tReader.UnzipOffset();
+	const int iChunk = (int) tReader.UnzipOffset();
+	const int64_t iDocs = (int64_t) tReader.UnzipOffset();
+
+	// checksum
+	if ( tReader.GetErrorFlag() || !tReader.CheckCrc ( "add chunk", tIndex.m_sName.cstr(), iTID, iTxnPos ) )
+		return false;
+
+	// check TID
+	if ( iTID<tIndex.m_iMaxTID )
+		sphDie ( "binlog: add chunk: descending tid (index=%s, lasttid=" INT64_FMT ", logtid=" INT64_FMT ", pos=" INT64_FMT ")",
+			tIndex.m_sName.cstr(), tIndex.m_iMaxTID, iTID, iTxnPos );
+
+	// check timestamp
+	if ( tmStamp<tIndex.m_tmMax )
+	{
+		if (!( uReplayFlags & SPH_REPLAY_ACCEPT_DESC_TIMESTAMP ))
+			sphDie ( "binlog: add chunk: descending time (index=%s, lasttime=" INT64_FMT ", logtime=" INT64_FMT ", pos=" INT64_FMT ")",
+				tIndex.m_sName.cstr(), tIndex.m_tmMax, tmStamp, iTxnPos );
+
+		sphWarning ( "binlog: add chunk: replaying txn despite descending time "
+			"(index=%s, logtid=" INT64_FMT ", lasttime=" INT64_FMT ", logtime=" INT64_FMT ", pos=" INT64_FMT ")",
+			tIndex.m_sName.cstr(), iTID, tIndex.m_tmMax, tmStamp, iTxnPos );
+		tIndex.m_tmMax = tmStamp;
+	}
+
+	// only replay transaction when index exists and does not have it yet (based on TID)
+	// the chunk itself was fully written before it got logged, so it only might be missing from the meta
+	if ( tIndex.m_pRT && iTID > tIndex.m_pRT->m_iTID )
+	{
+		// we normally expect per-index TIDs to be sequential
+		// but let's be graceful about that
+		if ( iTID!=tIndex.m_pRT->m_iTID+1 )
+			sphWarning ( "binlog: add chunk: unexpected tid (index=%s, indextid=" INT64_FMT ", logtid=" INT64_FMT ", pos=" INT64_FMT ")",
+				tIndex.m_sName.cstr(), tIndex.m_pRT->m_iTID, iTID, iTxnPos );
+
+		// the chunk got synced before it got logged, so it missing means the index lost data
+		CSphString sError;
+		if ( !tIndex.m_pRT->ReplayBulkChunk ( iChunk, iDocs, iTID, sError ) )
+			sphDie ( "binlog: add chunk: chunk %d lost (index=%s, logtid=" INT64_FMT ", pos=" INT64_FMT ", error=%s)",
+				iChunk, tIndex.m_sName.cstr(), iTID, iTxnPos, sError.cstr() );
+
+		// update committed tid on replay in case of unexpected / mismatched tid
+		tIndex.m_pRT->m_iTID = iTID;
+	}
+
+	// update info
+	tIndex.m_iMinTID = Min ( tIndex.m_iMinTID, iTID );
+	tIndex.m_iMaxTID = Max ( tIndex.m_iMaxTID, iTID );
+	tIndex.m_tmMin = Min ( tIndex.m_tmMin, tmStamp );
+	tIndex.m_tmMax = Max ( tIndex.m_tmMax, tmStamp );
+	return true;
+}
+
+
 void RtBinlog_c::CheckPath ( const CSphConfigSection & hSearchd, bool bTestMode )
 {
 #ifndef DATADIR
@@ -10441,22 +12979,73 @@ void sphRTConfigure ( const CSphConfigSection & hSearchd, bool bTestMode )
 	g_pRtBinlog->Configure ( hSearchd, bTestMode );
 	g_iRtFlushPeriod = hSearchd.GetInt ( "rt_flush_period", (int)g_iRtFlushPeriod );
 	g_iRtFlushPeriod = Max ( g_iRtFlushPeriod, 10 );
+	g_bRtMergeBackground = !bTestMode && hSearchd.GetInt ( "rt_merge_background", 1 )!=0;
+
+	g_iRtInsertThreads = Max ( hSearchd.GetInt ( "rt_insert_threads", 1 ), 1 );
+	if ( g_iRtInsertThreads>1 && !g_pRtInsertPool )
+	{
+#if USE_WINDOWS
+		g_pRtInsertPool = sphThreadPoolCreate ( g_iRtInsertThreads-1 );
+#else
+		char sSemName[24];
+		snprintf ( sSemName, sizeof(sSemName), "/rtinsert%d", (int) getpid() );
+		g_pRtInsertPool = sphThreadPoolCreate ( g_iRtInsertThreads-1, sSemName );
+#endif
+	}
 }
 
 
 void sphRTDone ()
 {
+	if ( g_bRtMergeActive )
+	{
+		Verify ( g_tRtMergeLock.Lock() );
+		g_bRtMergeShutdown = true;
+		g_tRtMergeWork.SetEvent();
+		Verify ( g_tRtMergeLock.Unlock() );
+
+		sphThreadJoin ( &g_tRtMergeThread );
+		g_bRtMergeActive = false;
+		g_tRtMergeWork.Done();
+		g_tRtMergeDone.Done();
+	}
+
+	if ( g_pRtInsertPool )
+	{
+		g_pRtInsertPool->Shutdown();
+		SafeDelete ( g_pRtInsertPool );
+	}
+	g_iRtInsertThreads = 1;
+
 	sphThreadKeyDelete ( g_tTlsAccumKey );
 	// its valid for "searchd --stop" case
 	SafeDelete ( g_pBinlog );
 }
 
 
+void sphGetBinlogStatus ( BinlogStatus_t & tStatus )
+{
+	memset ( &tStatus, 0, sizeof(tStatus) );
+	if ( g_pRtBinlog )
+		g_pRtBinlog->GetStatus ( tStatus );
+}
+
 void sphReplayBinlog ( const SmallStringHash_T<CSphIndex*> & hIndexes, DWORD uReplayFlags, ProgressCallbackSimple_t * pfnProgressCallback )
 {
 	MEMORY ( MEM_BINLOG );
 	g_pRtBinlog->Replay ( hIndexes, uReplayFlags, pfnProgressCallback );
 	g_pRtBinlog->CreateTimerThread();
+
+	// replay merges inline, from here on commits leave it to the merger
+	if ( g_bRtMergeBackground && !g_bRtMergeActive )
+	{
+		g_bRtMergeShutdown = false;
+		g_tRtMergeWork.Init ( &g_tRtMergeLock );
+		g_tRtMergeDone.Init ( &g_tRtMergeLock );
+		g_bRtMergeActive = sphThreadCreate ( &g_tRtMergeThread, RtIndex_t::MergeThreadFunc, NULL );
+		if ( !g_bRtMergeActive )
+			sphWarning ( "failed to create rt merge thread, merging on commit" );
+	}
 	g_bRTChangesAllowed = true;
 }
 
@@ -10543,6 +13132,10 @@ bool sphRTSchemaConfigure ( const CSphConfigSection & hIndex, CSphSchema * pSche
 		}
 	}
 
+	// generated attributes
+	if ( hIndex("json_attrs") && !sphJsonAttrsAddToSchema ( *pSchema, hIndex.GetStr ( "json_attrs" ), false, *pError ) )
+		return false;
+
 	if ( !pSchema->m_dAttrs.GetLength() && !g_bTestMode )
 	{
 		pError->SetSprintf ( "no attribute configured (use rt_attr directive)" );
@@ -23,6 +23,27 @@
 namespace NEO {
 
 	class ISphRtAccum;
+
+	/// a document of a multi-row insert, see AddDocument() for the meaning of the members
+	struct RtInsertDoc_t
+	{
+		const CSphMatch*			m_pDoc;
+		const char**				m_ppFields;
+		const char**				m_ppStr;
+		const CSphVector<DWORD>*	m_pMvas;
+	};
+
+	/// chunk set an RT index reader sees; it stays put whatever the writers do, until the reader goes away
+	class ISphRtReader
+	{
+	public:
+		virtual ~ISphRtReader() {}
+		virtual int GetDiskChunks() const = 0;
+		virtual const CSphIndex* GetDiskChunk(int iChunk) const = 0;
+		virtual int GetRamSegments() const = 0;
+		virtual int GetRamRows() const = 0;
+	};
+
 	/// RAM based updateable backend interface
 	class ISphRtIndex : public CSphIndex
 	{
@@ -36,6 +57,10 @@ namespace NEO {
 		/// fails in case of two open txns to different indexes
 		virtual bool AddDocument(ISphTokenizer* pTokenizer, int iFields, const char** ppFields, const CSphMatch& tDoc, bool bReplace, const CSphString& sTokenFilterOptions, const char** ppStr, const CSphVector<DWORD>& dMvas, CSphString& sError, CSphString& sWarning, ISphRtAccum* pAccExt) = 0;
 
+		/// insert/update a batch of documents in current txn, tokenizing them on up to rt_insert_threads threads
+		/// fails in case of two open txns to different indexes
+		virtual bool AddDocuments(int iFields, const CSphVector<RtInsertDoc_t>& dDocs, bool bReplace, const CSphString& sTokenFilterOptions, CSphString& sError, CSphString& sWarning, ISphRtAccum* pAccExt) = 0;
+
 		/// delete document in current txn
 		/// fails in case of two open txns to different indexes
 		virtual bool DeleteDocument(const SphDocID_t* pDocs, int iDocs, CSphString& sError, ISphRtAccum* pAccExt) = 0;
@@ -43,6 +68,11 @@ namespace NEO {
 		/// commit pending changes
 		virtual void Commit(int* pDeleted, ISphRtAccum* pAccExt) = 0;
 
+		/// commit pending changes straight into new disk chunks, for bulk loads
+		/// small txns get committed as usual
+		/// returns false and drops the txn if the chunks could not be written (see GetLastError())
+		virtual bool BulkCommit(int* pDeleted, ISphRtAccum* pAccExt) = 0;
+
 		/// undo pending changes
 		virtual void RollBack(ISphRtAccum* pAccExt) = 0;
 
@@ -63,6 +93,10 @@ namespace NEO {
 
 		virtual void Optimize(volatile bool* pForceTerminate, ThrottleState_t* pThrottle) = 0;
 
+		/// merge the disk chunks that the automatic compaction policy picks, if any
+		/// returns false if there was nothing to merge
+		virtual bool Compact(volatile bool* pForceTerminate, ThrottleState_t* pThrottle) = 0;
+
 		/// check settings vs current and return back tokenizer and dictionary in case of difference
 		virtual bool IsSameSettings(CSphReconfigureSettings& tSettings, CSphReconfigureSetup& tSetup, CSphString& sError) const = 0;
 
@@ -73,6 +107,9 @@ namespace NEO {
 		/// get disk chunk
 		virtual CSphIndex* GetDiskChunk(int iChunk) = 0;
 
+		/// pin the current chunk set, for callers that read it over several steps
+		virtual ISphRtReader* CreateReader() const = 0;
+
 		virtual ISphRtAccum* CreateAccum(CSphString& sError) = 0;
 
 		// instead of cloning for each AddDocument() call we could just call this method and improve batch inserts speed
@@ -116,6 +153,32 @@ namespace NEO {
 		SPH_REPLAY_IGNORE_OPEN_ERROR = 2
 	};
 
+	/// binlog group commit counters, see SHOW STATUS
+	struct BinlogStatus_t
+	{
+		bool		m_bGroupCommit;		///< binlog_flush=1 and the binlog is enabled
+		int64_t		m_iCommits;			///< txns that waited for a sync
+		int64_t		m_iSyncs;			///< fsync calls issued on behalf of them
+		int64_t		m_iSyncedTxns;		///< txns covered by those fsyncs
+		int64_t		m_iMaxBatch;		///< most txns covered by a single fsync
+		int64_t		m_tmSyncTotal;		///< time spent in fsync, in usec
+		int64_t		m_tmWaitTotal;		///< time committers spent waiting for their sync, in usec
+		int64_t		m_tmWaitMax;		///< longest such wait, in usec
+	};
+
+	void sphGetBinlogStatus(BinlogStatus_t& tStatus);
+
+	/// disk chunk figures that the automatic compaction looks at
+	struct RtChunkStats_t
+	{
+		int64_t		m_iSize;	///< files size, in bytes
+		int64_t		m_iRows;	///< docinfo rows, or 0 if none are dead
+		int64_t		m_iDead;	///< rows killed by newer chunks
+	};
+
+	/// compaction policy; pick the pair of disk chunks to merge, iDst older than iSrc; false if nothing is due
+	bool sphRtPickCompaction(const CSphVector<RtChunkStats_t>& dChunks, int& iDst, int& iSrc);
+
 	/// replay stored binlog
 	void sphReplayBinlog(const SmallStringHash_T<CSphIndex*>& hIndexes, DWORD uReplayFlags, ProgressCallbackSimple_t* pfnProgressCallback = NULL);
 
@@ -486,6 +486,10 @@ bool sphConfIndex ( const CSphConfigSection & hIndex, CSphIndexSettings & tSetti
 	tSettings.m_iEmbeddedLimit = hIndex.GetSize ( "embedded_limit", 16384 );
 	tSettings.m_bIndexFieldLens = hIndex.GetInt ( "index_field_lengths" )!=0;
 	tSettings.m_sIndexTokenFilter = hIndex.GetStr ( "index_token_filter" );
+	tSettings.m_sStringDictAttrs = hIndex.GetStr ( "string_attr_dict" );
+	tSettings.m_sJsonAttrs = hIndex.GetStr ( "json_attrs" );
+	tSettings.m_sGeoIndex = hIndex.GetStr ( "geo_index" );
+	tSettings.m_sRollups = hIndex.GetStr ( "rollup" );
 
 	// prefix/infix fields
 	CSphString sFields;
@@ -1418,6 +1422,14 @@ void sphConfigureCommon ( const CSphConfig & hConf )
 
 	g_bProgressiveMerge = ( hCommon.GetInt ( "progressive_merge", 1 )!=0 );
 
+	// merges and disk chunk saves split in two at most, attributes and words
+	g_iMergeThreads = Max ( hCommon.GetInt ( "merge_threads", g_iMergeThreads ), 1 );
+	if ( g_iMergeThreads>2 )
+	{
+		sphWarning ( "merge_threads=%d, but merges can only use 2 threads; clamped", g_iMergeThreads );
+		g_iMergeThreads = 2;
+	}
+
 	bool bJsonStrict = false;
 	bool bJsonAutoconvNumbers;
 	bool bJsonKeynamesToLowercase = false;
@@ -33,6 +33,9 @@
 #include "neo/core/die.h"
 #include "neo/core/match_engine.h"
 #include "neo/utility/inline_misc.h"
+#include "neo/core/mva_intersect.h"
+#include "neo/source/json_attrs.h"
+#include "neo/core/geo_dist.h"
 
 
 
@@ -981,26 +984,46 @@ public:
 
 //////////////////////////////////////////////////////////////////////////
 
+/// precompiled JSON path step, either a key or an index
+struct JsonPathStep_t
+{
+	bool		m_bIndex;
+	int			m_iIndex;
+	CSphString	m_sKey;
+	int			m_iKeyLen;
+	DWORD		m_uKeyBloom;
+};
+
+
 /// generic JSON value evaluation
 /// can handle arbitrary stacks of jsoncol.key1.arr2[indexexpr3].key4[keynameexpr5]
 /// m_dArgs holds the expressions that return actual accessors (either keynames or indexes)
 /// m_dRetTypes holds their respective types
+/// when all accessors are constants, the path is resolved once (m_dPath) and the last lookup is memoized
 struct Expr_JsonField_c : public Expr_WithLocator_c
 {
 protected:
 	const BYTE *			m_pStrings;
 	CSphVector<ISphExpr *>	m_dArgs;
 	CSphVector<ESphAttr>	m_dRetTypes;
+	CSphVector<JsonPathStep_t>	m_dPath;
+	bool					m_bConstPath;
+	mutable uint64_t		m_uLastOffset;
+	mutable int64_t			m_iLastValue;
 
 public:
 	/// takes over the expressions
 	Expr_JsonField_c ( const CSphAttrLocator & tLocator, int iLocator, CSphVector<ISphExpr*> & dArgs, CSphVector<ESphAttr> & dRetTypes )
 		: Expr_WithLocator_c ( tLocator, iLocator )
 		, m_pStrings ( NULL )
+		, m_bConstPath ( false )
+		, m_uLastOffset ( 0 )
+		, m_iLastValue ( 0 )
 	{
 		assert ( dArgs.GetLength()==dRetTypes.GetLength() );
 		m_dArgs.SwapData ( dArgs );
 		m_dRetTypes.SwapData ( dRetTypes );
+		CompilePath();
 	}
 
 	~Expr_JsonField_c ()
@@ -1014,8 +1037,10 @@ public:
 		Expr_WithLocator_c::Command ( eCmd, pArg );
 
 		if ( eCmd==SPH_EXPR_SET_STRING_POOL )
+		{
 			m_pStrings = (const BYTE*)pArg;
-		else if ( eCmd==SPH_EXPR_GET_DEPENDENT_COLS && m_iLocator!=-1 )
+			m_uLastOffset = 0;
+		} else if ( eCmd==SPH_EXPR_GET_DEPENDENT_COLS && m_iLocator!=-1 )
 			static_cast < CSphVector<int>* > ( pArg )->Add ( m_iLocator );
 		ARRAY_FOREACH ( i, m_dArgs )
 			if ( m_dArgs[i] )
@@ -1028,8 +1053,11 @@ public:
 		return 0;
 	}
 
-	virtual int64_t DoEval ( ESphJsonType eJson, const BYTE * pVal, const CSphMatch & tMatch ) const
+	virtual int64_t DoEval ( ESphJsonType eJson, const BYTE * pVal, const CSphMatch & tMatch, const BYTE * pRootEnd=NULL ) const
 	{
+		if ( m_bConstPath )
+			return PathEval ( eJson, pVal, pRootEnd );
+
 		int iLen;
 		const BYTE * pStr;
 
@@ -1046,7 +1074,7 @@ public:
 				// if ( m_dArgv[i]->IsStringPtr() ) SafeDeleteArray ( pStr );
 				assert ( !m_dArgs[i]->IsStringPtr() );
 				iLen = m_dArgs[i]->StringEval ( tMatch, &pStr );
-				eJson = sphJsonFindByKey ( eJson, &pVal, (const void *)pStr, iLen, sphJsonKeyMask ( (const char *)pStr, iLen ) );
+				eJson = sphJsonFindByKey ( eJson, &pVal, (const void *)pStr, iLen, sphJsonKeyMask ( (const char *)pStr, iLen ), i ? NULL : pRootEnd );
 				break;
 			case ESphAttr::SPH_ATTR_JSON_FIELD: // handle cases like "json.a [ json.b ]"
 				{
@@ -1061,7 +1089,7 @@ public:
 					case JSON_DOUBLE:	eJson = sphJsonFindByIndex ( eJson, &pVal, (int)sphQW2D ( sphJsonLoadBigint ( &p ) ) ); break;
 					case JSON_STRING:
 						iLen = sphJsonUnpackInt ( &p );
-						eJson = sphJsonFindByKey ( eJson, &pVal, (const void *)p, iLen, sphJsonKeyMask ( (const char *)p, iLen ) );
+						eJson = sphJsonFindByKey ( eJson, &pVal, (const void *)p, iLen, sphJsonKeyMask ( (const char *)p, iLen ), i ? NULL : pRootEnd );
 						break;
 					default:
 						return 0;
@@ -1090,21 +1118,35 @@ public:
 		if ( !uOffset )
 			return 0;
 
+		// same blob as the last time? (repeated evaluations, or deduplicated values)
+		if ( m_bConstPath && uOffset==m_uLastOffset )
+			return m_iLastValue;
+
+		int64_t iValue;
 		if ( m_tLocator.m_bDynamic )
 		{
 			// extends precalculated (aliased) field
 			const BYTE * pVal = m_pStrings + ( uOffset & 0xffffffff );
 			ESphJsonType eJson = (ESphJsonType)( uOffset >> 32 );
-			return DoEval ( eJson, pVal, tMatch );
-		}
+			iValue = DoEval ( eJson, pVal, tMatch );
+		} else
+		{
+			const BYTE * pVal = NULL;
+			int iBlobLen = sphUnpackStr ( m_pStrings + uOffset, &pVal );
+			if ( !pVal )
+				return 0;
 
-		const BYTE * pVal = NULL;
-		sphUnpackStr ( m_pStrings + uOffset, &pVal );
-		if ( !pVal )
-			return 0;
+			const BYTE * pRootEnd = pVal + iBlobLen;
+			ESphJsonType eJson = sphJsonFindFirst ( &pVal );
+			iValue = DoEval ( eJson, pVal, tMatch, pRootEnd );
+		}
 
-		ESphJsonType eJson = sphJsonFindFirst ( &pVal );
-		return DoEval ( eJson, pVal, tMatch );
+		if ( m_bConstPath )
+		{
+			m_uLastOffset = uOffset;
+			m_iLastValue = iValue;
+		}
+		return iValue;
 	}
 
 	virtual uint64_t GetHash ( const ISphSchema & tSorterSchema, uint64_t uPrevHash, bool & bDisable )
@@ -1114,6 +1156,75 @@ public:
 		CALC_CHILD_HASHES(m_dArgs);
 		return CALC_DEP_HASHES();
 	}
+
+protected:
+	/// resolve constant keys and indexes once, along with key bloom masks
+	void CompilePath ()
+	{
+		m_dPath.Reset();
+		m_bConstPath = false;
+
+		CSphMatch tDummy;
+		ARRAY_FOREACH ( i, m_dArgs )
+		{
+			if ( !m_dArgs[i] || !m_dArgs[i]->IsConst() )
+			{
+				m_dPath.Reset();
+				return;
+			}
+
+			JsonPathStep_t & tStep = m_dPath.Add();
+			tStep.m_bIndex = true;
+			tStep.m_iIndex = 0;
+			tStep.m_iKeyLen = 0;
+			tStep.m_uKeyBloom = 0;
+
+			switch ( m_dRetTypes[i] )
+			{
+			case ESphAttr::SPH_ATTR_INTEGER:	tStep.m_iIndex = m_dArgs[i]->IntEval ( tDummy ); break;
+			case ESphAttr::SPH_ATTR_BIGINT:	tStep.m_iIndex = (int)m_dArgs[i]->Int64Eval ( tDummy ); break;
+			case ESphAttr::SPH_ATTR_FLOAT:	tStep.m_iIndex = (int)m_dArgs[i]->Eval ( tDummy ); break;
+			case ESphAttr::SPH_ATTR_STRING:
+				{
+					if ( m_dArgs[i]->IsStringPtr() )
+					{
+						m_dPath.Reset();
+						return;
+					}
+					const BYTE * pStr = NULL;
+					int iLen = m_dArgs[i]->StringEval ( tDummy, &pStr );
+					tStep.m_bIndex = false;
+					tStep.m_sKey.SetBinary ( (const char *)pStr, iLen );
+					tStep.m_iKeyLen = iLen;
+					tStep.m_uKeyBloom = sphJsonKeyMask ( (const char *)pStr, iLen );
+					break;
+				}
+			default:
+				m_dPath.Reset();
+				return;
+			}
+		}
+
+		m_bConstPath = ( m_dPath.GetLength()>0 );
+	}
+
+	int64_t PathEval ( ESphJsonType eJson, const BYTE * pVal, const BYTE * pRootEnd ) const
+	{
+		ARRAY_FOREACH ( i, m_dPath )
+		{
+			const JsonPathStep_t & tStep = m_dPath[i];
+			if ( tStep.m_bIndex )
+				eJson = sphJsonFindByIndex ( eJson, &pVal, tStep.m_iIndex );
+			else
+				eJson = sphJsonFindByKey ( eJson, &pVal, tStep.m_sKey.cstr(), tStep.m_iKeyLen, tStep.m_uKeyBloom, i ? NULL : pRootEnd );
+
+			if ( eJson==JSON_EOF )
+				return 0;
+		}
+
+		int64_t iPacked = ( ( (int64_t)( pVal-m_pStrings ) ) | ( ( (int64_t)eJson )<<32 ) );
+		return iPacked;
+	}
 };
 
 
@@ -1125,12 +1236,16 @@ protected:
 	CSphString		m_sKey;
 	int				m_iKeyLen;
 	DWORD			m_uKeyBloom;
+	mutable DWORD	m_uLastOffset;
+	mutable int64_t	m_iLastValue;
 
 public:
 	/// takes over the expressions
 	Expr_JsonFastKey_c ( const CSphAttrLocator & tLocator, int iLocator, ISphExpr * pArg )
 		: Expr_WithLocator_c ( tLocator, iLocator )
 		, m_pStrings ( NULL )
+		, m_uLastOffset ( 0 )
+		, m_iLastValue ( 0 )
 	{
 		assert ( ( tLocator.m_iBitOffset % ROWITEM_BITS )==0 );
 		assert ( tLocator.m_iBitCount==ROWITEM_BITS );
@@ -1147,7 +1262,10 @@ public:
 		Expr_WithLocator_c::Command ( eCmd, pArg );
 
 		if ( eCmd==SPH_EXPR_SET_STRING_POOL )
+		{
 			m_pStrings = (const BYTE*)pArg;
+			m_uLastOffset = 0;
+		}
 	}
 
 	virtual float Eval ( const CSphMatch & ) const
@@ -1165,20 +1283,29 @@ public:
 			: tMatch.m_pStatic [ m_tLocator.m_iBitOffset >> ROWITEM_SHIFT ];
 		if ( !uOffset )
 			return 0;
+		// same blob as the last time? (repeated evaluations, or deduplicated values)
+		if ( uOffset==m_uLastOffset )
+			return m_iLastValue;
+
 		const BYTE * pJson;
-		sphUnpackStr ( m_pStrings + uOffset, &pJson );
+		int iBlobLen = sphUnpackStr ( m_pStrings + uOffset, &pJson );
+		const BYTE * pRootEnd = pJson + iBlobLen;
 
-		// all root objects start with a Bloom mask; quickly check it
-		if ( ( sphGetDword(pJson) & m_uKeyBloom )!=m_uKeyBloom )
-			return 0;
+		int64_t iPacked = 0;
 
+		// all root objects start with a Bloom mask; quickly check it
 		// OPTIMIZE? FindByKey does an extra (redundant) bloom check inside
-		ESphJsonType eJson = sphJsonFindByKey ( JSON_ROOT, &pJson, m_sKey.cstr(), m_iKeyLen, m_uKeyBloom );
-		if ( eJson==JSON_EOF )
-			return 0;
+		if ( ( sphGetDword(pJson) & m_uKeyBloom )==m_uKeyBloom )
+		{
+			ESphJsonType eJson = sphJsonFindByKey ( JSON_ROOT, &pJson, m_sKey.cstr(), m_iKeyLen, m_uKeyBloom, pRootEnd );
 
-		// keep actual attribute type and offset to data packed
-		int64_t iPacked = ( ( (int64_t)( pJson-m_pStrings ) ) | ( ( (int64_t)eJson )<<32 ) );
+			// keep actual attribute type and offset to data packed
+			if ( eJson!=JSON_EOF )
+				iPacked = ( ( (int64_t)( pJson-m_pStrings ) ) | ( ( (int64_t)eJson )<<32 ) );
+		}
+
+		m_uLastOffset = uOffset;
+		m_iLastValue = iPacked;
 		return iPacked;
 	}
 
@@ -2595,9 +2722,10 @@ struct ExprNode_t
 	};
 	int				m_iLeft;
 	int				m_iRight;
+	int				m_iJsonSrc;	///< original json field node, for attributes generated from json paths
 
 	ExprNode_t () : m_iToken ( 0 ), m_eRetType ( ESphAttr::SPH_ATTR_NONE ), m_eArgType ( ESphAttr::SPH_ATTR_NONE ),
-		m_iLocator ( -1 ), m_iLeft ( -1 ), m_iRight ( -1 ) {}
+		m_iLocator ( -1 ), m_iLeft ( -1 ), m_iRight ( -1 ), m_iJsonSrc ( -1 ) {}
 };
 
 struct StackNode_t
@@ -2661,6 +2789,7 @@ protected:
 	void					AppendToMapArg ( int iNode, const char * sKey, const char * sValue, int64_t iValue );
 	const char *			Attr2Ident ( uint64_t uAttrLoc );
 	int						AddNodeJsonField ( uint64_t uAttrLocator, int iLeft );
+	int						FindJsonAttr ( int iNode );
 	int						AddNodeJsonSubkey ( int64_t iValue );
 	int						AddNodeDotNumber ( int64_t iValue );
 	int						AddNodeIdent ( const char * sKey, int iLeft );
@@ -3882,7 +4011,7 @@ void GeodistInit()
 }
 
 
-inline float GeodistSphereRad ( float lat1, float lon1, float lat2, float lon2 )
+float GeodistSphereRad ( float lat1, float lon1, float lat2, float lon2 )
 {
 	static const double D = 2*6384000;
 	double dlat2 = 0.5*( lat1 - lat2 );
@@ -5045,64 +5174,25 @@ protected:
 template<>
 int Expr_MVAIn_c<false>::MvaEval ( const DWORD * pMva ) const
 {
-	// OPTIMIZE! FIXME! factor out a common function with Filter_MVAValues::Eval()
 	DWORD uLen = *pMva++;
-	const DWORD * pMvaMax = pMva+uLen;
 
 	const int64_t * pFilter = m_pUservar ? m_pUservar->Begin() : m_dValues.Begin();
-	const int64_t * pFilterMax = pFilter + ( m_pUservar ? m_pUservar->GetLength() : m_dValues.GetLength() );
+	int iFilter = m_pUservar ? m_pUservar->GetLength() : m_dValues.GetLength();
 
-	const DWORD * L = pMva;
-	const DWORD * R = pMvaMax - 1;
-	for ( ; pFilter < pFilterMax; pFilter++ )
-	{
-		while ( L<=R )
-		{
-			const DWORD * m = L + (R - L) / 2;
-
-			if ( *pFilter > *m )
-				L = m + 1;
-			else if ( *pFilter < *m )
-				R = m - 1;
-			else
-				return 1;
-		}
-		R = pMvaMax - 1;
-	}
-	return 0;
+	return sphMvaAny ( pMva, (int)uLen, pFilter, iFilter ) ? 1 : 0;
 }
 
 
 template<>
 int Expr_MVAIn_c<true>::MvaEval ( const DWORD * pMva ) const
 {
-	// OPTIMIZE! FIXME! factor out a common function with Filter_MVAValues::Eval()
 	DWORD uLen = *pMva++;
 	assert ( ( uLen%2 )==0 );
-	const DWORD * pMvaMax = pMva+uLen;
 
 	const int64_t * pFilter = m_pUservar ? m_pUservar->Begin() : m_dValues.Begin();
-	const int64_t * pFilterMax = pFilter + ( m_pUservar ? m_pUservar->GetLength() : m_dValues.GetLength() );
-
-	const int64_t * L = (const int64_t *)pMva;
-	const int64_t * R = (const int64_t *)( pMvaMax - 2 );
-	for ( ; pFilter < pFilterMax; pFilter++ )
-	{
-		while ( L<=R )
-		{
-			const int64_t * pVal = L + (R - L) / 2;
-			int64_t iMva = MVA_UPSIZE ( (const DWORD *)pVal );
+	int iFilter = m_pUservar ? m_pUservar->GetLength() : m_dValues.GetLength();
 
-			if ( *pFilter > iMva )
-				L = pVal + 1;
-			else if ( *pFilter < iMva )
-				R = pVal - 1;
-			else
-				return 1;
-		}
-		R = (const int64_t *) ( pMvaMax - 2 );
-	}
-	return 0;
+	return sphMvaAny ( (const int64_t *)pMva, (int)uLen/2, pFilter, iFilter ) ? 1 : 0;
 }
 
 /// LENGTH() evaluator for MVAs
@@ -5591,8 +5681,10 @@ static float Geodist ( GeoFunc_e eFunc, bool bDeg, float lat1, float lon1, float
 class Expr_GeodistAttrConst_c : public ISphExpr
 {
 public:
-	Expr_GeodistAttrConst_c ( Geofunc_fn pFunc, float fOut, CSphAttrLocator tLat, CSphAttrLocator tLon, float fAnchorLat, float fAnchorLon, int iLat, int iLon )
+	Expr_GeodistAttrConst_c ( Geofunc_fn pFunc, bool bDeg, bool bExact, float fOut, CSphAttrLocator tLat, CSphAttrLocator tLon, float fAnchorLat, float fAnchorLon, int iLat, int iLon )
 		: m_pFunc ( pFunc )
+		, m_bDeg ( bDeg )
+		, m_bExact ( bExact )
 		, m_fOut ( fOut )
 		, m_tLat ( tLat )
 		, m_tLon ( tLon )
@@ -5614,6 +5706,22 @@ public:
 			static_cast < CSphVector<int>* > ( pArg )->Add ( m_iLat );
 			static_cast < CSphVector<int>* > ( pArg )->Add ( m_iLon );
 		}
+
+		if ( eCmd==SPH_EXPR_GET_GEODIST )
+		{
+			GeodistInfo_t & tGeo = *static_cast<GeodistInfo_t*> ( pArg );
+			tGeo.m_pExpr = this;
+			tGeo.m_pFunc = m_pFunc;
+			tGeo.m_fOut = m_fOut;
+			tGeo.m_bDeg = m_bDeg;
+			tGeo.m_bExact = m_bExact;
+			tGeo.m_tLat = m_tLat;
+			tGeo.m_tLon = m_tLon;
+			tGeo.m_iLat = m_iLat;
+			tGeo.m_iLon = m_iLon;
+			tGeo.m_fAnchorLat = m_fAnchorLat;
+			tGeo.m_fAnchorLon = m_fAnchorLon;
+		}
 	}
 
 	virtual uint64_t GetHash ( const ISphSchema & tSorterSchema, uint64_t uPrevHash, bool & bDisable )
@@ -5628,6 +5736,8 @@ public:
 
 private:
 	Geofunc_fn		m_pFunc;
+	bool			m_bDeg;
+	bool			m_bExact;
 	float			m_fOut;
 	CSphAttrLocator	m_tLat;
 	CSphAttrLocator	m_tLon;
@@ -6071,7 +6181,7 @@ ISphExpr * ExprParser_t::CreateGeodistNode ( int iArgs )
 		if ( m_dNodes[dArgs[0]].m_iToken==TOK_ATTR_FLOAT && m_dNodes[dArgs[1]].m_iToken==TOK_ATTR_FLOAT )
 		{
 			// attr point
-			return new Expr_GeodistAttrConst_c ( GeodistFn ( eMethod, bDeg ), fOut,
+			return new Expr_GeodistAttrConst_c ( GeodistFn ( eMethod, bDeg ), bDeg, eMethod==GEO_HAVERSINE, fOut,
 				m_dNodes[dArgs[0]].m_tLocator, m_dNodes[dArgs[1]].m_tLocator,
 				FloatVal ( &m_dNodes[dArgs[2]] ), FloatVal ( &m_dNodes[dArgs[3]] ),
 				m_dNodes[dArgs[0]].m_iLocator, m_dNodes[dArgs[1]].m_iLocator );
@@ -6330,6 +6440,10 @@ int ExprParser_t::AddNodeWeight ()
 
 int ExprParser_t::AddNodeOp ( int iOp, int iLeft, int iRight )
 {
+	// generated attributes store missing values as zeroes, so null checks must still look at json
+	if ( ( iOp==TOK_IS_NULL || iOp==TOK_IS_NOT_NULL ) && iLeft>=0 && m_dNodes[iLeft].m_iJsonSrc>=0 )
+		iLeft = m_dNodes[iLeft].m_iJsonSrc;
+
 	ExprNode_t & tNode = m_dNodes.Add ();
 	tNode.m_iToken = iOp;
 
@@ -6963,7 +7077,50 @@ int ExprParser_t::AddNodeJsonField ( uint64_t uAttrLocator, int iLeft )
 {
 	int iNode = AddNodeAttr ( TOK_ATTR_JSON, uAttrLocator );
 	m_dNodes[iNode].m_iLeft = iLeft;
-	return m_dNodes.GetLength()-1;
+
+	int iGenerated = FindJsonAttr ( iNode );
+	if ( iGenerated<0 )
+		return iNode;
+
+	// constant path that was materialized at indexing time; read the generated attribute instead
+	const CSphColumnInfo & tCol = m_pSchema->GetAttr ( iGenerated );
+	int iToken = TOK_ATTR_INT;
+	if ( tCol.m_eAttrType==ESphAttr::SPH_ATTR_FLOAT )
+		iToken = TOK_ATTR_FLOAT;
+	else if ( tCol.m_tLocator.IsBitfield() )
+		iToken = TOK_ATTR_BITS;
+
+	int iAttr = AddNodeAttr ( iToken, sphPackAttrLocator ( tCol.m_tLocator, iGenerated ) );
+	m_dNodes[iAttr].m_iJsonSrc = iNode;
+	return iAttr;
+}
+
+
+/// check if a json field node is a constant path that has a generated attribute; returns its index or -1
+int ExprParser_t::FindJsonAttr ( int iNode )
+{
+	const ExprNode_t & tNode = m_dNodes[iNode];
+	if ( tNode.m_tLocator.m_bDynamic || tNode.m_iLeft<0 || tNode.m_iLocator<0 )
+		return -1;
+
+	CSphString sPath = m_pSchema->GetAttr ( tNode.m_iLocator ).m_sName;
+	CSphVector<int> dArgs;
+	GatherArgNodes ( tNode.m_iLeft, dArgs );
+	ARRAY_FOREACH ( i, dArgs )
+	{
+		const ExprNode_t & tArg = m_dNodes[dArgs[i]];
+		if ( tArg.m_iToken==TOK_SUBKEY )
+		{
+			CSphString sKey;
+			sKey.SetBinary ( m_sExpr+(int)( tArg.m_iConst>>32 ), (int)( tArg.m_iConst & 0xffffffffUL ) );
+			sPath.SetSprintf ( "%s.%s", sPath.cstr(), sKey.cstr() );
+		} else if ( tArg.m_iToken==TOK_CONST_INT && tArg.m_iConst>=0 )
+			sPath.SetSprintf ( "%s[" INT64_FMT "]", sPath.cstr(), tArg.m_iConst );
+		else
+			return -1;
+	}
+
+	return sphJsonAttrFind ( *m_pSchema, sPath.cstr() );
 }
 
 
@@ -200,6 +200,9 @@ namespace NEO {
 
 		virtual void			ResetKeywords() = 0;
 
+		/// add an already processed keyword as is
+		virtual SphWordID_t		AddKeyword(const BYTE* pWord) = 0;
+
 		virtual const char* GetLastWarning() const = 0;
 		virtual void			ResetWarning() = 0;
 	};
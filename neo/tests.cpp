@@ -2355,10 +2355,12 @@ static void DeleteIndexFiles ( const char * sIndex )
 		return;
 
 	const char * sExts[] = {
-		"kill", "lock", "meta", "ram",
-		"0.spa", "0.spd", "0.spe", "0.sph",
-		"0.spi", "0.spk", "0.spm", "0.spp",
-		"0.sps" };
+		"kill", "lock", "meta", "ram" };
+
+	const char * sChunkExts[] = {
+		"spa", "spd", "spe", "sph",
+		"spi", "spk", "spm", "spp",
+		"sps" };
 
 	CSphString sName;
 	for ( int i=0; i<(int)(sizeof(sExts)/sizeof(sExts[0])); i++ )
@@ -2366,6 +2368,14 @@ static void DeleteIndexFiles ( const char * sIndex )
 		sName.SetSprintf ( "%s.%s", sIndex, sExts[i] );
 		unlink ( sName.cstr() );
 	}
+
+	// the tests make a few disk chunks at most
+	for ( int iChunk=0; iChunk<8; iChunk++ )
+		for ( int i=0; i<(int)(sizeof(sChunkExts)/sizeof(sChunkExts[0])); i++ )
+		{
+			sName.SetSprintf ( "%s.%d.%s", sIndex, iChunk, sChunkExts[i] );
+			unlink ( sName.cstr() );
+		}
 }
 
 
@@ -4178,7 +4188,2233 @@ void TestTDigest()
 }
 
 
+void TestStringDict()
+{
+	printf ( "testing string attribute dictionary... " );
+
+	const char * dValues[] = { "pear", "apple", "Apple", "pear", "banana", "apple", "", "cherry" };
+	const int iValues = sizeof(dValues)/sizeof(dValues[0]);
+
+	CSphStringDictBuilder tBuilder;
+	DWORD dIds[iValues];
+	for ( int i=0; i<iValues; i++ )
+		dIds[i] = tBuilder.Add ( (const BYTE*)dValues[i], strlen ( dValues[i] ) );
+
+	Verify ( tBuilder.GetLength()==5 );
+	Verify ( dIds[0]==dIds[3] && dIds[1]==dIds[5] && dIds[1]!=dIds[2] );
+	Verify ( dIds[6]==0 );
+
+	const CSphString sTmpDict = "__stringdict.tmp";
+	CSphString sError;
+	CSphVector<DWORD> dRemap;
+	DWORD uEnd = 0;
+	{
+		CSphWriter tWriter;
+		Verify ( tWriter.OpenFile ( sTmpDict, sError ) );
+		tWriter.PutByte ( 0 ); // magic zero offset
+		Verify ( tBuilder.Save ( tWriter, dRemap, uEnd, sError ) );
+	}
+
+	CSphVector<BYTE> dPool ( uEnd );
+	FILE * fp = fopen ( sTmpDict.cstr(), "rb" );
+	Verify ( fp && fread ( dPool.Begin(), 1, uEnd, fp )==uEnd );
+	fclose ( fp );
+	unlink ( sTmpDict.cstr() );
+
+	CSphStringDict tDict;
+	Verify ( tDict.Setup ( dPool.Begin(), uEnd, sError ) );
+	Verify ( tDict.GetLength()==5 );
+
+	// codes preserve bytewise order
+	for ( int i=0; i<iValues; i++ )
+		for ( int j=0; j<iValues; j++ )
+		{
+			if ( !dIds[i] || !dIds[j] )
+				continue;
+			int iCmp = strcmp ( dValues[i], dValues[j] );
+			DWORD a = dRemap[dIds[i]], b = dRemap[dIds[j]];
+			Verify ( tDict.Contains(a) && tDict.Contains(b) );
+			Verify ( ( iCmp<0 && a<b ) || ( iCmp==0 && a==b ) || ( iCmp>0 && a>b ) );
+		}
+
+	CSphVector<SphAttr_t> dHits;
+	tDict.FindMatching ( (const BYTE*)"apple", 5, sphCollateBinary, dHits );
+	Verify ( dHits.GetLength()==1 && dHits[0]==dRemap[dIds[1]] );
+	tDict.FindMatching ( (const BYTE*)"apple", 5, sphCollateLibcCI, dHits );
+	Verify ( dHits.GetLength()==2 );
+	tDict.FindMatching ( (const BYTE*)"grape", 5, sphCollateBinary, dHits );
+	Verify ( dHits.GetLength()==0 );
+
+	printf ( "ok\n" );
+}
+
+
+void TestMvaPack()
+{
+	printf ( "testing MVA packing and intersections... " );
+
+	CSphVector<DWORD> dMva;
+	CSphVector<BYTE> dPacked;
+	CSphVector<DWORD> dUnpacked;
+
+	// short and long lists, sorted and not, 32 and 64 bit
+	const int dLens[] = { 0, 1, 5, 8, 9, 129, 300 };
+	for ( int iMva64=0; iMva64<2; iMva64++ )
+		for ( int iLen=0; iLen<(int)(sizeof(dLens)/sizeof(dLens[0])); iLen++ )
+			for ( int iSorted=0; iSorted<2; iSorted++ )
+	{
+		int iValues = dLens[iLen];
+		dMva.Resize ( 0 );
+		dMva.Add ( iMva64 ? iValues*2 : iValues );
+		int64_t iValue = iMva64 ? -(int64_t)U64C(5000000000) : 3;
+		for ( int i=0; i<iValues; i++ )
+		{
+			iValue = iSorted ? iValue + 1 + ( i*7919 ) % 1000 : sphRand();
+			dMva.Add ( DWORD ( iValue ) );
+			if ( iMva64 )
+				dMva.Add ( DWORD ( uint64_t(iValue)>>32 ) );
+		}
+
+		dPacked.Resize ( 0 );
+		sphPackMva ( dMva.Begin(), iMva64!=0, dPacked );
+		dPacked.Add ( 0xAB ); // guard
+
+		Verify ( sphPackedMvaLength ( dPacked.Begin() )==dMva.GetLength() );
+		dUnpacked.Resize ( dMva.GetLength() );
+		const BYTE * pEnd = sphUnpackMva ( dPacked.Begin(), iMva64!=0, dUnpacked.Begin() );
+		Verify ( pEnd==dPacked.Begin()+dPacked.GetLength()-1 );
+		Verify ( memcmp ( dUnpacked.Begin(), dMva.Begin(), dMva.GetLength()*sizeof(DWORD) )==0 );
+	}
+
+	// any/all against a linear reference, over both merge and gallop paths
+	DWORD dList[200];
+	for ( int i=0; i<200; i++ )
+		dList[i] = i*3;
+
+	CSphVector<SphAttr_t> dValues;
+	for ( int iList=1; iList<=200; iList*=3 )
+		for ( int iSet=1; iSet<=400; iSet*=4 )
+	{
+		dValues.Resize ( 0 );
+		for ( int i=0; i<iSet; i++ )
+			dValues.Add ( i*5+1 );
+
+		bool bAny = false, bAll = true;
+		for ( int i=0; i<iList; i++ )
+		{
+			bool bFound = dValues.BinarySearch ( dList[i] )!=NULL;
+			bAny |= bFound;
+			bAll &= bFound;
+		}
+
+		Verify ( sphMvaAny ( dList, iList, dValues.Begin(), iSet )==bAny );
+		Verify ( sphMvaAll ( dList, iList, dValues.Begin(), iSet )==bAll );
+	}
+
+	// short lists against a few values, the SIMD paths where the target has them; list values repeat,
+	// and a value past the dword range must not match its truncated self
+	const DWORD dShort[] = { 2, 2, 5, 7, 7, 7, 9, 9, 9, 9, 9 };
+	const SphAttr_t dPick[] = { -1, 2, 5, 7, 9, (SphAttr_t)U64C(0x100000002) };
+	const int iPicks = sizeof(dPick)/sizeof(dPick[0]);
+	for ( int iMask=1; iMask<( 1<<iPicks ); iMask++ )
+	{
+		dValues.Resize ( 0 );
+		for ( int i=0; i<iPicks; i++ )
+			if ( iMask & ( 1<<i ) )
+				dValues.Add ( dPick[i] );
+		if ( dValues.GetLength()>MVA_SIMD_MAX_VALUES )
+			continue;
+
+		for ( int iList=1; iList<=(int)(sizeof(dShort)/sizeof(dShort[0])); iList++ )
+		{
+			bool bAny = false, bAll = true;
+			for ( int i=0; i<iList; i++ )
+			{
+				bool bFound = false;
+				ARRAY_FOREACH ( j, dValues )
+					bFound |= ( dValues[j]==(SphAttr_t)dShort[i] );
+				bAny |= bFound;
+				bAll &= bFound;
+			}
+
+			Verify ( sphMvaAny ( dShort, iList, dValues.Begin(), dValues.GetLength() )==bAny );
+			Verify ( sphMvaAll ( dShort, iList, dValues.Begin(), dValues.GetLength() )==bAll );
+		}
+	}
+
+	int64_t dList64[] = { -10, 5, U64C(0x100000000) };
+	SphAttr_t dSet64[] = { 5, 7 };
+	Verify ( sphMvaAny ( dList64, 3, dSet64, 2 ) );
+	Verify ( !sphMvaAll ( dList64, 3, dSet64, 2 ) );
+	Verify ( sphMvaAll ( dList64+1, 1, dSet64, 2 ) );
+
+	printf ( "ok\n" );
+}
+
+void TestJsonKeyTable()
+{
+	printf ( "testing JSON key tables... " );
+
+	// root and nested objects large enough to get a key table, and a small one without
+	CSphString sJson = "{";
+	for ( int i=0; i<12; i++ )
+		sJson.SetSprintf ( "%s\"key%d\":%d,", sJson.cstr(), i, i*10 );
+	sJson.SetSprintf ( "%s\"obj\":{", sJson.cstr() );
+	for ( int i=0; i<10; i++ )
+		sJson.SetSprintf ( "%s\"n%d\":%d,", sJson.cstr(), i, i );
+	sJson.SetSprintf ( "%s\"last\":1},\"small\":{\"a\":1},\"key3\":777}", sJson.cstr() );
+
+	CSphVector<char> dSrc ( sJson.Length()+2 );
+	memcpy ( dSrc.Begin(), sJson.cstr(), sJson.Length() );
+	dSrc[sJson.Length()] = '\0';
+	dSrc[sJson.Length()+1] = '\0';
+
+	CSphVector<BYTE> dBlob;
+	CSphString sError;
+	Verify ( sphJsonParse ( dBlob, dSrc.Begin(), false, false, sError ) );
+
+	const BYTE * pRootEnd = dBlob.Begin() + dBlob.GetLength();
+	Verify ( sphJsonKeyTableSize ( pRootEnd )>0 );
+
+	CSphString sKey;
+	for ( int i=0; i<12; i++ )
+	{
+		sKey.SetSprintf ( "key%d", i );
+		const BYTE * p = dBlob.Begin();
+		ESphJsonType eType = sphJsonFindByKey ( JSON_ROOT, &p, sKey.cstr(), sKey.Length(), sphJsonKeyMask ( sKey.cstr(), sKey.Length() ), pRootEnd );
+		Verify ( eType==JSON_INT32 );
+		Verify ( sphJsonLoadInt ( &p )==i*10 ); // duplicate key3 resolves to the first occurrence
+	}
+
+	const BYTE * pObj = dBlob.Begin();
+	Verify ( sphJsonFindByKey ( JSON_ROOT, &pObj, "obj", 3, sphJsonKeyMask ( "obj", 3 ), pRootEnd )==JSON_OBJECT );
+	for ( int i=0; i<10; i++ )
+	{
+		sKey.SetSprintf ( "n%d", i );
+		const BYTE * p = pObj;
+		Verify ( sphJsonFindByKey ( JSON_OBJECT, &p, sKey.cstr(), sKey.Length(), sphJsonKeyMask ( sKey.cstr(), sKey.Length() ) )==JSON_INT32 );
+		Verify ( sphJsonLoadInt ( &p )==i );
+	}
+
+	const BYTE * p = pObj;
+	Verify ( sphJsonFindByKey ( JSON_OBJECT, &p, "n10", 3, sphJsonKeyMask ( "n10", 3 ) )==JSON_EOF );
+
+	p = dBlob.Begin();
+	Verify ( sphJsonFindByKey ( JSON_ROOT, &p, "small", 5, sphJsonKeyMask ( "small", 5 ), pRootEnd )==JSON_OBJECT );
+	Verify ( sphJsonFindByKey ( JSON_OBJECT, &p, "a", 1, sphJsonKeyMask ( "a", 1 ) )==JSON_INT32 );
+
+	// scanning without the root end must agree
+	p = dBlob.Begin();
+	Verify ( sphJsonFindByKey ( JSON_ROOT, &p, "key7", 4, sphJsonKeyMask ( "key7", 4 ) )==JSON_INT32 );
+	Verify ( sphJsonLoadInt ( &p )==70 );
+
+	printf ( "ok\n" );
+}
+
+
+void TestJsonAttrs()
+{
+	printf ( "testing generated JSON attributes... " );
+
+	CSphJsonAttr tPath;
+	CSphString sError;
+	Verify ( sphJsonAttrParsePath ( " J . obj ['price'] [2] .x", tPath, sError ) );
+	Verify ( tPath.m_sColumn=="j" && tPath.m_sPath=="j.obj.price[2].x" && tPath.m_dSteps.GetLength()==4 );
+	Verify ( !sphJsonAttrParsePath ( "j[0]", tPath, sError ) );
+	Verify ( !sphJsonAttrParsePath ( "j[k]", tPath, sError ) );
+
+	// commas within quoted keys do not split the spec
+	CSphVector<CSphJsonAttr> dQuoted;
+	Verify ( sphJsonAttrsParse ( "a:uint:j['x,y'], b:float:j[\"p, q\"].z", dQuoted, sError ) );
+	Verify ( dQuoted.GetLength()==2 && dQuoted[0].m_sPath=="j.x,y" && dQuoted[1].m_sPath=="j.p, q.z" );
+
+	CSphSchema tSchema;
+	CSphColumnInfo tJson ( "j", ESphAttr::SPH_ATTR_JSON );
+	tSchema.AddAttr ( tJson, true );
+
+	CSphString sSpec = "brand:uint:j.brand, price:float:j.obj.price, flag:bool:j.arr[1], big:bigint:j.big, str:uint:j.str";
+	Verify ( sphJsonAttrsAddToSchema ( tSchema, sSpec, true, sError ) );
+	Verify ( sphJsonAttrsAddToSchema ( tSchema, sSpec, true, sError ) ); // idempotent
+	Verify ( !sphJsonAttrsAddToSchema ( tSchema, "brand:float:j.brand", true, sError ) );
+	Verify ( !sphJsonAttrsAddToSchema ( tSchema, "x:string:j.brand", true, sError ) );
+	Verify ( !sphJsonAttrsAddToSchema ( tSchema, "x:uint:nosuchcol.brand", true, sError ) );
+
+	CSphVector<CSphJsonAttr> dAttrs;
+	Verify ( sphJsonAttrsSetup ( tSchema, sSpec, dAttrs, sError ) );
+	Verify ( dAttrs.GetLength()==5 );
+
+	int iBrand = tSchema.GetAttrIndex ( "brand" );
+	Verify ( sphJsonAttrFind ( tSchema, "j['brand']" )==iBrand );
+	Verify ( sphJsonAttrFind ( tSchema, "j.obj.price" )==tSchema.GetAttrIndex ( "price" ) );
+	Verify ( sphJsonAttrFind ( tSchema, "j.other" )<0 );
+	Verify ( sphJsonAttrFind ( tSchema, "brand" )<0 );
+
+	const char * sJson = "{\"brand\":42,\"obj\":{\"price\":1.5},\"arr\":[0,1],\"big\":12345678901,\"str\":\"17\"}";
+	CSphVector<char> dSrc ( (int)strlen(sJson)+2 );
+	memcpy ( dSrc.Begin(), sJson, strlen(sJson) );
+	dSrc[dSrc.GetLength()-2] = '\0';
+	dSrc[dSrc.GetLength()-1] = '\0';
+
+	CSphVector<BYTE> dBlob;
+	Verify ( sphJsonParse ( dBlob, dSrc.Begin(), false, false, sError ) );
+
+	CSphMatch tDoc;
+	tDoc.Reset ( tSchema.GetDynamicSize() );
+	int iJson = tSchema.GetAttrIndex ( "j" );
+	sphJsonAttrsEval ( tDoc, dAttrs, iJson, dBlob.Begin(), dBlob.GetLength() );
+
+	Verify ( tDoc.GetAttr ( dAttrs[0].m_tLocator )==42 );
+	Verify ( tDoc.GetAttrFloat ( dAttrs[1].m_tLocator )==1.5f );
+	Verify ( tDoc.GetAttr ( dAttrs[2].m_tLocator )==1 );
+	Verify ( tDoc.GetAttr ( dAttrs[3].m_tLocator )==I64C(12345678901) );
+	Verify ( tDoc.GetAttr ( dAttrs[4].m_tLocator )==17 );
+
+	// no data zeroes everything out
+	sphJsonAttrsEval ( tDoc, dAttrs, iJson, NULL, 0 );
+	ARRAY_FOREACH ( i, dAttrs )
+		Verify ( tDoc.GetAttr ( dAttrs[i].m_tLocator )==0 );
+
+	printf ( "ok\n" );
+}
+
+void TestGeoIndex()
+{
+	printf ( "testing spatial index... " );
+
+	// docid, lat, lon (radians); a dense cluster plus some points all over the globe
+	const int ROWS = 5000;
+	const int STRIDE = DOCINFO_IDSIZE + 2;
+	CSphVector<DWORD> dDocinfo ( ROWS*STRIDE );
+	CSphAttrLocator tLat ( 0, 32 );
+	CSphAttrLocator tLon ( 32, 32 );
+	tLat.m_bDynamic = tLon.m_bDynamic = false;
+
+	sphSrand ( 0 );
+	for ( int i=0; i<ROWS; i++ )
+	{
+		DWORD * pRow = dDocinfo.Begin() + i*STRIDE;
+		DOCINFOSETID ( pRow, (SphDocID_t)( i+1 ) );
+		float fLat = ( i%2 ) ? ( sphRand()%180000 )/1000.0f - 90.0f : 55.75f + ( sphRand()%1000 )/1000.0f;
+		float fLon = ( i%2 ) ? ( sphRand()%360000 )/1000.0f - 180.0f : 37.6f + ( sphRand()%1000 )/1000.0f;
+		sphSetRowAttr ( DOCINFO2ATTRS ( pRow ), tLat, sphF2DW ( fLat*float(M_PI)/180.0f ) );
+		sphSetRowAttr ( DOCINFO2ATTRS ( pRow ), tLon, sphF2DW ( fLon*float(M_PI)/180.0f ) );
+	}
+
+	CSphGeoIndex tIndex;
+	tIndex.Build ( dDocinfo.Begin(), ROWS, STRIDE, tLat, tLon );
+	Verify ( !tIndex.IsEmpty() );
+
+	const float dAnchors[][2] = { { 56.0f, 38.0f }, { 0.0f, 179.9f }, { -89.9f, 0.0f }, { 10.0f, -170.0f } };
+	const float dRadii[] = { 1000.0f, 50000.0f, 2000000.0f, 30000000.0f };
+	for ( int iAnchor=0; iAnchor<(int)( sizeof(dAnchors)/sizeof(dAnchors[0]) ); iAnchor++ )
+	{
+		GeodistInfo_t tGeo;
+		tGeo.m_pFunc = GeodistSphereRad;
+		tGeo.m_tLat = tLat;
+		tGeo.m_tLon = tLon;
+		tGeo.m_fAnchorLat = dAnchors[iAnchor][0]*float(M_PI)/180.0f;
+		tGeo.m_fAnchorLon = dAnchors[iAnchor][1]*float(M_PI)/180.0f;
+		Verify ( tIndex.Covers ( tGeo ) );
+
+		// within a radius, vs brute force
+		for ( int iRadius=0; iRadius<(int)( sizeof(dRadii)/sizeof(dRadii[0]) ); iRadius++ )
+		{
+			CSphVector<DWORD> dRows, dExpected;
+			tIndex.CollectWithin ( tGeo, dRadii[iRadius], dRows );
+			for ( int i=0; i<ROWS; i++ )
+			{
+				const DWORD * pAttrs = DOCINFO2ATTRS ( dDocinfo.Begin() + i*STRIDE );
+				if ( tGeo.Dist ( sphDW2F ( (DWORD)sphGetRowAttr ( pAttrs, tLat ) ), sphDW2F ( (DWORD)sphGetRowAttr ( pAttrs, tLon ) ) )<=dRadii[iRadius] )
+					dExpected.Add ( i );
+			}
+
+			Verify ( dRows.GetLength()==dExpected.GetLength() );
+			ARRAY_FOREACH ( i, dRows )
+				Verify ( dRows[i]==dExpected[i] );
+		}
+
+		// nearest ones must include every row that is closer than the farthest returned one
+		CSphVector<DWORD> dRows;
+		tIndex.CollectNearest ( tGeo, 20, dRows );
+		Verify ( dRows.GetLength()>=20 );
+
+		CSphVector<float> dDists;
+		for ( int i=0; i<ROWS; i++ )
+		{
+			const DWORD * pAttrs = DOCINFO2ATTRS ( dDocinfo.Begin() + i*STRIDE );
+			dDists.Add ( tGeo.Dist ( sphDW2F ( (DWORD)sphGetRowAttr ( pAttrs, tLat ) ), sphDW2F ( (DWORD)sphGetRowAttr ( pAttrs, tLon ) ) ) );
+		}
+		CSphVector<float> dSorted;
+		dSorted = dDists;
+		dSorted.Sort();
+
+		int iFound = 0;
+		ARRAY_FOREACH ( i, dRows )
+			if ( dDists [ dRows[i] ]<=dSorted[19] )
+				iFound++;
+		Verify ( iFound>=20 );
+	}
+
+	printf ( "ok\n" );
+}
+
+void TestGroupSpill()
+{
+	printf ( "testing group-by spill partitions... " );
+
+	const int DYNAMIC = 3;
+	const int GROUPS = 10000;
+	CSphGroupSpill tSpill ( 8 );
+	tSpill.Setup ( DYNAMIC );
+	Verify ( tSpill.Open() );
+
+	// two rounds, so that every partition gets appended to
+	CSphMatch tMatch;
+	tMatch.Reset ( DYNAMIC );
+	for ( int iRound=0; iRound<2; iRound++ )
+		for ( int i=0; i<GROUPS; i++ )
+		{
+			tMatch.m_uDocID = i+1;
+			tMatch.m_iWeight = iRound;
+			tMatch.m_pDynamic[0] = i;
+			tMatch.m_pDynamic[1] = i*7;
+			tMatch.m_pDynamic[2] = iRound;
+			Verify ( tSpill.WriteGroup ( tMatch, i ) );
+			Verify ( tSpill.WriteDistinct ( SphGroupedValue_t ( i, i*3+iRound, 1 ) ) );
+		}
+
+	// every record comes back exactly once, and in the partition of its key
+	CSphVector<int> dGroups ( GROUPS ), dValues ( GROUPS );
+	dGroups.Fill ( 0 );
+	dValues.Fill ( 0 );
+	SphGroupedValue_t tValue;
+	for ( int iPart=0; iPart<tSpill.GetParts(); iPart++ )
+	{
+		Verify ( !tSpill.IsEmpty ( iPart ) );
+		Verify ( tSpill.StartRead ( iPart, false ) );
+		for ( int iType = tSpill.ReadRecord ( tMatch, tValue ); iType!=CSphGroupSpill::RECORD_NONE; iType = tSpill.ReadRecord ( tMatch, tValue ) )
+		{
+			if ( iType==CSphGroupSpill::RECORD_GROUP )
+			{
+				int iGroup = tMatch.m_pDynamic[0];
+				Verify ( tSpill.PartOf ( iGroup )==iPart );
+				Verify ( tMatch.m_uDocID==(SphDocID_t)( iGroup+1 ) && (int)tMatch.m_pDynamic[1]==iGroup*7 );
+				Verify ( tMatch.m_iWeight==(int)tMatch.m_pDynamic[2] );
+				dGroups[iGroup]++;
+			} else
+			{
+				Verify ( tSpill.PartOf ( tValue.m_uGroup )==iPart );
+				Verify ( tValue.m_uValue/3==tValue.m_uGroup && tValue.m_iCount==1 );
+				dValues[(int)tValue.m_uGroup]++;
+			}
+		}
+		Verify ( tSpill.GetError().IsEmpty() );
+		tSpill.EndRead();
+		Verify ( tSpill.IsEmpty ( iPart ) );
+	}
+
+	for ( int i=0; i<GROUPS; i++ )
+		Verify ( dGroups[i]==2 && dValues[i]==2 );
+
+	// string payloads are spilled by value, and come back as fresh copies
+	CSphSchema tSchema;
+	CSphColumnInfo tCol ( "str", ESphAttr::SPH_ATTR_STRINGPTR );
+	tSchema.AddAttr ( tCol, true );
+	tCol.m_sName = "num";
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_INTEGER;
+	tSchema.AddAttr ( tCol, true );
+
+	const CSphAttrLocator & tLocStr = tSchema.GetAttr(0).m_tLocator;
+	const CSphAttrLocator & tLocNum = tSchema.GetAttr(1).m_tLocator;
+	CSphGroupSpill tStrSpill ( 2 );
+	tStrSpill.Setup ( tSchema );
+	Verify ( tStrSpill.Open() );
+
+	CSphMatch tStr;
+	tStr.Reset ( tSchema.GetDynamicSize() );
+	for ( int i=0; i<3; i++ )
+	{
+		CSphString sValue;
+		sValue.SetSprintf ( "group%d", i );
+		tStr.SetAttr ( tLocStr, i==2 ? 0 : (SphAttr_t)sValue.Leak() );
+		tStr.SetAttr ( tLocNum, i );
+		Verify ( tStrSpill.WriteGroup ( tStr, i ) );
+		tSchema.FreeStringPtrs ( &tStr );
+	}
+
+	int iStrings = 0;
+	for ( int iPart=0; iPart<tStrSpill.GetParts(); iPart++ )
+	{
+		if ( tStrSpill.IsEmpty ( iPart ) )
+			continue;
+		Verify ( tStrSpill.StartRead ( iPart, false ) );
+		while ( tStrSpill.ReadRecord ( tStr, tValue )==CSphGroupSpill::RECORD_GROUP )
+		{
+			int iGroup = (int)tStr.GetAttr ( tLocNum );
+			const char * sValue = (const char*)tStr.GetAttr ( tLocStr );
+			CSphString sExpected;
+			sExpected.SetSprintf ( "group%d", iGroup );
+			Verify ( iGroup==2 ? !sValue : ( sValue && sExpected==sValue ) );
+			tSchema.FreeStringPtrs ( &tStr );
+			iStrings++;
+		}
+		Verify ( tStrSpill.GetError().IsEmpty() );
+		tStrSpill.EndRead();
+	}
+	Verify ( iStrings==3 );
+
+	printf ( "ok\n" );
+}
+
+void TestHll()
+{
+	printf ( "testing hyperloglog sketches... " );
+
+	// a few sizes around the sparse/dense switch and well past it
+	const int dCounts[] = { 0, 1, 100, 2000, 20000, 300000 };
+	for ( int i=0; i<(int)(sizeof(dCounts)/sizeof(dCounts[0])); i++ )
+	{
+		BYTE * pSketch = sphHllCreate ( HLL_DEFAULT_PRECISION );
+		for ( int j=0; j<dCounts[i]; j++ )
+		{
+			sphHllAdd ( pSketch, sphHllHash ( j ) );
+			sphHllAdd ( pSketch, sphHllHash ( j ) ); // duplicates must not count
+		}
+		Verify ( sphHllCheck ( pSketch ) );
+		int64_t iEstimate = sphHllEstimate ( pSketch );
+		Verify ( fabs ( double ( iEstimate - dCounts[i] ) )<=0.04*dCounts[i]+1 );
+		SafeDeleteArray ( pSketch );
+	}
+
+	// merge of two overlapping halves must estimate the union, sparse and dense alike
+	for ( int iTotal=1000; iTotal<=100000; iTotal*=100 )
+	{
+		BYTE * pA = sphHllCreate ( HLL_DEFAULT_PRECISION );
+		BYTE * pB = sphHllCreate ( HLL_DEFAULT_PRECISION );
+		BYTE * pAll = sphHllCreate ( HLL_DEFAULT_PRECISION );
+		for ( int j=0; j<iTotal; j++ )
+		{
+			if ( j<iTotal*2/3 )
+				sphHllAdd ( pA, sphHllHash ( j ) );
+			if ( j>=iTotal/3 )
+				sphHllAdd ( pB, sphHllHash ( j ) );
+			sphHllAdd ( pAll, sphHllHash ( j ) );
+		}
+		Verify ( sphHllMerge ( pA, pB ) );
+		Verify ( sphHllEstimate ( pA )==sphHllEstimate ( pAll ) );
+		SafeDeleteArray ( pA );
+		SafeDeleteArray ( pB );
+		SafeDeleteArray ( pAll );
+	}
+
+	// different precisions do not merge
+	BYTE * pA = sphHllCreate ( HLL_DEFAULT_PRECISION );
+	BYTE * pB = sphHllCreate ( HLL_MIN_PRECISION );
+	Verify ( !sphHllMerge ( pA, pB ) );
+	SafeDeleteArray ( pA );
+	SafeDeleteArray ( pB );
+
+	printf ( "ok\n" );
+}
+
+static void CollectFacet ( ISphMatchSorter * pSorter, CSphVector<int> & dCounts )
+{
+	const CSphAttrLocator & tGroupby = pSorter->GetSchema().GetAttr ( pSorter->GetSchema().GetAttrIndex ( "@groupby" ) ).m_tLocator;
+	const CSphAttrLocator & tCount = pSorter->GetSchema().GetAttr ( pSorter->GetSchema().GetAttrIndex ( "@count" ) ).m_tLocator;
+
+	int iLen = pSorter->GetLength();
+	CSphMatch * pMatches = new CSphMatch [ iLen ];
+	Verify ( pSorter->Flatten ( pMatches, 0 )==iLen );
+	for ( int i=0; i<iLen; i++ )
+	{
+		int iKey = (int)pMatches[i].GetAttr ( tGroupby );
+		Verify ( iKey>=0 && iKey<dCounts.GetLength() && !dCounts[iKey] );
+		dCounts[iKey] = (int)pMatches[i].GetAttr ( tCount );
+	}
+	delete [] pMatches;
+}
+
+
+void TestFacetSorter()
+{
+	printf ( "testing facet aggregator... " );
+
+	const int DOCS = 140000;
+	const int BRANDS = 70000; // more than the aggregator keeps at once, so that it flushes midway
+	const int COLORS = 7;
+
+	CSphSchema tSchema;
+	CSphColumnInfo tCol;
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_INTEGER;
+	tCol.m_sName = "brand";
+	tSchema.AddAttr ( tCol, false );
+	tCol.m_sName = "color";
+	tSchema.AddAttr ( tCol, false );
+
+	const char * dGroups[] = { "brand", "color" };
+	const int dCardinality[] = { BRANDS, COLORS };
+	ISphMatchSorter * dDirect[2], * dFaceted[2];
+	CSphFacetSorter * pFacets = new CSphFacetSorter(); // facet sorters have to outlive the aggregator
+	for ( int i=0; i<2; i++ )
+	{
+		CSphQuery tQuery;
+		CSphString sError;
+		tQuery.m_sGroupBy = dGroups[i];
+		tQuery.m_eGroupFunc = SPH_GROUPBY_ATTR;
+		tQuery.m_sGroupSortBy = "@count desc";
+		tQuery.m_iMaxMatches = BRANDS;
+
+		SphQueueSettings_t tQueueSettings ( tQuery, tSchema, sError, NULL );
+		dDirect[i] = sphCreateQueue ( tQueueSettings );
+		dFaceted[i] = sphCreateQueue ( tQueueSettings );
+		Verify ( dDirect[i] && dFaceted[i] );
+		Verify ( pFacets->AddFacet ( dFaceted[i], tQuery ) );
+	}
+
+	const CSphAttrLocator & tBrand = tSchema.GetAttr(0).m_tLocator;
+	const CSphAttrLocator & tColor = tSchema.GetAttr(1).m_tLocator;
+	CSphVector<CSphRowitem> dRows ( DOCS*tSchema.GetRowSize() );
+	CSphMatch tMatch;
+	tMatch.Reset ( pFacets->GetSchema().GetDynamicSize() );
+	for ( int i=0; i<DOCS; i++ )
+	{
+		CSphRowitem * pRow = &dRows [ i*tSchema.GetRowSize() ];
+		sphSetRowAttr ( pRow, tBrand, ( i*7919 ) % BRANDS );
+		sphSetRowAttr ( pRow, tColor, i % COLORS );
+
+		tMatch.m_uDocID = i+1;
+		tMatch.m_pStatic = pRow;
+		dDirect[0]->Push ( tMatch );
+		dDirect[1]->Push ( tMatch );
+		pFacets->Push ( tMatch );
+	}
+	pFacets->Flush();
+	SafeDelete ( pFacets );
+
+	// groups and counts must match the ones computed match by match
+	for ( int i=0; i<2; i++ )
+	{
+		Verify ( dDirect[i]->GetTotalCount()==dFaceted[i]->GetTotalCount() );
+		CSphVector<int> dDirectCounts ( dCardinality[i] ), dFacetedCounts ( dCardinality[i] );
+		dDirectCounts.Fill ( 0 );
+		dFacetedCounts.Fill ( 0 );
+		CollectFacet ( dDirect[i], dDirectCounts );
+		CollectFacet ( dFaceted[i], dFacetedCounts );
+		ARRAY_FOREACH ( j, dDirectCounts )
+			Verify ( dDirectCounts[j]==dFacetedCounts[j] && dDirectCounts[j]==DOCS/dCardinality[i] );
+		SafeDelete ( dDirect[i] );
+		SafeDelete ( dFaceted[i] );
+	}
+
+	printf ( "ok\n" );
+}
+
+struct KeyQueueDoc_t
+{
+	int64_t		m_iA;
+	float		m_fB;
+	SphDocID_t	m_uID;
+
+	// a desc, b asc, id asc
+	bool IsBetter ( const KeyQueueDoc_t & t ) const
+	{
+		if ( m_iA!=t.m_iA )
+			return m_iA>t.m_iA;
+		if ( m_fB!=t.m_fB )
+			return m_fB<t.m_fB;
+		return m_uID<t.m_uID;
+	}
+};
+
+
+void TestKeyQueue()
+{
+	printf ( "testing key-array match queue... " );
+
+	const int DOCS = 20000;
+	const int MAX_MATCHES = 100;
+
+	CSphSchema tSchema;
+	CSphColumnInfo tCol;
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_BIGINT;
+	tCol.m_sName = "a";
+	tSchema.AddAttr ( tCol, false );
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_FLOAT;
+	tCol.m_sName = "b";
+	tSchema.AddAttr ( tCol, false );
+
+	CSphQuery tQuery;
+	CSphString sError;
+	tQuery.m_eSort = SPH_SORT_EXTENDED;
+	tQuery.m_sSortBy = "a desc, b asc";
+	tQuery.m_iMaxMatches = MAX_MATCHES;
+	SphQueueSettings_t tQueueSettings ( tQuery, tSchema, sError, NULL );
+	ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+	Verify ( pSorter );
+
+	// few distinct values, negative ones, and signed zeroes, so that every key part and the id tie-breaker matter
+	const CSphAttrLocator & tA = tSchema.GetAttr(0).m_tLocator;
+	const CSphAttrLocator & tB = tSchema.GetAttr(1).m_tLocator;
+	CSphVector<KeyQueueDoc_t> dDocs ( DOCS );
+	CSphVector<CSphRowitem> dRows ( DOCS*tSchema.GetRowSize() );
+	CSphMatch tMatch;
+	tMatch.Reset ( pSorter->GetSchema().GetDynamicSize() );
+	for ( int i=0; i<DOCS; i++ )
+	{
+		KeyQueueDoc_t & tDoc = dDocs[i];
+		tDoc.m_iA = ( i*7919 ) % 11 - 5;
+		tDoc.m_fB = ( ( i*104729 ) % 7 - 3 ) * 0.5f;
+		if ( tDoc.m_fB==0.0f && ( i & 1 ) )
+			tDoc.m_fB = -0.0f;
+		tDoc.m_uID = DOCS-i;
+
+		CSphRowitem * pRow = &dRows [ i*tSchema.GetRowSize() ];
+		sphSetRowAttr ( pRow, tA, tDoc.m_iA );
+		sphSetRowAttr ( pRow, tB, sphF2DW ( tDoc.m_fB ) );
+
+		tMatch.m_uDocID = tDoc.m_uID;
+		tMatch.m_pStatic = pRow;
+		pSorter->Push ( tMatch );
+	}
+
+	Verify ( pSorter->GetLength()==MAX_MATCHES );
+	CSphMatch * pMatches = new CSphMatch [ MAX_MATCHES ];
+	Verify ( pSorter->Flatten ( pMatches, 0 )==MAX_MATCHES );
+
+	// results must come best first, and nothing that did not make it may be better than the last one
+	CSphVector<KeyQueueDoc_t> dResult ( MAX_MATCHES );
+	for ( int i=0; i<MAX_MATCHES; i++ )
+	{
+		dResult[i] = dDocs [ DOCS-(int)pMatches[i].m_uDocID ];
+		Verify ( !i || dResult[i-1].IsBetter ( dResult[i] ) );
+	}
+
+	int iBetter = 0;
+	ARRAY_FOREACH ( i, dDocs )
+		if ( dDocs[i].IsBetter ( dResult.Last() ) )
+			iBetter++;
+	Verify ( iBetter==MAX_MATCHES-1 );
+
+	delete [] pMatches;
+	SafeDelete ( pSorter );
+
+	printf ( "ok\n" );
+}
+
+/// one merged row: docid and two attributes, whatever they are
+struct MergedRow_t
+{
+	SphDocID_t	m_uID;
+	SphAttr_t	m_iA;
+	SphAttr_t	m_iB;
+};
+
+/// merges the result sets of a few overlapping sources, serially without partition sorters, or on those
+static int MergeTestSources ( const CSphQuery & tSrcQuery, const CSphQuery & tQuery, const CSphSchema & tSchema,
+	const CSphVector<CSphRowitem> & dRows, int iSources, int iDocs, int iParts, CSphVector<MergedRow_t> & dResult )
+{
+	CSphString sError;
+	CSphQueryResult tRes;
+	CSphVector<int> dMatchCounts;
+	for ( int iSrc=0; iSrc<iSources; iSrc++ )
+	{
+		SphQueueSettings_t tQueueSettings ( tSrcQuery, tSchema, sError, NULL );
+		ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+		Verify ( pSorter );
+
+		CSphMatch tMatch;
+		tMatch.Reset ( pSorter->GetSchema().GetDynamicSize() );
+		for ( int i=0; i<iDocs; i++ )
+		{
+			tMatch.m_uDocID = iSrc*iDocs/2 + i + 1;
+			tMatch.m_pStatic = &dRows [ ( iSrc*iDocs+i )*tSchema.GetRowSize() ];
+			pSorter->Push ( tMatch );
+		}
+		dMatchCounts.Add ( sphFlattenQueue ( pSorter, &tRes, iSrc ) );
+		SafeDelete ( pSorter );
+	}
+
+	SphQueueSettings_t tQueueSettings ( tQuery, tSchema, sError, NULL );
+	ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+	Verify ( pSorter );
+	CSphVector<ISphMatchSorter*> dParts;
+	for ( int i=0; i<iParts; i++ )
+		dParts.Add ( sphCreateQueue ( tQueueSettings ) );
+
+	int64_t iArenaBytes = 0;
+	int iDupes = sphMergeDupes ( pSorter, dParts, tRes.m_dMatches, dMatchCounts, tRes.m_tSchema, iArenaBytes );
+	Verify ( !dParts.GetLength() );
+
+	// groups come out as @groupby and @count, plain matches as their own attributes
+	CSphAttrLocator tLocA, tLocB;
+	if ( pSorter->IsGroupby() )
+	{
+		tLocA = pSorter->GetSchema().GetAttr ( "@groupby" )->m_tLocator;
+		tLocB = pSorter->GetSchema().GetAttr ( "@count" )->m_tLocator;
+	} else
+	{
+		tLocA = tSchema.GetAttr ( "val" )->m_tLocator;
+		tLocB = tSchema.GetAttr ( "grp" )->m_tLocator;
+	}
+
+	tRes.m_dMatches.Reset();
+	sphFlattenQueue ( pSorter, &tRes, -1 );
+	dResult.Resize ( tRes.m_dMatches.GetLength() );
+	ARRAY_FOREACH ( i, tRes.m_dMatches )
+	{
+		dResult[i].m_uID = tRes.m_dMatches[i].m_uDocID;
+		dResult[i].m_iA = tRes.m_dMatches[i].GetAttr ( tLocA );
+		dResult[i].m_iB = tRes.m_dMatches[i].GetAttr ( tLocB );
+	}
+	SafeDelete ( pSorter );
+	return iDupes;
+}
+
+
+void TestMergeDupes()
+{
+	printf ( "testing partitioned result merge... " );
+
+	const int SOURCES = 4;
+	const int DOCS = 20000;
+	const int GROUPS = 1000;
+
+	CSphSchema tSchema;
+	CSphColumnInfo tCol;
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_INTEGER;
+	tCol.m_sName = "val";
+	tSchema.AddAttr ( tCol, false );
+	tCol.m_sName = "grp";
+	tSchema.AddAttr ( tCol, false );
+
+	// every source overlaps the next one by half, and has its own values for the docs they share,
+	// so that the pick among the dupes shows
+	const CSphAttrLocator & tVal = tSchema.GetAttr(0).m_tLocator;
+	const CSphAttrLocator & tGrp = tSchema.GetAttr(1).m_tLocator;
+	CSphVector<CSphRowitem> dRows ( SOURCES*DOCS*tSchema.GetRowSize() );
+	for ( int iSrc=0; iSrc<SOURCES; iSrc++ )
+		for ( int i=0; i<DOCS; i++ )
+		{
+			int iDoc = iSrc*DOCS/2 + i + 1;
+			CSphRowitem * pRow = &dRows [ ( iSrc*DOCS+i )*tSchema.GetRowSize() ];
+			sphSetRowAttr ( pRow, tVal, iDoc*10 + iSrc );
+			sphSetRowAttr ( pRow, tGrp, iDoc % GROUPS );
+		}
 
+	for ( int iGroupby=0; iGroupby<2; iGroupby++ )
+	{
+		// sources keep all they get, the final sorter takes fewer than there are, so that the partitions have to cut the same
+		// plain matches start with the lowest groups, where the sources overlap
+		CSphQuery dQueries[2];
+		for ( int j=0; j<2; j++ )
+		{
+			CSphQuery & tQuery = dQueries[j];
+			tQuery.m_iMaxMatches = j ? GROUPS/2 : DOCS;
+			if ( iGroupby )
+			{
+				tQuery.m_sGroupBy = "grp";
+				tQuery.m_eGroupFunc = SPH_GROUPBY_ATTR;
+				tQuery.m_sGroupSortBy = "@groupby asc";
+			} else
+			{
+				tQuery.m_eSort = SPH_SORT_EXTENDED;
+				tQuery.m_sSortBy = "grp asc, val desc";
+			}
+		}
+
+		CSphVector<MergedRow_t> dSerial, dParted;
+		int iSerialDupes = MergeTestSources ( dQueries[0], dQueries[1], tSchema, dRows, SOURCES, DOCS, 0, dSerial );
+		int iPartedDupes = MergeTestSources ( dQueries[0], dQueries[1], tSchema, dRows, SOURCES, DOCS, 3, dParted );
+
+		Verify ( iSerialDupes>0 && iSerialDupes==iPartedDupes );
+		Verify ( dSerial.GetLength()==GROUPS/2 && dSerial.GetLength()==dParted.GetLength() );
+		ARRAY_FOREACH ( i, dSerial )
+		{
+			Verify ( dSerial[i].m_iA==dParted[i].m_iA && dSerial[i].m_iB==dParted[i].m_iB );
+			Verify ( iGroupby || dSerial[i].m_uID==dParted[i].m_uID );
+		}
+
+		// plain merges keep the newest source of a dupe
+		if ( !iGroupby )
+			ARRAY_FOREACH ( i, dSerial )
+				Verify ( dSerial[i].m_iA==(SphAttr_t)( dSerial[i].m_uID*10 + Min ( ( dSerial[i].m_uID-1 )/( DOCS/2 ), SOURCES-1 ) ) );
+	}
+
+	printf ( "ok\n" );
+}
+
+void TestRollup()
+{
+	printf ( "testing rollups... " );
+
+	const int DOCS = 10000;
+	const int DAYS = 30;
+	const int CATEGORIES = 7;
+
+	CSphSchema tSchema;
+	CSphColumnInfo tCol;
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_INTEGER;
+	tCol.m_sName = "day";
+	tSchema.AddAttr ( tCol, false );
+	tCol.m_sName = "category";
+	tSchema.AddAttr ( tCol, false );
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_FLOAT;
+	tCol.m_sName = "price";
+	tSchema.AddAttr ( tCol, false );
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_STRING;
+	tCol.m_sName = "title";
+	tSchema.AddAttr ( tCol, false );
+
+	const CSphAttrLocator & tDay = tSchema.GetAttr ( tSchema.GetAttrIndex ( "day" ) ).m_tLocator;
+	const CSphAttrLocator & tCategory = tSchema.GetAttr ( tSchema.GetAttrIndex ( "category" ) ).m_tLocator;
+	const CSphAttrLocator & tPrice = tSchema.GetAttr ( tSchema.GetAttrIndex ( "price" ) ).m_tLocator;
+
+	// bad tuples are rejected, good ones next to them still go through
+	CSphVector<CSphRollup*> dRollups;
+	CSphString sError;
+	Verify ( !sphRollupsSetup ( "title : price; day : category, price; day : nosuchattr", tSchema, dRollups, sError ) );
+	Verify ( dRollups.GetLength()==1 );
+	SafeDelete ( dRollups[0] );
+
+	const int iStride = DOCINFO_IDSIZE + tSchema.GetRowSize();
+	CSphVector<CSphRowitem> dDocinfo;
+	dDocinfo.Resize ( DOCS*iStride );
+	dDocinfo.Fill ( 0 );
+
+	int dCounts[DAYS][CATEGORIES];
+	double dSums[DAYS][CATEGORIES];
+	memset ( dCounts, 0, sizeof(dCounts) );
+	memset ( dSums, 0, sizeof(dSums) );
+
+	for ( int i=0; i<DOCS; i++ )
+	{
+		CSphRowitem * pRow = dDocinfo.Begin() + i*iStride;
+		CSphRowitem * pAttrs = DOCINFO2ATTRS ( pRow );
+		int iDay = ( i*7 ) % DAYS;
+		int iCategory = ( i/3 ) % CATEGORIES;
+		float fPrice = float ( i%100 ) / 4.0f;
+		DOCINFOSETID ( pRow, (SphDocID_t)( i+1 ) );
+		sphSetRowAttr ( pAttrs, tDay, iDay );
+		sphSetRowAttr ( pAttrs, tCategory, iCategory );
+		sphSetRowAttr ( pAttrs, tPrice, sphF2DW ( fPrice ) );
+		dCounts[iDay][iCategory]++;
+		dSums[iDay][iCategory] += fPrice;
+	}
+
+	CSphRollup tRollup;
+	Verify ( tRollup.Setup ( "day, category : price", tSchema, sError ) );
+	Verify ( tRollup.GetDimension ( "category" )==1 && tRollup.GetMeasure ( "price" )==0 && tRollup.IsFloatMeasure ( 0 ) );
+	Verify ( tRollup.Uses ( "day" ) && !tRollup.Uses ( "title" ) );
+	tRollup.Build ( dDocinfo.Begin(), DOCS, iStride );
+
+	// every cell matches a brute force count, and starts with the first document that went into it
+	int iCells = 0;
+	for ( int i=0; i<DAYS; i++ )
+		for ( int j=0; j<CATEGORIES; j++ )
+			iCells += dCounts[i][j] ? 1 : 0;
+	Verify ( tRollup.GetCells()==iCells );
+
+	CSphVector<CSphRollup::Total_t> dTotals;
+	dTotals = tRollup.GetTotals();
+	for ( int iCell=0; iCell<tRollup.GetCells(); iCell++ )
+	{
+		const CSphRowitem * pRow = tRollup.GetDocinfo ( iCell );
+		const CSphRowitem * pAttrs = DOCINFO2ATTRS ( pRow );
+		int iDay = (int)sphGetRowAttr ( pAttrs, tDay );
+		int iCategory = (int)sphGetRowAttr ( pAttrs, tCategory );
+		Verify ( sphGetRowAttr ( pAttrs, tPrice )==0 );
+
+		const CSphRowitem * pFirst = dDocinfo.Begin() + ( DOCINFO2ID ( pRow )-1 )*iStride;
+		Verify ( sphGetRowAttr ( DOCINFO2ATTRS ( pFirst ), tDay )==(SphAttr_t)iDay );
+		Verify ( sphGetRowAttr ( DOCINFO2ATTRS ( pFirst ), tCategory )==(SphAttr_t)iCategory );
+
+		const CSphRollup::Total_t * pCell = dTotals.Begin() + iCell*tRollup.GetTotalsStride();
+		Verify ( pCell[0].m_iValue==dCounts[iDay][iCategory] );
+		Verify ( fabs ( pCell[1].m_fValue - dSums[iDay][iCategory] )<1e-6 );
+	}
+
+	// taking every document back out leaves nothing
+	for ( int i=0; i<DOCS; i++ )
+		Verify ( tRollup.Subtract ( DOCINFO2ATTRS ( dDocinfo.Begin() + i*iStride ), dTotals ) );
+	for ( int iCell=0; iCell<tRollup.GetCells(); iCell++ )
+		Verify ( dTotals[iCell*tRollup.GetTotalsStride()].m_iValue==0 );
+
+	// unknown cells can not be subtracted
+	CSphVector<CSphRowitem> dStray ( iStride );
+	dStray.Fill ( 0 );
+	sphSetRowAttr ( DOCINFO2ATTRS ( dStray.Begin() ), tDay, DAYS );
+	Verify ( !tRollup.Subtract ( DOCINFO2ATTRS ( dStray.Begin() ), dTotals ) );
+
+	printf ( "ok\n" );
+}
+
+struct TestMatchStream_t : public ISphMatchStream
+{
+	bool					m_bAccept;
+	int						m_iStopAfter;
+	CSphVector<SphDocID_t>	m_dDocs;
+
+	explicit TestMatchStream_t ( bool bAccept, int iStopAfter )
+		: m_bAccept ( bAccept )
+		, m_iStopAfter ( iStopAfter )
+	{}
+
+	virtual bool SetSchema ( const ISphSchema & )
+	{
+		return m_bAccept;
+	}
+
+	virtual bool PushMatch ( const CSphMatch & tMatch, const PoolPtrs_t & )
+	{
+		m_dDocs.Add ( tMatch.m_uDocID );
+		return m_dDocs.GetLength()<m_iStopAfter;
+	}
+};
+
+
+void TestStreamQueue()
+{
+	printf ( "testing stream match queue... " );
+
+	const int DOCS = 100;
+
+	CSphSchema tSchema;
+	CSphColumnInfo tCol ( "a", ESphAttr::SPH_ATTR_INTEGER );
+	tSchema.AddAttr ( tCol, false );
+
+	CSphQuery tQuery;
+	CSphString sError;
+	tQuery.m_iOffset = 10;
+	tQuery.m_iLimit = 20;
+
+	// matches past the offset go out as pushed, up to the limit, and the total still counts them all
+	TestMatchStream_t tStream ( true, DOCS );
+	SphQueueSettings_t tQueueSettings ( tQuery, tSchema, sError, NULL );
+	tQueueSettings.m_pStream = &tStream;
+	ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+	Verify ( pSorter && tQueueSettings.m_bStreaming );
+
+	CSphMatch tMatch;
+	tMatch.Reset ( pSorter->GetSchema().GetDynamicSize() );
+	for ( int i=0; i<DOCS; i++ )
+	{
+		tMatch.m_uDocID = DOCS-i;
+		Verify ( pSorter->Push ( tMatch ) );
+	}
+
+	Verify ( tStream.m_dDocs.GetLength()==tQuery.m_iLimit );
+	ARRAY_FOREACH ( i, tStream.m_dDocs )
+		Verify ( tStream.m_dDocs[i]==(SphDocID_t)( DOCS-tQuery.m_iOffset-i ) );
+	Verify ( pSorter->GetLength()==0 && pSorter->GetTotalCount()==DOCS );
+	SafeDelete ( pSorter );
+
+	// a stream that can take no more gets nothing else
+	TestMatchStream_t tShort ( true, 5 );
+	tQueueSettings.m_pStream = &tShort;
+	pSorter = sphCreateQueue ( tQueueSettings );
+	Verify ( pSorter && tQueueSettings.m_bStreaming );
+	for ( int i=0; i<DOCS; i++ )
+	{
+		tMatch.m_uDocID = i+1;
+		pSorter->Push ( tMatch );
+	}
+	Verify ( tShort.m_dDocs.GetLength()==5 );
+	SafeDelete ( pSorter );
+
+	// a stream that declines the schema leaves the query to a regular sorter
+	TestMatchStream_t tDecline ( false, DOCS );
+	SphQueueSettings_t tPlainSettings ( tQuery, tSchema, sError, NULL );
+	tPlainSettings.m_pStream = &tDecline;
+	pSorter = sphCreateQueue ( tPlainSettings );
+	Verify ( pSorter && !tPlainSettings.m_bStreaming );
+	for ( int i=0; i<DOCS; i++ )
+	{
+		tMatch.m_uDocID = i+1;
+		pSorter->Push ( tMatch );
+	}
+	Verify ( !tDecline.m_dDocs.GetLength() && pSorter->GetLength()==DOCS );
+	SafeDelete ( pSorter );
+
+	printf ( "ok\n" );
+}
+
+void TestGrouperMulti()
+{
+	printf ( "testing multi-attribute groupers... " );
+
+	// 16 + 16 + 32 bits, over a 2-item row
+	CSphVector<CSphAttrLocator> dLocators ( 3 );
+	dLocators[0] = CSphAttrLocator ( 0, 16 );
+	dLocators[1] = CSphAttrLocator ( 16, 16 );
+	dLocators[2] = CSphAttrLocator ( 32, 32 );
+	CSphVector<ESphAttr> dTypes ( 3 );
+	dTypes[0] = dTypes[1] = ESphAttr::SPH_ATTR_INTEGER;
+	dTypes[2] = ESphAttr::SPH_ATTR_TIMESTAMP;
+
+	Verify ( CSphGrouperMultiPacked<3>::CanPack ( dLocators, dTypes ) );
+	CSphGrouperMultiPacked<3> tPacked ( dLocators );
+
+	// every distinct tuple gets a distinct key
+	const DWORD dThird[] = { 0, 1, 0x80000000UL, 0xffffffffUL };
+	CSphVector<SphGroupKey_t> dKeys;
+	CSphMatch tMatch;
+	tMatch.Reset ( 2 );
+	CSphRowitem * pRow = tMatch.m_pDynamic;
+	for ( int a=0; a<20; a++ )
+		for ( int b=0; b<20; b++ )
+			for ( int c=0; c<4; c++ )
+			{
+				sphSetRowAttr ( pRow, dLocators[0], a*3271 );
+				sphSetRowAttr ( pRow, dLocators[1], 0xffff-b );
+				sphSetRowAttr ( pRow, dLocators[2], dThird[c] );
+				dKeys.Add ( tPacked.KeyFromMatch ( tMatch ) );
+			}
+	dKeys.Uniq();
+	Verify ( dKeys.GetLength()==20*20*4 );
+
+	// too wide, or not integers
+	dLocators[0] = CSphAttrLocator ( 0, 32 );
+	Verify ( !CSphGrouperMultiPacked<3>::CanPack ( dLocators, dTypes ) );
+	dLocators[0] = CSphAttrLocator ( 0, 16 );
+	dTypes[1] = ESphAttr::SPH_ATTR_STRING;
+	Verify ( !CSphGrouperMultiPacked<3>::CanPack ( dLocators, dTypes ) );
+	Verify ( !CSphGrouperMultiPacked<2>::CanPack ( dLocators, dTypes ) );
+
+	// integer and string; same string values at different pool offsets must make the same keys
+	dLocators.Resize ( 2 );
+	dTypes.Resize ( 2 );
+	dTypes[0] = ESphAttr::SPH_ATTR_STRING;
+	dTypes[1] = ESphAttr::SPH_ATTR_INTEGER;
+	dLocators[0] = CSphAttrLocator ( 0, 32 );
+	dLocators[1] = CSphAttrLocator ( 32, 32 );
+	Verify ( CSphGrouperIntString<BinaryHash_fn>::CanGroup ( dTypes ) );
+	CSphGrouperIntString<BinaryHash_fn> tIntString ( dLocators, dTypes );
+
+	BYTE dPool[32];
+	BYTE * pPool = dPool;
+	*pPool++ = 0; // offset 0 means no string
+	DWORD uFirst = DWORD ( pPool-dPool );
+	pPool += sphPackStrlen ( pPool, 3 );
+	memcpy ( pPool, "abc", 3 );
+	pPool += 3;
+	DWORD uSecond = DWORD ( pPool-dPool );
+	pPool += sphPackStrlen ( pPool, 3 );
+	memcpy ( pPool, "abc", 3 );
+	pPool += 3;
+	DWORD uOther = DWORD ( pPool-dPool );
+	pPool += sphPackStrlen ( pPool, 3 );
+	memcpy ( pPool, "abd", 3 );
+	tIntString.SetStringPool ( dPool );
+
+	sphSetRowAttr ( pRow, dLocators[0], uFirst );
+	sphSetRowAttr ( pRow, dLocators[1], 5 );
+	SphGroupKey_t uKey = tIntString.KeyFromMatch ( tMatch );
+	sphSetRowAttr ( pRow, dLocators[0], uSecond );
+	Verify ( tIntString.KeyFromMatch ( tMatch )==uKey );
+	sphSetRowAttr ( pRow, dLocators[1], 6 );
+	Verify ( tIntString.KeyFromMatch ( tMatch )!=uKey );
+	sphSetRowAttr ( pRow, dLocators[0], uOther );
+	sphSetRowAttr ( pRow, dLocators[1], 5 );
+	Verify ( tIntString.KeyFromMatch ( tMatch )!=uKey );
+
+	dTypes[1] = ESphAttr::SPH_ATTR_STRING;
+	Verify ( !CSphGrouperIntString<BinaryHash_fn>::CanGroup ( dTypes ) );
+
+	printf ( "ok\n" );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/// test RT index with a single "title" field and "gid", "val" integer attributes
+/// tSrcSchema gets the same attributes, but dynamic, as AddDocument() takes the rows that way
+static ISphRtIndex * CreateTestRT ( CSphSchema & tSrcSchema, int64_t iRamSize=32*1024*1024, bool bWordDict=false )
+{
+	CSphString sError;
+	CSphDictSettings tDictSettings;
+	tDictSettings.m_bWordDict = bWordDict;
+
+	ISphTokenizer * pTok = sphCreateUTF8Tokenizer();
+	CSphDict * pDict = bWordDict
+		? sphCreateDictionaryKeywords ( tDictSettings, NULL, pTok, "rt", sError )
+		: sphCreateDictionaryCRC ( tDictSettings, NULL, pTok, "rt", sError );
+
+	CSphColumnInfo tCol;
+	tSrcSchema.Reset();
+
+	tCol.m_sName = "title";
+	tSrcSchema.m_dFields.Add ( tCol );
+
+	tCol.m_sName = "gid";
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_INTEGER;
+	tSrcSchema.AddAttr ( tCol, true );
+
+	tCol.m_sName = "val";
+	tCol.m_eAttrType = ESphAttr::SPH_ATTR_INTEGER;
+	tSrcSchema.AddAttr ( tCol, true );
+
+	CSphSchema tSchema; // source schema must be all dynamic attrs; but index ones must be static
+	tSchema.m_dFields = tSrcSchema.m_dFields;
+	for ( int i=0; i<tSrcSchema.GetAttrsCount(); i++ )
+		tSchema.AddAttr ( tSrcSchema.GetAttr(i), false );
+
+	ISphRtIndex * pIndex = sphCreateIndexRT ( tSchema, "testrt", iRamSize, RT_INDEX_FILE_NAME, bWordDict );
+
+	pIndex->SetTokenizer ( pTok ); // index will own this pair from now on
+	pIndex->SetDictionary ( pDict );
+	pIndex->PostSetup();
+	Verify ( pIndex->Prealloc ( false ) );
+	return pIndex;
+}
+
+static void AddTestRTDoc ( ISphRtIndex * pIndex, const CSphSchema & tSrcSchema, int iDoc, int iGid, int iVal, bool bReplace )
+{
+	CSphString sError, sWarning, sFilter;
+	CSphVector<DWORD> dMvas;
+
+	CSphMatch tDoc;
+	tDoc.Reset ( tSrcSchema.GetRowSize() );
+	tDoc.m_uDocID = iDoc;
+	tDoc.SetAttr ( tSrcSchema.GetAttr(0).m_tLocator, iGid );
+	tDoc.SetAttr ( tSrcSchema.GetAttr(1).m_tLocator, iVal );
+
+	char sTitle[64];
+	snprintf ( sTitle, sizeof(sTitle), "cat doc%d group%d", iDoc, iGid );
+	const char * dFields[] = { sTitle };
+
+	Verify ( pIndex->AddDocument ( pIndex->CloneIndexingTokenizer(), 1, dFields, tDoc, bReplace, sFilter, NULL, dMvas, sError, sWarning, NULL ) );
+}
+
+/// recreates test query sorters, so that RT indexes may search disk chunks on several threads
+class TestSorterFactory_c : public ISphSorterFactory
+{
+public:
+	explicit TestSorterFactory_c ( const ISphSchema & tSchema )
+		: m_tSchema ( tSchema )
+	{}
+
+	virtual ISphMatchSorter * CreateSorter ( const CSphQuery & tQuery ) const
+	{
+		CSphString sError;
+		SphQueueSettings_t tQueueSettings ( tQuery, m_tSchema, sError, NULL );
+		tQueueSettings.m_bComputeItems = false;
+		return sphCreateQueue ( tQueueSettings );
+	}
+
+private:
+	const ISphSchema &	m_tSchema;
+};
+
+/// run the query over the whole index; iThreads over 1 lets it search the disk chunks in parallel
+static void QueryTestRT ( ISphRtIndex * pIndex, const CSphQuery & tQuery, int iThreads, CSphQueryResult & tResult, bool bComputeItems=false )
+{
+	TestSorterFactory_c tFactory ( pIndex->GetMatchSchema() );
+	CSphMultiQueryArgs tArgs ( KillListVector(), 1 );
+	if ( iThreads>1 )
+	{
+		tArgs.m_pSorterFactory = &tFactory;
+		tArgs.m_iThreads = iThreads;
+	}
+
+	SphQueueSettings_t tQueueSettings ( tQuery, pIndex->GetMatchSchema(), tResult.m_sError, NULL );
+	tQueueSettings.m_bComputeItems = bComputeItems;
+	ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+	Verify ( pSorter );
+	Verify ( pIndex->MultiQuery ( &tQuery, &tResult, 1, &pSorter, tArgs ) );
+
+	tResult.m_iTotalMatches = pSorter->GetTotalCount();
+	sphFlattenQueue ( pSorter, &tResult, 0 );
+	tResult.m_tSchema = pSorter->GetSchema(); // can SwapOut
+	SafeDelete ( pSorter );
+}
+
+static void CompareTestRTResults ( const CSphQueryResult & tA, const CSphQueryResult & tB )
+{
+	Verify ( tA.m_iTotalMatches==tB.m_iTotalMatches );
+	Verify ( tA.m_dMatches.GetLength()==tB.m_dMatches.GetLength() );
+	Verify ( tA.m_tSchema.GetAttrsCount()==tB.m_tSchema.GetAttrsCount() );
+
+	ARRAY_FOREACH ( i, tA.m_dMatches )
+	{
+		const CSphMatch & tMatchA = tA.m_dMatches[i];
+		const CSphMatch & tMatchB = tB.m_dMatches[i];
+		Verify ( tMatchA.m_uDocID==tMatchB.m_uDocID );
+		for ( int j=0; j<tA.m_tSchema.GetAttrsCount(); j++ )
+			Verify ( tMatchA.GetAttr ( tA.m_tSchema.GetAttr(j).m_tLocator )==tMatchB.GetAttr ( tB.m_tSchema.GetAttr(j).m_tLocator ) );
+	}
+}
+
+
+void TestRTParallelChunks ()
+{
+	printf ( "testing rt parallel disk chunks search... " );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	TestRTInit ();
+
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateTestRT ( tSrcSchema );
+
+	// a few disk chunks and a RAM chunk, every one of them holding every group and every value
+	const int CHUNKS = 4;
+	const int DOCS = 500;
+	const int GROUPS = 7;
+	const int VALUES = 13;
+	for ( int iChunk=0; iChunk<=CHUNKS; iChunk++ )
+	{
+		for ( int i=0; i<DOCS; i++ )
+		{
+			int iDoc = iChunk*DOCS + i + 1;
+			AddTestRTDoc ( pIndex, tSrcSchema, iDoc, iDoc % GROUPS, iDoc % VALUES, false );
+		}
+		pIndex->Commit ( NULL, NULL );
+		if ( iChunk<CHUNKS )
+			pIndex->ForceDiskChunk();
+	}
+
+	// plain matches; top-K and total found must not depend on the threads
+	CSphQuery tQuery;
+	tQuery.m_eSort = SPH_SORT_EXTENDED;
+	tQuery.m_sSortBy = "val desc, @id asc";
+	tQuery.m_iMaxMatches = 100;
+
+	CSphQueryResult tSerial, tParallel;
+	QueryTestRT ( pIndex, tQuery, 1, tSerial );
+	QueryTestRT ( pIndex, tQuery, CHUNKS, tParallel );
+	Verify ( tSerial.m_iTotalMatches==( CHUNKS+1 )*DOCS );
+	Verify ( tSerial.m_dMatches.GetLength()==tQuery.m_iMaxMatches );
+	CompareTestRTResults ( tSerial, tParallel );
+
+	// groups span chunks, so the worker sorters have to merge them
+	tQuery.m_sGroupBy = "gid";
+	tQuery.m_eGroupFunc = SPH_GROUPBY_ATTR;
+	tQuery.m_sGroupSortBy = "@groupby asc";
+
+	CSphQueryResult tSerialGroups, tParallelGroups;
+	QueryTestRT ( pIndex, tQuery, 1, tSerialGroups );
+	QueryTestRT ( pIndex, tQuery, CHUNKS, tParallelGroups );
+	Verify ( tSerialGroups.m_dMatches.GetLength()==GROUPS );
+	CompareTestRTResults ( tSerialGroups, tParallelGroups );
+
+	const CSphAttrLocator & tCount = tParallelGroups.m_tSchema.GetAttr ( tParallelGroups.m_tSchema.GetAttrIndex ( "@count" ) ).m_tLocator;
+	int iCounted = 0;
+	ARRAY_FOREACH ( i, tParallelGroups.m_dMatches )
+		iCounted += (int)tParallelGroups.m_dMatches[i].GetAttr ( tCount );
+	Verify ( iCounted==( CHUNKS+1 )*DOCS );
+
+	// distinct values span chunks too, and must not get counted once per worker
+	tQuery.m_sGroupDistinct = "val";
+
+	CSphQueryResult tSerialDistinct, tParallelDistinct;
+	QueryTestRT ( pIndex, tQuery, 1, tSerialDistinct );
+	QueryTestRT ( pIndex, tQuery, CHUNKS, tParallelDistinct );
+	Verify ( tSerialDistinct.m_dMatches.GetLength()==GROUPS );
+	CompareTestRTResults ( tSerialDistinct, tParallelDistinct );
+
+	const CSphAttrLocator & tDistinct = tParallelDistinct.m_tSchema.GetAttr ( tParallelDistinct.m_tSchema.GetAttrIndex ( "@distinct" ) ).m_tLocator;
+	ARRAY_FOREACH ( i, tParallelDistinct.m_dMatches )
+		Verify ( tParallelDistinct.m_dMatches[i].GetAttr ( tDistinct )==VALUES );
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+
+	printf ( "ok\n" );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+}
+
+void TestRTDeadRows ()
+{
+	printf ( "testing rt dead rows filtering... " );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	TestRTInit ();
+
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateTestRT ( tSrcSchema );
+
+	// chunk 0 gets every doc; chunk 1 replaces every 3rd and deletes every 5th; RAM replaces every 7th
+	const int DOCS = 600;
+	const int GROUPS = 7;
+	for ( int i=1; i<=DOCS; i++ )
+		AddTestRTDoc ( pIndex, tSrcSchema, i, i % GROUPS, 0, false );
+	pIndex->Commit ( NULL, NULL );
+	pIndex->ForceDiskChunk();
+
+	for ( int i=3; i<=DOCS; i+=3 )
+		AddTestRTDoc ( pIndex, tSrcSchema, i, i % GROUPS, 1, true );
+	pIndex->Commit ( NULL, NULL );
+
+	CSphString sError;
+	CSphVector<SphDocID_t> dDeleted;
+	for ( int i=5; i<=DOCS; i+=5 )
+		dDeleted.Add ( i );
+	Verify ( pIndex->DeleteDocument ( dDeleted.Begin(), dDeleted.GetLength(), sError, NULL ) );
+	pIndex->Commit ( NULL, NULL );
+	pIndex->ForceDiskChunk();
+
+	for ( int i=7; i<=DOCS; i+=7 )
+		AddTestRTDoc ( pIndex, tSrcSchema, i, i % GROUPS, 2, true );
+	pIndex->Commit ( NULL, NULL );
+
+	int iAlive = 0;
+	for ( int i=1; i<=DOCS; i++ )
+		if ( i%7==0 || i%5!=0 )
+			iAlive++;
+
+	// full scan and full-text, on one thread and on a thread per chunk; every alive doc once, with its newest values
+	const char * dQueries[] = { "", "cat" };
+	for ( int iQuery=0; iQuery<2; iQuery++ )
+		for ( int iThreads=1; iThreads<=2; iThreads++ )
+		{
+			CSphQuery tQuery;
+			tQuery.m_sQuery = dQueries[iQuery];
+			tQuery.m_eSort = SPH_SORT_EXTENDED;
+			tQuery.m_sSortBy = "@id asc";
+			tQuery.m_iMaxMatches = DOCS;
+
+			CSphQueryResult tResult;
+			QueryTestRT ( pIndex, tQuery, iThreads, tResult );
+			Verify ( tResult.m_iTotalMatches==iAlive );
+			Verify ( tResult.m_dMatches.GetLength()==iAlive );
+
+			const CSphAttrLocator & tVal = tResult.m_tSchema.GetAttr ( tResult.m_tSchema.GetAttrIndex ( "val" ) ).m_tLocator;
+			int iDoc = 0;
+			ARRAY_FOREACH ( i, tResult.m_dMatches )
+			{
+				const CSphMatch & tMatch = tResult.m_dMatches[i];
+				Verify ( (int)tMatch.m_uDocID>iDoc );
+				iDoc = (int)tMatch.m_uDocID;
+				Verify ( iDoc%7==0 || iDoc%5!=0 );
+
+				int iVal = ( iDoc%7==0 ) ? 2 : ( iDoc%3==0 ? 1 : 0 );
+				Verify ( tMatch.GetAttr ( tVal )==iVal );
+			}
+		}
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+
+	printf ( "ok\n" );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+}
+
+static bool PickTestCompaction ( const int64_t * pSizes, const int64_t * pDead, int iChunks, int & iDst, int & iSrc )
+{
+	CSphVector<RtChunkStats_t> dChunks ( iChunks );
+	ARRAY_FOREACH ( i, dChunks )
+	{
+		dChunks[i].m_iSize = pSizes[i];
+		dChunks[i].m_iRows = pDead[i] ? 1000 : 0;
+		dChunks[i].m_iDead = pDead[i];
+	}
+	return sphRtPickCompaction ( dChunks, iDst, iSrc );
+}
+
+
+void TestRTCompactPick ()
+{
+	printf ( "testing rt compaction policy... " );
+	int iDst = -1, iSrc = -1;
+
+	// nothing to merge a single chunk with
+	const int64_t dOne[] = { 100 };
+	const int64_t dNoDead[] = { 0, 0, 0, 0, 0, 0 };
+	Verify ( !PickTestCompaction ( dOne, dNoDead, 1, iDst, iSrc ) );
+
+	// a tier of 3 is not enough
+	const int64_t dThree[] = { 100, 120, 150, 5000 };
+	Verify ( !PickTestCompaction ( dThree, dNoDead, 4, iDst, iSrc ) );
+
+	// a tier of 4 gets its two smallest chunks merged, older one being the destination
+	const int64_t dTier[] = { 5000, 130, 100, 120, 110 };
+	Verify ( PickTestCompaction ( dTier, dNoDead, 5, iDst, iSrc ) );
+	Verify ( iDst==2 && iSrc==4 );
+
+	// chunks over 2x of the smallest one start a tier of their own
+	const int64_t dTiers[] = { 100, 150, 250, 300, 350, 400 };
+	Verify ( PickTestCompaction ( dTiers, dNoDead, 6, iDst, iSrc ) );
+	Verify ( iDst==2 && iSrc==3 );
+
+	// mostly dead chunks go before any tier, and get merged into their newer neighbour
+	const int64_t dDead[] = { 0, 100, 400, 0, 0 };
+	Verify ( PickTestCompaction ( dTier, dDead, 5, iDst, iSrc ) );
+	Verify ( iDst==2 && iSrc==3 );
+
+	// but only past the threshold, and never the newest chunk, as nothing can kill its rows
+	const int64_t dFewDead[] = { 0, 100, 250, 0, 900 };
+	Verify ( PickTestCompaction ( dThree, dFewDead, 4, iDst, iSrc )==false );
+	Verify ( PickTestCompaction ( dTier, dFewDead, 5, iDst, iSrc ) );
+	Verify ( iDst==2 && iSrc==4 );
+
+	printf ( "ok\n" );
+}
+
+static void DeleteBinlogFiles ()
+{
+	const char * sFiles[] = { "binlog.meta", "binlog.meta.new", "binlog.lock", "binlog.001", "binlog.002", "binlog.003" };
+	for ( int i=0; i<(int)(sizeof(sFiles)/sizeof(sFiles[0])); i++ )
+		unlink ( sFiles[i] );
+}
+
+/// RT subsystem with the binlog in the current dir, and the test index replayed from it
+static ISphRtIndex * CreateBinlogTestRT ( CSphSchema & tSrcSchema, int64_t iRamSize=32*1024*1024, bool bTestMode=true )
+{
+	CSphConfigSection tRTConfig;
+	Verify ( tRTConfig.Add ( CSphVariant ( ".", 0 ), "binlog_path" ) );
+	Verify ( tRTConfig.Add ( CSphVariant ( "1", 0 ), "binlog_flush" ) );
+
+	sphRTInit ( tRTConfig, bTestMode );
+	sphRTConfigure ( tRTConfig, bTestMode );
+
+	ISphRtIndex * pIndex = CreateTestRT ( tSrcSchema, iRamSize );
+	SmallStringHash_T<CSphIndex*> hIndexes;
+	hIndexes.Add ( pIndex, "testrt" );
+	sphReplayBinlog ( hIndexes, 0 );
+	return pIndex;
+}
+
+static int CountTestRTDocs ( ISphRtIndex * pIndex )
+{
+	CSphQuery tQuery;
+	CSphQueryResult tResult;
+	QueryTestRT ( pIndex, tQuery, 1, tResult );
+	return (int)tResult.m_iTotalMatches;
+}
+
+struct GroupCommitJob_t
+{
+	ISphRtIndex *		m_pIndex;
+	const CSphSchema *	m_pSchema;
+	int					m_iFirstDoc;
+	int					m_iTxns;
+	SphThread_t			m_tThd;
+};
+
+void GroupCommitThread ( void * pArg )
+{
+	GroupCommitJob_t * pJob = (GroupCommitJob_t *)pArg;
+	for ( int i=0; i<pJob->m_iTxns; i++ )
+	{
+		AddTestRTDoc ( pJob->m_pIndex, *pJob->m_pSchema, pJob->m_iFirstDoc+i, i, i, false );
+		pJob->m_pIndex->Commit ( NULL, NULL );
+	}
+}
+
+void TestRTGroupCommit ()
+{
+	printf ( "testing binlog group commit... " );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateBinlogTestRT ( tSrcSchema );
+
+	// concurrent committers to a single index, each waiting for its own sync ticket
+	// every one of them appends its next txn while the previous fsync is running, so fsyncs must get shared
+	const int THREADS = 8;
+	const int TXNS = 50;
+	GroupCommitJob_t dJobs[THREADS];
+	for ( int i=0; i<THREADS; i++ )
+	{
+		dJobs[i].m_pIndex = pIndex;
+		dJobs[i].m_pSchema = &tSrcSchema;
+		dJobs[i].m_iFirstDoc = 1 + i*TXNS;
+		dJobs[i].m_iTxns = TXNS;
+		Verify ( sphThreadCreate ( &dJobs[i].m_tThd, GroupCommitThread, &dJobs[i] ) );
+	}
+	for ( int i=0; i<THREADS; i++ )
+		Verify ( sphThreadJoin ( &dJobs[i].m_tThd ) );
+
+	// every commit waited once, every ticket was covered by exactly one fsync, and some fsyncs covered several txns
+	BinlogStatus_t tStatus;
+	sphGetBinlogStatus ( tStatus );
+	Verify ( tStatus.m_bGroupCommit );
+	Verify ( tStatus.m_iCommits==THREADS*TXNS );
+	Verify ( tStatus.m_iSyncedTxns==THREADS*TXNS );
+	Verify ( tStatus.m_iSyncs<tStatus.m_iCommits );
+	Verify ( tStatus.m_iMaxBatch>1 && tStatus.m_iMaxBatch<=THREADS );
+	Verify ( CountTestRTDocs ( pIndex )==THREADS*TXNS );
+
+	// the log keeps the txns in tid order, or the replay would refuse it
+	sphRTDone ();
+	SafeDelete ( pIndex );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+
+	pIndex = CreateBinlogTestRT ( tSrcSchema );
+	Verify ( CountTestRTDocs ( pIndex )==THREADS*TXNS );
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+
+	printf ( "ok\n" );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+}
+
+/// id, gid and val of every doc, in id order
+static void DumpTestRT ( ISphRtIndex * pIndex, CSphVector<SphAttr_t> & dDump )
+{
+	CSphQuery tQuery;
+	tQuery.m_eSort = SPH_SORT_EXTENDED;
+	tQuery.m_sSortBy = "@id asc";
+	tQuery.m_iMaxMatches = 100000;
+
+	CSphQueryResult tResult;
+	QueryTestRT ( pIndex, tQuery, 1, tResult );
+	Verify ( tResult.m_iTotalMatches==tResult.m_dMatches.GetLength() );
+
+	const CSphAttrLocator & tGid = tResult.m_tSchema.GetAttr ( tResult.m_tSchema.GetAttrIndex ( "gid" ) ).m_tLocator;
+	const CSphAttrLocator & tVal = tResult.m_tSchema.GetAttr ( tResult.m_tSchema.GetAttrIndex ( "val" ) ).m_tLocator;
+	dDump.Resize ( 0 );
+	ARRAY_FOREACH ( i, tResult.m_dMatches )
+	{
+		const CSphMatch & tMatch = tResult.m_dMatches[i];
+		dDump.Add ( (SphAttr_t)tMatch.m_uDocID );
+		dDump.Add ( tMatch.GetAttr ( tGid ) );
+		dDump.Add ( tMatch.GetAttr ( tVal ) );
+	}
+}
+
+void TestRTReplayBatches ()
+{
+	printf ( "testing binlog replay batching... " );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateBinlogTestRT ( tSrcSchema );
+
+	// many small commits, so that replay folds them in several batches
+	// replaces kill rows of older commits, deletes make kill-list only commits, and an update makes replay wait for the queue
+	const int ROUNDS = 300;
+	CSphString sError, sWarning;
+	for ( int iRound=0; iRound<ROUNDS; iRound++ )
+	{
+		AddTestRTDoc ( pIndex, tSrcSchema, iRound+1, iRound % 7, iRound, false );
+		if ( iRound%3==0 )
+			AddTestRTDoc ( pIndex, tSrcSchema, iRound/2+1, iRound % 5, 1000+iRound, true );
+		pIndex->Commit ( NULL, NULL );
+
+		if ( iRound%10==9 )
+		{
+			SphDocID_t uDel = iRound-5;
+			Verify ( pIndex->DeleteDocument ( &uDel, 1, sError, NULL ) );
+			pIndex->Commit ( NULL, NULL );
+		}
+
+		if ( iRound==ROUNDS/2 )
+		{
+			CSphAttrUpdate tUpd;
+			tUpd.m_dAttrs.Add ( CSphString ( "val" ).Leak() );
+			tUpd.m_dTypes.Add ( ESphAttr::SPH_ATTR_INTEGER );
+			for ( int i=1; i<=20; i++ )
+			{
+				tUpd.m_dDocids.Add ( i );
+				tUpd.m_dRowOffset.Add ( tUpd.m_dPool.GetLength() );
+				tUpd.m_dPool.Add ( 5000+i );
+			}
+			Verify ( pIndex->UpdateAttributes ( tUpd, -1, sError, sWarning )>0 );
+		}
+	}
+
+	CSphVector<SphAttr_t> dLive;
+	DumpTestRT ( pIndex, dLive );
+	Verify ( dLive.GetLength() );
+
+	// replay into a fresh index must come to the very same docs and values
+	sphRTDone ();
+	SafeDelete ( pIndex );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+
+	pIndex = CreateBinlogTestRT ( tSrcSchema );
+	CSphVector<SphAttr_t> dReplayed;
+	DumpTestRT ( pIndex, dReplayed );
+	Verify ( dReplayed.GetLength()==dLive.GetLength() );
+	ARRAY_FOREACH ( i, dLive )
+		Verify ( dReplayed[i]==dLive[i] );
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+
+	printf ( "ok\n" );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+}
+
+static void CopyTestFile ( const char * sFrom, const char * sTo )
+{
+	FILE * fpFrom = fopen ( sFrom, "rb" );
+	FILE * fpTo = fopen ( sTo, "wb" );
+	Verify ( fpFrom && fpTo );
+
+	char dBuf[4096];
+	size_t iRead;
+	while ( ( iRead = fread ( dBuf, 1, sizeof(dBuf), fpFrom ) )>0 )
+		Verify ( fwrite ( dBuf, 1, iRead, fpTo )==iRead );
+
+	fclose ( fpFrom );
+	fclose ( fpTo );
+}
+
+void TestRTBulkLoad ()
+{
+	printf ( "testing rt bulk load... " );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+
+	// small RAM chunk, so that the bulk txn gets cut into several runs
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateBinlogTestRT ( tSrcSchema, 256*1024 );
+
+	// docs 1..300 and 301..400 go to disk chunks of their own
+	for ( int i=1; i<=400; i++ )
+	{
+		AddTestRTDoc ( pIndex, tSrcSchema, i, i%7, i, false );
+		pIndex->Commit ( NULL, NULL );
+		if ( i%300==0 || i==400 )
+			pIndex->ForceDiskChunk();
+	}
+
+	// that is what a crash during the bulk load leaves on disk; the meta does not list any bulk chunk yet
+	char sMeta[SPH_MAX_FILENAME_LEN], sSavedMeta[SPH_MAX_FILENAME_LEN], sRam[SPH_MAX_FILENAME_LEN];
+	snprintf ( sMeta, sizeof(sMeta), "%s.meta", RT_INDEX_FILE_NAME );
+	snprintf ( sSavedMeta, sizeof(sSavedMeta), "%s.meta.saved", RT_INDEX_FILE_NAME );
+	snprintf ( sRam, sizeof(sRam), "%s.ram", RT_INDEX_FILE_NAME );
+	CopyTestFile ( sMeta, sSavedMeta );
+
+	// bulk txn replaces docs of both older chunks, and deletes one more
+	const int BULK = 20000;
+	for ( int i=101; i<=200; i++ )
+		AddTestRTDoc ( pIndex, tSrcSchema, i, 100, 1000+i, true );
+	for ( int i=351; i<=400; i++ )
+		AddTestRTDoc ( pIndex, tSrcSchema, i, 100, 1000+i, true );
+	for ( int i=0; i<BULK; i++ )
+		AddTestRTDoc ( pIndex, tSrcSchema, 10001+i, i%11, i, false );
+
+	CSphString sError;
+	SphDocID_t uDel = 50;
+	Verify ( pIndex->DeleteDocument ( &uDel, 1, sError, NULL ) );
+
+	int iDeleted = 0;
+	Verify ( pIndex->BulkCommit ( &iDeleted, NULL ) );
+	Verify ( iDeleted==151 );
+
+	CSphIndexStatus tStatus;
+	pIndex->GetStatus ( &tStatus );
+	Verify ( tStatus.m_iNumChunks>3 ); // the older chunks, and more than one run
+
+	// commits past the bulk load shadow it
+	for ( int i=10001; i<=10010; i++ )
+	{
+		AddTestRTDoc ( pIndex, tSrcSchema, i, 200, 7, true );
+		pIndex->Commit ( NULL, NULL );
+	}
+
+	// newer docs win, and the deleted one is gone
+	CSphVector<SphAttr_t> dLive;
+	DumpTestRT ( pIndex, dLive );
+	Verify ( dLive.GetLength()==3*( 400-1+BULK ) );
+	Verify ( dLive[0]==1 && dLive[2]==1 );
+	Verify ( dLive[3*49]==51 );
+	Verify ( dLive[3*149]==151 && dLive[3*149+1]==100 && dLive[3*149+2]==1151 );
+	Verify ( dLive[3*347]==349 && dLive[3*347+2]==349 );
+	Verify ( dLive[3*379]==381 && dLive[3*379+2]==1381 );
+	Verify ( dLive[3*399]==10001 && dLive[3*399+1]==200 && dLive[3*399+2]==7 );
+	Verify ( dLive[3*409]==10011 && dLive[3*409+2]==10 );
+
+	// replay must bring the bulk chunks back from the binlog, before the commits that followed them
+	sphRTDone ();
+	SafeDelete ( pIndex );
+	CopyTestFile ( sSavedMeta, sMeta );
+	unlink ( sSavedMeta );
+	unlink ( sRam );
+
+	pIndex = CreateBinlogTestRT ( tSrcSchema );
+	CSphVector<SphAttr_t> dReplayed;
+	DumpTestRT ( pIndex, dReplayed );
+	Verify ( dReplayed.GetLength()==dLive.GetLength() );
+	ARRAY_FOREACH ( i, dLive )
+		Verify ( dReplayed[i]==dLive[i] );
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+
+	printf ( "ok\n" );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+}
+
+void TestRTMergeUpdates ()
+{
+	printf ( "testing rt background merge vs updates... " );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+
+	// out of test mode, so that the background merger runs
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateBinlogTestRT ( tSrcSchema, 32*1024*1024, false );
+
+	// every commit adds a segment, and keeps the merger busy; updates hit the rows it is merging meanwhile
+	const int DOCS = 3000;
+	CSphVector<int> dExpected ( DOCS+1 );
+	CSphString sError, sWarning;
+	for ( int i=1; i<=DOCS; i++ )
+	{
+		AddTestRTDoc ( pIndex, tSrcSchema, i, i%7, 0, false );
+		pIndex->Commit ( NULL, NULL );
+		dExpected[i] = 0;
+
+		CSphAttrUpdate tUpd;
+		tUpd.m_dAttrs.Add ( CSphString ( "val" ).Leak() );
+		tUpd.m_dTypes.Add ( ESphAttr::SPH_ATTR_INTEGER );
+		for ( int j=0; j<4; j++ )
+		{
+			int iDoc = 1 + ( i*31 + j*97 ) % i;
+			tUpd.m_dDocids.Add ( iDoc );
+			tUpd.m_dRowOffset.Add ( tUpd.m_dPool.GetLength() );
+			tUpd.m_dPool.Add ( i*10+j );
+			dExpected[iDoc] = i*10+j;
+		}
+		Verify ( pIndex->UpdateAttributes ( tUpd, -1, sError, sWarning )>0 );
+	}
+
+	// let the merger settle
+	CSphIndexStatus tStatus;
+	for ( int i=0; i<1000; i++ )
+	{
+		pIndex->GetStatus ( &tStatus );
+		if ( !tStatus.m_iMergeBacklog )
+			break;
+		sphSleepMsec ( 5 );
+	}
+	Verify ( tStatus.m_iRamSegments<DOCS ); // merges did happen
+
+	// no update got lost by a merge that read the rows before it
+	CSphVector<SphAttr_t> dDump;
+	DumpTestRT ( pIndex, dDump );
+	Verify ( dDump.GetLength()==3*DOCS );
+	for ( int i=0; i<DOCS; i++ )
+	{
+		Verify ( dDump[3*i]==i+1 );
+		Verify ( dDump[3*i+2]==dExpected[i+1] );
+	}
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+
+	printf ( "ok\n" );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+}
+
+struct RtOptimizeJob_t
+{
+	ISphRtIndex *		m_pIndex;
+	volatile bool		m_bDone;
+	SphThread_t			m_tThd;
+};
+
+void RtOptimizeThread ( void * pArg )
+{
+	RtOptimizeJob_t * pJob = (RtOptimizeJob_t *)pArg;
+	bool bStop = false;
+	ThrottleState_t tThrottle;
+	pJob->m_pIndex->Optimize ( &bStop, &tThrottle );
+	pJob->m_bDone = true;
+}
+
+void TestRTSnapshotReader ()
+{
+	printf ( "testing rt reader snapshot... " );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateBinlogTestRT ( tSrcSchema );
+
+	// two disk chunks, and some docs in RAM
+	for ( int i=1; i<=250; i++ )
+	{
+		AddTestRTDoc ( pIndex, tSrcSchema, i, i%7, i, false );
+		pIndex->Commit ( NULL, NULL );
+		if ( i==100 || i==200 )
+			pIndex->ForceDiskChunk();
+	}
+
+	ISphRtReader * pReader = pIndex->CreateReader();
+	Verify ( pReader->GetDiskChunks()==2 );
+	const CSphIndex * dChunks[2] = { pReader->GetDiskChunk(0), pReader->GetDiskChunk(1) };
+	CSphString dNames[2] = { dChunks[0]->GetFilename(), dChunks[1]->GetFilename() };
+	int iSegments = pReader->GetRamSegments();
+	Verify ( pReader->GetRamRows()==50 );
+
+	// commit, flush, and optimize meanwhile; optimize must not free the chunks the reader holds
+	for ( int i=251; i<=300; i++ )
+	{
+		AddTestRTDoc ( pIndex, tSrcSchema, i, i%7, i, false );
+		pIndex->Commit ( NULL, NULL );
+	}
+	pIndex->ForceDiskChunk();
+
+	RtOptimizeJob_t tJob;
+	tJob.m_pIndex = pIndex;
+	tJob.m_bDone = false;
+	Verify ( sphThreadCreate ( &tJob.m_tThd, RtOptimizeThread, &tJob ) );
+	sphSleepMsec ( 200 );
+	Verify ( !tJob.m_bDone );
+
+	// the reader still sees what it pinned, while the others see the new data
+	Verify ( pReader->GetDiskChunks()==2 );
+	for ( int i=0; i<2; i++ )
+	{
+		Verify ( pReader->GetDiskChunk(i)==dChunks[i] );
+		Verify ( dNames[i]==dChunks[i]->GetFilename() );
+	}
+	Verify ( pReader->GetRamSegments()==iSegments );
+	Verify ( pReader->GetRamRows()==50 );
+	Verify ( CountTestRTDocs ( pIndex )==300 );
+
+	// letting go of it lets optimize go on
+	SafeDelete ( pReader );
+	Verify ( sphThreadJoin ( &tJob.m_tThd ) );
+	Verify ( tJob.m_bDone );
+
+	CSphIndexStatus tStatus;
+	pIndex->GetStatus ( &tStatus );
+	Verify ( tStatus.m_iNumChunks==1 );
+	Verify ( CountTestRTDocs ( pIndex )==300 );
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+
+	printf ( "ok\n" );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+}
+
+static void ReadTestFile ( const char * sFile, CSphVector<BYTE> & dData )
+{
+	FILE * fp = fopen ( sFile, "rb" );
+	Verify ( fp );
+
+	BYTE dBuf[4096];
+	size_t iRead;
+	dData.Resize ( 0 );
+	while ( ( iRead = fread ( dBuf, 1, sizeof(dBuf), fp ) )>0 )
+	{
+		int iOff = dData.GetLength();
+		dData.Resize ( iOff+(int)iRead );
+		memcpy ( dData.Begin()+iOff, dBuf, iRead );
+	}
+	fclose ( fp );
+}
+
+/// saves two disk chunks and optimizes them into one, with merges and saves on the given number of threads
+/// returns the data files of the chunks it saved, then of the merged one
+static void BuildMergedTestRT ( int iThreads, CSphVector < CSphVector<BYTE> > & dFiles )
+{
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+	g_iMergeThreads = iThreads;
+
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateBinlogTestRT ( tSrcSchema );
+
+	// the second chunk replaces some docs of the first one, so that the merge has to drop them
+	for ( int i=1; i<=3000; i++ )
+	{
+		AddTestRTDoc ( pIndex, tSrcSchema, i>2000 ? i-1500 : i, i%7, i, i>2000 );
+		if ( i%100==0 )
+			pIndex->Commit ( NULL, NULL );
+		if ( i==2000 || i==3000 )
+			pIndex->ForceDiskChunk();
+	}
+
+	const char * dExts[] = { "spa", "spd", "spp", "spi", "spm", "sps", "spk" };
+	const int iExts = sizeof(dExts)/sizeof(dExts[0]);
+	char sFile[SPH_MAX_FILENAME_LEN];
+	dFiles.Reset();
+
+	// throttled, so that the threads split the budget; but with no IO rate cap, so that it takes no time
+	bool bStop = false;
+	ThrottleState_t tThrottle;
+	tThrottle.m_iMaxIOSize = 65536;
+	for ( int iPass=0; iPass<2; iPass++ )
+	{
+		if ( iPass )
+		{
+			pIndex->Optimize ( &bStop, &tThrottle );
+			Verify ( pIndex->GetDiskChunk(1)==NULL );
+		}
+
+		for ( int iChunk=0; pIndex->GetDiskChunk(iChunk); iChunk++ )
+			for ( int i=0; i<iExts; i++ )
+			{
+				snprintf ( sFile, sizeof(sFile), "%s.%s", pIndex->GetDiskChunk(iChunk)->GetFilename(), dExts[i] );
+				ReadTestFile ( sFile, dFiles.Add() );
+			}
+	}
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	DeleteBinlogFiles ();
+}
+
+void TestRTMergeThreads ()
+{
+	printf ( "testing threaded rt chunk save and merge... " );
+
+	CSphVector < CSphVector<BYTE> > dSerial, dThreaded;
+	BuildMergedTestRT ( 1, dSerial );
+	BuildMergedTestRT ( 2, dThreaded );
+	g_iMergeThreads = 1;
+
+	// two saved chunks, and the merged one, byte for byte
+	Verify ( dSerial.GetLength()==3*7 && dSerial.GetLength()==dThreaded.GetLength() );
+	ARRAY_FOREACH ( i, dSerial )
+	{
+		Verify ( dSerial[i].GetLength()==dThreaded[i].GetLength() );
+		Verify ( !dSerial[i].GetLength() || !memcmp ( dSerial[i].Begin(), dThreaded[i].Begin(), dSerial[i].GetLength() ) );
+	}
+
+	printf ( "ok\n" );
+}
+
+/// one multi-row insert of iDocs rows, and a replace of every other one of them, tokenized on up to iThreads threads
+/// returns the data files of the disk chunk the inserts get saved to
+static void BuildInsertTestRT ( int iThreads, bool bWordDict, CSphVector < CSphVector<BYTE> > & dFiles )
+{
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+
+	CSphConfigSection tRTConfig;
+	CSphString sThreads;
+	sThreads.SetSprintf ( "%d", iThreads );
+	Verify ( tRTConfig.Add ( CSphVariant ( sThreads.cstr(), 0 ), "rt_insert_threads" ) );
+	sphRTInit ( tRTConfig, true );
+	sphRTConfigure ( tRTConfig, true );
+	SmallStringHash_T<CSphIndex*> hIndexes;
+	sphReplayBinlog ( hIndexes, 0 );
+
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateTestRT ( tSrcSchema, 32*1024*1024, bWordDict );
+
+	// the words repeat across the slices, so that keywords dictionaries get slice-local ids to remap
+	const int DOCS = 1000;
+	CSphFixedVector<CSphMatch> dMatches ( DOCS );
+	CSphFixedVector<CSphString> dTitles ( DOCS );
+	CSphFixedVector<const char *> dFields ( DOCS );
+	CSphVector<DWORD> dMvas;
+	CSphVector<RtInsertDoc_t> dDocs;
+	CSphString sError, sWarning, sFilter;
+
+	for ( int iPass=0; iPass<2; iPass++ )
+	{
+		dDocs.Resize ( 0 );
+		for ( int i=iPass; i<DOCS; i+=iPass+1 )
+		{
+			dMatches[i].Reset ( tSrcSchema.GetRowSize() );
+			dMatches[i].m_uDocID = i+1;
+			dMatches[i].SetAttr ( tSrcSchema.GetAttr(0).m_tLocator, i%7 );
+			dMatches[i].SetAttr ( tSrcSchema.GetAttr(1).m_tLocator, i+iPass );
+			dTitles[i].SetSprintf ( "cat doc%d group%d word%d word%d pass%d", i, i%7, i%13, i%101, iPass );
+			dFields[i] = dTitles[i].cstr();
+
+			RtInsertDoc_t & tDoc = dDocs.Add();
+			tDoc.m_pDoc = &dMatches[i];
+			tDoc.m_ppFields = &dFields[i];
+			tDoc.m_ppStr = NULL;
+			tDoc.m_pMvas = &dMvas;
+		}
+
+		Verify ( pIndex->AddDocuments ( 1, dDocs, iPass==1, sFilter, sError, sWarning, NULL ) );
+		pIndex->Commit ( NULL, NULL );
+	}
+	Verify ( CountTestRTDocs ( pIndex )==DOCS );
+	pIndex->ForceDiskChunk();
+
+	const char * dExts[] = { "spa", "spd", "spp", "spi", "spk" };
+	char sFile[SPH_MAX_FILENAME_LEN];
+	dFiles.Reset();
+	for ( int i=0; i<(int)(sizeof(dExts)/sizeof(dExts[0])); i++ )
+	{
+		snprintf ( sFile, sizeof(sFile), "%s.%s", pIndex->GetDiskChunk(0)->GetFilename(), dExts[i] );
+		ReadTestFile ( sFile, dFiles.Add() );
+	}
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+}
+
+void TestRTParallelInsert ()
+{
+	printf ( "testing rt multi-row insert tokenized on a pool... " );
+
+	for ( int iDict=0; iDict<2; iDict++ )
+	{
+		CSphVector < CSphVector<BYTE> > dSerial, dParallel;
+		BuildInsertTestRT ( 1, iDict==1, dSerial );
+		BuildInsertTestRT ( 4, iDict==1, dParallel );
+
+		// same docs, words and hits, byte for byte
+		Verify ( dSerial.GetLength()==dParallel.GetLength() );
+		ARRAY_FOREACH ( i, dSerial )
+		{
+			Verify ( dSerial[i].GetLength()==dParallel[i].GetLength() );
+			Verify ( !dSerial[i].GetLength() || !memcmp ( dSerial[i].Begin(), dParallel[i].Begin(), dSerial[i].GetLength() ) );
+		}
+	}
+
+	printf ( "ok\n" );
+}
+
+void TestRTLateLookup ()
+{
+	printf ( "testing rt disk chunk late docinfo lookup... " );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	TestRTInit ();
+
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateTestRT ( tSrcSchema );
+
+	const int DOCS = 1000;
+	for ( int i=1; i<=DOCS; i++ )
+		AddTestRTDoc ( pIndex, tSrcSchema, i, i%7, ( i*37 )%101, false );
+	pIndex->Commit ( NULL, NULL );
+
+	// a chain of computed columns over the stored attributes, with a shared dependency
+	CSphQuery tQuery;
+	tQuery.m_sQuery = "cat";
+	tQuery.m_eMode = SPH_MATCH_EXTENDED2;
+	tQuery.m_eSort = SPH_SORT_EXTENDED;
+	tQuery.m_iMaxMatches = 50;
+	const char * dItems[][2] = { { "val*2", "a" }, { "a+gid", "b" }, { "a+b", "c" } };
+	for ( int i=0; i<(int)(sizeof(dItems)/sizeof(dItems[0])); i++ )
+	{
+		CSphQueryItem & tItem = tQuery.m_dItems.Add();
+		tItem.m_sExpr = dItems[i][0];
+		tItem.m_sAlias = dItems[i][1];
+	}
+
+	// keys over the stored attributes through the chain need the rows before sorting; weight and id ones do not
+	const char * dSorts[] = { "c desc, @id asc", "b asc, @id desc", "@weight desc, @id desc" };
+	const int SORTS = sizeof(dSorts)/sizeof(dSorts[0]);
+
+	// RAM segments always get rows at match time, disk chunks only get them when sorting needs them
+	CSphQueryResult dRam[SORTS], dDisk[SORTS];
+	for ( int i=0; i<SORTS; i++ )
+	{
+		tQuery.m_sSortBy = dSorts[i];
+		QueryTestRT ( pIndex, tQuery, 1, dRam[i], true );
+	}
+
+	pIndex->ForceDiskChunk();
+	Verify ( pIndex->GetDiskChunk(0) && !pIndex->GetDiskChunk(1) );
+
+	for ( int i=0; i<SORTS; i++ )
+	{
+		tQuery.m_sSortBy = dSorts[i];
+		QueryTestRT ( pIndex, tQuery, 1, dDisk[i], true );
+		Verify ( dRam[i].m_iTotalMatches==DOCS );
+		Verify ( dRam[i].m_dMatches.GetLength()==tQuery.m_iMaxMatches );
+		CompareTestRTResults ( dRam[i], dDisk[i] );
+	}
+
+	// the computed columns must hold the values of the looked up rows
+	const CSphRsetSchema & tSchema = dDisk[0].m_tSchema;
+	const CSphAttrLocator & tGid = tSchema.GetAttr ( tSchema.GetAttrIndex ( "gid" ) ).m_tLocator;
+	const CSphAttrLocator & tVal = tSchema.GetAttr ( tSchema.GetAttrIndex ( "val" ) ).m_tLocator;
+	const CSphAttrLocator & tC = tSchema.GetAttr ( tSchema.GetAttrIndex ( "c" ) ).m_tLocator;
+	ARRAY_FOREACH ( i, dDisk[0].m_dMatches )
+	{
+		const CSphMatch & tMatch = dDisk[0].m_dMatches[i];
+		Verify ( tMatch.GetAttr ( tVal )==(SphAttr_t)( ( tMatch.m_uDocID*37 )%101 ) );
+		Verify ( tMatch.GetAttr ( tC )==4*tMatch.GetAttr ( tVal ) + tMatch.GetAttr ( tGid ) );
+		Verify ( i==0 || dDisk[0].m_dMatches[i-1].GetAttr ( tC )>=tMatch.GetAttr ( tC ) );
+	}
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+
+	printf ( "ok\n" );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+}
+
+/// runs a query on a sorter of the caller, which might have served other queries already
+static void QueryTestRTSorter ( ISphRtIndex * pIndex, const CSphQuery & tQuery, ISphMatchSorter * pSorter, CSphQueryResult & tResult )
+{
+	CSphMultiQueryArgs tArgs ( KillListVector(), 1 );
+	Verify ( pIndex->MultiQuery ( &tQuery, &tResult, 1, &pSorter, tArgs ) );
+	tResult.m_iTotalMatches = pSorter->GetTotalCount();
+	sphFlattenQueue ( pSorter, &tResult, 0 );
+	tResult.m_tSchema = pSorter->GetSchema();
+}
+
+void TestMatchArena ()
+{
+	printf ( "testing sorter match arena reuse... " );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	TestRTInit ();
+
+	CSphSchema tSrcSchema;
+	ISphRtIndex * pIndex = CreateTestRT ( tSrcSchema );
+	for ( int i=1; i<=1000; i++ )
+		AddTestRTDoc ( pIndex, tSrcSchema, i, i%7, ( i*37 )%101, false );
+	pIndex->Commit ( NULL, NULL );
+
+	// a computed column, so that the matches have dynamic rows for the arena to hold
+	CSphQuery tQuery;
+	tQuery.m_eMode = SPH_MATCH_EXTENDED2;
+	tQuery.m_eSort = SPH_SORT_EXTENDED;
+	tQuery.m_sSortBy = "a desc, @id asc";
+	tQuery.m_iMaxMatches = 100;
+	CSphQueryItem & tItem = tQuery.m_dItems.Add();
+	tItem.m_sExpr = "val*3+gid";
+	tItem.m_sAlias = "a";
+
+	CSphString sError;
+	SphQueueSettings_t tQueueSettings ( tQuery, pIndex->GetMatchSchema(), sError, NULL );
+	ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+	Verify ( pSorter );
+
+	// full queues over different docs, a single match, and the first query again; every round on the same sorter
+	const char * dQueries[] = { "cat", "group3", "doc77", "cat" };
+	int64_t iArenaBytes = 0;
+	for ( int i=0; i<(int)(sizeof(dQueries)/sizeof(dQueries[0])); i++ )
+	{
+		tQuery.m_sQuery = dQueries[i];
+
+		CSphQueryResult tReused, tFresh;
+		QueryTestRTSorter ( pIndex, tQuery, pSorter, tReused );
+		QueryTestRT ( pIndex, tQuery, 1, tFresh, true );
+		Verify ( tReused.m_dMatches.GetLength()>0 );
+
+		// rows the previous rounds left in the slots must not leak into this one
+		CompareTestRTResults ( tFresh, tReused );
+
+		// the first round sizes the arena; later ones reuse its rows, and still report it
+		Verify ( tReused.m_iArenaBytes>0 && tFresh.m_iArenaBytes>0 );
+		if ( !i )
+			iArenaBytes = tReused.m_iArenaBytes;
+		Verify ( tReused.m_iArenaBytes==iArenaBytes );
+	}
+	SafeDelete ( pSorter );
+
+	// group sorters keep their groups in the arena too
+	tQuery.m_sQuery = "cat";
+	tQuery.m_sGroupBy = "gid";
+	tQuery.m_eGroupFunc = SPH_GROUPBY_ATTR;
+	tQuery.m_sGroupSortBy = "@groupby asc";
+
+	CSphQueryResult tGroups;
+	QueryTestRT ( pIndex, tQuery, 1, tGroups, true );
+	Verify ( tGroups.m_dMatches.GetLength()==7 );
+	Verify ( tGroups.m_iArenaBytes>0 );
+
+	SafeDelete ( pIndex );
+	sphRTDone ();
+
+	printf ( "ok\n" );
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+}
 
 //////////////////////////////////////////////////////////////////////////
 
@@ -4239,6 +6475,31 @@ int main ()
 	TestRebalance();
 	TestLevenshtein();
 	TestTDigest();
+	TestStringDict();
+	TestMvaPack();
+	TestJsonKeyTable();
+	TestJsonAttrs();
+	TestGeoIndex();
+	TestGroupSpill();
+	TestHll();
+	TestFacetSorter();
+	TestKeyQueue();
+	TestMergeDupes();
+	TestRollup();
+	TestStreamQueue();
+	TestGrouperMulti();
+	TestRTParallelChunks ();
+	TestRTDeadRows ();
+	TestRTCompactPick ();
+	TestRTGroupCommit ();
+	TestRTReplayBatches ();
+	TestRTBulkLoad ();
+	TestRTMergeUpdates ();
+	TestRTSnapshotReader ();
+	TestRTMergeThreads ();
+	TestRTParallelInsert ();
+	TestRTLateLookup ();
+	TestMatchArena ();
 
 
 	unlink ( g_sTmpfile );
@@ -192,6 +192,10 @@ namespace NEO {
 		{ "rlp_context",			0, NULL },
 		{ "ondisk_attrs",			0, NULL },
 		{ "index_token_filter",		0, NULL },
+		{ "string_attr_dict",		0, NULL },
+		{ "json_attrs",				0, NULL },
+		{ "geo_index",				0, NULL },
+		{ "rollup",					0, NULL },
 		{ NULL,						0, NULL }
 	};
 
@@ -240,12 +244,15 @@ namespace NEO {
 		{ "max_batch_queries",		0, NULL },
 		{ "subtree_docs_cache",		0, NULL },
 		{ "subtree_hits_cache",		0, NULL },
+		{ "groupby_memory",			0, NULL },
+		{ "groupby_tmpdir",			0, NULL },
 		{ "workers",				0, NULL },
 		{ "prefork",				KEY_HIDDEN, NULL },
 		{ "dist_threads",			0, NULL },
 		{ "binlog_flush",			0, NULL },
 		{ "binlog_path",			0, NULL },
 		{ "binlog_max_log_size",	0, NULL },
+		{ "binlog_replay_threads",	0, NULL },
 		{ "thread_stack",			0, NULL },
 		{ "expansion_limit",		0, NULL },
 		{ "rt_flush_period",		0, NULL },
@@ -260,6 +267,9 @@ namespace NEO {
 		{ "sphinxql_state",			0, NULL },
 		{ "rt_merge_iops",			0, NULL },
 		{ "rt_merge_maxiosize",		0, NULL },
+		{ "rt_merge_background",	0, NULL },
+		{ "rt_insert_threads",		0, NULL },
+		{ "rt_compact_interval",	0, NULL },
 		{ "ha_ping_interval",		0, NULL },
 		{ "ha_period_karma",		0, NULL },
 		{ "predicted_time_costs",	0, NULL },
@@ -298,6 +308,7 @@ namespace NEO {
 		{ "rlp_max_batch_docs",		0, NULL },
 		{ "plugin_dir",				0, NULL },
 		{ "progressive_merge",		0, NULL },
+		{ "merge_threads",			0, NULL },
 		{ NULL,						0, NULL }
 	};
 